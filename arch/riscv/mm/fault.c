@@ -238,6 +238,36 @@ asmlinkage void do_page_fault(struct pt_regs *regs)
 		flags |= FAULT_FLAG_WRITE;
 	else if (cause == EXC_INST_PAGE_FAULT)
 		flags |= FAULT_FLAG_INSTRUCTION;
+
+#ifdef CONFIG_PER_VMA_LOCK
+	if (!(flags & FAULT_FLAG_USER))
+		goto lock_mmap;
+
+	vma = lock_vma_under_rcu(mm, addr);
+	if (!vma)
+		goto lock_mmap;
+
+	if (unlikely(access_error(cause, vma))) {
+		vma_end_read(vma);
+		goto lock_mmap;
+	}
+
+	fault = handle_mm_fault(vma, addr, flags | FAULT_FLAG_VMA_LOCK, regs);
+	if (!(fault & VM_FAULT_RETRY)) {
+		vma_end_read(vma);
+		count_vm_event(VMA_LOCK_SUCCESS);
+		if (unlikely(fault & VM_FAULT_ERROR))
+			mm_fault_error(regs, addr, fault);
+		return;
+	}
+	/* the VMA lock has been released, retry under mmap_lock */
+	count_vm_event(VMA_LOCK_RETRY);
+
+	if (fault_signal_pending(fault, regs))
+		return;
+lock_mmap:
+#endif /* CONFIG_PER_VMA_LOCK */
+
 retry:
 	mmap_read_lock(mm);
 	vma = find_vma(mm, addr);
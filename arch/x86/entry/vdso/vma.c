@@ -38,6 +38,11 @@ struct vdso_data *arch_get_vdso_data(void *vvar_page)
 }
 #undef EMIT_VVAR
 
+#ifdef CONFIG_VDSO_GETRANDOM
+/* updated by random.c, see crng_vdso_reseeded() */
+DEFINE_VVAR_SINGLE(struct vdso_rng_data, _vdso_rng_data);
+#endif
+
 unsigned int vclocks_used __read_mostly;
 
 #if defined(CONFIG_X86_64)
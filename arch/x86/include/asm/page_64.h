@@ -54,6 +54,10 @@ static inline void clear_page(void *page)
 			   : "cc", "memory", "rax", "rcx");
 }
 
+/* Clear a contiguous extent of pages, avoiding the cache where possible */
+void clear_pages(void *page, unsigned int npages);
+#define clear_pages clear_pages
+
 void copy_page(void *to, void *from);
 
 #endif	/* !__ASSEMBLY__ */
@@ -1859,19 +1859,6 @@ static void dbg_restore_debug_regs(void)
 #define dbg_restore_debug_regs()
 #endif /* ! CONFIG_KGDB */
 
-static void wait_for_master_cpu(int cpu)
-{
-#ifdef CONFIG_SMP
-	/*
-	 * wait for ACK from master CPU before continuing
-	 * with AP initialization
-	 */
-	WARN_ON(cpumask_test_and_set_cpu(cpu, cpu_initialized_mask));
-	while (!cpumask_test_cpu(cpu, cpu_callout_mask))
-		cpu_relax();
-#endif
-}
-
 #ifdef CONFIG_X86_64
 static inline void setup_getcpu(int cpu)
 {
@@ -1924,6 +1911,29 @@ static inline void tss_setup_ist(struct tss_struct *tss) { }
 
 #endif /* !CONFIG_X86_64 */
 
+static void wait_for_master_cpu(int cpu)
+{
+#ifdef CONFIG_SMP
+	WARN_ON(cpumask_test_and_set_cpu(cpu, cpu_initialized_mask));
+
+	/*
+	 * The master CPU may go on starting other APs now.  Load the
+	 * microcode meanwhile, which takes a while, so that this overlaps
+	 * with the startup of the other APs.
+	 */
+	ucode_cpu_init(cpu);
+
+	/*
+	 * wait for ACK from master CPU before continuing
+	 * with AP initialization
+	 */
+	while (!cpumask_test_cpu(cpu, cpu_callout_mask))
+		cpu_relax();
+#else
+	ucode_cpu_init(cpu);
+#endif
+}
+
 static inline void tss_setup_io_bitmap(struct tss_struct *tss)
 {
 	tss->x86_tss.io_bitmap_base = IO_BITMAP_OFFSET_INVALID;
@@ -1977,8 +1987,6 @@ void cpu_init(void)
 
 	wait_for_master_cpu(cpu);
 
-	ucode_cpu_init(cpu);
-
 #ifdef CONFIG_NUMA
 	if (this_cpu_read(numa_node) == 0 &&
 	    early_cpu_to_node(cpu) != NUMA_NO_NODE)
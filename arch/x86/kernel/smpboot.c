@@ -1086,16 +1086,15 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 
 	if (!boot_error) {
 		/*
-		 * Wait 10s total for first sign of life from AP
+		 * Wait 10s total for first sign of life from AP.  Once it
+		 * has set cpu_initialized_mask it runs on its own stack and
+		 * is done with the trampoline and initial_stack/initial_gs,
+		 * so the next AP may be started.
 		 */
 		boot_error = -1;
 		timeout = jiffies + 10*HZ;
 		while (time_before(jiffies, timeout)) {
 			if (cpumask_test_cpu(cpu, cpu_initialized_mask)) {
-				/*
-				 * Tell AP to proceed with initialization
-				 */
-				cpumask_set_cpu(cpu, cpu_callout_mask);
 				boot_error = 0;
 				break;
 			}
@@ -1103,21 +1102,6 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 		}
 	}
 
-	if (!boot_error) {
-		/*
-		 * Wait till AP completes initial initialization
-		 */
-		while (!cpumask_test_cpu(cpu, cpu_callin_mask)) {
-			/*
-			 * Allow other tasks to run while we wait for the
-			 * AP to come online. This also gives a chance
-			 * for the MTRR work(triggered by the AP coming online)
-			 * to be completed in the stop machine context.
-			 */
-			schedule();
-		}
-	}
-
 	if (x86_platform.legacy.warm_reset) {
 		/*
 		 * Cleanup possible dangling ends...
@@ -1128,12 +1112,15 @@ static int do_boot_cpu(int apicid, int cpu, struct task_struct *idle,
 	return boot_error;
 }
 
-int native_cpu_up(unsigned int cpu, struct task_struct *tidle)
+/*
+ * Start the AP and wait until it has come up on its own stack.  It then
+ * loads its microcode and waits for native_cpu_up() to let it go on.
+ */
+static int native_kick_ap(unsigned int cpu, struct task_struct *tidle,
+			  int *cpu0_nmi_registered)
 {
 	int apicid = apic->cpu_present_to_apicid(cpu);
-	int cpu0_nmi_registered = 0;
-	unsigned long flags;
-	int err, ret = 0;
+	int err;
 
 	lockdep_assert_irqs_enabled();
 
@@ -1154,12 +1141,6 @@ int native_cpu_up(unsigned int cpu, struct task_struct *tidle)
 		return -ENOSYS;
 	}
 
-	/*
-	 * Save current MTRR state in case it was changed since early boot
-	 * (e.g. by the ACPI SMI) to initialize new CPUs with MTRRs in sync:
-	 */
-	mtrr_save_state();
-
 	/* x86 CPUs take themselves offline, so delayed offline is OK. */
 	err = cpu_check_up_prepare(cpu);
 	if (err && err != -EBUSY)
@@ -1172,11 +1153,86 @@ int native_cpu_up(unsigned int cpu, struct task_struct *tidle)
 	if (err)
 		return err;
 
-	err = do_boot_cpu(apicid, cpu, tidle, &cpu0_nmi_registered);
+	err = do_boot_cpu(apicid, cpu, tidle, cpu0_nmi_registered);
 	if (err) {
 		pr_err("do_boot_cpu failed(%d) to wakeup CPU#%u\n", err, cpu);
-		ret = -EIO;
-		goto unreg_nmi;
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static bool parallel_bringup __initdata = true;
+
+static int __init no_parallel_bringup(char *str)
+{
+	parallel_bringup = false;
+	return 0;
+}
+early_param("no_parallel_bringup", no_parallel_bringup);
+
+/*
+ * The APs are kicked one at a time, since they share the trampoline and
+ * initial_stack, but load their microcode concurrently.  Everything past
+ * cpu_callout_mask is serialized by native_cpu_up().
+ */
+bool __init arch_cpuhp_init_parallel_bringup(void)
+{
+	return parallel_bringup && smp_ops.cpu_up == native_cpu_up;
+}
+
+/* CPU0 is woken up by NMI, native_cpu_up() deals with that. */
+static bool native_can_kick_ap(unsigned int cpu)
+{
+	return cpu && smp_ops.cpu_up == native_cpu_up;
+}
+
+int arch_cpuhp_kick_ap_alive(unsigned int cpu, struct task_struct *tidle)
+{
+	int cpu0_nmi_registered = 0;
+
+	if (!native_can_kick_ap(cpu))
+		return 0;
+
+	return native_kick_ap(cpu, tidle, &cpu0_nmi_registered);
+}
+
+int native_cpu_up(unsigned int cpu, struct task_struct *tidle)
+{
+	int cpu0_nmi_registered = 0;
+	unsigned long flags;
+	int ret = 0;
+
+	/* Kick the AP unless the CPUHP_BP_KICK_AP state already did. */
+	if (!native_can_kick_ap(cpu) ||
+	    !cpumask_test_cpu(cpu, cpu_initialized_mask)) {
+		ret = native_kick_ap(cpu, tidle, &cpu0_nmi_registered);
+		if (ret)
+			goto unreg_nmi;
+	}
+
+	/*
+	 * Save current MTRR state in case it was changed since early boot
+	 * (e.g. by the ACPI SMI) to initialize new CPUs with MTRRs in sync:
+	 */
+	mtrr_save_state();
+
+	/*
+	 * Tell AP to proceed with initialization
+	 */
+	cpumask_set_cpu(cpu, cpu_callout_mask);
+
+	/*
+	 * Wait till AP completes initial initialization
+	 */
+	while (!cpumask_test_cpu(cpu, cpu_callin_mask)) {
+		/*
+		 * Allow other tasks to run while we wait for the
+		 * AP to come online. This also gives a chance
+		 * for the MTRR work(triggered by the AP coming online)
+		 * to be completed in the stop machine context.
+		 */
+		schedule();
 	}
 
 	/*
@@ -761,6 +761,36 @@ static int branch_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 	return 0;
 }
 
+/*
+ * Returns -ENOSYS if this insn is not a nop that branch_xol_ops can skip.
+ *
+ * Compilers put multi-byte nops (0f 1f /0, possibly with a 66 prefix) and,
+ * with -fcf-protection, endbr32/endbr64 at the entry of many functions, and
+ * USDT probes are placed on a nop too. Emulating them as "jmp .+0" avoids
+ * the single-step in the xol area and the second trap on the hot path.
+ */
+static int nop_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	static const u8 endbr64[] = { 0xf3, 0x0f, 0x1e, 0xfa };
+	static const u8 endbr32[] = { 0xf3, 0x0f, 0x1e, 0xfb };
+
+	if (insn->length == sizeof(endbr64) &&
+	    (!memcmp(auprobe->insn, endbr64, sizeof(endbr64)) ||
+	     !memcmp(auprobe->insn, endbr32, sizeof(endbr32))))
+		goto nop;
+
+	if (insn->opcode.nbytes != 2 || OPCODE1(insn) != 0x0f ||
+	    OPCODE2(insn) != 0x1f || MODRM_REG(insn) != 0)
+		return -ENOSYS;
+nop:
+	auprobe->branch.opc1 = 0x90;
+	auprobe->branch.ilen = insn->length;
+	auprobe->branch.offs = 0;
+
+	auprobe->ops = &branch_xol_ops;
+	return 0;
+}
+
 /* Returns -ENOSYS if push_xol_ops doesn't handle this insn */
 static int push_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 {
@@ -859,6 +889,10 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 	if (ret)
 		return ret;
 
+	ret = nop_setup_xol_ops(auprobe, &insn);
+	if (ret != -ENOSYS)
+		return ret;
+
 	ret = branch_setup_xol_ops(auprobe, &insn);
 	if (ret != -ENOSYS)
 		return ret;
@@ -2257,6 +2257,8 @@ static void prepare_vmcs02_early(struct vcpu_vmx *vmx, struct vmcs12 *vmcs12)
 	exec_control &= ~CPU_BASED_INTR_WINDOW_EXITING;
 	exec_control &= ~CPU_BASED_NMI_WINDOW_EXITING;
 	exec_control &= ~CPU_BASED_TPR_SHADOW;
+	/* IPI virtualization is for L1 only, vmcs02 has no PID table. */
+	exec_control &= ~CPU_BASED_ACTIVATE_TERTIARY_CONTROLS;
 	exec_control |= vmcs12->cpu_based_vm_exec_control;
 
 	vmx->nested.l1_tpr_threshold = -1;
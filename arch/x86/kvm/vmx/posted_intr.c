@@ -85,11 +85,23 @@ static bool vmx_can_use_vtd_pi(struct kvm *kvm)
 		irq_remapping_cap(IRQ_POSTING_CAP);
 }
 
+/*
+ * The default posted interrupt vector does nothing when invoked outside
+ * guest mode.  Return whether a blocked vCPU can be the target of posted
+ * interrupts, as is the case when using either IPI virtualization or VT-d
+ * PI, so that the notification vector is switched to the one that calls
+ * back to pi_wakeup_handler().
+ */
+static bool vmx_needs_pi_wakeup(struct kvm_vcpu *vcpu)
+{
+	return vmx_can_use_ipiv(vcpu) || vmx_can_use_vtd_pi(vcpu->kvm);
+}
+
 void vmx_vcpu_pi_put(struct kvm_vcpu *vcpu)
 {
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 
-	if (!vmx_can_use_vtd_pi(vcpu->kvm))
+	if (!vmx_needs_pi_wakeup(vcpu))
 		return;
 
 	/* Set SN when the vCPU is preempted */
@@ -130,7 +142,7 @@ static void __pi_post_block(struct kvm_vcpu *vcpu)
 
 /*
  * This routine does the following things for vCPU which is going
- * to be blocked if VT-d PI is enabled.
+ * to be blocked if VT-d PI or IPI virtualization is enabled.
  * - Store the vCPU to the wakeup list, so when interrupts happen
  *   we can find the right vCPU to wake up.
  * - Change the Posted-interrupt descriptor as below:
@@ -147,7 +159,7 @@ int pi_pre_block(struct kvm_vcpu *vcpu)
 	struct pi_desc old, new;
 	struct pi_desc *pi_desc = vcpu_to_pi_desc(vcpu);
 
-	if (!vmx_can_use_vtd_pi(vcpu->kvm))
+	if (!vmx_needs_pi_wakeup(vcpu))
 		return 0;
 
 	WARN_ON(irqs_disabled());
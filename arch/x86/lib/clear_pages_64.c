@@ -0,0 +1,55 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Clearing of large, physically contiguous extents such as huge pages.
+ *
+ * Zeroing a huge page through the cache evicts the working set of every
+ * other task sharing the LLC, and the page is then touched a subpage at a
+ * time anyway.  Use stores that bypass the cache instead.
+ */
+
+#include <linux/types.h>
+#include <asm/barrier.h>
+#include <asm/cpufeature.h>
+#include <asm/page.h>
+
+/*
+ * With ERMS, long "rep stosb" runs use streaming stores internally and beat
+ * an explicit loop.
+ */
+static void clear_pages_erms(void *page, unsigned long len)
+{
+	asm volatile("rep stosb"
+		     : "+D" (page), "+c" (len)
+		     : "a" (0)
+		     : "memory");
+}
+
+static void clear_pages_movnt(void *page, unsigned long len)
+{
+	unsigned long zero = 0;
+	char *p = page, *end = p + len;
+
+	for (; p < end; p += 64)
+		asm volatile("movnti %1,   (%0)\n\t"
+			     "movnti %1,  8(%0)\n\t"
+			     "movnti %1, 16(%0)\n\t"
+			     "movnti %1, 24(%0)\n\t"
+			     "movnti %1, 32(%0)\n\t"
+			     "movnti %1, 40(%0)\n\t"
+			     "movnti %1, 48(%0)\n\t"
+			     "movnti %1, 56(%0)"
+			     : : "r" (p), "r" (zero) : "memory");
+
+	/* Non-temporal stores are weakly ordered, fence them */
+	wmb();
+}
+
+void clear_pages(void *page, unsigned int npages)
+{
+	unsigned long len = (unsigned long)npages << PAGE_SHIFT;
+
+	if (static_cpu_has(X86_FEATURE_ERMS))
+		clear_pages_erms(page, len);
+	else
+		clear_pages_movnt(page, len);
+}
@@ -766,6 +766,10 @@ static void blkcg_rstat_flush(struct cgroup_subsys_state *css, int cpu)
 	struct blkcg *blkcg = css_to_blkcg(css);
 	struct blkcg_gq *blkg;
 
+	/* Root-level stats are sourced from system-wide IO stats */
+	if (!cgroup_parent(css->cgroup))
+		return;
+
 	rcu_read_lock();
 
 	hlist_for_each_entry_rcu(blkg, &blkcg->blkg_list, blkcg_node) {
@@ -805,7 +809,7 @@ static void blkcg_rstat_flush(struct cgroup_subsys_state *css, int cpu)
 /*
  * The rstat algorithms intentionally don't handle the root cgroup to avoid
  * incurring overhead when no cgroups are defined. For that reason,
- * cgroup_rstat_flush in blkcg_print_stat does not actually fill out the
+ * css_rstat_flush in blkcg_print_stat does not actually fill out the
  * iostat in the root cgroup's blkcg_gq.
  *
  * However, we would like to re-use the printing code between the root and
@@ -861,7 +865,7 @@ static int blkcg_print_stat(struct seq_file *sf, void *v)
 	if (!seq_css(sf)->parent)
 		blkcg_fill_root_iostats();
 	else
-		cgroup_rstat_flush(blkcg->css.cgroup);
+		css_rstat_flush(&blkcg->css);
 
 	rcu_read_lock();
 
@@ -1931,7 +1935,7 @@ void blk_cgroup_bio_start(struct bio *bio)
 
 	u64_stats_update_end(&bis->sync);
 	if (cgroup_subsys_on_dfl(io_cgrp_subsys))
-		cgroup_rstat_updated(bio->bi_blkg->blkcg->css.cgroup, cpu);
+		css_rstat_updated(&bio->bi_blkg->blkcg->css, cpu);
 	put_cpu();
 }
 
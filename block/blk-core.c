@@ -140,6 +140,7 @@ static const char *const blk_op_name[] = {
 	REQ_OP_NAME(ZONE_APPEND),
 	REQ_OP_NAME(WRITE_SAME),
 	REQ_OP_NAME(WRITE_ZEROES),
+	REQ_OP_NAME(COPY),
 	REQ_OP_NAME(SCSI_IN),
 	REQ_OP_NAME(SCSI_OUT),
 	REQ_OP_NAME(DRV_IN),
@@ -737,6 +738,29 @@ static inline int bio_check_eod(struct bio *bio, sector_t maxsector)
 	return 0;
 }
 
+/*
+ * The source of a copy must lie within the same device or partition as the
+ * destination, which bio_check_eod() has already checked.
+ */
+static inline int bio_check_copy_eod(struct bio *bio, sector_t maxsector)
+{
+	unsigned int nr_sectors = bio_sectors(bio);
+	char b[BDEVNAME_SIZE];
+
+	if (bio_op(bio) != REQ_OP_COPY || !maxsector)
+		return 0;
+	if (nr_sectors > maxsector ||
+	    bio->bi_copy_src > maxsector - nr_sectors) {
+		pr_info_ratelimited("attempt to copy from beyond end of device\n"
+				    "%s: src=%llu, len=%u, limit=%llu\n",
+				    bio_devname(bio, b),
+				    (unsigned long long)bio->bi_copy_src,
+				    nr_sectors, (unsigned long long)maxsector);
+		return -EIO;
+	}
+	return 0;
+}
+
 /*
  * Remap block n of partition p to block n+start(p) of the disk.
  */
@@ -755,9 +779,12 @@ static inline int blk_partition_remap(struct bio *bio)
 		goto out;
 
 	if (bio_sectors(bio)) {
-		if (bio_check_eod(bio, part_nr_sects_read(p)))
+		if (bio_check_eod(bio, part_nr_sects_read(p)) ||
+		    bio_check_copy_eod(bio, part_nr_sects_read(p)))
 			goto out;
 		bio->bi_iter.bi_sector += p->start_sect;
+		if (bio_op(bio) == REQ_OP_COPY)
+			bio->bi_copy_src += p->start_sect;
 		trace_block_bio_remap(bio->bi_disk->queue, bio, part_devt(p),
 				      bio->bi_iter.bi_sector - p->start_sect);
 	}
@@ -833,6 +860,9 @@ static noinline_for_stack bool submit_bio_checks(struct bio *bio)
 			goto end_io;
 		if (unlikely(bio_check_eod(bio, get_capacity(bio->bi_disk))))
 			goto end_io;
+		if (unlikely(bio_check_copy_eod(bio,
+						get_capacity(bio->bi_disk))))
+			goto end_io;
 	}
 
 	/*
@@ -848,8 +878,14 @@ static noinline_for_stack bool submit_bio_checks(struct bio *bio)
 		}
 	}
 
-	if (!test_bit(QUEUE_FLAG_POLL, &q->queue_flags))
+	/*
+	 * Without polling the bio completes from interrupt context, where
+	 * the per-cpu bio cache must not be used.
+	 */
+	if (!test_bit(QUEUE_FLAG_POLL, &q->queue_flags)) {
 		bio->bi_opf &= ~REQ_HIPRI;
+		bio_clear_flag(bio, BIO_PERCPU_CACHE);
+	}
 
 	switch (bio_op(bio)) {
 	case REQ_OP_DISCARD:
@@ -884,6 +920,10 @@ static noinline_for_stack bool submit_bio_checks(struct bio *bio)
 		if (!q->limits.max_write_zeroes_sectors)
 			goto not_supported;
 		break;
+	case REQ_OP_COPY:
+		if (!q->limits.max_copy_sectors)
+			goto not_supported;
+		break;
 	default:
 		break;
 	}
@@ -1685,6 +1725,20 @@ EXPORT_SYMBOL(kblockd_mod_delayed_work_on);
  *   this kind of deadlock.
  */
 void blk_start_plug(struct blk_plug *plug)
+{
+	blk_start_plug_nr_ios(plug, 1);
+}
+EXPORT_SYMBOL(blk_start_plug);
+
+/**
+ * blk_start_plug_nr_ios - start a plug for a known number of I/Os
+ * @plug:	The &struct blk_plug that needs to be initialized
+ * @nr_ios:	Number of bios the caller is about to submit
+ *
+ * Like blk_start_plug(), but lets blk-mq allocate requests and tags for up
+ * to @nr_ios bios in one go when the first of them is submitted.
+ */
+void blk_start_plug_nr_ios(struct blk_plug *plug, unsigned short nr_ios)
 {
 	struct task_struct *tsk = current;
 
@@ -1696,7 +1750,9 @@ void blk_start_plug(struct blk_plug *plug)
 
 	INIT_LIST_HEAD(&plug->mq_list);
 	INIT_LIST_HEAD(&plug->cb_list);
+	INIT_LIST_HEAD(&plug->cached_rqs);
 	plug->rq_count = 0;
+	plug->nr_ios = min_t(unsigned short, nr_ios, BLK_MAX_REQUEST_COUNT);
 	plug->multiple_queues = false;
 	plug->nowait = false;
 
@@ -1706,7 +1762,7 @@ void blk_start_plug(struct blk_plug *plug)
 	 */
 	tsk->plug = plug;
 }
-EXPORT_SYMBOL(blk_start_plug);
+EXPORT_SYMBOL(blk_start_plug_nr_ios);
 
 static void flush_plug_callbacks(struct blk_plug *plug, bool from_schedule)
 {
@@ -1756,6 +1812,13 @@ void blk_flush_plug_list(struct blk_plug *plug, bool from_schedule)
 
 	if (!list_empty(&plug->mq_list))
 		blk_mq_flush_plug_list(plug, from_schedule);
+
+	/*
+	 * A task going to sleep mustn't hold up a queue freeze with the
+	 * requests it allocated ahead.
+	 */
+	if (from_schedule && unlikely(!list_empty(&plug->cached_rqs)))
+		blk_mq_free_plug_rqs(plug);
 }
 
 /**
@@ -1773,6 +1836,8 @@ void blk_finish_plug(struct blk_plug *plug)
 	if (plug != current->plug)
 		return;
 	blk_flush_plug_list(plug, false);
+	if (unlikely(!list_empty(&plug->cached_rqs)))
+		blk_mq_free_plug_rqs(plug);
 
 	current->plug = NULL;
 }
@@ -227,6 +227,9 @@ enum {
 
 	INUSE_ADJ_STEP_PCT	= 25,
 
+	/* vtime a CPU takes from an iocg's budget at a time, see below */
+	PCPU_VBUDGET_PCT	= 1,
+
 	/* Have some play in timer operations */
 	TIMER_SLACK_PCT		= 1,
 
@@ -408,6 +411,7 @@ struct ioc {
 
 	struct ioc_params		params;
 	struct ioc_margins		margins;
+	u64				pcpu_vbudget;
 	u32				period_us;
 	u32				timer_slack_ns;
 	u64				vrate_min;
@@ -447,6 +451,12 @@ struct ioc {
 
 struct iocg_pcpu_stat {
 	local64_t			abs_vusage;
+
+	/*
+	 * vtime this CPU has already charged to the iocg's vtime but not
+	 * used yet.  IOs issued within it don't touch the shared vtime.
+	 */
+	atomic64_t			vbudget;
 };
 
 struct iocg_stat {
@@ -718,19 +728,112 @@ static u64 cost_to_abs_cost(u64 cost, u32 hw_inuse)
 	return DIV64_U64_ROUND_UP(cost * hw_inuse, WEIGHT_ONE);
 }
 
-static void iocg_commit_bio(struct ioc_gq *iocg, struct bio *bio,
-			    u64 abs_cost, u64 cost)
+/*
+ * Charge @bio to @iocg.  @vbudget is additionally charged to @iocg->vtime
+ * and left to the local CPU's budget for following IOs.
+ */
+static void __iocg_commit_bio(struct ioc_gq *iocg, struct bio *bio,
+			      u64 abs_cost, u64 cost, u64 vbudget)
 {
 	struct iocg_pcpu_stat *gcs;
 
 	bio->bi_iocost_cost = cost;
-	atomic64_add(cost, &iocg->vtime);
+	atomic64_add(cost + vbudget, &iocg->vtime);
 
 	gcs = get_cpu_ptr(iocg->pcpu_stat);
 	local64_add(abs_cost, &gcs->abs_vusage);
+	if (vbudget)
+		atomic64_add(vbudget, &gcs->vbudget);
 	put_cpu_ptr(gcs);
 }
 
+static void iocg_commit_bio(struct ioc_gq *iocg, struct bio *bio,
+			    u64 abs_cost, u64 cost)
+{
+	__iocg_commit_bio(iocg, bio, abs_cost, cost, 0);
+}
+
+/*
+ * Under heavy parallel submission, advancing @iocg->vtime for every IO
+ * makes its cacheline bounce between all the submitting CPUs.  Instead,
+ * an IO that finds enough budget takes a little more of it, which the CPU
+ * keeps to itself and charges the following IOs against without touching
+ * @iocg->vtime.  The budget is handed back as soon as it runs short and
+ * every period by ioc_timer_fn(), so that it only ever shortens the view
+ * of the iocg's budget a bit.
+ *
+ * Returns true if @bio was charged to the local budget.
+ */
+static bool iocg_commit_bio_pcpu(struct ioc_gq *iocg, struct bio *bio,
+				 u64 abs_cost, u64 cost)
+{
+	struct iocg_pcpu_stat *gcs;
+	s64 vbudget;
+	bool ret = false;
+
+	gcs = get_cpu_ptr(iocg->pcpu_stat);
+	vbudget = atomic64_read(&gcs->vbudget);
+	while (vbudget >= (s64)cost) {
+		if (atomic64_try_cmpxchg(&gcs->vbudget, &vbudget,
+					 vbudget - cost)) {
+			bio->bi_iocost_cost = cost;
+			local64_add(abs_cost, &gcs->abs_vusage);
+			ret = true;
+			break;
+		}
+	}
+
+	if (!ret && vbudget) {
+		vbudget = atomic64_xchg(&gcs->vbudget, 0);
+		atomic64_sub(vbudget, &iocg->vtime);
+	}
+	put_cpu_ptr(gcs);
+
+	return ret;
+}
+
+/*
+ * Charge @bio to @iocg if it's within the budget at @now, which is the
+ * lockless common case of issuing an IO.
+ */
+static bool iocg_try_commit_bio(struct ioc_gq *iocg, struct bio *bio,
+				u64 abs_cost, u64 cost, struct ioc_now *now)
+{
+	u64 vbudget = READ_ONCE(iocg->ioc->pcpu_vbudget);
+	u64 vtime;
+
+	if (iocg_commit_bio_pcpu(iocg, bio, abs_cost, cost))
+		return true;
+
+	vtime = atomic64_read(&iocg->vtime);
+	if (!time_before_eq64(vtime + cost, now->vnow))
+		return false;
+
+	/* take a new local budget only if there's plenty left */
+	if (!time_before_eq64(vtime + cost + vbudget, now->vnow))
+		vbudget = 0;
+
+	__iocg_commit_bio(iocg, bio, abs_cost, cost, vbudget);
+	return true;
+}
+
+/* Hand the unused per-cpu budgets of @iocg back to its vtime. */
+static void iocg_flush_pcpu_vbudget(struct ioc_gq *iocg)
+{
+	s64 unused = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct iocg_pcpu_stat *gcs = per_cpu_ptr(iocg->pcpu_stat, cpu);
+
+		if (atomic64_read(&gcs->vbudget))
+			unused += atomic64_xchg(&gcs->vbudget, 0);
+	}
+
+	if (unused)
+		atomic64_sub(unused, &iocg->vtime);
+}
+
 static void iocg_lock(struct ioc_gq *iocg, bool lock_ioc, unsigned long *flags)
 {
 	if (lock_ioc) {
@@ -763,6 +866,9 @@ static void ioc_refresh_margins(struct ioc *ioc)
 	margins->min = (period_us * MARGIN_MIN_PCT / 100) * vrate;
 	margins->low = (period_us * MARGIN_LOW_PCT / 100) * vrate;
 	margins->target = (period_us * MARGIN_TARGET_PCT / 100) * vrate;
+
+	WRITE_ONCE(ioc->pcpu_vbudget,
+		   (period_us * PCPU_VBUDGET_PCT / 100) * vrate);
 }
 
 /* latency Qos params changed, update period_us and all the dependent params */
@@ -1238,6 +1344,7 @@ static bool iocg_activate(struct ioc_gq *iocg, struct ioc_now *now)
 	 * Always start with the target budget. On deactivation, we throw away
 	 * anything above it.
 	 */
+	iocg_flush_pcpu_vbudget(iocg);
 	vtarget = now->vnow - ioc->margins.target;
 	vtime = atomic64_read(&iocg->vtime);
 
@@ -2117,6 +2224,9 @@ static void ioc_timer_fn(struct timer_list *timer)
 	 * should have woken up in the last period and expire idle iocgs.
 	 */
 	list_for_each_entry_safe(iocg, tiocg, &ioc->active_iocgs, active_list) {
+		/* reconcile vtime before looking at it */
+		iocg_flush_pcpu_vbudget(iocg);
+
 		if (!waitqueue_active(&iocg->waitq) && !iocg->abs_vdebt &&
 		    !iocg->delay && !iocg_is_idle(iocg))
 			continue;
@@ -2565,10 +2675,8 @@ static void ioc_rqos_throttle(struct rq_qos *rqos, struct bio *bio)
 	 * in a while which is fine.
 	 */
 	if (!waitqueue_active(&iocg->waitq) && !iocg->abs_vdebt &&
-	    time_before_eq64(vtime + cost, now.vnow)) {
-		iocg_commit_bio(iocg, bio, abs_cost, cost);
+	    iocg_try_commit_bio(iocg, bio, abs_cost, cost, &now))
 		return;
-	}
 
 	/*
 	 * We're over budget. This can be handled in two ways. IOs which may
@@ -2700,10 +2808,8 @@ static void ioc_rqos_merge(struct rq_qos *rqos, struct request *rq,
 	 * cost assigned.
 	 */
 	if (rq->bio && rq->bio->bi_iocost_cost &&
-	    time_before_eq64(atomic64_read(&iocg->vtime) + cost, now.vnow)) {
-		iocg_commit_bio(iocg, bio, abs_cost, cost);
+	    iocg_try_commit_bio(iocg, bio, abs_cost, cost, &now))
 		return;
-	}
 
 	/*
 	 * Otherwise, account it as debt if @iocg is online, which it should
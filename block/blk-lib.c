@@ -439,3 +439,65 @@ int blkdev_issue_zeroout(struct block_device *bdev, sector_t sector,
 	return ret;
 }
 EXPORT_SYMBOL(blkdev_issue_zeroout);
+
+/**
+ * blkdev_issue_copy - offload a copy within a block device
+ * @bdev:	blockdev to copy on
+ * @src:	first source sector
+ * @dst:	first destination sector
+ * @nr_sects:	number of sectors to copy
+ * @gfp_mask:	memory allocation flags (for bio_alloc)
+ *
+ * Description:
+ *  Ask the device to copy @nr_sects sectors from @src to @dst itself,
+ *  without moving the data through host memory.  The ranges must not
+ *  overlap.  Returns -EOPNOTSUPP if the device cannot offload copies, in
+ *  which case the caller is expected to copy the data itself.
+ */
+int blkdev_issue_copy(struct block_device *bdev, sector_t src,
+		sector_t dst, sector_t nr_sects, gfp_t gfp_mask)
+{
+	sector_t bs_mask = (bdev_logical_block_size(bdev) >> 9) - 1;
+	unsigned int max_copy_sectors;
+	struct bio *bio = NULL;
+	int ret;
+
+	if (bdev_read_only(bdev))
+		return -EPERM;
+
+	if ((src | dst | nr_sects) & bs_mask)
+		return -EINVAL;
+
+	if (src < dst + nr_sects && dst < src + nr_sects)
+		return -EINVAL;
+
+	/* Ensure that max_copy_sectors doesn't overflow bi_size */
+	max_copy_sectors = min_t(unsigned int, bdev_copy_sectors(bdev),
+				 (UINT_MAX >> 9) & ~bs_mask);
+	if (max_copy_sectors == 0)
+		return -EOPNOTSUPP;
+
+	while (nr_sects) {
+		unsigned int len = min_t(sector_t, nr_sects, max_copy_sectors);
+
+		bio = blk_next_bio(bio, 0, gfp_mask);
+		bio->bi_iter.bi_sector = dst;
+		bio->bi_copy_src = src;
+		bio_set_dev(bio, bdev);
+		bio->bi_opf = REQ_OP_COPY;
+		bio->bi_iter.bi_size = len << 9;
+
+		src += len;
+		dst += len;
+		nr_sects -= len;
+		cond_resched();
+	}
+
+	if (!bio)
+		return 0;
+
+	ret = submit_bio_wait(bio);
+	bio_put(bio);
+	return ret;
+}
+EXPORT_SYMBOL(blkdev_issue_copy);
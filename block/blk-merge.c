@@ -313,6 +313,10 @@ void __blk_queue_split(struct bio **bio, unsigned int *nr_segs)
 		split = blk_bio_write_same_split(q, *bio, &q->bio_split,
 				nr_segs);
 		break;
+	case REQ_OP_COPY:
+		/* sized to max_copy_sectors by the submitter, never split */
+		*nr_segs = 0;
+		break;
 	default:
 		/*
 		 * All drivers must accept single-segments bios that are <=
@@ -386,6 +390,7 @@ unsigned int blk_recalc_rq_segments(struct request *rq)
 		}
 		return 1;
 	case REQ_OP_WRITE_ZEROES:
+	case REQ_OP_COPY:
 		return 0;
 	case REQ_OP_WRITE_SAME:
 		return 1;
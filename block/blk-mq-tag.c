@@ -178,6 +178,86 @@ unsigned int blk_mq_get_tag(struct blk_mq_alloc_data *data)
 	return tag + tag_offset;
 }
 
+/*
+ * Grab up to @nr_tags consecutive free bits of a single word of @bt with
+ * one atomic operation.  Returns the bits that were grabbed, shifted down
+ * so that bit 0 stands for bit @offset of @bt.
+ */
+static unsigned long bt_get_batch(struct sbitmap_queue *bt, int nr_tags,
+				  unsigned int *offset)
+{
+	struct sbitmap *sb = &bt->sb;
+	unsigned int hint, depth, index, i;
+
+	if (unlikely(bt->round_robin))
+		return 0;
+
+	depth = READ_ONCE(sb->depth);
+	hint = this_cpu_read(*bt->alloc_hint);
+	if (unlikely(hint >= depth))
+		hint = 0;
+	index = SB_NR_TO_INDEX(sb, hint);
+
+	for (i = 0; i < sb->map_nr; i++) {
+		struct sbitmap_word *map = &sb->map[index];
+		unsigned long map_depth = READ_ONCE(map->depth);
+		unsigned long get_mask, val;
+		unsigned int nr;
+
+		nr = find_first_zero_bit(&map->word, map_depth);
+		if (nr + nr_tags <= map_depth) {
+			atomic_long_t *ptr = (atomic_long_t *)&map->word;
+
+			get_mask = ((1UL << nr_tags) - 1) << nr;
+			val = READ_ONCE(map->word);
+			while (!atomic_long_try_cmpxchg(ptr, &val,
+							get_mask | val))
+				;
+			get_mask = (get_mask & ~val) >> nr;
+			if (get_mask) {
+				*offset = nr + (index << sb->shift);
+				hint = *offset + nr_tags;
+				this_cpu_write(*bt->alloc_hint,
+					       hint < depth ? hint : 0);
+				return get_mask;
+			}
+		}
+
+		if (++index >= sb->map_nr)
+			index = 0;
+	}
+
+	return 0;
+}
+
+/**
+ * blk_mq_get_tags - allocate a batch of driver tags without waiting
+ * @data: allocation parameters, see blk_mq_get_tag()
+ * @nr_tags: number of tags wanted, less than BITS_PER_LONG
+ * @offset: set to the tag that bit 0 of the return value stands for
+ *
+ * Returns a mask of the tags allocated, which may be fewer than @nr_tags,
+ * or 0 if none could be had at once.  Tags that are reserved, limited by
+ * the I/O scheduler or shared with other queues are never batched.
+ */
+unsigned long blk_mq_get_tags(struct blk_mq_alloc_data *data, int nr_tags,
+			      unsigned int *offset)
+{
+	struct blk_mq_tags *tags = blk_mq_tags_from_data(data);
+	unsigned long tag_mask;
+
+	if (data->shallow_depth || data->flags & BLK_MQ_REQ_RESERVED ||
+	    data->hctx->flags & BLK_MQ_F_TAG_QUEUE_SHARED)
+		return 0;
+
+	tag_mask = bt_get_batch(tags->bitmap_tags, nr_tags, offset);
+	if (!tag_mask)
+		return 0;
+
+	*offset += tags->nr_reserved_tags;
+	return tag_mask;
+}
+
 void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 		    unsigned int tag)
 {
@@ -192,6 +272,46 @@ void blk_mq_put_tag(struct blk_mq_tags *tags, struct blk_mq_ctx *ctx,
 	}
 }
 
+/**
+ * blk_mq_put_tags - free a batch of driver tags
+ * @tags: tag map the tags belong to
+ * @tag_array: the tags, none of them reserved
+ * @nr_tags: number of entries in @tag_array
+ *
+ * Clears the bits of each word of the bitmap with a single atomic
+ * operation, which pays off when the tags were allocated together.
+ */
+void blk_mq_put_tags(struct blk_mq_tags *tags, int *tag_array, int nr_tags)
+{
+	struct sbitmap_queue *bt = tags->bitmap_tags;
+	struct sbitmap *sb = &bt->sb;
+	unsigned long *addr = NULL, mask = 0;
+	int i;
+
+	/* Order the use of the requests before freeing their tags. */
+	smp_mb__before_atomic();
+	for (i = 0; i < nr_tags; i++) {
+		const int tag = tag_array[i] - tags->nr_reserved_tags;
+		unsigned long *this_addr;
+
+		BUG_ON(tag < 0 || tag >= tags->nr_tags);
+		this_addr = &sb->map[SB_NR_TO_INDEX(sb, tag)].word;
+		if (addr && addr != this_addr) {
+			atomic_long_andnot(mask, (atomic_long_t *)addr);
+			mask = 0;
+		}
+		addr = this_addr;
+		mask |= 1UL << SB_NR_TO_BIT(sb, tag);
+	}
+	if (mask)
+		atomic_long_andnot(mask, (atomic_long_t *)addr);
+
+	/* Clear the bits before looking for waiters, as sbitmap_queue_clear() */
+	smp_mb__after_atomic();
+	for (i = 0; i < nr_tags; i++)
+		sbitmap_queue_wake_up(bt);
+}
+
 struct bt_iter_data {
 	struct blk_mq_hw_ctx *hctx;
 	busy_iter_fn *fn;
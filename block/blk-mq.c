@@ -45,6 +45,10 @@ static DEFINE_PER_CPU(struct list_head, blk_cpu_done);
 
 static void blk_mq_poll_stats_start(struct request_queue *q);
 static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb);
+static void blk_mq_poll_update_est(struct request *rq, u64 now);
+
+/* Completions blk_poll() tries to reap before it returns */
+#define BLK_MQ_POLL_BATCH	8
 
 static int blk_mq_poll_stats_bkt(const struct request *rq)
 {
@@ -343,6 +347,45 @@ static struct request *blk_mq_rq_ctx_init(struct blk_mq_alloc_data *data,
 	return rq;
 }
 
+/*
+ * Allocate the tags of data->nr_tags requests at once, return one of the
+ * requests and put the others on data->cached_rqs.
+ */
+static struct request *
+__blk_mq_alloc_requests_batch(struct blk_mq_alloc_data *data,
+			      u64 alloc_time_ns)
+{
+	unsigned int tag, tag_offset;
+	unsigned long tag_mask;
+	struct request *rq;
+	int nr;
+
+	tag_mask = blk_mq_get_tags(data, data->nr_tags, &tag_offset);
+	if (unlikely(!tag_mask))
+		return NULL;
+
+	if (unlikely(test_bit(BLK_MQ_S_INACTIVE, &data->hctx->state))) {
+		for_each_set_bit(tag, &tag_mask, BITS_PER_LONG)
+			blk_mq_put_tag(blk_mq_tags_from_data(data), data->ctx,
+				       tag + tag_offset);
+		return NULL;
+	}
+
+	/* The caller holds a queue reference for the first request only. */
+	nr = hweight_long(tag_mask);
+	percpu_ref_get_many(&data->q->q_usage_counter, nr - 1);
+	data->nr_tags -= nr;
+
+	for_each_set_bit(tag, &tag_mask, BITS_PER_LONG) {
+		rq = blk_mq_rq_ctx_init(data, tag + tag_offset, alloc_time_ns);
+		list_add_tail(&rq->queuelist, data->cached_rqs);
+	}
+
+	rq = list_first_entry(data->cached_rqs, struct request, queuelist);
+	list_del_init(&rq->queuelist);
+	return rq;
+}
+
 static struct request *__blk_mq_alloc_request(struct blk_mq_alloc_data *data)
 {
 	struct request_queue *q = data->q;
@@ -375,6 +418,15 @@ static struct request *__blk_mq_alloc_request(struct blk_mq_alloc_data *data)
 	if (!e)
 		blk_mq_tag_busy(data->hctx);
 
+	if (data->nr_tags > 1 && !e) {
+		struct request *rq;
+
+		rq = __blk_mq_alloc_requests_batch(data, alloc_time_ns);
+		if (rq)
+			return rq;
+		data->nr_tags = 1;
+	}
+
 	/*
 	 * Waiting allocations only fail because of an inactive hctx.  In that
 	 * case just retry the hctx assignment and tag allocation as CPU hotplug
@@ -501,6 +553,52 @@ static void __blk_mq_free_request(struct request *rq)
 	blk_queue_exit(q);
 }
 
+static void blk_mq_put_plug_tags(struct blk_mq_hw_ctx *hctx, int *tag_array,
+				 int nr_tags)
+{
+	struct request_queue *q = hctx->queue;
+
+	blk_mq_put_tags(hctx->tags, tag_array, nr_tags);
+	blk_mq_sched_restart(hctx);
+	percpu_ref_put_many(&q->q_usage_counter, nr_tags);
+}
+
+/*
+ * Free the requests allocated ahead for a plug that were not used.  The
+ * tags of requests allocated together are freed together.
+ */
+void blk_mq_free_plug_rqs(struct blk_plug *plug)
+{
+	struct blk_mq_hw_ctx *hctx = NULL;
+	int tag_array[BLK_MAX_REQUEST_COUNT];
+	int nr_tags = 0;
+	struct request *rq;
+
+	while (!list_empty(&plug->cached_rqs)) {
+		rq = list_first_entry(&plug->cached_rqs, struct request,
+				      queuelist);
+		list_del_init(&rq->queuelist);
+
+		if (hctx != rq->mq_hctx || nr_tags == ARRAY_SIZE(tag_array)) {
+			if (nr_tags)
+				blk_mq_put_plug_tags(hctx, tag_array, nr_tags);
+			hctx = rq->mq_hctx;
+			nr_tags = 0;
+		}
+
+		/* Never issued, so there is no I/O scheduler or QoS state. */
+		rq->mq_ctx->rq_completed[rq_is_sync(rq)]++;
+		blk_crypto_free_request(rq);
+		blk_pm_mark_last_busy(rq);
+		WARN_ON_ONCE(!refcount_dec_and_test(&rq->ref));
+		rq->mq_hctx = NULL;
+		tag_array[nr_tags++] = rq->tag;
+	}
+
+	if (nr_tags)
+		blk_mq_put_plug_tags(hctx, tag_array, nr_tags);
+}
+
 void blk_mq_free_request(struct request *rq)
 {
 	struct request_queue *q = rq->q;
@@ -542,6 +640,8 @@ inline void __blk_mq_end_request(struct request *rq, blk_status_t error)
 	if (rq->rq_flags & RQF_STATS) {
 		blk_mq_poll_stats_start(rq->q);
 		blk_stat_add(rq, now);
+		if (rq->cmd_flags & REQ_HIPRI)
+			blk_mq_poll_update_est(rq, now);
 	}
 
 	blk_mq_sched_completed_request(rq, now);
@@ -2126,6 +2226,32 @@ static inline unsigned short blk_plug_max_rq_count(struct blk_plug *plug)
 	return BLK_MAX_REQUEST_COUNT;
 }
 
+/*
+ * Take the next request allocated ahead for @plug, if it fits @bio.  The
+ * request holds a queue reference of its own.
+ */
+static struct request *blk_mq_get_cached_request(struct request_queue *q,
+						 struct blk_plug *plug,
+						 struct bio *bio)
+{
+	struct request *rq;
+
+	if (list_empty(&plug->cached_rqs))
+		return NULL;
+
+	rq = list_first_entry(&plug->cached_rqs, struct request, queuelist);
+	if (rq->q != q || op_is_flush(bio->bi_opf) ||
+	    blk_mq_map_queue(q, bio->bi_opf, rq->mq_ctx) != rq->mq_hctx)
+		return NULL;
+
+	list_del_init(&rq->queuelist);
+	rq->cmd_flags = bio->bi_opf;
+	if (blk_mq_need_time_stamp(rq))
+		rq->start_time_ns = ktime_get_ns();
+	blk_queue_exit(q);
+	return rq;
+}
+
 /**
  * blk_mq_submit_bio - Create and send a request to block device.
  * @bio: Bio pointer.
@@ -2171,13 +2297,25 @@ blk_qc_t blk_mq_submit_bio(struct bio *bio)
 
 	rq_qos_throttle(q, bio);
 
-	data.cmd_flags = bio->bi_opf;
-	rq = __blk_mq_alloc_request(&data);
-	if (unlikely(!rq)) {
-		rq_qos_cleanup(q, bio);
-		if (bio->bi_opf & REQ_NOWAIT)
-			bio_wouldblock_error(bio);
-		goto queue_exit;
+	plug = blk_mq_plug(q, bio);
+	rq = plug ? blk_mq_get_cached_request(q, plug, bio) : NULL;
+	if (rq) {
+		data.ctx = rq->mq_ctx;
+		data.hctx = rq->mq_hctx;
+	} else {
+		data.cmd_flags = bio->bi_opf;
+		if (plug && !is_flush_fua) {
+			data.nr_tags = plug->nr_ios;
+			data.cached_rqs = &plug->cached_rqs;
+			plug->nr_ios = 1;
+		}
+		rq = __blk_mq_alloc_request(&data);
+		if (unlikely(!rq)) {
+			rq_qos_cleanup(q, bio);
+			if (bio->bi_opf & REQ_NOWAIT)
+				bio_wouldblock_error(bio);
+			goto queue_exit;
+		}
 	}
 
 	trace_block_getrq(q, bio, bio->bi_opf);
@@ -2196,7 +2334,6 @@ blk_qc_t blk_mq_submit_bio(struct bio *bio)
 		return BLK_QC_T_NONE;
 	}
 
-	plug = blk_mq_plug(q, bio);
 	if (unlikely(is_flush_fua)) {
 		/* Bypass scheduler for flush requests */
 		blk_insert_flush(rq);
@@ -3792,10 +3929,47 @@ static void blk_mq_poll_stats_fn(struct blk_stat_callback *cb)
 	}
 }
 
+/*
+ * Fold the completion time of a polled request into the estimate of its
+ * hardware queue: the mean moves by 1/8 and the mean deviation by 1/4 of
+ * the difference.  Concurrent completions may lose an update, which the
+ * averages absorb.
+ */
+static void blk_mq_poll_update_est(struct request *rq, u64 now)
+{
+	struct blk_mq_poll_est *est;
+	s64 value, mean, diff;
+	int bucket;
+
+	bucket = blk_mq_poll_stats_bkt(rq);
+	if (bucket < 0 || now <= rq->io_start_time_ns)
+		return;
+
+	est = &rq->mq_hctx->poll_est[bucket];
+	value = min_t(u64, now - rq->io_start_time_ns, U32_MAX);
+	mean = READ_ONCE(est->mean);
+	if (!mean) {
+		WRITE_ONCE(est->mean, value);
+		WRITE_ONCE(est->dev, value / 2);
+		return;
+	}
+
+	diff = value - mean;
+	WRITE_ONCE(est->mean, mean + diff / 8);
+	WRITE_ONCE(est->dev, READ_ONCE(est->dev) +
+		   (abs(diff) - (s64)READ_ONCE(est->dev)) / 4);
+}
+
+/*
+ * Returns the time to sleep before polling for @rq, and how much earlier
+ * than that the sleep may end in @slack.
+ */
 static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
-				       struct request *rq)
+				       struct request *rq, u64 *slack)
 {
+	struct blk_mq_poll_est *est;
 	unsigned long ret = 0;
+	u32 mean, dev;
 	int bucket;
 
 	/*
@@ -3805,19 +3979,32 @@ static unsigned long blk_mq_poll_nsecs(struct request_queue *q,
 	if (!blk_poll_stats_enable(q))
 		return 0;
 
-	/*
-	 * As an optimistic guess, use half of the mean service time
-	 * for this type of request. We can (and should) make this smarter.
-	 * For instance, if the completion latencies are tight, we can
-	 * get closer than just half the mean. This is especially
-	 * important on devices where the completion latencies are longer
-	 * than ~10 usec. We do use the stats for the relevant IO size
-	 * if available which does lead to better estimates.
-	 */
 	bucket = blk_mq_poll_stats_bkt(rq);
 	if (bucket < 0)
 		return ret;
 
+	/*
+	 * Requests of one size on one hardware queue, which usually maps
+	 * to one namespace or device queue, complete in much the same time.
+	 * Wake up two mean deviations ahead of their mean completion time,
+	 * which leaves little spinning when the latencies are tight and
+	 * backs off when they are not.  The earlier half of that margin can
+	 * be given up to hrtimer slack.
+	 */
+	est = &rq->mq_hctx->poll_est[bucket];
+	mean = READ_ONCE(est->mean);
+	dev = READ_ONCE(est->dev);
+	if (mean) {
+		if (mean <= 2 * dev)
+			return 0;
+		*slack = dev;
+		return mean - dev;
+	}
+
+	/*
+	 * No estimate for this hardware queue yet, fall back to half of
+	 * the mean service time of the whole queue.
+	 */
 	if (q->poll_stat[bucket].nr_samples)
 		ret = (q->poll_stat[bucket].mean + 1) / 2;
 
@@ -3830,6 +4017,7 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 	struct hrtimer_sleeper hs;
 	enum hrtimer_mode mode;
 	unsigned int nsecs;
+	u64 slack = 0;
 	ktime_t kt;
 
 	if (rq->rq_flags & RQF_MQ_POLL_SLEPT)
@@ -3838,28 +4026,26 @@ static bool blk_mq_poll_hybrid_sleep(struct request_queue *q,
 	/*
 	 * If we get here, hybrid polling is enabled. Hence poll_nsec can be:
 	 *
-	 *  0:	use half of prev avg
+	 *  0:	use the completion time estimate
 	 * >0:	use this specific value
 	 */
 	if (q->poll_nsec > 0)
 		nsecs = q->poll_nsec;
 	else
-		nsecs = blk_mq_poll_nsecs(q, rq);
+		nsecs = blk_mq_poll_nsecs(q, rq, &slack);
 
 	if (!nsecs)
 		return false;
 
 	rq->rq_flags |= RQF_MQ_POLL_SLEPT;
 
-	/*
-	 * This will be replaced with the stats tracking code, using
-	 * 'avg_completion_time / 2' as the pre-sleep target.
-	 */
-	kt = nsecs;
+	/* Let the timer fire anywhere in [nsecs - slack, nsecs]. */
+	slack = min_t(u64, slack, nsecs / 2);
+	kt = nsecs - slack;
 
 	mode = HRTIMER_MODE_REL;
 	hrtimer_init_sleeper_on_stack(&hs, CLOCK_MONOTONIC, mode);
-	hrtimer_set_expires(&hs.timer, kt);
+	hrtimer_set_expires_range_ns(&hs.timer, kt, slack);
 
 	do {
 		if (blk_mq_rq_state(rq) == MQ_RQ_COMPLETE)
@@ -3917,6 +4103,7 @@ static bool blk_mq_poll_hybrid(struct request_queue *q,
 int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 {
 	struct blk_mq_hw_ctx *hctx;
+	int found = 0;
 	long state;
 
 	if (!blk_qc_t_valid(cookie) ||
@@ -3949,8 +4136,18 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 		ret = q->mq_ops->poll(hctx);
 		if (ret > 0) {
 			hctx->poll_success++;
+			found += ret;
+			/*
+			 * Completions tend to come in bursts, reap the ones
+			 * that arrived meanwhile before returning.
+			 */
+			if (found < BLK_MQ_POLL_BATCH && !need_resched())
+				continue;
+		}
+
+		if (found) {
 			__set_current_state(TASK_RUNNING);
-			return ret;
+			return found;
 		}
 
 		if (signal_pending_state(state, current))
@@ -3964,7 +4161,8 @@ int blk_poll(struct request_queue *q, blk_qc_t cookie, bool spin)
 	} while (!need_resched());
 
 	__set_current_state(TASK_RUNNING);
-	return 0;
+	/* A resched may end the loop right after reaping a batch */
+	return found;
 }
 EXPORT_SYMBOL_GPL(blk_poll);
 
@@ -49,6 +49,7 @@ void blk_set_default_limits(struct queue_limits *lim)
 	lim->max_write_same_sectors = 0;
 	lim->max_write_zeroes_sectors = 0;
 	lim->max_zone_append_sectors = 0;
+	lim->max_copy_sectors = 0;
 	lim->max_discard_sectors = 0;
 	lim->max_hw_discard_sectors = 0;
 	lim->discard_granularity = 0;
@@ -208,6 +209,22 @@ void blk_queue_max_write_same_sectors(struct request_queue *q,
 }
 EXPORT_SYMBOL(blk_queue_max_write_same_sectors);
 
+/**
+ * blk_queue_max_copy_sectors - set max sectors for a single copy offload
+ * @q:  the request queue for the device
+ * @max_copy_sectors: maximum number of sectors to copy per command
+ *
+ * Description:
+ *    A non-zero value advertises REQ_OP_COPY support.  Stacking drivers
+ *    never inherit it, as they would also have to remap the copy source.
+ **/
+void blk_queue_max_copy_sectors(struct request_queue *q,
+		unsigned int max_copy_sectors)
+{
+	q->limits.max_copy_sectors = max_copy_sectors;
+}
+EXPORT_SYMBOL(blk_queue_max_copy_sectors);
+
 /**
  * blk_queue_max_write_zeroes_sectors - set max sectors for a single
  *                                      write zeroes
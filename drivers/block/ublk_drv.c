@@ -0,0 +1,1322 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Userspace block device - block device which IO is handled from userspace
+ *
+ * Take full use of io_uring passthrough command for communicating with
+ * ublk userspace daemon(ublksrvd) for handling basic IO request.
+ *
+ * Each hardware queue is served by one daemon task.  The daemon queues one
+ * UBLK_IO_FETCH_REQ command per tag, and the driver completes it once a
+ * request with that tag is queued.  The request itself is described in an
+ * io descriptor buffer the daemon mmaps, one per queue.  The result goes
+ * back with UBLK_IO_COMMIT_AND_FETCH_REQ, which also re-arms the tag, so a
+ * request costs the daemon a single command, and all the commands of one
+ * io_uring_enter() are batched.
+ *
+ * Request data is copied between the bio pages and the daemon's buffer by
+ * the daemon task itself, from io_uring task work.
+ */
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/fs.h>
+#include <linux/file.h>
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/idr.h>
+#include <linux/init.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/uio.h>
+#include <linux/uaccess.h>
+#include <linux/mutex.h>
+#include <linux/errno.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
+#include <linux/miscdevice.h>
+#include <linux/blkdev.h>
+#include <linux/blk-mq.h>
+#include <linux/io_uring.h>
+#include <uapi/linux/ublk_cmd.h>
+
+#define UBLK_MINORS		(1U << MINORBITS)
+
+/* the daemon of each queue is checked for having exited this often */
+#define UBLK_DAEMON_MONITOR_PERIOD	(5 * HZ)
+
+struct ublk_uring_cmd_pdu {
+	struct request *req;
+};
+
+/*
+ * io command is active: sqe cmd is received, and its cqe isn't done
+ *
+ * If the flag is set, the io command is owned by ublk driver, and waited
+ * for incoming blk-mq request from the ublk block device.
+ *
+ * If the flag is cleared, the io command will be completed, and owned by
+ * ublk server.
+ */
+#define UBLK_IO_FLAG_ACTIVE	0
+
+/*
+ * The request with this tag is being handled by the ublk server, and is
+ * going to be committed by UBLK_IO_COMMIT_AND_FETCH_REQ.
+ */
+#define UBLK_IO_FLAG_OWNED_BY_SRV	1
+
+/*
+ * IO command is aborted, so this flag is set in case of
+ * !UBLK_IO_FLAG_ACTIVE.
+ *
+ * After this flag is observed, any pending or new incoming request
+ * associated with this io command will be failed immediately
+ */
+#define UBLK_IO_FLAG_ABORTED	2
+
+struct ublk_io {
+	/* userspace buffer address from io cmd */
+	__u64	addr;
+	unsigned long flags;
+
+	struct io_uring_cmd *cmd;
+};
+
+struct ublk_queue {
+	int q_id;
+	int q_depth;
+
+	struct task_struct	*ubq_daemon;
+	char *io_cmd_buf;
+
+	unsigned short nr_io_ready;	/* how many ios setup */
+	struct ublk_device *dev;
+	struct ublk_io ios[];
+};
+
+struct ublk_device {
+	struct gendisk		*ub_disk;
+	struct request_queue	*ub_queue;
+
+	char	*__queues;
+
+	unsigned short  queue_size;
+	unsigned short  bs_shift;
+	struct ublksrv_ctrl_dev_info	dev_info;
+
+	struct blk_mq_tag_set	tag_set;
+
+	struct cdev		cdev;
+	struct device		cdev_dev;
+
+#define UB_STATE_OPEN		0
+	unsigned long		state;
+	int			ub_number;
+
+	struct mutex		mutex;
+
+	struct completion	completion;
+	unsigned int		nr_queues_ready;
+
+	/*
+	 * Our ubq->daemon may be killed without any notification, so
+	 * monitor each queue's daemon periodically
+	 */
+	struct delayed_work	monitor_work;
+	struct work_struct	stop_work;
+};
+
+static dev_t ublk_chr_devt;
+static struct class *ublk_chr_class;
+static int ublk_major;
+
+static DEFINE_IDR(ublk_index_idr);
+static DEFINE_SPINLOCK(ublk_idr_lock);
+static wait_queue_head_t ublk_idr_wq;	/* wait until one idr is freed */
+
+static DEFINE_MUTEX(ublk_ctl_mutex);
+
+static struct miscdevice ublk_misc;
+
+static const struct block_device_operations ub_fops = {
+	.owner =	THIS_MODULE,
+};
+
+static inline struct ublk_uring_cmd_pdu *ublk_get_uring_cmd_pdu(
+		struct io_uring_cmd *ioucmd)
+{
+	return (struct ublk_uring_cmd_pdu *)&ioucmd->pdu;
+}
+
+static inline struct ublksrv_io_desc *ublk_get_iod(struct ublk_queue *ubq,
+		int tag)
+{
+	return (struct ublksrv_io_desc *)
+		&(ubq->io_cmd_buf[tag * sizeof(struct ublksrv_io_desc)]);
+}
+
+static inline struct ublk_queue *ublk_get_queue(struct ublk_device *dev,
+		int qid)
+{
+	return (struct ublk_queue *)&(dev->__queues[qid * dev->queue_size]);
+}
+
+static inline char *ublk_queue_cmd_buf(struct ublk_device *ub, int q_id)
+{
+	return ublk_get_queue(ub, q_id)->io_cmd_buf;
+}
+
+static inline int ublk_queue_cmd_buf_size(struct ublk_device *ub, int q_id)
+{
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+
+	return round_up(ubq->q_depth * sizeof(struct ublksrv_io_desc),
+			PAGE_SIZE);
+}
+
+static inline bool ublk_queue_ready(struct ublk_queue *ubq)
+{
+	return ubq->nr_io_ready == ubq->q_depth;
+}
+
+static inline bool ubq_daemon_is_dying(struct ublk_queue *ubq)
+{
+	return ubq->ubq_daemon->flags & PF_EXITING;
+}
+
+/*
+ * Copy the data of @req between its bio pages and the daemon's buffer at
+ * @addr, at most @len bytes.  Must be called from the daemon task.
+ * Returns the number of bytes copied.
+ */
+static size_t ublk_copy_user_pages(struct request *req, __u64 addr,
+		size_t len, bool to_user)
+{
+	struct req_iterator rq_iter;
+	struct bio_vec bv;
+	struct iov_iter iter;
+	struct iovec iov;
+	size_t done = 0;
+
+	if (import_single_range(to_user ? READ : WRITE,
+				u64_to_user_ptr(addr), len, &iov, &iter))
+		return 0;
+
+	rq_for_each_segment(bv, req, rq_iter) {
+		size_t bytes = min_t(size_t, bv.bv_len, len - done);
+		size_t copied;
+
+		if (to_user)
+			copied = copy_page_to_iter(bv.bv_page, bv.bv_offset,
+						   bytes, &iter);
+		else
+			copied = copy_page_from_iter(bv.bv_page, bv.bv_offset,
+						     bytes, &iter);
+		done += copied;
+		if (copied != bytes || done == len)
+			break;
+	}
+
+	return done;
+}
+
+static inline unsigned int ublk_req_build_flags(struct request *req)
+{
+	unsigned int flags = 0;
+
+	if (req->cmd_flags & REQ_FAILFAST_DEV)
+		flags |= UBLK_IO_F_FAILFAST_DEV;
+
+	if (req->cmd_flags & REQ_FAILFAST_TRANSPORT)
+		flags |= UBLK_IO_F_FAILFAST_TRANSPORT;
+
+	if (req->cmd_flags & REQ_FAILFAST_DRIVER)
+		flags |= UBLK_IO_F_FAILFAST_DRIVER;
+
+	if (req->cmd_flags & REQ_META)
+		flags |= UBLK_IO_F_META;
+
+	if (req->cmd_flags & REQ_FUA)
+		flags |= UBLK_IO_F_FUA;
+
+	if (req->cmd_flags & REQ_NOUNMAP)
+		flags |= UBLK_IO_F_NOUNMAP;
+
+	return flags;
+}
+
+static blk_status_t ublk_setup_iod(struct ublk_queue *ubq, struct request *req)
+{
+	struct ublksrv_io_desc *iod = ublk_get_iod(ubq, req->tag);
+	struct ublk_io *io = &ubq->ios[req->tag];
+	u32 ublk_op;
+
+	switch (req_op(req)) {
+	case REQ_OP_READ:
+		ublk_op = UBLK_IO_OP_READ;
+		break;
+	case REQ_OP_WRITE:
+		ublk_op = UBLK_IO_OP_WRITE;
+		break;
+	case REQ_OP_FLUSH:
+		ublk_op = UBLK_IO_OP_FLUSH;
+		break;
+	case REQ_OP_DISCARD:
+		ublk_op = UBLK_IO_OP_DISCARD;
+		break;
+	case REQ_OP_WRITE_ZEROES:
+		ublk_op = UBLK_IO_OP_WRITE_ZEROES;
+		break;
+	default:
+		return BLK_STS_IOERR;
+	}
+
+	/* need to translate since kernel may change */
+	iod->op_flags = ublk_op | ublk_req_build_flags(req);
+	iod->nr_sectors = blk_rq_sectors(req);
+	iod->start_sector = blk_rq_pos(req);
+	iod->addr = io->addr;
+
+	return BLK_STS_OK;
+}
+
+static void ublk_complete_rq(struct request *req, struct ublk_io *io, int res)
+{
+	unsigned int bytes;
+
+	/* failed read IO if nothing is read */
+	if (!res && req_op(req) == REQ_OP_READ)
+		res = -EIO;
+
+	if (res < 0) {
+		blk_mq_end_request(req, errno_to_blk_status(res));
+		return;
+	}
+
+	if (req_op(req) != REQ_OP_READ) {
+		blk_mq_end_request(req, BLK_STS_OK);
+		return;
+	}
+
+	bytes = min_t(unsigned int, res, blk_rq_bytes(req));
+	bytes = ublk_copy_user_pages(req, io->addr, bytes, false);
+	if (!bytes) {
+		blk_mq_end_request(req, BLK_STS_IOERR);
+		return;
+	}
+
+	/* the rest of a short read is sent to the daemon again */
+	if (blk_update_request(req, BLK_STS_OK, bytes))
+		blk_mq_requeue_request(req, true);
+	else
+		__blk_mq_end_request(req, BLK_STS_OK);
+}
+
+/*
+ * Fail @req, which the daemon won't handle anymore.  The request may be
+ * seen by the monitor work and by the task work, only fail it once.
+ */
+static void __ublk_fail_req(struct ublk_io *io, struct request *req)
+{
+	WARN_ON_ONCE(test_bit(UBLK_IO_FLAG_ACTIVE, &io->flags) &&
+		     test_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags));
+
+	if (!test_and_set_bit(UBLK_IO_FLAG_ABORTED, &io->flags))
+		blk_mq_end_request(req, BLK_STS_IOERR);
+}
+
+static void ublk_rq_task_work_cb(struct io_uring_cmd *cmd)
+{
+	struct ublk_uring_cmd_pdu *pdu = ublk_get_uring_cmd_pdu(cmd);
+	struct request *req = pdu->req;
+	struct ublk_queue *ubq = req->mq_hctx->driver_data;
+	struct ublk_io *io = &ubq->ios[req->tag];
+
+	/*
+	 * Task is exiting if either:
+	 *
+	 * (1) current != ubq_daemon.
+	 * io_uring_cmd_complete_in_task() tries to run task_work
+	 * in a workqueue if ubq_daemon(cmd's task) is PF_EXITING.
+	 *
+	 * (2) current->flags & PF_EXITING.
+	 */
+	if (unlikely(current != ubq->ubq_daemon ||
+		     current->flags & PF_EXITING)) {
+		__ublk_fail_req(io, req);
+		if (test_and_clear_bit(UBLK_IO_FLAG_ACTIVE, &io->flags))
+			io_uring_cmd_done(cmd, UBLK_IO_RES_ABORT, 0);
+		return;
+	}
+
+	/* hand the data of a write over to the daemon */
+	if (req_op(req) == REQ_OP_WRITE &&
+	    ublk_copy_user_pages(req, io->addr, blk_rq_bytes(req), true) !=
+	    blk_rq_bytes(req)) {
+		/* the tag stays with the driver for the next request */
+		blk_mq_end_request(req, BLK_STS_IOERR);
+		return;
+	}
+
+	set_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags);
+	if (test_and_clear_bit(UBLK_IO_FLAG_ACTIVE, &io->flags))
+		io_uring_cmd_done(cmd, UBLK_IO_RES_OK, 0);
+}
+
+static blk_status_t ublk_queue_rq(struct blk_mq_hw_ctx *hctx,
+		const struct blk_mq_queue_data *bd)
+{
+	struct ublk_queue *ubq = hctx->driver_data;
+	struct request *rq = bd->rq;
+	struct ublk_io *io = &ubq->ios[rq->tag];
+	struct ublk_uring_cmd_pdu *pdu;
+	blk_status_t res;
+
+	/* fill iod to slot in io cmd buffer */
+	res = ublk_setup_iod(ubq, rq);
+	if (unlikely(res != BLK_STS_OK))
+		return BLK_STS_IOERR;
+
+	if (unlikely(ubq_daemon_is_dying(ubq)))
+		return BLK_STS_IOERR;
+
+	blk_mq_start_request(rq);
+
+	/* the daemon picks up the request the next time it runs task work */
+	pdu = ublk_get_uring_cmd_pdu(io->cmd);
+	pdu->req = rq;
+	io_uring_cmd_complete_in_task(io->cmd, ublk_rq_task_work_cb);
+
+	return BLK_STS_OK;
+}
+
+static int ublk_init_hctx(struct blk_mq_hw_ctx *hctx, void *driver_data,
+		unsigned int hctx_idx)
+{
+	struct ublk_device *ub = hctx->queue->queuedata;
+	struct ublk_queue *ubq = ublk_get_queue(ub, hctx->queue_num);
+
+	hctx->driver_data = ubq;
+	return 0;
+}
+
+static const struct blk_mq_ops ublk_mq_ops = {
+	.queue_rq       = ublk_queue_rq,
+	.init_hctx	= ublk_init_hctx,
+};
+
+static int ublk_ch_open(struct inode *inode, struct file *filp)
+{
+	struct ublk_device *ub = container_of(inode->i_cdev,
+			struct ublk_device, cdev);
+
+	if (test_and_set_bit(UB_STATE_OPEN, &ub->state))
+		return -EBUSY;
+	filp->private_data = ub;
+	return 0;
+}
+
+static int ublk_ch_release(struct inode *inode, struct file *filp)
+{
+	struct ublk_device *ub = filp->private_data;
+
+	clear_bit(UB_STATE_OPEN, &ub->state);
+	return 0;
+}
+
+/* map pre-allocated per-queue cmd buffer to ublksrv daemon */
+static int ublk_ch_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ublk_device *ub = filp->private_data;
+	size_t sz = vma->vm_end - vma->vm_start;
+	unsigned int max_sz = UBLK_MAX_QUEUE_DEPTH * sizeof(struct ublksrv_io_desc);
+	unsigned long pfn, end, phys_off = vma->vm_pgoff << PAGE_SHIFT;
+	int q_id;
+
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	/* the descriptors are read-only, keep mprotect() from changing that */
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	end = UBLKSRV_CMD_BUF_OFFSET + ub->dev_info.nr_hw_queues * max_sz;
+	if (phys_off < UBLKSRV_CMD_BUF_OFFSET || phys_off >= end)
+		return -EINVAL;
+
+	q_id = (phys_off - UBLKSRV_CMD_BUF_OFFSET) / max_sz;
+	if (phys_off != UBLKSRV_CMD_BUF_OFFSET + q_id * max_sz)
+		return -EINVAL;
+	if (sz != ublk_queue_cmd_buf_size(ub, q_id))
+		return -EINVAL;
+
+	pfn = virt_to_phys(ublk_queue_cmd_buf(ub, q_id)) >> PAGE_SHIFT;
+	return remap_pfn_range(vma, vma->vm_start, pfn, sz, vma->vm_page_prot);
+}
+
+static void ublk_commit_completion(struct ublk_device *ub,
+		struct ublksrv_io_cmd *ub_cmd)
+{
+	u32 qid = ub_cmd->q_id, tag = ub_cmd->tag;
+	struct ublk_queue *ubq = ublk_get_queue(ub, qid);
+	struct ublk_io *io = &ubq->ios[tag];
+	struct request *req;
+
+	/* now this cmd slot is owned by ublk driver */
+	clear_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags);
+
+	req = blk_mq_tag_to_rq(ub->tag_set.tags[qid], tag);
+	if (req && likely(!blk_should_fake_timeout(req->q)))
+		ublk_complete_rq(req, io, ub_cmd->result);
+}
+
+/*
+ * When ->ubq_daemon is exiting, either new request is ended immediately,
+ * or any queued io command is drained, so it is safe to abort queue
+ * lockless
+ */
+static void ublk_abort_queue(struct ublk_device *ub, struct ublk_queue *ubq)
+{
+	int i;
+
+	if (!ubq->ubq_daemon)
+		return;
+
+	for (i = 0; i < ubq->q_depth; i++) {
+		struct ublk_io *io = &ubq->ios[i];
+
+		if (test_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags)) {
+			struct request *rq;
+
+			/*
+			 * Either we fail the request or ublk_rq_task_work_cb
+			 * will do it
+			 */
+			rq = blk_mq_tag_to_rq(ub->tag_set.tags[ubq->q_id], i);
+			if (rq && blk_mq_request_started(rq))
+				__ublk_fail_req(io, rq);
+		}
+	}
+}
+
+static void ublk_daemon_monitor_work(struct work_struct *work)
+{
+	struct ublk_device *ub =
+		container_of(work, struct ublk_device, monitor_work.work);
+	int i;
+
+	for (i = 0; i < ub->dev_info.nr_hw_queues; i++) {
+		struct ublk_queue *ubq = ublk_get_queue(ub, i);
+
+		if (ubq_daemon_is_dying(ubq)) {
+			schedule_work(&ub->stop_work);
+
+			/* abort queue is for making forward progress */
+			ublk_abort_queue(ub, ubq);
+		}
+	}
+
+	/*
+	 * We can't schedule monitor work after ublk_remove() is started.
+	 *
+	 * No need ub->mutex, monitor work are canceled after state is marked
+	 * as DEAD, so DEAD state is observed reliably.
+	 */
+	if (ub->dev_info.state != UBLK_S_DEV_DEAD)
+		schedule_delayed_work(&ub->monitor_work,
+				      UBLK_DAEMON_MONITOR_PERIOD);
+}
+
+/* complete the fetch commands the daemon is waiting on */
+static void ublk_cancel_queue(struct ublk_queue *ubq)
+{
+	int i;
+
+	if (!ubq->ubq_daemon)
+		return;
+
+	for (i = 0; i < ubq->q_depth; i++) {
+		struct ublk_io *io = &ubq->ios[i];
+
+		if (test_and_clear_bit(UBLK_IO_FLAG_ACTIVE, &io->flags))
+			io_uring_cmd_done(io->cmd, UBLK_IO_RES_ABORT, 0);
+	}
+}
+
+/* Cancel all pending commands, must be called after del_gendisk() returns */
+static void ublk_cancel_dev(struct ublk_device *ub)
+{
+	int i;
+
+	for (i = 0; i < ub->dev_info.nr_hw_queues; i++)
+		ublk_cancel_queue(ublk_get_queue(ub, i));
+}
+
+static void ublk_stop_dev(struct ublk_device *ub)
+{
+	mutex_lock(&ub->mutex);
+	if (ub->dev_info.state == UBLK_S_DEV_DEAD)
+		goto unlock;
+
+	ub->dev_info.state = UBLK_S_DEV_DEAD;
+	del_gendisk(ub->ub_disk);
+	/* waits for the requests in flight */
+	blk_cleanup_queue(ub->ub_queue);
+	put_disk(ub->ub_disk);
+	ub->ub_disk = NULL;
+	ub->ub_queue = NULL;
+ unlock:
+	ublk_cancel_dev(ub);
+	mutex_unlock(&ub->mutex);
+	cancel_delayed_work_sync(&ub->monitor_work);
+}
+
+static int ublk_ctrl_stop_dev(struct ublk_device *ub)
+{
+	ublk_stop_dev(ub);
+	cancel_work_sync(&ub->stop_work);
+	return 0;
+}
+
+static void ublk_stop_work_fn(struct work_struct *work)
+{
+	struct ublk_device *ub =
+		container_of(work, struct ublk_device, stop_work);
+
+	ublk_stop_dev(ub);
+}
+
+/* device can only be started after all IOs are ready */
+static void ublk_mark_io_ready(struct ublk_device *ub, struct ublk_queue *ubq)
+{
+	mutex_lock(&ub->mutex);
+	ubq->nr_io_ready++;
+	if (ublk_queue_ready(ubq)) {
+		ubq->ubq_daemon = current;
+		get_task_struct(ubq->ubq_daemon);
+		ub->nr_queues_ready++;
+	}
+	if (ub->nr_queues_ready == ub->dev_info.nr_hw_queues)
+		complete_all(&ub->completion);
+	mutex_unlock(&ub->mutex);
+}
+
+static int ublk_ch_uring_cmd(struct io_uring_cmd *cmd, unsigned int issue_flags)
+{
+	const struct ublksrv_io_cmd *cmd_buf = cmd->cmd;
+	struct ublk_device *ub = cmd->file->private_data;
+	struct ublksrv_io_cmd ub_cmd;
+	struct ublk_queue *ubq;
+	struct ublk_io *io;
+	u32 cmd_op = cmd->cmd_op;
+	int ret = -EINVAL;
+
+	ub_cmd.q_id = READ_ONCE(cmd_buf->q_id);
+	ub_cmd.tag = READ_ONCE(cmd_buf->tag);
+	ub_cmd.result = READ_ONCE(cmd_buf->result);
+	ub_cmd.addr = READ_ONCE(cmd_buf->addr);
+
+	if (ub_cmd.q_id >= ub->dev_info.nr_hw_queues)
+		goto out;
+
+	ubq = ublk_get_queue(ub, ub_cmd.q_id);
+	if (!ubq || ub_cmd.q_id != ubq->q_id)
+		goto out;
+
+	if (ubq->ubq_daemon && ubq->ubq_daemon != current)
+		goto out;
+
+	if (ub_cmd.tag >= ubq->q_depth)
+		goto out;
+
+	io = &ubq->ios[ub_cmd.tag];
+
+	/* there is pending io cmd, something must be wrong */
+	if (test_bit(UBLK_IO_FLAG_ACTIVE, &io->flags)) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	switch (cmd_op) {
+	case UBLK_IO_FETCH_REQ:
+		/* UBLK_IO_FETCH_REQ is only allowed before queue is setup */
+		if (ublk_queue_ready(ubq)) {
+			ret = -EBUSY;
+			goto out;
+		}
+		/*
+		 * The io is being handled by server, so COMMIT_RQ is expected
+		 * instead of FETCH_REQ
+		 */
+		if (test_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags))
+			goto out;
+		/* FETCH_RQ has to provide IO buffer */
+		if (!ub_cmd.addr)
+			goto out;
+		io->cmd = cmd;
+		io->addr = ub_cmd.addr;
+		set_bit(UBLK_IO_FLAG_ACTIVE, &io->flags);
+
+		ublk_mark_io_ready(ub, ubq);
+		break;
+	case UBLK_IO_COMMIT_AND_FETCH_REQ:
+		/* FETCH_RQ has to provide IO buffer */
+		if (!ub_cmd.addr)
+			goto out;
+		if (!test_bit(UBLK_IO_FLAG_OWNED_BY_SRV, &io->flags))
+			goto out;
+		io->addr = ub_cmd.addr;
+		io->cmd = cmd;
+		/* the tag may be reused as soon as the request is completed */
+		set_bit(UBLK_IO_FLAG_ACTIVE, &io->flags);
+		ublk_commit_completion(ub, &ub_cmd);
+		break;
+	default:
+		goto out;
+	}
+	return -EIOCBQUEUED;
+
+ out:
+	return ret;
+}
+
+static const struct file_operations ublk_ch_fops = {
+	.owner = THIS_MODULE,
+	.open = ublk_ch_open,
+	.release = ublk_ch_release,
+	.llseek = no_llseek,
+	.uring_cmd = ublk_ch_uring_cmd,
+	.mmap = ublk_ch_mmap,
+};
+
+static void ublk_deinit_queue(struct ublk_device *ub, int q_id)
+{
+	int size = ublk_queue_cmd_buf_size(ub, q_id);
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+
+	if (ubq->ubq_daemon)
+		put_task_struct(ubq->ubq_daemon);
+	if (ubq->io_cmd_buf)
+		free_pages((unsigned long)ubq->io_cmd_buf, get_order(size));
+}
+
+static int ublk_init_queue(struct ublk_device *ub, int q_id)
+{
+	struct ublk_queue *ubq = ublk_get_queue(ub, q_id);
+	gfp_t gfp_flags = GFP_KERNEL | __GFP_ZERO;
+	void *ptr;
+	int size;
+
+	ubq->q_id = q_id;
+	ubq->q_depth = ub->dev_info.queue_depth;
+	size = ublk_queue_cmd_buf_size(ub, q_id);
+
+	ptr = (void *) __get_free_pages(gfp_flags, get_order(size));
+	if (!ptr)
+		return -ENOMEM;
+
+	ubq->io_cmd_buf = ptr;
+	ubq->dev = ub;
+	return 0;
+}
+
+static void ublk_deinit_queues(struct ublk_device *ub)
+{
+	int nr_queues = ub->dev_info.nr_hw_queues;
+	int i;
+
+	if (!ub->__queues)
+		return;
+
+	for (i = 0; i < nr_queues; i++)
+		ublk_deinit_queue(ub, i);
+	kfree(ub->__queues);
+}
+
+static int ublk_init_queues(struct ublk_device *ub)
+{
+	int nr_queues = ub->dev_info.nr_hw_queues;
+	int depth = ub->dev_info.queue_depth;
+	int ubq_size = sizeof(struct ublk_queue) + depth * sizeof(struct ublk_io);
+	int i, ret = -ENOMEM;
+
+	ub->queue_size = ubq_size;
+	ub->__queues = kcalloc(nr_queues, ubq_size, GFP_KERNEL);
+	if (!ub->__queues)
+		return ret;
+
+	for (i = 0; i < nr_queues; i++) {
+		if (ublk_init_queue(ub, i))
+			goto fail;
+	}
+
+	init_completion(&ub->completion);
+	return 0;
+
+ fail:
+	ublk_deinit_queues(ub);
+	return ret;
+}
+
+static int __ublk_alloc_dev_number(struct ublk_device *ub, int idx)
+{
+	int i = idx;
+	int err;
+
+	spin_lock(&ublk_idr_lock);
+	/* allocate id, if @id >= 0, we're requesting that specific id */
+	if (i >= 0) {
+		err = idr_alloc(&ublk_index_idr, ub, i, i + 1, GFP_NOWAIT);
+		if (err == -ENOSPC)
+			err = -EEXIST;
+	} else {
+		err = idr_alloc(&ublk_index_idr, ub, 0, UBLK_MINORS,
+				GFP_NOWAIT);
+	}
+	spin_unlock(&ublk_idr_lock);
+
+	if (err >= 0)
+		ub->ub_number = err;
+
+	return err;
+}
+
+static struct ublk_device *__ublk_create_dev(int idx)
+{
+	struct ublk_device *ub = NULL;
+	int ret;
+
+	ub = kzalloc(sizeof(*ub), GFP_KERNEL);
+	if (!ub)
+		return ERR_PTR(-ENOMEM);
+
+	ret = __ublk_alloc_dev_number(ub, idx);
+	if (ret < 0) {
+		kfree(ub);
+		return ERR_PTR(ret);
+	}
+	return ub;
+}
+
+static void __ublk_destroy_dev(struct ublk_device *ub)
+{
+	spin_lock(&ublk_idr_lock);
+	idr_remove(&ublk_index_idr, ub->ub_number);
+	wake_up_all(&ublk_idr_wq);
+	spin_unlock(&ublk_idr_lock);
+
+	mutex_destroy(&ub->mutex);
+
+	kfree(ub);
+}
+
+static void ublk_cdev_rel(struct device *dev)
+{
+	struct ublk_device *ub = container_of(dev, struct ublk_device, cdev_dev);
+
+	blk_mq_free_tag_set(&ub->tag_set);
+
+	ublk_deinit_queues(ub);
+
+	__ublk_destroy_dev(ub);
+}
+
+static int ublk_add_chdev(struct ublk_device *ub)
+{
+	struct device *dev = &ub->cdev_dev;
+	int minor = ub->ub_number;
+	int ret;
+
+	dev->parent = ublk_misc.this_device;
+	dev->devt = MKDEV(MAJOR(ublk_chr_devt), minor);
+	dev->class = ublk_chr_class;
+	dev->release = ublk_cdev_rel;
+	device_initialize(dev);
+
+	ret = dev_set_name(dev, "ublkc%d", minor);
+	if (ret)
+		goto fail;
+
+	cdev_init(&ub->cdev, &ublk_ch_fops);
+	ret = cdev_device_add(&ub->cdev, dev);
+	if (ret)
+		goto fail;
+	return 0;
+ fail:
+	put_device(dev);
+	return ret;
+}
+
+static void ublk_align_max_io_size(struct ublk_device *ub)
+{
+	unsigned int max_rq_bytes = ub->dev_info.rq_max_blocks << ub->bs_shift;
+
+	ub->dev_info.rq_max_blocks =
+		round_down(max_rq_bytes, PAGE_SIZE) >> ub->bs_shift;
+}
+
+static int ublk_add_tag_set(struct ublk_device *ub)
+{
+	ub->tag_set.ops = &ublk_mq_ops;
+	ub->tag_set.nr_hw_queues = ub->dev_info.nr_hw_queues;
+	ub->tag_set.queue_depth = ub->dev_info.queue_depth;
+	ub->tag_set.numa_node = NUMA_NO_NODE;
+	ub->tag_set.flags = BLK_MQ_F_SHOULD_MERGE;
+	ub->tag_set.driver_data = ub;
+	return blk_mq_alloc_tag_set(&ub->tag_set);
+}
+
+static void ublk_remove(struct ublk_device *ub)
+{
+	ublk_ctrl_stop_dev(ub);
+
+	cdev_device_del(&ub->cdev, &ub->cdev_dev);
+	put_device(&ub->cdev_dev);
+}
+
+static struct ublk_device *ublk_get_device_from_id(int idx)
+{
+	struct ublk_device *ub = NULL;
+
+	if (idx < 0)
+		return NULL;
+
+	spin_lock(&ublk_idr_lock);
+	ub = idr_find(&ublk_index_idr, idx);
+	if (ub)
+		get_device(&ub->cdev_dev);
+	spin_unlock(&ublk_idr_lock);
+
+	return ub;
+}
+
+static void ublk_put_device(struct ublk_device *ub)
+{
+	put_device(&ub->cdev_dev);
+}
+
+static int ublk_ctrl_start_dev(struct ublk_device *ub, struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	int ublksrv_pid = (int)READ_ONCE(header->data[0]);
+	unsigned int bsize = 1U << ub->bs_shift;
+	struct request_queue *q;
+	struct gendisk *disk;
+	int ret;
+
+	if (ublksrv_pid <= 0)
+		return -EINVAL;
+
+	if (wait_for_completion_interruptible(&ub->completion) != 0)
+		return -EINTR;
+
+	schedule_delayed_work(&ub->monitor_work, UBLK_DAEMON_MONITOR_PERIOD);
+
+	mutex_lock(&ub->mutex);
+	if (ub->dev_info.state == UBLK_S_DEV_LIVE) {
+		ret = -EEXIST;
+		goto out_unlock;
+	}
+
+	q = blk_mq_init_queue_data(&ub->tag_set, ub);
+	if (IS_ERR(q)) {
+		ret = PTR_ERR(q);
+		goto out_unlock;
+	}
+
+	blk_queue_logical_block_size(q, bsize);
+	blk_queue_physical_block_size(q, bsize);
+	blk_queue_io_min(q, bsize);
+	blk_queue_max_hw_sectors(q, ub->dev_info.rq_max_blocks <<
+				 (ub->bs_shift - SECTOR_SHIFT));
+	blk_queue_write_cache(q, true, true);
+
+	/* similar with loop */
+	q->limits.discard_granularity = PAGE_SIZE;
+	q->limits.discard_alignment = 0;
+	blk_queue_max_discard_sectors(q, UINT_MAX >> SECTOR_SHIFT);
+	blk_queue_max_write_zeroes_sectors(q, UINT_MAX >> SECTOR_SHIFT);
+	blk_queue_flag_set(QUEUE_FLAG_DISCARD, q);
+	blk_queue_flag_set(QUEUE_FLAG_NONROT, q);
+
+	disk = alloc_disk_node(1, NUMA_NO_NODE);
+	if (!disk) {
+		blk_cleanup_queue(q);
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	disk->flags |= GENHD_FL_EXT_DEVT;
+	disk->major = ublk_major;
+	disk->first_minor = ub->ub_number;
+	disk->fops = &ub_fops;
+	disk->private_data = ub;
+	disk->queue = q;
+	sprintf(disk->disk_name, "ublkb%d", ub->ub_number);
+	set_capacity(disk, ub->dev_info.dev_blocks << (ub->bs_shift - 9));
+
+	ub->ub_queue = q;
+	ub->ub_disk = disk;
+	ub->dev_info.ublksrv_pid = ublksrv_pid;
+	ub->dev_info.state = UBLK_S_DEV_LIVE;
+
+	add_disk(disk);
+	ret = 0;
+out_unlock:
+	mutex_unlock(&ub->mutex);
+	if (ret)
+		cancel_delayed_work_sync(&ub->monitor_work);
+	return ret;
+}
+
+static int ublk_ctrl_get_queue_affinity(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(READ_ONCE(header->addr));
+	struct ublk_device *ub;
+	cpumask_var_t cpumask;
+	unsigned long queue;
+	unsigned int retlen;
+	unsigned int i;
+	int ret = -EINVAL;
+
+	if (READ_ONCE(header->len) * BITS_PER_BYTE < nr_cpu_ids)
+		return -EINVAL;
+	if (READ_ONCE(header->len) & (sizeof(unsigned long)-1))
+		return -EINVAL;
+
+	ub = ublk_get_device_from_id(READ_ONCE(header->dev_id));
+	if (!ub)
+		return -EINVAL;
+
+	queue = READ_ONCE(header->data[0]);
+	if (queue >= ub->dev_info.nr_hw_queues)
+		goto out_put_device;
+
+	ret = -ENOMEM;
+	if (!zalloc_cpumask_var(&cpumask, GFP_KERNEL))
+		goto out_put_device;
+
+	for_each_possible_cpu(i) {
+		if (ub->tag_set.map[HCTX_TYPE_DEFAULT].mq_map[i] == queue)
+			cpumask_set_cpu(i, cpumask);
+	}
+
+	ret = -EFAULT;
+	retlen = min_t(unsigned short, READ_ONCE(header->len),
+		       cpumask_size());
+	if (copy_to_user(argp, cpumask, retlen))
+		goto out_free_cpumask;
+	if (retlen != READ_ONCE(header->len) &&
+	    clear_user(argp + retlen, READ_ONCE(header->len) - retlen))
+		goto out_free_cpumask;
+
+	ret = 0;
+out_free_cpumask:
+	free_cpumask_var(cpumask);
+out_put_device:
+	ublk_put_device(ub);
+	return ret;
+}
+
+static inline void ublk_dump_dev_info(struct ublksrv_ctrl_dev_info *info)
+{
+	pr_devel("%s: dev id %d flags %llx\n", __func__,
+			info->dev_id, info->flags[0]);
+	pr_devel("\t nr_hw_queues %d queue_depth %d block size %d dev_capacity %lld\n",
+			info->nr_hw_queues, info->queue_depth,
+			info->block_size, info->dev_blocks);
+}
+
+static int ublk_ctrl_add_dev(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(READ_ONCE(header->addr));
+	struct ublksrv_ctrl_dev_info info;
+	struct ublk_device *ub;
+	int ret = -EINVAL;
+
+	if (READ_ONCE(header->len) < sizeof(info) || !READ_ONCE(header->addr))
+		return -EINVAL;
+	if (READ_ONCE(header->queue_id) != (u16)-1) {
+		pr_warn("%s: queue_id is wrong %x\n",
+			__func__, READ_ONCE(header->queue_id));
+		return -EINVAL;
+	}
+	if (copy_from_user(&info, argp, sizeof(info)))
+		return -EFAULT;
+	ublk_dump_dev_info(&info);
+	if (READ_ONCE(header->dev_id) != info.dev_id) {
+		pr_warn("%s: dev id not match %u %u\n",
+			__func__, READ_ONCE(header->dev_id), info.dev_id);
+		return -EINVAL;
+	}
+
+	/* no driver features are defined yet */
+	if (info.flags[0] || info.flags[1])
+		return -EINVAL;
+	if (!info.nr_hw_queues || !info.queue_depth || !info.dev_blocks)
+		return -EINVAL;
+	if (info.block_size < SECTOR_SIZE || info.block_size > PAGE_SIZE ||
+	    !is_power_of_2(info.block_size))
+		return -EINVAL;
+
+	ret = mutex_lock_killable(&ublk_ctl_mutex);
+	if (ret)
+		return ret;
+
+	ub = __ublk_create_dev(info.dev_id == U32_MAX ? -1 : info.dev_id);
+	if (IS_ERR(ub)) {
+		ret = PTR_ERR(ub);
+		goto out_unlock;
+	}
+
+	mutex_init(&ub->mutex);
+	INIT_WORK(&ub->stop_work, ublk_stop_work_fn);
+	INIT_DELAYED_WORK(&ub->monitor_work, ublk_daemon_monitor_work);
+
+	memcpy(&ub->dev_info, &info, sizeof(info));
+
+	/* update device id */
+	ub->dev_info.dev_id = ub->ub_number;
+
+	ub->bs_shift = ilog2(ub->dev_info.block_size);
+	ub->dev_info.nr_hw_queues = min_t(unsigned int,
+			ub->dev_info.nr_hw_queues, nr_cpu_ids);
+	ub->dev_info.queue_depth = min_t(unsigned short,
+			ub->dev_info.queue_depth, UBLK_MAX_QUEUE_DEPTH);
+	ub->dev_info.state = UBLK_S_DEV_DEAD;
+	ublk_align_max_io_size(ub);
+	if (!ub->dev_info.rq_max_blocks) {
+		ret = -EINVAL;
+		goto out_destroy_dev;
+	}
+
+	ret = ublk_init_queues(ub);
+	if (ret)
+		goto out_destroy_dev;
+
+	ret = ublk_add_tag_set(ub);
+	if (ret)
+		goto out_deinit_queues;
+
+	ret = -EFAULT;
+	if (copy_to_user(argp, &ub->dev_info, sizeof(info)))
+		goto out_free_tag_set;
+
+	/*
+	 * Add the char dev so that ublksrv daemon can be setup.
+	 * ublk_add_chdev() will cleanup everything if it fails.
+	 */
+	ret = ublk_add_chdev(ub);
+	goto out_unlock;
+
+out_free_tag_set:
+	blk_mq_free_tag_set(&ub->tag_set);
+out_deinit_queues:
+	ublk_deinit_queues(ub);
+out_destroy_dev:
+	__ublk_destroy_dev(ub);
+out_unlock:
+	mutex_unlock(&ublk_ctl_mutex);
+	return ret;
+}
+
+static inline bool ublk_idr_freed(int id)
+{
+	void *ptr;
+
+	spin_lock(&ublk_idr_lock);
+	ptr = idr_find(&ublk_index_idr, id);
+	spin_unlock(&ublk_idr_lock);
+
+	return ptr == NULL;
+}
+
+static int ublk_ctrl_del_dev(int idx)
+{
+	struct ublk_device *ub;
+	int ret;
+
+	ret = mutex_lock_killable(&ublk_ctl_mutex);
+	if (ret)
+		return ret;
+
+	ub = ublk_get_device_from_id(idx);
+	if (ub) {
+		ublk_remove(ub);
+		ublk_put_device(ub);
+		ret = 0;
+	} else {
+		ret = -ENODEV;
+	}
+
+	/*
+	 * Wait until the idr is removed, then it can be reused after
+	 * DEL_DEV command is returned.
+	 */
+	if (!ret)
+		wait_event(ublk_idr_wq, ublk_idr_freed(idx));
+	mutex_unlock(&ublk_ctl_mutex);
+
+	return ret;
+}
+
+static inline void ublk_ctrl_cmd_dump(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+
+	pr_devel("%s: cmd_op %x, dev id %d qid %d data %llx buf %llx len %u\n",
+			__func__, cmd->cmd_op, header->dev_id, header->queue_id,
+			header->data[0], header->addr, header->len);
+}
+
+static int ublk_ctrl_get_dev_info(struct io_uring_cmd *cmd)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	void __user *argp = u64_to_user_ptr(READ_ONCE(header->addr));
+	struct ublk_device *ub;
+	int ret = 0;
+
+	if (READ_ONCE(header->len) < sizeof(struct ublksrv_ctrl_dev_info) ||
+	    !READ_ONCE(header->addr))
+		return -EINVAL;
+
+	ub = ublk_get_device_from_id(READ_ONCE(header->dev_id));
+	if (!ub)
+		return -EINVAL;
+
+	if (copy_to_user(argp, &ub->dev_info, sizeof(ub->dev_info)))
+		ret = -EFAULT;
+	ublk_put_device(ub);
+
+	return ret;
+}
+
+static int ublk_ctrl_uring_cmd(struct io_uring_cmd *cmd,
+		unsigned int issue_flags)
+{
+	const struct ublksrv_ctrl_cmd *header = cmd->cmd;
+	struct ublk_device *ub;
+	int ret = -EINVAL;
+
+	ublk_ctrl_cmd_dump(cmd);
+
+	if (!(issue_flags & IO_URING_F_SQE128))
+		goto out;
+
+	/* the control commands may sleep, run them from io-wq */
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		return -EAGAIN;
+
+	ret = -EPERM;
+	if (!capable(CAP_SYS_ADMIN))
+		goto out;
+
+	ret = -ENODEV;
+	switch (cmd->cmd_op) {
+	case UBLK_CMD_START_DEV:
+		ub = ublk_get_device_from_id(READ_ONCE(header->dev_id));
+		if (ub) {
+			ret = ublk_ctrl_start_dev(ub, cmd);
+			ublk_put_device(ub);
+		}
+		break;
+	case UBLK_CMD_STOP_DEV:
+		ub = ublk_get_device_from_id(READ_ONCE(header->dev_id));
+		if (ub) {
+			ret = ublk_ctrl_stop_dev(ub);
+			ublk_put_device(ub);
+		}
+		break;
+	case UBLK_CMD_GET_DEV_INFO:
+		ret = ublk_ctrl_get_dev_info(cmd);
+		break;
+	case UBLK_CMD_ADD_DEV:
+		ret = ublk_ctrl_add_dev(cmd);
+		break;
+	case UBLK_CMD_DEL_DEV:
+		ret = ublk_ctrl_del_dev(READ_ONCE(header->dev_id));
+		break;
+	case UBLK_CMD_GET_QUEUE_AFFINITY:
+		ret = ublk_ctrl_get_queue_affinity(cmd);
+		break;
+	default:
+		ret = -EOPNOTSUPP;
+		break;
+	}
+ out:
+	pr_devel("%s: cmd done ret %d cmd_op %x, dev id %d qid %d\n",
+			__func__, ret, cmd->cmd_op, header->dev_id,
+			header->queue_id);
+	return ret;
+}
+
+static const struct file_operations ublk_ctl_fops = {
+	.open		= nonseekable_open,
+	.uring_cmd      = ublk_ctrl_uring_cmd,
+	.owner		= THIS_MODULE,
+	.llseek		= noop_llseek,
+};
+
+static struct miscdevice ublk_misc = {
+	.minor		= MISC_DYNAMIC_MINOR,
+	.name		= "ublk-control",
+	.fops		= &ublk_ctl_fops,
+};
+
+static int __init ublk_init(void)
+{
+	int ret;
+
+	init_waitqueue_head(&ublk_idr_wq);
+
+	ret = misc_register(&ublk_misc);
+	if (ret)
+		return ret;
+
+	ret = alloc_chrdev_region(&ublk_chr_devt, 0, UBLK_MINORS, "ublk-char");
+	if (ret)
+		goto unregister_mis;
+
+	ublk_chr_class = class_create(THIS_MODULE, "ublk-char");
+	if (IS_ERR(ublk_chr_class)) {
+		ret = PTR_ERR(ublk_chr_class);
+		goto free_chrdev_region;
+	}
+
+	ret = register_blkdev(0, "ublkb");
+	if (ret < 0)
+		goto destroy_class;
+	ublk_major = ret;
+
+	return 0;
+
+destroy_class:
+	class_destroy(ublk_chr_class);
+free_chrdev_region:
+	unregister_chrdev_region(ublk_chr_devt, UBLK_MINORS);
+unregister_mis:
+	misc_deregister(&ublk_misc);
+	return ret;
+}
+
+static void __exit ublk_exit(void)
+{
+	struct ublk_device *ub;
+	int id;
+
+	idr_for_each_entry(&ublk_index_idr, ub, id)
+		ublk_remove(ub);
+
+	unregister_blkdev(ublk_major, "ublkb");
+	class_destroy(ublk_chr_class);
+	misc_deregister(&ublk_misc);
+
+	idr_destroy(&ublk_index_idr);
+	unregister_chrdev_region(ublk_chr_devt, UBLK_MINORS);
+}
+
+module_init(ublk_init);
+module_exit(ublk_exit);
+
+MODULE_LICENSE("GPL");
@@ -337,6 +337,9 @@
 #include <linux/uuid.h>
 #include <crypto/chacha.h>
 #include <crypto/sha.h>
+#ifdef CONFIG_VDSO_GETRANDOM
+#include <vdso/datapage.h>
+#endif
 
 #include <asm/processor.h>
 #include <linux/uaccess.h>
@@ -472,6 +475,31 @@ static void _crng_backtrack_protect(struct crng_state *crng,
 static void process_random_ready_list(void);
 static void _get_random_bytes(void *buf, int nbytes);
 
+#ifdef CONFIG_VDSO_GETRANDOM
+/*
+ * The vDSO getrandom() keys its per-thread states from the syscall and
+ * rekeys them whenever the generation changes, so bump it on every reseed
+ * of the primary crng.  It is never 0 once the vDSO may use it, 0 is what
+ * fresh and wiped states carry.
+ */
+static void crng_vdso_reseeded(void)
+{
+	struct vdso_rng_data *rng = &_vdso_rng_data;
+
+	/* pairs with the smp_rmb() in __cvdso_getrandom_data() */
+	smp_store_release(&rng->generation, rng->generation + 1);
+}
+
+static void crng_vdso_ready(void)
+{
+	crng_vdso_reseeded();
+	WRITE_ONCE(_vdso_rng_data.is_ready, true);
+}
+#else
+static inline void crng_vdso_reseeded(void) {}
+static inline void crng_vdso_ready(void) {}
+#endif
+
 static struct ratelimit_state unseeded_warning =
 	RATELIMIT_STATE_INIT("warn_unseeded_randomness", HZ, 3);
 static struct ratelimit_state urandom_warning =
@@ -834,6 +862,7 @@ static void __init crng_initialize_primary(struct crng_state *crng)
 		invalidate_batched_entropy();
 		numa_crng_init();
 		crng_init = 2;
+		crng_vdso_ready();
 		pr_notice("crng done (trusting CPU's manufacturer)\n");
 	}
 	crng->init_time = jiffies - CRNG_RESEED_INTERVAL - 1;
@@ -853,6 +882,7 @@ static void crng_finalize_init(struct crng_state *crng)
 	invalidate_batched_entropy();
 	numa_crng_init();
 	crng_init = 2;
+	crng_vdso_ready();
 	process_random_ready_list();
 	wake_up_interruptible(&crng_init_wait);
 	kill_fasync(&fasync, SIGIO, POLL_IN);
@@ -1024,6 +1054,8 @@ static void crng_reseed(struct crng_state *crng, struct entropy_store *r)
 	}
 	memzero_explicit(&buf, sizeof(buf));
 	WRITE_ONCE(crng->init_time, jiffies);
+	if (crng == &primary_crng)
+		crng_vdso_reseeded();
 	spin_unlock_irqrestore(&crng->lock, flags);
 	crng_finalize_init(crng);
 }
@@ -13,21 +13,180 @@
 #include <linux/highmem.h>
 #include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/nodemask.h>
 #include <linux/scatterlist.h>
 #include <linux/slab.h>
 #include <linux/sched/signal.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
 #include <asm/page.h>
 
 #include "heap-helpers.h"
 
 struct dma_heap *sys_heap;
 
+/*
+ * Buffers are built from the largest chunks the buddy allocator hands out
+ * without a fight, so that importers get few, large scatterlist entries
+ * and IOMMU mappings stay contiguous. Freed chunks are kept in per-node,
+ * per-order pools for the next allocation and given back to the buddy
+ * allocator by a shrinker under memory pressure.
+ */
+#define HIGH_ORDER_GFP	(((GFP_HIGHUSER | __GFP_ZERO | __GFP_NOWARN \
+			   | __GFP_NORETRY) & ~__GFP_RECLAIM))
+#define LOW_ORDER_GFP	(GFP_HIGHUSER | __GFP_ZERO)
+
+/* 2MB, 64KB and single pages with 4KB pages */
+static const unsigned int orders[] = {9, 4, 0};
+#define NUM_ORDERS ARRAY_SIZE(orders)
+
+/*
+ * Chunks are split into order-0 pages when they are allocated, like the
+ * pages of the CMA heap, so the helpers can treat every page on its own.
+ * A pooled chunk is still a run of 1 << order such pages, linked through
+ * the lru of its first page.
+ */
+struct system_heap_pool {
+	spinlock_t lock;
+	struct list_head chunks;
+	unsigned long count;
+};
+
+/* nr_node_ids * NUM_ORDERS pools */
+static struct system_heap_pool *system_pools;
+static atomic_long_t system_pool_pages;
+
+/* Per-buffer record of how the pages array divides into chunks */
+struct system_heap_chunks {
+	unsigned int nr;
+	u8 order[];
+};
+
+static struct system_heap_pool *system_pool(int nid, unsigned int i)
+{
+	return &system_pools[nid * NUM_ORDERS + i];
+}
+
+static struct page *system_pool_remove(int nid, unsigned int i)
+{
+	struct system_heap_pool *pool = system_pool(nid, i);
+	struct page *page;
+
+	spin_lock(&pool->lock);
+	page = list_first_entry_or_null(&pool->chunks, struct page, lru);
+	if (page) {
+		list_del(&page->lru);
+		pool->count--;
+	}
+	spin_unlock(&pool->lock);
+
+	if (page)
+		atomic_long_sub(1UL << orders[i], &system_pool_pages);
+	return page;
+}
+
+static void system_pool_add(struct page *page, unsigned int i)
+{
+	struct system_heap_pool *pool = system_pool(page_to_nid(page), i);
+	unsigned long nr = 1UL << orders[i], n;
+
+	/* Pooled memory goes out again as a new buffer, so wipe it now. */
+	for (n = 0; n < nr; n++)
+		clear_highpage(page + n);
+
+	spin_lock(&pool->lock);
+	list_add_tail(&page->lru, &pool->chunks);
+	pool->count++;
+	spin_unlock(&pool->lock);
+
+	atomic_long_add(nr, &system_pool_pages);
+}
+
+static void system_free_chunk(struct page *page, unsigned int order)
+{
+	unsigned long n;
+
+	for (n = 0; n < (1UL << order); n++)
+		__free_page(page + n);
+}
+
+static void system_release_chunk(struct page *page, unsigned int i)
+{
+	unsigned long n;
+
+	/*
+	 * Somebody may still hold a reference to one of the pages, e.g. a
+	 * pin taken through a userspace mapping. Such a chunk is not ours
+	 * alone any more; drop our references and let the last user free
+	 * it.
+	 */
+	for (n = 0; n < (1UL << orders[i]); n++) {
+		if (page_count(page + n) != 1) {
+			system_free_chunk(page, orders[i]);
+			return;
+		}
+	}
+
+	system_pool_add(page, i);
+}
+
+static struct page *system_alloc_chunk(int nid, unsigned long nr_pages,
+				       unsigned int *idx)
+{
+	struct page *page;
+	unsigned int i;
+
+	for (i = *idx; i < NUM_ORDERS; i++) {
+		unsigned int order = orders[i];
+
+		if (order >= MAX_ORDER || nr_pages < (1UL << order))
+			continue;
+
+		page = system_pool_remove(nid, i);
+		if (page)
+			goto out;
+
+		page = alloc_pages_node(nid, order ? HIGH_ORDER_GFP :
+						     LOW_ORDER_GFP, order);
+		if (!page)
+			continue;
+
+		if (order)
+			split_page(page, order);
+		goto out;
+	}
+	return NULL;
+
+out:
+	/* Don't retry orders that just failed for the rest of the buffer */
+	*idx = i;
+	return page;
+}
+
+static unsigned int system_order_index(unsigned int order)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_ORDERS; i++)
+		if (orders[i] == order)
+			break;
+	return i;
+}
+
 static void system_heap_free(struct heap_helper_buffer *buffer)
 {
-	pgoff_t pg;
+	struct system_heap_chunks *chunks = buffer->priv_virt;
+	pgoff_t pg = 0;
+	unsigned int c;
+
+	for (c = 0; c < chunks->nr; c++) {
+		unsigned int order = chunks->order[c];
 
-	for (pg = 0; pg < buffer->pagecount; pg++)
-		__free_page(buffer->pages[pg]);
+		system_release_chunk(buffer->pages[pg],
+				     system_order_index(order));
+		pg += 1UL << order;
+	}
+	kfree(chunks);
 	kfree(buffer->pages);
 	kfree(buffer);
 }
@@ -37,10 +196,18 @@ static int system_heap_allocate(struct dma_heap *heap,
 				unsigned long fd_flags,
 				unsigned long heap_flags)
 {
+	int nid = (long)dma_heap_get_drvdata(heap);
 	struct heap_helper_buffer *helper_buffer;
+	struct system_heap_chunks *chunks;
+	unsigned int i = 0, c = 0, n;
 	struct dma_buf *dmabuf;
+	struct page *page;
 	int ret = -ENOMEM;
-	pgoff_t pg;
+	pgoff_t pg = 0;
+
+	/* The generic heap places buffers next to the allocating task. */
+	if (nid == NUMA_NO_NODE)
+		nid = numa_mem_id();
 
 	helper_buffer = kzalloc(sizeof(*helper_buffer), GFP_KERNEL);
 	if (!helper_buffer)
@@ -59,24 +226,37 @@ static int system_heap_allocate(struct dma_heap *heap,
 		goto err0;
 	}
 
-	for (pg = 0; pg < helper_buffer->pagecount; pg++) {
+	/* At worst every page is a chunk of its own */
+	chunks = kmalloc(struct_size(chunks, order, helper_buffer->pagecount),
+			 GFP_KERNEL);
+	if (!chunks)
+		goto err1;
+	helper_buffer->priv_virt = chunks;
+
+	while (pg < helper_buffer->pagecount) {
 		/*
 		 * Avoid trying to allocate memory if the process
 		 * has been killed by by SIGKILL
 		 */
 		if (fatal_signal_pending(current))
-			goto err1;
+			goto err2;
 
-		helper_buffer->pages[pg] = alloc_page(GFP_KERNEL | __GFP_ZERO);
-		if (!helper_buffer->pages[pg])
-			goto err1;
+		page = system_alloc_chunk(nid, helper_buffer->pagecount - pg,
+					  &i);
+		if (!page)
+			goto err2;
+
+		chunks->order[c++] = orders[i];
+		for (n = 0; n < (1U << orders[i]); n++)
+			helper_buffer->pages[pg++] = page + n;
 	}
+	chunks->nr = c;
 
 	/* create the dmabuf */
 	dmabuf = heap_helper_export_dmabuf(helper_buffer, fd_flags);
 	if (IS_ERR(dmabuf)) {
 		ret = PTR_ERR(dmabuf);
-		goto err1;
+		goto err2;
 	}
 
 	helper_buffer->dmabuf = dmabuf;
@@ -90,9 +270,16 @@ static int system_heap_allocate(struct dma_heap *heap,
 
 	return ret;
 
+err2:
+	while (c > 0) {
+		unsigned int order = chunks->order[--c];
+
+		pg -= 1UL << order;
+		system_release_chunk(helper_buffer->pages[pg],
+				     system_order_index(order));
+	}
+	kfree(chunks);
 err1:
-	while (pg > 0)
-		__free_page(helper_buffer->pages[--pg]);
 	kfree(helper_buffer->pages);
 err0:
 	kfree(helper_buffer);
@@ -100,22 +287,113 @@ static int system_heap_allocate(struct dma_heap *heap,
 	return ret;
 }
 
+static unsigned long system_pool_count(struct shrinker *shrinker,
+				       struct shrink_control *sc)
+{
+	return atomic_long_read(&system_pool_pages) ? : SHRINK_EMPTY;
+}
+
+static unsigned long system_pool_scan(struct shrinker *shrinker,
+				      struct shrink_control *sc)
+{
+	unsigned long freed = 0;
+	unsigned int i;
+	int nid;
+
+	/* Largest chunks first, they are the cheapest to give back */
+	for (i = 0; i < NUM_ORDERS; i++) {
+		for_each_node(nid) {
+			struct page *page;
+
+			while (freed < sc->nr_to_scan) {
+				page = system_pool_remove(nid, i);
+				if (!page)
+					break;
+				system_free_chunk(page, orders[i]);
+				freed += 1UL << orders[i];
+			}
+		}
+	}
+
+	return freed ? : SHRINK_STOP;
+}
+
+static struct shrinker system_pool_shrinker = {
+	.count_objects = system_pool_count,
+	.scan_objects = system_pool_scan,
+	.seeks = DEFAULT_SEEKS,
+};
+
+static int system_pools_init(void)
+{
+	unsigned int n;
+
+	system_pools = kcalloc(nr_node_ids * NUM_ORDERS,
+			       sizeof(*system_pools), GFP_KERNEL);
+	if (!system_pools)
+		return -ENOMEM;
+
+	for (n = 0; n < nr_node_ids * NUM_ORDERS; n++) {
+		spin_lock_init(&system_pools[n].lock);
+		INIT_LIST_HEAD(&system_pools[n].chunks);
+	}
+
+	return register_shrinker(&system_pool_shrinker);
+}
+
 static const struct dma_heap_ops system_heap_ops = {
 	.allocate = system_heap_allocate,
 };
 
+/*
+ * A buffer is only known to its importers after it has been allocated, so
+ * the plain "system" heap cannot follow the device. On NUMA machines every
+ * node with memory gets a "system-node<N>" heap as well, for userspace that
+ * knows which device the buffer is going to.
+ */
+static void system_heap_create_node_heaps(void)
+{
+	struct dma_heap_export_info exp_info;
+	struct dma_heap *heap;
+	int nid;
+
+	if (num_node_state(N_MEMORY) < 2)
+		return;
+
+	for_each_node_state(nid, N_MEMORY) {
+		exp_info.name = kasprintf(GFP_KERNEL, "system-node%d", nid);
+		if (!exp_info.name)
+			return;
+		exp_info.ops = &system_heap_ops;
+		exp_info.priv = (void *)(long)nid;
+
+		heap = dma_heap_add(&exp_info);
+		if (IS_ERR(heap)) {
+			pr_warn("dma_heap: failed to add %s heap: %ld\n",
+				exp_info.name, PTR_ERR(heap));
+			kfree(exp_info.name);
+		}
+	}
+}
+
 static int system_heap_create(void)
 {
 	struct dma_heap_export_info exp_info;
 	int ret = 0;
 
+	ret = system_pools_init();
+	if (ret)
+		return ret;
+
 	exp_info.name = "system";
 	exp_info.ops = &system_heap_ops;
-	exp_info.priv = NULL;
+	exp_info.priv = (void *)(long)NUMA_NO_NODE;
 
 	sys_heap = dma_heap_add(&exp_info);
 	if (IS_ERR(sys_heap))
-		ret = PTR_ERR(sys_heap);
+		return PTR_ERR(sys_heap);
+
+	system_heap_create_node_heaps();
 
 	return ret;
 }
@@ -288,6 +288,37 @@ static void iommu_dma_flush_iotlb_all(struct iova_domain *iovad)
 	domain->ops->flush_iotlb_all(domain);
 }
 
+/*
+ * Beyond this many IOVA pages, a flush queue timeout invalidates the whole
+ * IOTLB rather than the span of the IOVAs freed since the last timeout.
+ */
+#define IOMMU_DMA_FQ_RANGE_MAX_PAGES	512
+
+static void iommu_dma_flush_iotlb_range(struct iova_domain *iovad,
+					unsigned long start_pfn,
+					unsigned long end_pfn)
+{
+	struct iommu_dma_cookie *cookie;
+	struct iommu_domain *domain;
+	unsigned long shift = iova_shift(iovad);
+
+	cookie = container_of(iovad, struct iommu_dma_cookie, iovad);
+	domain = cookie->fq_domain;
+
+	if (end_pfn - start_pfn >= IOMMU_DMA_FQ_RANGE_MAX_PAGES) {
+		domain->ops->flush_iotlb_all(domain);
+		return;
+	}
+
+	domain->ops->flush_iotlb_range(domain, start_pfn << shift,
+				       (end_pfn - start_pfn + 1) << shift);
+}
+
+static bool dev_is_untrusted(struct device *dev)
+{
+	return dev_is_pci(dev) && to_pci_dev(dev)->untrusted;
+}
+
 /**
  * iommu_dma_init_domain - Initialise a DMA mapping domain
  * @domain: IOMMU domain previously prepared by iommu_get_dma_cookie()
@@ -342,9 +373,17 @@ static int iommu_dma_init_domain(struct iommu_domain *domain, dma_addr_t base,
 
 	init_iova_domain(iovad, 1UL << order, base_pfn);
 
-	if (!cookie->fq_domain && !iommu_domain_get_attr(domain,
-			DOMAIN_ATTR_DMA_USE_FLUSH_QUEUE, &attr) && attr) {
+	/*
+	 * Untrusted devices always get strict invalidation, whatever the
+	 * default policy, so iommu.strict=0 remains usable on machines with
+	 * external-facing ports.
+	 */
+	if (!cookie->fq_domain && (!dev || !dev_is_untrusted(dev)) &&
+	    !iommu_domain_get_attr(domain, DOMAIN_ATTR_DMA_USE_FLUSH_QUEUE,
+				   &attr) && attr) {
 		if (init_iova_flush_queue(iovad, iommu_dma_flush_iotlb_all,
+					domain->ops->flush_iotlb_range ?
+					iommu_dma_flush_iotlb_range : NULL,
 					NULL))
 			pr_warn("iova flush queue initialization failed\n");
 		else
@@ -421,7 +460,7 @@ static dma_addr_t iommu_dma_alloc_iova(struct iommu_domain *domain,
 	 * rounding up anything cacheable to make sure that can't happen. The
 	 * order of the unadjusted size will still match upon freeing.
 	 */
-	if (iova_len < (1 << (IOVA_RANGE_CACHE_MAX_SIZE - 1)))
+	if (iovad->rcache_size && iova_len < (1 << (iovad->rcache_size - 1)))
 		iova_len = roundup_pow_of_two(iova_len);
 
 	dma_limit = min_not_zero(dma_limit, dev->bus_dma_limit);
@@ -11,10 +11,16 @@
 #include <linux/smp.h>
 #include <linux/bitops.h>
 #include <linux/cpu.h>
+#include <linux/topology.h>
 
 /* The anchor node sits above the top of the usable address space */
 #define IOVA_ANCHOR	~0UL
 
+static unsigned int rcache_size = IOVA_RANGE_CACHE_DEFAULT_SIZE;
+module_param(rcache_size, uint, 0444);
+MODULE_PARM_DESC(rcache_size,
+	"Log2 of the largest IOVA range size (in pages) kept in the per-CPU caches");
+
 static bool iova_rcache_insert(struct iova_domain *iovad,
 			       unsigned long pfn,
 			       unsigned long size);
@@ -76,7 +82,8 @@ static void free_iova_flush_queue(struct iova_domain *iovad)
 }
 
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor)
+			  iova_flush_cb flush_cb, iova_flush_range_cb flush_range_cb,
+			  iova_entry_dtor entry_dtor)
 {
 	struct iova_fq __percpu *queue;
 	int cpu;
@@ -89,6 +96,7 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 		return -ENOMEM;
 
 	iovad->flush_cb   = flush_cb;
+	iovad->flush_range_cb = flush_range_cb;
 	iovad->entry_dtor = entry_dtor;
 
 	for_each_possible_cpu(cpu) {
@@ -97,6 +105,8 @@ int init_iova_flush_queue(struct iova_domain *iovad,
 		fq = per_cpu_ptr(queue, cpu);
 		fq->head = 0;
 		fq->tail = 0;
+		fq->flush_pfn_lo = ULONG_MAX;
+		fq->flush_pfn_hi = 0;
 
 		spin_lock_init(&fq->lock);
 	}
@@ -505,6 +515,39 @@ static void iova_domain_flush(struct iova_domain *iovad)
 	atomic64_inc(&iovad->fq_flush_finish_cnt);
 }
 
+/*
+ * Flush only the span of IOVAs queued on any CPU since the previous range
+ * flush.  Every entry queued before fq_flush_start_cnt is bumped has its
+ * pfns in some fq's span by the time we take that fq's lock, or they were
+ * taken by an earlier range flush, which has completed: range flushes only
+ * run from the (self-serialising) flush timer.  Full flushes leave the
+ * spans alone, so they can only make the next range flush over-cover.
+ */
+static void iova_domain_flush_range(struct iova_domain *iovad)
+{
+	unsigned long lo = ULONG_MAX, hi = 0;
+	int cpu;
+
+	atomic64_inc(&iovad->fq_flush_start_cnt);
+
+	for_each_possible_cpu(cpu) {
+		struct iova_fq *fq = per_cpu_ptr(iovad->fq, cpu);
+		unsigned long flags;
+
+		spin_lock_irqsave(&fq->lock, flags);
+		lo = min(lo, fq->flush_pfn_lo);
+		hi = max(hi, fq->flush_pfn_hi);
+		fq->flush_pfn_lo = ULONG_MAX;
+		fq->flush_pfn_hi = 0;
+		spin_unlock_irqrestore(&fq->lock, flags);
+	}
+
+	if (lo <= hi)
+		iovad->flush_range_cb(iovad, lo, hi);
+
+	atomic64_inc(&iovad->fq_flush_finish_cnt);
+}
+
 static void fq_destroy_all_entries(struct iova_domain *iovad)
 {
 	int cpu;
@@ -532,7 +575,10 @@ static void fq_flush_timeout(struct timer_list *t)
 	int cpu;
 
 	atomic_set(&iovad->fq_timer_on, 0);
-	iova_domain_flush(iovad);
+	if (iovad->flush_range_cb)
+		iova_domain_flush_range(iovad);
+	else
+		iova_domain_flush(iovad);
 
 	for_each_possible_cpu(cpu) {
 		unsigned long flags;
@@ -574,6 +620,9 @@ void queue_iova(struct iova_domain *iovad,
 	fq->entries[idx].data     = data;
 	fq->entries[idx].counter  = atomic64_read(&iovad->fq_flush_start_cnt);
 
+	fq->flush_pfn_lo = min(fq->flush_pfn_lo, pfn);
+	fq->flush_pfn_hi = max(fq->flush_pfn_hi, pfn + pages - 1);
+
 	spin_unlock_irqrestore(&fq->lock, flags);
 
 	/* Avoid false sharing as much as possible. */
@@ -858,25 +907,60 @@ static void iova_magazine_push(struct iova_magazine *mag, unsigned long pfn)
 	mag->pfns[mag->size++] = pfn;
 }
 
-static void init_iova_rcaches(struct iova_domain *iovad)
+static void free_iova_rcache(struct iova_rcache *rcache);
+
+static int init_iova_rcache(struct iova_rcache *rcache)
 {
 	struct iova_cpu_rcache *cpu_rcache;
-	struct iova_rcache *rcache;
+	struct iova_rcache_depot *depot;
 	unsigned int cpu;
+	int node;
+
+	rcache->cpu_rcaches = NULL;
+	rcache->depots = kcalloc(nr_node_ids, sizeof(*rcache->depots),
+				 GFP_KERNEL);
+	if (!rcache->depots)
+		return -ENOMEM;
+
+	for_each_node(node) {
+		depot = kzalloc_node(sizeof(*depot), GFP_KERNEL, node);
+		if (!depot)
+			goto out_free;
+		spin_lock_init(&depot->lock);
+		rcache->depots[node] = depot;
+	}
+
+	rcache->cpu_rcaches = __alloc_percpu(sizeof(*cpu_rcache), cache_line_size());
+	if (!rcache->cpu_rcaches)
+		goto out_free;
+	for_each_possible_cpu(cpu) {
+		cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
+		spin_lock_init(&cpu_rcache->lock);
+		cpu_rcache->loaded = iova_magazine_alloc(GFP_KERNEL);
+		cpu_rcache->prev = iova_magazine_alloc(GFP_KERNEL);
+	}
+	return 0;
+
+out_free:
+	free_iova_rcache(rcache);
+	return -ENOMEM;
+}
+
+static void init_iova_rcaches(struct iova_domain *iovad)
+{
 	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
-		rcache = &iovad->rcaches[i];
-		spin_lock_init(&rcache->lock);
-		rcache->depot_size = 0;
-		rcache->cpu_rcaches = __alloc_percpu(sizeof(*cpu_rcache), cache_line_size());
-		if (WARN_ON(!rcache->cpu_rcaches))
-			continue;
-		for_each_possible_cpu(cpu) {
-			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
-			spin_lock_init(&cpu_rcache->lock);
-			cpu_rcache->loaded = iova_magazine_alloc(GFP_KERNEL);
-			cpu_rcache->prev = iova_magazine_alloc(GFP_KERNEL);
+	iovad->rcache_size = clamp_t(unsigned int, rcache_size, 1,
+				     IOVA_RANGE_CACHE_MAX_SIZE);
+
+	/*
+	 * Orders we fail to set up are simply not cached, allocations of
+	 * that size and larger then go to the rbtree.
+	 */
+	for (i = 0; i < iovad->rcache_size; ++i) {
+		if (WARN_ON(init_iova_rcache(&iovad->rcaches[i]))) {
+			iovad->rcache_size = i;
+			break;
 		}
 	}
 }
@@ -908,14 +992,17 @@ static bool __iova_rcache_insert(struct iova_domain *iovad,
 		struct iova_magazine *new_mag = iova_magazine_alloc(GFP_ATOMIC);
 
 		if (new_mag) {
-			spin_lock(&rcache->lock);
-			if (rcache->depot_size < MAX_GLOBAL_MAGS) {
-				rcache->depot[rcache->depot_size++] =
+			struct iova_rcache_depot *depot =
+				rcache->depots[numa_node_id()];
+
+			spin_lock(&depot->lock);
+			if (depot->depot_size < MAX_GLOBAL_MAGS) {
+				depot->depot[depot->depot_size++] =
 						cpu_rcache->loaded;
 			} else {
 				mag_to_free = cpu_rcache->loaded;
 			}
-			spin_unlock(&rcache->lock);
+			spin_unlock(&depot->lock);
 
 			cpu_rcache->loaded = new_mag;
 			can_insert = true;
@@ -940,12 +1027,31 @@ static bool iova_rcache_insert(struct iova_domain *iovad, unsigned long pfn,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_size)
 		return false;
 
 	return __iova_rcache_insert(iovad, &iovad->rcaches[log_size], pfn);
 }
 
+/*
+ * Take a full magazine from 'depot'.  The unlocked peek keeps CPUs that
+ * scan empty depots, in particular other nodes' ones, off their locks.
+ */
+static struct iova_magazine *iova_depot_pop(struct iova_rcache_depot *depot)
+{
+	struct iova_magazine *mag = NULL;
+
+	if (!READ_ONCE(depot->depot_size))
+		return NULL;
+
+	spin_lock(&depot->lock);
+	if (depot->depot_size > 0)
+		mag = depot->depot[--depot->depot_size];
+	spin_unlock(&depot->lock);
+
+	return mag;
+}
+
 /*
  * Caller wants to allocate a new IOVA range from 'rcache'.  If we can
  * satisfy the request, return a matching non-NULL range and remove
@@ -968,13 +1074,30 @@ static unsigned long __iova_rcache_get(struct iova_rcache *rcache,
 		swap(cpu_rcache->prev, cpu_rcache->loaded);
 		has_pfn = true;
 	} else {
-		spin_lock(&rcache->lock);
-		if (rcache->depot_size > 0) {
+		int this_node = numa_node_id();
+		struct iova_magazine *mag;
+		int node;
+
+		/*
+		 * Prefer this node's depot, but a magazine from any other
+		 * node still beats falling back to the rbtree.
+		 */
+		mag = iova_depot_pop(rcache->depots[this_node]);
+		if (!mag) {
+			for_each_online_node(node) {
+				if (node == this_node)
+					continue;
+				mag = iova_depot_pop(rcache->depots[node]);
+				if (mag)
+					break;
+			}
+		}
+
+		if (mag) {
 			iova_magazine_free(cpu_rcache->loaded);
-			cpu_rcache->loaded = rcache->depot[--rcache->depot_size];
+			cpu_rcache->loaded = mag;
 			has_pfn = true;
 		}
-		spin_unlock(&rcache->lock);
 	}
 
 	if (has_pfn)
@@ -996,7 +1119,7 @@ static unsigned long iova_rcache_get(struct iova_domain *iovad,
 {
 	unsigned int log_size = order_base_2(size);
 
-	if (log_size >= IOVA_RANGE_CACHE_MAX_SIZE)
+	if (log_size >= iovad->rcache_size)
 		return 0;
 
 	return __iova_rcache_get(&iovad->rcaches[log_size], limit_pfn - size);
@@ -1005,24 +1128,44 @@ static unsigned long iova_rcache_get(struct iova_domain *iovad,
 /*
  * free rcache data structures.
  */
-static void free_iova_rcaches(struct iova_domain *iovad)
+static void free_iova_rcache(struct iova_rcache *rcache)
 {
-	struct iova_rcache *rcache;
 	struct iova_cpu_rcache *cpu_rcache;
+	struct iova_rcache_depot *depot;
 	unsigned int cpu;
-	int i, j;
+	int node, j;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
-		rcache = &iovad->rcaches[i];
+	if (rcache->cpu_rcaches) {
 		for_each_possible_cpu(cpu) {
 			cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 			iova_magazine_free(cpu_rcache->loaded);
 			iova_magazine_free(cpu_rcache->prev);
 		}
 		free_percpu(rcache->cpu_rcaches);
-		for (j = 0; j < rcache->depot_size; ++j)
-			iova_magazine_free(rcache->depot[j]);
+		rcache->cpu_rcaches = NULL;
 	}
+
+	if (!rcache->depots)
+		return;
+
+	for_each_node(node) {
+		depot = rcache->depots[node];
+		if (!depot)
+			continue;
+		for (j = 0; j < depot->depot_size; ++j)
+			iova_magazine_free(depot->depot[j]);
+		kfree(depot);
+	}
+	kfree(rcache->depots);
+	rcache->depots = NULL;
+}
+
+static void free_iova_rcaches(struct iova_domain *iovad)
+{
+	int i;
+
+	for (i = 0; i < iovad->rcache_size; ++i)
+		free_iova_rcache(&iovad->rcaches[i]);
 }
 
 /*
@@ -1035,7 +1178,7 @@ void free_cpu_cached_iovas(unsigned int cpu, struct iova_domain *iovad)
 	unsigned long flags;
 	int i;
 
-	for (i = 0; i < IOVA_RANGE_CACHE_MAX_SIZE; ++i) {
+	for (i = 0; i < iovad->rcache_size; ++i) {
 		rcache = &iovad->rcaches[i];
 		cpu_rcache = per_cpu_ptr(rcache->cpu_rcaches, cpu);
 		spin_lock_irqsave(&cpu_rcache->lock, flags);
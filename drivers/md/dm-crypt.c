@@ -136,6 +136,7 @@ enum cipher_flags {
 	CRYPT_MODE_INTEGRITY_AEAD,	/* Use authenticated mode for cihper */
 	CRYPT_IV_LARGE_SECTORS,		/* Calculate IV from sector_size, not 512B sectors */
 	CRYPT_ENCRYPT_PREPROCESS,	/* Must preprocess data for encryption (elephant) */
+	CRYPT_SYNC_CIPHER,		/* Cipher never completes asynchronously */
 };
 
 /*
@@ -221,6 +222,7 @@ struct crypt_config {
 };
 
 #define MIN_IOS		64
+#define DM_CRYPT_SYNC_BATCH	8	/* sectors converted between reschedule points */
 #define MAX_TAG_SIZE	480
 #define POOL_ENTRY_SIZE	512
 
@@ -1543,6 +1545,7 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 {
 	unsigned int tag_offset = 0;
 	unsigned int sector_step = cc->sector_size >> SECTOR_SHIFT;
+	bool sync = test_bit(CRYPT_SYNC_CIPHER, &cc->cipher_flags);
 	int r;
 
 	/*
@@ -1561,7 +1564,12 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 			return BLK_STS_DEV_RESOURCE;
 		}
 
-		atomic_inc(&ctx->cc_pending);
+		/*
+		 * A synchronous cipher finishes the request before returning,
+		 * so it never needs a cc_pending reference of its own.
+		 */
+		if (!sync)
+			atomic_inc(&ctx->cc_pending);
 
 		if (crypt_integrity_aead(cc))
 			r = crypt_convert_block_aead(cc, ctx, ctx->r.req_aead, tag_offset);
@@ -1608,23 +1616,26 @@ static blk_status_t crypt_convert(struct crypt_config *cc,
 		 * The request was already processed (synchronously).
 		 */
 		case 0:
-			atomic_dec(&ctx->cc_pending);
+			if (!sync)
+				atomic_dec(&ctx->cc_pending);
 			ctx->cc_sector += sector_step;
 			tag_offset++;
-			if (!atomic)
+			if (!atomic && !(tag_offset % DM_CRYPT_SYNC_BATCH))
 				cond_resched();
 			continue;
 		/*
 		 * There was a data integrity error.
 		 */
 		case -EBADMSG:
-			atomic_dec(&ctx->cc_pending);
+			if (!sync)
+				atomic_dec(&ctx->cc_pending);
 			return BLK_STS_PROTECTION;
 		/*
 		 * There was an error while processing the request.
 		 */
 		default:
-			atomic_dec(&ctx->cc_pending);
+			if (!sync)
+				atomic_dec(&ctx->cc_pending);
 			return BLK_STS_IOERR;
 		}
 	}
@@ -2307,6 +2318,9 @@ static int crypt_alloc_tfms_skcipher(struct crypt_config *cc, char *ciphermode)
 	 */
 	DMDEBUG_LIMIT("%s using implementation \"%s\"", ciphermode,
 	       crypto_skcipher_alg(any_tfm(cc))->base.cra_driver_name);
+
+	if (!(crypto_skcipher_alg(any_tfm(cc))->base.cra_flags & CRYPTO_ALG_ASYNC))
+		set_bit(CRYPT_SYNC_CIPHER, &cc->cipher_flags);
 	return 0;
 }
 
@@ -2328,6 +2342,9 @@ static int crypt_alloc_tfms_aead(struct crypt_config *cc, char *ciphermode)
 
 	DMDEBUG_LIMIT("%s using implementation \"%s\"", ciphermode,
 	       crypto_aead_alg(any_tfm_aead(cc))->base.cra_driver_name);
+
+	if (!(crypto_aead_alg(any_tfm_aead(cc))->base.cra_flags & CRYPTO_ALG_ASYNC))
+		set_bit(CRYPT_SYNC_CIPHER, &cc->cipher_flags);
 	return 0;
 }
 
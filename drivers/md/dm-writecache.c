@@ -117,6 +117,7 @@ struct dm_writecache {
 		};
 	};
 	struct rb_root tree;
+	seqcount_mutex_t tree_seq;
 
 	size_t freelist_size;
 	size_t writeback_size;
@@ -643,8 +644,10 @@ static void writecache_insert_entry(struct dm_writecache *wc, struct wc_entry *i
 		else
 			node = &parent->rb_right;
 	}
+	write_seqcount_begin(&wc->tree_seq);
 	rb_link_node(&ins->rb_node, parent, node);
 	rb_insert_color(&ins->rb_node, &wc->tree);
+	write_seqcount_end(&wc->tree_seq);
 	list_add(&ins->lru, &wc->lru);
 	ins->age = jiffies;
 }
@@ -652,7 +655,9 @@ static void writecache_insert_entry(struct dm_writecache *wc, struct wc_entry *i
 static void writecache_unlink(struct dm_writecache *wc, struct wc_entry *e)
 {
 	list_del(&e->lru);
+	write_seqcount_begin(&wc->tree_seq);
 	rb_erase(&e->rb_node, &wc->tree);
+	write_seqcount_end(&wc->tree_seq);
 }
 
 static void writecache_add_to_freelist(struct dm_writecache *wc, struct wc_entry *e)
@@ -993,7 +998,9 @@ static void writecache_resume(struct dm_target *ti)
 		}
 	}
 
+	write_seqcount_begin(&wc->tree_seq);
 	wc->tree = RB_ROOT;
+	write_seqcount_end(&wc->tree_seq);
 	INIT_LIST_HEAD(&wc->lru);
 	if (WC_MODE_SORT_FREELIST(wc)) {
 		wc->freetree = RB_ROOT;
@@ -1285,6 +1292,52 @@ static void writecache_offload_bio(struct dm_writecache *wc, struct bio *bio)
 	bio_list_add(&wc->flush_list, bio);
 }
 
+/*
+ * Look up a read without taking wc->lock.  Only a read that misses the
+ * cache is handled here: it is remapped to the origin and clipped at the
+ * next cached block.  A hit, or a tree that changed under us, falls back
+ * to the locked path.  The successor is tracked during the descent so
+ * that rb_next() is never called on a tree that may be rotating.
+ */
+static bool writecache_map_read_miss(struct dm_writecache *wc, struct bio *bio)
+{
+	struct dm_target *ti = wc->ti;
+	sector_t sector = dm_target_offset(ti, bio->bi_iter.bi_sector);
+	sector_t next_boundary = 0;
+	struct wc_entry *e, *following;
+	struct rb_node *node;
+	unsigned seq;
+
+	if (unlikely((((unsigned)sector | bio_sectors(bio)) &
+		      (wc->block_size / 512 - 1)) != 0))
+		return false;
+
+	seq = read_seqcount_begin(&wc->tree_seq);
+	following = NULL;
+	node = READ_ONCE(wc->tree.rb_node);
+	while (node) {
+		e = container_of(node, struct wc_entry, rb_node);
+		if (read_original_sector(wc, e) == sector)
+			return false;
+		if (read_original_sector(wc, e) > sector) {
+			following = e;
+			node = READ_ONCE(e->rb_node.rb_left);
+		} else {
+			node = READ_ONCE(e->rb_node.rb_right);
+		}
+	}
+	if (following)
+		next_boundary = read_original_sector(wc, following) - sector;
+	if (read_seqcount_retry(&wc->tree_seq, seq))
+		return false;
+
+	bio->bi_iter.bi_sector = sector;
+	if (following && next_boundary < bio_sectors(bio))
+		dm_accept_partial_bio(bio, next_boundary);
+	bio_set_dev(bio, wc->dev->bdev);
+	return true;
+}
+
 static int writecache_map(struct dm_target *ti, struct bio *bio)
 {
 	struct wc_entry *e;
@@ -1292,6 +1345,10 @@ static int writecache_map(struct dm_target *ti, struct bio *bio)
 
 	bio->bi_private = NULL;
 
+	if (bio_op(bio) == REQ_OP_READ && !(bio->bi_opf & REQ_PREFLUSH) &&
+	    writecache_map_read_miss(wc, bio))
+		return DM_MAPIO_REMAPPED;
+
 	wc_lock(wc);
 
 	if (unlikely(bio->bi_opf & REQ_PREFLUSH)) {
@@ -2109,6 +2166,7 @@ static int writecache_ctr(struct dm_target *ti, unsigned argc, char **argv)
 	wc->ti = ti;
 
 	mutex_init(&wc->lock);
+	seqcount_mutex_init(&wc->tree_seq, &wc->lock);
 	wc->max_age = MAX_AGE_UNSPECIFIED;
 	writecache_poison_lists(wc);
 	init_waitqueue_head(&wc->freelist_wait);
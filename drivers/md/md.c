@@ -3690,6 +3690,7 @@ int md_rdev_init(struct md_rdev *rdev)
 	rdev->new_data_offset = 0;
 	rdev->sb_events = 0;
 	rdev->last_read_error = 0;
+	rdev->read_lat_ewma = 0;
 	rdev->sb_loaded = 0;
 	rdev->bb_page = NULL;
 	atomic_set(&rdev->nr_pending, 0);
@@ -5499,6 +5500,37 @@ static struct md_sysfs_entry md_serialize_policy =
 __ATTR(serialize_policy, S_IRUGO | S_IWUSR, serialize_policy_show,
        serialize_policy_store);
 
+static const char * const md_read_policy_names[] = {
+	[MD_READ_POLICY_DISTANCE]	= "distance",
+	[MD_READ_POLICY_LATENCY]	= "latency",
+};
+
+static ssize_t read_policy_show(struct mddev *mddev, char *page)
+{
+	return sprintf(page, "%s\n",
+		       md_read_policy_names[READ_ONCE(mddev->read_policy)]);
+}
+
+/*
+ * Select how raid1/raid10 balance reads between the mirrors.  It takes
+ * effect for the next read, no need to suspend the array.
+ */
+static ssize_t
+read_policy_store(struct mddev *mddev, const char *buf, size_t len)
+{
+	int policy;
+
+	policy = sysfs_match_string(md_read_policy_names, buf);
+	if (policy < 0)
+		return policy;
+
+	WRITE_ONCE(mddev->read_policy, policy);
+	return len;
+}
+
+static struct md_sysfs_entry md_read_policy =
+__ATTR(read_policy, S_IRUGO | S_IWUSR, read_policy_show, read_policy_store);
+
 
 static struct attribute *md_default_attrs[] = {
 	&md_level.attr,
@@ -5519,6 +5551,7 @@ static struct attribute *md_default_attrs[] = {
 	&md_consistency_policy.attr,
 	&md_fail_last_dev.attr,
 	&md_serialize_policy.attr,
+	&md_read_policy.attr,
 	NULL,
 };
 
@@ -6250,6 +6283,7 @@ static void __md_stop_writes(struct mddev *mddev)
 	}
 	/* disable policy to guarantee rdevs free resources for serialization */
 	mddev->serialize_policy = 0;
+	mddev->read_policy = MD_READ_POLICY_DISTANCE;
 	mddev_destroy_serial_pool(mddev, NULL, true);
 }
 
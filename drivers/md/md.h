@@ -109,6 +109,9 @@ struct md_rdev {
 					 * only maintained for arrays that
 					 * support hot removal
 					 */
+	unsigned long	read_lat_ewma;	/* moving average of read latency in
+					 * ns, maintained by raid1/raid10
+					 */
 	atomic_t	read_errors;	/* number of consecutive read errors that
 					 * we have tried to ignore.
 					 */
@@ -505,11 +508,21 @@ struct mddev {
 	unsigned int			good_device_nr;	/* good device num within cluster raid */
 	unsigned int			noio_flag; /* for memalloc scope API */
 
+	int	read_policy;		/* enum md_read_policy */
+
 	bool	has_superblocks:1;
 	bool	fail_last_dev:1;
 	bool	serialize_policy:1;
 };
 
+/* How raid1 and raid10 pick the mirror to read from */
+enum md_read_policy {
+	/* stay on sequential streams, else nearest head or fewest pending */
+	MD_READ_POLICY_DISTANCE,
+	/* shortest expected wait: pending requests times read latency */
+	MD_READ_POLICY_LATENCY,
+};
+
 enum recovery_flags {
 	/*
 	 * If neither SYNC or RESHAPE are set, then it is a recovery.
@@ -776,6 +789,27 @@ static inline void rdev_dec_pending(struct md_rdev *rdev, struct mddev *mddev)
 	}
 }
 
+/* A new read latency sample weighs 1/8 in rdev->read_lat_ewma */
+#define MD_READ_LAT_EWMA_SHIFT	3
+
+static inline void md_rdev_update_read_lat(struct md_rdev *rdev, u64 start_ns)
+{
+	unsigned long ewma = READ_ONCE(rdev->read_lat_ewma);
+	u64 lat = ktime_get_ns() - start_ns;
+
+	ewma += (lat >> MD_READ_LAT_EWMA_SHIFT) -
+		(ewma >> MD_READ_LAT_EWMA_SHIFT);
+	WRITE_ONCE(rdev->read_lat_ewma, ewma);
+}
+
+/* Expected wait for a new read on @rdev, for MD_READ_POLICY_LATENCY */
+static inline u64 md_rdev_read_cost(struct md_rdev *rdev)
+{
+	unsigned long ewma = max(READ_ONCE(rdev->read_lat_ewma), 1UL);
+
+	return (u64)(atomic_read(&rdev->nr_pending) + 1) * ewma;
+}
+
 extern struct md_cluster_operations *md_cluster_ops;
 static inline int mddev_is_clustered(struct mddev *mddev)
 {
@@ -368,8 +368,10 @@ static void raid1_end_read_request(struct bio *bio)
 	 */
 	update_head_pos(r1_bio->read_disk, r1_bio);
 
-	if (uptodate)
+	if (uptodate) {
 		set_bit(R1BIO_Uptodate, &r1_bio->state);
+		md_rdev_update_read_lat(rdev, r1_bio->read_start_ns);
+	}
 	else if (test_bit(FailFast, &rdev->flags) &&
 		 test_bit(R1BIO_FailFast, &r1_bio->state))
 		/* This was a fail-fast read so we definitely
@@ -596,14 +598,16 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	const sector_t this_sector = r1_bio->sector;
 	int sectors;
 	int best_good_sectors;
-	int best_disk, best_dist_disk, best_pending_disk;
+	int best_disk, best_dist_disk, best_pending_disk, best_cost_disk;
 	int has_nonrot_disk;
 	int disk;
 	sector_t best_dist;
 	unsigned int min_pending;
+	u64 min_cost;
 	struct md_rdev *rdev;
 	int choose_first;
 	int choose_next_idle;
+	bool by_latency;
 
 	rcu_read_lock();
 	/*
@@ -618,6 +622,10 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	best_dist = MaxSector;
 	best_pending_disk = -1;
 	min_pending = UINT_MAX;
+	best_cost_disk = -1;
+	min_cost = U64_MAX;
+	by_latency = READ_ONCE(conf->mddev->read_policy) ==
+		MD_READ_POLICY_LATENCY;
 	best_good_sectors = 0;
 	has_nonrot_disk = 0;
 	choose_next_idle = 0;
@@ -710,6 +718,19 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 			best_disk = disk;
 			break;
 		}
+		/*
+		 * Head position means nothing to SSDs, but a member that
+		 * is slower or busier than the others does.
+		 */
+		if (by_latency) {
+			u64 cost = md_rdev_read_cost(rdev);
+
+			if (cost < min_cost) {
+				min_cost = cost;
+				best_cost_disk = disk;
+			}
+			continue;
+		}
 		/* Don't change to another disk for sequential reads */
 		if (conf->mirrors[disk].next_seq_sect == this_sector
 		    || dist == 0) {
@@ -761,6 +782,8 @@ static int read_balance(struct r1conf *conf, struct r1bio *r1_bio, int *max_sect
 	 * disk is rotational, which might/might not be optimal for raids with
 	 * mixed ratation/non-rotational disks depending on workload.
 	 */
+	if (best_disk == -1 && best_cost_disk >= 0)
+		best_disk = best_cost_disk;
 	if (best_disk == -1) {
 		if (has_nonrot_disk || min_pending == 0)
 			best_disk = best_pending_disk;
@@ -1308,6 +1331,7 @@ static void raid1_read_request(struct mddev *mddev, struct bio *bio,
 	        trace_block_bio_remap(read_bio->bi_disk->queue, read_bio,
 				disk_devt(mddev->gendisk), r1_bio->sector);
 
+	r1_bio->read_start_ns = ktime_get_ns();
 	submit_bio_noacct(read_bio);
 }
 
@@ -167,6 +167,7 @@ struct r1bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_disk;
+	u64			read_start_ns;	/* when the read was issued */
 
 	struct list_head	retry_list;
 
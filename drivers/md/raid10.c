@@ -372,6 +372,7 @@ static void raid10_end_read_request(struct bio *bio)
 		 * wait for the 'master' bio.
 		 */
 		set_bit(R10BIO_Uptodate, &r10_bio->state);
+		md_rdev_update_read_lat(rdev, r10_bio->read_start_ns);
 	} else {
 		/* If all other devices that store this block have
 		 * failed, we want to return the error upwards rather
@@ -710,10 +711,14 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 	int best_good_sectors;
 	sector_t new_distance, best_dist;
 	struct md_rdev *best_dist_rdev, *best_pending_rdev, *rdev = NULL;
+	struct md_rdev *best_cost_rdev = NULL;
 	int do_balance;
-	int best_dist_slot, best_pending_slot;
+	int best_dist_slot, best_pending_slot, best_cost_slot = -1;
 	bool has_nonrot_disk = false;
 	unsigned int min_pending;
+	u64 min_cost = U64_MAX;
+	bool by_latency = READ_ONCE(conf->mddev->read_policy) ==
+		MD_READ_POLICY_LATENCY;
 	struct geom *geo = &conf->geo;
 
 	raid10_find_phys(conf, r10_bio);
@@ -795,6 +800,21 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		if (!do_balance)
 			break;
 
+		if (best_dist_slot >= 0 || best_cost_slot >= 0)
+			/* At least 2 disks to choose from so failfast is OK */
+			set_bit(R10BIO_FailFast, &r10_bio->state);
+
+		if (by_latency) {
+			u64 cost = md_rdev_read_cost(rdev);
+
+			if (cost < min_cost) {
+				min_cost = cost;
+				best_cost_slot = slot;
+				best_cost_rdev = rdev;
+			}
+			continue;
+		}
+
 		nonrot = blk_queue_nonrot(bdev_get_queue(rdev->bdev));
 		has_nonrot_disk |= nonrot;
 		pending = atomic_read(&rdev->nr_pending);
@@ -804,9 +824,6 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 			best_pending_rdev = rdev;
 		}
 
-		if (best_dist_slot >= 0)
-			/* At least 2 disks to choose from so failfast is OK */
-			set_bit(R10BIO_FailFast, &r10_bio->state);
 		/* This optimisation is debatable, and completely destroys
 		 * sequential read speed for 'far copies' arrays.  So only
 		 * keep it for 'near' arrays, and review those later.
@@ -828,7 +845,10 @@ static struct md_rdev *read_balance(struct r10conf *conf,
 		}
 	}
 	if (slot >= conf->copies) {
-		if (has_nonrot_disk) {
+		if (best_cost_slot >= 0) {
+			slot = best_cost_slot;
+			rdev = best_cost_rdev;
+		} else if (has_nonrot_disk) {
 			slot = best_pending_slot;
 			rdev = best_pending_rdev;
 		} else {
@@ -1204,6 +1224,7 @@ static void raid10_read_request(struct mddev *mddev, struct bio *bio,
 	        trace_block_bio_remap(read_bio->bi_disk->queue,
 	                              read_bio, disk_devt(mddev->gendisk),
 	                              r10_bio->sector);
+	r10_bio->read_start_ns = ktime_get_ns();
 	submit_bio_noacct(read_bio);
 	return;
 }
@@ -133,6 +133,7 @@ struct r10bio {
 	 * if the IO is in READ direction, then this is where we read
 	 */
 	int			read_slot;
+	u64			read_start_ns;	/* when the read was issued */
 
 	struct list_head	retry_list;
 	/*
@@ -415,7 +415,7 @@ static inline void remove_hash(struct stripe_head *sh)
 	pr_debug("remove_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_del_init(&sh->hash);
+	hlist_del_init_rcu(&sh->hash);
 }
 
 static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
@@ -425,7 +425,7 @@ static inline void insert_hash(struct r5conf *conf, struct stripe_head *sh)
 	pr_debug("insert_hash(), stripe %llu\n",
 		(unsigned long long)sh->sector);
 
-	hlist_add_head(&sh->hash, hp);
+	hlist_add_head_rcu(&sh->hash, hp);
 }
 
 /* find an idle stripe, make sure it is unhashed, and return it. */
@@ -699,6 +699,41 @@ static int has_failed(struct r5conf *conf)
 	return 0;
 }
 
+/*
+ * Find a stripe that is already active and take a reference to it, without
+ * taking the hash lock.  A write spanning a whole stripe looks the stripe up
+ * once per data disk, so this is the common case on wide arrays.
+ *
+ * stripe_heads are SLAB_TYPESAFE_BY_RCU and may be reinitialised for
+ * another sector by init_stripe() as soon as their count drops to zero, so
+ * the stripe is checked again once the reference is held.  Stripes with no
+ * reference are left to the slow path.
+ */
+static struct stripe_head *find_get_active_stripe(struct r5conf *conf,
+						  sector_t sector,
+						  short generation)
+{
+	struct stripe_head *sh;
+
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(sh, stripe_hash(conf, sector), hash) {
+		if (sh->sector != sector || sh->generation != generation)
+			continue;
+		if (!atomic_inc_not_zero(&sh->count))
+			break;
+		if (sh->sector == sector && sh->generation == generation &&
+		    !hlist_unhashed(&sh->hash)) {
+			rcu_read_unlock();
+			return sh;
+		}
+		rcu_read_unlock();
+		raid5_release_stripe(sh);
+		return NULL;
+	}
+	rcu_read_unlock();
+	return NULL;
+}
+
 struct stripe_head *
 raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 			int previous, int noblock, int noquiesce)
@@ -709,6 +744,13 @@ raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 
 	pr_debug("get_stripe, sector %llu\n", (unsigned long long)sector);
 
+	if (noquiesce || !READ_ONCE(conf->quiesce)) {
+		sh = find_get_active_stripe(conf, sector,
+					    conf->generation - previous);
+		if (sh)
+			return sh;
+	}
+
 	spin_lock_irq(conf->hash_locks + hash);
 
 	do {
@@ -744,6 +786,12 @@ raid5_get_active_stripe(struct r5conf *conf, sector_t sector,
 					  &conf->cache_state);
 			} else {
 				init_stripe(sh, sector, previous);
+				/*
+				 * Pairs with atomic_inc_not_zero() in
+				 * find_get_active_stripe(): the new sector
+				 * must be visible before the reference.
+				 */
+				smp_mb__before_atomic();
 				atomic_inc(&sh->count);
 			}
 		} else if (!atomic_inc_not_zero(&sh->count)) {
@@ -2370,7 +2418,7 @@ static int grow_stripes(struct r5conf *conf, int num)
 	conf->active_name = 0;
 	sc = kmem_cache_create(conf->cache_name[conf->active_name],
 			       sizeof(struct stripe_head)+(devs-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return 1;
 	conf->slab_cache = sc;
@@ -2496,7 +2544,7 @@ static int resize_stripes(struct r5conf *conf, int newsize)
 	/* Step 1 */
 	sc = kmem_cache_create(conf->cache_name[1-conf->active_name],
 			       sizeof(struct stripe_head)+(newsize-1)*sizeof(struct r5dev),
-			       0, 0, NULL);
+			       0, SLAB_TYPESAFE_BY_RCU, NULL);
 	if (!sc)
 		return -ENOMEM;
 
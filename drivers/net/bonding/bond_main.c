@@ -79,6 +79,8 @@
 #include <net/pkt_sched.h>
 #include <linux/rculist.h>
 #include <net/flow_dissector.h>
+#include <linux/filter.h>
+#include <net/xdp.h>
 #include <net/xfrm.h>
 #include <net/bonding.h>
 #include <net/bond_3ad.h>
@@ -1375,7 +1377,7 @@ static void bond_compute_features(struct bonding *bond)
 	struct list_head *iter;
 	struct slave *slave;
 	unsigned short max_hard_header_len = ETH_HLEN;
-	unsigned int gso_max_size = GSO_MAX_SIZE;
+	unsigned int gso_max_size = GSO_LEGACY_MAX_SIZE;
 	u16 gso_max_segs = GSO_MAX_SEGS;
 
 	if (!bond_has_slaves(bond))
@@ -1689,6 +1691,50 @@ void bond_lower_state_changed(struct slave *slave)
 	netdev_lower_state_changed(slave->dev, &info);
 }
 
+/* Slaves run the program of the bond, so they must be able to both run and
+ * transmit XDP frames, and must not have a program of their own.
+ */
+static int bond_xdp_slave_check(struct net_device *bond_dev,
+				struct net_device *slave_dev,
+				struct netlink_ext_ack *extack)
+{
+	if (!slave_dev->netdev_ops->ndo_bpf ||
+	    !slave_dev->netdev_ops->ndo_xdp_xmit) {
+		NL_SET_ERR_MSG(extack, "Slave device does not support XDP");
+		slave_err(bond_dev, slave_dev, "Error: Slave device does not support XDP\n");
+		return -EOPNOTSUPP;
+	}
+
+	if (dev_xdp_prog_count(slave_dev) > 0) {
+		NL_SET_ERR_MSG(extack, "Slave has an XDP program loaded");
+		slave_err(bond_dev, slave_dev, "Error: Slave has XDP program loaded\n");
+		return -EOPNOTSUPP;
+	}
+
+	return 0;
+}
+
+static int bond_xdp_slave_set(struct net_device *slave_dev,
+			      struct bpf_prog *prog,
+			      struct netlink_ext_ack *extack)
+{
+	struct netdev_bpf xdp = {
+		.command = XDP_SETUP_PROG,
+		.prog	 = prog,
+		.extack	 = extack,
+	};
+	int err;
+
+	/* the slave driver takes over the reference, see dev_xdp_install() */
+	if (prog)
+		bpf_prog_inc(prog);
+	err = slave_dev->netdev_ops->ndo_bpf(slave_dev, &xdp);
+	if (err && prog)
+		bpf_prog_put(prog);
+
+	return err;
+}
+
 /* enslave device <slave> to bond device <master> */
 int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 		 struct netlink_ext_ack *extack)
@@ -1749,6 +1795,12 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 		return -EPERM;
 	}
 
+	if (bond->xdp_prog) {
+		res = bond_xdp_slave_check(bond_dev, slave_dev, extack);
+		if (res)
+			return res;
+	}
+
 	/* set bonding device ether type by slave - bonding netdevices are
 	 * created with ether_setup, so when the slave type is not ARPHRD_ETHER
 	 * there is a need to override some of the type dependent attribs/funcs.
@@ -2052,6 +2104,14 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 		goto err_upper_unlink;
 	}
 
+	if (bond->xdp_prog) {
+		res = bond_xdp_slave_set(slave_dev, bond->xdp_prog, extack);
+		if (res) {
+			slave_dbg(bond_dev, slave_dev, "Error %d calling ndo_bpf\n", res);
+			goto err_sysfs_del;
+		}
+	}
+
 	/* If the mode uses primary, then the following is handled by
 	 * bond_change_active_slave().
 	 */
@@ -2060,7 +2120,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 		if (bond_dev->flags & IFF_PROMISC) {
 			res = dev_set_promiscuity(slave_dev, 1);
 			if (res)
-				goto err_sysfs_del;
+				goto err_xdp_unset;
 		}
 
 		/* set allmulti level to new slave */
@@ -2069,7 +2129,7 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 			if (res) {
 				if (bond_dev->flags & IFF_PROMISC)
 					dev_set_promiscuity(slave_dev, -1);
-				goto err_sysfs_del;
+				goto err_xdp_unset;
 			}
 		}
 
@@ -2109,6 +2169,10 @@ int bond_enslave(struct net_device *bond_dev, struct net_device *slave_dev,
 	return 0;
 
 /* Undo stages on error */
+err_xdp_unset:
+	if (bond->xdp_prog)
+		bond_xdp_slave_set(slave_dev, NULL, NULL);
+
 err_sysfs_del:
 	bond_sysfs_slave_del(new_slave);
 
@@ -2227,6 +2291,9 @@ static int __bond_release_one(struct net_device *bond_dev,
 	if (BOND_MODE(bond) == BOND_MODE_8023AD)
 		bond_3ad_unbind_slave(slave);
 
+	if (bond->xdp_prog && bond_xdp_slave_set(slave_dev, NULL, NULL))
+		slave_warn(bond_dev, slave_dev, "failed to unload XDP program\n");
+
 	bond_upper_dev_unlink(bond, slave);
 
 	if (bond_mode_can_use_xmit_hash(bond))
@@ -3581,64 +3648,76 @@ static struct notifier_block bond_netdev_notifier = {
 /*---------------------------- Hashing Policies -----------------------------*/
 
 /* L2 hash helper */
-static inline u32 bond_eth_hash(struct sk_buff *skb)
+static inline u32 bond_eth_hash(struct sk_buff *skb, void *data, int mhoff,
+				int hlen)
 {
 	struct ethhdr *ep, hdr_tmp;
 
-	ep = skb_header_pointer(skb, 0, sizeof(hdr_tmp), &hdr_tmp);
+	ep = __skb_header_pointer(skb, mhoff, sizeof(hdr_tmp), data, hlen,
+				  &hdr_tmp);
 	if (ep)
 		return ep->h_dest[5] ^ ep->h_source[5] ^ ep->h_proto;
 	return 0;
 }
 
+/* @skb may be NULL when hashing an xdp_buff, in which case only the first
+ * @hlen bytes at @data are available
+ */
 static bool bond_flow_ip(struct sk_buff *skb, struct flow_keys *fk,
-			 int *noff, int *proto, bool l34)
+			 void *data, int hlen, __be16 l2_proto,
+			 int *nhoff, int *ip_proto, bool l34)
 {
 	const struct ipv6hdr *iph6;
 	const struct iphdr *iph;
+	struct ipv6hdr _iph6;
+	struct iphdr _iph;
 
-	if (skb->protocol == htons(ETH_P_IP)) {
-		if (unlikely(!pskb_may_pull(skb, *noff + sizeof(*iph))))
+	if (l2_proto == htons(ETH_P_IP)) {
+		iph = __skb_header_pointer(skb, *nhoff, sizeof(_iph), data,
+					   hlen, &_iph);
+		if (unlikely(!iph))
 			return false;
-		iph = (const struct iphdr *)(skb->data + *noff);
 		iph_to_flow_copy_v4addrs(fk, iph);
-		*noff += iph->ihl << 2;
+		*nhoff += iph->ihl << 2;
 		if (!ip_is_fragment(iph))
-			*proto = iph->protocol;
-	} else if (skb->protocol == htons(ETH_P_IPV6)) {
-		if (unlikely(!pskb_may_pull(skb, *noff + sizeof(*iph6))))
+			*ip_proto = iph->protocol;
+	} else if (l2_proto == htons(ETH_P_IPV6)) {
+		iph6 = __skb_header_pointer(skb, *nhoff, sizeof(_iph6), data,
+					    hlen, &_iph6);
+		if (unlikely(!iph6))
 			return false;
-		iph6 = (const struct ipv6hdr *)(skb->data + *noff);
 		iph_to_flow_copy_v6addrs(fk, iph6);
-		*noff += sizeof(*iph6);
-		*proto = iph6->nexthdr;
+		*nhoff += sizeof(*iph6);
+		*ip_proto = iph6->nexthdr;
 	} else {
 		return false;
 	}
 
-	if (l34 && *proto >= 0)
-		fk->ports.ports = skb_flow_get_ports(skb, *noff, *proto);
+	if (l34 && *ip_proto >= 0)
+		fk->ports.ports = __skb_flow_get_ports(skb, *nhoff, *ip_proto,
+						       data, hlen);
 
 	return true;
 }
 
 /* Extract the appropriate headers based on bond's xmit policy */
 static bool bond_flow_dissect(struct bonding *bond, struct sk_buff *skb,
-			      struct flow_keys *fk)
+			      void *data, __be16 l2_proto, int nhoff,
+			      int hlen, struct flow_keys *fk)
 {
 	bool l34 = bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER34;
-	int noff, proto = -1;
+	int ip_proto = -1;
 
 	if (bond->params.xmit_policy > BOND_XMIT_POLICY_LAYER23) {
 		memset(fk, 0, sizeof(*fk));
 		return __skb_flow_dissect(NULL, skb, &flow_keys_bonding,
-					  fk, NULL, 0, 0, 0, 0);
+					  fk, data, l2_proto, nhoff, hlen, 0);
 	}
 
 	fk->ports.ports = 0;
 	memset(&fk->icmp, 0, sizeof(fk->icmp));
-	noff = skb_network_offset(skb);
-	if (!bond_flow_ip(skb, fk, &noff, &proto, l34))
+	if (!bond_flow_ip(skb, fk, data, hlen, l2_proto, &nhoff, &ip_proto,
+			  l34))
 		return false;
 
 	/* ICMP error packets contains at least 8 bytes of the header
@@ -3646,51 +3725,43 @@ static bool bond_flow_dissect(struct bonding *bond, struct sk_buff *skb,
 	 * to correlate ICMP error packets within the same flow which
 	 * generated the error.
 	 */
-	if (proto == IPPROTO_ICMP || proto == IPPROTO_ICMPV6) {
-		skb_flow_get_icmp_tci(skb, &fk->icmp, skb->data,
-				      skb_transport_offset(skb),
-				      skb_headlen(skb));
-		if (proto == IPPROTO_ICMP) {
+	if (ip_proto == IPPROTO_ICMP || ip_proto == IPPROTO_ICMPV6) {
+		skb_flow_get_icmp_tci(skb, &fk->icmp, data, nhoff, hlen);
+		if (ip_proto == IPPROTO_ICMP) {
 			if (!icmp_is_err(fk->icmp.type))
 				return true;
 
-			noff += sizeof(struct icmphdr);
-		} else if (proto == IPPROTO_ICMPV6) {
+			nhoff += sizeof(struct icmphdr);
+		} else if (ip_proto == IPPROTO_ICMPV6) {
 			if (!icmpv6_is_err(fk->icmp.type))
 				return true;
 
-			noff += sizeof(struct icmp6hdr);
+			nhoff += sizeof(struct icmp6hdr);
 		}
-		return bond_flow_ip(skb, fk, &noff, &proto, l34);
+		return bond_flow_ip(skb, fk, data, hlen, l2_proto, &nhoff,
+				    &ip_proto, l34);
 	}
 
 	return true;
 }
 
-/**
- * bond_xmit_hash - generate a hash value based on the xmit policy
- * @bond: bonding device
- * @skb: buffer to use for headers
- *
- * This function will extract the necessary headers from the skb buffer and use
- * them to generate a hash based on the xmit_policy set in the bonding device
+/* Generic hash function shared by skb and xdp_buff transmit, @mhoff is the
+ * offset of the MAC header and @nhoff the one of the network header
  */
-u32 bond_xmit_hash(struct bonding *bond, struct sk_buff *skb)
+static u32 __bond_xmit_hash(struct bonding *bond, struct sk_buff *skb,
+			    void *data, __be16 l2_proto, int mhoff, int nhoff,
+			    int hlen)
 {
 	struct flow_keys flow;
 	u32 hash;
 
-	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34 &&
-	    skb->l4_hash)
-		return skb->hash;
-
 	if (bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER2 ||
-	    !bond_flow_dissect(bond, skb, &flow))
-		return bond_eth_hash(skb);
+	    !bond_flow_dissect(bond, skb, data, l2_proto, nhoff, hlen, &flow))
+		return bond_eth_hash(skb, data, mhoff, hlen);
 
 	if (bond->params.xmit_policy == BOND_XMIT_POLICY_LAYER23 ||
 	    bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP23) {
-		hash = bond_eth_hash(skb);
+		hash = bond_eth_hash(skb, data, mhoff, hlen);
 	} else {
 		if (flow.icmp.id)
 			memcpy(&hash, &flow.icmp, sizeof(hash));
@@ -3705,6 +3776,46 @@ u32 bond_xmit_hash(struct bonding *bond, struct sk_buff *skb)
 	return hash >> 1;
 }
 
+/**
+ * bond_xmit_hash - generate a hash value based on the xmit policy
+ * @bond: bonding device
+ * @skb: buffer to use for headers
+ *
+ * This function will extract the necessary headers from the skb buffer and use
+ * them to generate a hash based on the xmit_policy set in the bonding device
+ */
+u32 bond_xmit_hash(struct bonding *bond, struct sk_buff *skb)
+{
+	if (bond->params.xmit_policy == BOND_XMIT_POLICY_ENCAP34 &&
+	    skb->l4_hash)
+		return skb->hash;
+
+	return __bond_xmit_hash(bond, skb, skb->data, skb->protocol, 0,
+				skb_network_offset(skb), skb_headlen(skb));
+}
+
+/**
+ * bond_xmit_hash_xdp - generate a hash value based on the xmit policy
+ * @bond: bonding device
+ * @xdp: buffer to use for headers
+ *
+ * The XDP variant of bond_xmit_hash; there is no skb, so only the linear
+ * part of the frame is looked at.
+ */
+static u32 bond_xmit_hash_xdp(struct bonding *bond, struct xdp_buff *xdp)
+{
+	struct ethhdr *eth;
+
+	if (xdp->data + sizeof(struct ethhdr) > xdp->data_end)
+		return 0;
+
+	eth = (struct ethhdr *)xdp->data;
+
+	return __bond_xmit_hash(bond, NULL, xdp->data, eth->h_proto, 0,
+				sizeof(struct ethhdr),
+				xdp->data_end - xdp->data);
+}
+
 /*-------------------------- Device entry points ----------------------------*/
 
 void bond_work_init_all(struct bonding *bond)
@@ -4689,6 +4800,173 @@ static struct net_device *bond_xmit_get_slave(struct net_device *master_dev,
 	return NULL;
 }
 
+/*-------------------------------- XDP ------------------------------------*/
+
+static struct slave *bond_xdp_xmit_3ad_xor_slave_get(struct bonding *bond,
+						     struct xdp_buff *xdp)
+{
+	struct bond_up_slave *slaves;
+	unsigned int count;
+	u32 hash;
+
+	hash = bond_xmit_hash_xdp(bond, xdp);
+	slaves = rcu_dereference(bond->usable_slaves);
+	count = slaves ? READ_ONCE(slaves->count) : 0;
+	if (unlikely(!count))
+		return NULL;
+
+	return slaves->arr[hash % count];
+}
+
+/* must be called with rcu_read_lock held */
+static struct net_device *bond_xdp_get_xmit_slave(struct net_device *bond_dev,
+						  struct xdp_buff *xdp)
+{
+	struct bonding *bond = netdev_priv(bond_dev);
+	struct slave *slave;
+
+	switch (BOND_MODE(bond)) {
+	case BOND_MODE_ACTIVEBACKUP:
+		slave = bond_xmit_activebackup_slave_get(bond, NULL);
+		break;
+	case BOND_MODE_8023AD:
+	case BOND_MODE_XOR:
+		slave = bond_xdp_xmit_3ad_xor_slave_get(bond, xdp);
+		break;
+	default:
+		slave = NULL;
+		break;
+	}
+
+	return slave ? slave->dev : NULL;
+}
+
+/* Frames are spread over the slaves one by one; consecutive frames hashing
+ * to the same slave are handed to it as a single batch.
+ */
+static int bond_xdp_xmit(struct net_device *bond_dev, int n,
+			 struct xdp_frame **frames, u32 flags)
+{
+	struct net_device *slave_devs[DEV_MAP_BULK_SIZE];
+	int i, j, err, sent = 0;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(n > DEV_MAP_BULK_SIZE))
+		return -EINVAL;
+
+	rcu_read_lock();
+
+	for (i = 0; i < n; i++) {
+		struct xdp_buff xdp;
+
+		xdp_convert_frame_to_buff(frames[i], &xdp);
+		slave_devs[i] = bond_xdp_get_xmit_slave(bond_dev, &xdp);
+	}
+
+	for (i = 0; i < n; i = j) {
+		struct net_device *slave_dev = slave_devs[i];
+
+		for (j = i + 1; j < n && slave_devs[j] == slave_dev; j++)
+			;
+
+		err = slave_dev ? slave_dev->netdev_ops->ndo_xdp_xmit(slave_dev,
+							j - i, &frames[i],
+							flags) : -ENXIO;
+		if (err >= 0) {
+			/* the slave already freed the frames it dropped */
+			sent += err;
+			continue;
+		}
+
+		while (i < j)
+			xdp_return_frame_rx_napi(frames[i++]);
+	}
+
+	rcu_read_unlock();
+
+	return sent;
+}
+
+static int bond_xdp_set(struct net_device *dev, struct bpf_prog *prog,
+			struct netlink_ext_ack *extack)
+{
+	struct bonding *bond = netdev_priv(dev);
+	struct slave *slave, *rollback_slave;
+	struct list_head *iter;
+	struct bpf_prog *old_prog;
+	int err;
+
+	ASSERT_RTNL();
+
+	if (prog && !bond_mode_can_use_xdp(BOND_MODE(bond))) {
+		NL_SET_ERR_MSG(extack, "No XDP support for the current bonding mode");
+		return -EOPNOTSUPP;
+	}
+
+	old_prog = bond->xdp_prog;
+	bond->xdp_prog = prog;
+
+	bond_for_each_slave(bond, slave, iter) {
+		struct net_device *slave_dev = slave->dev;
+
+		if (prog && !old_prog) {
+			err = bond_xdp_slave_check(dev, slave_dev, extack);
+			if (err)
+				goto err;
+		}
+
+		err = bond_xdp_slave_set(slave_dev, prog, extack);
+		if (err) {
+			/* ndo_bpf() sets extack error message */
+			slave_err(dev, slave_dev, "Error %d calling ndo_bpf\n", err);
+			goto err;
+		}
+	}
+
+	if (prog && !old_prog)
+		static_branch_inc(&bpf_master_redirect_enabled_key);
+	else if (!prog && old_prog)
+		static_branch_dec(&bpf_master_redirect_enabled_key);
+
+	/* drop the reference moved to us by dev_xdp_install() */
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+
+err:
+	/* unwind the program changes, without overwriting the original error */
+	bond->xdp_prog = old_prog;
+
+	bond_for_each_slave(bond, rollback_slave, iter) {
+		struct net_device *slave_dev = rollback_slave->dev;
+		int err_unwind;
+
+		if (slave == rollback_slave)
+			break;
+
+		err_unwind = bond_xdp_slave_set(slave_dev, old_prog, NULL);
+		if (err_unwind)
+			slave_err(dev, slave_dev,
+				  "Error %d when unwinding XDP program change\n",
+				  err_unwind);
+	}
+
+	return err;
+}
+
+static int bond_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return bond_xdp_set(dev, xdp->prog, xdp->extack);
+	default:
+		return -EINVAL;
+	}
+}
+
 static netdev_tx_t __bond_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct bonding *bond = netdev_priv(dev);
@@ -4825,6 +5103,9 @@ static const struct net_device_ops bond_netdev_ops = {
 	.ndo_fix_features	= bond_fix_features,
 	.ndo_features_check	= passthru_features_check,
 	.ndo_get_xmit_slave	= bond_xmit_get_slave,
+	.ndo_bpf		= bond_xdp,
+	.ndo_xdp_xmit		= bond_xdp_xmit,
+	.ndo_xdp_get_xmit_slave = bond_xdp_get_xmit_slave,
 };
 
 static const struct device_type bond_type = {
@@ -761,6 +761,12 @@ static void bond_set_xfrm_features(struct net_device *bond_dev, u64 mode)
 static int bond_option_mode_set(struct bonding *bond,
 				const struct bond_opt_value *newval)
 {
+	if (bond->xdp_prog && !bond_mode_can_use_xdp(newval->value)) {
+		netdev_err(bond->dev, "%s mode is incompatible with the XDP program loaded\n",
+			   newval->string);
+		return -EOPNOTSUPP;
+	}
+
 	if (!bond_mode_uses_arp(newval->value)) {
 		if (bond->params.arp_interval) {
 			netdev_dbg(bond->dev, "%s mode is incompatible with arp monitoring, start mii monitoring\n",
@@ -340,6 +340,8 @@ int ice_setup_rx_ctx(struct ice_ring *ring)
 							 NULL);
 			if (err)
 				return err;
+			xdp_rxq_info_set_metadata_ops(&ring->xdp_rxq,
+						      &ice_xdp_metadata_ops);
 		}
 	}
 	/* Receive Queue Base Address.
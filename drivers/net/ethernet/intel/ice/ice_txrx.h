@@ -162,6 +162,16 @@ struct ice_tx_offload_params {
 	u8 header_len;
 };
 
+/* xdp_buff built by ice_clean_rx_irq(), the descriptor backs the XDP RX
+ * hints
+ */
+struct ice_xdp_buff {
+	struct xdp_buff xdp;
+	union ice_32b_rx_flex_desc *eop_desc;
+};
+
+extern const struct xdp_metadata_ops ice_xdp_metadata_ops;
+
 struct ice_rx_buf {
 	union {
 		struct {
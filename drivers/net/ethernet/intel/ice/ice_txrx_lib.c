@@ -70,6 +70,95 @@ ice_rx_hash(struct ice_ring *rx_ring, union ice_32b_rx_flex_desc *rx_desc,
 	skb_set_hash(skb, hash, ice_ptype_to_htype(rx_ptype));
 }
 
+/**
+ * ice_xdp_rx_hash - RSS hash XDP RX hint
+ * @xdp: xdp_buff embedded in a struct ice_xdp_buff
+ * @hash: returned RSS hash value
+ * @rss_type: returned set of headers the hash was computed over
+ */
+static int
+ice_xdp_rx_hash(const struct xdp_buff *xdp, u32 *hash,
+		enum xdp_rss_hash_type *rss_type)
+{
+	const struct ice_xdp_buff *ixbuf = (void *)xdp;
+	const struct ice_32b_rx_flex_desc_nic *nic_mdid;
+	struct ice_rx_ptype_decoded decoded;
+	u8 ptype;
+
+	if (!(xdp->rxq->dev->features & NETIF_F_RXHASH))
+		return -ENODATA;
+
+	if (ixbuf->eop_desc->wb.rxdid != ICE_RXDID_FLEX_NIC)
+		return -ENODATA;
+
+	nic_mdid = (const struct ice_32b_rx_flex_desc_nic *)ixbuf->eop_desc;
+	*hash = le32_to_cpu(nic_mdid->rss_hash);
+
+	ptype = le16_to_cpu(ixbuf->eop_desc->wb.ptype_flex_flags0) &
+		ICE_RX_FLEX_DESC_PTYPE_M;
+	decoded = ice_decode_rx_desc_ptype(ptype);
+
+	*rss_type = XDP_RSS_TYPE_NONE;
+	if (!decoded.known || decoded.outer_ip != ICE_RX_PTYPE_OUTER_IP)
+		return 0;
+
+	if (decoded.outer_ip_ver == ICE_RX_PTYPE_OUTER_IPV4)
+		*rss_type = XDP_RSS_TYPE_L3_IPV4;
+	else if (decoded.outer_ip_ver == ICE_RX_PTYPE_OUTER_IPV6)
+		*rss_type = XDP_RSS_TYPE_L3_IPV6;
+
+	switch (decoded.inner_prot) {
+	case ICE_RX_PTYPE_INNER_PROT_TCP:
+		*rss_type |= XDP_RSS_L4 | XDP_RSS_L4_TCP;
+		break;
+	case ICE_RX_PTYPE_INNER_PROT_UDP:
+		*rss_type |= XDP_RSS_L4 | XDP_RSS_L4_UDP;
+		break;
+	case ICE_RX_PTYPE_INNER_PROT_SCTP:
+		*rss_type |= XDP_RSS_L4 | XDP_RSS_L4_SCTP;
+		break;
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+/**
+ * ice_xdp_rx_vlan_tag - stripped VLAN tag XDP RX hint
+ * @xdp: xdp_buff embedded in a struct ice_xdp_buff
+ * @vlan_proto: returned VLAN protocol
+ * @vlan_tci: returned VLAN tag control information
+ */
+static int
+ice_xdp_rx_vlan_tag(const struct xdp_buff *xdp, __be16 *vlan_proto,
+		    u16 *vlan_tci)
+{
+	u16 stat_err_bits = BIT(ICE_RX_FLEX_DESC_STATUS0_L2TAG1P_S);
+	const struct ice_xdp_buff *ixbuf = (void *)xdp;
+	u16 vlan_tag;
+
+	if (!(xdp->rxq->dev->features & NETIF_F_HW_VLAN_CTAG_RX))
+		return -ENODATA;
+
+	if (!ice_test_staterr(ixbuf->eop_desc, stat_err_bits))
+		return -ENODATA;
+
+	vlan_tag = le16_to_cpu(ixbuf->eop_desc->wb.l2tag1);
+	if (!(vlan_tag & VLAN_VID_MASK))
+		return -ENODATA;
+
+	*vlan_proto = htons(ETH_P_8021Q);
+	*vlan_tci = vlan_tag;
+	return 0;
+}
+
+/* The hardware RX timestamp is not reported by this driver yet */
+const struct xdp_metadata_ops ice_xdp_metadata_ops = {
+	.xmo_rx_hash		= ice_xdp_rx_hash,
+	.xmo_rx_vlan_tag	= ice_xdp_rx_vlan_tag,
+};
+
 /**
  * ice_rx_csum - Indicate in skb if checksum is good
  * @ring: the ring we care about
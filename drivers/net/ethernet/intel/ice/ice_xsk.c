@@ -412,9 +412,11 @@ int ice_xsk_pool_setup(struct ice_vsi *vsi, struct xsk_buff_pool *pool, u16 qid)
  */
 bool ice_alloc_rx_bufs_zc(struct ice_ring *rx_ring, u16 count)
 {
+	struct xdp_buff *xdp[ICE_XSK_ALLOC_BATCH];
 	union ice_32b_rx_flex_desc *rx_desc;
 	u16 ntu = rx_ring->next_to_use;
 	struct ice_rx_buf *rx_buf;
+	u32 nb_buffs, i;
 	bool ret = false;
 	dma_addr_t dma;
 
@@ -424,27 +426,37 @@ bool ice_alloc_rx_bufs_zc(struct ice_ring *rx_ring, u16 count)
 	rx_desc = ICE_RX_DESC(rx_ring, ntu);
 	rx_buf = &rx_ring->rx_buf[ntu];
 
+	/* The xdp pointers live in struct ice_rx_buf, so the pool fills a
+	 * small array on the stack that is then spread over the ring.
+	 */
 	do {
-		rx_buf->xdp = xsk_buff_alloc(rx_ring->xsk_pool);
-		if (!rx_buf->xdp) {
+		nb_buffs = xsk_buff_alloc_batch(rx_ring->xsk_pool, xdp,
+						min_t(u16, count,
+						      ICE_XSK_ALLOC_BATCH));
+		if (!nb_buffs) {
 			ret = true;
 			break;
 		}
 
-		dma = xsk_buff_xdp_get_dma(rx_buf->xdp);
-		rx_desc->read.pkt_addr = cpu_to_le64(dma);
-		rx_desc->wb.status_error0 = 0;
-
-		rx_desc++;
-		rx_buf++;
-		ntu++;
-
-		if (unlikely(ntu == rx_ring->count)) {
-			rx_desc = ICE_RX_DESC(rx_ring, 0);
-			rx_buf = rx_ring->rx_buf;
-			ntu = 0;
+		for (i = 0; i < nb_buffs; i++) {
+			rx_buf->xdp = xdp[i];
+			dma = xsk_buff_xdp_get_dma(xdp[i]);
+			rx_desc->read.pkt_addr = cpu_to_le64(dma);
+			rx_desc->wb.status_error0 = 0;
+
+			rx_desc++;
+			rx_buf++;
+			ntu++;
+
+			if (unlikely(ntu == rx_ring->count)) {
+				rx_desc = ICE_RX_DESC(rx_ring, 0);
+				rx_buf = rx_ring->rx_buf;
+				ntu = 0;
+			}
 		}
-	} while (--count);
+
+		count -= nb_buffs;
+	} while (count);
 
 	if (rx_ring->next_to_use != ntu) {
 		/* clear the status bits for the next_to_use descriptor */
@@ -669,55 +681,79 @@ int ice_clean_rx_irq_zc(struct ice_ring *rx_ring, int budget)
 }
 
 /**
- * ice_xmit_zc - Completes AF_XDP entries, and cleans XDP entries
+ * ice_xmit_pkt - Fill a Tx descriptor for one AF_XDP frame
  * @xdp_ring: XDP Tx ring
- * @budget: max number of frames to xmit
- *
- * Returns true if cleanup/transmission is done.
+ * @desc: AF_XDP descriptor of the frame
  */
-static bool ice_xmit_zc(struct ice_ring *xdp_ring, int budget)
+static void ice_xmit_pkt(struct ice_ring *xdp_ring, struct xdp_desc *desc)
 {
-	struct ice_tx_desc *tx_desc = NULL;
-	bool work_done = true;
-	struct xdp_desc desc;
+	struct ice_tx_desc *tx_desc;
 	dma_addr_t dma;
 
-	while (likely(budget-- > 0)) {
-		struct ice_tx_buf *tx_buf;
-
-		if (unlikely(!ICE_DESC_UNUSED(xdp_ring))) {
-			xdp_ring->tx_stats.tx_busy++;
-			work_done = false;
-			break;
-		}
-
-		tx_buf = &xdp_ring->tx_buf[xdp_ring->next_to_use];
+	dma = xsk_buff_raw_get_dma(xdp_ring->xsk_pool, desc->addr);
+	xsk_buff_raw_dma_sync_for_device(xdp_ring->xsk_pool, dma, desc->len);
 
-		if (!xsk_tx_peek_desc(xdp_ring->xsk_pool, &desc))
-			break;
+	xdp_ring->tx_buf[xdp_ring->next_to_use].bytecount = desc->len;
 
-		dma = xsk_buff_raw_get_dma(xdp_ring->xsk_pool, desc.addr);
-		xsk_buff_raw_dma_sync_for_device(xdp_ring->xsk_pool, dma,
-						 desc.len);
+	tx_desc = ICE_TX_DESC(xdp_ring, xdp_ring->next_to_use++);
+	tx_desc->buf_addr = cpu_to_le64(dma);
+	tx_desc->cmd_type_offset_bsz =
+		ice_build_ctob(ICE_TXD_LAST_DESC_CMD, 0, desc->len, 0);
+}
 
-		tx_buf->bytecount = desc.len;
+/**
+ * ice_fill_tx_hw_ring - Fill Tx descriptors for a run of AF_XDP frames
+ * @xdp_ring: XDP Tx ring
+ * @descs: AF_XDP descriptors of the frames
+ * @nb_pkts: number of frames, which must fit before the end of the ring
+ */
+static void ice_fill_tx_hw_ring(struct ice_ring *xdp_ring,
+				struct xdp_desc *descs, u32 nb_pkts)
+{
+	u32 i;
 
-		tx_desc = ICE_TX_DESC(xdp_ring, xdp_ring->next_to_use);
-		tx_desc->buf_addr = cpu_to_le64(dma);
-		tx_desc->cmd_type_offset_bsz =
-			ice_build_ctob(ICE_TXD_LAST_DESC_CMD, 0, desc.len, 0);
+	for (i = 0; i < nb_pkts; i++)
+		ice_xmit_pkt(xdp_ring, &descs[i]);
+}
 
-		xdp_ring->next_to_use++;
-		if (xdp_ring->next_to_use == xdp_ring->count)
-			xdp_ring->next_to_use = 0;
+/**
+ * ice_xmit_zc - Completes AF_XDP entries, and cleans XDP entries
+ * @xdp_ring: XDP Tx ring
+ * @budget: max number of frames to xmit
+ *
+ * Returns true if cleanup/transmission is done.
+ */
+static bool ice_xmit_zc(struct ice_ring *xdp_ring, int budget)
+{
+	u32 nb_pkts, nb_processed = 0;
+	u16 unused = ICE_DESC_UNUSED(xdp_ring);
+	bool ring_limited = false;
+	struct xdp_desc *descs;
+
+	if (unused < budget) {
+		budget = unused;
+		ring_limited = true;
 	}
 
-	if (tx_desc) {
-		ice_xdp_ring_update_tail(xdp_ring);
-		xsk_tx_release(xdp_ring->xsk_pool);
+	nb_pkts = xsk_tx_peek_release_desc_batch(xdp_ring->xsk_pool, budget);
+	if (ring_limited && nb_pkts == budget)
+		xdp_ring->tx_stats.tx_busy++;
+	if (!nb_pkts)
+		return !ring_limited;
+
+	descs = xdp_ring->xsk_pool->tx_descs;
+	if (xdp_ring->next_to_use + nb_pkts >= xdp_ring->count) {
+		nb_processed = xdp_ring->count - xdp_ring->next_to_use;
+		ice_fill_tx_hw_ring(xdp_ring, descs, nb_processed);
+		xdp_ring->next_to_use = 0;
 	}
 
-	return budget > 0 && work_done;
+	ice_fill_tx_hw_ring(xdp_ring, &descs[nb_processed],
+			    nb_pkts - nb_processed);
+
+	ice_xdp_ring_update_tail(xdp_ring);
+
+	return nb_pkts < budget;
 }
 
 /**
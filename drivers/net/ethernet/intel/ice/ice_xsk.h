@@ -8,6 +8,9 @@
 
 struct ice_vsi;
 
+/* Rx buffers taken from the pool per xsk_buff_alloc_batch() call */
+#define ICE_XSK_ALLOC_BATCH	32
+
 #ifdef CONFIG_XDP_SOCKETS
 int ice_xsk_pool_setup(struct ice_vsi *vsi, struct xsk_buff_pool *pool,
 		       u16 qid);
@@ -534,6 +534,8 @@ static int mlx5e_alloc_rq(struct mlx5e_channel *c,
 		}
 		err = xdp_rxq_info_reg_mem_model(&rq->xdp_rxq,
 						 MEM_TYPE_PAGE_POOL, rq->page_pool);
+		xdp_rxq_info_set_metadata_ops(&rq->xdp_rxq,
+					      &mlx5e_xdp_metadata_ops);
 	}
 	if (err)
 		goto err_free_by_rq_type;
@@ -56,10 +56,12 @@
 
 static struct sk_buff *
 mlx5e_skb_from_cqe_mpwrq_linear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *wi,
-				u16 cqe_bcnt, u32 head_offset, u32 page_idx);
+				struct mlx5_cqe64 *cqe, u16 cqe_bcnt,
+				u32 head_offset, u32 page_idx);
 static struct sk_buff *
 mlx5e_skb_from_cqe_mpwrq_nonlinear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *wi,
-				   u16 cqe_bcnt, u32 head_offset, u32 page_idx);
+				   struct mlx5_cqe64 *cqe, u16 cqe_bcnt,
+				   u32 head_offset, u32 page_idx);
 static void mlx5e_handle_rx_cqe(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe);
 static void mlx5e_handle_rx_cqe_mpwrq(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe);
 
@@ -850,6 +852,64 @@ static inline void mlx5e_skb_set_hash(struct mlx5_cqe64 *cqe,
 	skb_set_hash(skb, be32_to_cpu(cqe->rss_hash_result), ht);
 }
 
+static int mlx5e_xdp_rx_timestamp(const struct xdp_buff *xdp, u64 *timestamp)
+{
+	const struct mlx5e_xdp_buff *mxbuf = (void *)xdp;
+
+	if (unlikely(!mlx5e_rx_hw_stamp(mxbuf->rq->tstamp)))
+		return -ENODATA;
+
+	*timestamp = mlx5_timecounter_cyc2time(mxbuf->rq->clock,
+					       get_cqe_ts(mxbuf->cqe));
+	return 0;
+}
+
+/* Index is cqe->rss_hash_type[7:6] (L4) << 2 | cqe->rss_hash_type[3:2] (L3) */
+static const enum xdp_rss_hash_type mlx5e_xdp_rss_type[16] = {
+	[0x1] = XDP_RSS_TYPE_L3_IPV4,
+	[0x2] = XDP_RSS_TYPE_L3_IPV6,
+	[0x5] = XDP_RSS_TYPE_L4_IPV4_TCP,
+	[0x6] = XDP_RSS_TYPE_L4_IPV6_TCP,
+	[0x9] = XDP_RSS_TYPE_L4_IPV4_UDP,
+	[0xa] = XDP_RSS_TYPE_L4_IPV6_UDP,
+	[0xd] = XDP_RSS_TYPE_L4_IPV4_IPSEC,
+	[0xe] = XDP_RSS_TYPE_L4_IPV6_IPSEC,
+};
+
+static int mlx5e_xdp_rx_hash(const struct xdp_buff *xdp, u32 *hash,
+			     enum xdp_rss_hash_type *rss_type)
+{
+	const struct mlx5e_xdp_buff *mxbuf = (void *)xdp;
+	u8 cht = mxbuf->cqe->rss_hash_type;
+
+	if (unlikely(!(xdp->rxq->dev->features & NETIF_F_RXHASH)))
+		return -ENODATA;
+
+	*hash = be32_to_cpu(mxbuf->cqe->rss_hash_result);
+	*rss_type = mlx5e_xdp_rss_type[((cht & CQE_RSS_HTYPE_L4) >> 4) |
+				       ((cht & CQE_RSS_HTYPE_IP) >> 2)];
+	return 0;
+}
+
+static int mlx5e_xdp_rx_vlan_tag(const struct xdp_buff *xdp,
+				 __be16 *vlan_proto, u16 *vlan_tci)
+{
+	const struct mlx5e_xdp_buff *mxbuf = (void *)xdp;
+
+	if (!cqe_has_vlan(mxbuf->cqe))
+		return -ENODATA;
+
+	*vlan_proto = htons(ETH_P_8021Q);
+	*vlan_tci = be16_to_cpu(mxbuf->cqe->vlan_info);
+	return 0;
+}
+
+const struct xdp_metadata_ops mlx5e_xdp_metadata_ops = {
+	.xmo_rx_timestamp	= mlx5e_xdp_rx_timestamp,
+	.xmo_rx_hash		= mlx5e_xdp_rx_hash,
+	.xmo_rx_vlan_tag	= mlx5e_xdp_rx_vlan_tag,
+};
+
 static inline bool is_last_ethertype_ip(struct sk_buff *skb, int *network_depth,
 					__be16 *proto)
 {
@@ -1120,9 +1180,14 @@ struct sk_buff *mlx5e_build_linear_skb(struct mlx5e_rq *rq, void *va,
 	return skb;
 }
 
-static void mlx5e_fill_xdp_buff(struct mlx5e_rq *rq, void *va, u16 headroom,
-				u32 len, struct xdp_buff *xdp)
+static void mlx5e_fill_xdp_buff(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe,
+				void *va, u16 headroom, u32 len,
+				struct mlx5e_xdp_buff *mxbuf)
 {
+	struct xdp_buff *xdp = &mxbuf->xdp;
+
+	mxbuf->cqe = cqe;
+	mxbuf->rq = rq;
 	xdp->data_hard_start = va;
 	xdp->data = va + headroom;
 	xdp_set_data_meta_invalid(xdp);
@@ -1137,7 +1202,7 @@ mlx5e_skb_from_cqe_linear(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe,
 {
 	struct mlx5e_dma_info *di = wi->di;
 	u16 rx_headroom = rq->buff.headroom;
-	struct xdp_buff xdp;
+	struct mlx5e_xdp_buff mxbuf;
 	struct sk_buff *skb;
 	void *va, *data;
 	u32 frag_size;
@@ -1151,11 +1216,11 @@ mlx5e_skb_from_cqe_linear(struct mlx5e_rq *rq, struct mlx5_cqe64 *cqe,
 	net_prefetchw(va); /* xdp_frame data area */
 	net_prefetch(data);
 
-	mlx5e_fill_xdp_buff(rq, va, rx_headroom, cqe_bcnt, &xdp);
-	if (mlx5e_xdp_handle(rq, di, &cqe_bcnt, &xdp))
+	mlx5e_fill_xdp_buff(rq, cqe, va, rx_headroom, cqe_bcnt, &mxbuf);
+	if (mlx5e_xdp_handle(rq, di, &cqe_bcnt, &mxbuf.xdp))
 		return NULL; /* page/packet was consumed by XDP */
 
-	rx_headroom = xdp.data - xdp.data_hard_start;
+	rx_headroom = mxbuf.xdp.data - mxbuf.xdp.data_hard_start;
 	frag_size = MLX5_SKB_FRAG_SZ(rx_headroom + cqe_bcnt);
 	skb = mlx5e_build_linear_skb(rq, va, frag_size, rx_headroom, cqe_bcnt);
 	if (unlikely(!skb))
@@ -1366,7 +1431,7 @@ static void mlx5e_handle_rx_cqe_mpwrq_rep(struct mlx5e_rq *rq, struct mlx5_cqe64
 	skb = INDIRECT_CALL_2(rq->mpwqe.skb_from_cqe_mpwrq,
 			      mlx5e_skb_from_cqe_mpwrq_linear,
 			      mlx5e_skb_from_cqe_mpwrq_nonlinear,
-			      rq, wi, cqe_bcnt, head_offset, page_idx);
+			      rq, wi, cqe, cqe_bcnt, head_offset, page_idx);
 	if (!skb)
 		goto mpwrq_cqe_out;
 
@@ -1400,7 +1465,8 @@ const struct mlx5e_rx_handlers mlx5e_rx_handlers_rep = {
 
 static struct sk_buff *
 mlx5e_skb_from_cqe_mpwrq_nonlinear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *wi,
-				   u16 cqe_bcnt, u32 head_offset, u32 page_idx)
+				   struct mlx5_cqe64 *cqe, u16 cqe_bcnt,
+				   u32 head_offset, u32 page_idx)
 {
 	u16 headlen = min_t(u16, MLX5E_RX_MAX_HEAD, cqe_bcnt);
 	struct mlx5e_dma_info *di = &wi->umr.dma_info[page_idx];
@@ -1446,12 +1512,13 @@ mlx5e_skb_from_cqe_mpwrq_nonlinear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *w
 
 static struct sk_buff *
 mlx5e_skb_from_cqe_mpwrq_linear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *wi,
-				u16 cqe_bcnt, u32 head_offset, u32 page_idx)
+				struct mlx5_cqe64 *cqe, u16 cqe_bcnt,
+				u32 head_offset, u32 page_idx)
 {
 	struct mlx5e_dma_info *di = &wi->umr.dma_info[page_idx];
 	u16 rx_headroom = rq->buff.headroom;
 	u32 cqe_bcnt32 = cqe_bcnt;
-	struct xdp_buff xdp;
+	struct mlx5e_xdp_buff mxbuf;
 	struct sk_buff *skb;
 	void *va, *data;
 	u32 frag_size;
@@ -1471,14 +1538,14 @@ mlx5e_skb_from_cqe_mpwrq_linear(struct mlx5e_rq *rq, struct mlx5e_mpw_info *wi,
 	net_prefetchw(va); /* xdp_frame data area */
 	net_prefetch(data);
 
-	mlx5e_fill_xdp_buff(rq, va, rx_headroom, cqe_bcnt32, &xdp);
-	if (mlx5e_xdp_handle(rq, di, &cqe_bcnt32, &xdp)) {
+	mlx5e_fill_xdp_buff(rq, cqe, va, rx_headroom, cqe_bcnt32, &mxbuf);
+	if (mlx5e_xdp_handle(rq, di, &cqe_bcnt32, &mxbuf.xdp)) {
 		if (__test_and_clear_bit(MLX5E_RQ_FLAG_XDP_XMIT, rq->flags))
 			__set_bit(page_idx, wi->xdp_xmit_bitmap); /* non-atomic */
 		return NULL; /* page/packet was consumed by XDP */
 	}
 
-	rx_headroom = xdp.data - xdp.data_hard_start;
+	rx_headroom = mxbuf.xdp.data - mxbuf.xdp.data_hard_start;
 	frag_size = MLX5_SKB_FRAG_SZ(rx_headroom + cqe_bcnt32);
 	skb = mlx5e_build_linear_skb(rq, va, frag_size, rx_headroom, cqe_bcnt32);
 	if (unlikely(!skb))
@@ -1525,7 +1592,7 @@ static void mlx5e_handle_rx_cqe_mpwrq(struct mlx5e_rq *rq, struct mlx5_cqe64 *cq
 	skb = INDIRECT_CALL_2(rq->mpwqe.skb_from_cqe_mpwrq,
 			      mlx5e_skb_from_cqe_mpwrq_linear,
 			      mlx5e_skb_from_cqe_mpwrq_nonlinear,
-			      rq, wi, cqe_bcnt, head_offset, page_idx);
+			      rq, wi, cqe, cqe_bcnt, head_offset, page_idx);
 	if (!skb)
 		goto mpwrq_cqe_out;
 
@@ -78,6 +78,12 @@ struct veth_xdp_tx_bq {
 	unsigned int count;
 };
 
+/* xdp_buff handed to XDP programs, @skb is NULL for xdp_frames */
+struct veth_xdp_buff {
+	struct xdp_buff xdp;
+	struct sk_buff *skb;
+};
+
 /*
  * ethtool interface
  */
@@ -544,6 +550,52 @@ static void veth_xdp_flush(struct veth_rq *rq, struct veth_xdp_tx_bq *bq)
 	rcu_read_unlock();
 }
 
+static int veth_xdp_rx_timestamp(const struct xdp_buff *xdp, u64 *timestamp)
+{
+	const struct veth_xdp_buff *vxbuf = (void *)xdp;
+
+	if (!vxbuf->skb || !skb_hwtstamps(vxbuf->skb)->hwtstamp)
+		return -ENODATA;
+
+	*timestamp = skb_hwtstamps(vxbuf->skb)->hwtstamp;
+	return 0;
+}
+
+static int veth_xdp_rx_hash(const struct xdp_buff *xdp, u32 *hash,
+			    enum xdp_rss_hash_type *rss_type)
+{
+	const struct veth_xdp_buff *vxbuf = (void *)xdp;
+	struct sk_buff *skb = vxbuf->skb;
+
+	if (!skb)
+		return -ENODATA;
+
+	*hash = skb_get_hash(skb);
+	*rss_type = skb->l4_hash ? XDP_RSS_TYPE_L4_ANY : XDP_RSS_TYPE_NONE;
+
+	return 0;
+}
+
+static int veth_xdp_rx_vlan_tag(const struct xdp_buff *xdp, __be16 *vlan_proto,
+				u16 *vlan_tci)
+{
+	const struct veth_xdp_buff *vxbuf = (void *)xdp;
+	struct sk_buff *skb = vxbuf->skb;
+
+	if (!skb || !skb_vlan_tag_present(skb))
+		return -ENODATA;
+
+	*vlan_proto = skb->vlan_proto;
+	*vlan_tci = skb_vlan_tag_get(skb);
+	return 0;
+}
+
+static const struct xdp_metadata_ops veth_xdp_metadata_ops = {
+	.xmo_rx_timestamp	= veth_xdp_rx_timestamp,
+	.xmo_rx_hash		= veth_xdp_rx_hash,
+	.xmo_rx_vlan_tag	= veth_xdp_rx_vlan_tag,
+};
+
 static int veth_xdp_tx(struct veth_rq *rq, struct xdp_buff *xdp,
 		       struct veth_xdp_tx_bq *bq)
 {
@@ -578,23 +630,25 @@ static struct sk_buff *veth_xdp_rcv_one(struct veth_rq *rq,
 	rcu_read_lock();
 	xdp_prog = rcu_dereference(rq->xdp_prog);
 	if (likely(xdp_prog)) {
-		struct xdp_buff xdp;
+		struct veth_xdp_buff vxbuf;
+		struct xdp_buff *xdp = &vxbuf.xdp;
 		u32 act;
 
-		xdp_convert_frame_to_buff(frame, &xdp);
-		xdp.rxq = &rq->xdp_rxq;
+		xdp_convert_frame_to_buff(frame, xdp);
+		xdp->rxq = &rq->xdp_rxq;
+		vxbuf.skb = NULL;
 
-		act = bpf_prog_run_xdp(xdp_prog, &xdp);
+		act = bpf_prog_run_xdp(xdp_prog, xdp);
 
 		switch (act) {
 		case XDP_PASS:
-			delta = frame->data - xdp.data;
-			len = xdp.data_end - xdp.data;
+			delta = frame->data - xdp->data;
+			len = xdp->data_end - xdp->data;
 			break;
 		case XDP_TX:
 			orig_frame = *frame;
-			xdp.rxq->mem = frame->mem;
-			if (unlikely(veth_xdp_tx(rq, &xdp, bq) < 0)) {
+			xdp->rxq->mem = frame->mem;
+			if (unlikely(veth_xdp_tx(rq, xdp, bq) < 0)) {
 				trace_xdp_exception(rq->dev, xdp_prog, act);
 				frame = &orig_frame;
 				stats->rx_drops++;
@@ -605,8 +659,8 @@ static struct sk_buff *veth_xdp_rcv_one(struct veth_rq *rq,
 			goto xdp_xmit;
 		case XDP_REDIRECT:
 			orig_frame = *frame;
-			xdp.rxq->mem = frame->mem;
-			if (xdp_do_redirect(rq->dev, &xdp, xdp_prog)) {
+			xdp->rxq->mem = frame->mem;
+			if (xdp_do_redirect(rq->dev, xdp, xdp_prog)) {
 				frame = &orig_frame;
 				stats->rx_drops++;
 				goto err_xdp;
@@ -655,8 +709,9 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 	u32 pktlen, headroom, act, metalen;
 	void *orig_data, *orig_data_end;
 	struct bpf_prog *xdp_prog;
+	struct veth_xdp_buff vxbuf;
+	struct xdp_buff *xdp = &vxbuf.xdp;
 	int mac_len, delta, off;
-	struct xdp_buff xdp;
 
 	skb_orphan(skb);
 
@@ -708,29 +763,30 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 		skb = nskb;
 	}
 
-	xdp.data_hard_start = skb->head;
-	xdp.data = skb_mac_header(skb);
-	xdp.data_end = xdp.data + pktlen;
-	xdp.data_meta = xdp.data;
-	xdp.rxq = &rq->xdp_rxq;
+	xdp->data_hard_start = skb->head;
+	xdp->data = skb_mac_header(skb);
+	xdp->data_end = xdp->data + pktlen;
+	xdp->data_meta = xdp->data;
+	xdp->rxq = &rq->xdp_rxq;
+	vxbuf.skb = skb;
 
 	/* SKB "head" area always have tailroom for skb_shared_info */
-	xdp.frame_sz = (void *)skb_end_pointer(skb) - xdp.data_hard_start;
-	xdp.frame_sz += SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
+	xdp->frame_sz = (void *)skb_end_pointer(skb) - xdp->data_hard_start;
+	xdp->frame_sz += SKB_DATA_ALIGN(sizeof(struct skb_shared_info));
 
-	orig_data = xdp.data;
-	orig_data_end = xdp.data_end;
+	orig_data = xdp->data;
+	orig_data_end = xdp->data_end;
 
-	act = bpf_prog_run_xdp(xdp_prog, &xdp);
+	act = bpf_prog_run_xdp(xdp_prog, xdp);
 
 	switch (act) {
 	case XDP_PASS:
 		break;
 	case XDP_TX:
-		get_page(virt_to_page(xdp.data));
+		get_page(virt_to_page(xdp->data));
 		consume_skb(skb);
-		xdp.rxq->mem = rq->xdp_mem;
-		if (unlikely(veth_xdp_tx(rq, &xdp, bq) < 0)) {
+		xdp->rxq->mem = rq->xdp_mem;
+		if (unlikely(veth_xdp_tx(rq, xdp, bq) < 0)) {
 			trace_xdp_exception(rq->dev, xdp_prog, act);
 			stats->rx_drops++;
 			goto err_xdp;
@@ -739,10 +795,10 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 		rcu_read_unlock();
 		goto xdp_xmit;
 	case XDP_REDIRECT:
-		get_page(virt_to_page(xdp.data));
+		get_page(virt_to_page(xdp->data));
 		consume_skb(skb);
-		xdp.rxq->mem = rq->xdp_mem;
-		if (xdp_do_redirect(rq->dev, &xdp, xdp_prog)) {
+		xdp->rxq->mem = rq->xdp_mem;
+		if (xdp_do_redirect(rq->dev, xdp, xdp_prog)) {
 			stats->rx_drops++;
 			goto err_xdp;
 		}
@@ -762,7 +818,7 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 	rcu_read_unlock();
 
 	/* check if bpf_xdp_adjust_head was used */
-	delta = orig_data - xdp.data;
+	delta = orig_data - xdp->data;
 	off = mac_len + delta;
 	if (off > 0)
 		__skb_push(skb, off);
@@ -771,12 +827,12 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 	skb->mac_header -= delta;
 
 	/* check if bpf_xdp_adjust_tail was used */
-	off = xdp.data_end - orig_data_end;
+	off = xdp->data_end - orig_data_end;
 	if (off != 0)
 		__skb_put(skb, off); /* positive on grow, negative on shrink */
 	skb->protocol = eth_type_trans(skb, rq->dev);
 
-	metalen = xdp.data - xdp.data_meta;
+	metalen = xdp->data - xdp->data_meta;
 	if (metalen)
 		skb_metadata_set(skb, metalen);
 out:
@@ -789,7 +845,7 @@ static struct sk_buff *veth_xdp_rcv_skb(struct veth_rq *rq,
 	return NULL;
 err_xdp:
 	rcu_read_unlock();
-	page_frag_free(xdp.data);
+	page_frag_free(xdp->data);
 xdp_xmit:
 	return NULL;
 }
@@ -936,6 +992,8 @@ static int veth_enable_xdp(struct net_device *dev)
 
 			/* Save original mem info as it can be overwritten */
 			rq->xdp_mem = rq->xdp_rxq.mem;
+			xdp_rxq_info_set_metadata_ops(&rq->xdp_rxq,
+						      &veth_xdp_metadata_ops);
 		}
 
 		err = veth_napi_add(dev);
@@ -1264,6 +1322,7 @@ static void veth_setup(struct net_device *dev)
 	dev->hw_features = VETH_FEATURES;
 	dev->hw_enc_features = VETH_FEATURES;
 	dev->mpls_features = NETIF_F_HW_CSUM | NETIF_F_GSO_SOFTWARE;
+	netif_set_tso_max_size(dev, GSO_MAX_SIZE);
 }
 
 /*
@@ -21,6 +21,7 @@
 #include <linux/kernel.h>
 #include <net/route.h>
 #include <net/xdp.h>
+#include <net/page_pool.h>
 #include <net/net_failover.h>
 
 static int napi_weight = NAPI_POLL_WEIGHT;
@@ -37,6 +38,9 @@ module_param(napi_tx, bool, 0644);
 
 #define VIRTNET_RX_PAD (NET_IP_ALIGN + NET_SKB_PAD)
 
+/* Completed TX buffers reaped per virtqueue_get_buf_batch() call */
+#define VIRTNET_TX_FREE_BATCH	16
+
 /* Amount of XDP headroom to prepend to packets for use by xdp_adjust_head */
 #define VIRTIO_XDP_HEADROOM 256
 
@@ -155,6 +159,11 @@ struct receive_queue {
 	/* Page frag for packet buffer allocation. */
 	struct page_frag alloc_frag;
 
+	/* Full pages for mergeable buffers with XDP headroom, recycled on
+	 * XDP_DROP, on completion of XDP_TX/XDP_REDIRECT and on skb free.
+	 */
+	struct page_pool *page_pool;
+
 	/* RX: fragments + linear part + virtio header */
 	struct scatterlist sg[MAX_SKB_FRAGS + 2];
 
@@ -374,6 +383,17 @@ static unsigned int mergeable_ctx_to_truesize(void *mrg_ctx)
 	return (unsigned long)mrg_ctx & ((1 << MRG_CTX_HEADER_SHIFT) - 1);
 }
 
+/* Drop a page of a mergeable buffer, recycling it if it came from the
+ * page_pool of the queue. @allow_direct is only safe from NAPI context.
+ */
+static void virtnet_put_page(struct page *page, bool allow_direct)
+{
+	if (page_is_page_pool(page))
+		page_pool_put_full_page(page->pp, page, allow_direct);
+	else
+		put_page(page);
+}
+
 /* Called from bottom half context */
 static struct sk_buff *page_to_skb(struct virtnet_info *vi,
 				   struct receive_queue *rq,
@@ -427,10 +447,12 @@ static struct sk_buff *page_to_skb(struct virtnet_info *vi,
 	offset += copy;
 
 	if (vi->mergeable_rx_bufs) {
+		if (rq->page_pool)
+			skb_mark_for_recycle(skb);
 		if (len)
 			skb_add_rx_frag(skb, 0, page, offset, len, truesize);
 		else
-			put_page(page);
+			virtnet_put_page(page, true);
 		return skb;
 	}
 
@@ -626,8 +648,15 @@ static struct page *xdp_linearize_page(struct receive_queue *rq,
 				       int page_off,
 				       unsigned int *len)
 {
-	struct page *page = alloc_page(GFP_ATOMIC);
+	struct page *page;
 
+	/* XDP_TX and XDP_REDIRECT hand the page back to the memory model
+	 * of the queue, which is the page_pool if there is one.
+	 */
+	if (rq->page_pool)
+		page = page_pool_alloc_pages(rq->page_pool, GFP_ATOMIC);
+	else
+		page = alloc_page(GFP_ATOMIC);
 	if (!page)
 		return NULL;
 
@@ -651,21 +680,21 @@ static struct page *xdp_linearize_page(struct receive_queue *rq,
 		 * is sending packet larger than the MTU.
 		 */
 		if ((page_off + buflen + tailroom) > PAGE_SIZE) {
-			put_page(p);
+			virtnet_put_page(p, true);
 			goto err_buf;
 		}
 
 		memcpy(page_address(page) + page_off,
 		       page_address(p) + off, buflen);
 		page_off += buflen;
-		put_page(p);
+		virtnet_put_page(p, true);
 	}
 
 	/* Headroom does not contribute to packet length */
 	*len = page_off - VIRTIO_XDP_HEADROOM;
 	return page;
 err_buf:
-	__free_pages(page, 0);
+	virtnet_put_page(page, true);
 	return NULL;
 }
 
@@ -938,7 +967,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			/* We can only create skb based on xdp_page. */
 			if (unlikely(xdp_page != page)) {
 				rcu_read_unlock();
-				put_page(page);
+				virtnet_put_page(page, true);
 				head_skb = page_to_skb(vi, rq, xdp_page, offset,
 						       len, PAGE_SIZE, false,
 						       metasize);
@@ -954,12 +983,12 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			if (unlikely(err < 0)) {
 				trace_xdp_exception(vi->dev, xdp_prog, act);
 				if (unlikely(xdp_page != page))
-					put_page(xdp_page);
+					virtnet_put_page(xdp_page, true);
 				goto err_xdp;
 			}
 			*xdp_xmit |= VIRTIO_XDP_TX;
 			if (unlikely(xdp_page != page))
-				put_page(page);
+				virtnet_put_page(page, true);
 			rcu_read_unlock();
 			goto xdp_xmit;
 		case XDP_REDIRECT:
@@ -967,12 +996,12 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			err = xdp_do_redirect(dev, &xdp, xdp_prog);
 			if (err) {
 				if (unlikely(xdp_page != page))
-					put_page(xdp_page);
+					virtnet_put_page(xdp_page, true);
 				goto err_xdp;
 			}
 			*xdp_xmit |= VIRTIO_XDP_REDIR;
 			if (unlikely(xdp_page != page))
-				put_page(page);
+				virtnet_put_page(page, true);
 			rcu_read_unlock();
 			goto xdp_xmit;
 		default:
@@ -983,7 +1012,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 			fallthrough;
 		case XDP_DROP:
 			if (unlikely(xdp_page != page))
-				__free_pages(xdp_page, 0);
+				virtnet_put_page(xdp_page, true);
 			goto err_xdp;
 		}
 	}
@@ -1025,6 +1054,8 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 
 			if (unlikely(!nskb))
 				goto err_skb;
+			if (rq->page_pool)
+				skb_mark_for_recycle(nskb);
 			if (curr_skb == head_skb)
 				skb_shinfo(curr_skb)->frag_list = nskb;
 			else
@@ -1040,7 +1071,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 		}
 		offset = buf - page_address(page);
 		if (skb_can_coalesce(curr_skb, num_skb_frags, page, offset)) {
-			put_page(page);
+			virtnet_put_page(page, true);
 			skb_coalesce_rx_frag(curr_skb, num_skb_frags - 1,
 					     len, truesize);
 		} else {
@@ -1056,7 +1087,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 	rcu_read_unlock();
 	stats->xdp_drops++;
 err_skb:
-	put_page(page);
+	virtnet_put_page(page, true);
 	while (num_buf-- > 1) {
 		buf = virtqueue_get_buf(rq->vq, &len);
 		if (unlikely(!buf)) {
@@ -1067,7 +1098,7 @@ static struct sk_buff *receive_mergeable(struct net_device *dev,
 		}
 		stats->bytes += len;
 		page = virt_to_head_page(buf);
-		put_page(page);
+		virtnet_put_page(page, true);
 	}
 err_buf:
 	stats->drops++;
@@ -1089,7 +1120,7 @@ static void receive_buf(struct virtnet_info *vi, struct receive_queue *rq,
 		pr_debug("%s: short packet %i\n", dev->name, len);
 		dev->stats.rx_length_errors++;
 		if (vi->mergeable_rx_bufs) {
-			put_page(virt_to_head_page(buf));
+			virtnet_put_page(virt_to_head_page(buf), true);
 		} else if (vi->big_packets) {
 			give_pages(rq, buf);
 		} else {
@@ -1248,6 +1279,20 @@ static int add_recvbuf_mergeable(struct virtnet_info *vi,
 	 * disabled GSO for XDP, it won't be a big issue.
 	 */
 	len = get_mergeable_buf_len(rq, &rq->mrg_avg_pkt_len, room);
+
+	/* With XDP every buffer takes a full page, so it can come straight
+	 * from the page_pool and go back there once XDP or the stack is
+	 * done with it.
+	 */
+	if (headroom && rq->page_pool) {
+		struct page *page = page_pool_alloc_pages(rq->page_pool, gfp);
+
+		if (unlikely(!page))
+			return -ENOMEM;
+		buf = (char *)page_address(page) + headroom;
+		goto add_buf;
+	}
+
 	if (unlikely(!skb_page_frag_refill(len + room, alloc_frag, gfp)))
 		return -ENOMEM;
 
@@ -1265,11 +1310,12 @@ static int add_recvbuf_mergeable(struct virtnet_info *vi,
 		alloc_frag->offset += hole;
 	}
 
+add_buf:
 	sg_init_one(rq->sg, buf, len);
 	ctx = mergeable_len_to_ctx(len, headroom);
 	err = virtqueue_add_inbuf_ctx(rq->vq, rq->sg, 1, buf, ctx, gfp);
 	if (err < 0)
-		put_page(virt_to_head_page(buf));
+		virtnet_put_page(virt_to_head_page(buf), false);
 
 	return err;
 }
@@ -1287,6 +1333,7 @@ static bool try_fill_recv(struct virtnet_info *vi, struct receive_queue *rq,
 	int err;
 	bool oom;
 
+	virtqueue_add_batch_start(rq->vq);
 	do {
 		if (vi->mergeable_rx_bufs)
 			err = add_recvbuf_mergeable(vi, rq, gfp);
@@ -1299,6 +1346,7 @@ static bool try_fill_recv(struct virtnet_info *vi, struct receive_queue *rq,
 		if (err)
 			break;
 	} while (rq->vq->num_free);
+	virtqueue_add_batch_end(rq->vq);
 	if (virtqueue_kick_prepare(rq->vq) && virtqueue_notify(rq->vq)) {
 		unsigned long flags;
 
@@ -1422,26 +1470,31 @@ static int virtnet_receive(struct receive_queue *rq, int budget,
 
 static void free_old_xmit_skbs(struct send_queue *sq, bool in_napi)
 {
-	unsigned int len;
+	void *ptrs[VIRTNET_TX_FREE_BATCH];
 	unsigned int packets = 0;
 	unsigned int bytes = 0;
-	void *ptr;
+	unsigned int i, n;
 
-	while ((ptr = virtqueue_get_buf(sq->vq, &len)) != NULL) {
-		if (likely(!is_xdp_frame(ptr))) {
-			struct sk_buff *skb = ptr;
+	while ((n = virtqueue_get_buf_batch(sq->vq, ptrs, NULL, NULL,
+					    ARRAY_SIZE(ptrs)))) {
+		for (i = 0; i < n; i++) {
+			void *ptr = ptrs[i];
 
-			pr_debug("Sent skb %p\n", skb);
+			if (likely(!is_xdp_frame(ptr))) {
+				struct sk_buff *skb = ptr;
 
-			bytes += skb->len;
-			napi_consume_skb(skb, in_napi);
-		} else {
-			struct xdp_frame *frame = ptr_to_xdp(ptr);
+				pr_debug("Sent skb %p\n", skb);
 
-			bytes += frame->len;
-			xdp_return_frame(frame);
+				bytes += skb->len;
+				napi_consume_skb(skb, in_napi);
+			} else {
+				struct xdp_frame *frame = ptr_to_xdp(ptr);
+
+				bytes += frame->len;
+				xdp_return_frame(frame);
+			}
 		}
-		packets++;
+		packets += n;
 	}
 
 	/* Avoid overhead when no packets have been processed
@@ -1533,8 +1586,14 @@ static int virtnet_open(struct net_device *dev)
 		if (err < 0)
 			return err;
 
-		err = xdp_rxq_info_reg_mem_model(&vi->rq[i].xdp_rxq,
-						 MEM_TYPE_PAGE_SHARED, NULL);
+		if (vi->rq[i].page_pool)
+			err = xdp_rxq_info_reg_mem_model(&vi->rq[i].xdp_rxq,
+							 MEM_TYPE_PAGE_POOL,
+							 vi->rq[i].page_pool);
+		else
+			err = xdp_rxq_info_reg_mem_model(&vi->rq[i].xdp_rxq,
+							 MEM_TYPE_PAGE_SHARED,
+							 NULL);
 		if (err < 0) {
 			xdp_rxq_info_unreg(&vi->rq[i].xdp_rxq);
 			return err;
@@ -2680,6 +2739,8 @@ static void virtnet_free_queues(struct virtnet_info *vi)
 	for (i = 0; i < vi->max_queue_pairs; i++) {
 		__netif_napi_del(&vi->rq[i].napi);
 		__netif_napi_del(&vi->sq[i].napi);
+		/* in-flight pages keep the pool alive until they return */
+		page_pool_destroy(vi->rq[i].page_pool);
 	}
 
 	/* We called __netif_napi_del(),
@@ -2743,7 +2804,7 @@ static void free_unused_bufs(struct virtnet_info *vi)
 
 		while ((buf = virtqueue_detach_unused_buf(vq)) != NULL) {
 			if (vi->mergeable_rx_bufs) {
-				put_page(virt_to_head_page(buf));
+				virtnet_put_page(virt_to_head_page(buf), false);
 			} else if (vi->big_packets) {
 				give_pages(&vi->rq[i], buf);
 			} else {
@@ -2904,6 +2965,34 @@ static int virtnet_alloc_queues(struct virtnet_info *vi)
 	return -ENOMEM;
 }
 
+static int virtnet_create_page_pools(struct virtnet_info *vi)
+{
+	int i;
+
+	/* Only mergeable buffers use full pages, for XDP */
+	if (!vi->mergeable_rx_bufs)
+		return 0;
+
+	for (i = 0; i < vi->max_queue_pairs; i++) {
+		struct receive_queue *rq = &vi->rq[i];
+		struct page_pool_params pp_params = {
+			.order = 0,
+			.pool_size = virtqueue_get_vring_size(rq->vq),
+			.nid = dev_to_node(&vi->vdev->dev),
+			.dev = &vi->vdev->dev,
+			.dma_dir = DMA_FROM_DEVICE,
+		};
+		struct page_pool *pool;
+
+		pool = page_pool_create(&pp_params);
+		if (IS_ERR(pool))
+			return PTR_ERR(pool);
+		rq->page_pool = pool;
+	}
+
+	return 0;
+}
+
 static int init_vqs(struct virtnet_info *vi)
 {
 	int ret;
@@ -2917,12 +3006,18 @@ static int init_vqs(struct virtnet_info *vi)
 	if (ret)
 		goto err_free;
 
+	ret = virtnet_create_page_pools(vi);
+	if (ret)
+		goto err_del_vqs;
+
 	get_online_cpus();
 	virtnet_set_affinity(vi);
 	put_online_cpus();
 
 	return 0;
 
+err_del_vqs:
+	vi->vdev->config->del_vqs(vi->vdev);
 err_free:
 	virtnet_free_queues(vi);
 err:
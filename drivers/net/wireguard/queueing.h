@@ -62,6 +62,7 @@ struct packet_cb {
 	atomic_t state;
 	u32 mtu;
 	u8 ds;
+	u8 nr_frags;
 };
 
 #define PACKET_CB(skb) ((struct packet_cb *)((skb)->cb))
@@ -246,9 +246,9 @@ static void keep_key_fresh(struct wg_peer *peer)
 	}
 }
 
-static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+static bool decrypt_packet_prepare(struct sk_buff *skb,
+				   struct noise_keypair *keypair)
 {
-	struct scatterlist sg[MAX_SKB_FRAGS + 8];
 	struct sk_buff *trailer;
 	unsigned int offset;
 	int num_frags;
@@ -275,10 +275,18 @@ static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
 	num_frags = skb_cow_data(skb, 0, &trailer);
 	offset += sizeof(struct message_data);
 	skb_pull(skb, offset);
-	if (unlikely(num_frags < 0 || num_frags > ARRAY_SIZE(sg)))
+	if (unlikely(num_frags < 0 || num_frags > MAX_SKB_FRAGS + 8))
 		return false;
+	PACKET_CB(skb)->nr_frags = num_frags;
+	return true;
+}
+
+static bool decrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+{
+	struct scatterlist sg[MAX_SKB_FRAGS + 8];
+	unsigned int offset = skb->data - skb_network_header(skb);
 
-	sg_init_table(sg, num_frags);
+	sg_init_table(sg, PACKET_CB(skb)->nr_frags);
 	if (skb_to_sgvec(skb, sg, 0, skb->len) <= 0)
 		return false;
 
@@ -501,13 +509,32 @@ void wg_packet_decrypt_worker(struct work_struct *work)
 {
 	struct crypt_queue *queue = container_of(work, struct multicore_worker,
 						 work)->ptr;
-	struct sk_buff *skb;
+	struct sk_buff *batch[MAX_CRYPT_BATCH];
+	enum packet_state state;
+	int i, n;
 
-	while ((skb = ptr_ring_consume_bh(&queue->ring)) != NULL) {
-		enum packet_state state =
-			likely(decrypt_packet(skb, PACKET_CB(skb)->keypair)) ?
-				PACKET_STATE_CRYPTED : PACKET_STATE_DEAD;
-		wg_queue_enqueue_per_peer_rx(skb, state);
+	/* As on the send side, take a batch off the ring at once and do the
+	 * setup for all of it before decrypting any of it.
+	 */
+	while ((n = ptr_ring_consume_batched_bh(&queue->ring, (void **)batch,
+						ARRAY_SIZE(batch))) > 0) {
+		for (i = 0; i < n; ++i) {
+			if (unlikely(!decrypt_packet_prepare(batch[i],
+					PACKET_CB(batch[i])->keypair))) {
+				wg_queue_enqueue_per_peer_rx(batch[i],
+							     PACKET_STATE_DEAD);
+				batch[i] = NULL;
+			}
+		}
+
+		for (i = 0; i < n; ++i) {
+			if (!batch[i])
+				continue;
+			state = likely(decrypt_packet(batch[i],
+						PACKET_CB(batch[i])->keypair)) ?
+					PACKET_STATE_CRYPTED : PACKET_STATE_DEAD;
+			wg_queue_enqueue_per_peer_rx(batch[i], state);
+		}
 		if (need_resched())
 			cond_resched();
 	}
@@ -159,10 +159,14 @@ static unsigned int calculate_skb_padding(struct sk_buff *skb)
 	return padded_size - last_unit;
 }
 
-static bool encrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+/* Everything but the actual encryption: padding, headers, checksums. Done for a
+ * whole batch before any of it is encrypted, so that the crypto runs back to
+ * back instead of being interleaved with per-packet setup.
+ */
+static bool encrypt_packet_prepare(struct sk_buff *skb,
+				   struct noise_keypair *keypair)
 {
-	unsigned int padding_len, plaintext_len, trailer_len;
-	struct scatterlist sg[MAX_SKB_FRAGS + 8];
+	unsigned int padding_len, trailer_len;
 	struct message_data *header;
 	struct sk_buff *trailer;
 	int num_frags;
@@ -175,12 +179,12 @@ static bool encrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
 	/* Calculate lengths. */
 	padding_len = calculate_skb_padding(skb);
 	trailer_len = padding_len + noise_encrypted_len(0);
-	plaintext_len = skb->len + padding_len;
 
 	/* Expand data section to have room for padding and auth tag. */
 	num_frags = skb_cow_data(skb, trailer_len, &trailer);
-	if (unlikely(num_frags < 0 || num_frags > ARRAY_SIZE(sg)))
+	if (unlikely(num_frags < 0 || num_frags > MAX_SKB_FRAGS + 8))
 		return false;
+	PACKET_CB(skb)->nr_frags = num_frags;
 
 	/* Set the padding to zeros, and make sure it and the auth tag are part
 	 * of the skb.
@@ -207,9 +211,16 @@ static bool encrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
 	header->key_idx = keypair->remote_index;
 	header->counter = cpu_to_le64(PACKET_CB(skb)->nonce);
 	pskb_put(skb, trailer, trailer_len);
+	return true;
+}
+
+static bool encrypt_packet(struct sk_buff *skb, struct noise_keypair *keypair)
+{
+	unsigned int plaintext_len = skb->len - message_data_len(0);
+	struct scatterlist sg[MAX_SKB_FRAGS + 8];
 
 	/* Now we can encrypt the scattergather segments */
-	sg_init_table(sg, num_frags);
+	sg_init_table(sg, PACKET_CB(skb)->nr_frags);
 	if (skb_to_sgvec(skb, sg, sizeof(struct message_data),
 			 noise_encrypted_len(plaintext_len)) <= 0)
 		return false;
@@ -288,21 +299,42 @@ void wg_packet_encrypt_worker(struct work_struct *work)
 {
 	struct crypt_queue *queue = container_of(work, struct multicore_worker,
 						 work)->ptr;
+	struct sk_buff *batch[MAX_CRYPT_BATCH];
 	struct sk_buff *first, *skb, *next;
+	int i, n;
+
+	while ((n = ptr_ring_consume_batched_bh(&queue->ring, (void **)batch,
+						ARRAY_SIZE(batch))) > 0) {
+		for (i = 0; i < n; ++i) {
+			first = batch[i];
+			skb_list_walk_safe(first, skb, next) {
+				if (unlikely(!encrypt_packet_prepare(skb,
+						PACKET_CB(first)->keypair))) {
+					wg_queue_enqueue_per_peer_tx(first,
+							PACKET_STATE_DEAD);
+					batch[i] = NULL;
+					break;
+				}
+			}
+		}
 
-	while ((first = ptr_ring_consume_bh(&queue->ring)) != NULL) {
-		enum packet_state state = PACKET_STATE_CRYPTED;
-
-		skb_list_walk_safe(first, skb, next) {
-			if (likely(encrypt_packet(skb,
-					PACKET_CB(first)->keypair))) {
-				wg_reset_packet(skb, true);
-			} else {
-				state = PACKET_STATE_DEAD;
-				break;
+		for (i = 0; i < n; ++i) {
+			enum packet_state state = PACKET_STATE_CRYPTED;
+
+			first = batch[i];
+			if (!first)
+				continue;
+			skb_list_walk_safe(first, skb, next) {
+				if (likely(encrypt_packet(skb,
+						PACKET_CB(first)->keypair))) {
+					wg_reset_packet(skb, true);
+				} else {
+					state = PACKET_STATE_DEAD;
+					break;
+				}
 			}
+			wg_queue_enqueue_per_peer_tx(first, state);
 		}
-		wg_queue_enqueue_per_peer_tx(first, state);
 		if (need_resched())
 			cond_resched();
 	}
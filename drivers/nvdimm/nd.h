@@ -157,6 +157,9 @@ struct nd_region {
 	struct nd_interleave_set *nd_set;
 	struct nd_percpu_lane __percpu *lane;
 	int (*flush)(struct nd_region *nd_region, struct bio *bio);
+	spinlock_t flush_lock;
+	struct list_head flush_pending;
+	struct work_struct flush_work;
 	struct nd_mapping mapping[];
 };
 
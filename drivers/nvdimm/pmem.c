@@ -189,6 +189,44 @@ static blk_status_t pmem_do_write(struct pmem_device *pmem,
 	return rc;
 }
 
+struct pmem_flush_req {
+	struct nvdimm_flush_req req;
+	struct bio *bio;
+};
+
+static void pmem_flush_end(struct nvdimm_flush_req *req, int rc)
+{
+	struct pmem_flush_req *pfr = container_of(req, typeof(*pfr), req);
+	struct bio *bio = pfr->bio;
+
+	if (rc && !bio->bi_status)
+		bio->bi_status = errno_to_blk_status(rc);
+	kfree(pfr);
+	bio_endio(bio);
+}
+
+/*
+ * A flush of an asynchronous region is a round trip to the host, so FUA
+ * writes issued concurrently share one flush and complete from it instead
+ * of each flushing on their own in the submitter's context.
+ */
+static bool pmem_flush_async(struct nd_region *nd_region, struct bio *bio)
+{
+	struct pmem_flush_req *pfr;
+
+	if (!test_bit(ND_REGION_ASYNC, &nd_region->flags))
+		return false;
+
+	pfr = kmalloc(sizeof(*pfr), GFP_NOIO);
+	if (!pfr)
+		return false;
+
+	pfr->req.end = pmem_flush_end;
+	pfr->bio = bio;
+	nvdimm_flush_async(nd_region, &pfr->req);
+	return true;
+}
+
 static blk_qc_t pmem_submit_bio(struct bio *bio)
 {
 	int ret = 0;
@@ -221,12 +259,18 @@ static blk_qc_t pmem_submit_bio(struct bio *bio)
 	if (do_acct)
 		bio_end_io_acct(bio, start);
 
-	if (bio->bi_opf & REQ_FUA)
-		ret = nvdimm_flush(nd_region, bio);
-
 	if (ret)
 		bio->bi_status = errno_to_blk_status(ret);
 
+	if (bio->bi_opf & REQ_FUA) {
+		if (pmem_flush_async(nd_region, bio))
+			return BLK_QC_T_NONE;
+
+		ret = nvdimm_flush(nd_region, bio);
+		if (ret)
+			bio->bi_status = errno_to_blk_status(ret);
+	}
+
 	bio_endio(bio);
 	return BLK_QC_T_NONE;
 }
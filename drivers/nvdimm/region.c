@@ -93,6 +93,9 @@ static int nd_region_remove(struct device *dev)
 
 	device_for_each_child(dev, NULL, child_unregister);
 
+	/* complete queued flushes while the flush hints are still mapped */
+	flush_work(&nd_region->flush_work);
+
 	/* flush attribute readers and disable */
 	nvdimm_bus_lock(dev);
 	nd_region->ns_seed = NULL;
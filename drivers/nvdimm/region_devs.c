@@ -9,6 +9,7 @@
 #include <linux/slab.h>
 #include <linux/hash.h>
 #include <linux/sort.h>
+#include <linux/workqueue.h>
 #include <linux/io.h>
 #include <linux/nd.h>
 #include "nd-core.h"
@@ -1026,6 +1027,38 @@ static unsigned long default_align(struct nd_region *nd_region)
 	return align;
 }
 
+static void nvdimm_flush_work(struct work_struct *work)
+{
+	struct nd_region *nd_region = container_of(work, typeof(*nd_region),
+			flush_work);
+	struct nvdimm_flush_req *req, *next;
+	LIST_HEAD(batch);
+	int rc;
+
+	spin_lock_irq(&nd_region->flush_lock);
+	while (!list_empty(&nd_region->flush_pending)) {
+		list_splice_init(&nd_region->flush_pending, &batch);
+		spin_unlock_irq(&nd_region->flush_lock);
+
+		/*
+		 * Every request in the batch was queued before this flush
+		 * started, so one flush completes all of them.
+		 */
+		if (!nd_region->flush && !dev_get_drvdata(&nd_region->dev))
+			rc = -ENXIO;
+		else
+			rc = nvdimm_flush(nd_region, NULL);
+
+		list_for_each_entry_safe(req, next, &batch, list) {
+			list_del(&req->list);
+			req->end(req, rc);
+		}
+
+		spin_lock_irq(&nd_region->flush_lock);
+	}
+	spin_unlock_irq(&nd_region->flush_lock);
+}
+
 static struct nd_region *nd_region_create(struct nvdimm_bus *nvdimm_bus,
 		struct nd_region_desc *ndr_desc,
 		const struct device_type *dev_type, const char *caller)
@@ -1135,6 +1168,9 @@ static struct nd_region *nd_region_create(struct nvdimm_bus *nvdimm_bus,
 		nd_region->flush = ndr_desc->flush;
 	else
 		nd_region->flush = NULL;
+	spin_lock_init(&nd_region->flush_lock);
+	INIT_LIST_HEAD(&nd_region->flush_pending);
+	INIT_WORK(&nd_region->flush_work, nvdimm_flush_work);
 
 	nd_device_register(dev);
 
@@ -1189,6 +1225,36 @@ int nvdimm_flush(struct nd_region *nd_region, struct bio *bio)
 
 	return rc;
 }
+
+/**
+ * nvdimm_flush_async - queue a flush of the region's posted write queues
+ * @nd_region: blk or interleaved pmem region
+ * @req: request, completed through @req->end once the flush is done
+ *
+ * Writes issued by the caller before this call are covered by the flush.
+ * Requests queued while a flush is in progress are batched and completed
+ * together by the next one, so that concurrent committers share a single
+ * flush instead of each waiting for their own.
+ */
+void nvdimm_flush_async(struct nd_region *nd_region,
+		struct nvdimm_flush_req *req)
+{
+	unsigned long flags;
+
+	/*
+	 * The flush runs on another cpu, fence this cpu's writes to pmem
+	 * before handing them over.
+	 */
+	pmem_wmb();
+
+	spin_lock_irqsave(&nd_region->flush_lock, flags);
+	list_add_tail(&req->list, &nd_region->flush_pending);
+	spin_unlock_irqrestore(&nd_region->flush_lock, flags);
+
+	queue_work(system_unbound_wq, &nd_region->flush_work);
+}
+EXPORT_SYMBOL_GPL(nvdimm_flush_async);
+
 /**
  * nvdimm_flush - flush any posted write queues between the cpu and pmem media
  * @nd_region: blk or interleaved pmem region
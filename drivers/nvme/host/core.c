@@ -10,6 +10,7 @@
 #include <linux/delay.h>
 #include <linux/errno.h>
 #include <linux/hdreg.h>
+#include <linux/io_uring.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
 #include <linux/backing-dev.h>
@@ -816,6 +817,8 @@ static inline blk_status_t nvme_setup_rw(struct nvme_ns *ns,
 
 void nvme_cleanup_cmd(struct request *req)
 {
+	nvme_mpath_end_request(req);
+
 	if (req->rq_flags & RQF_SPECIAL_PAYLOAD) {
 		struct nvme_ns *ns = req->rq_disk->private_data;
 		struct page *page = req->special_vec.bv_page;
@@ -881,6 +884,8 @@ blk_status_t nvme_setup_cmd(struct nvme_ns *ns, struct request *req,
 	if (!(ctrl->quirks & NVME_QUIRK_SKIP_CID_GEN))
 		nvme_req(req)->genctr++;
 	cmd->common.command_id = nvme_cid(req);
+	if (ret == BLK_STS_OK)
+		nvme_mpath_start_request(req);
 	trace_nvme_setup_cmd(req, cmd);
 	return ret;
 }
@@ -1645,6 +1650,229 @@ static int nvme_user_cmd64(struct nvme_ctrl *ctrl, struct nvme_ns *ns,
 	return status;
 }
 
+/*
+ * Per-command state of an NVME_URING_CMD_* passthrough, kept in the
+ * io_uring_cmd pdu while the request is in flight.
+ */
+struct nvme_uring_cmd_pdu {
+	union {
+		struct bio *bio;
+		struct request *req;
+	};
+	void *meta; /* kernel-resident buffer */
+	void __user *meta_buffer;
+	u32 meta_len;
+};
+
+static inline struct nvme_uring_cmd_pdu *nvme_uring_cmd_pdu(
+		struct io_uring_cmd *ioucmd)
+{
+	return (struct nvme_uring_cmd_pdu *)&ioucmd->pdu;
+}
+
+static void nvme_uring_task_cb(struct io_uring_cmd *ioucmd)
+{
+	struct nvme_uring_cmd_pdu *pdu = nvme_uring_cmd_pdu(ioucmd);
+	struct request *req = pdu->req;
+	struct bio *bio = req->bio;
+	u64 result;
+	int status;
+
+	if (nvme_req(req)->flags & NVME_REQ_CANCELLED)
+		status = -EINTR;
+	else
+		status = nvme_req(req)->status;
+	result = le64_to_cpu(nvme_req(req)->result.u64);
+
+	if (pdu->meta && !status && rq_data_dir(req) == READ) {
+		if (copy_to_user(pdu->meta_buffer, pdu->meta, pdu->meta_len))
+			status = -EFAULT;
+	}
+	kfree(pdu->meta);
+	if (bio)
+		blk_rq_unmap_user(bio);
+	kfree(nvme_req(req)->cmd);
+	blk_mq_free_request(req);
+
+	io_uring_cmd_done(ioucmd, status, result);
+}
+
+static void nvme_uring_cmd_end_io(struct request *req, blk_status_t err)
+{
+	struct io_uring_cmd *ioucmd = req->end_io_data;
+	struct nvme_uring_cmd_pdu *pdu = nvme_uring_cmd_pdu(ioucmd);
+	/* extract bio before reusing the same field for request */
+	struct bio *bio = pdu->bio;
+
+	pdu->req = req;
+	req->bio = bio;
+	/* unmapping the user buffer needs task context */
+	io_uring_cmd_complete_in_task(ioucmd, nvme_uring_task_cb);
+}
+
+/*
+ * The command lives in the SQE, which userspace can still modify. Take a
+ * single snapshot of it and only look at that afterwards.
+ */
+static void nvme_uring_cmd_copy(struct nvme_uring_cmd *cmd,
+		const struct nvme_uring_cmd *sqe_cmd)
+{
+	cmd->opcode = READ_ONCE(sqe_cmd->opcode);
+	cmd->flags = READ_ONCE(sqe_cmd->flags);
+	cmd->nsid = READ_ONCE(sqe_cmd->nsid);
+	cmd->cdw2 = READ_ONCE(sqe_cmd->cdw2);
+	cmd->cdw3 = READ_ONCE(sqe_cmd->cdw3);
+	cmd->metadata = READ_ONCE(sqe_cmd->metadata);
+	cmd->addr = READ_ONCE(sqe_cmd->addr);
+	cmd->metadata_len = READ_ONCE(sqe_cmd->metadata_len);
+	cmd->data_len = READ_ONCE(sqe_cmd->data_len);
+	cmd->cdw10 = READ_ONCE(sqe_cmd->cdw10);
+	cmd->cdw11 = READ_ONCE(sqe_cmd->cdw11);
+	cmd->cdw12 = READ_ONCE(sqe_cmd->cdw12);
+	cmd->cdw13 = READ_ONCE(sqe_cmd->cdw13);
+	cmd->cdw14 = READ_ONCE(sqe_cmd->cdw14);
+	cmd->cdw15 = READ_ONCE(sqe_cmd->cdw15);
+	cmd->timeout_ms = READ_ONCE(sqe_cmd->timeout_ms);
+}
+
+static int nvme_uring_cmd_io(struct nvme_ctrl *ctrl, struct nvme_ns *ns,
+		struct io_uring_cmd *ioucmd, const struct nvme_uring_cmd *cmd,
+		unsigned int issue_flags)
+{
+	struct nvme_uring_cmd_pdu *pdu = nvme_uring_cmd_pdu(ioucmd);
+	struct request_queue *q = ns ? ns->queue : ctrl->admin_q;
+	struct gendisk *disk = ns ? ns->disk : NULL;
+	blk_mq_req_flags_t rq_flags = 0;
+	unsigned int data_len, meta_len;
+	void __user *meta_buffer;
+	void __user *ubuffer;
+	struct nvme_command *c;
+	struct request *req;
+	struct bio *bio = NULL;
+	void *meta = NULL;
+	u32 timeout_ms;
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EACCES;
+
+	c = kzalloc(sizeof(*c), GFP_KERNEL);
+	if (!c)
+		return -ENOMEM;
+	c->common.opcode = cmd->opcode;
+	c->common.flags = cmd->flags;
+	if (c->common.flags) {
+		ret = -EINVAL;
+		goto out_free_cmd;
+	}
+	c->common.nsid = cpu_to_le32(cmd->nsid);
+	c->common.cdw2[0] = cpu_to_le32(cmd->cdw2);
+	c->common.cdw2[1] = cpu_to_le32(cmd->cdw3);
+	c->common.cdw10 = cpu_to_le32(cmd->cdw10);
+	c->common.cdw11 = cpu_to_le32(cmd->cdw11);
+	c->common.cdw12 = cpu_to_le32(cmd->cdw12);
+	c->common.cdw13 = cpu_to_le32(cmd->cdw13);
+	c->common.cdw14 = cpu_to_le32(cmd->cdw14);
+	c->common.cdw15 = cpu_to_le32(cmd->cdw15);
+
+	/*
+	 * Commands that need the queues frozen or a rescan afterwards can't
+	 * be issued asynchronously, use the ioctl interface for those.
+	 */
+	if (nvme_command_effects(ctrl, ns, c->common.opcode) &
+	    (NVME_CMD_EFFECTS_NIC | NVME_CMD_EFFECTS_NCC |
+	     NVME_CMD_EFFECTS_CCC | NVME_CMD_EFFECTS_CSE_MASK)) {
+		ret = -EOPNOTSUPP;
+		goto out_free_cmd;
+	}
+
+	ubuffer = nvme_to_user_ptr(cmd->addr);
+	data_len = cmd->data_len;
+	meta_buffer = nvme_to_user_ptr(cmd->metadata);
+	meta_len = cmd->metadata_len;
+	timeout_ms = cmd->timeout_ms;
+
+	if (issue_flags & IO_URING_F_NONBLOCK)
+		rq_flags |= BLK_MQ_REQ_NOWAIT;
+
+	req = nvme_alloc_request(q, c, rq_flags, NVME_QID_ANY);
+	if (IS_ERR(req)) {
+		ret = PTR_ERR(req);
+		goto out_free_cmd;
+	}
+
+	req->timeout = timeout_ms ? msecs_to_jiffies(timeout_ms) : ADMIN_TIMEOUT;
+	nvme_req(req)->flags |= NVME_REQ_USERCMD;
+
+	if (ubuffer && data_len) {
+		ret = blk_rq_map_user(q, req, NULL, ubuffer, data_len,
+				GFP_KERNEL);
+		if (ret)
+			goto out_free_req;
+		bio = req->bio;
+		bio->bi_disk = disk;
+		if (disk && meta_buffer && meta_len) {
+			meta = nvme_add_user_metadata(bio, meta_buffer, meta_len,
+					0, nvme_is_write(c));
+			if (IS_ERR(meta)) {
+				ret = PTR_ERR(meta);
+				goto out_unmap;
+			}
+			req->cmd_flags |= REQ_INTEGRITY;
+		}
+	}
+
+	/* to free bio on completion, as req->bio will be null at that time */
+	pdu->bio = bio;
+	pdu->meta = meta;
+	pdu->meta_buffer = meta_buffer;
+	pdu->meta_len = meta_len;
+	req->end_io_data = ioucmd;
+	blk_execute_rq_nowait(q, disk, req, 0, nvme_uring_cmd_end_io);
+	return -EIOCBQUEUED;
+
+ out_unmap:
+	if (bio)
+		blk_rq_unmap_user(bio);
+ out_free_req:
+	blk_mq_free_request(req);
+ out_free_cmd:
+	kfree(c);
+	return ret;
+}
+
+static int nvme_dev_uring_cmd(struct io_uring_cmd *ioucmd,
+		unsigned int issue_flags)
+{
+	struct nvme_ctrl *ctrl = ioucmd->file->private_data;
+	struct nvme_uring_cmd cmd;
+	struct nvme_ns *ns;
+	int ret;
+
+	BUILD_BUG_ON(sizeof(struct nvme_uring_cmd_pdu) > sizeof(ioucmd->pdu));
+
+	/* the command doesn't fit a small SQE, the result a small CQE */
+	if (!(issue_flags & IO_URING_F_SQE128) ||
+	    !(issue_flags & IO_URING_F_CQE32))
+		return -EOPNOTSUPP;
+
+	nvme_uring_cmd_copy(&cmd, ioucmd->cmd);
+
+	switch (ioucmd->cmd_op) {
+	case NVME_URING_CMD_ADMIN:
+		return nvme_uring_cmd_io(ctrl, NULL, ioucmd, &cmd, issue_flags);
+	case NVME_URING_CMD_IO:
+		ns = nvme_find_get_ns(ctrl, cmd.nsid);
+		if (!ns)
+			return -EINVAL;
+		ret = nvme_uring_cmd_io(ctrl, ns, ioucmd, &cmd, issue_flags);
+		nvme_put_ns(ns);
+		return ret;
+	default:
+		return -ENOTTY;
+	}
+}
+
 /*
  * Issue ioctl requests on the first available path.  Note that unlike normal
  * block layer requests we will not retry failed request on another controller.
@@ -3276,6 +3504,7 @@ static const struct file_operations nvme_dev_fops = {
 	.release	= nvme_dev_release,
 	.unlocked_ioctl	= nvme_dev_ioctl,
 	.compat_ioctl	= compat_ptr_ioctl,
+	.uring_cmd	= nvme_dev_uring_cmd,
 };
 
 static ssize_t nvme_sysfs_reset(struct device *dev,
@@ -174,6 +174,7 @@ struct nvme_request {
 enum {
 	NVME_REQ_CANCELLED		= (1 << 0),
 	NVME_REQ_USERCMD		= (1 << 1),
+	NVME_MPATH_CNT_ACTIVE		= (1 << 2),
 };
 
 static inline struct nvme_request *nvme_req(struct request *req)
@@ -320,6 +321,8 @@ struct nvme_ctrl {
 	size_t ana_log_size;
 	struct timer_list anatt_timer;
 	struct work_struct ana_work;
+	/* requests in flight, for the queue-depth iopolicy */
+	atomic_t nr_active;
 #endif
 
 	/* Power saving configuration */
@@ -349,6 +352,7 @@ struct nvme_ctrl {
 enum nvme_iopolicy {
 	NVME_IOPOLICY_NUMA,
 	NVME_IOPOLICY_RR,
+	NVME_IOPOLICY_QD,
 };
 
 struct nvme_subsystem {
@@ -731,6 +735,31 @@ static inline void nvme_trace_bio_complete(struct request *req,
 		trace_block_bio_complete(ns->head->disk->queue, req->bio);
 }
 
+/*
+ * Count the multipath requests in flight on each controller while the
+ * queue-depth iopolicy is in use.  A request is counted from the time its
+ * command is set up until it is cleaned up, across retries.
+ */
+static inline void nvme_mpath_start_request(struct request *rq)
+{
+	struct nvme_ctrl *ctrl = nvme_req(rq)->ctrl;
+
+	if ((rq->cmd_flags & REQ_NVME_MPATH) &&
+	    READ_ONCE(ctrl->subsys->iopolicy) == NVME_IOPOLICY_QD &&
+	    !(nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE)) {
+		atomic_inc(&ctrl->nr_active);
+		nvme_req(rq)->flags |= NVME_MPATH_CNT_ACTIVE;
+	}
+}
+
+static inline void nvme_mpath_end_request(struct request *rq)
+{
+	if (nvme_req(rq)->flags & NVME_MPATH_CNT_ACTIVE) {
+		atomic_dec(&nvme_req(rq)->ctrl->nr_active);
+		nvme_req(rq)->flags &= ~NVME_MPATH_CNT_ACTIVE;
+	}
+}
+
 extern struct device_attribute dev_attr_ana_grpid;
 extern struct device_attribute dev_attr_ana_state;
 extern struct device_attribute subsys_attr_iopolicy;
@@ -782,6 +811,12 @@ static inline void nvme_trace_bio_complete(struct request *req,
         blk_status_t status)
 {
 }
+static inline void nvme_mpath_start_request(struct request *rq)
+{
+}
+static inline void nvme_mpath_end_request(struct request *rq)
+{
+}
 static inline void nvme_mpath_init_ctrl(struct nvme_ctrl *ctrl)
 {
 }
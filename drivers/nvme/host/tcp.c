@@ -62,6 +62,7 @@ enum nvme_tcp_queue_flags {
 	NVME_TCP_Q_ALLOCATED	= 0,
 	NVME_TCP_Q_LIVE		= 1,
 	NVME_TCP_Q_POLLING	= 2,
+	NVME_TCP_Q_IO_CPU_SET	= 3,
 };
 
 enum nvme_tcp_recv_state {
@@ -134,6 +135,8 @@ struct nvme_tcp_ctrl {
 static LIST_HEAD(nvme_tcp_ctrl_list);
 static DEFINE_MUTEX(nvme_tcp_ctrl_mutex);
 static struct workqueue_struct *nvme_tcp_wq;
+/* number of I/O queues whose io_work runs on each CPU */
+static atomic_t nvme_tcp_cpu_queues[NR_CPUS];
 static const struct blk_mq_ops nvme_tcp_mq_ops;
 static const struct blk_mq_ops nvme_tcp_admin_mq_ops;
 static int nvme_tcp_try_send(struct nvme_tcp_queue *queue);
@@ -1385,6 +1388,47 @@ static void nvme_tcp_set_queue_io_cpu(struct nvme_tcp_queue *queue)
 	queue->io_cpu = cpumask_next_wrap(n - 1, cpu_online_mask, -1, false);
 }
 
+/*
+ * Once the tag set is mapped, move the io_work of an I/O queue to one of
+ * the CPUs that submit to its hctx, so that submission, the socket work and
+ * completion share a cache.  Among those, take the CPU serving the fewest
+ * queues of all controllers.  Keep the default if no online CPU maps to the
+ * queue, e.g. while the number of queues changes on reconnect.
+ */
+static void nvme_tcp_map_queue_io_cpu(struct nvme_tcp_queue *queue)
+{
+	struct blk_mq_tag_set *set = &queue->ctrl->tag_set;
+	int hctx_idx = nvme_tcp_queue_id(queue) - 1;
+	int cpu, io_cpu = -1, min_queues = INT_MAX;
+	unsigned int *mq_map;
+
+	if (nvme_tcp_default_queue(queue))
+		mq_map = set->map[HCTX_TYPE_DEFAULT].mq_map;
+	else if (nvme_tcp_read_queue(queue))
+		mq_map = set->map[HCTX_TYPE_READ].mq_map;
+	else
+		mq_map = set->map[HCTX_TYPE_POLL].mq_map;
+	if (!mq_map)
+		return;
+
+	for_each_online_cpu(cpu) {
+		int nr_queues = atomic_read(&nvme_tcp_cpu_queues[cpu]);
+
+		if (mq_map[cpu] != hctx_idx)
+			continue;
+		if (nr_queues < min_queues) {
+			io_cpu = cpu;
+			min_queues = nr_queues;
+		}
+	}
+	if (io_cpu < 0)
+		return;
+
+	queue->io_cpu = io_cpu;
+	atomic_inc(&nvme_tcp_cpu_queues[io_cpu]);
+	set_bit(NVME_TCP_Q_IO_CPU_SET, &queue->flags);
+}
+
 static int nvme_tcp_alloc_queue(struct nvme_ctrl *nctrl,
 		int qid, size_t queue_size)
 {
@@ -1542,6 +1586,8 @@ static void __nvme_tcp_stop_queue(struct nvme_tcp_queue *queue)
 	kernel_sock_shutdown(queue->sock, SHUT_RDWR);
 	nvme_tcp_restore_sock_calls(queue);
 	cancel_work_sync(&queue->io_work);
+	if (test_and_clear_bit(NVME_TCP_Q_IO_CPU_SET, &queue->flags))
+		atomic_dec(&nvme_tcp_cpu_queues[queue->io_cpu]);
 }
 
 static void nvme_tcp_stop_queue(struct nvme_ctrl *nctrl, int qid)
@@ -1560,10 +1606,12 @@ static int nvme_tcp_start_queue(struct nvme_ctrl *nctrl, int idx)
 	struct nvme_tcp_ctrl *ctrl = to_tcp_ctrl(nctrl);
 	int ret;
 
-	if (idx)
+	if (idx) {
+		nvme_tcp_map_queue_io_cpu(&ctrl->queues[idx]);
 		ret = nvmf_connect_io_queue(nctrl, idx, false);
-	else
+	} else {
 		ret = nvmf_connect_admin_queue(nctrl);
+	}
 
 	if (!ret) {
 		set_bit(NVME_TCP_Q_LIVE, &ctrl->queues[idx].flags);
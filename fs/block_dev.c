@@ -215,7 +215,12 @@ static struct inode *bdev_file_inode(struct file *file)
 
 static unsigned int dio_bio_write_op(struct kiocb *iocb)
 {
-	unsigned int op = REQ_OP_WRITE | REQ_SYNC | REQ_IDLE;
+	unsigned int op = REQ_SYNC | REQ_IDLE;
+
+	if (iocb->ki_flags & IOCB_ZONE_APPEND)
+		op |= REQ_OP_ZONE_APPEND;
+	else
+		op |= REQ_OP_WRITE;
 
 	/* avoid the need for a I/O completion work item */
 	if (iocb->ki_flags & IOCB_DSYNC)
@@ -266,6 +271,10 @@ __blkdev_direct_IO_simple(struct kiocb *iocb, struct iov_iter *iter,
 	bio.bi_private = current;
 	bio.bi_end_io = blkdev_bio_end_io_simple;
 	bio.bi_ioprio = iocb->ki_ioprio;
+	if (iov_iter_rw(iter) == READ)
+		bio.bi_opf = REQ_OP_READ;
+	else
+		bio.bi_opf = dio_bio_write_op(iocb);
 
 	ret = bio_iov_iter_get_pages(&bio, iter);
 	if (unlikely(ret))
@@ -273,11 +282,9 @@ __blkdev_direct_IO_simple(struct kiocb *iocb, struct iov_iter *iter,
 	ret = bio.bi_iter.bi_size;
 
 	if (iov_iter_rw(iter) == READ) {
-		bio.bi_opf = REQ_OP_READ;
 		if (iter_is_iovec(iter))
 			should_dirty = true;
 	} else {
-		bio.bi_opf = dio_bio_write_op(iocb);
 		task_io_account_write(ret);
 	}
 	if (iocb->ki_flags & IOCB_NOWAIT)
@@ -299,6 +306,8 @@ __blkdev_direct_IO_simple(struct kiocb *iocb, struct iov_iter *iter,
 	bio_release_pages(&bio, should_dirty);
 	if (unlikely(bio.bi_status))
 		ret = blk_status_to_errno(bio.bi_status);
+	else if (iocb->ki_flags & IOCB_ZONE_APPEND)
+		iocb->ki_pos = ((loff_t)bio.bi_iter.bi_sector << SECTOR_SHIFT) + ret;
 
 out:
 	if (vecs != inline_vecs)
@@ -319,6 +328,8 @@ struct blkdev_dio {
 	bool			multi_bio : 1;
 	bool			should_dirty : 1;
 	bool			is_sync : 1;
+	/* where a zone append landed, valid once the bio completed */
+	sector_t		append_sector;
 	struct bio		bio;
 };
 
@@ -339,20 +350,29 @@ static void blkdev_bio_end_io(struct bio *bio)
 
 	if (bio->bi_status && !dio->bio.bi_status)
 		dio->bio.bi_status = bio->bi_status;
+	if (bio_op(bio) == REQ_OP_ZONE_APPEND)
+		dio->append_sector = bio->bi_iter.bi_sector;
 
 	if (!dio->multi_bio || atomic_dec_and_test(&dio->ref)) {
 		if (!dio->is_sync) {
 			struct kiocb *iocb = dio->iocb;
+			loff_t written_pos = 0;
 			ssize_t ret;
 
 			if (likely(!dio->bio.bi_status)) {
 				ret = dio->size;
-				iocb->ki_pos += ret;
+				if (iocb->ki_flags & IOCB_ZONE_APPEND) {
+					written_pos = (loff_t)dio->append_sector <<
+							SECTOR_SHIFT;
+					iocb->ki_pos = written_pos + ret;
+				} else {
+					iocb->ki_pos += ret;
+				}
 			} else {
 				ret = blk_status_to_errno(dio->bio.bi_status);
 			}
 
-			dio->iocb->ki_complete(iocb, ret, 0);
+			dio->iocb->ki_complete(iocb, ret, written_pos);
 			if (dio->multi_bio)
 				bio_put(&dio->bio);
 		} else {
@@ -390,7 +410,7 @@ __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter, int nr_pages)
 	    (bdev_logical_block_size(bdev) - 1))
 		return -EINVAL;
 
-	bio = bio_alloc_bioset(GFP_KERNEL, nr_pages, &blkdev_dio_pool);
+	bio = bio_alloc_kiocb(iocb, nr_pages, &blkdev_dio_pool);
 
 	dio = container_of(bio, struct blkdev_dio, bio);
 	dio->is_sync = is_sync = is_sync_kiocb(iocb);
@@ -419,6 +439,10 @@ __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter, int nr_pages)
 		bio->bi_private = dio;
 		bio->bi_end_io = blkdev_bio_end_io;
 		bio->bi_ioprio = iocb->ki_ioprio;
+		if (is_read)
+			bio->bi_opf = REQ_OP_READ;
+		else
+			bio->bi_opf = dio_bio_write_op(iocb);
 
 		ret = bio_iov_iter_get_pages(bio, iter);
 		if (unlikely(ret)) {
@@ -428,11 +452,9 @@ __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter, int nr_pages)
 		}
 
 		if (is_read) {
-			bio->bi_opf = REQ_OP_READ;
 			if (dio->should_dirty)
 				bio_set_pages_dirty(bio);
 		} else {
-			bio->bi_opf = dio_bio_write_op(iocb);
 			task_io_account_write(bio->bi_iter.bi_size);
 		}
 		if (iocb->ki_flags & IOCB_NOWAIT)
@@ -441,7 +463,14 @@ __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter, int nr_pages)
 		dio->size += bio->bi_iter.bi_size;
 		pos += bio->bi_iter.bi_size;
 
-		nr_pages = iov_iter_npages(iter, BIO_MAX_PAGES);
+		/*
+		 * A zone append cannot be split, as each bio may land anywhere
+		 * in the zone.  Whatever did not fit is a short write.
+		 */
+		if (iocb->ki_flags & IOCB_ZONE_APPEND)
+			nr_pages = 0;
+		else
+			nr_pages = iov_iter_npages(iter, BIO_MAX_PAGES);
 		if (!nr_pages) {
 			bool polled = false;
 
@@ -494,8 +523,11 @@ __blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter, int nr_pages)
 
 	if (!ret)
 		ret = blk_status_to_errno(dio->bio.bi_status);
-	if (likely(!ret))
+	if (likely(!ret)) {
 		ret = dio->size;
+		if (iocb->ki_flags & IOCB_ZONE_APPEND)
+			iocb->ki_pos = ((loff_t)dio->append_sector << SECTOR_SHIFT) + ret;
+	}
 
 	bio_put(&dio->bio);
 	return ret;
@@ -517,7 +549,8 @@ blkdev_direct_IO(struct kiocb *iocb, struct iov_iter *iter)
 
 static __init int blkdev_init(void)
 {
-	return bioset_init(&blkdev_dio_pool, 4, offsetof(struct blkdev_dio, bio), BIOSET_NEED_BVECS);
+	return bioset_init(&blkdev_dio_pool, 4, offsetof(struct blkdev_dio, bio),
+			   BIOSET_NEED_BVECS | BIOSET_PERCPU_CACHE);
 }
 module_init(blkdev_init);
 
@@ -1747,6 +1780,7 @@ EXPORT_SYMBOL(blkdev_get_by_dev);
 static int blkdev_open(struct inode * inode, struct file * filp)
 {
 	struct block_device *bdev;
+	int ret;
 
 	/*
 	 * Preserve backwards compatibility and allow large file access
@@ -1772,7 +1806,10 @@ static int blkdev_open(struct inode * inode, struct file * filp)
 	filp->f_mapping = bdev->bd_inode->i_mapping;
 	filp->f_wb_err = filemap_sample_wb_err(filp->f_mapping);
 
-	return blkdev_get(bdev, filp->f_mode, filp);
+	ret = blkdev_get(bdev, filp->f_mode, filp);
+	if (!ret && bdev_is_zoned(bdev))
+		filp->f_mode |= FMODE_ZONE_APPEND;
+	return ret;
 }
 
 static void __blkdev_put(struct block_device *bdev, fmode_t mode, int for_part)
@@ -1900,6 +1937,43 @@ static long block_ioctl(struct file *file, unsigned cmd, unsigned long arg)
  * Does not take i_mutex for the write and thus is not for general purpose
  * use.
  */
+/*
+ * Append to the zone that starts at iocb->ki_pos.  On completion ki_pos
+ * points past the data, wherever in the zone the device placed it.
+ */
+static ssize_t blkdev_zone_append(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct address_space *mapping = iocb->ki_filp->f_mapping;
+	struct block_device *bdev = I_BDEV(mapping->host);
+	loff_t zone_bytes = bdev_zone_sectors(bdev) << SECTOR_SHIFT;
+	loff_t start = iocb->ki_pos, end = start + zone_bytes - 1;
+	int ret;
+
+	if (!(iocb->ki_flags & IOCB_DIRECT) || iov_iter_is_bvec(from))
+		return -EINVAL;
+	if (start & (zone_bytes - 1))
+		return -EINVAL;
+
+	/*
+	 * The data may land anywhere past the write pointer, so the cached
+	 * pages of the whole zone have to go.
+	 */
+	if (iocb->ki_flags & IOCB_NOWAIT) {
+		if (filemap_range_has_page(mapping, start, end))
+			return -EAGAIN;
+	} else {
+		ret = filemap_write_and_wait_range(mapping, start, end);
+		if (ret)
+			return ret;
+	}
+	ret = invalidate_inode_pages2_range(mapping, start >> PAGE_SHIFT,
+					    end >> PAGE_SHIFT);
+	if (ret)
+		return ret;
+
+	return blkdev_direct_IO(iocb, from);
+}
+
 ssize_t blkdev_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
 	struct file *file = iocb->ki_filp;
@@ -1931,7 +2005,10 @@ ssize_t blkdev_write_iter(struct kiocb *iocb, struct iov_iter *from)
 	}
 
 	blk_start_plug(&plug);
-	ret = __generic_file_write_iter(iocb, from);
+	if (iocb->ki_flags & IOCB_ZONE_APPEND)
+		ret = blkdev_zone_append(iocb, from);
+	else
+		ret = __generic_file_write_iter(iocb, from);
 	if (ret > 0)
 		ret = generic_write_sync(iocb, ret);
 	iov_iter_reexpand(from, iov_iter_count(from) + shorted);
@@ -2066,6 +2143,61 @@ static long blkdev_fallocate(struct file *file, int mode, loff_t start,
 					     end >> PAGE_SHIFT);
 }
 
+/*
+ * Copies within one device are offloaded to it when the queue advertises
+ * REQ_OP_COPY; anything else goes through the page cache as before.
+ */
+static ssize_t blkdev_copy_file_range(struct file *file_in, loff_t pos_in,
+				      struct file *file_out, loff_t pos_out,
+				      size_t len, unsigned int flags)
+{
+	struct block_device *bdev = I_BDEV(bdev_file_inode(file_out));
+	struct address_space *mapping = bdev->bd_inode->i_mapping;
+	loff_t isize = i_size_read(bdev->bd_inode);
+	loff_t end;
+	int error;
+
+	if (I_BDEV(bdev_file_inode(file_in)) != bdev ||
+	    !bdev_copy_sectors(bdev) ||
+	    ((pos_in | pos_out | len) & (bdev_logical_block_size(bdev) - 1)))
+		goto fallback;
+
+	if (pos_out >= isize)
+		return -ENOSPC;
+	len = min_t(loff_t, len, isize - pos_out);
+	len = min_t(size_t, len, MAX_RW_COUNT);
+	end = pos_out + len - 1;
+
+	/* The device reads the source from media, write back what is cached */
+	error = filemap_write_and_wait_range(mapping, pos_in, pos_in + len - 1);
+	if (error)
+		return error;
+
+	/* Invalidate the page cache, including dirty pages. */
+	error = truncate_bdev_range(bdev, file_out->f_mode, pos_out, end);
+	if (error)
+		return error;
+
+	error = blkdev_issue_copy(bdev, pos_in >> 9, pos_out >> 9, len >> 9,
+				  GFP_KERNEL);
+	if (error == -EOPNOTSUPP)
+		goto fallback;
+	if (error)
+		return error;
+
+	/*
+	 * Invalidate again; if someone wandered in and dirtied a page,
+	 * the caller will be given -EBUSY.
+	 */
+	error = invalidate_inode_pages2_range(mapping, pos_out >> PAGE_SHIFT,
+					      end >> PAGE_SHIFT);
+	return error ? error : len;
+
+fallback:
+	return generic_copy_file_range(file_in, pos_in, file_out, pos_out,
+				       len, flags);
+}
+
 const struct file_operations def_blk_fops = {
 	.open		= blkdev_open,
 	.release	= blkdev_close,
@@ -2082,6 +2214,7 @@ const struct file_operations def_blk_fops = {
 	.splice_read	= generic_file_splice_read,
 	.splice_write	= iter_file_splice_write,
 	.fallocate	= blkdev_fallocate,
+	.copy_file_range = blkdev_copy_file_range,
 };
 
 /**
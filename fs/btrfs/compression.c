@@ -783,6 +783,177 @@ blk_status_t btrfs_submit_compressed_read(struct inode *inode, struct bio *bio,
 	return ret;
 }
 
+struct compressed_raw_read {
+	atomic_t pending_bios;
+	blk_status_t status;
+	struct completion done;
+};
+
+static void end_compressed_raw_read(struct bio *bio)
+{
+	struct compressed_raw_read *rr = bio->bi_private;
+
+	if (bio->bi_status)
+		rr->status = bio->bi_status;
+	bio_put(bio);
+	if (atomic_dec_and_test(&rr->pending_bios))
+		complete(&rr->done);
+}
+
+static void submit_compressed_raw_bio(struct btrfs_fs_info *fs_info,
+				      struct inode *inode, struct bio *bio,
+				      u8 *sums, int mirror_num)
+{
+	blk_status_t ret = 0;
+
+	if (!(BTRFS_I(inode)->flags & BTRFS_INODE_NODATASUM))
+		ret = btrfs_lookup_bio_sums(inode, bio, (u64)-1, sums);
+	if (!ret)
+		ret = btrfs_map_bio(fs_info, bio, mirror_num);
+	if (ret) {
+		bio->bi_status = ret;
+		bio_endio(bio);
+	}
+}
+
+static int read_compressed_extent_mirror(struct btrfs_inode *inode,
+					 u64 disk_bytenr, u64 file_start,
+					 struct page **pages,
+					 unsigned long nr_pages, u8 *sums,
+					 int mirror_num)
+{
+	struct btrfs_fs_info *fs_info = inode->root->fs_info;
+	struct inode *vfs_inode = &inode->vfs_inode;
+	const u16 csum_size = btrfs_super_csum_size(fs_info->super_copy);
+	struct compressed_raw_read rr;
+	u64 cur_disk_byte = disk_bytenr;
+	struct bio *bio;
+	unsigned long i;
+
+	atomic_set(&rr.pending_bios, 1);
+	rr.status = BLK_STS_OK;
+	init_completion(&rr.done);
+
+	bio = btrfs_bio_alloc(cur_disk_byte);
+	bio->bi_opf = REQ_OP_READ;
+	bio->bi_private = &rr;
+	bio->bi_end_io = end_compressed_raw_read;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = pages[i];
+		int submit = 0;
+
+		page->mapping = vfs_inode->i_mapping;
+		page->index = file_start >> PAGE_SHIFT;
+		if (bio->bi_iter.bi_size)
+			submit = btrfs_bio_fits_in_stripe(page, PAGE_SIZE,
+							  bio, 0);
+		page->mapping = NULL;
+
+		if (submit || bio_add_page(bio, page, PAGE_SIZE, 0) <
+		    PAGE_SIZE) {
+			unsigned int nr_sectors;
+
+			nr_sectors = DIV_ROUND_UP(bio->bi_iter.bi_size,
+						  fs_info->sectorsize);
+			atomic_inc(&rr.pending_bios);
+			submit_compressed_raw_bio(fs_info, vfs_inode, bio,
+						  sums, mirror_num);
+			sums += csum_size * nr_sectors;
+
+			bio = btrfs_bio_alloc(cur_disk_byte);
+			bio->bi_opf = REQ_OP_READ;
+			bio->bi_private = &rr;
+			bio->bi_end_io = end_compressed_raw_read;
+			bio_add_page(bio, page, PAGE_SIZE, 0);
+		}
+		cur_disk_byte += PAGE_SIZE;
+	}
+	submit_compressed_raw_bio(fs_info, vfs_inode, bio, sums, mirror_num);
+
+	wait_for_completion_io(&rr.done);
+	return blk_status_to_errno(rr.status);
+}
+
+static int check_compressed_raw_csum(struct btrfs_inode *inode,
+				     struct page **pages,
+				     unsigned long nr_pages, u8 *sums,
+				     u64 disk_start, int mirror_num)
+{
+	struct btrfs_fs_info *fs_info = inode->root->fs_info;
+	SHASH_DESC_ON_STACK(shash, fs_info->csum_shash);
+	const u16 csum_size = btrfs_super_csum_size(fs_info->super_copy);
+	u8 csum[BTRFS_CSUM_SIZE];
+	unsigned long i;
+	char *kaddr;
+
+	if (inode->flags & BTRFS_INODE_NODATASUM)
+		return 0;
+
+	shash->tfm = fs_info->csum_shash;
+
+	for (i = 0; i < nr_pages; i++) {
+		kaddr = kmap_atomic(pages[i]);
+		crypto_shash_digest(shash, kaddr, PAGE_SIZE, csum);
+		kunmap_atomic(kaddr);
+
+		if (memcmp(&csum, sums, csum_size)) {
+			btrfs_print_data_csum_error(inode, disk_start, csum,
+						    sums, mirror_num);
+			return -EIO;
+		}
+		sums += csum_size;
+	}
+	return 0;
+}
+
+/*
+ * Read the on-disk bytes of a compressed extent into @pages without
+ * decompressing them.
+ *
+ * @inode:		inode the extent belongs to
+ * @disk_bytenr:	logical start of the extent on disk
+ * @file_start:		file offset the extent was written at (em->orig_start)
+ * @pages:		caller allocated pages, @nr_pages of them
+ *
+ * The read is synchronous.  The data checksums are verified the same way a
+ * regular compressed read does, and other mirrors are tried on failure.
+ */
+int btrfs_read_compressed_extent_raw(struct btrfs_inode *inode,
+				     u64 disk_bytenr, u64 file_start,
+				     struct page **pages,
+				     unsigned long nr_pages)
+{
+	struct btrfs_fs_info *fs_info = inode->root->fs_info;
+	const u16 csum_size = btrfs_super_csum_size(fs_info->super_copy);
+	u64 disk_len = (u64)nr_pages << PAGE_SHIFT;
+	int num_copies;
+	int mirror;
+	int ret = -EIO;
+	u8 *sums;
+
+	sums = kvcalloc(DIV_ROUND_UP(disk_len, fs_info->sectorsize),
+			csum_size, GFP_NOFS);
+	if (!sums)
+		return -ENOMEM;
+
+	num_copies = btrfs_num_copies(fs_info, disk_bytenr, disk_len);
+	for (mirror = 1; mirror <= num_copies; mirror++) {
+		ret = read_compressed_extent_mirror(inode, disk_bytenr,
+						    file_start, pages,
+						    nr_pages, sums, mirror);
+		if (!ret)
+			ret = check_compressed_raw_csum(inode, pages, nr_pages,
+							sums, disk_bytenr,
+							mirror);
+		if (!ret)
+			break;
+	}
+
+	kvfree(sums);
+	return ret;
+}
+
 /*
  * Heuristic uses systematic sampling to collect data from the input data
  * range, the logic can be tuned by the following constants:
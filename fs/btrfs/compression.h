@@ -99,6 +99,10 @@ blk_status_t btrfs_submit_compressed_write(struct btrfs_inode *inode, u64 start,
 				  struct cgroup_subsys_state *blkcg_css);
 blk_status_t btrfs_submit_compressed_read(struct inode *inode, struct bio *bio,
 				 int mirror_num, unsigned long bio_flags);
+int btrfs_read_compressed_extent_raw(struct btrfs_inode *inode,
+				     u64 disk_bytenr, u64 file_start,
+				     struct page **pages,
+				     unsigned long nr_pages);
 
 unsigned int btrfs_compress_str2level(unsigned int type, const char *str);
 
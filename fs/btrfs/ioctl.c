@@ -2705,6 +2705,142 @@ static int btrfs_ioctl_ino_lookup_user(struct file *file, void __user *argp)
 	return ret;
 }
 
+/*
+ * Copy a compressed extent to userspace as it is stored on disk, without
+ * decompressing it.  Only regular compressed extents are handled, anything
+ * else returns -ENODATA and the caller falls back to a normal read.
+ */
+static int btrfs_ioctl_encoded_read(struct file *file, void __user *argp)
+{
+	struct inode *inode = file_inode(file);
+	struct btrfs_fs_info *fs_info = btrfs_sb(inode->i_sb);
+	struct extent_io_tree *io_tree = &BTRFS_I(inode)->io_tree;
+	struct btrfs_ioctl_encoded_read_args args;
+	struct extent_map *em = NULL;
+	struct page **pages = NULL;
+	unsigned long nr_pages = 0;
+	unsigned long i;
+	u64 lockend;
+	u64 disk_bytenr;
+	u64 orig_start;
+	u64 copied = 0;
+	int ret;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (!(file->f_mode & FMODE_READ))
+		return -EBADF;
+
+	if (copy_from_user(&args, argp, sizeof(args)))
+		return -EFAULT;
+
+	if (args.reserved32 || memchr_inv(args.reserved, 0,
+					  sizeof(args.reserved)))
+		return -EINVAL;
+
+	if (!IS_ALIGNED(args.offset, fs_info->sectorsize))
+		return -EINVAL;
+
+	inode_lock_shared(inode);
+
+	if (args.offset >= i_size_read(inode)) {
+		ret = -ENODATA;
+		goto out_unlock_inode;
+	}
+
+	lockend = args.offset + fs_info->sectorsize - 1;
+	ret = btrfs_wait_ordered_range(inode, args.offset,
+				       fs_info->sectorsize);
+	if (ret)
+		goto out_unlock_inode;
+
+	lock_extent(io_tree, args.offset, lockend);
+
+	em = btrfs_get_extent(BTRFS_I(inode), NULL, 0, args.offset,
+			      fs_info->sectorsize);
+	if (IS_ERR(em)) {
+		ret = PTR_ERR(em);
+		em = NULL;
+		goto out_unlock_extent;
+	}
+
+	if (em->block_start >= EXTENT_MAP_LAST_BYTE ||
+	    test_bit(EXTENT_FLAG_PREALLOC, &em->flags) ||
+	    !test_bit(EXTENT_FLAG_COMPRESSED, &em->flags)) {
+		ret = -ENODATA;
+		goto out_unlock_extent;
+	}
+
+	args.len = min(extent_map_end(em), (u64)i_size_read(inode)) -
+		   args.offset;
+	args.unencoded_len = em->ram_bytes;
+	args.unencoded_offset = args.offset - em->orig_start;
+	args.encoded_len = em->block_len;
+	args.compression = em->compress_type;
+	disk_bytenr = em->block_start;
+	orig_start = em->orig_start;
+
+	if (args.buf_len < args.encoded_len) {
+		ret = -ENOBUFS;
+		goto out_unlock_extent;
+	}
+
+	nr_pages = DIV_ROUND_UP(args.encoded_len, PAGE_SIZE);
+	pages = kcalloc(nr_pages, sizeof(struct page *), GFP_NOFS);
+	if (!pages) {
+		ret = -ENOMEM;
+		goto out_unlock_extent;
+	}
+	for (i = 0; i < nr_pages; i++) {
+		pages[i] = alloc_page(GFP_NOFS | __GFP_HIGHMEM);
+		if (!pages[i]) {
+			ret = -ENOMEM;
+			goto out_unlock_extent;
+		}
+	}
+
+	ret = btrfs_read_compressed_extent_raw(BTRFS_I(inode), disk_bytenr,
+					       orig_start, pages, nr_pages);
+
+out_unlock_extent:
+	unlock_extent(io_tree, args.offset, lockend);
+out_unlock_inode:
+	inode_unlock_shared(inode);
+	free_extent_map(em);
+	if (ret)
+		goto out_free;
+
+	for (i = 0; i < nr_pages; i++) {
+		size_t bytes = min_t(u64, PAGE_SIZE, args.encoded_len - copied);
+		char *kaddr;
+		unsigned long left;
+
+		kaddr = kmap(pages[i]);
+		left = copy_to_user(u64_to_user_ptr(args.buf + copied), kaddr,
+				    bytes);
+		kunmap(pages[i]);
+		if (left) {
+			ret = -EFAULT;
+			goto out_free;
+		}
+		copied += bytes;
+	}
+
+	if (copy_to_user(argp, &args, sizeof(args)))
+		ret = -EFAULT;
+
+out_free:
+	if (pages) {
+		for (i = 0; i < nr_pages; i++) {
+			if (pages[i])
+				__free_page(pages[i]);
+		}
+		kfree(pages);
+	}
+	return ret;
+}
+
 /* Get the subvolume information in BTRFS_ROOT_ITEM and BTRFS_ROOT_BACKREF */
 static int btrfs_ioctl_get_subvol_info(struct file *file, void __user *argp)
 {
@@ -5041,6 +5177,8 @@ long btrfs_ioctl(struct file *file, unsigned int
 		return btrfs_ioctl_get_subvol_rootref(file, argp);
 	case BTRFS_IOC_INO_LOOKUP_USER:
 		return btrfs_ioctl_ino_lookup_user(file, argp);
+	case BTRFS_IOC_ENCODED_READ:
+		return btrfs_ioctl_encoded_read(file, argp);
 	}
 
 	return -ENOTTY;
@@ -1797,7 +1797,6 @@ static int scrub_checksum_data(struct scrub_block *sblock)
 	kaddr = page_address(spage->page);
 
 	shash->tfm = fs_info->csum_shash;
-	crypto_shash_init(shash);
 	crypto_shash_digest(shash, kaddr, PAGE_SIZE, csum);
 
 	if (memcmp(csum, spage->csum, sctx->csum_size))
@@ -3762,6 +3761,16 @@ static noinline_for_stack int scrub_workers_get(struct btrfs_fs_info *fs_info,
 	if (refcount_inc_not_zero(&fs_info->scrub_workers_refcnt))
 		return 0;
 
+	/*
+	 * Checksum verification runs on these workers.  When many devices
+	 * are scrubbed at the same time, thread_pool_size (at most 8 by
+	 * default) is what limits throughput, so allow one active worker
+	 * per read-write device, bounded by the number of online CPUs.
+	 */
+	max_active = max_t(int, max_active,
+			   min_t(u64, fs_info->fs_devices->rw_devices,
+				 num_online_cpus()));
+
 	scrub_workers = btrfs_alloc_workqueue(fs_info, "scrub", flags,
 					      is_dev_replace ? 1 : max_active, 4);
 	if (!scrub_workers)
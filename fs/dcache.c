@@ -123,6 +123,30 @@ static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 static DEFINE_PER_CPU(long, nr_dentry_negative);
 
+/*
+ * Upper bound on the number of unused negative dentries kept on each
+ * superblock's LRU.  Zero means no limit, leaving them to the shrinker.
+ */
+unsigned long sysctl_negative_dentry_limit __read_mostly;
+
+static void d_negative_inc(struct dentry *dentry)
+{
+	struct super_block *sb = dentry->d_sb;
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&sb->s_nr_dentry_negative);
+	if (unlikely(limit) &&
+	    percpu_counter_read_positive(&sb->s_nr_dentry_negative) > limit)
+		schedule_work(&sb->s_negative_dentry_work);
+}
+
+static void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 
 /*
@@ -330,7 +354,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	WRITE_ONCE(dentry->d_flags, flags);
 	dentry->d_inode = NULL;
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -339,7 +363,7 @@ static void dentry_free(struct dentry *dentry)
 	if (unlikely(dname_external(dentry))) {
 		struct external_name *p = external_name(dentry);
 		if (likely(atomic_dec_and_test(&p->u.count))) {
-			call_rcu(&dentry->d_u.d_rcu, __d_free_external);
+			call_rcu_lazy(&dentry->d_u.d_rcu, __d_free_external);
 			return;
 		}
 	}
@@ -347,7 +371,7 @@ static void dentry_free(struct dentry *dentry)
 	if (dentry->d_flags & DCACHE_NORCU)
 		__d_free(&dentry->d_u.d_rcu);
 	else
-		call_rcu(&dentry->d_u.d_rcu, __d_free);
+		call_rcu_lazy(&dentry->d_u.d_rcu, __d_free);
 }
 
 /*
@@ -400,7 +424,7 @@ static void d_lru_add(struct dentry *dentry)
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -410,7 +434,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -442,7 +466,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -452,7 +476,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -1244,6 +1268,76 @@ static enum lru_status dentry_lru_isolate_shrink(struct list_head *item,
 }
 
 
+static enum lru_status dentry_lru_isolate_negative(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct list_head *freeable = arg;
+	struct dentry	*dentry = container_of(item, struct dentry, d_lru);
+
+	if (!spin_trylock(&dentry->d_lock))
+		return LRU_SKIP;
+
+	/*
+	 * Rotate positive dentries out of the way, keeping their referenced
+	 * bit, so that the next batch looks at new entries.
+	 */
+	if (!d_is_negative(dentry)) {
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	if (dentry->d_lockref.count) {
+		d_lru_isolate(lru, dentry);
+		spin_unlock(&dentry->d_lock);
+		return LRU_REMOVED;
+	}
+
+	if (dentry->d_flags & DCACHE_REFERENCED) {
+		dentry->d_flags &= ~DCACHE_REFERENCED;
+		spin_unlock(&dentry->d_lock);
+		return LRU_ROTATE;
+	}
+
+	d_lru_shrink_move(lru, dentry, freeable);
+	spin_unlock(&dentry->d_lock);
+
+	return LRU_REMOVED;
+}
+
+/*
+ * Trim the negative dentries of a superblock back below
+ * sysctl_negative_dentry_limit, leaving some slack so that we are not
+ * rescheduled on the very next negative lookup.  At most one pass over the
+ * LRU is made.
+ */
+void d_negative_trim_work(struct work_struct *work)
+{
+	struct super_block *sb = container_of(work, struct super_block,
+					      s_negative_dentry_work);
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+	long excess, to_walk;
+
+	if (!limit || !trylock_super(sb))
+		return;
+	if (!(sb->s_flags & SB_BORN))
+		goto out;
+
+	excess = percpu_counter_sum_positive(&sb->s_nr_dentry_negative) -
+		 (limit - limit / 8);
+	to_walk = list_lru_count(&sb->s_dentry_lru);
+	while (excess > 0 && to_walk > 0) {
+		LIST_HEAD(dispose);
+
+		excess -= list_lru_walk(&sb->s_dentry_lru,
+				dentry_lru_isolate_negative, &dispose, 1024);
+		shrink_dentry_list(&dispose);
+		to_walk -= 1024;
+		cond_resched();
+	}
+out:
+	up_read(&sb->s_umount);
+}
+
 /**
  * shrink_dcache_sb - shrink dcache for a superblock
  * @sb: superblock
@@ -1942,7 +2036,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 * Decrement negative dentry count if it was in the LRU list.
 	 */
 	if (dentry->d_flags & DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
@@ -2655,6 +2749,41 @@ void __d_lookup_done(struct dentry *dentry)
 }
 EXPORT_SYMBOL(__d_lookup_done);
 
+/**
+ * d_lock_update - exclude other creates and removals of a name
+ * @dentry: dentry about to be created or removed
+ *
+ * When the parent is only locked shared (see IS_PAR_DIROPS()), this keeps
+ * concurrent create and unlink of the same name apart.  Sleeps until no one
+ * else holds the update lock on @dentry.  The caller must hold a reference
+ * and recheck d_unhashed() afterwards: the dentry may have been dropped by
+ * the previous holder.
+ */
+void d_lock_update(struct dentry *dentry)
+{
+	spin_lock(&dentry->d_lock);
+	while (dentry->d_flags & DCACHE_PAR_UPDATE) {
+		spin_unlock(&dentry->d_lock);
+		wait_var_event(&dentry->d_flags,
+			       !(READ_ONCE(dentry->d_flags) & DCACHE_PAR_UPDATE));
+		spin_lock(&dentry->d_lock);
+	}
+	dentry->d_flags |= DCACHE_PAR_UPDATE;
+	spin_unlock(&dentry->d_lock);
+}
+EXPORT_SYMBOL(d_lock_update);
+
+void d_unlock_update(struct dentry *dentry)
+{
+	spin_lock(&dentry->d_lock);
+	dentry->d_flags &= ~DCACHE_PAR_UPDATE;
+	spin_unlock(&dentry->d_lock);
+	/* pairs with the barrier in wait_var_event()'s prepare_to_wait */
+	smp_mb();
+	wake_up_var(&dentry->d_flags);
+}
+EXPORT_SYMBOL(d_unlock_update);
+
 /* inode->i_lock held if inode is non-NULL */
 
 static inline void __d_add(struct dentry *dentry, struct inode *inode)
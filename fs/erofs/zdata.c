@@ -7,6 +7,8 @@
 #include "zdata.h"
 #include "compress.h"
 #include <linux/prefetch.h>
+#include <linux/cpuhotplug.h>
+#include <linux/kthread.h>
 
 #include <trace/events/erofs.h>
 
@@ -34,8 +36,96 @@ typedef tagptr1_t compressed_page_t;
 static struct workqueue_struct *z_erofs_workqueue __read_mostly;
 static struct kmem_cache *pcluster_cachep __read_mostly;
 
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+static struct kthread_worker __rcu **z_erofs_pcpu_workers;
+static enum cpuhp_state erofs_cpuhp_state;
+static DEFINE_SPINLOCK(z_erofs_pcpu_worker_lock);
+
+static struct kthread_worker *erofs_init_percpu_worker(int cpu)
+{
+	struct kthread_worker *worker =
+		kthread_create_worker_on_cpu(cpu, 0, "erofs_worker/%u", cpu);
+
+	if (IS_ERR(worker))
+		return worker;
+	if (IS_ENABLED(CONFIG_EROFS_FS_PCPU_KTHREAD_HIPRI))
+		sched_set_fifo_low(worker->task);
+	return worker;
+}
+
+static int erofs_cpu_online(unsigned int cpu)
+{
+	struct kthread_worker *worker, *old;
+
+	worker = erofs_init_percpu_worker(cpu);
+	if (IS_ERR(worker))
+		return PTR_ERR(worker);
+
+	spin_lock(&z_erofs_pcpu_worker_lock);
+	old = rcu_dereference_protected(z_erofs_pcpu_workers[cpu],
+			lockdep_is_held(&z_erofs_pcpu_worker_lock));
+	if (!old)
+		rcu_assign_pointer(z_erofs_pcpu_workers[cpu], worker);
+	spin_unlock(&z_erofs_pcpu_worker_lock);
+	if (old)
+		kthread_destroy_worker(worker);
+	return 0;
+}
+
+static int erofs_cpu_offline(unsigned int cpu)
+{
+	struct kthread_worker *worker;
+
+	spin_lock(&z_erofs_pcpu_worker_lock);
+	worker = rcu_dereference_protected(z_erofs_pcpu_workers[cpu],
+			lockdep_is_held(&z_erofs_pcpu_worker_lock));
+	rcu_assign_pointer(z_erofs_pcpu_workers[cpu], NULL);
+	spin_unlock(&z_erofs_pcpu_worker_lock);
+
+	synchronize_rcu();
+	if (worker)
+		kthread_destroy_worker(worker);
+	return 0;
+}
+
+static int z_erofs_init_pcpu_workers(void)
+{
+	int ret;
+
+	z_erofs_pcpu_workers = kcalloc(num_possible_cpus(),
+				       sizeof(*z_erofs_pcpu_workers),
+				       GFP_KERNEL);
+	if (!z_erofs_pcpu_workers)
+		return -ENOMEM;
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "fs/erofs:online",
+				erofs_cpu_online, erofs_cpu_offline);
+	if (ret < 0) {
+		kfree(z_erofs_pcpu_workers);
+		z_erofs_pcpu_workers = NULL;
+		return ret;
+	}
+	erofs_cpuhp_state = ret;
+	return 0;
+}
+
+static void z_erofs_destroy_pcpu_workers(void)
+{
+	if (!z_erofs_pcpu_workers)
+		return;
+	/* the offline callback tears down each worker */
+	cpuhp_remove_state(erofs_cpuhp_state);
+	kfree(z_erofs_pcpu_workers);
+	z_erofs_pcpu_workers = NULL;
+}
+#else
+static inline int z_erofs_init_pcpu_workers(void) { return 0; }
+static inline void z_erofs_destroy_pcpu_workers(void) {}
+#endif
+
 void z_erofs_exit_zip_subsystem(void)
 {
+	z_erofs_destroy_pcpu_workers();
 	destroy_workqueue(z_erofs_workqueue);
 	kmem_cache_destroy(pcluster_cachep);
 }
@@ -74,8 +164,12 @@ int __init z_erofs_init_zip_subsystem(void)
 					    SLAB_RECLAIM_ACCOUNT,
 					    z_erofs_pcluster_init_once);
 	if (pcluster_cachep) {
-		if (!z_erofs_init_workqueue())
+		if (!z_erofs_init_workqueue()) {
+			/* fall back to the workqueue if this fails */
+			if (z_erofs_init_pcpu_workers())
+				pr_warn("failed to create per-CPU decompression workers\n");
 			return 0;
+		}
 
 		kmem_cache_destroy(pcluster_cachep);
 	}
@@ -691,6 +785,11 @@ static int z_erofs_do_read_page(struct z_erofs_decompress_frontend *fe,
 	goto out;
 }
 
+static void z_erofs_decompressqueue_work(struct work_struct *work);
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+static void z_erofs_decompressqueue_kthread_work(struct kthread_work *work);
+#endif
+
 static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 				       bool sync, int bios)
 {
@@ -705,8 +804,33 @@ static void z_erofs_decompress_kickoff(struct z_erofs_decompressqueue *io,
 		return;
 	}
 
-	if (!atomic_add_return(bios, &io->pending_bios))
-		queue_work(z_erofs_workqueue, &io->u.work);
+	if (atomic_add_return(bios, &io->pending_bios))
+		return;
+
+	/* decompress in place unless the last bio completed in atomic context */
+	if (!in_atomic() && !irqs_disabled()) {
+		z_erofs_decompressqueue_work(&io->u.work);
+		return;
+	}
+
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+	{
+		struct kthread_worker *worker;
+
+		rcu_read_lock();
+		worker = rcu_dereference(
+				z_erofs_pcpu_workers[raw_smp_processor_id()]);
+		if (worker) {
+			kthread_init_work(&io->u.kthread_work,
+					  z_erofs_decompressqueue_kthread_work);
+			kthread_queue_work(worker, &io->u.kthread_work);
+			rcu_read_unlock();
+			return;
+		}
+		rcu_read_unlock();
+	}
+#endif
+	queue_work(z_erofs_workqueue, &io->u.work);
 }
 
 static void z_erofs_decompressqueue_endio(struct bio *bio)
@@ -958,10 +1082,8 @@ static void z_erofs_decompress_queue(const struct z_erofs_decompressqueue *io,
 	}
 }
 
-static void z_erofs_decompressqueue_work(struct work_struct *work)
+static void z_erofs_decompress_bgqueue(struct z_erofs_decompressqueue *bgq)
 {
-	struct z_erofs_decompressqueue *bgq =
-		container_of(work, struct z_erofs_decompressqueue, u.work);
 	LIST_HEAD(pagepool);
 
 	DBG_BUGON(bgq->head == Z_EROFS_PCLUSTER_TAIL_CLOSED);
@@ -971,6 +1093,20 @@ static void z_erofs_decompressqueue_work(struct work_struct *work)
 	kvfree(bgq);
 }
 
+static void z_erofs_decompressqueue_work(struct work_struct *work)
+{
+	z_erofs_decompress_bgqueue(container_of(work,
+				struct z_erofs_decompressqueue, u.work));
+}
+
+#ifdef CONFIG_EROFS_FS_PCPU_KTHREAD
+static void z_erofs_decompressqueue_kthread_work(struct kthread_work *work)
+{
+	z_erofs_decompress_bgqueue(container_of(work,
+				struct z_erofs_decompressqueue, u.kthread_work));
+}
+#endif
+
 static struct page *pickup_page_for_submission(struct z_erofs_pcluster *pcl,
 					       unsigned int nr,
 					       struct list_head *pagepool,
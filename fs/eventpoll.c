@@ -23,6 +23,7 @@
 #include <linux/syscalls.h>
 #include <linux/rbtree.h>
 #include <linux/wait.h>
+#include <linux/hrtimer.h>
 #include <linux/eventpoll.h>
 #include <linux/mount.h>
 #include <linux/bitops.h>
@@ -220,9 +221,16 @@ struct eventpoll {
 	/* used to optimize loop detection check */
 	u64 gen;
 
+	/* wakeup batching, set by EPOLL_CTL_MIN_WAIT */
+	unsigned int min_events;
+	u64 min_wait_ns;
+
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	/* used to track busy poll napi_id */
 	unsigned int napi_id;
+	/* busy poll mode of the socket that supplied napi_id */
+	u8 prefer_busy_poll;
+	u16 busy_poll_budget;
 #endif
 
 #ifdef CONFIG_DEBUG_LOCK_ALLOC
@@ -396,8 +404,12 @@ static void ep_busy_loop(struct eventpoll *ep, int nonblock)
 {
 	unsigned int napi_id = READ_ONCE(ep->napi_id);
 
+	u16 budget = READ_ONCE(ep->busy_poll_budget);
+
 	if ((napi_id >= MIN_NAPI_ID) && net_busy_loop_on())
-		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep);
+		napi_busy_loop(napi_id, nonblock ? NULL : ep_busy_loop_end, ep,
+			       READ_ONCE(ep->prefer_busy_poll),
+			       budget ?: BUSY_POLL_BUDGET);
 }
 
 static inline void ep_reset_busy_poll_napi_id(struct eventpoll *ep)
@@ -431,11 +443,16 @@ static inline void ep_set_busy_poll_napi_id(struct epitem *epi)
 	napi_id = READ_ONCE(sk->sk_napi_id);
 	ep = epi->ep;
 
-	/* Non-NAPI IDs can be rejected
-	 *	or
-	 * Nothing to do if we already have this ID
-	 */
-	if (napi_id < MIN_NAPI_ID || napi_id == ep->napi_id)
+	/* Non-NAPI IDs can be rejected */
+	if (napi_id < MIN_NAPI_ID)
+		return;
+
+	/* Busy poll the way the socket asked for, see SO_PREFER_BUSY_POLL */
+	WRITE_ONCE(ep->prefer_busy_poll, READ_ONCE(sk->sk_prefer_busy_poll));
+	WRITE_ONCE(ep->busy_poll_budget, READ_ONCE(sk->sk_busy_poll_budget));
+
+	/* Nothing to do if we already have this ID */
+	if (napi_id == ep->napi_id)
 		return;
 
 	/* record NAPI ID for use in next busy poll */
@@ -1804,6 +1821,58 @@ static inline struct timespec64 ep_set_mstimeout(long ms)
 	return timespec64_add_safe(now, ts);
 }
 
+/* Longest batching delay accepted by EPOLL_CTL_MIN_WAIT */
+#define EP_MIN_WAIT_MAX_US	USEC_PER_SEC
+
+/*
+ * Waiter used when wakeup batching is enabled: the first wakeup starts a
+ * timer of min_wait_ns, and the task is only woken once min_events wakeups
+ * have been seen or the timer expires.
+ */
+struct ep_batch_wait {
+	wait_queue_entry_t wait;
+	struct hrtimer timer;
+	struct task_struct *task;
+	unsigned int nr_events;
+	unsigned int min_events;
+	u64 min_wait_ns;
+};
+
+static int ep_batch_wake_function(struct wait_queue_entry *wq_entry,
+				  unsigned int mode, int sync, void *key)
+{
+	struct ep_batch_wait *bw = container_of(wq_entry, struct ep_batch_wait,
+						wait);
+
+	/* Serialized by ep->wq.lock */
+	if (++bw->nr_events < bw->min_events) {
+		if (bw->nr_events == 1)
+			hrtimer_start(&bw->timer, ns_to_ktime(bw->min_wait_ns),
+				      HRTIMER_MODE_REL);
+		return 0;
+	}
+	return autoremove_wake_function(wq_entry, mode, sync, key);
+}
+
+static enum hrtimer_restart ep_batch_timer_fn(struct hrtimer *timer)
+{
+	struct ep_batch_wait *bw = container_of(timer, struct ep_batch_wait,
+						timer);
+
+	wake_up_process(bw->task);
+	return HRTIMER_NORESTART;
+}
+
+static int ep_set_min_wait(struct eventpoll *ep, struct epoll_event *epds)
+{
+	if (epds->data > EP_MIN_WAIT_MAX_US)
+		return -EINVAL;
+
+	WRITE_ONCE(ep->min_wait_ns, epds->data * NSEC_PER_USEC);
+	WRITE_ONCE(ep->min_events, epds->events);
+	return 0;
+}
+
 /**
  * ep_poll - Retrieves ready events, and delivers them to the caller supplied
  *           event buffer.
@@ -1826,7 +1895,8 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 {
 	int res = 0, eavail, timed_out = 0;
 	u64 slack = 0;
-	wait_queue_entry_t wait;
+	struct ep_batch_wait bw;
+	bool batch = false;
 	ktime_t expires, *to = NULL;
 
 	lockdep_assert_irqs_enabled();
@@ -1854,6 +1924,16 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		goto send_events;
 	}
 
+	bw.min_events = READ_ONCE(ep->min_events);
+	if (bw.min_events > 1) {
+		batch = true;
+		bw.task = current;
+		bw.min_wait_ns = READ_ONCE(ep->min_wait_ns);
+		hrtimer_init_on_stack(&bw.timer, CLOCK_MONOTONIC,
+				      HRTIMER_MODE_REL);
+		bw.timer.function = ep_batch_timer_fn;
+	}
+
 fetch_events:
 
 	if (!ep_events_available(ep))
@@ -1882,7 +1962,11 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * explicitly, thus ep->lock is not taken, which halts the
 		 * event delivery.
 		 */
-		init_wait(&wait);
+		init_wait(&bw.wait);
+		if (batch) {
+			bw.wait.func = ep_batch_wake_function;
+			bw.nr_events = 0;
+		}
 
 		write_lock_irq(&ep->lock);
 		/*
@@ -1904,7 +1988,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 			if (signal_pending(current))
 				res = -EINTR;
 			else
-				__add_wait_queue_exclusive(&ep->wq, &wait);
+				__add_wait_queue_exclusive(&ep->wq, &bw.wait);
 		}
 		write_unlock_irq(&ep->lock);
 
@@ -1922,7 +2006,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 
 	__set_current_state(TASK_RUNNING);
 
-	if (!list_empty_careful(&wait.entry)) {
+	if (!list_empty_careful(&bw.wait.entry)) {
 		write_lock_irq(&ep->lock);
 		/*
 		 * If the thread timed out and is not on the wait queue, it
@@ -1931,8 +2015,8 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * empty, it needs to harvest events.
 		 */
 		if (timed_out)
-			eavail = list_empty(&wait.entry);
-		__remove_wait_queue(&ep->wq, &wait);
+			eavail = list_empty(&bw.wait.entry);
+		__remove_wait_queue(&ep->wq, &bw.wait);
 		write_unlock_irq(&ep->lock);
 	}
 
@@ -1955,6 +2039,10 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 	    !(res = ep_send_events(ep, events, maxevents)) && !timed_out)
 		goto fetch_events;
 
+	if (batch) {
+		hrtimer_cancel(&bw.timer);
+		destroy_hrtimer_on_stack(&bw.timer);
+	}
 	return res;
 }
 
@@ -2133,6 +2221,13 @@ int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 	if (!f.file)
 		goto error_return;
 
+	if (op == EPOLL_CTL_MIN_WAIT) {
+		error = -EINVAL;
+		if (is_file_epoll(f.file))
+			error = ep_set_min_wait(f.file->private_data, epds);
+		goto error_fput;
+	}
+
 	/* Get the "struct file *" for the target file */
 	tf = fdget(fd);
 	if (!tf.file)
@@ -64,6 +64,9 @@
 #include <linux/compat.h>
 #include <linux/vmalloc.h>
 #include <linux/io_uring.h>
+#include <linux/ksm.h>
+#include <linux/task_work.h>
+#include <uapi/linux/spawn.h>
 
 #include <linux/uaccess.h>
 #include <asm/mmu_context.h>
@@ -375,6 +378,10 @@ static int bprm_mm_init(struct linux_binprm *bprm)
 	bprm->rlim_stack = current->signal->rlim[RLIMIT_STACK];
 	task_unlock(current->group_leader);
 
+	err = ksm_execve(mm);
+	if (err)
+		goto err;
+
 	err = __bprm_mm_init(bprm);
 	if (err)
 		goto err;
@@ -978,8 +985,6 @@ static int exec_mmap(struct mm_struct *mm)
 	tsk = current;
 	old_mm = current->mm;
 	exec_mm_release(tsk, old_mm);
-	if (old_mm)
-		sync_mm_rss(old_mm);
 
 	ret = down_write_killable(&tsk->signal->exec_update_lock);
 	if (ret)
@@ -1800,6 +1805,7 @@ static int bprm_execve(struct linux_binprm *bprm,
 	if (IS_ERR(file))
 		goto out_unmark;
 
+	sched_mm_cid_before_execve(current);
 	sched_exec();
 
 	bprm->file = file;
@@ -1821,6 +1827,7 @@ static int bprm_execve(struct linux_binprm *bprm,
 	if (retval < 0)
 		goto out;
 
+	sched_mm_cid_after_execve(current);
 	/* execve succeeded */
 	current->fs->in_exec = 0;
 	current->in_execve = 0;
@@ -1841,6 +1848,8 @@ static int bprm_execve(struct linux_binprm *bprm,
 	if (bprm->point_of_no_return && !fatal_signal_pending(current))
 		force_sigsegv(SIGSEGV);
 
+	sched_mm_cid_after_execve(current);
+
 out_unmark:
 	current->fs->in_exec = 0;
 	current->in_execve = 0;
@@ -2072,6 +2081,363 @@ SYSCALL_DEFINE5(execveat,
 			   argv, envp, flags);
 }
 
+/*
+ * spawn(2) starts a program in a new child without duplicating the caller's
+ * address space.  Like a vfork() child it shares the caller's mm, but it
+ * never runs user code in it: before first returning to user mode it applies
+ * the file actions and execs from task_work, so the caller is not blocked
+ * and does not pay for copying its page tables.  Everything the child needs
+ * is copied up front, the caller may reuse its memory once spawn returns.
+ *
+ * The file actions and the exec run inside the kernel, where seccomp does not
+ * see them, so spawn is refused to tasks running under a seccomp filter.
+ */
+struct spawn_request {
+	struct callback_head work;
+	char *filename;
+	char **argv;
+	char **envp;
+	struct spawn_action *actions;
+	char **paths;		/* kernel copies of the action paths */
+	unsigned int nr_actions;
+	sigset_t sigmask;
+};
+
+static struct user_arg_ptr spawn_user_arg_ptr(u64 uptr)
+{
+	struct user_arg_ptr p = { .ptr.native = u64_to_user_ptr(uptr) };
+
+#ifdef CONFIG_COMPAT
+	if (in_compat_syscall()) {
+		p.is_compat = true;
+		p.ptr.compat = compat_ptr(uptr);
+	}
+#endif
+	return p;
+}
+
+/* Like strndup_user(), but charged to the caller's memcg */
+static char *spawn_strndup_user(const char __user *ustr, long n)
+{
+	long length;
+	char *str;
+
+	length = strnlen_user(ustr, n);
+	if (!length)
+		return ERR_PTR(-EFAULT);
+	if (length > n)
+		return ERR_PTR(-EINVAL);
+
+	str = kmalloc(length, GFP_KERNEL_ACCOUNT);
+	if (!str)
+		return ERR_PTR(-ENOMEM);
+	if (copy_from_user(str, ustr, length)) {
+		kfree(str);
+		return ERR_PTR(-EFAULT);
+	}
+	str[length - 1] = '\0';
+	return str;
+}
+
+/*
+ * The strings end up on the new program's stack, apply the limit execve()
+ * would: see bprm_stack_limits().
+ */
+static unsigned long spawn_strings_limit(void)
+{
+	unsigned long limit = _STK_LIM / 4 * 3;
+
+	limit = min(limit, rlimit(RLIMIT_STACK) / 4);
+	return max_t(unsigned long, limit, ARG_MAX);
+}
+
+static void spawn_free_strings(char **strings)
+{
+	char **p;
+
+	if (!strings)
+		return;
+	for (p = strings; *p; p++)
+		kfree(*p);
+	kfree(strings);
+}
+
+/* Copies the strings and their pointers out of @limit bytes */
+static char **spawn_copy_strings(struct user_arg_ptr ustrings,
+				 unsigned long *limit)
+{
+	char **strings;
+	size_t len;
+	int i, n;
+
+	n = count(ustrings, MAX_ARG_STRINGS);
+	if (n < 0)
+		return ERR_PTR(n);
+	if ((unsigned long)n * sizeof(void *) >= *limit)
+		return ERR_PTR(-E2BIG);
+	*limit -= n * sizeof(void *);
+
+	strings = kcalloc(n + 1, sizeof(*strings), GFP_KERNEL_ACCOUNT);
+	if (!strings)
+		return ERR_PTR(-ENOMEM);
+
+	for (i = 0; i < n; i++) {
+		const char __user *str = get_user_arg_ptr(ustrings, i);
+		char *s;
+
+		s = IS_ERR_OR_NULL(str) ? ERR_PTR(-EFAULT) :
+				spawn_strndup_user(str, MAX_ARG_STRLEN);
+		if (IS_ERR(s))
+			goto err;
+		strings[i] = s;
+
+		len = strlen(s) + 1;
+		if (len > *limit) {
+			s = ERR_PTR(-E2BIG);
+			goto err;
+		}
+		*limit -= len;
+
+		if (fatal_signal_pending(current)) {
+			s = ERR_PTR(-ERESTARTNOHAND);
+			goto err;
+		}
+		cond_resched();
+	}
+	return strings;
+
+err:
+	spawn_free_strings(strings);
+	return ERR_CAST(s);
+}
+
+static void spawn_free_request(struct spawn_request *req)
+{
+	unsigned int i;
+
+	if (req->paths) {
+		for (i = 0; i < req->nr_actions; i++)
+			kfree(req->paths[i]);
+		kfree(req->paths);
+	}
+	kfree(req->actions);
+	spawn_free_strings(req->envp);
+	spawn_free_strings(req->argv);
+	kfree(req->filename);
+	kfree(req);
+}
+
+static int spawn_copy_actions(struct spawn_request *req, u64 uactions,
+			      unsigned int nr)
+{
+	struct spawn_action *actions;
+	unsigned int i;
+
+	actions = kmalloc_array(nr, sizeof(*actions), GFP_KERNEL_ACCOUNT);
+	if (!actions)
+		return -ENOMEM;
+	req->actions = actions;
+	if (copy_from_user(actions, u64_to_user_ptr(uactions),
+			   array_size(nr, sizeof(*actions))))
+		return -EFAULT;
+
+	req->paths = kcalloc(nr, sizeof(*req->paths), GFP_KERNEL_ACCOUNT);
+	if (!req->paths)
+		return -ENOMEM;
+	req->nr_actions = nr;
+
+	for (i = 0; i < nr; i++) {
+		char *path;
+
+		if (actions[i].__reserved)
+			return -EINVAL;
+
+		switch (actions[i].type) {
+		case SPAWN_ACTION_CLOSE:
+		case SPAWN_ACTION_DUP2:
+			continue;
+		case SPAWN_ACTION_OPEN:
+		case SPAWN_ACTION_CHDIR:
+			path = spawn_strndup_user(
+					u64_to_user_ptr(actions[i].path),
+					PATH_MAX);
+			if (IS_ERR(path))
+				return PTR_ERR(path);
+			req->paths[i] = path;
+			continue;
+		default:
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+static int spawn_apply_action(const struct spawn_action *act,
+			      const char *pathname)
+{
+	struct file *file;
+	struct path path;
+	int error;
+
+	switch (act->type) {
+	case SPAWN_ACTION_CLOSE:
+		error = ksys_close(act->fd);
+		/* Like posix_spawn(), closing an unused descriptor is fine */
+		return error == -EBADF ? 0 : error;
+	case SPAWN_ACTION_DUP2:
+		file = fget(act->fd);
+		if (!file)
+			return -EBADF;
+		if (act->fd == act->newfd) {
+			set_close_on_exec(act->fd, 0);
+			error = 0;
+		} else {
+			error = replace_fd(act->newfd, file, 0);
+		}
+		fput(file);
+		return error < 0 ? error : 0;
+	case SPAWN_ACTION_OPEN:
+		file = filp_open(pathname, act->flags, act->mode);
+		if (IS_ERR(file))
+			return PTR_ERR(file);
+		error = replace_fd(act->fd, file, act->flags & O_CLOEXEC);
+		fput(file);
+		return error < 0 ? error : 0;
+	case SPAWN_ACTION_CHDIR:
+		error = kern_path(pathname, LOOKUP_FOLLOW | LOOKUP_DIRECTORY,
+				  &path);
+		if (error)
+			return error;
+		error = inode_permission(d_inode(path.dentry),
+					 MAY_EXEC | MAY_CHDIR);
+		if (!error)
+			set_fs_pwd(current->fs, &path);
+		path_put(&path);
+		return error;
+	}
+	return -EINVAL;
+}
+
+/* Runs in the child, before it first returns to user mode */
+static void spawn_child_work(struct callback_head *work)
+{
+	struct spawn_request *req = container_of(work, struct spawn_request,
+						 work);
+	unsigned int i;
+	int error = 0;
+
+	/* Killed before getting here, task_work is being flushed by exit */
+	if (current->flags & PF_EXITING) {
+		spawn_free_request(req);
+		return;
+	}
+
+	for (i = 0; i < req->nr_actions && !error; i++)
+		error = spawn_apply_action(&req->actions[i], req->paths[i]);
+	if (!error)
+		error = kernel_execve(req->filename,
+				      (const char *const *)req->argv,
+				      (const char *const *)req->envp);
+	if (!error)
+		set_current_blocked(&req->sigmask);
+	spawn_free_request(req);
+
+	/* Same status as a shell that could not run the command */
+	if (error)
+		do_exit(127 << 8);
+}
+
+SYSCALL_DEFINE2(spawn, struct spawn_args __user *, uargs, size_t, usize)
+{
+	struct spawn_request *req;
+	struct spawn_args args;
+	struct kernel_clone_args kargs = {
+		.flags		= CLONE_VM,
+		.exit_signal	= SIGCHLD,
+	};
+	unsigned long limit;
+	void *ptr;
+	pid_t pid;
+	int err;
+
+	BUILD_BUG_ON(sizeof(struct spawn_args) != SPAWN_ARGS_SIZE_VER0);
+
+#ifdef CONFIG_SECCOMP_FILTER
+	if (current->seccomp.mode == SECCOMP_MODE_FILTER)
+		return -EPERM;
+#endif
+
+	if (unlikely(usize < SPAWN_ARGS_SIZE_VER0))
+		return -EINVAL;
+	err = copy_struct_from_user(&args, sizeof(args), uargs, usize);
+	if (err)
+		return err;
+
+	if (args.flags & ~SPAWN_SETSIGMASK)
+		return -EINVAL;
+	if (args.nr_actions > SPAWN_ACTIONS_MAX)
+		return -EINVAL;
+
+	req = kzalloc(sizeof(*req), GFP_KERNEL_ACCOUNT);
+	if (!req)
+		return -ENOMEM;
+	init_task_work(&req->work, spawn_child_work);
+
+	ptr = spawn_strndup_user(u64_to_user_ptr(args.filename), PATH_MAX);
+	if (IS_ERR(ptr))
+		goto out_err;
+	req->filename = ptr;
+
+	/* the filename goes on the new stack as well, it fits in ARG_MAX */
+	limit = spawn_strings_limit() - (strlen(req->filename) + 1);
+
+	ptr = spawn_copy_strings(spawn_user_arg_ptr(args.argv), &limit);
+	if (IS_ERR(ptr))
+		goto out_err;
+	req->argv = ptr;
+
+	ptr = spawn_copy_strings(spawn_user_arg_ptr(args.envp), &limit);
+	if (IS_ERR(ptr))
+		goto out_err;
+	req->envp = ptr;
+
+	if (args.nr_actions) {
+		err = spawn_copy_actions(req, args.actions, args.nr_actions);
+		if (err)
+			goto out_free;
+	}
+
+	req->sigmask = current->blocked;
+	if (args.flags & SPAWN_SETSIGMASK) {
+#ifdef CONFIG_COMPAT
+		if (in_compat_syscall())
+			err = get_compat_sigset(&req->sigmask,
+					compat_ptr(args.sigmask));
+		else
+#endif
+		if (copy_from_user(&req->sigmask,
+				   u64_to_user_ptr(args.sigmask),
+				   sizeof(sigset_t)))
+			err = -EFAULT;
+		if (err)
+			goto out_free;
+		sigdelsetmask(&req->sigmask, sigmask(SIGKILL) | sigmask(SIGSTOP));
+	}
+
+	/* From here on the child owns req, see kernel_clone() */
+	kargs.spawn_work = &req->work;
+	pid = kernel_clone(&kargs);
+	if (pid < 0)
+		spawn_free_request(req);
+	return pid;
+
+out_err:
+	err = PTR_ERR(ptr);
+out_free:
+	spawn_free_request(req);
+	return err;
+}
+
 #ifdef CONFIG_COMPAT
 COMPAT_SYSCALL_DEFINE3(execve, const char __user *, filename,
 	const compat_uptr_t __user *, argv,
@@ -136,6 +136,9 @@ static int ext4_readdir(struct file *file, struct dir_context *ctx)
 			 * critical that it gets flushed back to the disk.
 			 */
 			ext4_clear_inode_flag(inode, EXT4_INODE_INDEX);
+		} else if (IS_PAR_DIROPS(inode)) {
+			/* The linear walk can't run against parallel updates */
+			return -EFSCORRUPTED;
 		}
 	}
 
@@ -533,6 +536,7 @@ static int ext4_dx_readdir(struct file *file, struct dir_context *ctx)
 {
 	struct dir_private_info *info = file->private_data;
 	struct inode *inode = file_inode(file);
+	bool par = IS_PAR_DIROPS(inode);
 	struct fname *fname;
 	int ret = 0;
 
@@ -578,9 +582,13 @@ static int ext4_dx_readdir(struct file *file, struct dir_context *ctx)
 			info->curr_node = NULL;
 			free_rb_tree_fname(&info->root);
 			file->f_version = inode_query_iversion(inode);
+			if (par)
+				down_read(&EXT4_I(inode)->i_dir_sem);
 			ret = ext4_htree_fill_tree(file, info->curr_hash,
 						   info->curr_minor_hash,
 						   &info->next_hash);
+			if (par)
+				up_read(&EXT4_I(inode)->i_dir_sem);
 			if (ret < 0)
 				goto finished;
 			if (ret == 0) {
@@ -1019,6 +1019,16 @@ struct ext4_inode_info {
 	 */
 	struct rw_semaphore xattr_sem;
 
+	/*
+	 * Directories with S_PAR_DIROPS get create and unlink called with
+	 * i_rwsem only held shared.  i_dir_sem then serializes the changes
+	 * to the directory blocks: it is held for write while an entry is
+	 * added or removed, and for read while lookup and readdir walk the
+	 * blocks.  It ranks below transaction start.  Other directories
+	 * don't take it.
+	 */
+	struct rw_semaphore i_dir_sem;
+
 	struct list_head i_orphan;	/* unlinked but open inodes */
 
 	/* Fast commit related info */
@@ -1237,6 +1247,10 @@ struct ext4_inode_info {
 #define EXT4_MOUNT2_JOURNAL_FAST_COMMIT	0x00000010 /* Journal fast commit */
 #define EXT4_MOUNT2_DAX_NEVER		0x00000020 /* Do not allow Direct Access */
 #define EXT4_MOUNT2_DAX_INODE		0x00000040 /* For printing options only */
+#define EXT4_MOUNT2_MB_OPTIMIZE_SCAN	0x00000080 /* Pick groups by their largest
+						      free extent */
+#define EXT4_MOUNT2_PAR_DIROPS		0x00000100 /* Create and unlink in
+						      parallel in htree dirs */
 
 
 #define clear_opt(sb, opt)		EXT4_SB(sb)->s_mount_opt &= \
@@ -1535,6 +1549,9 @@ struct ext4_sb_info {
 	unsigned long s_mb_last_start;
 	unsigned int s_mb_prefetch;
 	unsigned int s_mb_prefetch_limit;
+	/* initialized groups, listed by bb_largest_free_order */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
 
 	/* stats for buddy allocator */
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1644,6 +1661,8 @@ struct ext4_sb_info {
 	struct buffer_head *s_fc_bh;
 	struct ext4_fc_stats s_fc_stats;
 	u64 s_fc_avg_commit_time;
+	ktime_t s_fc_last_commit_end;	/* end of the last fast commit */
+	pid_t s_fc_last_sync_writer;	/* last task to request a fast commit */
 #ifdef CONFIG_EXT4_DEBUG
 	int s_fc_debug_max_replay;
 #endif
@@ -1690,9 +1709,10 @@ enum {
 	EXT4_MF_MNTDIR_SAMPLED,
 	EXT4_MF_FS_ABORTED,	/* Fatal error detected */
 	EXT4_MF_FC_INELIGIBLE,	/* Fast commit ineligible */
-	EXT4_MF_FC_COMMITTING	/* File system underoing a fast
+	EXT4_MF_FC_COMMITTING,	/* File system underoing a fast
 				 * commit.
 				 */
+	EXT4_MF_MB_OPTIMIZE_SCAN /* mb_optimize_scan was given at mount */
 };
 
 static inline void ext4_set_mount_flag(struct super_block *sb, int bit)
@@ -3285,6 +3305,8 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
+	struct          list_head bb_largest_free_order_node;
 	struct          list_head bb_prealloc_list;
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
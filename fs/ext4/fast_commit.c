@@ -7,6 +7,8 @@
  *
  * Ext4 fast commits routines.
  */
+#include <linux/hrtimer.h>
+
 #include "ext4.h"
 #include "ext4_jbd2.h"
 #include "ext4_extents.h"
@@ -1075,6 +1077,42 @@ static int ext4_fc_perform_commit(journal_t *journal)
 	return ret;
 }
 
+/*
+ * Fast commit batching. When fsyncs from different tasks race, give the
+ * other tasks a chance to queue their inodes so that a single fast commit
+ * covers all of them, instead of each fsync paying for its own commit and
+ * flush. This mirrors what jbd2_journal_stop() does for synchronous handles:
+ * sleep for about one average commit time, bounded by the min_batch_time
+ * and max_batch_time mount options, unless the updates pending since the
+ * last fast commit are already older than that. Returns true if we slept.
+ */
+static bool ext4_fc_batch_wait(struct super_block *sb)
+{
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	pid_t pid = current->pid;
+	u64 commit_time, batch_time;
+	ktime_t expires;
+
+	if (!sbi->s_max_batch_time ||
+	    READ_ONCE(sbi->s_fc_last_sync_writer) == pid)
+		return false;
+	WRITE_ONCE(sbi->s_fc_last_sync_writer, pid);
+
+	commit_time = READ_ONCE(sbi->s_fc_avg_commit_time);
+	commit_time = max_t(u64, commit_time, 1000ULL * sbi->s_min_batch_time);
+	commit_time = min_t(u64, commit_time, 1000ULL * sbi->s_max_batch_time);
+
+	batch_time = ktime_to_ns(ktime_sub(ktime_get(),
+				 READ_ONCE(sbi->s_fc_last_commit_end)));
+	if (batch_time >= commit_time)
+		return false;
+
+	expires = ktime_add_ns(ktime_get(), commit_time);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_ABS);
+	return true;
+}
+
 /*
  * The main commit entry point. Performs a fast commit for transaction
  * commit_tid if needed. If it's not possible to perform a fast commit
@@ -1088,6 +1126,7 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 	int nblks = 0, ret, bsize = journal->j_blocksize;
 	int subtid = atomic_read(&sbi->s_fc_subtid);
 	int reason = EXT4_FC_REASON_OK, fc_bufs_before = 0;
+	bool batched = false;
 	ktime_t start_time, commit_time;
 
 	trace_ext4_fc_commit_start(sb);
@@ -1100,6 +1139,20 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 		goto out;
 	}
 
+	/*
+	 * If another task's fast commit completed while we were waiting, it
+	 * covered the inodes we queued, so there is nothing left to commit.
+	 * Don't let the wait itself feed into the average commit time.
+	 */
+	if (ext4_fc_batch_wait(sb)) {
+		start_time = ktime_get();
+		if (atomic_read(&sbi->s_fc_subtid) > subtid) {
+			reason = EXT4_FC_REASON_ALREADY_COMMITTED;
+			batched = true;
+			goto out;
+		}
+	}
+
 restart_fc:
 	ret = jbd2_fc_begin_commit(journal, commit_tid);
 	if (ret == -EALREADY) {
@@ -1130,6 +1183,7 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 		goto out;
 	}
 	atomic_inc(&sbi->s_fc_subtid);
+	WRITE_ONCE(sbi->s_fc_last_commit_end, ktime_get());
 	jbd2_fc_end_commit(journal);
 out:
 	/* Has any ineligible update happened since we started? */
@@ -1145,6 +1199,8 @@ int ext4_fc_commit(journal_t *journal, tid_t commit_tid)
 	} else {
 		sbi->s_fc_stats.fc_num_commits++;
 		sbi->s_fc_stats.fc_numblks += nblks;
+		if (batched)
+			sbi->s_fc_stats.fc_batched++;
 	}
 	spin_unlock(&sbi->s_fc_lock);
 	nblks = (reason == EXT4_FC_REASON_OK) ? nblks : 0;
@@ -2147,9 +2203,9 @@ int ext4_fc_info_show(struct seq_file *seq, void *v)
 		return 0;
 
 	seq_printf(seq,
-		"fc stats:\n%ld commits\n%ld ineligible\n%ld numblks\n%lluus avg_commit_time\n",
+		"fc stats:\n%ld commits\n%ld ineligible\n%ld numblks\n%ld batched\n%lluus avg_commit_time\n",
 		   stats->fc_num_commits, stats->fc_ineligible_commits,
-		   stats->fc_numblks,
+		   stats->fc_numblks, stats->fc_batched,
 		   div_u64(sbi->s_fc_avg_commit_time, 1000));
 	seq_puts(seq, "Ineligible reasons:\n");
 	for (i = 0; i < EXT4_FC_REASON_MAX; i++)
@@ -4506,6 +4506,30 @@ static bool ext4_should_enable_dax(struct inode *inode)
 	return ext4_test_inode_flag(inode, EXT4_INODE_DAX);
 }
 
+/*
+ * Whether the VFS may call create and unlink on this directory with i_rwsem
+ * held shared.  Lookups and readdir of an htree directory take i_dir_sem,
+ * the linear walks do not.  With metadata_csum, a corrupted htree index is
+ * an error rather than a fallback to a linear directory.  Casefolded
+ * directories don't keep negative dentries hashed, which the VFS relies on
+ * to order a create against an unlink of the same name.
+ */
+static bool ext4_should_par_dirops(struct inode *inode)
+{
+	if (!test_opt2(inode->i_sb, PAR_DIROPS))
+		return false;
+	if (!S_ISDIR(inode->i_mode))
+		return false;
+	if (!is_dx(inode))
+		return false;
+	if (!ext4_has_metadata_csum(inode->i_sb))
+		return false;
+	if (ext4_test_inode_flag(inode, EXT4_INODE_CASEFOLD))
+		return false;
+
+	return true;
+}
+
 void ext4_set_inode_flags(struct inode *inode, bool init)
 {
 	unsigned int flags = EXT4_I(inode)->i_flags;
@@ -4536,9 +4560,11 @@ void ext4_set_inode_flags(struct inode *inode, bool init)
 		new_fl |= S_CASEFOLD;
 	if (flags & EXT4_VERITY_FL)
 		new_fl |= S_VERITY;
+	if (ext4_should_par_dirops(inode))
+		new_fl |= S_PAR_DIROPS;
 	inode_set_flags(inode, new_fl,
 			S_SYNC|S_APPEND|S_IMMUTABLE|S_NOATIME|S_DIRSYNC|S_DAX|
-			S_ENCRYPTED|S_CASEFOLD|S_VERITY);
+			S_ENCRYPTED|S_CASEFOLD|S_VERITY|S_PAR_DIROPS);
 }
 
 static blkcnt_t ext4_inode_blocks(struct ext4_inode *raw_inode,
@@ -751,18 +751,37 @@ static void ext4_mb_mark_free_simple(struct super_block *sb,
 static void
 mb_set_largest_free_order(struct super_block *sb, struct ext4_group_info *grp)
 {
-	int i;
-	int bits;
-
-	grp->bb_largest_free_order = -1; /* uninit */
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	int i, new_order = -1;
 
-	bits = sb->s_blocksize_bits + 1;
-	for (i = bits; i >= 0; i--) {
+	for (i = MB_NUM_ORDERS(sb) - 1; i >= 0; i--) {
 		if (grp->bb_counters[i] > 0) {
-			grp->bb_largest_free_order = i;
+			new_order = i;
 			break;
 		}
 	}
+
+	if (!ext4_test_mount_flag(sb, EXT4_MF_MB_OPTIMIZE_SCAN) ||
+	    new_order == grp->bb_largest_free_order) {
+		grp->bb_largest_free_order = new_order;
+		return;
+	}
+
+	/* Move the group to the list of its new largest free order */
+	if (grp->bb_largest_free_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+		list_del_init(&grp->bb_largest_free_order_node);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[
+					grp->bb_largest_free_order]);
+	}
+	grp->bb_largest_free_order = new_order;
+	if (new_order >= 0) {
+		write_lock(&sbi->s_mb_largest_free_orders_locks[new_order]);
+		list_add_tail(&grp->bb_largest_free_order_node,
+			      &sbi->s_mb_largest_free_orders[new_order]);
+		write_unlock(&sbi->s_mb_largest_free_orders_locks[new_order]);
+	}
 }
 
 static noinline_for_stack
@@ -2296,6 +2315,58 @@ void ext4_mb_prefetch_fini(struct super_block *sb, ext4_group_t group,
 	}
 }
 
+/*
+ * With mb_optimize_scan, pick the next group for cr 0 or 1 from the
+ * largest free order lists instead of walking all groups.  Only groups
+ * with an initialized buddy are listed, so no bitmap is read here.  The
+ * lowest order that can hold the request is tried first.
+ */
+static bool ext4_mb_choose_next_group_order(struct ext4_allocation_context *ac,
+					    int cr, ext4_group_t *group,
+					    ext4_group_t ngroups)
+{
+	struct super_block *sb = ac->ac_sb;
+	struct ext4_sb_info *sbi = EXT4_SB(sb);
+	struct ext4_group_info *grp;
+	int order;
+
+	order = cr == 0 ? ac->ac_2order : fls(ac->ac_g_ex.fe_len) - 1;
+	for (; order < MB_NUM_ORDERS(sb); order++) {
+		if (list_empty(&sbi->s_mb_largest_free_orders[order]))
+			continue;
+		read_lock(&sbi->s_mb_largest_free_orders_locks[order]);
+		list_for_each_entry(grp, &sbi->s_mb_largest_free_orders[order],
+				    bb_largest_free_order_node) {
+			if (grp->bb_group < ngroups &&
+			    ext4_mb_good_group(ac, grp->bb_group, cr)) {
+				*group = grp->bb_group;
+				read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+				return true;
+			}
+		}
+		read_unlock(&sbi->s_mb_largest_free_orders_locks[order]);
+	}
+	return false;
+}
+
+/*
+ * Advance to the next group to scan.  For cr 0 and 1 with
+ * mb_optimize_scan the group comes from the largest free order lists,
+ * and the pass ends once they hold nothing suitable.
+ */
+static void ext4_mb_next_group(struct ext4_allocation_context *ac, int cr,
+			       ext4_group_t *group, ext4_group_t *i,
+			       ext4_group_t ngroups)
+{
+	(*i)++;
+	if (cr < 2 && ext4_test_mount_flag(ac->ac_sb, EXT4_MF_MB_OPTIMIZE_SCAN)) {
+		if (!ext4_mb_choose_next_group_order(ac, cr, group, ngroups))
+			*i = ngroups;
+		return;
+	}
+	(*group)++;
+}
+
 static noinline_for_stack int
 ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 {
@@ -2373,7 +2444,8 @@ ext4_mb_regular_allocator(struct ext4_allocation_context *ac)
 		group = ac->ac_g_ex.fe_group;
 		prefetch_grp = group;
 
-		for (i = 0; i < ngroups; group++, i++) {
+		for (i = 0; i < ngroups;
+		     ext4_mb_next_group(ac, cr, &group, &i, ngroups)) {
 			int ret = 0;
 			cond_resched();
 			/*
@@ -2676,7 +2748,9 @@ int ext4_mb_add_groupinfo(struct super_block *sb, ext4_group_t group,
 	INIT_LIST_HEAD(&meta_group_info[i]->bb_prealloc_list);
 	init_rwsem(&meta_group_info[i]->alloc_sem);
 	meta_group_info[i]->bb_free_root = RB_ROOT;
+	INIT_LIST_HEAD(&meta_group_info[i]->bb_largest_free_order_node);
 	meta_group_info[i]->bb_largest_free_order = -1;  /* uninit */
+	meta_group_info[i]->bb_group = group;
 
 	mb_group_bb_bitmap_alloc(sb, meta_group_info[i], group);
 	return 0;
@@ -2873,6 +2947,28 @@ int ext4_mb_init(struct super_block *sb)
 		i++;
 	} while (i <= sb->s_blocksize_bits + 1);
 
+	sbi->s_mb_largest_free_orders =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(struct list_head),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	sbi->s_mb_largest_free_orders_locks =
+		kmalloc_array(MB_NUM_ORDERS(sb), sizeof(rwlock_t),
+			      GFP_KERNEL);
+	if (!sbi->s_mb_largest_free_orders_locks) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < MB_NUM_ORDERS(sb); i++) {
+		INIT_LIST_HEAD(&sbi->s_mb_largest_free_orders[i]);
+		rwlock_init(&sbi->s_mb_largest_free_orders_locks[i]);
+	}
+	/* Only honoured at mount, the lists would be stale otherwise */
+	if (test_opt2(sb, MB_OPTIMIZE_SCAN))
+		ext4_set_mount_flag(sb, EXT4_MF_MB_OPTIMIZE_SCAN);
+
 	spin_lock_init(&sbi->s_md_lock);
 	spin_lock_init(&sbi->s_bal_lock);
 	sbi->s_mb_free_pending = 0;
@@ -2936,6 +3032,10 @@ int ext4_mb_init(struct super_block *sb)
 	free_percpu(sbi->s_locality_groups);
 	sbi->s_locality_groups = NULL;
 out:
+	kfree(sbi->s_mb_largest_free_orders);
+	sbi->s_mb_largest_free_orders = NULL;
+	kfree(sbi->s_mb_largest_free_orders_locks);
+	sbi->s_mb_largest_free_orders_locks = NULL;
 	kfree(sbi->s_mb_offsets);
 	sbi->s_mb_offsets = NULL;
 	kfree(sbi->s_mb_maxs);
@@ -2992,6 +3092,8 @@ int ext4_mb_release(struct super_block *sb)
 		kvfree(group_info);
 		rcu_read_unlock();
 	}
+	kfree(sbi->s_mb_largest_free_orders);
+	kfree(sbi->s_mb_largest_free_orders_locks);
 	kfree(sbi->s_mb_offsets);
 	kfree(sbi->s_mb_maxs);
 	iput(sbi->s_buddy_cache);
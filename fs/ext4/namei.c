@@ -1683,16 +1683,24 @@ static struct dentry *ext4_lookup(struct inode *dir, struct dentry *dentry, unsi
 	struct inode *inode;
 	struct ext4_dir_entry_2 *de;
 	struct buffer_head *bh;
+	bool par = IS_PAR_DIROPS(dir);
+	__u32 ino = 0;
 
 	if (dentry->d_name.len > EXT4_NAME_LEN)
 		return ERR_PTR(-ENAMETOOLONG);
 
+	/* the blocks can only change under us with parallel dir-ops */
+	if (par)
+		down_read(&EXT4_I(dir)->i_dir_sem);
 	bh = ext4_lookup_entry(dir, dentry, &de);
+	if (!IS_ERR_OR_NULL(bh))
+		ino = le32_to_cpu(de->inode);
+	if (par)
+		up_read(&EXT4_I(dir)->i_dir_sem);
 	if (IS_ERR(bh))
 		return ERR_CAST(bh);
 	inode = NULL;
 	if (bh) {
-		__u32 ino = le32_to_cpu(de->inode);
 		brelse(bh);
 		if (!ext4_valid_inum(dir->i_sb, ino)) {
 			EXT4_ERROR_INODE(dir, "bad inode number: %u", ino);
@@ -2098,6 +2106,7 @@ static int make_indexed_dir(handle_t *handle, struct ext4_filename *fname,
 		return PTR_ERR(bh2);
 	}
 	ext4_set_inode_flag(dir, EXT4_INODE_INDEX);
+	ext4_set_inode_flags(dir, false);
 	data2 = bh2->b_data;
 
 	memcpy(data2, de, len);
@@ -2172,6 +2181,11 @@ static int make_indexed_dir(handle_t *handle, struct ext4_filename *fname,
  * NOTE!! The inode part of 'de' is left at 0 - which means you
  * may not sleep between calling this and putting something into
  * the entry, as someone else might have used it while you slept.
+ *
+ * With S_PAR_DIROPS the directory blocks are only changed under i_dir_sem,
+ * as create may run with the parent's i_rwsem held shared, see
+ * ext4_should_par_dirops().  make_indexed_dir() may set the flag on the way,
+ * so whether to take i_dir_sem is decided once up front.
  */
 static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 			  struct inode *inode)
@@ -2186,6 +2200,7 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	unsigned blocksize;
 	ext4_lblk_t block, blocks;
 	int	csum_size = 0;
+	bool	par = IS_PAR_DIROPS(dir);
 
 	if (ext4_has_metadata_csum(inode->i_sb))
 		csum_size = sizeof(struct ext4_dir_entry_tail);
@@ -2208,6 +2223,8 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 	if (retval)
 		return retval;
 
+	if (par)
+		down_write(&EXT4_I(dir)->i_dir_sem);
 	if (ext4_has_inline_data(dir)) {
 		retval = ext4_try_add_inline_entry(handle, &fname, dir, inode);
 		if (retval < 0)
@@ -2278,6 +2295,8 @@ static int ext4_add_entry(handle_t *handle, struct dentry *dentry,
 
 	retval = add_dirent_to_buf(handle, &fname, dir, inode, de, bh);
 out:
+	if (par)
+		up_write(&EXT4_I(dir)->i_dir_sem);
 	ext4_fname_free_filename(&fname);
 	brelse(bh);
 	if (retval == 0)
@@ -3196,13 +3215,20 @@ int __ext4_unlink(handle_t *handle, struct inode *dir, const struct qstr *d_name
 	struct buffer_head *bh;
 	struct ext4_dir_entry_2 *de;
 	int skip_remove_dentry = 0;
+	bool par = IS_PAR_DIROPS(dir);
 
+	/* Keep @de valid until it is removed, see ext4_add_entry() */
+	if (par)
+		down_write(&EXT4_I(dir)->i_dir_sem);
 	bh = ext4_find_entry(dir, d_name, &de, NULL);
-	if (IS_ERR(bh))
-		return PTR_ERR(bh);
+	if (IS_ERR(bh)) {
+		retval = PTR_ERR(bh);
+		bh = NULL;
+		goto out;
+	}
 
 	if (!bh)
-		return -ENOENT;
+		goto out;
 
 	if (le32_to_cpu(de->inode) != inode->i_ino) {
 		/*
@@ -3242,6 +3268,8 @@ int __ext4_unlink(handle_t *handle, struct inode *dir, const struct qstr *d_name
 	retval = ext4_mark_inode_dirty(handle, inode);
 
 out:
+	if (par)
+		up_write(&EXT4_I(dir)->i_dir_sem);
 	brelse(bh);
 	return retval;
 }
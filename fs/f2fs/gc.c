@@ -37,7 +37,8 @@ static int gc_thread_func(void *data)
 
 	set_freezable();
 	do {
-		bool sync_mode;
+		bool sync_mode, boost;
+		unsigned int nr_rounds;
 
 		wait_event_interruptible_timeout(*wq,
 				kthread_should_stop() || freezing(current) ||
@@ -84,7 +85,9 @@ static int gc_thread_func(void *data)
 		 * invalidated soon after by user update or deletion.
 		 * So, I'd like to wait some time to collect dirty segments.
 		 */
-		if (sbi->gc_mode == GC_URGENT_HIGH) {
+		boost = need_to_boost_gc(sbi, gc_th);
+
+		if (sbi->gc_mode == GC_URGENT_HIGH || boost) {
 			wait_ms = gc_th->urgent_sleep_time;
 			down_write(&sbi->gc_lock);
 			goto do_gc;
@@ -111,9 +114,24 @@ static int gc_thread_func(void *data)
 
 		sync_mode = F2FS_OPTION(sbi).bggc_mode == BGGC_MODE_SYNC;
 
-		/* if return value is not zero, no victim was selected */
-		if (f2fs_gc(sbi, sync_mode, true, false, NULL_SEGNO))
-			wait_ms = gc_th->no_gc_sleep_time;
+		/*
+		 * When boosted, clean one section per f2fs_gc() call and retake
+		 * gc_lock in between, so that foreground f2fs_balance_fs() is
+		 * not shut out for the whole round.
+		 */
+		nr_rounds = boost ? gc_th->boost_sections : 1;
+		while (1) {
+			/* if return value is not zero, no victim was selected */
+			if (f2fs_gc(sbi, sync_mode, true, false, NULL_SEGNO)) {
+				wait_ms = gc_th->no_gc_sleep_time;
+				break;
+			}
+			if (--nr_rounds == 0 || kthread_should_stop() ||
+					!need_to_boost_gc(sbi, gc_th))
+				break;
+			cond_resched();
+			down_write(&sbi->gc_lock);
+		}
 
 		trace_f2fs_background_gc(sbi->sb, wait_ms,
 				prefree_segments(sbi), free_segments(sbi));
@@ -144,6 +162,10 @@ int f2fs_start_gc_thread(struct f2fs_sb_info *sbi)
 	gc_th->max_sleep_time = DEF_GC_THREAD_MAX_SLEEP_TIME;
 	gc_th->no_gc_sleep_time = DEF_GC_THREAD_NOGC_SLEEP_TIME;
 
+	gc_th->boost_sections = f2fs_sb_has_blkzoned(sbi) ?
+				DEF_GC_THREAD_BOOST_SECTIONS : 1;
+	gc_th->boost_free_percent = DEF_GC_THREAD_BOOST_FREE_PERCENT;
+
 	gc_th->gc_wake= 0;
 
 	sbi->gc_thread = gc_th;
@@ -15,6 +15,10 @@
 #define DEF_GC_THREAD_MAX_SLEEP_TIME	60000
 #define DEF_GC_THREAD_NOGC_SLEEP_TIME	300000	/* wait 5 min */
 
+/* clean several sections per round once free sections run low on zoned devices */
+#define DEF_GC_THREAD_BOOST_SECTIONS	8	/* sections per boosted round */
+#define DEF_GC_THREAD_BOOST_FREE_PERCENT	10	/* boost below 10% free sections */
+
 /* choose candidates from sections which has age of more than 7 days */
 #define DEF_GC_THREAD_AGE_THRESHOLD		(60 * 60 * 24 * 7)
 #define DEF_GC_THREAD_CANDIDATE_RATIO		20	/* select 20% oldest sections as candidates */
@@ -40,6 +44,10 @@ struct f2fs_gc_kthread {
 	unsigned int max_sleep_time;
 	unsigned int no_gc_sleep_time;
 
+	/* for boosting background gc when free sections run low */
+	unsigned int boost_sections;
+	unsigned int boost_free_percent;
+
 	/* for changing gc mode */
 	unsigned int gc_wake;
 };
@@ -155,6 +163,22 @@ static inline void decrease_sleep_time(struct f2fs_gc_kthread *gc_th,
 		*wait -= min_time;
 }
 
+/*
+ * Background GC is boosted when free sections drop below boost_free_percent
+ * of the main area: it then runs without waiting for the IO subsystem to
+ * become idle and cleans up to boost_sections sections per round, so that
+ * sustained writes on a large zoned device don't outrun cleaning and end
+ * up stalled in foreground GC.
+ */
+static inline bool need_to_boost_gc(struct f2fs_sb_info *sbi,
+					struct f2fs_gc_kthread *gc_th)
+{
+	if (gc_th->boost_sections <= 1)
+		return false;
+	return (unsigned long long)free_sections(sbi) * 100 <
+		(unsigned long long)MAIN_SECS(sbi) * gc_th->boost_free_percent;
+}
+
 static inline bool has_enough_invalid_blocks(struct f2fs_sb_info *sbi)
 {
 	block_t invalid_user_blocks = sbi->user_block_count -
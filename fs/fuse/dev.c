@@ -21,6 +21,8 @@
 #include <linux/swap.h>
 #include <linux/splice.h>
 #include <linux/sched.h>
+#include <linux/sched/task.h>
+#include <linux/io_uring.h>
 
 MODULE_ALIAS_MISCDEV(FUSE_MINOR);
 MODULE_ALIAS("devname:fuse");
@@ -204,15 +206,39 @@ static unsigned int fuse_req_hash(u64 unique)
 	return hash_long(unique & ~FUSE_INT_REQ_BIT, FUSE_PQ_HASH_BITS);
 }
 
+/* An io_uring command parked on fiq->uring_ents */
+struct fuse_uring_ent {
+	struct list_head list;
+	struct io_uring_cmd *cmd;
+	struct fuse_dev *fud;
+	struct task_struct *task;
+	struct mm_struct *mm;
+	void __user *buf;
+	size_t buf_len;
+};
+
+static void fuse_uring_task_cb(struct io_uring_cmd *cmd);
+
 /**
- * A new request is available, wake fiq->waitq
+ * A new request is available, wake fiq->waitq and one parked io_uring
+ * command
  */
 static void fuse_dev_wake_and_unlock(struct fuse_iqueue *fiq)
 __releases(fiq->lock)
 {
+	struct fuse_uring_ent *ent;
+
+	ent = list_first_entry_or_null(&fiq->uring_ents,
+				       struct fuse_uring_ent, list);
+	if (ent)
+		list_del_init(&ent->list);
 	wake_up(&fiq->waitq);
 	kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
 	spin_unlock(&fiq->lock);
+
+	/* Copy the request out from the server's context */
+	if (ent)
+		io_uring_cmd_complete_in_task(ent->cmd, fuse_uring_task_cb);
 }
 
 const struct fuse_iqueue_ops fuse_dev_fiq_ops = {
@@ -785,7 +811,8 @@ static int fuse_check_page(struct page *page)
 	       1 << PG_active |
 	       1 << PG_workingset |
 	       1 << PG_reclaim |
-	       1 << PG_waiters))) {
+	       1 << PG_waiters |
+	       LRU_GEN_MASK))) {
 		dump_page(page, "fuse: trying to steal weird page");
 		return 1;
 	}
@@ -1200,7 +1227,7 @@ __releases(fiq->lock)
  * fuse_request_end().  Otherwise add it to the processing list, and set
  * the 'sent' flag.
  */
-static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
+static ssize_t fuse_dev_do_read(struct fuse_dev *fud, bool nonblock,
 				struct fuse_copy_state *cs, size_t nbytes)
 {
 	ssize_t err;
@@ -1237,7 +1264,7 @@ static ssize_t fuse_dev_do_read(struct fuse_dev *fud, struct file *file,
 			break;
 		spin_unlock(&fiq->lock);
 
-		if (file->f_flags & O_NONBLOCK)
+		if (nonblock)
 			return -EAGAIN;
 		err = wait_event_interruptible_exclusive(fiq->waitq,
 				!fiq->connected || request_pending(fiq));
@@ -1363,7 +1390,8 @@ static ssize_t fuse_dev_read(struct kiocb *iocb, struct iov_iter *to)
 
 	fuse_copy_init(&cs, 1, to);
 
-	return fuse_dev_do_read(fud, file, &cs, iov_iter_count(to));
+	return fuse_dev_do_read(fud, file->f_flags & O_NONBLOCK, &cs,
+				iov_iter_count(to));
 }
 
 static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
@@ -1387,7 +1415,7 @@ static ssize_t fuse_dev_splice_read(struct file *in, loff_t *ppos,
 	fuse_copy_init(&cs, 1, NULL);
 	cs.pipebufs = bufs;
 	cs.pipe = pipe;
-	ret = fuse_dev_do_read(fud, in, &cs, len);
+	ret = fuse_dev_do_read(fud, in->f_flags & O_NONBLOCK, &cs, len);
 	if (ret < 0)
 		goto out;
 
@@ -2103,6 +2131,205 @@ static void end_polls(struct fuse_conn *fc)
 	}
 }
 
+/*
+ * io_uring transport
+ *
+ * Instead of read() and write() on the device, the server may issue
+ * IORING_OP_URING_CMD commands.  FUSE_URING_REQ_FETCH parks a buffer until
+ * a request is available and completes with the request copied into it,
+ * exactly as read() would have returned it.  FUSE_URING_REQ_COMMIT_AND_FETCH
+ * first consumes the reply found in the same buffer, as write() would, and
+ * then waits for the next request.  A server thread keeping a batch of
+ * these commands in flight answers and fetches any number of requests per
+ * io_uring_enter() instead of two syscalls per request.
+ */
+#define FUSE_URING_MONITOR_PERIOD	(HZ / 2)
+
+struct fuse_uring_cmd_pdu {
+	struct fuse_uring_ent *ent;
+};
+
+static inline struct fuse_uring_cmd_pdu *fuse_uring_cmd_pdu(
+		struct io_uring_cmd *cmd)
+{
+	return (struct fuse_uring_cmd_pdu *)&cmd->pdu;
+}
+
+static void fuse_uring_done(struct fuse_uring_ent *ent, ssize_t ret)
+{
+	struct io_uring_cmd *cmd = ent->cmd;
+
+	put_task_struct(ent->task);
+	kfree(ent);
+	io_uring_cmd_done(cmd, ret, 0);
+}
+
+static ssize_t fuse_uring_read(struct fuse_uring_ent *ent)
+{
+	struct fuse_copy_state cs;
+	struct iov_iter iter;
+	struct iovec iov;
+	int err;
+
+	err = import_single_range(READ, ent->buf, ent->buf_len, &iov, &iter);
+	if (err)
+		return err;
+
+	fuse_copy_init(&cs, 1, &iter);
+
+	return fuse_dev_do_read(ent->fud, true, &cs, iov_iter_count(&iter));
+}
+
+static ssize_t fuse_uring_commit(struct fuse_uring_ent *ent)
+{
+	struct fuse_out_header __user *oh = ent->buf;
+	struct fuse_copy_state cs;
+	struct iov_iter iter;
+	struct iovec iov;
+	u32 len;
+	int err;
+
+	if (get_user(len, &oh->len))
+		return -EFAULT;
+	if (len > ent->buf_len)
+		return -EINVAL;
+
+	err = import_single_range(WRITE, ent->buf, len, &iov, &iter);
+	if (err)
+		return err;
+
+	fuse_copy_init(&cs, 0, &iter);
+
+	return fuse_dev_do_write(ent->fud, &cs, len);
+}
+
+/*
+ * Hand the next request to @ent, or park it on fiq->uring_ents until
+ * fuse_dev_wake_and_unlock() finds it.  Must run in the server's context,
+ * the request is copied straight to its buffer.
+ */
+static void fuse_uring_fetch(struct fuse_uring_ent *ent)
+{
+	struct fuse_iqueue *fiq = &ent->fud->fc->iq;
+	ssize_t ret;
+
+	for (;;) {
+		ret = fuse_uring_read(ent);
+		if (ret != -EAGAIN)
+			break;
+
+		spin_lock(&fiq->lock);
+		if (fiq->connected && !request_pending(fiq)) {
+			list_add_tail(&ent->list, &fiq->uring_ents);
+			spin_unlock(&fiq->lock);
+			schedule_delayed_work(&fiq->uring_monitor,
+					      FUSE_URING_MONITOR_PERIOD);
+			return;
+		}
+		spin_unlock(&fiq->lock);
+	}
+
+	fuse_uring_done(ent, ret);
+}
+
+static void fuse_uring_task_cb(struct io_uring_cmd *cmd)
+{
+	struct fuse_uring_ent *ent = fuse_uring_cmd_pdu(cmd)->ent;
+
+	/*
+	 * The task work may run on the exit path, or fall back to an io-wq
+	 * thread, neither of which can reach the server's buffer.
+	 */
+	if ((current->flags & PF_EXITING) || current->mm != ent->mm) {
+		fuse_uring_done(ent, -ECONNABORTED);
+		return;
+	}
+
+	fuse_uring_fetch(ent);
+}
+
+static void fuse_uring_end_list(struct list_head *head, ssize_t ret)
+{
+	struct fuse_uring_ent *ent, *next;
+
+	list_for_each_entry_safe(ent, next, head, list) {
+		list_del_init(&ent->list);
+		fuse_uring_done(ent, ret);
+	}
+}
+
+/*
+ * A parked command keeps the io_uring, and with it the device file, busy.
+ * If the server dies without aborting the connection, its exit would wait
+ * forever for those commands, so complete them once the task is exiting.
+ */
+void fuse_uring_monitor_work(struct work_struct *work)
+{
+	struct fuse_iqueue *fiq = container_of(work, struct fuse_iqueue,
+					       uring_monitor.work);
+	struct fuse_uring_ent *ent, *next;
+	LIST_HEAD(dead);
+	bool rearm;
+
+	spin_lock(&fiq->lock);
+	list_for_each_entry_safe(ent, next, &fiq->uring_ents, list) {
+		if (ent->task->flags & PF_EXITING)
+			list_move_tail(&ent->list, &dead);
+	}
+	rearm = !list_empty(&fiq->uring_ents);
+	spin_unlock(&fiq->lock);
+
+	fuse_uring_end_list(&dead, -ECONNABORTED);
+
+	if (rearm)
+		schedule_delayed_work(&fiq->uring_monitor,
+				      FUSE_URING_MONITOR_PERIOD);
+}
+
+static int fuse_dev_uring_cmd(struct io_uring_cmd *cmd,
+			      unsigned int issue_flags)
+{
+	const struct fuse_uring_cmd_req *req = cmd->cmd;
+	struct fuse_dev *fud = fuse_get_dev(cmd->file);
+	struct fuse_uring_ent *ent;
+	ssize_t ret;
+
+	if (!fud)
+		return -EPERM;
+
+	if (cmd->cmd_op != FUSE_URING_REQ_FETCH &&
+	    cmd->cmd_op != FUSE_URING_REQ_COMMIT_AND_FETCH)
+		return -EOPNOTSUPP;
+
+	if (req->flags)
+		return -EINVAL;
+
+	ent = kmalloc(sizeof(*ent), GFP_KERNEL);
+	if (!ent)
+		return -ENOMEM;
+
+	INIT_LIST_HEAD(&ent->list);
+	ent->cmd = cmd;
+	ent->fud = fud;
+	ent->task = get_task_struct(current);
+	ent->mm = current->mm;
+	ent->buf = u64_to_user_ptr(req->buf);
+	ent->buf_len = req->buf_len;
+	fuse_uring_cmd_pdu(cmd)->ent = ent;
+
+	if (cmd->cmd_op == FUSE_URING_REQ_COMMIT_AND_FETCH) {
+		ret = fuse_uring_commit(ent);
+		if (ret < 0) {
+			put_task_struct(ent->task);
+			kfree(ent);
+			return ret;
+		}
+	}
+
+	fuse_uring_fetch(ent);
+	return -EIOCBQUEUED;
+}
+
 /*
  * Abort all requests.
  *
@@ -2130,6 +2357,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		struct fuse_dev *fud;
 		struct fuse_req *req, *next;
 		LIST_HEAD(to_end);
+		LIST_HEAD(uring_ents);
 		unsigned int i;
 
 		/* Background queuing checks fc->connected under bg_lock */
@@ -2172,6 +2400,7 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		list_splice_tail_init(&fiq->pending, &to_end);
 		while (forget_pending(fiq))
 			kfree(fuse_dequeue_forget(fiq, 1, NULL));
+		list_splice_init(&fiq->uring_ents, &uring_ents);
 		wake_up_all(&fiq->waitq);
 		spin_unlock(&fiq->lock);
 		kill_fasync(&fiq->fasync, SIGIO, POLL_IN);
@@ -2180,6 +2409,8 @@ void fuse_abort_conn(struct fuse_conn *fc)
 		spin_unlock(&fc->lock);
 
 		end_requests(&to_end);
+		fuse_uring_end_list(&uring_ents,
+				    fc->aborted ? -ECONNABORTED : -ENODEV);
 	} else {
 		spin_unlock(&fc->lock);
 	}
@@ -2282,6 +2513,16 @@ static long fuse_dev_ioctl(struct file *file, unsigned int cmd,
 				fput(old);
 			}
 		}
+	} else if (cmd == FUSE_DEV_IOC_PASSTHROUGH_OPEN) {
+		struct fuse_passthrough_out pto;
+		struct fuse_dev *fud = fuse_get_dev(file);
+
+		err = -EFAULT;
+		if (!copy_from_user(&pto, (void __user *) arg, sizeof(pto))) {
+			err = -EINVAL;
+			if (fud && !pto.flags)
+				err = fuse_passthrough_open(fud->fc, pto.fd);
+		}
 	}
 	return err;
 }
@@ -2299,6 +2540,7 @@ const struct file_operations fuse_dev_operations = {
 	.fasync		= fuse_dev_fasync,
 	.unlocked_ioctl = fuse_dev_ioctl,
 	.compat_ioctl   = compat_ptr_ioctl,
+	.uring_cmd	= fuse_dev_uring_cmd,
 };
 EXPORT_SYMBOL_GPL(fuse_dev_operations);
 
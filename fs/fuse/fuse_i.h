@@ -27,6 +27,7 @@
 #include <linux/poll.h>
 #include <linux/workqueue.h>
 #include <linux/kref.h>
+#include <linux/idr.h>
 #include <linux/xattr.h>
 #include <linux/pid_namespace.h>
 #include <linux/refcount.h>
@@ -180,6 +181,12 @@ struct fuse_conn;
 struct fuse_mount;
 struct fuse_release_args;
 
+/** Backing file of a passthrough open */
+struct fuse_passthrough {
+	struct file *filp;
+	struct cred *cred;
+};
+
 /** FUSE specific file data */
 struct fuse_file {
 	/** Fuse connection for this file */
@@ -231,6 +238,9 @@ struct fuse_file {
 	/** Wait queue head for poll */
 	wait_queue_head_t poll_wait;
 
+	/** Backing file for passthrough I/O, if any */
+	struct fuse_passthrough passthrough;
+
 	/** Has flock been performed on this file? */
 	bool flock:1;
 };
@@ -449,6 +459,12 @@ struct fuse_iqueue {
 	/** O_ASYNC requests */
 	struct fasync_struct *fasync;
 
+	/** io_uring commands waiting for a request */
+	struct list_head uring_ents;
+
+	/** Completes parked io_uring commands of exited servers */
+	struct delayed_work uring_monitor;
+
 	/** Device-specific callbacks */
 	const struct fuse_iqueue_ops *ops;
 
@@ -747,6 +763,9 @@ struct fuse_conn {
 	/* Auto-mount submounts announced by the server */
 	unsigned int auto_submounts:1;
 
+	/** Passthrough mode for read/write/mmap is enabled */
+	unsigned int passthrough:1;
+
 	/** The number of requests waiting for completion */
 	atomic_t num_waiting;
 
@@ -790,6 +809,12 @@ struct fuse_conn {
 
 	/** List of filesystems using this connection */
 	struct list_head mounts;
+
+	/** Protects passthrough_req */
+	spinlock_t passthrough_req_lock;
+
+	/** Backing files registered but not yet claimed by an open */
+	struct idr passthrough_req;
 };
 
 /*
@@ -1210,6 +1235,11 @@ int fuse_readdir(struct file *file, struct dir_context *ctx);
  */
 unsigned int fuse_len_args(unsigned int numargs, struct fuse_arg *args);
 
+/**
+ * Fail io_uring commands parked by servers that have exited
+ */
+void fuse_uring_monitor_work(struct work_struct *work);
+
 /**
  * Get the next unique ID for a request
  */
@@ -1232,4 +1262,14 @@ void fuse_dax_inode_cleanup(struct inode *inode);
 bool fuse_dax_check_alignment(struct fuse_conn *fc, unsigned int map_alignment);
 void fuse_dax_cancel_work(struct fuse_conn *fc);
 
+/* passthrough.c */
+int fuse_passthrough_open(struct fuse_conn *fc, u32 fd);
+void fuse_passthrough_setup(struct fuse_conn *fc, struct fuse_file *ff,
+			    struct fuse_open_out *outarg);
+void fuse_passthrough_release(struct fuse_passthrough *passthrough);
+void fuse_passthrough_conn_free(struct fuse_conn *fc);
+ssize_t fuse_passthrough_read_iter(struct kiocb *iocb, struct iov_iter *to);
+ssize_t fuse_passthrough_write_iter(struct kiocb *iocb, struct iov_iter *from);
+int fuse_passthrough_mmap(struct file *file, struct vm_area_struct *vma);
+
 #endif /* _FS_FUSE_I_H */
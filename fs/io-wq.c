@@ -108,6 +108,9 @@ struct io_wqe {
 
 	struct io_wq *wq;
 	struct io_wq_work *hash_tail[IO_WQ_NR_HASH_BUCKETS];
+
+	/* workers of this node run here, node cpumask unless overridden */
+	cpumask_var_t cpu_mask;
 };
 
 /*
@@ -122,10 +125,14 @@ struct io_wq {
 
 	struct task_struct *manager;
 	struct user_struct *user;
+	/* RLIMIT_NPROC of the creator, checked when queueing unbound work */
+	unsigned long nproc;
 	refcount_t refs;
 	struct completion done;
 
 	struct hlist_node cpuhp_node;
+	/* serializes wqe->cpu_mask updates against its users */
+	struct mutex aff_lock;
 
 	refcount_t use_refs;
 };
@@ -701,7 +708,9 @@ static bool create_io_worker(struct io_wq *wq, struct io_wqe *wqe, int index)
 		kfree(worker);
 		return false;
 	}
-	kthread_bind_mask(worker->task, cpumask_of_node(wqe->node));
+	mutex_lock(&wq->aff_lock);
+	kthread_bind_mask(worker->task, wqe->cpu_mask);
+	mutex_unlock(&wq->aff_lock);
 
 	raw_spin_lock_irq(&wqe->lock);
 	hlist_nulls_add_head_rcu(&worker->nulls_node, &wqe->free_list);
@@ -852,7 +861,7 @@ static bool io_wq_can_queue(struct io_wqe *wqe, struct io_wqe_acct *acct,
 	if (free_worker)
 		return true;
 
-	if (atomic_read(&wqe->wq->user->processes) >= acct->max_workers &&
+	if (atomic_read(&wqe->wq->user->processes) >= wqe->wq->nproc &&
 	    !(capable(CAP_SYS_RESOURCE) || capable(CAP_SYS_ADMIN)))
 		return false;
 
@@ -1106,6 +1115,9 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 
 	/* caller must already hold a reference to this */
 	wq->user = data->user;
+	if (wq->user)
+		wq->nproc = task_rlimit(current, RLIMIT_NPROC);
+	mutex_init(&wq->aff_lock);
 
 	ret = -ENOMEM;
 	for_each_node(node) {
@@ -1118,13 +1130,13 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 		if (!wqe)
 			goto err;
 		wq->wqes[node] = wqe;
+		if (!alloc_cpumask_var(&wqe->cpu_mask, GFP_KERNEL))
+			goto err;
 		wqe->node = alloc_node;
+		cpumask_copy(wqe->cpu_mask, cpumask_of_node(node));
 		wqe->acct[IO_WQ_ACCT_BOUND].max_workers = bounded;
 		atomic_set(&wqe->acct[IO_WQ_ACCT_BOUND].nr_running, 0);
-		if (wq->user) {
-			wqe->acct[IO_WQ_ACCT_UNBOUND].max_workers =
-					task_rlimit(current, RLIMIT_NPROC);
-		}
+		wqe->acct[IO_WQ_ACCT_UNBOUND].max_workers = wq->nproc;
 		atomic_set(&wqe->acct[IO_WQ_ACCT_UNBOUND].nr_running, 0);
 		wqe->wq = wq;
 		raw_spin_lock_init(&wqe->lock);
@@ -1152,8 +1164,12 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 	complete(&wq->done);
 err:
 	cpuhp_state_remove_instance_nocalls(io_wq_online, &wq->cpuhp_node);
-	for_each_node(node)
+	for_each_node(node) {
+		if (!wq->wqes[node])
+			continue;
+		free_cpumask_var(wq->wqes[node]->cpu_mask);
 		kfree(wq->wqes[node]);
+	}
 err_wqes:
 	kfree(wq->wqes);
 err_wq:
@@ -1186,8 +1202,10 @@ static void __io_wq_destroy(struct io_wq *wq)
 
 	wait_for_completion(&wq->done);
 
-	for_each_node(node)
+	for_each_node(node) {
+		free_cpumask_var(wq->wqes[node]->cpu_mask);
 		kfree(wq->wqes[node]);
+	}
 	kfree(wq->wqes);
 	kfree(wq);
 }
@@ -1210,24 +1228,86 @@ static bool io_wq_worker_affinity(struct io_worker *worker, void *data)
 	struct rq *rq;
 
 	rq = task_rq_lock(task, &rf);
-	do_set_cpus_allowed(task, cpumask_of_node(worker->wqe->node));
+	do_set_cpus_allowed(task, worker->wqe->cpu_mask);
 	task->flags |= PF_NO_SETAFFINITY;
 	task_rq_unlock(rq, task, &rf);
 	return false;
 }
 
-static int io_wq_cpu_online(unsigned int cpu, struct hlist_node *node)
+static void __io_wq_update_affinity(struct io_wq *wq)
+	__must_hold(wq->aff_lock)
 {
-	struct io_wq *wq = hlist_entry_safe(node, struct io_wq, cpuhp_node);
 	int i;
 
 	rcu_read_lock();
 	for_each_node(i)
 		io_wq_for_each_worker(wq->wqes[i], io_wq_worker_affinity, NULL);
 	rcu_read_unlock();
+}
+
+static int io_wq_cpu_online(unsigned int cpu, struct hlist_node *node)
+{
+	struct io_wq *wq = hlist_entry_safe(node, struct io_wq, cpuhp_node);
+
+	mutex_lock(&wq->aff_lock);
+	__io_wq_update_affinity(wq);
+	mutex_unlock(&wq->aff_lock);
 	return 0;
 }
 
+/*
+ * Confine all workers of @wq to @mask, or go back to the per-node default
+ * if @mask is NULL. Applies to running workers as well as future ones.
+ */
+int io_wq_cpu_affinity(struct io_wq *wq, const struct cpumask *mask)
+{
+	int i;
+
+	if (mask && !cpumask_intersects(mask, cpu_online_mask))
+		return -EINVAL;
+
+	mutex_lock(&wq->aff_lock);
+	for_each_node(i) {
+		struct io_wqe *wqe = wq->wqes[i];
+
+		if (mask)
+			cpumask_copy(wqe->cpu_mask, mask);
+		else
+			cpumask_copy(wqe->cpu_mask, cpumask_of_node(i));
+	}
+	__io_wq_update_affinity(wq);
+	mutex_unlock(&wq->aff_lock);
+	return 0;
+}
+
+/*
+ * Set the per-node cap of bounded (index 0) and unbounded (index 1) workers,
+ * a zero entry leaves that cap alone. The previous caps are returned in
+ * @new_count. Workers above a lowered cap go away once they idle out.
+ */
+void io_wq_max_workers(struct io_wq *wq, unsigned int *new_count)
+{
+	unsigned int prev[2] = { 0, 0 };
+	int i, node;
+
+	for_each_node(node) {
+		struct io_wqe *wqe = wq->wqes[node];
+
+		raw_spin_lock_irq(&wqe->lock);
+		for (i = 0; i < ARRAY_SIZE(prev); i++) {
+			struct io_wqe_acct *acct = &wqe->acct[i];
+
+			prev[i] = max(prev[i], acct->max_workers);
+			if (new_count[i])
+				acct->max_workers = new_count[i];
+		}
+		raw_spin_unlock_irq(&wqe->lock);
+	}
+
+	for (i = 0; i < ARRAY_SIZE(prev); i++)
+		new_count[i] = prev[i];
+}
+
 static __init int io_wq_init(void)
 {
 	int ret;
@@ -121,6 +121,9 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data);
 bool io_wq_get(struct io_wq *wq, struct io_wq_data *data);
 void io_wq_destroy(struct io_wq *wq);
 
+int io_wq_cpu_affinity(struct io_wq *wq, const struct cpumask *mask);
+void io_wq_max_workers(struct io_wq *wq, unsigned int *new_count);
+
 void io_wq_enqueue(struct io_wq *wq, struct io_wq_work *work);
 void io_wq_hash_work(struct io_wq_work *work, void *val);
 
@@ -71,6 +71,7 @@
 #include <linux/sizes.h>
 #include <linux/hugetlb.h>
 #include <linux/highmem.h>
+#include <linux/vmalloc.h>
 #include <linux/namei.h>
 #include <linux/fsnotify.h>
 #include <linux/fadvise.h>
@@ -226,6 +227,20 @@ struct io_buffer {
 	__u16 bid;
 };
 
+/*
+ * A buffer group backed by a ring that the application maps and refills
+ * itself, see IORING_REGISTER_PBUF_RING. The kernel owns ->head, the
+ * application owns the tail stored in the shared ring.
+ */
+struct io_buffer_list {
+	struct io_uring_buf_ring	*buf_ring;
+	struct page			**buf_pages;
+	int				nr_pages;
+	__u16				bgid;
+	__u16				head;
+	__u16				mask;
+};
+
 struct io_restriction {
 	DECLARE_BITMAP(register_op, IORING_REGISTER_LAST);
 	DECLARE_BITMAP(sqe_op, IORING_OP_LAST);
@@ -247,6 +262,24 @@ struct io_sq_data {
 	struct wait_queue_head	wait;
 };
 
+/*
+ * Per-opcode latency histograms, see IORING_REGISTER_LAT_STATS. Bucket 0
+ * counts latencies below 1024ns, bucket n those in [2^(n+9), 2^(n+10)) ns,
+ * and the last bucket everything above.
+ */
+#define IO_LAT_BUCKETS		24
+
+enum {
+	IO_LAT_QUEUE,		/* submission to the issue that completed it */
+	IO_LAT_EXEC,		/* that issue to posting the CQE */
+	IO_LAT_TOTAL,		/* submission to posting the CQE */
+	IO_LAT_NR,
+};
+
+struct io_lat_hist {
+	u64			buckets[IO_LAT_NR][IO_LAT_BUCKETS];
+};
+
 struct io_ring_ctx {
 	struct {
 		struct percpu_ref	refs;
@@ -300,6 +333,9 @@ struct io_ring_ctx {
 	 */
 	struct task_struct	*sqo_task;
 
+	/* IORING_SETUP_SINGLE_ISSUER: the only task allowed to submit */
+	struct task_struct	*submitter_task;
+
 	/* Only used for accounting purposes */
 	struct mm_struct	*mm_account;
 
@@ -345,6 +381,7 @@ struct io_ring_ctx {
 #endif
 
 	struct xarray		io_buffers;
+	struct xarray		io_buf_rings;
 
 	struct xarray		personalities;
 	u32			pers_next;
@@ -364,6 +401,8 @@ struct io_ring_ctx {
 	struct {
 		struct mutex		uring_lock;
 		wait_queue_head_t	wait;
+		/* IORING_SETUP_DEFER_TASKRUN task_work, run by submitter_task */
+		struct llist_head	work_llist;
 	} ____cacheline_aligned_in_smp;
 
 	struct {
@@ -389,6 +428,9 @@ struct io_ring_ctx {
 
 	struct work_struct		exit_work;
 	struct io_restriction		restrictions;
+
+	/* IORING_REGISTER_LAT_STATS, indexed by opcode */
+	struct io_lat_hist __percpu	**lat_hist;
 };
 
 /*
@@ -475,7 +517,24 @@ struct io_sr_msg {
 	int				msg_flags;
 	int				bgid;
 	size_t				len;
-	struct io_buffer		*kbuf;
+	/* length asked for by a multishot recv, reset for every buffer */
+	size_t				mshot_len;
+	union {
+		struct io_buffer	*kbuf;
+		/* REQ_F_BUFFER_RING, buffer consumed from a buffer ring */
+		void __user		*ring_buf;
+		/* IORING_OP_SEND_ZC, posts the buffer release CQE */
+		struct io_kiocb		*notif;
+	};
+};
+
+/*
+ * Zero-copy send notification, a request of its own that is only ever
+ * completed once the network stack dropped the last reference to uarg.
+ */
+struct io_notif {
+	struct file			*file;
+	struct ubuf_info		uarg;
 };
 
 struct io_open {
@@ -543,10 +602,43 @@ struct io_statx {
 	struct statx __user		*buffer;
 };
 
+struct io_rename {
+	struct file			*file;
+	int				old_dfd;
+	int				new_dfd;
+	struct filename			*oldpath;
+	struct filename			*newpath;
+	int				flags;
+};
+
+struct io_unlink {
+	struct file			*file;
+	int				dfd;
+	int				flags;
+	struct filename			*filename;
+};
+
+struct io_mkdir {
+	struct file			*file;
+	int				dfd;
+	umode_t				mode;
+	struct filename			*filename;
+};
+
+struct io_getdents {
+	struct file			*file;
+	struct linux_dirent64 __user	*dirent;
+	unsigned int			count;
+	loff_t				pos;
+};
+
 struct io_completion {
 	struct file			*file;
 	struct list_head		list;
 	u32				cflags;
+	/* IORING_SETUP_CQE32 payload, valid with REQ_F_CQE32_INIT */
+	u64				extra1;
+	u64				extra2;
 };
 
 struct io_async_connect {
@@ -590,6 +682,10 @@ enum {
 	REQ_F_NO_FILE_TABLE_BIT,
 	REQ_F_WORK_INITIALIZED_BIT,
 	REQ_F_LTIMEOUT_ACTIVE_BIT,
+	REQ_F_BUFFER_RING_BIT,
+	REQ_F_APOLL_MULTISHOT_BIT,
+	REQ_F_CQE32_INIT_BIT,
+	REQ_F_LAT_STATS_BIT,
 
 	/* not a real bit, just to check we're not overflowing the space */
 	__REQ_F_LAST_BIT,
@@ -635,6 +731,14 @@ enum {
 	REQ_F_WORK_INITIALIZED	= BIT(REQ_F_WORK_INITIALIZED_BIT),
 	/* linked timeout is active, i.e. prepared by link's head */
 	REQ_F_LTIMEOUT_ACTIVE	= BIT(REQ_F_LTIMEOUT_ACTIVE_BIT),
+	/* selected buffer was consumed from a registered buffer ring */
+	REQ_F_BUFFER_RING	= BIT(REQ_F_BUFFER_RING_BIT),
+	/* stays armed through poll and posts a CQE per event */
+	REQ_F_APOLL_MULTISHOT	= BIT(REQ_F_APOLL_MULTISHOT_BIT),
+	/* compl.extra1/extra2 are set for a big CQE */
+	REQ_F_CQE32_INIT	= BIT(REQ_F_CQE32_INIT_BIT),
+	/* accounted in ctx->lat_hist, lat_submit/lat_issue are valid */
+	REQ_F_LAT_STATS		= BIT(REQ_F_LAT_STATS_BIT),
 };
 
 struct async_poll {
@@ -669,6 +773,12 @@ struct io_kiocb {
 		struct io_splice	splice;
 		struct io_provide_buf	pbuf;
 		struct io_statx		statx;
+		struct io_rename	rename;
+		struct io_unlink	unlink;
+		struct io_mkdir		mkdir;
+		struct io_getdents	getdents;
+		struct io_notif		notif;
+		struct io_uring_cmd	uring_cmd;
 		/* use only after cleaning per-op data, see io_clean_op() */
 		struct io_completion	compl;
 	};
@@ -687,6 +797,9 @@ struct io_kiocb {
 	refcount_t			refs;
 	struct task_struct		*task;
 	u64				user_data;
+	/* REQ_F_LAT_STATS timestamps, ktime_get_ns() */
+	u64				lat_submit;
+	u64				lat_issue;
 
 	struct list_head		link_list;
 
@@ -698,6 +811,7 @@ struct io_kiocb {
 
 	struct percpu_ref		*fixed_file_refs;
 	struct callback_head		task_work;
+	struct llist_node		work_node;
 	/* for polled requests, i.e. IORING_OP_POLL_ADD and async armed poll */
 	struct hlist_node		hash_node;
 	struct async_poll		*apoll;
@@ -741,6 +855,10 @@ struct io_submit_state {
 	unsigned int		ios_left;
 };
 
+/* command payload of the largest (IORING_SETUP_SQE128) SQE */
+#define IO_URING_CMD_PDU_MAX	\
+	(2 * sizeof(struct io_uring_sqe) - offsetof(struct io_uring_sqe, cmd))
+
 struct io_op_def {
 	/* needs req->file assigned */
 	unsigned		needs_file : 1;
@@ -937,6 +1055,34 @@ static const struct io_op_def io_op_defs[] = {
 		.hash_reg_file		= 1,
 		.unbound_nonreg_file	= 1,
 	},
+	[IORING_OP_SEND_ZC] = {
+		.needs_file		= 1,
+		.unbound_nonreg_file	= 1,
+		.pollout		= 1,
+		.work_flags		= IO_WQ_WORK_BLKCG,
+	},
+	[IORING_OP_URING_CMD] = {
+		.needs_file		= 1,
+		.needs_async_data	= 1,
+		.async_size		= IO_URING_CMD_PDU_MAX,
+		.work_flags		= IO_WQ_WORK_MM | IO_WQ_WORK_BLKCG,
+	},
+	[IORING_OP_RENAMEAT] = {
+		.work_flags		= IO_WQ_WORK_FILES | IO_WQ_WORK_FS |
+						IO_WQ_WORK_BLKCG,
+	},
+	[IORING_OP_UNLINKAT] = {
+		.work_flags		= IO_WQ_WORK_FILES | IO_WQ_WORK_FS |
+						IO_WQ_WORK_BLKCG,
+	},
+	[IORING_OP_MKDIRAT] = {
+		.work_flags		= IO_WQ_WORK_FILES | IO_WQ_WORK_FS |
+						IO_WQ_WORK_BLKCG,
+	},
+	[IORING_OP_GETDENTS] = {
+		.needs_file		= 1,
+		.work_flags		= IO_WQ_WORK_MM | IO_WQ_WORK_BLKCG,
+	},
 };
 
 enum io_mem_account {
@@ -1214,6 +1360,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	init_completion(&ctx->ref_comp);
 	init_completion(&ctx->sq_thread_comp);
 	xa_init_flags(&ctx->io_buffers, XA_FLAGS_ALLOC1);
+	xa_init(&ctx->io_buf_rings);
 	xa_init_flags(&ctx->personalities, XA_FLAGS_ALLOC1);
 	mutex_init(&ctx->uring_lock);
 	init_waitqueue_head(&ctx->wait);
@@ -1225,6 +1372,7 @@ static struct io_ring_ctx *io_ring_ctx_alloc(struct io_uring_params *p)
 	INIT_LIST_HEAD(&ctx->inflight_list);
 	INIT_DELAYED_WORK(&ctx->file_put_work, io_file_put_work);
 	init_llist_head(&ctx->file_put_llist);
+	init_llist_head(&ctx->work_llist);
 	return ctx;
 err:
 	if (ctx->fallback_req)
@@ -1609,7 +1757,25 @@ static struct io_uring_cqe *io_get_cqring(struct io_ring_ctx *ctx)
 		return NULL;
 
 	ctx->cached_cq_tail++;
-	return &rings->cqes[tail & ctx->cq_mask];
+	tail &= ctx->cq_mask;
+	if (ctx->flags & IORING_SETUP_CQE32)
+		tail <<= 1;
+	return &rings->cqes[tail];
+}
+
+static inline void io_fill_cqe_extra(struct io_kiocb *req,
+				     struct io_uring_cqe *cqe)
+{
+	u64 extra1 = 0, extra2 = 0;
+
+	if (!(req->ctx->flags & IORING_SETUP_CQE32))
+		return;
+	if (req->flags & REQ_F_CQE32_INIT) {
+		extra1 = req->compl.extra1;
+		extra2 = req->compl.extra2;
+	}
+	WRITE_ONCE(cqe->big_cqe[0], extra1);
+	WRITE_ONCE(cqe->big_cqe[1], extra2);
 }
 
 static inline bool io_should_trigger_evfd(struct io_ring_ctx *ctx)
@@ -1679,6 +1845,7 @@ static bool __io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force,
 			WRITE_ONCE(cqe->user_data, req->user_data);
 			WRITE_ONCE(cqe->res, req->result);
 			WRITE_ONCE(cqe->flags, req->compl.cflags);
+			io_fill_cqe_extra(req, cqe);
 		} else {
 			ctx->cached_cq_overflow++;
 			WRITE_ONCE(ctx->rings->cq_overflow,
@@ -1715,6 +1882,28 @@ static void io_cqring_overflow_flush(struct io_ring_ctx *ctx, bool force,
 	}
 }
 
+static inline unsigned int io_lat_bucket(u64 ns)
+{
+	return min_t(unsigned int, fls64(ns >> 10), IO_LAT_BUCKETS - 1);
+}
+
+static void io_account_latency(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_lat_hist __percpu *hist = ctx->lat_hist[req->opcode];
+	u64 now = ktime_get_ns();
+	u64 queue = req->lat_issue - req->lat_submit;
+	u64 exec = now - req->lat_issue;
+	u64 total = now - req->lat_submit;
+
+	this_cpu_inc(hist->buckets[IO_LAT_QUEUE][io_lat_bucket(queue)]);
+	this_cpu_inc(hist->buckets[IO_LAT_EXEC][io_lat_bucket(exec)]);
+	this_cpu_inc(hist->buckets[IO_LAT_TOTAL][io_lat_bucket(total)]);
+
+	trace_io_uring_req_latency(ctx, req->opcode, req->user_data, queue,
+				   exec, total);
+}
+
 static void __io_cqring_fill_event(struct io_kiocb *req, long res,
 				   unsigned int cflags)
 {
@@ -1722,6 +1911,8 @@ static void __io_cqring_fill_event(struct io_kiocb *req, long res,
 	struct io_uring_cqe *cqe;
 
 	trace_io_uring_complete(ctx, req->user_data, res);
+	if (req->flags & REQ_F_LAT_STATS)
+		io_account_latency(req);
 
 	/*
 	 * If we can't get a cq entry, userspace overflowed the
@@ -1733,6 +1924,7 @@ static void __io_cqring_fill_event(struct io_kiocb *req, long res,
 		WRITE_ONCE(cqe->user_data, req->user_data);
 		WRITE_ONCE(cqe->res, res);
 		WRITE_ONCE(cqe->flags, cflags);
+		io_fill_cqe_extra(req, cqe);
 	} else if (ctx->cq_overflow_flushed ||
 		   atomic_read(&req->task->io_uring->in_idle)) {
 		/*
@@ -1774,6 +1966,40 @@ static void io_cqring_add_event(struct io_kiocb *req, long res, long cflags)
 	io_cqring_ev_posted(ctx);
 }
 
+/*
+ * Post a CQE with IORING_CQE_F_MORE for a multishot request that stays armed.
+ * A request that is still alive can't be put on the overflow list, so this
+ * fails if the CQ ring is full (or already overflowed) and the caller then
+ * has to terminate the request with a normal completion.
+ */
+static bool io_cqring_post_more(struct io_kiocb *req, long res,
+				unsigned int cflags)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_uring_cqe *cqe = NULL;
+	unsigned long flags;
+
+	spin_lock_irqsave(&ctx->completion_lock, flags);
+	if (!test_bit(0, &ctx->cq_check_overflow))
+		cqe = io_get_cqring(ctx);
+	if (cqe) {
+		trace_io_uring_complete(ctx, req->user_data, res);
+		if (req->flags & REQ_F_LAT_STATS)
+			io_account_latency(req);
+		WRITE_ONCE(cqe->user_data, req->user_data);
+		WRITE_ONCE(cqe->res, res);
+		WRITE_ONCE(cqe->flags, cflags | IORING_CQE_F_MORE);
+		io_fill_cqe_extra(req, cqe);
+		io_commit_cqring(ctx);
+	}
+	spin_unlock_irqrestore(&ctx->completion_lock, flags);
+
+	if (!cqe)
+		return false;
+	io_cqring_ev_posted(ctx);
+	return true;
+}
+
 static void io_submit_flush_completions(struct io_comp_state *cs)
 {
 	struct io_ring_ctx *ctx = cs->ctx;
@@ -2029,7 +2255,7 @@ static struct io_kiocb *io_req_find_next(struct io_kiocb *req)
 	return __io_req_find_next(req);
 }
 
-static int io_req_task_work_add(struct io_kiocb *req, bool twa_signal_ok)
+static int __io_req_task_work_add(struct io_kiocb *req, bool twa_signal_ok)
 {
 	struct task_struct *tsk = req->task;
 	struct io_ring_ctx *ctx = req->ctx;
@@ -2056,6 +2282,77 @@ static int io_req_task_work_add(struct io_kiocb *req, bool twa_signal_ok)
 	return ret;
 }
 
+/*
+ * Ring is going away, hand any queued local work back to the task it belongs
+ * to, or to the io-wq manager if that task is exiting.
+ */
+static void io_move_task_work_from_local(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node;
+	struct io_kiocb *req, *tmp;
+
+	node = llist_reverse_order(llist_del_all(&ctx->work_llist));
+	llist_for_each_entry_safe(req, tmp, node, work_node) {
+		if (unlikely(__io_req_task_work_add(req, true))) {
+			struct task_struct *tsk;
+
+			tsk = io_wq_get_task(ctx->io_wq);
+			task_work_add(tsk, &req->task_work, TWA_NONE);
+			wake_up_process(tsk);
+		}
+	}
+}
+
+/*
+ * With IORING_SETUP_DEFER_TASKRUN, task_work is not added to the task but
+ * queued on the ring, and only run when the submitter waits for completions.
+ * This avoids interrupting the task with TWA_SIGNAL for every completion, and
+ * lets all pending completions be processed in one go.
+ */
+static int io_req_task_work_add(struct io_kiocb *req, bool twa_signal_ok)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+
+	if (!(ctx->flags & IORING_SETUP_DEFER_TASKRUN))
+		return __io_req_task_work_add(req, twa_signal_ok);
+
+	if (req->task->flags & PF_EXITING)
+		return -ESRCH;
+
+	/* first entry, the waiter needs to know there's work to do */
+	if (llist_add(&req->work_node, &ctx->work_llist))
+		wake_up(&ctx->wait);
+	/*
+	 * Pairs with io_move_task_work_from_local() after killing the ctx refs,
+	 * nobody may be left to run the list once the ring is going away.
+	 */
+	if (unlikely(percpu_ref_is_dying(&ctx->refs)))
+		io_move_task_work_from_local(ctx);
+	return 0;
+}
+
+static bool io_run_local_work(struct io_ring_ctx *ctx)
+{
+	struct llist_node *node;
+	struct io_kiocb *req, *tmp;
+
+	if (!(ctx->flags & IORING_SETUP_DEFER_TASKRUN) ||
+	    llist_empty(&ctx->work_llist))
+		return false;
+	if (WARN_ON_ONCE(ctx->submitter_task != current))
+		return false;
+
+	__set_current_state(TASK_RUNNING);
+	do {
+		/* run in the order the work was queued */
+		node = llist_reverse_order(llist_del_all(&ctx->work_llist));
+		llist_for_each_entry_safe(req, tmp, node, work_node)
+			req->task_work.func(&req->task_work);
+	} while (!llist_empty(&ctx->work_llist));
+
+	return true;
+}
+
 static void __io_req_task_cancel(struct io_kiocb *req, int error)
 {
 	struct io_ring_ctx *ctx = req->ctx;
@@ -2298,18 +2595,25 @@ static unsigned int io_put_kbuf(struct io_kiocb *req, struct io_buffer *kbuf)
 {
 	unsigned int cflags;
 
-	cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
+	/* ring buffers are consumed at selection, req->buf_index is the bid */
+	if (req->flags & REQ_F_BUFFER_RING) {
+		cflags = req->buf_index << IORING_CQE_BUFFER_SHIFT;
+		req->flags &= ~REQ_F_BUFFER_RING;
+	} else {
+		cflags = kbuf->bid << IORING_CQE_BUFFER_SHIFT;
+		kfree(kbuf);
+	}
 	cflags |= IORING_CQE_F_BUFFER;
 	req->flags &= ~REQ_F_BUFFER_SELECTED;
-	kfree(kbuf);
 	return cflags;
 }
 
 static inline unsigned int io_put_rw_kbuf(struct io_kiocb *req)
 {
-	struct io_buffer *kbuf;
+	struct io_buffer *kbuf = NULL;
 
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
+	if (!(req->flags & REQ_F_BUFFER_RING))
+		kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
 	return io_put_kbuf(req, kbuf);
 }
 
@@ -2550,10 +2854,11 @@ static void kiocb_end_write(struct io_kiocb *req)
 	file_end_write(req->file);
 }
 
-static void io_complete_rw_common(struct kiocb *kiocb, long res,
+static void io_complete_rw_common(struct kiocb *kiocb, long res, long res2,
 				  struct io_comp_state *cs)
 {
 	struct io_kiocb *req = container_of(kiocb, struct io_kiocb, rw.kiocb);
+	bool zone_append = kiocb->ki_flags & IOCB_ZONE_APPEND;
 	int cflags = 0;
 
 	if (kiocb->ki_flags & IOCB_WRITE)
@@ -2563,6 +2868,16 @@ static void io_complete_rw_common(struct kiocb *kiocb, long res,
 		req_set_fail_links(req);
 	if (req->flags & REQ_F_BUFFER_SELECTED)
 		cflags = io_put_rw_kbuf(req);
+	/*
+	 * A zone append reports where its data landed in big_cqe[0].  compl
+	 * overlays the kiocb, which must not be touched past this point.
+	 */
+	if (zone_append && res >= 0 &&
+	    (req->ctx->flags & IORING_SETUP_CQE32)) {
+		req->compl.extra1 = res2;
+		req->compl.extra2 = 0;
+		req->flags |= REQ_F_CQE32_INIT;
+	}
 	__io_req_complete(req, res, cflags, cs);
 }
 
@@ -2647,7 +2962,7 @@ static void __io_complete_rw(struct io_kiocb *req, long res, long res2,
 			     struct io_comp_state *cs)
 {
 	if (!io_rw_reissue(req, res))
-		io_complete_rw_common(&req->rw.kiocb, res, cs);
+		io_complete_rw_common(&req->rw.kiocb, res, res2, cs);
 }
 
 static void io_complete_rw(struct kiocb *kiocb, long res, long res2)
@@ -2837,7 +3152,7 @@ static int io_prep_rw(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		    !kiocb->ki_filp->f_op->iopoll)
 			return -EOPNOTSUPP;
 
-		kiocb->ki_flags |= IOCB_HIPRI;
+		kiocb->ki_flags |= IOCB_HIPRI | IOCB_ALLOC_CACHE;
 		kiocb->ki_complete = io_complete_rw_iopoll;
 		req->iopoll_completed = 0;
 	} else {
@@ -2895,21 +3210,19 @@ static void kiocb_done(struct kiocb *kiocb, ssize_t ret,
 		io_rw_done(kiocb, ret);
 }
 
-static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
-			       struct iov_iter *iter)
+static ssize_t __io_import_fixed(struct io_kiocb *req, int rw,
+				 struct iov_iter *iter, u64 buf_addr,
+				 size_t len)
 {
 	struct io_ring_ctx *ctx = req->ctx;
-	size_t len = req->rw.len;
 	struct io_mapped_ubuf *imu;
 	u16 index, buf_index = req->buf_index;
 	size_t offset;
-	u64 buf_addr;
 
 	if (unlikely(buf_index >= ctx->nr_user_bufs))
 		return -EFAULT;
 	index = array_index_nospec(buf_index, ctx->nr_user_bufs);
 	imu = &ctx->user_bufs[index];
-	buf_addr = req->rw.addr;
 
 	/* overflow */
 	if (buf_addr + len < buf_addr)
@@ -2963,6 +3276,12 @@ static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
 	return len;
 }
 
+static ssize_t io_import_fixed(struct io_kiocb *req, int rw,
+			       struct iov_iter *iter)
+{
+	return __io_import_fixed(req, rw, iter, req->rw.addr, req->rw.len);
+}
+
 static void io_ring_submit_unlock(struct io_ring_ctx *ctx, bool needs_lock)
 {
 	if (needs_lock)
@@ -2981,54 +3300,107 @@ static void io_ring_submit_lock(struct io_ring_ctx *ctx, bool needs_lock)
 		mutex_lock(&ctx->uring_lock);
 }
 
-static struct io_buffer *io_buffer_select(struct io_kiocb *req, size_t *len,
-					  int bgid, struct io_buffer *kbuf,
-					  bool needs_lock)
+/*
+ * Grab the next buffer the application has published in the ring. The entry
+ * is consumed right away: the request keeps a copy of the address and the
+ * buffer ID instead of a reference to ring memory, so there is nothing to
+ * allocate here and nothing to free at completion time.
+ */
+static void __user *io_ring_buffer_select(struct io_kiocb *req, size_t *len,
+					  struct io_buffer_list *bl)
+{
+	struct io_uring_buf_ring *br = bl->buf_ring;
+	struct io_uring_buf *buf;
+	__u16 head = bl->head;
+	__u32 buf_len;
+
+	/* pairs with the store_release of ->tail by the application */
+	if (unlikely(smp_load_acquire(&br->tail) == head))
+		return ERR_PTR(-ENOBUFS);
+
+	buf = &br->bufs[head & bl->mask];
+	buf_len = min_t(__u32, READ_ONCE(buf->len), MAX_RW_COUNT);
+	if (*len > buf_len)
+		*len = buf_len;
+	req->buf_index = READ_ONCE(buf->bid);
+	req->flags |= REQ_F_BUFFER_RING;
+	bl->head++;
+	return u64_to_user_ptr(READ_ONCE(buf->addr));
+}
+
+/*
+ * Returns the user address of a buffer from group @bgid. For a classic
+ * provided buffer group the io_buffer now owned by the request is returned
+ * through @kbuf, ring backed groups set REQ_F_BUFFER_RING instead.
+ */
+static void __user *io_buffer_select(struct io_kiocb *req, size_t *len,
+				     int bgid, struct io_buffer **kbuf,
+				     bool needs_lock)
 {
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer_list *bl;
 	struct io_buffer *head;
+	void __user *ret;
 
-	if (req->flags & REQ_F_BUFFER_SELECTED)
-		return kbuf;
+	io_ring_submit_lock(ctx, needs_lock);
 
-	io_ring_submit_lock(req->ctx, needs_lock);
+	lockdep_assert_held(&ctx->uring_lock);
 
-	lockdep_assert_held(&req->ctx->uring_lock);
+	bl = xa_load(&ctx->io_buf_rings, bgid);
+	if (bl) {
+		ret = io_ring_buffer_select(req, len, bl);
+		goto out;
+	}
 
-	head = xa_load(&req->ctx->io_buffers, bgid);
+	head = xa_load(&ctx->io_buffers, bgid);
 	if (head) {
+		struct io_buffer *buf;
+
 		if (!list_empty(&head->list)) {
-			kbuf = list_last_entry(&head->list, struct io_buffer,
+			buf = list_last_entry(&head->list, struct io_buffer,
 							list);
-			list_del(&kbuf->list);
+			list_del(&buf->list);
 		} else {
-			kbuf = head;
-			xa_erase(&req->ctx->io_buffers, bgid);
+			buf = head;
+			xa_erase(&ctx->io_buffers, bgid);
 		}
-		if (*len > kbuf->len)
-			*len = kbuf->len;
+		if (*len > buf->len)
+			*len = buf->len;
+		*kbuf = buf;
+		ret = u64_to_user_ptr(buf->addr);
 	} else {
-		kbuf = ERR_PTR(-ENOBUFS);
+		ret = ERR_PTR(-ENOBUFS);
 	}
+out:
+	io_ring_submit_unlock(ctx, needs_lock);
 
-	io_ring_submit_unlock(req->ctx, needs_lock);
-
-	return kbuf;
+	return ret;
 }
 
 static void __user *io_rw_buffer_select(struct io_kiocb *req, size_t *len,
 					bool needs_lock)
 {
 	struct io_buffer *kbuf;
-	u16 bgid;
-
-	kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
-	bgid = req->buf_index;
-	kbuf = io_buffer_select(req, len, bgid, kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
-	req->rw.addr = (u64) (unsigned long) kbuf;
+	void __user *buf;
+
+	if (req->flags & REQ_F_BUFFER_SELECTED) {
+		if (req->flags & REQ_F_BUFFER_RING)
+			return u64_to_user_ptr(req->rw.addr);
+		kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
+		return u64_to_user_ptr(kbuf->addr);
+	}
+
+	buf = io_buffer_select(req, len, req->buf_index, &kbuf, needs_lock);
+	if (IS_ERR(buf))
+		return buf;
+	if (req->flags & REQ_F_BUFFER_RING) {
+		req->rw.addr = (u64) (unsigned long) buf;
+		req->rw.len = *len;
+	} else {
+		req->rw.addr = (u64) (unsigned long) kbuf;
+	}
 	req->flags |= REQ_F_BUFFER_SELECTED;
-	return u64_to_user_ptr(kbuf->addr);
+	return buf;
 }
 
 #ifdef CONFIG_COMPAT
@@ -3085,6 +3457,11 @@ static ssize_t io_iov_buffer_select(struct io_kiocb *req, struct iovec *iov,
 	if (req->flags & REQ_F_BUFFER_SELECTED) {
 		struct io_buffer *kbuf;
 
+		if (req->flags & REQ_F_BUFFER_RING) {
+			iov[0].iov_base = u64_to_user_ptr(req->rw.addr);
+			iov[0].iov_len = req->rw.len;
+			return 0;
+		}
 		kbuf = (struct io_buffer *) (unsigned long) req->rw.addr;
 		iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
 		iov[0].iov_len = kbuf->len;
@@ -3566,9 +3943,14 @@ static int io_write(struct io_kiocb *req, bool force_nonblock,
 	if (force_nonblock && !io_file_supports_async(req->file, WRITE))
 		goto copy_iov;
 
-	/* file path doesn't support NOWAIT for non-direct_IO */
+	/*
+	 * File path doesn't support NOWAIT for non-direct_IO, unless the
+	 * filesystem opted in. A sync write has to go async regardless.
+	 */
 	if (force_nonblock && !(kiocb->ki_flags & IOCB_DIRECT) &&
-	    (req->flags & REQ_F_ISREG))
+	    (req->flags & REQ_F_ISREG) &&
+	    (!(req->file->f_mode & FMODE_BUF_WASYNC) ||
+	     (kiocb->ki_flags & IOCB_DSYNC)))
 		goto copy_iov;
 
 	ret = rw_verify_area(WRITE, req->file, io_kiocb_ppos(kiocb), io_size);
@@ -3609,6 +3991,26 @@ static int io_write(struct io_kiocb *req, bool force_nonblock,
 		/* IOPOLL retry should happen for io-wq threads */
 		if ((req->ctx->flags & IORING_SETUP_IOPOLL) && ret2 == -EAGAIN)
 			goto copy_iov;
+
+		/*
+		 * A non-blocking buffered write stops short rather than
+		 * blocking. The position has already been moved past what was
+		 * written, finish the rest from io-wq and account for what
+		 * we've done so far.
+		 */
+		if (force_nonblock && ret2 > 0 && ret2 < io_size &&
+		    !(kiocb->ki_flags & IOCB_DIRECT) &&
+		    (req->flags & REQ_F_ISREG)) {
+			if (!io_setup_async_rw(req, iovec, inline_vecs, iter,
+					       true)) {
+				rw = req->async_data;
+				rw->bytes_done += ret2;
+				kiocb_end_write(req);
+				kiocb->ki_flags &= ~IOCB_WRITE;
+				return -EAGAIN;
+			}
+			/* no memory to punt the rest, complete it short */
+		}
 done:
 		kiocb_done(kiocb, ret2, cs);
 	} else {
@@ -3616,8 +4018,14 @@ static int io_write(struct io_kiocb *req, bool force_nonblock,
 		/* some cases will consume bytes even on error returns */
 		iov_iter_revert(iter, io_size - iov_iter_count(iter));
 		ret = io_setup_async_rw(req, iovec, inline_vecs, iter, false);
-		if (!ret)
+		if (!ret) {
+			/* the retry takes its own freeze protection */
+			if (kiocb->ki_flags & IOCB_WRITE) {
+				kiocb_end_write(req);
+				kiocb->ki_flags &= ~IOCB_WRITE;
+			}
 			return -EAGAIN;
+		}
 	}
 out_free:
 	/* it's reportedly faster than delegating the null check to kfree() */
@@ -3726,6 +4134,118 @@ static int io_splice(struct io_kiocb *req, bool force_nonblock)
 	return 0;
 }
 
+static void io_uring_cmd_work(struct callback_head *cb)
+{
+	struct io_kiocb *req = container_of(cb, struct io_kiocb, task_work);
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+
+	ioucmd->task_work_cb(ioucmd);
+}
+
+void io_uring_cmd_complete_in_task(struct io_uring_cmd *ioucmd,
+			void (*task_work_cb)(struct io_uring_cmd *))
+{
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
+	int ret;
+
+	ioucmd->task_work_cb = task_work_cb;
+	init_task_work(&req->task_work, io_uring_cmd_work);
+	ret = io_req_task_work_add(req, true);
+	if (unlikely(ret)) {
+		struct task_struct *tsk;
+
+		tsk = io_wq_get_task(req->ctx->io_wq);
+		task_work_add(tsk, &req->task_work, TWA_NONE);
+		wake_up_process(tsk);
+	}
+}
+EXPORT_SYMBOL_GPL(io_uring_cmd_complete_in_task);
+
+/*
+ * Called by the driver once a queued command is done, from task context
+ * (see io_uring_cmd_complete_in_task()). res2 ends up in big_cqe[0] if the
+ * ring was set up with IORING_SETUP_CQE32.
+ */
+void io_uring_cmd_done(struct io_uring_cmd *ioucmd, ssize_t ret, ssize_t res2)
+{
+	struct io_kiocb *req = container_of(ioucmd, struct io_kiocb, uring_cmd);
+
+	if (ret < 0)
+		req_set_fail_links(req);
+	if (req->ctx->flags & IORING_SETUP_CQE32) {
+		/* the driver is done with ->pdu, which compl overlays */
+		req->compl.extra1 = res2;
+		req->compl.extra2 = 0;
+		req->flags |= REQ_F_CQE32_INIT;
+	}
+	io_req_complete(req, ret);
+}
+EXPORT_SYMBOL_GPL(io_uring_cmd_done);
+
+static size_t io_uring_cmd_pdu_size(struct io_ring_ctx *ctx)
+{
+	if (ctx->flags & IORING_SETUP_SQE128)
+		return IO_URING_CMD_PDU_MAX;
+	return sizeof(struct io_uring_sqe) - offsetof(struct io_uring_sqe, cmd);
+}
+
+static int io_uring_cmd_prep(struct io_kiocb *req,
+			     const struct io_uring_sqe *sqe)
+{
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->rw_flags || sqe->__pad1)
+		return -EINVAL;
+
+	ioucmd->cmd_op = READ_ONCE(sqe->cmd_op);
+	ioucmd->cmd = sqe->cmd;
+	/* deferred or linked, the SQE will be gone by the time we issue */
+	if (req->async_data) {
+		memcpy(req->async_data, sqe->cmd,
+		       io_uring_cmd_pdu_size(req->ctx));
+		ioucmd->cmd = req->async_data;
+	}
+	return 0;
+}
+
+static int io_uring_cmd(struct io_kiocb *req, bool force_nonblock)
+{
+	struct io_uring_cmd *ioucmd = &req->uring_cmd;
+	struct io_ring_ctx *ctx = req->ctx;
+	struct file *file = req->file;
+	unsigned int issue_flags = 0;
+	int ret;
+
+	if (!file->f_op->uring_cmd)
+		return -EOPNOTSUPP;
+
+	if (ctx->flags & IORING_SETUP_SQE128)
+		issue_flags |= IO_URING_F_SQE128;
+	if (ctx->flags & IORING_SETUP_CQE32)
+		issue_flags |= IO_URING_F_CQE32;
+	if (force_nonblock)
+		issue_flags |= IO_URING_F_NONBLOCK;
+
+	ret = file->f_op->uring_cmd(ioucmd, issue_flags);
+	if (ret == -EAGAIN && force_nonblock) {
+		/* punted to io-wq, keep a copy of the command */
+		if (!req->async_data) {
+			if (__io_alloc_async_data(req))
+				return -ENOMEM;
+			memcpy(req->async_data, ioucmd->cmd,
+			       io_uring_cmd_pdu_size(ctx));
+			ioucmd->cmd = req->async_data;
+		}
+		return -EAGAIN;
+	}
+
+	if (ret != -EIOCBQUEUED)
+		io_uring_cmd_done(ioucmd, ret, 0);
+	return 0;
+}
+
 /*
  * IORING_OP_NOP just posts a completion event, nothing else.
  */
@@ -4075,6 +4595,12 @@ static int io_provide_buffers(struct io_kiocb *req, bool force_nonblock,
 
 	lockdep_assert_held(&ctx->uring_lock);
 
+	/* ring backed groups are refilled through the ring itself */
+	if (unlikely(xa_load(&ctx->io_buf_rings, p->bgid))) {
+		ret = -EEXIST;
+		goto out;
+	}
+
 	list = head = xa_load(&ctx->io_buffers, p->bgid);
 
 	ret = io_add_buffers(p, &head);
@@ -4083,6 +4609,7 @@ static int io_provide_buffers(struct io_kiocb *req, bool force_nonblock,
 		if (ret < 0)
 			__io_remove_buffers(ctx, head, p->bgid, -1U);
 	}
+out:
 	if (ret < 0)
 		req_set_fail_links(req);
 
@@ -4255,10 +4782,204 @@ static int io_statx(struct io_kiocb *req, bool force_nonblock)
 	return 0;
 }
 
-static int io_close_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+static int io_renameat_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
 {
-	/*
-	 * If we queue this for async, it must not be cancellable. That would
+	struct io_rename *ren = &req->rename;
+	const char __user *oldf, *newf;
+
+	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL)))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->buf_index || sqe->splice_fd_in)
+		return -EINVAL;
+	if (unlikely(req->flags & REQ_F_FIXED_FILE))
+		return -EBADF;
+
+	ren->old_dfd = READ_ONCE(sqe->fd);
+	oldf = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	newf = u64_to_user_ptr(READ_ONCE(sqe->addr2));
+	ren->new_dfd = READ_ONCE(sqe->len);
+	ren->flags = READ_ONCE(sqe->rename_flags);
+
+	ren->oldpath = getname(oldf);
+	if (IS_ERR(ren->oldpath))
+		return PTR_ERR(ren->oldpath);
+
+	ren->newpath = getname(newf);
+	if (IS_ERR(ren->newpath)) {
+		putname(ren->oldpath);
+		return PTR_ERR(ren->newpath);
+	}
+
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+static int io_renameat(struct io_kiocb *req, bool force_nonblock)
+{
+	struct io_rename *ren = &req->rename;
+	int ret;
+
+	if (force_nonblock)
+		return -EAGAIN;
+
+	ret = do_renameat2(ren->old_dfd, ren->oldpath, ren->new_dfd,
+				ren->newpath, ren->flags);
+
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_unlinkat_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_unlink *un = &req->unlink;
+	const char __user *fname;
+
+	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL)))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->off || sqe->len || sqe->buf_index ||
+	    sqe->splice_fd_in)
+		return -EINVAL;
+	if (unlikely(req->flags & REQ_F_FIXED_FILE))
+		return -EBADF;
+
+	un->dfd = READ_ONCE(sqe->fd);
+
+	un->flags = READ_ONCE(sqe->unlink_flags);
+	if (un->flags & ~AT_REMOVEDIR)
+		return -EINVAL;
+
+	fname = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	un->filename = getname(fname);
+	if (IS_ERR(un->filename))
+		return PTR_ERR(un->filename);
+
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+static int io_unlinkat(struct io_kiocb *req, bool force_nonblock)
+{
+	struct io_unlink *un = &req->unlink;
+	int ret;
+
+	if (force_nonblock)
+		return -EAGAIN;
+
+	if (un->flags & AT_REMOVEDIR)
+		ret = do_rmdir(un->dfd, un->filename);
+	else
+		ret = do_unlinkat(un->dfd, un->filename);
+
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_mkdirat_prep(struct io_kiocb *req,
+			   const struct io_uring_sqe *sqe)
+{
+	struct io_mkdir *mkd = &req->mkdir;
+	const char __user *fname;
+
+	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL)))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->off || sqe->rw_flags || sqe->buf_index ||
+	    sqe->splice_fd_in)
+		return -EINVAL;
+	if (unlikely(req->flags & REQ_F_FIXED_FILE))
+		return -EBADF;
+
+	mkd->dfd = READ_ONCE(sqe->fd);
+	mkd->mode = READ_ONCE(sqe->len);
+
+	fname = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	mkd->filename = getname(fname);
+	if (IS_ERR(mkd->filename))
+		return PTR_ERR(mkd->filename);
+
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+static int io_mkdirat(struct io_kiocb *req, bool force_nonblock)
+{
+	struct io_mkdir *mkd = &req->mkdir;
+	int ret;
+
+	if (force_nonblock)
+		return -EAGAIN;
+
+	ret = do_mkdirat(mkd->dfd, mkd->filename, mkd->mode);
+
+	req->flags &= ~REQ_F_NEED_CLEANUP;
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_getdents_prep(struct io_kiocb *req,
+			    const struct io_uring_sqe *sqe)
+{
+	struct io_getdents *gd = &req->getdents;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (sqe->ioprio || sqe->rw_flags || sqe->buf_index ||
+	    sqe->splice_fd_in)
+		return -EINVAL;
+
+	gd->pos = READ_ONCE(sqe->off);
+	gd->dirent = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	gd->count = READ_ONCE(sqe->len);
+	return 0;
+}
+
+static int io_getdents(struct io_kiocb *req, bool force_nonblock)
+{
+	struct io_getdents *gd = &req->getdents;
+	struct file *file = req->file;
+	bool pos_lock;
+	int ret;
+
+	if (force_nonblock)
+		return -EAGAIN;
+
+	/* directory position is shared, serialize like fdget_pos() does */
+	pos_lock = file->f_mode & FMODE_ATOMIC_POS;
+	if (pos_lock)
+		mutex_lock(&file->f_pos_lock);
+
+	ret = 0;
+	if (file->f_pos != gd->pos) {
+		loff_t res = vfs_llseek(file, gd->pos, SEEK_SET);
+
+		if (res < 0)
+			ret = res;
+	}
+	if (!ret)
+		ret = vfs_getdents(file, gd->dirent, gd->count);
+
+	if (pos_lock)
+		mutex_unlock(&file->f_pos_lock);
+
+	if (ret < 0)
+		req_set_fail_links(req);
+	io_req_complete(req, ret);
+	return 0;
+}
+
+static int io_close_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	/*
+	 * If we queue this for async, it must not be cancellable. That would
 	 * leave the 'file' in an undeterminate state, and here need to modify
 	 * io_wq_work.flags, so initialize io_wq_work firstly.
 	 */
@@ -4477,6 +5198,7 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	msg.msg_control = NULL;
 	msg.msg_controllen = 0;
 	msg.msg_namelen = 0;
+	msg.msg_ubuf = NULL;
 
 	flags = req->sr_msg.msg_flags | MSG_NOSIGNAL;
 	if (flags & MSG_DONTWAIT)
@@ -4500,6 +5222,145 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	return 0;
 }
 
+static void io_notif_complete(struct callback_head *cb)
+{
+	struct io_kiocb *notif = container_of(cb, struct io_kiocb, task_work);
+
+	io_cqring_add_event(notif, 0, IORING_CQE_F_NOTIF);
+	io_put_req(notif);
+}
+
+/*
+ * Called once the last skb referencing the buffer is gone, which can happen
+ * from any context, so post the CQE from task context.
+ */
+static void io_notif_callback(struct ubuf_info *uarg, bool zerocopy_success)
+{
+	struct io_notif *n = container_of(uarg, struct io_notif, uarg);
+	struct io_kiocb *notif = container_of(n, struct io_kiocb, notif);
+	int ret;
+
+	init_task_work(&notif->task_work, io_notif_complete);
+	ret = io_req_task_work_add(notif, true);
+	if (unlikely(ret)) {
+		struct task_struct *tsk;
+
+		tsk = io_wq_get_task(notif->ctx->io_wq);
+		task_work_add(tsk, &notif->task_work, TWA_NONE);
+		wake_up_process(tsk);
+	}
+}
+
+static struct io_kiocb *io_alloc_notif(struct io_kiocb *req)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_kiocb *notif;
+	struct ubuf_info *uarg;
+
+	notif = kmem_cache_alloc(req_cachep, GFP_KERNEL);
+	if (unlikely(!notif))
+		return NULL;
+
+	notif->opcode = IORING_OP_NOP;
+	notif->user_data = req->user_data;
+	notif->async_data = NULL;
+	notif->file = NULL;
+	notif->ctx = ctx;
+	notif->flags = 0;
+	refcount_set(&notif->refs, 1);
+	notif->task = current;
+	notif->result = 0;
+
+	get_task_struct(current);
+	percpu_counter_inc(&current->io_uring->inflight);
+	percpu_ref_get(&ctx->refs);
+
+	uarg = &notif->notif.uarg;
+	uarg->callback = io_notif_callback;
+	uarg->zerocopy = 1;
+	uarg->flags = UARG_F_EXTERNAL;
+	uarg->mmp.user = NULL;
+	refcount_set(&uarg->refcnt, 1);
+	return notif;
+}
+
+static int io_send_zc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	struct io_sr_msg *sr = &req->sr_msg;
+
+	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
+		return -EINVAL;
+	if (unlikely(sqe->ioprio || sqe->off || sqe->addr2))
+		return -EINVAL;
+
+	sr->buf = u64_to_user_ptr(READ_ONCE(sqe->addr));
+	sr->len = READ_ONCE(sqe->len);
+	sr->msg_flags = READ_ONCE(sqe->msg_flags);
+	req->buf_index = READ_ONCE(sqe->buf_index);
+
+	sr->notif = io_alloc_notif(req);
+	if (unlikely(!sr->notif))
+		return -ENOMEM;
+	req->flags |= REQ_F_NEED_CLEANUP;
+	return 0;
+}
+
+/*
+ * Send straight out of a registered buffer. The buffer pages are attached to
+ * the skbs, so the request completes with IORING_CQE_F_MORE set and a second
+ * CQE flagged IORING_CQE_F_NOTIF follows once the buffer may be reused.
+ */
+static int io_send_zc(struct io_kiocb *req, bool force_nonblock,
+		      struct io_comp_state *cs)
+{
+	struct io_sr_msg *sr = &req->sr_msg;
+	struct msghdr msg;
+	struct socket *sock;
+	unsigned flags;
+	int min_ret = 0;
+	int ret;
+
+	sock = sock_from_file(req->file, &ret);
+	if (unlikely(!sock))
+		return ret;
+
+	ret = __io_import_fixed(req, WRITE, &msg.msg_iter,
+				(u64)(unsigned long)sr->buf, sr->len);
+	if (unlikely(ret < 0))
+		return ret;
+
+	msg.msg_name = NULL;
+	msg.msg_control = NULL;
+	msg.msg_controllen = 0;
+	msg.msg_namelen = 0;
+	msg.msg_ubuf = &sr->notif->notif.uarg;
+
+	flags = sr->msg_flags | MSG_NOSIGNAL | MSG_ZEROCOPY;
+	if (flags & MSG_DONTWAIT)
+		req->flags |= REQ_F_NOWAIT;
+	else if (force_nonblock)
+		flags |= MSG_DONTWAIT;
+
+	if (flags & MSG_WAITALL)
+		min_ret = iov_iter_count(&msg.msg_iter);
+
+	msg.msg_flags = flags;
+	ret = sock_sendmsg(sock, &msg);
+	if (force_nonblock && ret == -EAGAIN)
+		return -EAGAIN;
+	if (ret == -ERESTARTSYS)
+		ret = -EINTR;
+
+	/* drop the submission reference, skbs hold their own */
+	sock_zerocopy_put(msg.msg_ubuf);
+	sr->notif = NULL;
+
+	if (ret < min_ret)
+		req_set_fail_links(req);
+	__io_req_complete(req, ret, IORING_CQE_F_MORE, cs);
+	return 0;
+}
+
 static int __io_recvmsg_copy_hdr(struct io_kiocb *req,
 				 struct io_async_msghdr *iomsg)
 {
@@ -4591,24 +5452,38 @@ static int io_recvmsg_copy_hdr(struct io_kiocb *req,
 	return __io_recvmsg_copy_hdr(req, iomsg);
 }
 
-static struct io_buffer *io_recv_buffer_select(struct io_kiocb *req,
-					       bool needs_lock)
+static void __user *io_recv_buffer_select(struct io_kiocb *req,
+					  bool needs_lock)
 {
 	struct io_sr_msg *sr = &req->sr_msg;
-	struct io_buffer *kbuf;
+	struct io_buffer *kbuf = NULL;
+	void __user *buf;
+
+	if (req->flags & REQ_F_BUFFER_SELECTED) {
+		if (req->flags & REQ_F_BUFFER_RING)
+			return sr->ring_buf;
+		return u64_to_user_ptr(sr->kbuf->addr);
+	}
 
-	kbuf = io_buffer_select(req, &sr->len, sr->bgid, sr->kbuf, needs_lock);
-	if (IS_ERR(kbuf))
-		return kbuf;
+	buf = io_buffer_select(req, &sr->len, sr->bgid, &kbuf, needs_lock);
+	if (IS_ERR(buf))
+		return buf;
 
-	sr->kbuf = kbuf;
+	if (req->flags & REQ_F_BUFFER_RING)
+		sr->ring_buf = buf;
+	else
+		sr->kbuf = kbuf;
 	req->flags |= REQ_F_BUFFER_SELECTED;
-	return kbuf;
+	return buf;
 }
 
 static inline unsigned int io_put_recv_kbuf(struct io_kiocb *req)
 {
-	return io_put_kbuf(req, req->sr_msg.kbuf);
+	struct io_buffer *kbuf = NULL;
+
+	if (!(req->flags & REQ_F_BUFFER_RING))
+		kbuf = req->sr_msg.kbuf;
+	return io_put_kbuf(req, kbuf);
 }
 
 static int io_recvmsg_prep(struct io_kiocb *req,
@@ -4616,6 +5491,7 @@ static int io_recvmsg_prep(struct io_kiocb *req,
 {
 	struct io_async_msghdr *async_msg = req->async_data;
 	struct io_sr_msg *sr = &req->sr_msg;
+	unsigned int flags;
 	int ret;
 
 	if (unlikely(req->ctx->flags & IORING_SETUP_IOPOLL))
@@ -4626,6 +5502,22 @@ static int io_recvmsg_prep(struct io_kiocb *req,
 	sr->len = READ_ONCE(sqe->len);
 	sr->bgid = READ_ONCE(sqe->buf_group);
 
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_RECV_MULTISHOT)
+		return -EINVAL;
+	if (flags & IORING_RECV_MULTISHOT) {
+		if (req->opcode != IORING_OP_RECV)
+			return -EINVAL;
+		if (!(req->flags & REQ_F_BUFFER_SELECT))
+			return -EINVAL;
+		if (sr->msg_flags & MSG_WAITALL)
+			return -EINVAL;
+		if (req->flags & (REQ_F_LINK | REQ_F_HARDLINK))
+			return -EINVAL;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+		sr->mshot_len = sr->len;
+	}
+
 #ifdef CONFIG_COMPAT
 	if (req->ctx->compat)
 		sr->msg_flags |= MSG_CMSG_COMPAT;
@@ -4644,7 +5536,7 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 {
 	struct io_async_msghdr iomsg, *kmsg;
 	struct socket *sock;
-	struct io_buffer *kbuf;
+	void __user *buf;
 	unsigned flags;
 	int min_ret = 0;
 	int ret, cflags = 0;
@@ -4668,10 +5560,10 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 	}
 
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		kmsg->fast_iov[0].iov_base = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
+		kmsg->fast_iov[0].iov_base = buf;
 		iov_iter_init(&kmsg->msg.msg_iter, READ, kmsg->iov,
 				1, req->sr_msg.len);
 	}
@@ -4706,7 +5598,6 @@ static int io_recvmsg(struct io_kiocb *req, bool force_nonblock,
 static int io_recv(struct io_kiocb *req, bool force_nonblock,
 		   struct io_comp_state *cs)
 {
-	struct io_buffer *kbuf;
 	struct io_sr_msg *sr = &req->sr_msg;
 	struct msghdr msg;
 	void __user *buf = sr->buf;
@@ -4720,11 +5611,11 @@ static int io_recv(struct io_kiocb *req, bool force_nonblock,
 	if (unlikely(!sock))
 		return ret;
 
+retry_multishot:
 	if (req->flags & REQ_F_BUFFER_SELECT) {
-		kbuf = io_recv_buffer_select(req, !force_nonblock);
-		if (IS_ERR(kbuf))
-			return PTR_ERR(kbuf);
-		buf = u64_to_user_ptr(kbuf->addr);
+		buf = io_recv_buffer_select(req, !force_nonblock);
+		if (IS_ERR(buf))
+			return PTR_ERR(buf);
 	}
 
 	ret = import_single_range(READ, buf, sr->len, &iov, &msg.msg_iter);
@@ -4755,6 +5646,19 @@ static int io_recv(struct io_kiocb *req, bool force_nonblock,
 out_free:
 	if (req->flags & REQ_F_BUFFER_SELECTED)
 		cflags = io_put_recv_kbuf(req);
+	/*
+	 * Multishot only ever runs from the nonblocking (poll driven) path,
+	 * from io-wq it degrades to a single shot. Keep going until the socket
+	 * is drained, EOF or an error terminates it, or the CQ ring is full.
+	 */
+	if ((req->flags & REQ_F_APOLL_MULTISHOT) && force_nonblock && ret > 0 &&
+	    io_cqring_post_more(req, ret, cflags)) {
+		/* we made progress, allow the poll handler to be re-armed */
+		req->flags &= ~REQ_F_POLLED;
+		sr->len = sr->mshot_len;
+		cflags = 0;
+		goto retry_multishot;
+	}
 	if (ret < min_ret || ((flags & MSG_WAITALL) && (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC))))
 		req_set_fail_links(req);
 	__io_req_complete(req, ret, cflags, cs);
@@ -4765,15 +5669,26 @@ static int io_accept_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
 	struct io_accept *accept = &req->accept;
 
+	unsigned int flags;
+
 	if (unlikely(req->ctx->flags & (IORING_SETUP_IOPOLL|IORING_SETUP_SQPOLL)))
 		return -EINVAL;
-	if (sqe->ioprio || sqe->len || sqe->buf_index || sqe->splice_fd_in)
+	if (sqe->len || sqe->buf_index || sqe->splice_fd_in)
 		return -EINVAL;
 
 	accept->addr = u64_to_user_ptr(READ_ONCE(sqe->addr));
 	accept->addr_len = u64_to_user_ptr(READ_ONCE(sqe->addr2));
 	accept->flags = READ_ONCE(sqe->accept_flags);
 	accept->nofile = rlimit(RLIMIT_NOFILE);
+
+	flags = READ_ONCE(sqe->ioprio);
+	if (flags & ~IORING_ACCEPT_MULTISHOT)
+		return -EINVAL;
+	if (flags & IORING_ACCEPT_MULTISHOT) {
+		if (req->flags & (REQ_F_LINK | REQ_F_HARDLINK))
+			return -EINVAL;
+		req->flags |= REQ_F_APOLL_MULTISHOT;
+	}
 	return 0;
 }
 
@@ -4784,9 +5699,12 @@ static int io_accept(struct io_kiocb *req, bool force_nonblock,
 	unsigned int file_flags = force_nonblock ? O_NONBLOCK : 0;
 	int ret;
 
-	if (req->file->f_flags & O_NONBLOCK)
+	/* multishot always waits through poll, regardless of O_NONBLOCK */
+	if ((req->file->f_flags & O_NONBLOCK) &&
+	    !(req->flags & REQ_F_APOLL_MULTISHOT))
 		req->flags |= REQ_F_NOWAIT;
 
+retry:
 	ret = __sys_accept4_file(req->file, file_flags, accept->addr,
 					accept->addr_len, accept->flags,
 					accept->nofile);
@@ -4796,6 +5714,11 @@ static int io_accept(struct io_kiocb *req, bool force_nonblock,
 		if (ret == -ERESTARTSYS)
 			ret = -EINTR;
 		req_set_fail_links(req);
+	} else if ((req->flags & REQ_F_APOLL_MULTISHOT) && force_nonblock &&
+		   io_cqring_post_more(req, ret, 0)) {
+		/* we made progress, allow the poll handler to be re-armed */
+		req->flags &= ~REQ_F_POLLED;
+		goto retry;
 	}
 	__io_req_complete(req, ret, 0, cs);
 	return 0;
@@ -4881,6 +5804,17 @@ static int io_send(struct io_kiocb *req, bool force_nonblock,
 	return -EOPNOTSUPP;
 }
 
+static int io_send_zc_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
+{
+	return -EOPNOTSUPP;
+}
+
+static int io_send_zc(struct io_kiocb *req, bool force_nonblock,
+		      struct io_comp_state *cs)
+{
+	return -EOPNOTSUPP;
+}
+
 static int io_recvmsg_prep(struct io_kiocb *req,
 			   const struct io_uring_sqe *sqe)
 {
@@ -5850,6 +6784,14 @@ static int io_req_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return io_files_update_prep(req, sqe);
 	case IORING_OP_STATX:
 		return io_statx_prep(req, sqe);
+	case IORING_OP_RENAMEAT:
+		return io_renameat_prep(req, sqe);
+	case IORING_OP_UNLINKAT:
+		return io_unlinkat_prep(req, sqe);
+	case IORING_OP_MKDIRAT:
+		return io_mkdirat_prep(req, sqe);
+	case IORING_OP_GETDENTS:
+		return io_getdents_prep(req, sqe);
 	case IORING_OP_FADVISE:
 		return io_fadvise_prep(req, sqe);
 	case IORING_OP_MADVISE:
@@ -5866,6 +6808,10 @@ static int io_req_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 		return io_remove_buffers_prep(req, sqe);
 	case IORING_OP_TEE:
 		return io_tee_prep(req, sqe);
+	case IORING_OP_SEND_ZC:
+		return io_send_zc_prep(req, sqe);
+	case IORING_OP_URING_CMD:
+		return io_uring_cmd_prep(req, sqe);
 	}
 
 	printk_once(KERN_WARNING "io_uring: unhandled opcode %d\n",
@@ -5961,7 +6907,9 @@ static void io_req_drop_files(struct io_kiocb *req)
 
 static void __io_clean_op(struct io_kiocb *req)
 {
-	if (req->flags & REQ_F_BUFFER_SELECTED) {
+	/* nothing to free if the buffer came from a buffer ring */
+	if ((req->flags & (REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING)) ==
+	    REQ_F_BUFFER_SELECTED) {
 		switch (req->opcode) {
 		case IORING_OP_READV:
 		case IORING_OP_READ_FIXED:
@@ -5973,8 +6921,8 @@ static void __io_clean_op(struct io_kiocb *req)
 			kfree(req->sr_msg.kbuf);
 			break;
 		}
-		req->flags &= ~REQ_F_BUFFER_SELECTED;
 	}
+	req->flags &= ~(REQ_F_BUFFER_SELECTED | REQ_F_BUFFER_RING);
 
 	if (req->flags & REQ_F_NEED_CLEANUP) {
 		switch (req->opcode) {
@@ -6006,6 +6954,21 @@ static void __io_clean_op(struct io_kiocb *req)
 			if (req->open.filename)
 				putname(req->open.filename);
 			break;
+		case IORING_OP_RENAMEAT:
+			putname(req->rename.oldpath);
+			putname(req->rename.newpath);
+			break;
+		case IORING_OP_UNLINKAT:
+			putname(req->unlink.filename);
+			break;
+		case IORING_OP_MKDIRAT:
+			putname(req->mkdir.filename);
+			break;
+		case IORING_OP_SEND_ZC:
+			/* never issued, nothing references the buffer */
+			if (req->sr_msg.notif)
+				io_put_req_deferred(req->sr_msg.notif, 1);
+			break;
 		}
 		req->flags &= ~REQ_F_NEED_CLEANUP;
 	}
@@ -6017,6 +6980,9 @@ static int io_issue_sqe(struct io_kiocb *req, bool force_nonblock,
 	struct io_ring_ctx *ctx = req->ctx;
 	int ret;
 
+	if (req->flags & REQ_F_LAT_STATS)
+		req->lat_issue = ktime_get_ns();
+
 	switch (req->opcode) {
 	case IORING_OP_NOP:
 		ret = io_nop(req, cs);
@@ -6049,6 +7015,12 @@ static int io_issue_sqe(struct io_kiocb *req, bool force_nonblock,
 	case IORING_OP_SEND:
 		ret = io_send(req, force_nonblock, cs);
 		break;
+	case IORING_OP_SEND_ZC:
+		ret = io_send_zc(req, force_nonblock, cs);
+		break;
+	case IORING_OP_URING_CMD:
+		ret = io_uring_cmd(req, force_nonblock);
+		break;
 	case IORING_OP_RECVMSG:
 		ret = io_recvmsg(req, force_nonblock, cs);
 		break;
@@ -6085,6 +7057,18 @@ static int io_issue_sqe(struct io_kiocb *req, bool force_nonblock,
 	case IORING_OP_STATX:
 		ret = io_statx(req, force_nonblock);
 		break;
+	case IORING_OP_RENAMEAT:
+		ret = io_renameat(req, force_nonblock);
+		break;
+	case IORING_OP_UNLINKAT:
+		ret = io_unlinkat(req, force_nonblock);
+		break;
+	case IORING_OP_MKDIRAT:
+		ret = io_mkdirat(req, force_nonblock);
+		break;
+	case IORING_OP_GETDENTS:
+		ret = io_getdents(req, force_nonblock);
+		break;
 	case IORING_OP_FADVISE:
 		ret = io_fadvise(req, force_nonblock);
 		break;
@@ -6512,7 +7496,7 @@ static void io_submit_state_end(struct io_submit_state *state)
 static void io_submit_state_start(struct io_submit_state *state,
 				  struct io_ring_ctx *ctx, unsigned int max_ios)
 {
-	blk_start_plug(&state->plug);
+	blk_start_plug_nr_ios(&state->plug, max_ios);
 	state->comp.nr = 0;
 	INIT_LIST_HEAD(&state->comp.list);
 	state->comp.ctx = ctx;
@@ -6555,8 +7539,12 @@ static const struct io_uring_sqe *io_get_sqe(struct io_ring_ctx *ctx)
 	 *    though the application is the one updating it.
 	 */
 	head = READ_ONCE(sq_array[ctx->cached_sq_head & ctx->sq_mask]);
-	if (likely(head < ctx->sq_entries))
+	if (likely(head < ctx->sq_entries)) {
+		/* double index for 128-byte SQEs, twice as big */
+		if (ctx->flags & IORING_SETUP_SQE128)
+			head <<= 1;
 		return &ctx->sq_sqes[head];
+	}
 
 	/* drop invalid entries */
 	ctx->cached_sq_dropped++;
@@ -6620,6 +7608,11 @@ static int io_init_req(struct io_ring_ctx *ctx, struct io_kiocb *req,
 	if (unlikely(req->opcode >= IORING_OP_LAST))
 		return -EINVAL;
 
+	if (unlikely(ctx->lat_hist)) {
+		req->flags |= REQ_F_LAT_STATS;
+		req->lat_submit = req->lat_issue = ktime_get_ns();
+	}
+
 	if (unlikely(io_sq_thread_acquire_mm(ctx, req)))
 		return -EFAULT;
 
@@ -6973,6 +7966,12 @@ static inline bool io_should_wake(struct io_wait_queue *iowq)
 			atomic_read(&ctx->cq_timeouts) != iowq->nr_timeouts;
 }
 
+static inline bool io_has_local_work(struct io_ring_ctx *ctx)
+{
+	return (ctx->flags & IORING_SETUP_DEFER_TASKRUN) &&
+		!llist_empty(&ctx->work_llist);
+}
+
 static int io_wake_function(struct wait_queue_entry *curr, unsigned int mode,
 			    int wake_flags, void *key)
 {
@@ -6981,9 +7980,11 @@ static int io_wake_function(struct wait_queue_entry *curr, unsigned int mode,
 
 	/*
 	 * Cannot safely flush overflowed CQEs from here, ensure we wake up
-	 * the task, and the next invocation will do it.
+	 * the task, and the next invocation will do it. Same for deferred
+	 * task_work, which must run in the context of the waiting task.
 	 */
-	if (io_should_wake(iowq) || test_bit(0, &iowq->ctx->cq_check_overflow))
+	if (io_should_wake(iowq) || test_bit(0, &iowq->ctx->cq_check_overflow) ||
+	    io_has_local_work(iowq->ctx))
 		return autoremove_wake_function(curr, mode, wake_flags, key);
 	return -1;
 }
@@ -7027,7 +8028,7 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 		io_cqring_overflow_flush(ctx, false, NULL, NULL);
 		if (io_cqring_events(ctx) >= min_events)
 			return 0;
-		if (!io_run_task_work())
+		if (!io_run_task_work() && !io_run_local_work(ctx))
 			break;
 	} while (1);
 
@@ -7052,7 +8053,7 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 						TASK_INTERRUPTIBLE);
 		/* make sure we run task_work before checking for signals */
 		ret = io_run_task_work_sig();
-		if (ret > 0) {
+		if (ret > 0 || io_run_local_work(ctx)) {
 			finish_wait(&ctx->wait, &iowq.wq);
 			continue;
 		}
@@ -7060,7 +8061,8 @@ static int io_cqring_wait(struct io_ring_ctx *ctx, int min_events,
 			break;
 		if (io_should_wake(&iowq))
 			break;
-		if (test_bit(0, &ctx->cq_check_overflow)) {
+		if (test_bit(0, &ctx->cq_check_overflow) ||
+		    io_has_local_work(ctx)) {
 			finish_wait(&ctx->wait, &iowq.wq);
 			continue;
 		}
@@ -7913,6 +8915,7 @@ static int io_uring_alloc_task_context(struct task_struct *task)
 	xa_init(&tctx->xa);
 	init_waitqueue_head(&tctx->wait);
 	tctx->last = NULL;
+	memset(tctx->registered_rings, 0, sizeof(tctx->registered_rings));
 	atomic_set(&tctx->in_idle, 0);
 	tctx->sqpoll = false;
 	io_init_identity(&tctx->__identity);
@@ -7927,6 +8930,8 @@ void __io_uring_free(struct task_struct *tsk)
 
 	WARN_ON_ONCE(!xa_empty(&tctx->xa));
 	WARN_ON_ONCE(refcount_read(&tctx->identity->count) != 1);
+	WARN_ON_ONCE(memchr_inv(tctx->registered_rings, 0,
+				sizeof(tctx->registered_rings)));
 	if (tctx->identity != &tctx->__identity)
 		kfree(tctx->identity);
 	percpu_counter_destroy(&tctx->inflight);
@@ -8095,12 +9100,17 @@ static void *io_mem_alloc(size_t size)
 	return (void *) __get_free_pages(gfp_flags, get_order(size));
 }
 
-static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
-				size_t *sq_offset)
+static unsigned long rings_size(unsigned int flags, unsigned sq_entries,
+				unsigned cq_entries, size_t *sq_offset)
 {
 	struct io_rings *rings;
 	size_t off, sq_array_size;
 
+	if (flags & IORING_SETUP_CQE32) {
+		if (check_shl_overflow(cq_entries, 1, &cq_entries))
+			return SIZE_MAX;
+	}
+
 	off = struct_size(rings, cqes, cq_entries);
 	if (off == SIZE_MAX)
 		return SIZE_MAX;
@@ -8124,21 +9134,28 @@ static unsigned long rings_size(unsigned sq_entries, unsigned cq_entries,
 	return off;
 }
 
-static unsigned long ring_pages(unsigned sq_entries, unsigned cq_entries)
+static size_t sqes_size(unsigned int flags, unsigned sq_entries)
+{
+	if (flags & IORING_SETUP_SQE128)
+		return array3_size(2, sizeof(struct io_uring_sqe), sq_entries);
+	return array_size(sizeof(struct io_uring_sqe), sq_entries);
+}
+
+static unsigned long ring_pages(unsigned int flags, unsigned sq_entries,
+				unsigned cq_entries)
 {
 	size_t pages;
 
 	pages = (size_t)1 << get_order(
-		rings_size(sq_entries, cq_entries, NULL));
-	pages += (size_t)1 << get_order(
-		array_size(sizeof(struct io_uring_sqe), sq_entries));
+		rings_size(flags, sq_entries, cq_entries, NULL));
+	pages += (size_t)1 << get_order(sqes_size(flags, sq_entries));
 
 	return pages;
 }
 
 static int io_sqe_buffer_unregister(struct io_ring_ctx *ctx)
 {
-	int i, j;
+	int i, j, n;
 
 	if (!ctx->user_bufs)
 		return -ENXIO;
@@ -8146,8 +9163,16 @@ static int io_sqe_buffer_unregister(struct io_ring_ctx *ctx)
 	for (i = 0; i < ctx->nr_user_bufs; i++) {
 		struct io_mapped_ubuf *imu = &ctx->user_bufs[i];
 
-		for (j = 0; j < imu->nr_bvecs; j++)
-			unpin_user_page(imu->bvec[j].bv_page);
+		/* release runs of contiguous pages one compound page at a time */
+		for (j = 0; j < imu->nr_bvecs; j += n) {
+			struct page *page = imu->bvec[j].bv_page;
+
+			for (n = 1; j + n < imu->nr_bvecs; n++) {
+				if (imu->bvec[j + n].bv_page != nth_page(page, n))
+					break;
+			}
+			unpin_user_page_range_dirty_lock(page, n, false);
+		}
 
 		if (imu->acct_pages)
 			io_unaccount_mem(ctx, imu->acct_pages, ACCT_PINNED);
@@ -8423,13 +9448,130 @@ static int io_eventfd_unregister(struct io_ring_ctx *ctx)
 	return -ENXIO;
 }
 
+static void io_free_buf_ring(struct io_buffer_list *bl)
+{
+	vunmap(bl->buf_ring);
+	unpin_user_pages(bl->buf_pages, bl->nr_pages);
+	kvfree(bl->buf_pages);
+	kfree(bl);
+}
+
+static int io_register_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+	struct page **pages;
+	unsigned long ubuf;
+	size_t ring_size;
+	int nr_pages, pret, ret;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+	if (!reg.ring_addr)
+		return -EFAULT;
+	if (reg.ring_addr & ~PAGE_MASK)
+		return -EINVAL;
+	if (!is_power_of_2(reg.ring_entries) || reg.ring_entries >= 65536)
+		return -EINVAL;
+	if (xa_load(&ctx->io_buffers, reg.bgid) ||
+	    xa_load(&ctx->io_buf_rings, reg.bgid))
+		return -EEXIST;
+
+	ubuf = reg.ring_addr;
+	ring_size = reg.ring_entries * sizeof(struct io_uring_buf);
+	nr_pages = DIV_ROUND_UP(ring_size, PAGE_SIZE);
+
+	bl = kzalloc(sizeof(*bl), GFP_KERNEL_ACCOUNT);
+	pages = kvmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
+	if (!bl || !pages) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	mmap_read_lock(current->mm);
+	pret = pin_user_pages(ubuf, nr_pages, FOLL_WRITE | FOLL_LONGTERM,
+			      pages, NULL);
+	mmap_read_unlock(current->mm);
+	if (pret != nr_pages) {
+		ret = pret < 0 ? pret : -EFAULT;
+		if (pret > 0)
+			unpin_user_pages(pages, pret);
+		goto err_free;
+	}
+
+	/* give the kernel a contiguous view of the (usually small) ring */
+	bl->buf_ring = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL);
+	if (!bl->buf_ring) {
+		ret = -ENOMEM;
+		unpin_user_pages(pages, nr_pages);
+		goto err_free;
+	}
+	bl->buf_pages = pages;
+	bl->nr_pages = nr_pages;
+	bl->bgid = reg.bgid;
+	bl->mask = reg.ring_entries - 1;
+	bl->head = 0;
+
+	ret = xa_err(xa_store(&ctx->io_buf_rings, reg.bgid, bl, GFP_KERNEL));
+	if (ret) {
+		io_free_buf_ring(bl);
+		return ret;
+	}
+	return 0;
+err_free:
+	kvfree(pages);
+	kfree(bl);
+	return ret;
+}
+
+static int io_unregister_pbuf_ring(struct io_ring_ctx *ctx, void __user *arg)
+{
+	struct io_uring_buf_reg reg;
+	struct io_buffer_list *bl;
+
+	if (copy_from_user(&reg, arg, sizeof(reg)))
+		return -EFAULT;
+	if (reg.pad || reg.resv[0] || reg.resv[1] || reg.resv[2])
+		return -EINVAL;
+
+	/*
+	 * Requests only hold copies of consumed entries, so the ring can go
+	 * away even with buffers from it still in flight.
+	 */
+	bl = xa_erase(&ctx->io_buf_rings, reg.bgid);
+	if (!bl)
+		return -ENOENT;
+	io_free_buf_ring(bl);
+	return 0;
+}
+
 static void io_destroy_buffers(struct io_ring_ctx *ctx)
 {
+	struct io_buffer_list *bl;
 	struct io_buffer *buf;
 	unsigned long index;
 
 	xa_for_each(&ctx->io_buffers, index, buf)
 		__io_remove_buffers(ctx, buf, index, -1U);
+
+	xa_for_each(&ctx->io_buf_rings, index, bl) {
+		xa_erase(&ctx->io_buf_rings, index);
+		io_free_buf_ring(bl);
+	}
+}
+
+static void io_free_lat_stats(struct io_ring_ctx *ctx)
+{
+	int i;
+
+	if (!ctx->lat_hist)
+		return;
+	for (i = 0; i < IORING_OP_LAST; i++)
+		free_percpu(ctx->lat_hist[i]);
+	kfree(ctx->lat_hist);
+	ctx->lat_hist = NULL;
 }
 
 static void io_ring_ctx_free(struct io_ring_ctx *ctx)
@@ -8443,6 +9585,9 @@ static void io_ring_ctx_free(struct io_ring_ctx *ctx)
 		mmdrop(ctx->mm_account);
 		ctx->mm_account = NULL;
 	}
+	if (ctx->submitter_task)
+		put_task_struct(ctx->submitter_task);
+	io_free_lat_stats(ctx);
 
 #ifdef CONFIG_BLK_CGROUP
 	if (ctx->sqo_blkcg_css)
@@ -8539,6 +9684,7 @@ static void io_ring_exit_work(struct work_struct *work)
 	 */
 	do {
 		io_iopoll_try_reap_events(ctx);
+		io_move_task_work_from_local(ctx);
 	} while (!wait_for_completion_timeout(&ctx->ref_comp, HZ/20));
 	io_ring_ctx_free(ctx);
 }
@@ -8557,6 +9703,7 @@ static void io_ring_ctx_wait_and_kill(struct io_ring_ctx *ctx)
 
 	mutex_lock(&ctx->uring_lock);
 	percpu_ref_kill(&ctx->refs);
+	io_move_task_work_from_local(ctx);
 	/* if force is set, the ring is going away. always drop after that */
 
 	if (WARN_ON_ONCE((ctx->flags & IORING_SETUP_SQPOLL) && !ctx->sqo_dead))
@@ -8583,8 +9730,8 @@ static void io_ring_ctx_wait_and_kill(struct io_ring_ctx *ctx)
 	 * is closed but resources aren't reaped yet. This can cause
 	 * spurious failure in setting up a new ring.
 	 */
-	io_unaccount_mem(ctx, ring_pages(ctx->sq_entries, ctx->cq_entries),
-			 ACCT_LOCKED);
+	io_unaccount_mem(ctx, ring_pages(ctx->flags, ctx->sq_entries,
+					 ctx->cq_entries), ACCT_LOCKED);
 
 	INIT_WORK(&ctx->exit_work, io_ring_exit_work);
 	/*
@@ -8687,6 +9834,7 @@ static void io_uring_cancel_files(struct io_ring_ctx *ctx,
 		io_poll_remove_all(ctx, task, files);
 		io_kill_timeouts(ctx, task, files);
 		/* cancellations _may_ trigger task work */
+		io_move_task_work_from_local(ctx);
 		io_run_task_work();
 
 		prepare_to_wait(&task->io_uring->wait, &wait,
@@ -8721,6 +9869,7 @@ static void __io_uring_cancel_task_requests(struct io_ring_ctx *ctx,
 		ret |= io_kill_timeouts(ctx, task, NULL);
 		if (!ret)
 			break;
+		io_move_task_work_from_local(ctx);
 		io_run_task_work();
 		cond_resched();
 	}
@@ -8824,15 +9973,157 @@ static void io_uring_del_task_file(struct file *file)
 		fput(file);
 }
 
+static void io_uring_unreg_ringfd(struct io_uring_task *tctx)
+{
+	int i;
+
+	for (i = 0; i < IO_RINGFD_REG_MAX; i++) {
+		if (tctx->registered_rings[i]) {
+			fput(tctx->registered_rings[i]);
+			tctx->registered_rings[i] = NULL;
+		}
+	}
+}
+
 static void io_uring_remove_task_files(struct io_uring_task *tctx)
 {
 	struct file *file;
 	unsigned long index;
 
+	io_uring_unreg_ringfd(tctx);
 	xa_for_each(&tctx->xa, index, file)
 		io_uring_del_task_file(file);
 }
 
+static int io_ring_add_registered_fd(struct io_uring_task *tctx, int fd,
+				     int start, int end)
+{
+	struct file *file;
+	int offset, ret;
+
+	for (offset = start; offset < end; offset++) {
+		offset = array_index_nospec(offset, IO_RINGFD_REG_MAX);
+		if (tctx->registered_rings[offset])
+			continue;
+
+		file = fget(fd);
+		if (!file)
+			return -EBADF;
+		if (file->f_op != &io_uring_fops) {
+			fput(file);
+			return -EOPNOTSUPP;
+		}
+		/* makes sure the exit and exec cancelation paths find us */
+		ret = io_uring_add_task_file(file->private_data, file);
+		if (ret) {
+			fput(file);
+			return ret;
+		}
+		tctx->registered_rings[offset] = file;
+		return offset;
+	}
+
+	return -EBUSY;
+}
+
+/*
+ * Register ring files in the task private ring table. The returned index can
+ * be passed to io_uring_enter(2) with IORING_ENTER_REGISTERED_RING instead of
+ * a file descriptor, which saves the fdget/fdput (and the atomic on the shared
+ * file refcount for a multi-threaded file table) for every call. An offset of
+ * -1U picks the first free slot. Returns the number of entries registered.
+ */
+static int io_ringfd_register(struct io_ring_ctx *ctx, void __user *__arg,
+			      unsigned nr_args)
+{
+	struct io_uring_rsrc_update __user *arg = __arg;
+	struct io_uring_rsrc_update reg;
+	struct io_uring_task *tctx;
+	int ret, i;
+
+	if (!nr_args || nr_args > IO_RINGFD_REG_MAX)
+		return -EINVAL;
+
+	if (unlikely(!current->io_uring)) {
+		ret = io_uring_alloc_task_context(current);
+		if (unlikely(ret))
+			return ret;
+	}
+	tctx = current->io_uring;
+
+	for (i = 0; i < nr_args; i++) {
+		int start, end;
+
+		if (copy_from_user(&reg, &arg[i], sizeof(reg))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (reg.resv) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (reg.offset == -1U) {
+			start = 0;
+			end = IO_RINGFD_REG_MAX;
+		} else {
+			if (reg.offset >= IO_RINGFD_REG_MAX) {
+				ret = -EINVAL;
+				break;
+			}
+			start = reg.offset;
+			end = start + 1;
+		}
+
+		ret = io_ring_add_registered_fd(tctx, reg.data, start, end);
+		if (ret < 0)
+			break;
+
+		reg.offset = ret;
+		if (copy_to_user(&arg[i], &reg, sizeof(reg))) {
+			fput(tctx->registered_rings[reg.offset]);
+			tctx->registered_rings[reg.offset] = NULL;
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	return i ? i : ret;
+}
+
+static int io_ringfd_unregister(struct io_ring_ctx *ctx, void __user *__arg,
+				unsigned nr_args)
+{
+	struct io_uring_rsrc_update __user *arg = __arg;
+	struct io_uring_task *tctx = current->io_uring;
+	struct io_uring_rsrc_update reg;
+	int ret = 0, i;
+
+	if (!nr_args || nr_args > IO_RINGFD_REG_MAX)
+		return -EINVAL;
+	if (!tctx)
+		return 0;
+
+	for (i = 0; i < nr_args; i++) {
+		if (copy_from_user(&reg, &arg[i], sizeof(reg))) {
+			ret = -EFAULT;
+			break;
+		}
+		if (reg.resv || reg.data || reg.offset >= IO_RINGFD_REG_MAX) {
+			ret = -EINVAL;
+			break;
+		}
+
+		reg.offset = array_index_nospec(reg.offset, IO_RINGFD_REG_MAX);
+		if (tctx->registered_rings[reg.offset]) {
+			fput(tctx->registered_rings[reg.offset]);
+			tctx->registered_rings[reg.offset] = NULL;
+		}
+	}
+
+	return i ? i : ret;
+}
+
 void __io_uring_files_cancel(struct files_struct *files)
 {
 	struct io_uring_task *tctx = current->io_uring;
@@ -9064,10 +10355,25 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 	io_run_task_work();
 
 	if (flags & ~(IORING_ENTER_GETEVENTS | IORING_ENTER_SQ_WAKEUP |
-			IORING_ENTER_SQ_WAIT))
+			IORING_ENTER_SQ_WAIT | IORING_ENTER_REGISTERED_RING))
 		return -EINVAL;
 
-	f = fdget(fd);
+	/*
+	 * Ring fd has been registered via IORING_REGISTER_RING_FDS, we don't
+	 * need to grab a file reference as only the task itself can modify its
+	 * ring table. fdput() is a nop for a zero ->flags.
+	 */
+	if (flags & IORING_ENTER_REGISTERED_RING) {
+		struct io_uring_task *tctx = current->io_uring;
+
+		if (unlikely(!tctx || fd >= IO_RINGFD_REG_MAX))
+			return -EINVAL;
+		fd = array_index_nospec(fd, IO_RINGFD_REG_MAX);
+		f.file = tctx->registered_rings[fd];
+		f.flags = 0;
+	} else {
+		f = fdget(fd);
+	}
 	if (!f.file)
 		return -EBADF;
 
@@ -9084,6 +10390,11 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 	if (ctx->flags & IORING_SETUP_R_DISABLED)
 		goto out;
 
+	ret = -EEXIST;
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    ctx->submitter_task != current)
+		goto out;
+
 	/*
 	 * For SQ polling, the thread will do all submissions and completions.
 	 * Just return the requested submit count, and wake the thread if
@@ -9119,6 +10430,9 @@ SYSCALL_DEFINE6(io_uring_enter, unsigned int, fd, u32, to_submit,
 	if (flags & IORING_ENTER_GETEVENTS) {
 		min_complete = min(min_complete, ctx->cq_entries);
 
+		/* reap deferred completions even if we're not going to wait */
+		io_run_local_work(ctx);
+
 		/*
 		 * When SETUP_IOPOLL and SETUP_SQPOLL are both enabled, user
 		 * space applications don't need to do io completion events
@@ -9174,6 +10488,44 @@ static int io_uring_show_cred(struct seq_file *m, unsigned int id,
 	return 0;
 }
 
+static void io_uring_show_lat_stats(struct io_ring_ctx *ctx,
+				    struct seq_file *m)
+{
+	static const char * const names[IO_LAT_NR] = {
+		[IO_LAT_QUEUE]	= "queue",
+		[IO_LAT_EXEC]	= "exec",
+		[IO_LAT_TOTAL]	= "total",
+	};
+	struct io_lat_hist sum;
+	int op, cpu, t, b;
+
+	seq_printf(m, "LatencyStats:\t%d log2 buckets from 1024ns\n",
+		   IO_LAT_BUCKETS);
+	for (op = 0; op < IORING_OP_LAST; op++) {
+		u64 nr = 0;
+
+		memset(&sum, 0, sizeof(sum));
+		for_each_possible_cpu(cpu) {
+			struct io_lat_hist *h = per_cpu_ptr(ctx->lat_hist[op], cpu);
+
+			for (t = 0; t < IO_LAT_NR; t++)
+				for (b = 0; b < IO_LAT_BUCKETS; b++)
+					sum.buckets[t][b] += h->buckets[t][b];
+		}
+		for (b = 0; b < IO_LAT_BUCKETS; b++)
+			nr += sum.buckets[IO_LAT_TOTAL][b];
+		if (!nr)
+			continue;
+
+		for (t = 0; t < IO_LAT_NR; t++) {
+			seq_printf(m, "  op=%d %s:", op, names[t]);
+			for (b = 0; b < IO_LAT_BUCKETS; b++)
+				seq_printf(m, " %llu", sum.buckets[t][b]);
+			seq_putc(m, '\n');
+		}
+	}
+}
+
 static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 {
 	struct io_sq_data *sq = NULL;
@@ -9231,6 +10583,9 @@ static void __io_uring_show_fdinfo(struct io_ring_ctx *ctx, struct seq_file *m)
 					req->task->task_works != NULL);
 	}
 	spin_unlock_irq(&ctx->completion_lock);
+	/* ->lat_hist is only changed under the uring_lock */
+	if (has_lock && ctx->lat_hist)
+		io_uring_show_lat_stats(ctx, m);
 	if (has_lock)
 		mutex_unlock(&ctx->uring_lock);
 }
@@ -9271,7 +10626,8 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	ctx->sq_entries = p->sq_entries;
 	ctx->cq_entries = p->cq_entries;
 
-	size = rings_size(p->sq_entries, p->cq_entries, &sq_array_offset);
+	size = rings_size(p->flags, p->sq_entries, p->cq_entries,
+			  &sq_array_offset);
 	if (size == SIZE_MAX)
 		return -EOVERFLOW;
 
@@ -9288,7 +10644,7 @@ static int io_allocate_scq_urings(struct io_ring_ctx *ctx,
 	ctx->sq_mask = rings->sq_ring_mask;
 	ctx->cq_mask = rings->cq_ring_mask;
 
-	size = array_size(sizeof(struct io_uring_sqe), p->sq_entries);
+	size = sqes_size(p->flags, p->sq_entries);
 	if (size == SIZE_MAX) {
 		io_mem_free(ctx->rings);
 		ctx->rings = NULL;
@@ -9403,8 +10759,8 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	limit_mem = !capable(CAP_IPC_LOCK);
 
 	if (limit_mem) {
-		ret = __io_account_mem(user,
-				ring_pages(p->sq_entries, p->cq_entries));
+		ret = __io_account_mem(user, ring_pages(p->flags,
+					p->sq_entries, p->cq_entries));
 		if (ret) {
 			free_uid(user);
 			return ret;
@@ -9414,8 +10770,8 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	ctx = io_ring_ctx_alloc(p);
 	if (!ctx) {
 		if (limit_mem)
-			__io_unaccount_mem(user, ring_pages(p->sq_entries,
-								p->cq_entries));
+			__io_unaccount_mem(user, ring_pages(p->flags,
+						p->sq_entries, p->cq_entries));
 		free_uid(user);
 		return -ENOMEM;
 	}
@@ -9427,6 +10783,9 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	ctx->sessionid = current->sessionid;
 #endif
 	ctx->sqo_task = get_task_struct(current);
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    !(ctx->flags & IORING_SETUP_R_DISABLED))
+		ctx->submitter_task = get_task_struct(current);
 
 	/*
 	 * This is just grabbed for accounting purposes. When a process exits,
@@ -9462,8 +10821,8 @@ static int io_uring_create(unsigned entries, struct io_uring_params *p,
 	 * do this before hitting the general error path, as ring freeing
 	 * will un-account as well.
 	 */
-	io_account_mem(ctx, ring_pages(p->sq_entries, p->cq_entries),
-		       ACCT_LOCKED);
+	io_account_mem(ctx, ring_pages(p->flags, p->sq_entries,
+				       p->cq_entries), ACCT_LOCKED);
 	ctx->limit_mem = limit_mem;
 
 	ret = io_allocate_scq_urings(ctx, p);
@@ -9551,7 +10910,20 @@ static long io_uring_setup(u32 entries, struct io_uring_params __user *params)
 	if (p.flags & ~(IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL |
 			IORING_SETUP_SQ_AFF | IORING_SETUP_CQSIZE |
 			IORING_SETUP_CLAMP | IORING_SETUP_ATTACH_WQ |
-			IORING_SETUP_R_DISABLED))
+			IORING_SETUP_R_DISABLED | IORING_SETUP_SQE128 |
+			IORING_SETUP_CQE32 | IORING_SETUP_SINGLE_ISSUER |
+			IORING_SETUP_DEFER_TASKRUN))
+		return -EINVAL;
+
+	/*
+	 * Deferred task_work is run by the submitter, which must be known. The
+	 * SQPOLL thread does all submissions and completions itself.
+	 */
+	if ((p.flags & IORING_SETUP_DEFER_TASKRUN) &&
+	    !(p.flags & IORING_SETUP_SINGLE_ISSUER))
+		return -EINVAL;
+	if ((p.flags & IORING_SETUP_SINGLE_ISSUER) &&
+	    (p.flags & IORING_SETUP_SQPOLL))
 		return -EINVAL;
 
 	return  io_uring_create(entries, &p, params);
@@ -9703,10 +11075,93 @@ static int io_register_enable_rings(struct io_ring_ctx *ctx)
 	if (ctx->restrictions.registered)
 		ctx->restricted = 1;
 
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) && !ctx->submitter_task)
+		ctx->submitter_task = get_task_struct(current);
+
 	io_sq_offload_start(ctx);
 	return 0;
 }
 
+static int io_register_iowq_aff(struct io_ring_ctx *ctx, void __user *arg,
+				unsigned len)
+{
+	cpumask_var_t new_mask;
+	int ret;
+
+	if (!alloc_cpumask_var(&new_mask, GFP_KERNEL))
+		return -ENOMEM;
+
+	cpumask_clear(new_mask);
+	if (len > cpumask_size())
+		len = cpumask_size();
+
+#ifdef CONFIG_COMPAT
+	if (ctx->compat)
+		ret = compat_get_bitmap(cpumask_bits(new_mask),
+					(const compat_ulong_t __user *)arg,
+					len * 8 /* CHAR_BIT */);
+	else
+#endif
+		ret = copy_from_user(new_mask, arg, len) ? -EFAULT : 0;
+
+	if (!ret)
+		ret = io_wq_cpu_affinity(ctx->io_wq, new_mask);
+	free_cpumask_var(new_mask);
+	return ret;
+}
+
+static int io_register_iowq_max_workers(struct io_ring_ctx *ctx,
+					void __user *arg)
+{
+	__u32 new_count[2];
+	int i;
+
+	if (copy_from_user(new_count, arg, sizeof(new_count)))
+		return -EFAULT;
+	for (i = 0; i < ARRAY_SIZE(new_count); i++)
+		if (new_count[i] > INT_MAX)
+			return -EINVAL;
+
+	io_wq_max_workers(ctx->io_wq, new_count);
+
+	if (copy_to_user(arg, new_count, sizeof(new_count)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+ * Both run with the ring quiesced, so no request carrying REQ_F_LAT_STATS
+ * is in flight while ->lat_hist changes.
+ */
+static int io_register_lat_stats(struct io_ring_ctx *ctx)
+{
+	int i;
+
+	if (ctx->lat_hist)
+		return -EBUSY;
+
+	ctx->lat_hist = kcalloc(IORING_OP_LAST, sizeof(*ctx->lat_hist),
+				GFP_KERNEL);
+	if (!ctx->lat_hist)
+		return -ENOMEM;
+	for (i = 0; i < IORING_OP_LAST; i++) {
+		ctx->lat_hist[i] = alloc_percpu(struct io_lat_hist);
+		if (!ctx->lat_hist[i]) {
+			io_free_lat_stats(ctx);
+			return -ENOMEM;
+		}
+	}
+	return 0;
+}
+
+static int io_unregister_lat_stats(struct io_ring_ctx *ctx)
+{
+	if (!ctx->lat_hist)
+		return -ENXIO;
+	io_free_lat_stats(ctx);
+	return 0;
+}
+
 static bool io_register_op_must_quiesce(int op)
 {
 	switch (op) {
@@ -9715,6 +11170,13 @@ static bool io_register_op_must_quiesce(int op)
 	case IORING_REGISTER_PROBE:
 	case IORING_REGISTER_PERSONALITY:
 	case IORING_UNREGISTER_PERSONALITY:
+	case IORING_REGISTER_PBUF_RING:
+	case IORING_UNREGISTER_PBUF_RING:
+	case IORING_REGISTER_RING_FDS:
+	case IORING_UNREGISTER_RING_FDS:
+	case IORING_REGISTER_IOWQ_AFF:
+	case IORING_UNREGISTER_IOWQ_AFF:
+	case IORING_REGISTER_IOWQ_MAX_WORKERS:
 		return false;
 	default:
 		return true;
@@ -9736,8 +11198,14 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 	if (percpu_ref_is_dying(&ctx->refs))
 		return -ENXIO;
 
+	/* a disabled ring gets its submitter when it's enabled */
+	if ((ctx->flags & IORING_SETUP_SINGLE_ISSUER) && ctx->submitter_task &&
+	    ctx->submitter_task != current)
+		return -EEXIST;
+
 	if (io_register_op_must_quiesce(opcode)) {
 		percpu_ref_kill(&ctx->refs);
+		io_move_task_work_from_local(ctx);
 
 		/*
 		 * Drop uring mutex before waiting for references to exit. If
@@ -9845,6 +11313,54 @@ static int __io_uring_register(struct io_ring_ctx *ctx, unsigned opcode,
 	case IORING_REGISTER_RESTRICTIONS:
 		ret = io_register_restrictions(ctx, arg, nr_args);
 		break;
+	case IORING_REGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_register_pbuf_ring(ctx, arg);
+		break;
+	case IORING_UNREGISTER_PBUF_RING:
+		ret = -EINVAL;
+		if (!arg || nr_args != 1)
+			break;
+		ret = io_unregister_pbuf_ring(ctx, arg);
+		break;
+	case IORING_REGISTER_RING_FDS:
+		ret = io_ringfd_register(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_RING_FDS:
+		ret = io_ringfd_unregister(ctx, arg, nr_args);
+		break;
+	case IORING_REGISTER_IOWQ_AFF:
+		ret = -EINVAL;
+		if (!arg || !nr_args)
+			break;
+		ret = io_register_iowq_aff(ctx, arg, nr_args);
+		break;
+	case IORING_UNREGISTER_IOWQ_AFF:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = io_wq_cpu_affinity(ctx->io_wq, NULL);
+		break;
+	case IORING_REGISTER_IOWQ_MAX_WORKERS:
+		ret = -EINVAL;
+		if (!arg || nr_args != 2)
+			break;
+		ret = io_register_iowq_max_workers(ctx, arg);
+		break;
+	case IORING_REGISTER_LAT_STATS:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = io_register_lat_stats(ctx);
+		break;
+	case IORING_UNREGISTER_LAT_STATS:
+		ret = -EINVAL;
+		if (arg || nr_args)
+			break;
+		ret = io_unregister_lat_stats(ctx);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
@@ -9903,6 +11419,7 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(4,  __s32,  fd);
 	BUILD_BUG_SQE_ELEM(8,  __u64,  off);
 	BUILD_BUG_SQE_ELEM(8,  __u64,  addr2);
+	BUILD_BUG_SQE_ELEM(8,  __u32,  cmd_op);
 	BUILD_BUG_SQE_ELEM(16, __u64,  addr);
 	BUILD_BUG_SQE_ELEM(16, __u64,  splice_off_in);
 	BUILD_BUG_SQE_ELEM(24, __u32,  len);
@@ -9921,11 +11438,16 @@ static int __init io_uring_init(void)
 	BUILD_BUG_SQE_ELEM(28, __u32,  statx_flags);
 	BUILD_BUG_SQE_ELEM(28, __u32,  fadvise_advice);
 	BUILD_BUG_SQE_ELEM(28, __u32,  splice_flags);
+	BUILD_BUG_SQE_ELEM(28, __u32,  rename_flags);
+	BUILD_BUG_SQE_ELEM(28, __u32,  unlink_flags);
 	BUILD_BUG_SQE_ELEM(32, __u64,  user_data);
 	BUILD_BUG_SQE_ELEM(40, __u16,  buf_index);
 	BUILD_BUG_SQE_ELEM(42, __u16,  personality);
 	BUILD_BUG_SQE_ELEM(44, __s32,  splice_fd_in);
+	BUILD_BUG_ON(offsetof(struct io_uring_sqe, cmd) != 48);
 
+	BUILD_BUG_ON(sizeof(struct io_uring_cmd) > sizeof_field(struct io_kiocb,
+							      rw));
 	BUILD_BUG_ON(ARRAY_SIZE(io_op_defs) != IORING_OP_LAST);
 	BUILD_BUG_ON(__REQ_F_LAST_BIT >= 8 * sizeof(int));
 	req_cachep = KMEM_CACHE(io_kiocb, SLAB_HWCACHE_ALIGN | SLAB_PANIC);
@@ -49,16 +49,22 @@ static inline struct iomap_page *to_iomap_page(struct page *page)
 static struct bio_set iomap_ioend_bioset;
 
 static struct iomap_page *
-iomap_page_create(struct inode *inode, struct page *page)
+iomap_page_create(struct inode *inode, struct page *page, unsigned int flags)
 {
 	struct iomap_page *iop = to_iomap_page(page);
 	unsigned int nr_blocks = i_blocks_per_page(inode, page);
+	gfp_t gfp = GFP_NOFS | __GFP_NOFAIL;
 
 	if (iop || nr_blocks <= 1)
 		return iop;
 
+	if (flags & IOMAP_NOWAIT)
+		gfp = GFP_NOWAIT;
+
 	iop = kzalloc(struct_size(iop, uptodate, BITS_TO_LONGS(nr_blocks)),
-			GFP_NOFS | __GFP_NOFAIL);
+			gfp);
+	if (!iop)
+		return NULL;
 	spin_lock_init(&iop->uptodate_lock);
 	if (PageUptodate(page))
 		bitmap_fill(iop->uptodate, nr_blocks);
@@ -85,15 +91,16 @@ iomap_page_release(struct page *page)
  * Calculate the range inside the page that we actually need to read.
  */
 static void
-iomap_adjust_read_range(struct inode *inode, struct iomap_page *iop,
-		loff_t *pos, loff_t length, unsigned *offp, unsigned *lenp)
+iomap_adjust_read_range(struct inode *inode, struct page *page,
+		struct iomap_page *iop, loff_t *pos, loff_t length,
+		unsigned *offp, unsigned *lenp)
 {
 	loff_t orig_pos = *pos;
 	loff_t isize = i_size_read(inode);
 	unsigned block_bits = inode->i_blkbits;
 	unsigned block_size = (1 << block_bits);
-	unsigned poff = offset_in_page(*pos);
-	unsigned plen = min_t(loff_t, PAGE_SIZE - poff, length);
+	unsigned poff = offset_in_thp(page, *pos);
+	unsigned plen = min_t(loff_t, thp_size(page) - poff, length);
 	unsigned first = poff >> block_bits;
 	unsigned last = (poff + plen - 1) >> block_bits;
 
@@ -131,7 +138,7 @@ iomap_adjust_read_range(struct inode *inode, struct iomap_page *iop,
 	 * page cache for blocks that are entirely outside of i_size.
 	 */
 	if (orig_pos <= isize && orig_pos + length > isize) {
-		unsigned end = offset_in_page(isize - 1) >> block_bits;
+		unsigned end = offset_in_thp(page, isize - 1) >> block_bits;
 
 		if (first <= end && last > end)
 			plen -= (last - end) * block_size;
@@ -172,14 +179,16 @@ iomap_set_range_uptodate(struct page *page, unsigned off, unsigned len)
 static void
 iomap_read_page_end_io(struct bio_vec *bvec, int error)
 {
-	struct page *page = bvec->bv_page;
+	/* the segments of a THP are completed one base page at a time */
+	struct page *page = thp_head(bvec->bv_page);
+	unsigned int off = (bvec->bv_page - page) * PAGE_SIZE + bvec->bv_offset;
 	struct iomap_page *iop = to_iomap_page(page);
 
 	if (unlikely(error)) {
 		ClearPageUptodate(page);
 		SetPageError(page);
 	} else {
-		iomap_set_range_uptodate(page, bvec->bv_offset, bvec->bv_len);
+		iomap_set_range_uptodate(page, off, bvec->bv_len);
 	}
 
 	if (!iop || atomic_sub_and_test(bvec->bv_len, &iop->read_bytes_pending))
@@ -239,7 +248,7 @@ iomap_readpage_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 {
 	struct iomap_readpage_ctx *ctx = data;
 	struct page *page = ctx->cur_page;
-	struct iomap_page *iop = iomap_page_create(inode, page);
+	struct iomap_page *iop = iomap_page_create(inode, page, 0);
 	bool same_page = false, is_contig = false;
 	loff_t orig_pos = pos;
 	unsigned poff, plen;
@@ -252,7 +261,7 @@ iomap_readpage_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 	}
 
 	/* zero post-eof blocks as the page may be mapped */
-	iomap_adjust_read_range(inode, iop, &pos, length, &poff, &plen);
+	iomap_adjust_read_range(inode, page, iop, &pos, length, &poff, &plen);
 	if (plen == 0)
 		goto done;
 
@@ -315,16 +324,19 @@ iomap_readpage_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 int
 iomap_readpage(struct page *page, const struct iomap_ops *ops)
 {
-	struct iomap_readpage_ctx ctx = { .cur_page = page };
+	struct iomap_readpage_ctx ctx = { };
 	struct inode *inode = page->mapping->host;
 	unsigned poff;
 	loff_t ret;
 
-	trace_iomap_readpage(page->mapping->host, 1);
+	/* a read retried on a THP by index hands us one of its subpages */
+	page = thp_head(page);
+	ctx.cur_page = page;
+	trace_iomap_readpage(page->mapping->host, thp_nr_pages(page));
 
-	for (poff = 0; poff < PAGE_SIZE; poff += ret) {
+	for (poff = 0; poff < thp_size(page); poff += ret) {
 		ret = iomap_apply(inode, page_offset(page) + poff,
-				PAGE_SIZE - poff, 0, ops, &ctx,
+				thp_size(page) - poff, 0, ops, &ctx,
 				iomap_readpage_actor);
 		if (ret <= 0) {
 			WARN_ON_ONCE(ret == 0);
@@ -358,7 +370,8 @@ iomap_readahead_actor(struct inode *inode, loff_t pos, loff_t length,
 	loff_t done, ret;
 
 	for (done = 0; done < length; done += ret) {
-		if (ctx->cur_page && offset_in_page(pos + done) == 0) {
+		if (ctx->cur_page &&
+		    offset_in_thp(ctx->cur_page, pos + done) == 0) {
 			if (!ctx->cur_page_in_bio)
 				unlock_page(ctx->cur_page);
 			put_page(ctx->cur_page);
@@ -433,13 +446,16 @@ int
 iomap_is_partially_uptodate(struct page *page, unsigned long from,
 		unsigned long count)
 {
-	struct iomap_page *iop = to_iomap_page(page);
+	struct page *head = thp_head(page);
+	struct iomap_page *iop = to_iomap_page(head);
 	struct inode *inode = page->mapping->host;
 	unsigned len, first, last;
 	unsigned i;
 
 	/* Limit range to one page */
 	len = min_t(unsigned, PAGE_SIZE - from, count);
+	/* the per-block state of a THP is indexed from its head page */
+	from += (page - head) * PAGE_SIZE;
 
 	/* First and last blocks in range within page */
 	first = from >> inode->i_blkbits;
@@ -483,7 +499,7 @@ iomap_invalidatepage(struct page *page, unsigned int offset, unsigned int len)
 	 * If we are invalidating the entire page, clear the dirty state from it
 	 * and release it to avoid unnecessary buildup of the LRU.
 	 */
-	if (offset == 0 && len == PAGE_SIZE) {
+	if (offset == 0 && len == thp_size(page)) {
 		WARN_ON_ONCE(PageWriteback(page));
 		cancel_dirty_page(page);
 		iomap_page_release(page);
@@ -516,6 +532,7 @@ EXPORT_SYMBOL_GPL(iomap_migrate_page);
 
 enum {
 	IOMAP_WRITE_F_UNSHARE		= (1 << 0),
+	IOMAP_WRITE_F_NOWAIT		= (1 << 1),
 };
 
 static void
@@ -550,18 +567,24 @@ static int
 __iomap_write_begin(struct inode *inode, loff_t pos, unsigned len, int flags,
 		struct page *page, struct iomap *srcmap)
 {
-	struct iomap_page *iop = iomap_page_create(inode, page);
+	struct iomap_page *iop;
 	loff_t block_size = i_blocksize(inode);
 	loff_t block_start = round_down(pos, block_size);
 	loff_t block_end = round_up(pos + len, block_size);
 	unsigned from = offset_in_page(pos), to = from + len, poff, plen;
 
+	iop = iomap_page_create(inode, page,
+			(flags & IOMAP_WRITE_F_NOWAIT) ? IOMAP_NOWAIT : 0);
+	if ((flags & IOMAP_WRITE_F_NOWAIT) && !iop &&
+	    i_blocks_per_page(inode, page) > 1)
+		return -EAGAIN;
+
 	if (PageUptodate(page))
 		return 0;
 	ClearPageError(page);
 
 	do {
-		iomap_adjust_read_range(inode, iop, &block_start,
+		iomap_adjust_read_range(inode, page, iop, &block_start,
 				block_end - block_start, &poff, &plen);
 		if (plen == 0)
 			break;
@@ -576,7 +599,13 @@ __iomap_write_begin(struct inode *inode, loff_t pos, unsigned len, int flags,
 				return -EIO;
 			zero_user_segments(page, poff, from, to, poff + plen);
 		} else {
-			int status = iomap_read_page_sync(block_start, page,
+			int status;
+
+			/* reading in the rest of the block would block */
+			if (flags & IOMAP_WRITE_F_NOWAIT)
+				return -EAGAIN;
+
+			status = iomap_read_page_sync(block_start, page,
 					poff, plen, srcmap);
 			if (status)
 				return status;
@@ -608,10 +637,26 @@ iomap_write_begin(struct inode *inode, loff_t pos, unsigned len, unsigned flags,
 			return status;
 	}
 
-	page = grab_cache_page_write_begin(inode->i_mapping, pos >> PAGE_SHIFT,
-			AOP_FLAG_NOFS);
+	if (flags & IOMAP_WRITE_F_NOWAIT) {
+		/*
+		 * Only page cache hits are handled without blocking: don't
+		 * allocate a new page and don't wait for the page lock.
+		 */
+		page = pagecache_get_page(inode->i_mapping, pos >> PAGE_SHIFT,
+				FGP_LOCK | FGP_WRITE | FGP_NOWAIT | FGP_NOFS,
+				mapping_gfp_mask(inode->i_mapping));
+		if (page && PageWriteback(page) &&
+		    (inode->i_sb->s_iflags & SB_I_STABLE_WRITES)) {
+			unlock_page(page);
+			put_page(page);
+			page = NULL;
+		}
+	} else {
+		page = grab_cache_page_write_begin(inode->i_mapping,
+				pos >> PAGE_SHIFT, AOP_FLAG_NOFS);
+	}
 	if (!page) {
-		status = -ENOMEM;
+		status = (flags & IOMAP_WRITE_F_NOWAIT) ? -EAGAIN : -ENOMEM;
 		goto out_no_page;
 	}
 
@@ -745,14 +790,24 @@ static size_t iomap_write_end(struct inode *inode, loff_t pos, size_t len,
 	return ret;
 }
 
+struct iomap_write_ctx {
+	struct iov_iter		*iter;
+	unsigned int		flags;	/* IOMAP_WRITE_F_* */
+};
+
 static loff_t
 iomap_write_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 		struct iomap *iomap, struct iomap *srcmap)
 {
-	struct iov_iter *i = data;
+	struct iomap_write_ctx *ctx = data;
+	struct iov_iter *i = ctx->iter;
+	unsigned int bdp_flags = 0;
 	long status = 0;
 	ssize_t written = 0;
 
+	if (ctx->flags & IOMAP_WRITE_F_NOWAIT)
+		bdp_flags |= BDP_ASYNC;
+
 	do {
 		struct page *page;
 		unsigned long offset;	/* Offset into pagecache page */
@@ -781,8 +836,8 @@ iomap_write_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 			break;
 		}
 
-		status = iomap_write_begin(inode, pos, bytes, 0, &page, iomap,
-				srcmap);
+		status = iomap_write_begin(inode, pos, bytes, ctx->flags, &page,
+				iomap, srcmap);
 		if (unlikely(status))
 			break;
 
@@ -814,7 +869,10 @@ iomap_write_actor(struct inode *inode, loff_t pos, loff_t length, void *data,
 		written += copied;
 		length -= copied;
 
-		balance_dirty_pages_ratelimited(inode->i_mapping);
+		status = balance_dirty_pages_ratelimited_flags(inode->i_mapping,
+				bdp_flags);
+		if (unlikely(status))
+			break;
 	} while (iov_iter_count(i) && length);
 
 	return written ? written : status;
@@ -826,10 +884,17 @@ iomap_file_buffered_write(struct kiocb *iocb, struct iov_iter *iter,
 {
 	struct inode *inode = iocb->ki_filp->f_mapping->host;
 	loff_t pos = iocb->ki_pos, ret = 0, written = 0;
+	struct iomap_write_ctx ctx = { .iter = iter };
+	unsigned int flags = IOMAP_WRITE;
+
+	if (iocb->ki_flags & IOCB_NOWAIT) {
+		ctx.flags |= IOMAP_WRITE_F_NOWAIT;
+		flags |= IOMAP_NOWAIT;
+	}
 
 	while (iov_iter_count(iter)) {
 		ret = iomap_apply(inode, pos, iov_iter_count(iter),
-				IOMAP_WRITE, ops, iter, iomap_write_actor);
+				flags, ops, &ctx, iomap_write_actor);
 		if (ret <= 0)
 			break;
 		pos += ret;
@@ -997,7 +1062,7 @@ iomap_page_mkwrite_actor(struct inode *inode, loff_t pos, loff_t length,
 		block_commit_write(page, 0, length);
 	} else {
 		WARN_ON_ONCE(!PageUptodate(page));
-		iomap_page_create(inode, page);
+		iomap_page_create(inode, page, 0);
 		set_page_dirty(page);
 	}
 
@@ -479,10 +479,98 @@ void nfs_force_use_readdirplus(struct inode *dir)
 	}
 }
 
+/*
+ * Small regular files found by READDIRPLUS may have their contents read
+ * ahead, so that a "readdir then open everything" workload does not pay a
+ * full round trip per file.  nfs_readdir_prefetch_size is the largest file
+ * size that will be prefetched (0 disables prefetching) and
+ * nfs_readdir_prefetch_window bounds the number of prefetches in flight
+ * per mount.
+ */
+static unsigned int nfs_readdir_prefetch_size;
+module_param(nfs_readdir_prefetch_size, uint, 0644);
+MODULE_PARM_DESC(nfs_readdir_prefetch_size,
+		 "Largest file read ahead from a READDIRPLUS reply (0 = off)");
+static unsigned int nfs_readdir_prefetch_window = 32;
+module_param(nfs_readdir_prefetch_window, uint, 0644);
+MODULE_PARM_DESC(nfs_readdir_prefetch_window,
+		 "Maximum READDIRPLUS prefetches in flight per mount");
+
+struct nfs_readdir_prefetch {
+	struct work_struct work;
+	struct nfs_open_context *ctx;
+};
+
+static void nfs_readdir_prefetch_work(struct work_struct *work)
+{
+	struct nfs_readdir_prefetch *p =
+		container_of(work, struct nfs_readdir_prefetch, work);
+	struct nfs_open_context *ctx = p->ctx;
+	struct inode *inode = d_inode(ctx->dentry);
+	struct nfs_server *server = NFS_SERVER(inode);
+	struct file_ra_state ra;
+	loff_t size = i_size_read(inode);
+
+	/*
+	 * Make the context visible to nfs_find_open_context() so that
+	 * ->readahead() can find a credential without a struct file.
+	 */
+	nfs_inode_attach_open_context(ctx);
+	file_ra_state_init(&ra, inode->i_mapping);
+	if (size > 0 && inode->i_mapping->nrpages == 0)
+		page_cache_sync_readahead(inode->i_mapping, &ra, NULL, 0,
+					  DIV_ROUND_UP(size, PAGE_SIZE));
+	/* the context may hold the last reference keeping server alive */
+	atomic_dec(&server->readdir_prefetch);
+	put_nfs_open_context(ctx);
+	kfree(p);
+}
+
+static void nfs_readdir_prefetch(struct file *dir, struct dentry *dentry)
+{
+	struct inode *inode = d_inode(dentry);
+	struct nfs_server *server;
+	struct nfs_readdir_prefetch *p;
+	struct nfs_open_context *ctx;
+	loff_t size;
+
+	if (!inode || !S_ISREG(inode->i_mode))
+		return;
+	/* NFSv4 READ needs open state, which we do not have here */
+	if (NFS_PROTO(inode)->version > 3)
+		return;
+	size = i_size_read(inode);
+	if (size == 0 || size > nfs_readdir_prefetch_size)
+		return;
+	if (inode->i_mapping->nrpages != 0)
+		return;
+	server = NFS_SERVER(inode);
+	if (atomic_inc_return(&server->readdir_prefetch) >
+	    nfs_readdir_prefetch_window)
+		goto out_dec;
+
+	p = kmalloc(sizeof(*p), GFP_KERNEL);
+	if (!p)
+		goto out_dec;
+	/* Read with the credential of whoever is listing the directory */
+	ctx = alloc_nfs_open_context(dentry, FMODE_READ, dir);
+	if (IS_ERR(ctx)) {
+		kfree(p);
+		goto out_dec;
+	}
+	p->ctx = ctx;
+	INIT_WORK(&p->work, nfs_readdir_prefetch_work);
+	queue_work(nfsiod_workqueue, &p->work);
+	return;
+out_dec:
+	atomic_dec(&server->readdir_prefetch);
+}
+
 static
-void nfs_prime_dcache(struct dentry *parent, struct nfs_entry *entry,
+void nfs_prime_dcache(struct file *file, struct nfs_entry *entry,
 		unsigned long dir_verifier)
 {
+	struct dentry *parent = file_dentry(file);
 	struct qstr filename = QSTR_INIT(entry->name, entry->len);
 	DECLARE_WAIT_QUEUE_HEAD_ONSTACK(wq);
 	struct dentry *dentry;
@@ -552,6 +640,8 @@ void nfs_prime_dcache(struct dentry *parent, struct nfs_entry *entry,
 		dentry = alias;
 	}
 	nfs_set_verifier(dentry, dir_verifier);
+	if (nfs_readdir_prefetch_size)
+		nfs_readdir_prefetch(file, dentry);
 out:
 	dput(dentry);
 }
@@ -592,7 +682,7 @@ int nfs_readdir_page_filler(nfs_readdir_descriptor_t *desc, struct nfs_entry *en
 		count++;
 
 		if (desc->plus)
-			nfs_prime_dcache(file_dentry(desc->file), entry,
+			nfs_prime_dcache(desc->file, entry,
 					desc->dir_verifier);
 
 		status = nfs_readdir_add_to_array(entry, page);
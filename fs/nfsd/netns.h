@@ -20,6 +20,7 @@
 
 struct cld_net;
 struct nfsd4_client_tracking_ops;
+struct nfsd_pool_scale;
 
 /*
  * Represents a nfsd "container". With respect to nfsv4 state tracking, the
@@ -112,6 +113,15 @@ struct nfsd_net {
 	 */
 	unsigned int max_connections;
 
+	/*
+	 * Upper bound on the number of threads the server may scale up to
+	 * under load. Defaults to '0' which disables scaling, so the thread
+	 * count stays what was written to 'threads' or 'pool_threads'.
+	 */
+	unsigned int max_threads;
+	struct nfsd_pool_scale *pool_scale;
+	struct delayed_work scale_work;
+
 	u32 clientid_base;
 	u32 clientid_counter;
 	u32 clverifier_counter;
@@ -605,6 +605,121 @@ bool i_am_nfsd(void)
 	return kthread_func(current) == nfsd;
 }
 
+/*
+ * Thread scaling
+ *
+ * While nn->max_threads is set, nfsd_scale_work() samples each pool every
+ * NFSD_SCALE_INTERVAL.  Transports that were enqueued without finding an
+ * idle thread (packets that did not wake a thread) mean the pool is short
+ * of threads, and up to NFSD_SCALE_STEP are added.  A pool that went
+ * NFSD_SCALE_IDLE intervals without such misses gives back one thread,
+ * down to the count last set by the administrator.
+ */
+#define NFSD_SCALE_INTERVAL	HZ
+#define NFSD_SCALE_STEP		4
+#define NFSD_SCALE_IDLE		30
+
+struct nfsd_pool_scale {
+	unsigned int	floor;
+	unsigned int	idle;
+	unsigned long	packets;
+	unsigned long	woken;
+};
+
+static void nfsd_scale_set_floor(struct nfsd_net *nn)
+{
+	struct svc_serv *serv = nn->nfsd_serv;
+	unsigned int i;
+
+	if (!nn->pool_scale)
+		return;
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		nn->pool_scale[i].floor = serv->sv_pools[i].sp_nrthreads;
+		nn->pool_scale[i].idle = 0;
+	}
+}
+
+static void nfsd_scale_pool(struct svc_serv *serv, struct svc_pool *pool,
+			    struct nfsd_pool_scale *ps, unsigned int max)
+{
+	unsigned long packets = atomic_long_read(&pool->sp_stats.packets);
+	unsigned long woken = atomic_long_read(&pool->sp_stats.threads_woken);
+	long missed = (long)((packets - ps->packets) - (woken - ps->woken));
+	unsigned int nr = pool->sp_nrthreads;
+	unsigned int target = nr;
+
+	ps->packets = packets;
+	ps->woken = woken;
+
+	if (missed > 0) {
+		ps->idle = 0;
+		if (nr < max)
+			target = min_t(unsigned int, max,
+				       nr + min_t(long, missed, NFSD_SCALE_STEP));
+	} else if (nr > ps->floor && ++ps->idle >= NFSD_SCALE_IDLE) {
+		ps->idle = 0;
+		target = nr - 1;
+	}
+
+	if (target != nr)
+		serv->sv_ops->svo_setup(serv, pool, target);
+}
+
+void nfsd_scale_work(struct work_struct *work)
+{
+	struct nfsd_net *nn = container_of(to_delayed_work(work),
+					   struct nfsd_net, scale_work);
+	struct svc_serv *serv;
+	unsigned int max, i;
+
+	/* nfsd_destroy() may be waiting for us with nfsd_mutex held */
+	if (!mutex_trylock(&nfsd_mutex))
+		goto out_rearm;
+
+	serv = nn->nfsd_serv;
+	if (!serv || !nn->max_threads || !nn->pool_scale) {
+		mutex_unlock(&nfsd_mutex);
+		return;
+	}
+
+	max = DIV_ROUND_UP(nn->max_threads, serv->sv_nrpools);
+	for (i = 0; i < serv->sv_nrpools; i++)
+		nfsd_scale_pool(serv, &serv->sv_pools[i], &nn->pool_scale[i],
+				max);
+	mutex_unlock(&nfsd_mutex);
+out_rearm:
+	schedule_delayed_work(&nn->scale_work, NFSD_SCALE_INTERVAL);
+}
+
+void nfsd_scale_start(struct nfsd_net *nn)
+{
+	WARN_ON(!mutex_is_locked(&nfsd_mutex));
+
+	if (nn->nfsd_serv && nn->max_threads && nn->pool_scale)
+		schedule_delayed_work(&nn->scale_work, NFSD_SCALE_INTERVAL);
+}
+
+static void nfsd_scale_init(struct nfsd_net *nn)
+{
+	struct svc_serv *serv = nn->nfsd_serv;
+	unsigned int i;
+
+	/* Without it the server simply runs with a fixed thread count */
+	nn->pool_scale = kcalloc(serv->sv_nrpools, sizeof(*nn->pool_scale),
+				 GFP_KERNEL);
+	if (!nn->pool_scale)
+		return;
+
+	for (i = 0; i < serv->sv_nrpools; i++) {
+		struct svc_pool *pool = &serv->sv_pools[i];
+
+		nn->pool_scale[i].packets =
+			atomic_long_read(&pool->sp_stats.packets);
+		nn->pool_scale[i].woken =
+			atomic_long_read(&pool->sp_stats.threads_woken);
+	}
+}
+
 int nfsd_create_serv(struct net *net)
 {
 	int error;
@@ -630,6 +745,7 @@ int nfsd_create_serv(struct net *net)
 		return error;
 	}
 
+	nfsd_scale_init(nn);
 	set_max_drc();
 	/* check if the notifier is already set */
 	if (atomic_inc_return(&nfsd_notifier_refcount) == 1) {
@@ -674,8 +790,12 @@ void nfsd_destroy(struct net *net)
 	if (destroy)
 		svc_shutdown_net(nn->nfsd_serv, net);
 	svc_destroy(nn->nfsd_serv);
-	if (destroy)
+	if (destroy) {
 		nn->nfsd_serv = NULL;
+		kfree(nn->pool_scale);
+		nn->pool_scale = NULL;
+		cancel_delayed_work(&nn->scale_work);
+	}
 }
 
 int nfsd_set_nrthreads(int n, int *nthreads, struct net *net)
@@ -727,6 +847,7 @@ int nfsd_set_nrthreads(int n, int *nthreads, struct net *net)
 		if (err)
 			break;
 	}
+	nfsd_scale_set_floor(nn);
 	nfsd_destroy(net);
 	return err;
 }
@@ -769,6 +890,8 @@ nfsd_svc(int nrservs, struct net *net, const struct cred *cred)
 			NULL, nrservs);
 	if (error)
 		goto out_shutdown;
+	nfsd_scale_set_floor(nn);
+	nfsd_scale_start(nn);
 	/* We are holding a reference to nn->nfsd_serv which
 	 * we don't want to count in the return value,
 	 * so subtract 1
@@ -3,6 +3,7 @@
 #include <linux/path.h>
 #include <linux/slab.h>
 #include <linux/exportfs.h>
+#include <linux/hash.h>
 
 extern struct kmem_cache *fanotify_mark_cache;
 extern struct kmem_cache *fanotify_fid_event_cachep;
@@ -139,7 +140,9 @@ enum fanotify_event_type {
 
 struct fanotify_event {
 	struct fsnotify_event fse;
+	struct hlist_node merge_list;	/* List for hashed merge */
 	u32 mask;
+	u32 hash;			/* Hash of the fields compared on merge */
 	enum fanotify_event_type type;
 	struct pid *pid;
 };
@@ -148,7 +151,9 @@ static inline void fanotify_init_event(struct fanotify_event *event,
 				       unsigned long id, u32 mask)
 {
 	fsnotify_init_event(&event->fse, id);
+	INIT_HLIST_NODE(&event->merge_list);
 	event->mask = mask;
+	event->hash = 0;
 	event->pid = NULL;
 }
 
@@ -269,6 +274,37 @@ static inline struct fanotify_event *FANOTIFY_E(struct fsnotify_event *fse)
 	return container_of(fse, struct fanotify_event, fse);
 }
 
+/*
+ * Queued events are hashed by the fields fanotify_should_merge() compares,
+ * so a new event only needs to be checked against its own bucket instead of
+ * the tail of the whole queue.
+ */
+#define FANOTIFY_HTABLE_BITS	(7)
+#define FANOTIFY_HTABLE_SIZE	(1 << FANOTIFY_HTABLE_BITS)
+
+/* Permission and overflow events are never merged, so never hashed */
+static inline bool fanotify_is_hashed_event(u32 mask)
+{
+	return !fanotify_is_perm_event(mask) && !(mask & FS_Q_OVERFLOW);
+}
+
+static inline struct hlist_head *
+fanotify_event_hash_bucket(struct fsnotify_group *group,
+			   struct fanotify_event *event)
+{
+	return &group->fanotify_data.merge_hash[hash_32(event->hash,
+						FANOTIFY_HTABLE_BITS)];
+}
+
+static inline void fanotify_unhash_event(struct fsnotify_group *group,
+					 struct fanotify_event *event)
+{
+	assert_spin_locked(&group->notification_lock);
+
+	if (fanotify_is_hashed_event(event->mask))
+		hlist_del_init(&event->merge_list);
+}
+
 static inline bool fanotify_event_has_path(struct fanotify_event *event)
 {
 	return event->type == FANOTIFY_EVENT_TYPE_PATH ||
@@ -24,6 +24,17 @@ struct ovl_aio_req {
 
 static struct kmem_cache *ovl_aio_request_cachep;
 
+/*
+ * Regular files opened for write on a lower inode are not copied up at open
+ * time, see ovl_open().  Until the first modification @realfile is the lower
+ * file opened read-only; once the inode is copied up, @upperfile caches the
+ * upper file so that each operation does not have to reopen it.
+ */
+struct ovl_file {
+	struct file *realfile;
+	struct file *upperfile;
+};
+
 static char ovl_whatisit(struct inode *inode, struct inode *realinode)
 {
 	if (realinode != ovl_inode_upper(inode))
@@ -37,13 +48,13 @@ static char ovl_whatisit(struct inode *inode, struct inode *realinode)
 /* No atime modificaton nor notify on underlying */
 #define OVL_OPEN_FLAGS (O_NOATIME | FMODE_NONOTIFY)
 
-static struct file *ovl_open_realfile(const struct file *file,
-				      struct inode *realinode)
+static struct file *__ovl_open_realfile(const struct file *file,
+					struct inode *realinode,
+					unsigned int flags)
 {
 	struct inode *inode = file_inode(file);
 	struct file *realfile;
 	const struct cred *old_cred;
-	int flags = file->f_flags | OVL_OPEN_FLAGS;
 	int acc_mode = ACC_MODE(flags);
 	int err;
 
@@ -69,6 +80,13 @@ static struct file *ovl_open_realfile(const struct file *file,
 	return realfile;
 }
 
+static struct file *ovl_open_realfile(const struct file *file,
+				      struct inode *realinode)
+{
+	return __ovl_open_realfile(file, realinode,
+				   file->f_flags | OVL_OPEN_FLAGS);
+}
+
 #define OVL_SETFL_MASK (O_APPEND | O_NONBLOCK | O_NDELAY | O_DIRECT)
 
 static int ovl_change_flags(struct file *file, unsigned int flags)
@@ -78,8 +96,11 @@ static int ovl_change_flags(struct file *file, unsigned int flags)
 
 	flags |= OVL_OPEN_FLAGS;
 
-	/* If some flag changed that cannot be changed then something's amiss */
-	if (WARN_ON((file->f_flags ^ flags) & ~OVL_SETFL_MASK))
+	/*
+	 * If some flag changed that cannot be changed then something's amiss.
+	 * The access mode differs on a lazily opened lower file.
+	 */
+	if (WARN_ON((file->f_flags ^ flags) & ~(OVL_SETFL_MASK | O_ACCMODE)))
 		return -EIO;
 
 	flags &= OVL_SETFL_MASK;
@@ -106,14 +127,38 @@ static int ovl_change_flags(struct file *file, unsigned int flags)
 	return 0;
 }
 
+static struct file *ovl_upper_file(const struct file *file,
+				   struct inode *upperinode)
+{
+	struct ovl_file *of = file->private_data;
+	struct file *upperfile = READ_ONCE(of->upperfile);
+	struct file *old;
+
+	if (upperfile)
+		return upperfile;
+
+	upperfile = ovl_open_realfile(file, upperinode);
+	if (IS_ERR(upperfile))
+		return upperfile;
+
+	old = cmpxchg_release(&of->upperfile, NULL, upperfile);
+	if (old) {
+		fput(upperfile);
+		upperfile = old;
+	}
+
+	return upperfile;
+}
+
 static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 			       bool allow_meta)
 {
 	struct inode *inode = file_inode(file);
+	struct ovl_file *of = file->private_data;
 	struct inode *realinode;
 
 	real->flags = 0;
-	real->file = file->private_data;
+	real->file = of->realfile;
 
 	if (allow_meta)
 		realinode = ovl_inode_real(inode);
@@ -122,14 +167,21 @@ static int ovl_real_fdget_meta(const struct file *file, struct fd *real,
 
 	/* Has it been copied up since we'd opened it? */
 	if (unlikely(file_inode(real->file) != realinode)) {
-		real->flags = FDPUT_FPUT;
-		real->file = ovl_open_realfile(file, realinode);
-
-		return PTR_ERR_OR_ZERO(real->file);
+		if (realinode == ovl_inode_upper(inode)) {
+			real->file = ovl_upper_file(file, realinode);
+			if (IS_ERR(real->file))
+				return PTR_ERR(real->file);
+		} else {
+			real->flags = FDPUT_FPUT;
+			real->file = ovl_open_realfile(file, realinode);
+
+			return PTR_ERR_OR_ZERO(real->file);
+		}
 	}
 
 	/* Did the flags change since open? */
-	if (unlikely((file->f_flags ^ real->file->f_flags) & ~OVL_OPEN_FLAGS))
+	if (unlikely((file->f_flags ^ real->file->f_flags) &
+		     ~(OVL_OPEN_FLAGS | O_ACCMODE)))
 		return ovl_change_flags(real->file, file->f_flags);
 
 	return 0;
@@ -147,30 +199,84 @@ static int ovl_real_fdget(const struct file *file, struct fd *real)
 	return ovl_real_fdget_meta(file, real, false);
 }
 
-static int ovl_open(struct inode *inode, struct file *file)
+/*
+ * Like ovl_real_fdget(), for operations that modify the file data: finish
+ * the copy-up that ovl_open() deferred.
+ */
+static int ovl_real_fdget_write(const struct file *file, struct fd *real)
 {
-	struct file *realfile;
 	int err;
 
 	err = ovl_maybe_copy_up(file_dentry(file), file->f_flags);
 	if (err)
 		return err;
 
+	return ovl_real_fdget(file, real);
+}
+
+/*
+ * Many programs open files read-write and never write to them.  Copying up
+ * the whole file for those is wasted work, so regular files opened for write
+ * without O_TRUNC are read from the lower layer until they are modified.
+ */
+static bool ovl_open_lazy(struct dentry *dentry, unsigned int flags)
+{
+	if (!d_is_reg(dentry) || (flags & O_TRUNC))
+		return false;
+
+	if (!(OPEN_FMODE(flags) & FMODE_WRITE))
+		return false;
+
+	return !ovl_already_copied_up(dentry, flags);
+}
+
+static int ovl_open(struct inode *inode, struct file *file)
+{
+	struct dentry *dentry = file_dentry(file);
+	struct ovl_file *of;
+	struct file *realfile;
+	unsigned int flags;
+	bool lazy;
+	int err;
+
+	lazy = ovl_open_lazy(dentry, file->f_flags);
+	if (!lazy) {
+		err = ovl_maybe_copy_up(dentry, file->f_flags);
+		if (err)
+			return err;
+	}
+
 	/* No longer need these flags, so don't pass them on to underlying fs */
 	file->f_flags &= ~(O_CREAT | O_EXCL | O_NOCTTY | O_TRUNC);
 
-	realfile = ovl_open_realfile(file, ovl_inode_realdata(inode));
-	if (IS_ERR(realfile))
+	of = kzalloc(sizeof(*of), GFP_KERNEL);
+	if (!of)
+		return -ENOMEM;
+
+	flags = file->f_flags | OVL_OPEN_FLAGS;
+	if (lazy)
+		flags = (flags & ~O_ACCMODE) | O_RDONLY;
+
+	realfile = __ovl_open_realfile(file, ovl_inode_realdata(inode), flags);
+	if (IS_ERR(realfile)) {
+		kfree(of);
 		return PTR_ERR(realfile);
+	}
 
-	file->private_data = realfile;
+	of->realfile = realfile;
+	file->private_data = of;
 
 	return 0;
 }
 
 static int ovl_release(struct inode *inode, struct file *file)
 {
-	fput(file->private_data);
+	struct ovl_file *of = file->private_data;
+
+	if (of->upperfile)
+		fput(of->upperfile);
+	fput(of->realfile);
+	kfree(of);
 
 	return 0;
 }
@@ -360,15 +466,15 @@ static ssize_t ovl_write_iter(struct kiocb *iocb, struct iov_iter *iter)
 		return 0;
 
 	inode_lock(inode);
-	/* Update mode */
-	ovl_copyattr(ovl_inode_real(inode), inode);
-	ret = file_remove_privs(file);
+	ret = ovl_real_fdget_write(file, &real);
 	if (ret)
 		goto out_unlock;
 
-	ret = ovl_real_fdget(file, &real);
+	/* Update mode */
+	ovl_copyattr(ovl_inode_real(inode), inode);
+	ret = file_remove_privs(file);
 	if (ret)
-		goto out_unlock;
+		goto out_fdput;
 
 	ret = -EINVAL;
 	if (iocb->ki_flags & IOCB_DIRECT &&
@@ -436,19 +542,22 @@ static ssize_t ovl_splice_write(struct pipe_inode_info *pipe, struct file *out,
 	struct fd real;
 	const struct cred *old_cred;
 	struct inode *inode = file_inode(out);
-	struct inode *realinode = ovl_inode_real(inode);
+	struct inode *realinode;
 	ssize_t ret;
 
 	inode_lock(inode);
-	/* Update mode */
-	ovl_copyattr(realinode, inode);
-	ret = file_remove_privs(out);
+	ret = ovl_real_fdget_write(out, &real);
 	if (ret)
 		goto out_unlock;
 
-	ret = ovl_real_fdget(out, &real);
-	if (ret)
+	/* Update mode */
+	realinode = ovl_inode_real(inode);
+	ovl_copyattr(realinode, inode);
+	ret = file_remove_privs(out);
+	if (ret) {
+		fdput(real);
 		goto out_unlock;
+	}
 
 	old_cred = ovl_override_creds(inode->i_sb);
 	file_start_write(real.file);
@@ -495,17 +604,31 @@ static int ovl_fsync(struct file *file, loff_t start, loff_t end, int datasync)
 
 static int ovl_mmap(struct file *file, struct vm_area_struct *vma)
 {
-	struct file *realfile = file->private_data;
+	struct file *realfile;
+	struct fd real;
 	const struct cred *old_cred;
 	int ret;
 
-	if (!realfile->f_op->mmap)
-		return -ENODEV;
-
 	if (WARN_ON(file != vma->vm_file))
 		return -EIO;
 
-	vma->vm_file = get_file(realfile);
+	/* A shared mapping may be written to, copy up now */
+	if ((vma->vm_flags & VM_SHARED) && (vma->vm_flags & VM_MAYWRITE))
+		ret = ovl_real_fdget_write(file, &real);
+	else
+		ret = ovl_real_fdget(file, &real);
+	if (ret)
+		return ret;
+
+	realfile = get_file(real.file);
+	fdput(real);
+
+	if (!realfile->f_op->mmap) {
+		fput(realfile);
+		return -ENODEV;
+	}
+
+	vma->vm_file = realfile;
 
 	old_cred = ovl_override_creds(file_inode(file)->i_sb);
 	ret = call_mmap(vma->vm_file, vma);
@@ -531,7 +654,7 @@ static long ovl_fallocate(struct file *file, int mode, loff_t offset, loff_t len
 	const struct cred *old_cred;
 	int ret;
 
-	ret = ovl_real_fdget(file, &real);
+	ret = ovl_real_fdget_write(file, &real);
 	if (ret)
 		return ret;
 
@@ -687,7 +810,7 @@ static loff_t ovl_copyfile(struct file *file_in, loff_t pos_in,
 	const struct cred *old_cred;
 	loff_t ret;
 
-	ret = ovl_real_fdget(file_out, &real_out);
+	ret = ovl_real_fdget_write(file_out, &real_out);
 	if (ret)
 		return ret;
 
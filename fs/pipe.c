@@ -58,6 +58,14 @@ unsigned int pipe_max_size = 1048576;
 unsigned long pipe_user_pages_hard;
 unsigned long pipe_user_pages_soft = PIPE_DEF_BUFFERS * INR_OPEN_CUR;
 
+/*
+ * Order of the compound pages used for large writes into stream pipes,
+ * so that each ring slot carries more than a single page of data. Zero
+ * (the default) keeps order-0 buffers. Can be set by root in
+ * /proc/sys/fs/pipe-page-order
+ */
+unsigned int pipe_page_order;
+
 /*
  * We use head and tail indices that aren't masked off, except at the point of
  * dereference, but rather they're allowed to wrap naturally.  This means there
@@ -131,7 +139,7 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page && !PageCompound(page))
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -142,7 +150,11 @@ static bool anon_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) != 1)
+	/*
+	 * Stealers such as fuse and splice into the page cache expect a
+	 * single page; large write buffers stay with the pipe.
+	 */
+	if (page_count(page) != 1 || PageCompound(page))
 		return false;
 	memcg_kmem_uncharge_page(page, 0);
 	__SetPageLocked(page);
@@ -399,6 +411,47 @@ static inline int is_packetized(struct file *file)
 	return (file->f_flags & O_DIRECT) != 0;
 }
 
+/*
+ * Back a write that fills at least a whole pipe_page_order page with a
+ * compound page.  Packet mode keeps one PIPE_BUF sized packet per buffer.
+ * These come from lowmem so that splice consumers can address the whole
+ * buffer through page_address() as they do for order-0 pages.
+ *
+ * user->pipe_bufs counts pages, so before its slots may hold 1 << order
+ * pages each the pipe accounts for that many, within the same limits as
+ * F_SETPIPE_SZ.  Called with the pipe locked.
+ */
+static struct page *pipe_alloc_large_page(struct pipe_inode_info *pipe,
+					  struct file *filp, size_t len)
+{
+	unsigned int order = READ_ONCE(pipe_page_order);
+	unsigned long pages, user_bufs;
+
+	if (!order || is_packetized(filp) || len < (PAGE_SIZE << order))
+		return NULL;
+
+	pages = (unsigned long)pipe->max_usage << order;
+	if (pipe->nr_accounted < pages) {
+		if (pages * PAGE_SIZE > READ_ONCE(pipe_max_size) &&
+		    !capable(CAP_SYS_RESOURCE))
+			return NULL;
+
+		user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted,
+						 pages);
+		if ((too_many_pipe_buffers_hard(user_bufs) ||
+		     too_many_pipe_buffers_soft(user_bufs)) &&
+		    pipe_is_unprivileged_user()) {
+			(void) account_pipe_buffers(pipe->user, pages,
+						    pipe->nr_accounted);
+			return NULL;
+		}
+		pipe->nr_accounted = pages;
+	}
+
+	return alloc_pages(GFP_KERNEL | __GFP_ACCOUNT | __GFP_COMP |
+			   __GFP_NOWARN | __GFP_NORETRY, order);
+}
+
 /* Done while waiting without holding the pipe lock - thus the READ_ONCE() */
 static inline bool pipe_writable(const struct pipe_inode_info *pipe)
 {
@@ -458,7 +511,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 		int offset = buf->offset + buf->len;
 
 		if ((buf->flags & PIPE_BUF_FLAG_CAN_MERGE) &&
-		    offset + chars <= PAGE_SIZE) {
+		    offset + chars <= page_size(buf->page)) {
 			ret = pipe_buf_confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -488,9 +541,15 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			unsigned int mask = pipe->ring_size - 1;
 			struct pipe_buffer *buf = &pipe->bufs[head & mask];
 			struct page *page = pipe->tmp_page;
+			struct page *large;
+			size_t size;
 			int copied;
 
-			if (!page) {
+			large = pipe_alloc_large_page(pipe, filp,
+						      iov_iter_count(from));
+			if (large) {
+				page = large;
+			} else if (!page) {
 				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
@@ -509,6 +568,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			head = pipe->head;
 			if (pipe_full(head, pipe->tail, pipe->max_usage)) {
 				spin_unlock_irq(&pipe->rd_wait.lock);
+				if (large)
+					put_page(large);
 				continue;
 			}
 
@@ -525,10 +586,12 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_PACKET;
 			else
 				buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
-			pipe->tmp_page = NULL;
+			if (!large)
+				pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			size = page_size(page);
+			copied = copy_page_from_iter(page, 0, size, from);
+			if (unlikely(copied < size && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -56,6 +56,15 @@ static int seq_show(struct seq_file *m, void *v)
 	seq_printf(m, "pos:\t%lli\nflags:\t0%o\nmnt_id:\t%i\n",
 		   (long long)file->f_pos, f_flags,
 		   real_mount(file->f_path.mnt)->mnt_id);
+#ifdef CONFIG_BPF_READAHEAD
+	if (S_ISREG(file_inode(file)->i_mode)) {
+		struct ra_stats *stats = &file->f_mapping->ra_stats;
+
+		seq_printf(m, "ra_sync:\t%lu\nra_async:\t%lu\nra_policy:\t%lu\nra_pages:\t%lu\n",
+			   READ_ONCE(stats->sync), READ_ONCE(stats->async),
+			   READ_ONCE(stats->policy), READ_ONCE(stats->pages));
+	}
+#endif
 
 	show_fd_locks(m, file, files);
 	if (seq_has_overflowed(m))
@@ -32,9 +32,9 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 	unsigned long text, lib, swap, anon, file, shmem;
 	unsigned long hiwater_vm, total_vm, hiwater_rss, total_rss;
 
-	anon = get_mm_counter(mm, MM_ANONPAGES);
-	file = get_mm_counter(mm, MM_FILEPAGES);
-	shmem = get_mm_counter(mm, MM_SHMEMPAGES);
+	anon = get_mm_counter_sum(mm, MM_ANONPAGES);
+	file = get_mm_counter_sum(mm, MM_FILEPAGES);
+	shmem = get_mm_counter_sum(mm, MM_SHMEMPAGES);
 
 	/*
 	 * Note: to minimize their overhead, mm maintains hiwater_vm and
@@ -55,7 +55,7 @@ void task_mem(struct seq_file *m, struct mm_struct *mm)
 	text = min(text, mm->exec_vm << PAGE_SHIFT);
 	lib = (mm->exec_vm << PAGE_SHIFT) - text;
 
-	swap = get_mm_counter(mm, MM_SWAPENTS);
+	swap = get_mm_counter_sum(mm, MM_SWAPENTS);
 	SEQ_PUT_DEC("VmPeak:\t", hiwater_vm);
 	SEQ_PUT_DEC(" kB\nVmSize:\t", total_vm);
 	SEQ_PUT_DEC(" kB\nVmLck:\t", mm->locked_vm);
@@ -88,12 +88,12 @@ unsigned long task_statm(struct mm_struct *mm,
 			 unsigned long *shared, unsigned long *text,
 			 unsigned long *data, unsigned long *resident)
 {
-	*shared = get_mm_counter(mm, MM_FILEPAGES) +
-			get_mm_counter(mm, MM_SHMEMPAGES);
+	*shared = get_mm_counter_sum(mm, MM_FILEPAGES) +
+			get_mm_counter_sum(mm, MM_SHMEMPAGES);
 	*text = (PAGE_ALIGN(mm->end_code) - (mm->start_code & PAGE_MASK))
 								>> PAGE_SHIFT;
 	*data = mm->data_vm + mm->stack_vm;
-	*resident = *shared + get_mm_counter(mm, MM_ANONPAGES);
+	*resident = *shared + get_mm_counter_sum(mm, MM_ANONPAGES);
 	return mm->total_vm;
 }
 
@@ -647,6 +647,9 @@ static void show_smap_vma_flags(struct seq_file *m, struct vm_area_struct *vma)
 		[ilog2(VM_MERGEABLE)]	= "mg",
 		[ilog2(VM_UFFD_MISSING)]= "um",
 		[ilog2(VM_UFFD_WP)]	= "uw",
+#ifdef CONFIG_HAVE_ARCH_USERFAULTFD_MINOR
+		[ilog2(VM_UFFD_MINOR)]	= "ui",
+#endif /* CONFIG_HAVE_ARCH_USERFAULTFD_MINOR */
 #ifdef CONFIG_ARM64_MTE
 		[ilog2(VM_MTE)]		= "mt",
 		[ilog2(VM_MTE_ALLOWED)]	= "",
@@ -1252,6 +1255,7 @@ static ssize_t clear_refs_write(struct file *file, const char __user *buf,
 			for (vma = mm->mmap; vma; vma = vma->vm_next) {
 				if (!(vma->vm_flags & VM_SOFTDIRTY))
 					continue;
+				vma_start_write(vma);
 				vma->vm_flags &= ~VM_SOFTDIRTY;
 				vma_set_page_prot(vma);
 			}
@@ -1301,6 +1305,7 @@ struct pagemapread {
 #define PM_PFRAME_MASK		GENMASK_ULL(PM_PFRAME_BITS - 1, 0)
 #define PM_SOFT_DIRTY		BIT_ULL(55)
 #define PM_MMAP_EXCLUSIVE	BIT_ULL(56)
+#define PM_UFFD_WP		BIT_ULL(57)
 #define PM_FILE			BIT_ULL(61)
 #define PM_SWAP			BIT_ULL(62)
 #define PM_PRESENT		BIT_ULL(63)
@@ -1374,10 +1379,14 @@ static pagemap_entry_t pte_to_pagemap_entry(struct pagemapread *pm,
 		page = vm_normal_page(vma, addr, pte);
 		if (pte_soft_dirty(pte))
 			flags |= PM_SOFT_DIRTY;
+		if (pte_uffd_wp(pte))
+			flags |= PM_UFFD_WP;
 	} else if (is_swap_pte(pte)) {
 		swp_entry_t entry;
 		if (pte_swp_soft_dirty(pte))
 			flags |= PM_SOFT_DIRTY;
+		if (pte_swp_uffd_wp(pte))
+			flags |= PM_UFFD_WP;
 		entry = pte_to_swp_entry(pte);
 		if (pm->show_pfn)
 			frame = swp_type(entry) |
@@ -1425,6 +1434,8 @@ static int pagemap_pmd_range(pmd_t *pmdp, unsigned long addr, unsigned long end,
 			flags |= PM_PRESENT;
 			if (pmd_soft_dirty(pmd))
 				flags |= PM_SOFT_DIRTY;
+			if (pmd_uffd_wp(pmd))
+				flags |= PM_UFFD_WP;
 			if (pm->show_pfn)
 				frame = pmd_pfn(pmd) +
 					((addr & ~PMD_MASK) >> PAGE_SHIFT);
@@ -1443,6 +1454,8 @@ static int pagemap_pmd_range(pmd_t *pmdp, unsigned long addr, unsigned long end,
 			flags |= PM_SWAP;
 			if (pmd_swp_soft_dirty(pmd))
 				flags |= PM_SOFT_DIRTY;
+			if (pmd_swp_uffd_wp(pmd))
+				flags |= PM_UFFD_WP;
 			VM_BUG_ON(!is_pmd_migration_entry(pmd));
 			page = migration_entry_to_page(entry);
 		}
@@ -1682,11 +1695,402 @@ static int pagemap_release(struct inode *inode, struct file *file)
 	return 0;
 }
 
+#define PM_SCAN_CATEGORIES	(PAGE_IS_FILE | PAGE_IS_PRESENT | PAGE_IS_SWAPPED | \
+				 PAGE_IS_PFNZERO | PAGE_IS_HUGE | PAGE_IS_SOFT_DIRTY)
+#define PM_SCAN_FLAGS		(PM_SCAN_CLEAR_SOFT_DIRTY)
+#define PM_SCAN_BUFFER_LEN	512	/* regions collected per mmap_lock hold */
+
+struct pagemap_scan_private {
+	struct pm_scan_arg arg;
+	struct page_region *vec_buf;
+	unsigned long vec_buf_len, vec_buf_index;
+	unsigned long found_pages, walk_end;
+};
+
+static unsigned long pagemap_page_category(struct vm_area_struct *vma,
+					   unsigned long addr, pte_t pte)
+{
+	unsigned long categories = 0;
+
+	if (pte_present(pte)) {
+		struct page *page;
+
+		categories |= PAGE_IS_PRESENT;
+		if (pte_soft_dirty(pte))
+			categories |= PAGE_IS_SOFT_DIRTY;
+		if (is_zero_pfn(pte_pfn(pte)))
+			categories |= PAGE_IS_PFNZERO;
+		page = vm_normal_page(vma, addr, pte);
+		if (page && !PageAnon(page))
+			categories |= PAGE_IS_FILE;
+	} else if (is_swap_pte(pte)) {
+		categories |= PAGE_IS_SWAPPED;
+		if (pte_swp_soft_dirty(pte))
+			categories |= PAGE_IS_SOFT_DIRTY;
+	}
+
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+
+	return categories;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static unsigned long pagemap_thp_category(struct vm_area_struct *vma,
+					  pmd_t pmd)
+{
+	unsigned long categories = PAGE_IS_HUGE;
+
+	if (pmd_present(pmd)) {
+		categories |= PAGE_IS_PRESENT;
+		if (pmd_soft_dirty(pmd))
+			categories |= PAGE_IS_SOFT_DIRTY;
+		if (is_huge_zero_pmd(pmd))
+			categories |= PAGE_IS_PFNZERO;
+		else if (!PageAnon(pmd_page(pmd)))
+			categories |= PAGE_IS_FILE;
+	} else if (is_swap_pmd(pmd)) {
+		categories |= PAGE_IS_SWAPPED;
+		if (pmd_swp_soft_dirty(pmd))
+			categories |= PAGE_IS_SOFT_DIRTY;
+	}
+
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+
+	return categories;
+}
+#endif
+
+static bool pagemap_scan_is_interesting(const struct pagemap_scan_private *p,
+					unsigned long categories)
+{
+	categories ^= p->arg.category_inverted;
+	if ((categories & p->arg.category_mask) != p->arg.category_mask)
+		return false;
+	if (p->arg.category_anyof_mask &&
+	    !(categories & p->arg.category_anyof_mask))
+		return false;
+	return true;
+}
+
+/*
+ * Record [addr, *end) in the region buffer, extending the last region when
+ * it is contiguous and has the same categories.  On PM_END_OF_BUFFER only
+ * [addr, *end) was recorded (possibly nothing) and the walk must stop.
+ */
+static int pagemap_scan_output(unsigned long categories,
+			       struct pagemap_scan_private *p,
+			       unsigned long addr, unsigned long *end)
+{
+	struct page_region *cur = NULL;
+	unsigned long n_pages;
+	int ret = 0;
+
+	if (p->arg.max_pages && p->found_pages == p->arg.max_pages)
+		goto stop;
+
+	n_pages = (*end - addr) >> PAGE_SHIFT;
+	if (p->arg.max_pages && n_pages > p->arg.max_pages - p->found_pages) {
+		n_pages = p->arg.max_pages - p->found_pages;
+		*end = addr + (n_pages << PAGE_SHIFT);
+		ret = PM_END_OF_BUFFER;
+	}
+
+	categories &= p->arg.return_mask;
+	if (p->vec_buf_index)
+		cur = &p->vec_buf[p->vec_buf_index - 1];
+	if (!cur || cur->end != addr || cur->categories != categories) {
+		if (p->vec_buf_index == p->vec_buf_len)
+			goto stop;
+		cur = &p->vec_buf[p->vec_buf_index++];
+		cur->start = addr;
+		cur->categories = categories;
+	}
+	cur->end = *end;
+	p->found_pages += n_pages;
+
+	if (ret)
+		p->walk_end = *end;
+	return ret;
+
+stop:
+	*end = addr;
+	p->walk_end = addr;
+	return PM_END_OF_BUFFER;
+}
+
+static int pagemap_scan_pmd_entry(pmd_t *pmd, unsigned long start,
+				  unsigned long end, struct mm_walk *walk)
+{
+	struct pagemap_scan_private *p = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	bool clear = p->arg.flags & PM_SCAN_CLEAR_SOFT_DIRTY;
+	unsigned long categories, addr, next;
+	pte_t *pte, *orig_pte;
+	spinlock_t *ptl;
+	int ret = 0;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		unsigned long n_pages = (end - start) >> PAGE_SHIFT;
+		bool partial;
+
+		categories = pagemap_thp_category(vma, *pmd);
+		if (!pagemap_scan_is_interesting(p, categories)) {
+			spin_unlock(ptl);
+			return 0;
+		}
+
+		partial = end - start != HPAGE_PMD_SIZE ||
+			  (p->arg.max_pages &&
+			   p->arg.max_pages - p->found_pages < n_pages);
+		if (clear && partial && (categories & PAGE_IS_SOFT_DIRTY)) {
+			/*
+			 * The soft-dirty bit covers the whole pmd.  Split an
+			 * anonymous THP so only the reported pages get
+			 * cleared; anything else is reported but left dirty.
+			 */
+			if (vma_is_anonymous(vma) &&
+			    p->found_pages != p->arg.max_pages) {
+				spin_unlock(ptl);
+				split_huge_pmd(vma, pmd, start);
+				goto process_ptes;
+			}
+			clear = false;
+		}
+
+		ret = pagemap_scan_output(categories, p, start, &end);
+		if (clear && end != start && (categories & PAGE_IS_SOFT_DIRTY))
+			clear_soft_dirty_pmd(vma, start, pmd);
+		spin_unlock(ptl);
+		return ret;
+	}
+process_ptes:
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		return 0;
+
+	orig_pte = pte = pte_offset_map_lock(vma->vm_mm, pmd, start, &ptl);
+	for (addr = start; addr != end; pte++, addr += PAGE_SIZE) {
+		categories = pagemap_page_category(vma, addr, *pte);
+		if (!pagemap_scan_is_interesting(p, categories))
+			continue;
+
+		next = addr + PAGE_SIZE;
+		ret = pagemap_scan_output(categories, p, addr, &next);
+		if (next == addr)
+			break;
+		if (clear && (categories & PAGE_IS_SOFT_DIRTY))
+			clear_soft_dirty(vma, addr, pte);
+		if (ret)
+			break;
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+	cond_resched();
+
+	return ret;
+}
+
+static int pagemap_scan_pte_hole(unsigned long addr, unsigned long end,
+				 int depth, struct mm_walk *walk)
+{
+	struct pagemap_scan_private *p = walk->private;
+	struct vm_area_struct *vma = walk->vma;
+	unsigned long categories = 0;
+
+	/* Nothing to report for the gaps between vmas */
+	if (!vma)
+		return 0;
+
+	if (vma->vm_flags & VM_SOFTDIRTY)
+		categories |= PAGE_IS_SOFT_DIRTY;
+	if (!pagemap_scan_is_interesting(p, categories))
+		return 0;
+
+	return pagemap_scan_output(categories, p, addr, &end);
+}
+
+static const struct mm_walk_ops pagemap_scan_ops = {
+	.pmd_entry	= pagemap_scan_pmd_entry,
+	.pte_hole	= pagemap_scan_pte_hole,
+};
+
+/*
+ * Every page of [start, end) that was VM_SOFTDIRTY has been reported, so the
+ * vmas covering it can go back to per-pte tracking, as clear_refs does.
+ */
+static void pagemap_scan_clear_vmas(struct mm_struct *mm, unsigned long start,
+				    unsigned long end)
+{
+	struct vm_area_struct *vma;
+
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		if (!(vma->vm_flags & VM_SOFTDIRTY))
+			continue;
+		/* The new vma starting at @start is handled next time round */
+		if (vma->vm_start < start) {
+			if (split_vma(mm, vma, start, 0))
+				return;
+			continue;
+		}
+		if (vma->vm_end > end && split_vma(mm, vma, end, 0))
+			return;
+		vma_start_write(vma);
+		vma->vm_flags &= ~VM_SOFTDIRTY;
+		vma_set_page_prot(vma);
+	}
+}
+
+static int pagemap_scan_flush(struct pagemap_scan_private *p,
+			      struct page_region __user *vec, unsigned long n)
+{
+	if (copy_to_user(vec, p->vec_buf, n * sizeof(*vec)))
+		return -EFAULT;
+
+	/* Keep the unflushed tail, it may still grow on the next walk */
+	memmove(p->vec_buf, p->vec_buf + n,
+		(p->vec_buf_index - n) * sizeof(*p->vec_buf));
+	p->vec_buf_index -= n;
+	return 0;
+}
+
+static long do_pagemap_scan(struct mm_struct *mm, unsigned long uarg)
+{
+	struct pm_scan_arg __user *uargp = (struct pm_scan_arg __user *)uarg;
+	struct pagemap_scan_private p = {};
+	struct mmu_notifier_range range;
+	struct page_region __user *vec;
+	unsigned long start, end;
+	unsigned long vec_out = 0;
+	bool clear;
+	long ret;
+
+	if (copy_from_user(&p.arg, uargp, sizeof(p.arg)))
+		return -EFAULT;
+	if (p.arg.size != sizeof(p.arg))
+		return -EINVAL;
+	if ((p.arg.flags & ~PM_SCAN_FLAGS) ||
+	    ((p.arg.category_inverted | p.arg.category_mask |
+	      p.arg.category_anyof_mask | p.arg.return_mask) &
+	     ~PM_SCAN_CATEGORIES))
+		return -EINVAL;
+
+	start = p.arg.start;
+	end = p.arg.end;
+	if (start != p.arg.start || end != p.arg.end ||
+	    !IS_ALIGNED(start, PAGE_SIZE) || !IS_ALIGNED(end, PAGE_SIZE) ||
+	    start > end)
+		return -EINVAL;
+
+	vec = u64_to_user_ptr(p.arg.vec);
+	if (!p.arg.vec_len || p.arg.vec_len > ULONG_MAX / sizeof(*vec) ||
+	    !access_ok(vec, p.arg.vec_len * sizeof(*vec)))
+		return -EINVAL;
+
+	if (!mm || !mmget_not_zero(mm))
+		return -ESRCH;
+
+	ret = -ENOMEM;
+	p.vec_buf_len = min_t(unsigned long, PM_SCAN_BUFFER_LEN, p.arg.vec_len);
+	p.vec_buf = kmalloc_array(p.vec_buf_len, sizeof(*p.vec_buf),
+				  GFP_KERNEL);
+	if (!p.vec_buf)
+		goto out_mm;
+
+	clear = p.arg.flags & PM_SCAN_CLEAR_SOFT_DIRTY;
+	p.walk_end = start;
+	while (start < end) {
+		unsigned long n;
+		bool done;
+
+		p.vec_buf_len = min_t(unsigned long, PM_SCAN_BUFFER_LEN,
+				      p.arg.vec_len - vec_out);
+		p.walk_end = end;
+
+		if (clear)
+			ret = mmap_write_lock_killable(mm);
+		else
+			ret = mmap_read_lock_killable(mm);
+		if (ret)
+			break;
+
+		if (clear) {
+			inc_tlb_flush_pending(mm);
+			mmu_notifier_range_init(&range, MMU_NOTIFY_SOFT_DIRTY,
+						0, NULL, mm, start, end);
+			mmu_notifier_invalidate_range_start(&range);
+		}
+		ret = walk_page_range(mm, start, end, &pagemap_scan_ops, &p);
+		if (clear) {
+			mmu_notifier_invalidate_range_end(&range);
+			flush_tlb_mm(mm);
+			dec_tlb_flush_pending(mm);
+			if (ret >= 0)
+				pagemap_scan_clear_vmas(mm, start, p.walk_end);
+			mmap_write_unlock(mm);
+		} else {
+			mmap_read_unlock(mm);
+		}
+		if (ret < 0)
+			break;
+
+		start = p.walk_end;
+		done = ret != PM_END_OF_BUFFER ||
+		       (p.arg.max_pages && p.found_pages == p.arg.max_pages) ||
+		       p.vec_buf_index == p.arg.vec_len - vec_out;
+		ret = 0;
+		if (done)
+			break;
+
+		/* Region buffer is full, hand all but the last one to the user */
+		n = p.vec_buf_index - 1;
+		ret = pagemap_scan_flush(&p, vec + vec_out, n);
+		if (ret)
+			break;
+		vec_out += n;
+	}
+
+	if (!ret) {
+		unsigned long n = p.vec_buf_index;
+
+		ret = pagemap_scan_flush(&p, vec + vec_out, n);
+		vec_out += n;
+	}
+	if (!ret && put_user(p.walk_end, &uargp->walk_end))
+		ret = -EFAULT;
+	if (!ret)
+		ret = vec_out;
+
+	kfree(p.vec_buf);
+out_mm:
+	mmput(mm);
+	return ret;
+}
+
+static long pagemap_ioctl(struct file *file, unsigned int cmd,
+			  unsigned long arg)
+{
+	struct mm_struct *mm = file->private_data;
+
+	switch (cmd) {
+	case PAGEMAP_SCAN:
+		return do_pagemap_scan(mm, arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
 const struct file_operations proc_pagemap_operations = {
 	.llseek		= mem_lseek, /* borrow this */
 	.read		= pagemap_read,
 	.open		= pagemap_open,
 	.release	= pagemap_release,
+	.unlocked_ioctl	= pagemap_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 #endif /* CONFIG_PROC_PAGE_MONITOR */
 
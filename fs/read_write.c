@@ -1427,9 +1427,22 @@ static int generic_copy_file_checks(struct file *file_in, loff_t pos_in,
 	loff_t size_in;
 	int ret;
 
-	ret = generic_file_rw_checks(file_in, file_out);
-	if (ret)
-		return ret;
+	/*
+	 * Block devices may offload copies between ranges of the same device.
+	 * Size and overlap are those of the bdev inode, not the device node.
+	 */
+	if (S_ISBLK(inode_in->i_mode) && S_ISBLK(inode_out->i_mode)) {
+		if (!(file_in->f_mode & FMODE_READ) ||
+		    !(file_out->f_mode & FMODE_WRITE) ||
+		    (file_out->f_flags & O_APPEND))
+			return -EBADF;
+		inode_in = file_in->f_mapping->host;
+		inode_out = file_out->f_mapping->host;
+	} else {
+		ret = generic_file_rw_checks(file_in, file_out);
+		if (ret)
+			return ret;
+	}
 
 	/* Don't touch certain kinds of inodes */
 	if (IS_IMMUTABLE(inode_out))
@@ -12,6 +12,7 @@
 #include <linux/mm.h>
 #include <linux/errno.h>
 #include <linux/stat.h>
+#include <linux/fcntl.h>
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/fsnotify.h>
@@ -24,6 +25,8 @@
 
 #include <asm/unaligned.h>
 
+#include "internal.h"
+
 /*
  * Note the "unsafe_put_user() semantics: we goto a
  * label for errors.
@@ -351,10 +354,13 @@ static int filldir64(struct dir_context *ctx, const char *name, int namlen,
 	return -EFAULT;
 }
 
-SYSCALL_DEFINE3(getdents64, unsigned int, fd,
-		struct linux_dirent64 __user *, dirent, unsigned int, count)
+/*
+ * Caller is responsible for serializing against other users of the file
+ * position, see fdget_pos().
+ */
+int vfs_getdents(struct file *file, struct linux_dirent64 __user *dirent,
+		 unsigned int count)
 {
-	struct fd f;
 	struct getdents_callback64 buf = {
 		.ctx.actor = filldir64,
 		.count = count,
@@ -362,19 +368,168 @@ SYSCALL_DEFINE3(getdents64, unsigned int, fd,
 	};
 	int error;
 
+	error = iterate_dir(file, &buf.ctx);
+	if (error >= 0)
+		error = buf.error;
+	if (buf.prev_reclen) {
+		struct linux_dirent64 __user * lastdirent;
+		typeof(lastdirent->d_off) d_off = buf.ctx.pos;
+
+		lastdirent = (void __user *) buf.current_dir - buf.prev_reclen;
+		if (put_user(d_off, &lastdirent->d_off))
+			error = -EFAULT;
+		else
+			error = count - buf.count;
+	}
+	return error;
+}
+
+SYSCALL_DEFINE3(getdents64, unsigned int, fd,
+		struct linux_dirent64 __user *, dirent, unsigned int, count)
+{
+	struct fd f;
+	int error;
+
+	f = fdget_pos(fd);
+	if (!f.file)
+		return -EBADF;
+
+	error = vfs_getdents(f.file, dirent, count);
+	fdput_pos(f);
+	return error;
+}
+
+struct getdents_statx_callback {
+	struct dir_context ctx;
+	struct file *file;
+	struct dirent_statx __user *current_dir;
+	int prev_reclen;
+	int count;
+	int error;
+	unsigned int flags;
+	unsigned int mask;
+};
+
+/*
+ * Fill in the attributes of @name from the dentry cache.  We are called
+ * with the directory locked, so we must not call into ->lookup(); names
+ * that are not already cached are reported with an empty stx_mask.
+ */
+static int filldir_statx_attr(struct getdents_statx_callback *buf,
+			      const char *name, int namlen,
+			      struct statx __user *stx)
+{
+	struct qstr this = QSTR_INIT(name, namlen);
+	struct path path = { .mnt = buf->file->f_path.mnt };
+	struct kstat stat;
+	int error = -ENOENT;
+
+	path.dentry = d_hash_and_lookup(buf->file->f_path.dentry, &this);
+	if (IS_ERR_OR_NULL(path.dentry))
+		goto miss;
+	if (d_really_is_positive(path.dentry) && !d_mountpoint(path.dentry))
+		error = vfs_getattr(&path, &stat, buf->mask, buf->flags);
+	dput(path.dentry);
+	if (!error)
+		return cp_statx(&stat, stx);
+miss:
+	return clear_user(stx, sizeof(*stx)) ? -EFAULT : 0;
+}
+
+static int filldir_statx(struct dir_context *ctx, const char *name, int namlen,
+			 loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct dirent_statx __user *dirent, *prev;
+	struct getdents_statx_callback *buf =
+		container_of(ctx, struct getdents_statx_callback, ctx);
+	int reclen = ALIGN(offsetof(struct dirent_statx, d_name) + namlen + 1,
+		sizeof(u64));
+	int prev_reclen;
+
+	buf->error = verify_dirent_name(name, namlen);
+	if (unlikely(buf->error))
+		return buf->error;
+	buf->error = -EINVAL;	/* only used if we fail.. */
+	if (reclen > buf->count)
+		return -EINVAL;
+	prev_reclen = buf->prev_reclen;
+	if (prev_reclen && signal_pending(current))
+		return -EINTR;
+	dirent = buf->current_dir;
+	prev = (void __user *)dirent - prev_reclen;
+
+	if (filldir_statx_attr(buf, name, namlen, &dirent->d_statx))
+		goto efault;
+
+	if (!user_write_access_begin(prev, reclen + prev_reclen))
+		goto efault;
+
+	/* This might be 'dirent->d_off', but if so it will get overwritten */
+	unsafe_put_user(offset, &prev->d_off, efault_end);
+	unsafe_put_user(ino, &dirent->d_ino, efault_end);
+	unsafe_put_user(reclen, &dirent->d_reclen, efault_end);
+	unsafe_put_user(d_type, &dirent->d_type, efault_end);
+	unsafe_copy_dirent_name(dirent->d_name, name, namlen, efault_end);
+	user_write_access_end();
+
+	buf->prev_reclen = reclen;
+	buf->current_dir = (void __user *)dirent + reclen;
+	buf->count -= reclen;
+	return 0;
+
+efault_end:
+	user_write_access_end();
+efault:
+	buf->error = -EFAULT;
+	return -EFAULT;
+}
+
+/**
+ * sys_getdents_statx - read directory entries together with their attributes
+ * @fd: directory to read
+ * @dirent: buffer for struct dirent_statx records
+ * @count: size of @dirent in bytes
+ * @flags: AT_STATX_* sync flags, as for statx()
+ * @mask: STATX_* fields wanted, as for statx()
+ *
+ * This saves the statx() call per entry that ls -l and friends make after
+ * getdents64().  Attributes are only reported for names that are present in
+ * the dentry cache; see struct dirent_statx.
+ */
+SYSCALL_DEFINE5(getdents_statx, unsigned int, fd,
+		struct dirent_statx __user *, dirent, unsigned int, count,
+		unsigned int, flags, unsigned int, mask)
+{
+	struct getdents_statx_callback buf = {
+		.ctx.actor = filldir_statx,
+		.count = count,
+		.current_dir = dirent,
+		.flags = flags,
+		.mask = mask,
+	};
+	struct fd f;
+	int error;
+
+	if (flags & ~AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if ((flags & AT_STATX_SYNC_TYPE) == AT_STATX_SYNC_TYPE)
+		return -EINVAL;
+	if (mask & STATX__RESERVED)
+		return -EINVAL;
+
 	f = fdget_pos(fd);
 	if (!f.file)
 		return -EBADF;
 
+	buf.file = f.file;
 	error = iterate_dir(f.file, &buf.ctx);
 	if (error >= 0)
 		error = buf.error;
 	if (buf.prev_reclen) {
-		struct linux_dirent64 __user * lastdirent;
-		typeof(lastdirent->d_off) d_off = buf.ctx.pos;
+		struct dirent_statx __user *lastdirent;
 
 		lastdirent = (void __user *) buf.current_dir - buf.prev_reclen;
-		if (put_user(d_off, &lastdirent->d_off))
+		if (put_user(buf.ctx.pos, &lastdirent->d_off))
 			error = -EFAULT;
 		else
 			error = count - buf.count;
@@ -39,6 +39,7 @@
 #include "squashfs_fs_sb.h"
 #include "squashfs_fs_i.h"
 #include "squashfs.h"
+#include "page_actor.h"
 
 /*
  * Locate cache slot in range [offset, index] for specified inode.  If
@@ -494,7 +495,100 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+/*
+ * Read ahead a batch of pages one datablock at a time, decompressing each
+ * block straight into the pages of the readahead window.  Pages of the
+ * block outside the window are decompressed into the page actor's scratch
+ * buffer.  Pages we do not handle here (tail-end fragments, sparse blocks,
+ * errors) are unlocked without being marked uptodate and will be read by
+ * squashfs_readpage() when accessed.
+ */
+static void squashfs_readahead(struct readahead_control *ractl)
+{
+	struct inode *inode = ractl->mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	loff_t isize = i_size_read(inode);
+	int shift = msblk->block_log - PAGE_SHIFT;
+	unsigned int max_pages = 1U << shift;
+	int file_end = isize >> msblk->block_log;
+	pgoff_t next = readahead_index(ractl);
+	struct page **batch, **page;
+	unsigned int nr, i;
+
+	batch = kmalloc_array(max_pages, sizeof(void *), GFP_KERNEL);
+	page = kmalloc_array(max_pages, sizeof(void *), GFP_KERNEL);
+	if (batch == NULL || page == NULL)
+		goto out;
+
+	for (;;) {
+		struct squashfs_page_actor *actor;
+		int index = next >> shift;
+		unsigned int offset = next & (max_pages - 1);
+		int expected, bsize, pages, bytes, res;
+		u64 block = 0;
+		void *pageaddr;
+
+		nr = __readahead_batch(ractl, batch, max_pages - offset);
+		if (nr == 0)
+			break;
+		next += nr;
+
+		if (index > file_end || (index == file_end &&
+		    squashfs_i(inode)->fragment_block != SQUASHFS_INVALID_BLK))
+			goto skip;
+
+		expected = index == file_end ?
+			(isize & (msblk->block_size - 1)) : msblk->block_size;
+		pages = (expected + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		if (offset + nr > pages)
+			goto skip;
+
+		bsize = read_blocklist(inode, index, &block);
+		if (bsize <= 0)
+			goto skip;
+
+		memset(page, 0, pages * sizeof(void *));
+		for (i = 0; i < nr; i++)
+			page[offset + i] = batch[i];
+
+		actor = squashfs_page_actor_init_special(page, pages, 0);
+		if (actor == NULL)
+			goto skip;
+
+		res = squashfs_read_data(inode->i_sb, block, bsize, NULL, actor);
+		squashfs_page_actor_free(actor);
+		if (res != expected)
+			goto skip;
+
+		/* Last page (if present) may have trailing bytes not filled */
+		bytes = res % PAGE_SIZE;
+		if (bytes && page[pages - 1]) {
+			pageaddr = kmap_atomic(page[pages - 1]);
+			memset(pageaddr + bytes, 0, PAGE_SIZE - bytes);
+			kunmap_atomic(pageaddr);
+		}
+
+		for (i = 0; i < nr; i++) {
+			flush_dcache_page(batch[i]);
+			SetPageUptodate(batch[i]);
+		}
+skip:
+		for (i = 0; i < nr; i++) {
+			unlock_page(batch[i]);
+			put_page(batch[i]);
+		}
+	}
+
+out:
+	kfree(batch);
+	kfree(page);
+}
+#endif
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+#ifdef CONFIG_SQUASHFS_FILE_DIRECT
+	.readahead = squashfs_readahead,
+#endif
 };
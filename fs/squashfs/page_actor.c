@@ -50,42 +50,77 @@ struct squashfs_page_actor *squashfs_page_actor_init(void **buffer,
 	actor->buffer = buffer;
 	actor->pages = pages;
 	actor->next_page = 0;
+	actor->tmp_buffer = NULL;
 	actor->squashfs_first_page = cache_first_page;
 	actor->squashfs_next_page = cache_next_page;
 	actor->squashfs_finish_page = cache_finish_page;
 	return actor;
 }
 
-/* Implementation of page_actor for decompressing directly into page cache. */
+/*
+ * Implementation of page_actor for decompressing directly into page cache.
+ * Page array entries may be NULL for pages we could not grab; their part of
+ * the output is decompressed into tmp_buffer and thrown away.
+ */
+static void *handle_next_page(struct squashfs_page_actor *actor)
+{
+	int n = actor->next_page;
+
+	if (actor->pageaddr) {
+		kunmap_atomic(actor->pageaddr);
+		actor->pageaddr = NULL;
+	}
+
+	if (n == actor->pages)
+		return NULL;
+
+	actor->next_page++;
+	if (actor->page[n] == NULL)
+		return actor->tmp_buffer;
+
+	return actor->pageaddr = kmap_atomic(actor->page[n]);
+}
+
 static void *direct_first_page(struct squashfs_page_actor *actor)
 {
-	actor->next_page = 1;
-	return actor->pageaddr = kmap_atomic(actor->page[0]);
+	actor->next_page = 0;
+	return handle_next_page(actor);
 }
 
 static void *direct_next_page(struct squashfs_page_actor *actor)
 {
-	if (actor->pageaddr)
-		kunmap_atomic(actor->pageaddr);
-
-	return actor->pageaddr = actor->next_page == actor->pages ? NULL :
-		kmap_atomic(actor->page[actor->next_page++]);
+	return handle_next_page(actor);
 }
 
 static void direct_finish_page(struct squashfs_page_actor *actor)
 {
-	if (actor->pageaddr)
+	if (actor->pageaddr) {
 		kunmap_atomic(actor->pageaddr);
+		actor->pageaddr = NULL;
+	}
 }
 
 struct squashfs_page_actor *squashfs_page_actor_init_special(struct page **page,
 	int pages, int length)
 {
 	struct squashfs_page_actor *actor = kmalloc(sizeof(*actor), GFP_KERNEL);
+	int i;
 
 	if (actor == NULL)
 		return NULL;
 
+	actor->tmp_buffer = NULL;
+	for (i = 0; i < pages; i++) {
+		if (page[i] == NULL) {
+			actor->tmp_buffer = kmalloc(PAGE_SIZE, GFP_KERNEL);
+			if (actor->tmp_buffer == NULL) {
+				kfree(actor);
+				return NULL;
+			}
+			break;
+		}
+	}
+
 	actor->length = length ? : pages * PAGE_SIZE;
 	actor->page = page;
 	actor->pages = pages;
@@ -162,6 +162,7 @@ static void destroy_super_work(struct work_struct *work)
 
 	for (i = 0; i < SB_FREEZE_LEVELS; i++)
 		percpu_free_rwsem(&s->s_writers.rw_sem[i]);
+	percpu_counter_destroy(&s->s_nr_dentry_negative);
 	kfree(s);
 }
 
@@ -273,6 +274,9 @@ static struct super_block *alloc_super(struct file_system_type *type, int flags,
 		goto fail;
 	if (list_lru_init_memcg(&s->s_inode_lru, &s->s_shrink))
 		goto fail;
+	if (percpu_counter_init(&s->s_nr_dentry_negative, 0, GFP_KERNEL))
+		goto fail;
+	INIT_WORK(&s->s_negative_dentry_work, d_negative_trim_work);
 	return s;
 
 fail:
@@ -469,6 +473,11 @@ void generic_shutdown_super(struct super_block *sb)
 			   sb->s_id);
 		}
 	}
+	/*
+	 * Any negative dentry may have queued the trimmer, with or without
+	 * s_root.  It backs off while we hold s_umount.
+	 */
+	cancel_work_sync(&sb->s_negative_dentry_work);
 	spin_lock(&sb_lock);
 	/* should be initialized for __put_super_and_need_restart() */
 	hlist_del_init(&sb->s_instances);
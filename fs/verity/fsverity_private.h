@@ -19,6 +19,8 @@
 #include <linux/mempool.h>
 
 struct ahash_request;
+struct crypto_wait;
+struct scatterlist;
 
 /*
  * Implementation limit: maximum depth of the Merkle tree.  For now 8 is plenty;
@@ -125,6 +127,11 @@ void fsverity_free_hash_request(struct fsverity_hash_alg *alg,
 				struct ahash_request *req);
 const u8 *fsverity_prepare_hash_state(struct fsverity_hash_alg *alg,
 				      const u8 *salt, size_t salt_size);
+int fsverity_start_hash_page(const struct merkle_tree_params *params,
+			     const struct inode *inode,
+			     struct ahash_request *req, struct scatterlist *sg,
+			     struct crypto_wait *wait, struct page *page,
+			     u8 *out);
 int fsverity_hash_page(const struct merkle_tree_params *params,
 		       const struct inode *inode,
 		       struct ahash_request *req, struct page *page, u8 *out);
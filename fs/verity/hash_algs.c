@@ -218,35 +218,39 @@ const u8 *fsverity_prepare_hash_state(struct fsverity_hash_alg *alg,
 }
 
 /**
- * fsverity_hash_page() - hash a single data or hash page
+ * fsverity_start_hash_page() - start hashing a single data or hash page
  * @params: the Merkle tree's parameters
  * @inode: inode for which the hashing is being done
  * @req: preallocated hash request
+ * @sg: scatterlist for the request, must live until it completes
+ * @wait: completion for the request, must live until it completes
  * @page: the page to hash
  * @out: output digest, size 'params->digest_size' bytes
  *
- * Hash a single data or hash block, assuming block_size == PAGE_SIZE.
- * The hash is salted if a salt is specified in the Merkle tree parameters.
+ * Like fsverity_hash_page(), but don't wait for the hash to complete, so that
+ * several pages can be in flight on an asynchronous hash implementation.  The
+ * caller must pass the return value and @wait to crypto_wait_req().
  *
- * Return: 0 on success, -errno on failure
+ * Return: the result of submitting the request
  */
-int fsverity_hash_page(const struct merkle_tree_params *params,
-		       const struct inode *inode,
-		       struct ahash_request *req, struct page *page, u8 *out)
+int fsverity_start_hash_page(const struct merkle_tree_params *params,
+			     const struct inode *inode,
+			     struct ahash_request *req, struct scatterlist *sg,
+			     struct crypto_wait *wait, struct page *page,
+			     u8 *out)
 {
-	struct scatterlist sg;
-	DECLARE_CRYPTO_WAIT(wait);
 	int err;
 
 	if (WARN_ON(params->block_size != PAGE_SIZE))
 		return -EINVAL;
 
-	sg_init_table(&sg, 1);
-	sg_set_page(&sg, page, PAGE_SIZE, 0);
+	crypto_init_wait(wait);
+	sg_init_table(sg, 1);
+	sg_set_page(sg, page, PAGE_SIZE, 0);
 	ahash_request_set_callback(req, CRYPTO_TFM_REQ_MAY_SLEEP |
 					CRYPTO_TFM_REQ_MAY_BACKLOG,
-				   crypto_req_done, &wait);
-	ahash_request_set_crypt(req, &sg, out, PAGE_SIZE);
+				   crypto_req_done, wait);
+	ahash_request_set_crypt(req, sg, out, PAGE_SIZE);
 
 	if (params->hashstate) {
 		err = crypto_ahash_import(req, params->hashstate);
@@ -255,11 +259,34 @@ int fsverity_hash_page(const struct merkle_tree_params *params,
 				     "Error %d importing hash state", err);
 			return err;
 		}
-		err = crypto_ahash_finup(req);
-	} else {
-		err = crypto_ahash_digest(req);
+		return crypto_ahash_finup(req);
 	}
+	return crypto_ahash_digest(req);
+}
+
+/**
+ * fsverity_hash_page() - hash a single data or hash page
+ * @params: the Merkle tree's parameters
+ * @inode: inode for which the hashing is being done
+ * @req: preallocated hash request
+ * @page: the page to hash
+ * @out: output digest, size 'params->digest_size' bytes
+ *
+ * Hash a single data or hash block, assuming block_size == PAGE_SIZE.
+ * The hash is salted if a salt is specified in the Merkle tree parameters.
+ *
+ * Return: 0 on success, -errno on failure
+ */
+int fsverity_hash_page(const struct merkle_tree_params *params,
+		       const struct inode *inode,
+		       struct ahash_request *req, struct page *page, u8 *out)
+{
+	struct scatterlist sg;
+	struct crypto_wait wait;
+	int err;
 
+	err = fsverity_start_hash_page(params, inode, req, &sg, &wait, page,
+				       out);
 	err = crypto_wait_req(err, &wait);
 	if (err)
 		fsverity_err(inode, "Error %d computing page hash", err);
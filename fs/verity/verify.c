@@ -10,6 +10,8 @@
 #include <crypto/hash.h>
 #include <linux/bio.h>
 #include <linux/ratelimit.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
 
 static struct workqueue_struct *fsverity_read_workqueue;
 
@@ -81,11 +83,13 @@ static inline int cmp_hashes(const struct fsverity_info *vi,
  * Note that multiple processes may race to verify a hash page and mark it
  * Checked, but it doesn't matter; the result will be the same either way.
  *
+ * If @data_hash is non-NULL, it is the already computed hash of @data_page.
+ *
  * Return: true if the page is valid, else false.
  */
 static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 			struct ahash_request *req, struct page *data_page,
-			unsigned long level0_ra_pages)
+			unsigned long level0_ra_pages, const u8 *data_hash)
 {
 	const struct merkle_tree_params *params = &vi->tree_params;
 	const unsigned int hsize = params->digest_size;
@@ -166,10 +170,14 @@ static bool verify_page(struct inode *inode, const struct fsverity_info *vi,
 	}
 
 	/* Finally, verify the data page */
-	err = fsverity_hash_page(params, inode, req, data_page, real_hash);
-	if (err)
-		goto out;
-	err = cmp_hashes(vi, want_hash, real_hash, index, -1);
+	if (!data_hash) {
+		err = fsverity_hash_page(params, inode, req, data_page,
+					 real_hash);
+		if (err)
+			goto out;
+		data_hash = real_hash;
+	}
+	err = cmp_hashes(vi, want_hash, data_hash, index, -1);
 out:
 	for (; level > 0; level--)
 		put_page(hpages[level - 1]);
@@ -196,7 +204,7 @@ bool fsverity_verify_page(struct page *page)
 	/* This allocation never fails, since it's mempool-backed. */
 	req = fsverity_alloc_hash_request(vi->tree_params.hash_alg, GFP_NOFS);
 
-	valid = verify_page(inode, vi, req, page, 0);
+	valid = verify_page(inode, vi, req, page, 0, NULL);
 
 	fsverity_free_hash_request(vi->tree_params.hash_alg, req);
 
@@ -205,6 +213,90 @@ bool fsverity_verify_page(struct page *page)
 EXPORT_SYMBOL_GPL(fsverity_verify_page);
 
 #ifdef CONFIG_BLOCK
+/*
+ * Maximum number of data pages of a bio whose hashes are in flight at once.
+ * Each page gets its own hash request, so that hash implementations that can
+ * process several requests in parallel are kept busy.
+ */
+#define FSVERITY_VERIFY_BATCH	16
+
+struct fsverity_verify_batch {
+	unsigned int nr_reqs;
+	unsigned int nr_pages;
+	struct ahash_request *reqs[FSVERITY_VERIFY_BATCH];
+	struct page *pages[FSVERITY_VERIFY_BATCH];
+	unsigned long ra_pages[FSVERITY_VERIFY_BATCH];
+	struct scatterlist sgs[FSVERITY_VERIFY_BATCH];
+	struct crypto_wait waits[FSVERITY_VERIFY_BATCH];
+	int errs[FSVERITY_VERIFY_BATCH];
+	u8 hashes[FSVERITY_VERIFY_BATCH][FS_VERITY_MAX_DIGEST_SIZE];
+};
+
+static void free_verify_batch(struct fsverity_verify_batch *batch)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch->nr_reqs; i++)
+		ahash_request_free(batch->reqs[i]);
+	kfree(batch);
+}
+
+/*
+ * The extra requests don't come from the mempool, so this may fail; the
+ * caller then falls back to verifying one page at a time.
+ */
+static struct fsverity_verify_batch *
+alloc_verify_batch(struct fsverity_hash_alg *alg, unsigned int nr_pages)
+{
+	struct fsverity_verify_batch *batch;
+
+	batch = kmalloc(sizeof(*batch), GFP_NOFS);
+	if (!batch)
+		return NULL;
+	batch->nr_pages = 0;
+	for (batch->nr_reqs = 0;
+	     batch->nr_reqs < min_t(unsigned int, nr_pages,
+				    FSVERITY_VERIFY_BATCH);
+	     batch->nr_reqs++) {
+		batch->reqs[batch->nr_reqs] = ahash_request_alloc(alg->tfm,
+								  GFP_NOFS);
+		if (!batch->reqs[batch->nr_reqs]) {
+			free_verify_batch(batch);
+			return NULL;
+		}
+	}
+	return batch;
+}
+
+static void verify_batch(struct inode *inode, const struct fsverity_info *vi,
+			 struct ahash_request *req,
+			 struct fsverity_verify_batch *batch)
+{
+	const struct merkle_tree_params *params = &vi->tree_params;
+	unsigned int i;
+
+	for (i = 0; i < batch->nr_pages; i++)
+		batch->errs[i] = fsverity_start_hash_page(params, inode,
+				batch->reqs[i], &batch->sgs[i],
+				&batch->waits[i], batch->pages[i],
+				batch->hashes[i]);
+
+	for (i = 0; i < batch->nr_pages; i++) {
+		struct page *page = batch->pages[i];
+		int err = crypto_wait_req(batch->errs[i], &batch->waits[i]);
+
+		if (err) {
+			fsverity_err(inode, "Error %d computing page hash",
+				     err);
+			SetPageError(page);
+		} else if (!verify_page(inode, vi, req, page,
+					batch->ra_pages[i], batch->hashes[i])) {
+			SetPageError(page);
+		}
+	}
+	batch->nr_pages = 0;
+}
+
 /**
  * fsverity_verify_bio() - verify a 'read' bio that has just completed
  * @bio: the bio to verify
@@ -225,14 +317,19 @@ void fsverity_verify_bio(struct bio *bio)
 	struct inode *inode = bio_first_page_all(bio)->mapping->host;
 	const struct fsverity_info *vi = inode->i_verity_info;
 	const struct merkle_tree_params *params = &vi->tree_params;
+	struct fsverity_verify_batch *batch = NULL;
 	struct ahash_request *req;
 	struct bio_vec *bv;
 	struct bvec_iter_all iter_all;
 	unsigned long max_ra_pages = 0;
+	unsigned int nr_pages = 0;
 
 	/* This allocation never fails, since it's mempool-backed. */
 	req = fsverity_alloc_hash_request(params->hash_alg, GFP_NOFS);
 
+	bio_for_each_segment_all(bv, bio, iter_all)
+		nr_pages++;
+
 	if (bio->bi_opf & REQ_RAHEAD) {
 		/*
 		 * If this bio is for data readahead, then we also do readahead
@@ -243,22 +340,38 @@ void fsverity_verify_bio(struct bio *bio)
 		 * This improves sequential read performance, as it greatly
 		 * reduces the number of I/O requests made to the Merkle tree.
 		 */
-		bio_for_each_segment_all(bv, bio, iter_all)
-			max_ra_pages++;
-		max_ra_pages /= 4;
+		max_ra_pages = nr_pages / 4;
 	}
 
+	if (nr_pages > 1)
+		batch = alloc_verify_batch(params->hash_alg, nr_pages);
+
 	bio_for_each_segment_all(bv, bio, iter_all) {
 		struct page *page = bv->bv_page;
 		unsigned long level0_index = page->index >> params->log_arity;
 		unsigned long level0_ra_pages =
 			min(max_ra_pages, params->level0_blocks - level0_index);
 
-		if (!PageError(page) &&
-		    !verify_page(inode, vi, req, page, level0_ra_pages))
-			SetPageError(page);
+		if (PageError(page))
+			continue;
+
+		if (!batch) {
+			if (!verify_page(inode, vi, req, page, level0_ra_pages,
+					 NULL))
+				SetPageError(page);
+			continue;
+		}
+
+		batch->pages[batch->nr_pages] = page;
+		batch->ra_pages[batch->nr_pages] = level0_ra_pages;
+		if (++batch->nr_pages == batch->nr_reqs)
+			verify_batch(inode, vi, req, batch);
 	}
 
+	if (batch) {
+		verify_batch(inode, vi, req, batch);
+		free_verify_batch(batch);
+	}
 	fsverity_free_hash_request(params->hash_alg, req);
 }
 EXPORT_SYMBOL_GPL(fsverity_verify_bio);
@@ -877,7 +877,12 @@ xfs_buffered_write_iomap_begin(
 
 	ASSERT(!XFS_IS_REALTIME_INODE(ip));
 
-	xfs_ilock(ip, XFS_ILOCK_EXCL);
+	if (flags & IOMAP_NOWAIT) {
+		if (!xfs_ilock_nowait(ip, XFS_ILOCK_EXCL))
+			return -EAGAIN;
+	} else {
+		xfs_ilock(ip, XFS_ILOCK_EXCL);
+	}
 
 	if (XFS_IS_CORRUPT(mp, !xfs_ifork_has_extents(&ip->i_df)) ||
 	    XFS_TEST_ERROR(false, mp, XFS_ERRTAG_BMAPIFORMAT)) {
@@ -888,6 +893,9 @@ xfs_buffered_write_iomap_begin(
 	XFS_STATS_INC(mp, xs_blk_mapw);
 
 	if (!(ip->i_df.if_flags & XFS_IFEXTENTS)) {
+		error = -EAGAIN;
+		if (flags & IOMAP_NOWAIT)
+			goto out_unlock;
 		error = xfs_iread_extents(NULL, ip, XFS_DATA_FORK);
 		if (error)
 			goto out_unlock;
@@ -945,6 +953,11 @@ xfs_buffered_write_iomap_begin(
 
 		xfs_trim_extent(&imap, offset_fsb, end_fsb - offset_fsb);
 
+		/* looking up shared extents may have to read the refcount btree */
+		error = -EAGAIN;
+		if (flags & IOMAP_NOWAIT)
+			goto out_unlock;
+
 		/* Trim the mapping to the nearest shared extent boundary. */
 		error = xfs_bmap_trim_cow(ip, &imap, &shared);
 		if (error)
@@ -980,6 +993,14 @@ xfs_buffered_write_iomap_begin(
 			allocfork = XFS_COW_FORK;
 	}
 
+	/*
+	 * Reserving delalloc blocks can block on quota and free space
+	 * accounting, leave that to a blocking retry.
+	 */
+	error = -EAGAIN;
+	if (flags & IOMAP_NOWAIT)
+		goto out_unlock;
+
 	error = xfs_qm_dqattach_locked(ip, false);
 	if (error)
 		goto out_unlock;
@@ -1379,10 +1379,12 @@ xfs_setup_iops(
 	case S_IFREG:
 		inode->i_op = &xfs_inode_operations;
 		inode->i_fop = &xfs_file_operations;
-		if (IS_DAX(inode))
+		if (IS_DAX(inode)) {
 			inode->i_mapping->a_ops = &xfs_dax_aops;
-		else
+		} else {
 			inode->i_mapping->a_ops = &xfs_address_space_operations;
+			mapping_set_thp_readahead(inode->i_mapping);
+		}
 		break;
 	case S_IFDIR:
 		if (xfs_sb_version_hasasciici(&XFS_M(inode->i_sb)->m_sb))
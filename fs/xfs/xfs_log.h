@@ -17,6 +17,7 @@ struct xfs_log_vec {
 	int			lv_bytes;	/* accounted space in buffer */
 	int			lv_buf_len;	/* aligned size of buffer */
 	int			lv_size;	/* size of allocated lv */
+	uint32_t		lv_order_id;	/* commit order in the CIL */
 };
 
 #define XFS_LOG_VEC_ORDERED	(-1)
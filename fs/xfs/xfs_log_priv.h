@@ -236,6 +236,7 @@ struct xfs_cil_ctx {
 	struct xlog_ticket	*ticket;	/* chkpt ticket */
 	int			nvecs;		/* number of regions */
 	int			space_used;	/* aggregate size of regions */
+	atomic_t		order_id;	/* next commit order id */
 	struct list_head	busy_extents;	/* busy extents in chkpt */
 	struct xfs_log_vec	*lv_chain;	/* logvecs being pushed */
 	struct list_head	iclog_entry;
@@ -259,9 +260,23 @@ struct xfs_cil_ctx {
  * the commit LSN to be determined as well. This should make synchronous
  * operations almost as efficient as the old logging methods.
  */
+/*
+ * Log items are added to the CIL on the per-cpu list of the committing CPU,
+ * with preemption disabled. An item already in the CIL stays on the list it
+ * is on; the push sorts all items back into commit order by lv_order_id. The
+ * lists are only drained with the xc_ctx_lock held exclusively.
+ */
+struct xlog_cil_pcp {
+	struct list_head	log_items;
+};
+
+/* xc_flags */
+#define XLOG_CIL_EMPTY		0	/* no items since the last push */
+
 struct xfs_cil {
 	struct xlog		*xc_log;
-	struct list_head	xc_cil;
+	struct xlog_cil_pcp __percpu *xc_pcp;
+	unsigned long		xc_flags;
 	spinlock_t		xc_cil_lock;
 
 	struct rw_semaphore	xc_ctx_lock ____cacheline_aligned_in_smp;
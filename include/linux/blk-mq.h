@@ -158,6 +158,16 @@ struct blk_mq_hw_ctx {
 	/** @poll_success: Count how many polled requests were completed. */
 	unsigned long		poll_success;
 
+	/**
+	 * @poll_est: Moving average and mean deviation of the completion
+	 * time of the polled requests of this hardware queue, in ns, by
+	 * blk_mq_poll_stats_bkt() bucket.  Used by hybrid polling.
+	 */
+	struct blk_mq_poll_est {
+		u32		mean;
+		u32		dev;
+	} poll_est[BLK_MQ_POLL_STATS_BKTS];
+
 #ifdef CONFIG_BLK_DEBUG_FS
 	/**
 	 * @debugfs_dir: debugfs directory for this hardware queue. Named
@@ -56,6 +56,8 @@ struct bpf_reg_state {
 
 		u32 mem_size; /* for PTR_TO_MEM | PTR_TO_MEM_OR_NULL */
 
+		u32 subprogno; /* for PTR_TO_FUNC */
+
 		/* Max size from any of the above. */
 		unsigned long raw;
 	};
@@ -191,6 +193,8 @@ struct bpf_func_state {
 	 * zero == main subprog
 	 */
 	u32 subprogno;
+	/* this frame is a callback invoked by a helper, e.g. bpf_loop() */
+	bool in_callback_fn;
 
 	/* The following fields should be last. See copy_func_state() */
 	int acquired_refs;
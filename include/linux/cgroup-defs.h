@@ -28,6 +28,7 @@ struct cgroup;
 struct cgroup_root;
 struct cgroup_subsys;
 struct cgroup_taskset;
+struct css_rstat_cpu;
 struct kernfs_node;
 struct kernfs_ops;
 struct kernfs_open_file;
@@ -149,8 +150,11 @@ struct cgroup_subsys_state {
 	struct list_head sibling;
 	struct list_head children;
 
-	/* flush target list anchored at cgrp->rstat_css_list */
-	struct list_head rstat_css_node;
+	/*
+	 * per-cpu updated tree links, only for the self css and the csses
+	 * of subsystems implementing ->css_rstat_flush()
+	 */
+	struct css_rstat_cpu __percpu *rstat_cpu;
 
 	/*
 	 * PI: Subsys-unique ID.  0 is unused and root is always 1.  The
@@ -287,10 +291,9 @@ struct cgroup_base_stat {
 
 /*
  * rstat - cgroup scalable recursive statistics.  Accounting is done
- * per-cpu in cgroup_rstat_cpu which is then lazily propagated up the
- * hierarchy on reads.
+ * per-cpu and then lazily propagated up the hierarchy on reads.
  *
- * When a stat gets updated, the cgroup_rstat_cpu and its ancestors are
+ * When a stat gets updated, the css_rstat_cpu and its ancestors are
  * linked into the updated tree.  On the following read, propagation only
  * considers and consumes the updated tree.  This makes reading O(the
  * number of descendants which have been active since last read) instead of
@@ -301,10 +304,27 @@ struct cgroup_base_stat {
  * become very expensive.  By propagating selectively, increasing reading
  * frequency decreases the cost of each read.
  *
- * This struct hosts both the fields which implement the above -
- * updated_children and updated_next - and the fields which track basic
- * resource statistics on top of it - bsync, bstat and last_bstat.
+ * Each subsystem implementing ->css_rstat_flush() has its own updated
+ * trees, built from the csses of the subsystem, and its own locks.  The
+ * basic resource statistics below use the trees of the cgroups' self csses.
  */
+struct css_rstat_cpu {
+	/*
+	 * Child csses with stat updates on this cpu since the last read
+	 * are linked on the parent's ->updated_children through
+	 * ->updated_next.
+	 *
+	 * In addition to being more compact, singly-linked list pointing
+	 * to the css makes it unnecessary for each per-cpu struct to
+	 * point back to the associated css.
+	 *
+	 * Protected by the subsystem's per-cpu rstat lock.
+	 */
+	struct cgroup_subsys_state *updated_children;	/* terminated by self */
+	struct cgroup_subsys_state *updated_next;	/* NULL iff not on the list */
+};
+
+/* per-cpu basic resource statistics of a cgroup */
 struct cgroup_rstat_cpu {
 	/*
 	 * ->bsync protects ->bstat.  These are the only fields which get
@@ -318,20 +338,6 @@ struct cgroup_rstat_cpu {
 	 * deltas to propagate to the global counters.
 	 */
 	struct cgroup_base_stat last_bstat;
-
-	/*
-	 * Child cgroups with stat updates on this cpu since the last read
-	 * are linked on the parent's ->updated_children through
-	 * ->updated_next.
-	 *
-	 * In addition to being more compact, singly-linked list pointing
-	 * to the cgroup makes it unnecessary for each per-cpu struct to
-	 * point back to the associated cgroup.
-	 *
-	 * Protected by per-cpu cgroup_rstat_cpu_lock.
-	 */
-	struct cgroup *updated_children;	/* terminated by self cgroup */
-	struct cgroup *updated_next;		/* NULL iff not on the list */
 };
 
 struct cgroup_freezer_state {
@@ -450,7 +456,6 @@ struct cgroup {
 
 	/* per-cpu recursive resource statistics */
 	struct cgroup_rstat_cpu __percpu *rstat_cpu;
-	struct list_head rstat_css_list;
 
 	/* cgroup basic resource statistics */
 	struct cgroup_base_stat last_bstat;
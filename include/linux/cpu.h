@@ -22,6 +22,7 @@
 struct device;
 struct device_node;
 struct attribute_group;
+struct task_struct;
 
 struct cpu {
 	int node_id;		/* The node which contains the CPU */
@@ -96,6 +97,8 @@ extern void cpu_maps_update_begin(void);
 extern void cpu_maps_update_done(void);
 int bringup_hibernate_cpu(unsigned int sleep_cpu);
 void bringup_nonboot_cpus(unsigned int setup_max_cpus);
+int arch_cpuhp_kick_ap_alive(unsigned int cpu, struct task_struct *tidle);
+bool arch_cpuhp_init_parallel_bringup(void);
 
 #else	/* CONFIG_SMP */
 #define cpuhp_tasks_frozen	0
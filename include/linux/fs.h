@@ -31,6 +31,7 @@
 #include <linux/uidgid.h>
 #include <linux/lockdep.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
 #include <linux/delayed_call.h>
 #include <linux/uuid.h>
@@ -163,6 +164,9 @@ typedef int (dio_iodone_t)(struct kiocb *iocb, loff_t offset,
 /* File is stream-like */
 #define FMODE_STREAM		((__force fmode_t)0x200000)
 
+/* File supports RWF_ZONE_APPEND */
+#define FMODE_ZONE_APPEND	((__force fmode_t)0x400000)
+
 /* File was opened by fanotify and shouldn't generate fanotify events */
 #define FMODE_NONOTIFY		((__force fmode_t)0x4000000)
 
@@ -178,6 +182,9 @@ typedef int (dio_iodone_t)(struct kiocb *iocb, loff_t offset,
 /* File supports async buffered reads */
 #define FMODE_BUF_RASYNC	((__force fmode_t)0x40000000)
 
+/* File supports non-blocking buffered writes */
+#define FMODE_BUF_WASYNC	((__force fmode_t)0x80000000)
+
 /*
  * Attribute flags.  These should be or-ed together to figure out what
  * has been changed!
@@ -308,6 +315,8 @@ enum rw_hint {
 #define IOCB_SYNC		(__force int) RWF_SYNC
 #define IOCB_NOWAIT		(__force int) RWF_NOWAIT
 #define IOCB_APPEND		(__force int) RWF_APPEND
+#define IOCB_ZONE_APPEND	(__force int) RWF_ZONE_APPEND
+#define IOCB_DONTCACHE		(__force int) RWF_DONTCACHE
 
 /* non-RWF related bits - start at 16 */
 #define IOCB_EVENTFD		(1 << 16)
@@ -316,6 +325,8 @@ enum rw_hint {
 /* iocb->ki_waitq is valid */
 #define IOCB_WAITQ		(1 << 19)
 #define IOCB_NOIO		(1 << 20)
+/* can use bio alloc cache */
+#define IOCB_ALLOC_CACHE	(1 << 21)
 
 struct kiocb {
 	struct file		*ki_filp;
@@ -429,6 +440,20 @@ int pagecache_write_end(struct file *, struct address_space *mapping,
 				loff_t pos, unsigned len, unsigned copied,
 				struct page *page, void *fsdata);
 
+/**
+ * struct ra_stats - readahead activity on a mapping
+ * @sync: readahead decisions taken on a cache miss
+ * @async: readahead decisions taken on hitting the readahead marker
+ * @policy: decisions made by the attached readahead policy
+ * @pages: pages submitted for readahead
+ */
+struct ra_stats {
+	unsigned long sync;
+	unsigned long async;
+	unsigned long policy;
+	unsigned long pages;
+};
+
 /**
  * struct address_space - Contents of a cacheable, mappable object.
  * @host: Owner, either the inode or the block_device.
@@ -447,6 +472,7 @@ int pagecache_write_end(struct file *, struct address_space *mapping,
  * @private_lock: For use by the owner of the address_space.
  * @private_list: For use by the owner of the address_space.
  * @private_data: For use by the owner of the address_space.
+ * @ra_stats: Readahead statistics, reported in fdinfo.
  */
 struct address_space {
 	struct inode		*host;
@@ -468,6 +494,9 @@ struct address_space {
 	spinlock_t		private_lock;
 	struct list_head	private_list;
 	void			*private_data;
+#ifdef CONFIG_BPF_READAHEAD
+	struct ra_stats		ra_stats;
+#endif
 } __attribute__((aligned(sizeof(long)))) __randomize_layout;
 	/*
 	 * On most architectures that alignment is already the case; but
@@ -893,6 +922,8 @@ struct fown_struct {
 /*
  * Track a single file's readahead state
  */
+#define RA_HISTORY_LEN	4
+
 struct file_ra_state {
 	pgoff_t start;			/* where readahead started */
 	unsigned int size;		/* # of readahead pages */
@@ -902,6 +933,10 @@ struct file_ra_state {
 	unsigned int ra_pages;		/* Maximum readahead window */
 	unsigned int mmap_miss;		/* Cache miss stat for mmap accesses */
 	loff_t prev_pos;		/* Cache last read() position */
+#ifdef CONFIG_BPF_READAHEAD
+	pgoff_t history[RA_HISTORY_LEN];	/* Recent readahead indexes */
+	unsigned int history_idx;	/* Next slot in history[] */
+#endif
 };
 
 /*
@@ -1531,6 +1566,9 @@ struct super_block {
 	 */
 	struct list_lru		s_dentry_lru;
 	struct list_lru		s_inode_lru;
+	/* negative dentries on s_dentry_lru, see sysctl_negative_dentry_limit */
+	struct percpu_counter	s_nr_dentry_negative;
+	struct work_struct	s_negative_dentry_work;
 	struct rcu_head		rcu;
 	struct work_struct	destroy_work;
 
@@ -1818,6 +1856,7 @@ struct dir_context {
 #define REMAP_FILE_ADVISORY		(REMAP_FILE_CAN_SHORTEN)
 
 struct iov_iter;
+struct io_uring_cmd;
 
 struct file_operations {
 	struct module *owner;
@@ -1859,6 +1898,7 @@ struct file_operations {
 				   struct file *file_out, loff_t pos_out,
 				   loff_t len, unsigned int remap_flags);
 	int (*fadvise)(struct file *, loff_t, loff_t, int);
+	int (*uring_cmd)(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
 } __randomize_layout;
 
 struct inode_operations {
@@ -1991,6 +2031,7 @@ struct super_operations {
 #define S_ENCRYPTED	(1 << 14) /* Encrypted file (using fs/crypto/) */
 #define S_CASEFOLD	(1 << 15) /* Casefolded file */
 #define S_VERITY	(1 << 16) /* Verity file (using fs/verity/) */
+#define S_PAR_DIROPS	(1 << 17) /* create/unlink with parent locked shared */
 
 /*
  * Note that nosuid etc flags are inode-specific: setting some file-system
@@ -2033,6 +2074,7 @@ static inline bool sb_rdonly(const struct super_block *sb) { return sb->s_flags
 #define IS_ENCRYPTED(inode)	((inode)->i_flags & S_ENCRYPTED)
 #define IS_CASEFOLDED(inode)	((inode)->i_flags & S_CASEFOLD)
 #define IS_VERITY(inode)	((inode)->i_flags & S_VERITY)
+#define IS_PAR_DIROPS(inode)	((inode)->i_flags & S_PAR_DIROPS)
 
 #define IS_WHITEOUT(inode)	(S_ISCHR(inode->i_mode) && \
 				 (inode)->i_rdev == WHITEOUT_DEV)
@@ -2223,6 +2265,7 @@ static inline void file_accessed(struct file *file)
 }
 
 extern int file_modified(struct file *file);
+extern int kiocb_modified(struct kiocb *iocb);
 
 int sync_inode(struct inode *inode, struct writeback_control *wbc);
 int sync_inode_metadata(struct inode *inode, int wait);
@@ -2729,6 +2772,7 @@ extern int vfs_fsync(struct file *file, int datasync);
 
 extern int sync_file_range(struct file *file, loff_t offset, loff_t nbytes,
 				unsigned int flags);
+extern void filemap_dontcache_write(struct kiocb *iocb, ssize_t count);
 
 /*
  * Sync the bytes written if this was a synchronous write.  Expect ki_pos
@@ -2745,6 +2789,9 @@ static inline ssize_t generic_write_sync(struct kiocb *iocb, ssize_t count)
 			return ret;
 	}
 
+	if (unlikely(iocb->ki_flags & IOCB_DONTCACHE) && count > 0)
+		filemap_dontcache_write(iocb, count);
+
 	return count;
 }
 
@@ -3277,6 +3324,9 @@ static inline int kiocb_set_rw_flags(struct kiocb *ki, rwf_t flags)
 			return -EOPNOTSUPP;
 		kiocb_flags |= IOCB_NOIO;
 	}
+	if ((flags & RWF_ZONE_APPEND) &&
+	    !(ki->ki_filp->f_mode & FMODE_ZONE_APPEND))
+		return -EOPNOTSUPP;
 	kiocb_flags |= (__force int) (flags & RWF_SUPPORTED);
 	if (flags & RWF_SYNC)
 		kiocb_flags |= IOCB_DSYNC;
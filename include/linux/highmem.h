@@ -284,6 +284,11 @@ static inline void clear_highpage(struct page *page)
 	kunmap_atomic(kaddr);
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/* THP aware, the ranges may span all the subpages of a compound page */
+void zero_user_segments(struct page *page, unsigned start1, unsigned end1,
+		unsigned start2, unsigned end2);
+#else
 static inline void zero_user_segments(struct page *page,
 	unsigned start1, unsigned end1,
 	unsigned start2, unsigned end2)
@@ -301,6 +306,7 @@ static inline void zero_user_segments(struct page *page,
 	kunmap_atomic(kaddr);
 	flush_dcache_page(page);
 }
+#endif
 
 static inline void zero_user_segment(struct page *page,
 	unsigned start, unsigned end)
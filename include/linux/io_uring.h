@@ -22,6 +22,9 @@ struct io_identity {
 	refcount_t			count;
 };
 
+/* size of the per-task table of registered ring files */
+#define IO_RINGFD_REG_MAX	16
+
 struct io_uring_task {
 	/* submission side */
 	struct xarray		xa;
@@ -32,9 +35,39 @@ struct io_uring_task {
 	struct io_identity	*identity;
 	atomic_t		in_idle;
 	bool			sqpoll;
+	/* rings registered through IORING_REGISTER_RING_FDS */
+	struct file		*registered_rings[IO_RINGFD_REG_MAX];
+};
+
+/* issue_flags passed to file_operations->uring_cmd() */
+enum io_uring_cmd_flags {
+	IO_URING_F_NONBLOCK		= 1,
+	/* the SQE is 128 bytes, ->cmd holds 80 bytes of payload */
+	IO_URING_F_SQE128		= 2,
+	/* the CQE is 32 bytes, io_uring_cmd_done() res2 gets posted */
+	IO_URING_F_CQE32		= 4,
+};
+
+/*
+ * Handed to file_operations->uring_cmd() for IORING_OP_URING_CMD. The driver
+ * either returns the result right away or returns -EIOCBQUEUED and completes
+ * the command later through io_uring_cmd_done(). pdu is scratch space owned
+ * by the driver while the command is in flight.
+ */
+struct io_uring_cmd {
+	struct file	*file;
+	const void	*cmd;
+	/* callback to defer completions to task context */
+	void (*task_work_cb)(struct io_uring_cmd *cmd);
+	u32		cmd_op;
+	u32		pad;
+	u8		pdu[32];
 };
 
 #if defined(CONFIG_IO_URING)
+void io_uring_cmd_done(struct io_uring_cmd *cmd, ssize_t ret, ssize_t res2);
+void io_uring_cmd_complete_in_task(struct io_uring_cmd *ioucmd,
+			void (*task_work_cb)(struct io_uring_cmd *));
 struct sock *io_uring_get_socket(struct file *file);
 void __io_uring_task_cancel(void);
 void __io_uring_files_cancel(struct files_struct *files);
@@ -56,6 +89,14 @@ static inline void io_uring_free(struct task_struct *tsk)
 		__io_uring_free(tsk);
 }
 #else
+static inline void io_uring_cmd_done(struct io_uring_cmd *cmd, ssize_t ret,
+		ssize_t ret2)
+{
+}
+static inline void io_uring_cmd_complete_in_task(struct io_uring_cmd *ioucmd,
+			void (*task_work_cb)(struct io_uring_cmd *))
+{
+}
 static inline struct sock *io_uring_get_socket(struct file *file)
 {
 	return NULL;
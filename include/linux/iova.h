@@ -25,13 +25,18 @@ struct iova {
 struct iova_magazine;
 struct iova_cpu_rcache;
 
-#define IOVA_RANGE_CACHE_MAX_SIZE 6	/* log of max cached IOVA range size (in pages) */
-#define MAX_GLOBAL_MAGS 32	/* magazines per bin */
+#define IOVA_RANGE_CACHE_DEFAULT_SIZE 6	/* log of max cached IOVA range size (in pages) */
+#define IOVA_RANGE_CACHE_MAX_SIZE 11	/* upper limit of iova.rcache_size= */
+#define MAX_GLOBAL_MAGS 32	/* magazines per bin and NUMA node */
 
-struct iova_rcache {
+struct iova_rcache_depot {
 	spinlock_t lock;
 	unsigned long depot_size;
 	struct iova_magazine *depot[MAX_GLOBAL_MAGS];
+};
+
+struct iova_rcache {
+	struct iova_rcache_depot **depots;	/* indexed by NUMA node */
 	struct iova_cpu_rcache __percpu *cpu_rcaches;
 };
 
@@ -40,6 +45,11 @@ struct iova_domain;
 /* Call-Back from IOVA code into IOMMU drivers */
 typedef void (* iova_flush_cb)(struct iova_domain *domain);
 
+/* Same, but only the pfns in [start_pfn, end_pfn] need flushing */
+typedef void (* iova_flush_range_cb)(struct iova_domain *domain,
+				     unsigned long start_pfn,
+				     unsigned long end_pfn);
+
 /* Destructor for per-entry data */
 typedef void (* iova_entry_dtor)(unsigned long data);
 
@@ -62,6 +72,8 @@ struct iova_fq {
 	struct iova_fq_entry entries[IOVA_FQ_SIZE];
 	unsigned head, tail;
 	spinlock_t lock;
+	/* Span of the entries queued since the last range flush */
+	unsigned long flush_pfn_lo, flush_pfn_hi;
 };
 
 /* holds all the iova translations for a domain */
@@ -84,10 +96,15 @@ struct iova_domain {
 
 	struct iova	anchor;		/* rbtree lookup anchor */
 	struct iova_rcache rcaches[IOVA_RANGE_CACHE_MAX_SIZE];	/* IOVA range caches */
+	unsigned int	rcache_size;	/* log of max cached IOVA range size,
+					   rcaches above it are not set up */
 
 	iova_flush_cb	flush_cb;	/* Call-Back function to flush IOMMU
 					   TLBs */
 
+	iova_flush_range_cb flush_range_cb; /* Optional, flushes only the
+					   span queued since the last flush */
+
 	iova_entry_dtor entry_dtor;	/* IOMMU driver specific destructor for
 					   iova entry */
 
@@ -157,7 +174,8 @@ void init_iova_domain(struct iova_domain *iovad, unsigned long granule,
 	unsigned long start_pfn);
 bool has_iova_flush_queue(struct iova_domain *iovad);
 int init_iova_flush_queue(struct iova_domain *iovad,
-			  iova_flush_cb flush_cb, iova_entry_dtor entry_dtor);
+			  iova_flush_cb flush_cb, iova_flush_range_cb flush_range_cb,
+			  iova_entry_dtor entry_dtor);
 struct iova *find_iova(struct iova_domain *iovad, unsigned long pfn);
 void put_iova_domain(struct iova_domain *iovad);
 struct iova *split_and_remove_iova(struct iova_domain *iovad,
@@ -243,6 +261,7 @@ static inline bool has_iova_flush_queue(struct iova_domain *iovad)
 
 static inline int init_iova_flush_queue(struct iova_domain *iovad,
 					iova_flush_cb flush_cb,
+					iova_flush_range_cb flush_range_cb,
 					iova_entry_dtor entry_dtor)
 {
 	return -ENODEV;
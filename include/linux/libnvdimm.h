@@ -130,6 +130,17 @@ struct nd_region_desc {
 	int (*flush)(struct nd_region *nd_region, struct bio *bio);
 };
 
+/**
+ * struct nvdimm_flush_req - a queued request for a region flush
+ * @list: entry in the region's queue of pending requests
+ * @end: called from process context with the result of a flush that
+ *	 started after the request was queued
+ */
+struct nvdimm_flush_req {
+	struct list_head list;
+	void (*end)(struct nvdimm_flush_req *req, int rc);
+};
+
 struct device;
 void *devm_nvdimm_memremap(struct device *dev, resource_size_t offset,
 		size_t size, unsigned long flags);
@@ -304,6 +315,8 @@ void nd_region_release_lane(struct nd_region *nd_region, unsigned int lane);
 u64 nd_fletcher64(void *addr, size_t len, bool le);
 int nvdimm_flush(struct nd_region *nd_region, struct bio *bio);
 int generic_nvdimm_flush(struct nd_region *nd_region);
+void nvdimm_flush_async(struct nd_region *nd_region,
+		struct nvdimm_flush_req *req);
 int nvdimm_has_flush(struct nd_region *nd_region);
 int nvdimm_has_cache(struct nd_region *nd_region);
 int nvdimm_in_overwrite(struct nvdimm *nvdimm);
@@ -28,6 +28,9 @@
 #include <linux/security.h>
 #include <linux/init.h>
 #include <linux/rculist.h>
+#include <linux/static_call.h>
+#include <linux/jump_label.h>
+#include <linux/lsm_count.h>
 
 /**
  * union security_list_options - Linux Security Module hook function list
@@ -1537,21 +1540,45 @@ union security_list_options {
 	#define LSM_HOOK(RET, DEFAULT, NAME, ...) RET (*NAME)(__VA_ARGS__);
 	#include "lsm_hook_defs.h"
 	#undef LSM_HOOK
+	void *lsm_func_addr;
 };
 
-struct security_hook_heads {
-	#define LSM_HOOK(RET, DEFAULT, NAME, ...) struct hlist_head NAME;
+/*
+ * Every hook has MAX_LSM_COUNT static call slots, which are filled in LSM
+ * initialization order, so the hooks of the stacked LSMs are called in the
+ * same order as with the former hook lists.
+ *
+ * @key: the static call key, as defined by STATIC_CALL_KEY()
+ * @trampoline: the static call trampoline, as defined by STATIC_CALL_TRAMP()
+ * @hl: the security_hook_list of the LSM using this slot, if any
+ * @active: enabled while the slot has a hook that is to be called
+ */
+struct lsm_static_call {
+	struct static_call_key		*key;
+	void				*trampoline;
+	struct security_hook_list	*hl;
+	struct static_key_false		*active;
+} __randomize_layout;
+
+/*
+ * Table of the static calls of all the LSM hooks, see
+ * include/linux/lsm_hook_defs.h.
+ */
+struct lsm_static_calls_table {
+	#define LSM_HOOK(RET, DEFAULT, NAME, ...) \
+		struct lsm_static_call NAME[MAX_LSM_COUNT];
 	#include "lsm_hook_defs.h"
 	#undef LSM_HOOK
 } __randomize_layout;
 
 /*
  * Security module hook list structure.
- * For use with generic list macros for common operations.
+ * @scalls: the static call slots of the hook
+ * @hook: the hook function
+ * @lsm: the name of the LSM providing the hook
  */
 struct security_hook_list {
-	struct hlist_node		list;
-	struct hlist_head		*head;
+	struct lsm_static_call		*scalls;
 	union security_list_options	hook;
 	char				*lsm;
 } __randomize_layout;
@@ -1580,10 +1607,10 @@ struct lsm_blob_sizes {
  * care of the common case and reduces the amount of
  * text involved.
  */
-#define LSM_HOOK_INIT(HEAD, HOOK) \
-	{ .head = &security_hook_heads.HEAD, .hook = { .HEAD = HOOK } }
+#define LSM_HOOK_INIT(NAME, HOOK) \
+	{ .scalls = static_calls_table.NAME, .hook = { .NAME = HOOK } }
 
-extern struct security_hook_heads security_hook_heads;
+extern struct lsm_static_calls_table static_calls_table __ro_after_init;
 extern char *lsm_names;
 
 extern void security_add_hooks(struct security_hook_list *hooks, int count,
@@ -1635,10 +1662,22 @@ extern struct lsm_info __start_early_lsm_info[], __end_early_lsm_info[];
 static inline void security_delete_hooks(struct security_hook_list *hooks,
 						int count)
 {
-	int i;
+	struct lsm_static_call *scall;
+	int i, j;
 
-	for (i = 0; i < count; i++)
-		hlist_del_rcu(&hooks[i].list);
+	/*
+	 * The static call keeps pointing at the hook, only its slot is
+	 * switched off.
+	 */
+	for (i = 0; i < count; i++) {
+		for (j = 0; j < MAX_LSM_COUNT; j++) {
+			scall = &hooks[i].scalls[j];
+			if (scall->hl == &hooks[i]) {
+				static_branch_disable(scall->active);
+				break;
+			}
+		}
+	}
 }
 #endif /* CONFIG_SECURITY_SELINUX_DISABLE */
 
@@ -9,6 +9,19 @@
 static inline void mmap_init_lock(struct mm_struct *mm)
 {
 	init_rwsem(&mm->mmap_lock);
+#ifdef CONFIG_PER_VMA_LOCK
+	mm->mm_lock_seq = 0;
+#endif
+}
+
+/* Drop all the VMA write locks taken in this mmap_lock write section */
+static inline void vma_end_write_all(struct mm_struct *mm)
+{
+#ifdef CONFIG_PER_VMA_LOCK
+	lockdep_assert_held_write(&mm->mmap_lock);
+	/* pairs with the smp_load_acquire() in vma_start_read() */
+	smp_store_release(&mm->mm_lock_seq, mm->mm_lock_seq + 1);
+#endif
 }
 
 static inline void mmap_write_lock(struct mm_struct *mm)
@@ -33,11 +46,13 @@ static inline bool mmap_write_trylock(struct mm_struct *mm)
 
 static inline void mmap_write_unlock(struct mm_struct *mm)
 {
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_lock);
 }
 
 static inline void mmap_write_downgrade(struct mm_struct *mm)
 {
+	vma_end_write_all(mm);
 	downgrade_write(&mm->mmap_lock);
 }
 
@@ -3,6 +3,15 @@
 #define _LINUX_MMZONE_H
 
 #ifndef __ASSEMBLY__
+
+/*
+ * The number of generations tracked by each lruvec when the multi-gen LRU is
+ * in use. These are needed by kernel/bounds.c to size the generation field in
+ * page->flags.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
 #ifndef __GENERATING_BOUNDS_H
 
 #include <linux/spinlock.h>
@@ -113,9 +122,8 @@ static inline bool free_area_empty(struct free_area *area, int migratetype)
 struct pglist_data;
 
 /*
- * zone->lock and the zone lru_lock are two of the hottest locks in the kernel.
- * So add a wild amount of padding here to ensure that they fall into separate
- * cachelines.  There are very few zone structures in the machine, so space
+ * Add a wild amount of padding here to ensure that hot fields fall into
+ * separate cachelines.  There are very few zone structures in the machine, so space
  * consumption is not a concern here.
  */
 #if defined(CONFIG_SMP)
@@ -206,6 +214,10 @@ enum node_stat_item {
 	NR_KERNEL_STACK_KB,	/* measured in KiB */
 #if IS_ENABLED(CONFIG_SHADOW_CALL_STACK)
 	NR_KERNEL_SCS_KB,	/* measured in KiB */
+#endif
+#ifdef CONFIG_NUMA_BALANCING
+	PGPROMOTE_SUCCESS,	/* pages promoted to a top tier node */
+	PGPROMOTE_CANDIDATE,	/* pages considered for promotion */
 #endif
 	NR_VM_NODE_STAT_ITEMS
 };
@@ -274,8 +286,61 @@ enum lruvec_flags {
 					 */
 };
 
+struct lruvec;
+
+#ifdef CONFIG_LRU_GEN
+/*
+ * The multi-gen LRU sorts the pages of an lruvec into generations, each of
+ * them holding the pages found accessed by the same aging pass. The youngest
+ * generation is max_seq and the oldest one is min_seq of the respective type;
+ * a page stores (max_seq % MAX_NR_GENS) + 1 in page->flags when it's promoted
+ * by the aging, which walks the page tables of the processes charged to the
+ * lruvec, and the eviction reclaims from min_seq. Within the two youngest
+ * generations pages are reported as active, and as inactive otherwise.
+ */
+enum {
+	LRU_GEN_ANON,
+	LRU_GEN_FILE,
+};
+
+struct lru_gen_struct {
+	/* the aging increments the youngest generation number */
+	unsigned long max_seq;
+	/* the eviction increments the oldest generation numbers */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* the multi-gen LRU lists, per generation, type and zone */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the sizes of the above lists, lazily updated by the aging */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* whether a page table walk is in progress for this lruvec */
+	bool aging;
+	/* whether the multi-gen LRU lists are in use by this lruvec */
+	bool enabled;
+};
+
+void lru_gen_init_lruvec(struct lruvec *lruvec);
+#ifdef CONFIG_MEMCG
+void lru_gen_online_memcg(struct mem_cgroup *memcg);
+#endif
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+
+#ifdef CONFIG_MEMCG
+static inline void lru_gen_online_memcg(struct mem_cgroup *memcg)
+{
+}
+#endif
+
+#endif /* CONFIG_LRU_GEN */
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
+	/* per lruvec lru_lock for memcg */
+	spinlock_t			lru_lock;
 	/*
 	 * These track the cost of reclaiming one LRU - file or anon -
 	 * over the other. As the observed cost of reclaiming one LRU
@@ -292,6 +357,10 @@ struct lruvec {
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
+#ifdef CONFIG_LRU_GEN
+	/* evictable pages, when the multi-gen LRU is in use */
+	struct lru_gen_struct		lrugen;
+#endif
 };
 
 /* Isolate unmapped pages */
@@ -316,13 +385,31 @@ enum zone_watermarks {
 #define high_wmark_pages(z) (z->_watermark[WMARK_HIGH] + z->watermark_boost)
 #define wmark_pages(z, i) (z->_watermark[i] + z->watermark_boost)
 
+/*
+ * One list per migrate type for each order up to PAGE_ALLOC_COSTLY_ORDER,
+ * plus one for pageblock_order pages backing THPs.
+ */
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#define NR_PCP_THP 1
+#else
+#define NR_PCP_THP 0
+#endif
+#define NR_PCP_LISTS (MIGRATE_PCPTYPES * (PAGE_ALLOC_COSTLY_ORDER + 1 + NR_PCP_THP))
+
+/*
+ * Pages on the pcp lists carry their order next to the migrate type in
+ * page->index while being drained.
+ */
+#define NR_PCP_ORDER_WIDTH 8
+#define NR_PCP_ORDER_MASK ((1<<NR_PCP_ORDER_WIDTH) - 1)
+
 struct per_cpu_pages {
-	int count;		/* number of pages in the list */
+	int count;		/* number of base pages in the lists */
 	int high;		/* high watermark, emptying needed */
 	int batch;		/* chunk size for buddy add/remove */
 
-	/* Lists of pages, one per migrate type stored on the pcp-lists */
-	struct list_head lists[MIGRATE_PCPTYPES];
+	/* Lists of pages, one per migrate type and order on the pcp-lists */
+	struct list_head lists[NR_PCP_LISTS];
 };
 
 struct per_cpu_pageset {
@@ -776,7 +863,6 @@ typedef struct pglist_data {
 
 	/* Write-intensive fields used by page reclaim */
 	ZONE_PADDING(_pad1_)
-	spinlock_t		lru_lock;
 
 #ifdef CONFIG_DEFERRED_STRUCT_PAGE_INIT
 	/*
@@ -790,6 +876,13 @@ typedef struct pglist_data {
 	struct deferred_split deferred_split_queue;
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING
+	/* start in ms of the current promotion rate limit period */
+	unsigned int nbp_rl_start;
+	/* PGPROMOTE_CANDIDATE at the start of the rate limit period */
+	unsigned long nbp_rl_nr_cand;
+#endif
+
 	/* Fields commonly accessed by the page reclaim scanner */
 
 	/*
@@ -240,6 +240,7 @@ struct nfs_server {
 	void (*destroy)(struct nfs_server *);
 
 	atomic_t active; /* Keep trace of any activity to this server */
+	atomic_t readdir_prefetch; /* READPLUS-driven prefetches in flight */
 
 	/* mountd-related mount options */
 	struct sockaddr_storage	mountd_address;
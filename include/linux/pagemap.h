@@ -30,6 +30,7 @@ enum mapping_flags {
 	/* writeback related tags are not used */
 	AS_NO_WRITEBACK_TAGS = 5,
 	AS_THP_SUPPORT = 6,	/* THPs supported */
+	AS_THP_READAHEAD = 7,	/* THPs read ahead while not open for write */
 };
 
 /**
@@ -126,6 +127,23 @@ static inline bool mapping_thp_support(struct address_space *mapping)
 	return test_bit(AS_THP_SUPPORT, &mapping->flags);
 }
 
+/*
+ * The filesystem can read a THP through ->readpage() or ->readahead(),
+ * letting readahead allocate THPs for the file as long as it is not open
+ * for write. Like khugepaged collapsed read-only THPs, they are truncated
+ * when the file is opened for write.
+ */
+static inline void mapping_set_thp_readahead(struct address_space *mapping)
+{
+	if (IS_ENABLED(CONFIG_READ_ONLY_THP_FOR_FS))
+		set_bit(AS_THP_READAHEAD, &mapping->flags);
+}
+
+static inline bool mapping_thp_readahead(struct address_space *mapping)
+{
+	return test_bit(AS_THP_READAHEAD, &mapping->flags);
+}
+
 static inline int filemap_nr_thps(struct address_space *mapping)
 {
 #ifdef CONFIG_READ_ONLY_THP_FOR_FS
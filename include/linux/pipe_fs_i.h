@@ -3,6 +3,7 @@
 #define _LINUX_PIPE_FS_I_H
 
 #define PIPE_DEF_BUFFERS	16
+#define PIPE_MAX_PAGE_ORDER	4	/* upper bound for fs.pipe-page-order */
 
 #define PIPE_BUF_FLAG_LRU	0x01	/* page is on the LRU */
 #define PIPE_BUF_FLAG_ATOMIC	0x02	/* was atomically mapped */
@@ -239,6 +240,7 @@ void pipe_unlock(struct pipe_inode_info *);
 void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size;
+extern unsigned int pipe_page_order;
 extern unsigned long pipe_user_pages_hard;
 extern unsigned long pipe_user_pages_soft;
 
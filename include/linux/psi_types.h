@@ -134,6 +134,12 @@ struct psi_trigger {
 };
 
 struct psi_group {
+	/*
+	 * Pressure accounting for the group; when off, only the per-cpu
+	 * task counts are maintained (cgroup.pressure)
+	 */
+	bool enabled;
+
 	/* Protects data used by the aggregator */
 	struct mutex avgs_lock;
 
@@ -55,6 +55,14 @@ static inline void kvfree_call_rcu(struct rcu_head *head, rcu_callback_t func)
 	kvfree((void *) func);
 }
 
+/* Tiny RCU has no grace-period machinery worth batching for. */
+static inline void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	call_rcu(head, func);
+}
+
+static inline void rcu_lazy_flush_all(void) { }
+
 void rcu_qs(void);
 
 static inline void rcu_softirq_qs(void)
@@ -34,6 +34,8 @@ static inline void rcu_virt_note_context_switch(int cpu)
 
 void synchronize_rcu_expedited(void);
 void kvfree_call_rcu(struct rcu_head *head, rcu_callback_t func);
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func);
+void rcu_lazy_flush_all(void);
 
 void rcu_barrier(void);
 bool rcu_eqs_special_set(int cpu);
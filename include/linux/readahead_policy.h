@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_READAHEAD_POLICY_H
+#define _LINUX_READAHEAD_POLICY_H
+
+#include <linux/fs.h>
+
+#define RA_POLICY_NAME_MAX	16
+
+/**
+ * struct ra_policy_ctx - a readahead decision handed to the policy
+ * @file: file being read, may be NULL
+ * @index: page the reader wants
+ * @req_count: number of pages the reader wants
+ * @max_pages: largest window the policy may ask for
+ * @async: true if the reader hit the readahead marker
+ * @history: indexes of the previous readahead decisions, latest first
+ * @start: first page of the window to read
+ * @size: number of pages to read from @start
+ * @async_size: start the next readahead when this many pages are left
+ *
+ * @start, @size and @async_size hold the current readahead window on
+ * entry and are the only fields the policy may write.
+ */
+struct ra_policy_ctx {
+	struct file *file;
+	pgoff_t index;
+	unsigned long req_count;
+	unsigned long max_pages;
+	bool async;
+	pgoff_t history[RA_HISTORY_LEN];
+
+	pgoff_t start;
+	unsigned long size;
+	unsigned long async_size;
+};
+
+struct readahead_policy_ops {
+	/*
+	 * Return true to read the window set in @ctx, false to fall back to
+	 * the default heuristic.  A zero size reads nothing ahead.
+	 */
+	bool (*get_window)(struct ra_policy_ctx *ctx);
+
+	char name[RA_POLICY_NAME_MAX];
+};
+
+int readahead_register_policy(struct readahead_policy_ops *ops);
+void readahead_unregister_policy(struct readahead_policy_ops *ops);
+
+#endif /* _LINUX_READAHEAD_POLICY_H */
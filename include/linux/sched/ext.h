@@ -0,0 +1,100 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef _LINUX_SCHED_EXT_H
+#define _LINUX_SCHED_EXT_H
+
+#include <linux/list.h>
+#include <linux/types.h>
+
+#ifdef CONFIG_SCHED_CLASS_EXT
+
+struct task_struct;
+struct scx_dispatch_q;
+
+/*
+ * Dispatch queue ids.  The BPF scheduler creates sched_ext_ops::nr_dsqs
+ * queues of its own, numbered from 0.  Besides those there is a global
+ * queue, which any CPU consumes from, and the local queue of each CPU,
+ * which only that CPU runs tasks from.
+ */
+#define SCX_DSQ_GLOBAL		((u64)-1)
+#define SCX_DSQ_LOCAL		((u64)-2)
+
+#define SCX_DSQ_MAX		1024U
+
+/* Default time slice and watchdog timeout */
+#define SCX_SLICE_DFL		(20 * NSEC_PER_MSEC)
+#define SCX_TIMEOUT_DFL_MS	30000U
+
+/* sched_ext_ops::enqueue() flags */
+#define SCX_ENQ_WAKEUP		(1ULL << 0)	/* the task just woke up */
+#define SCX_ENQ_EXPIRED		(1ULL << 1)	/* the task used up its slice */
+
+#define SCX_OPS_NAME_LEN	32
+
+/**
+ * struct sched_ext_entity - per-task state of the ext scheduling class
+ * @dsq_node: link on @dsq
+ * @runnable_node: link on the runnable list of the task's rq
+ * @dsq: dispatch queue the task is on, NULL while running or in transit
+ * @slice: time left before the task is handed back to the BPF scheduler,
+ *	   in nanoseconds.  The BPF scheduler may change it.
+ * @runnable_at: jiffies when the task last became runnable, for the watchdog
+ * @holding_cpu: CPU migrating the task from a shared dispatch queue
+ * @flags: SCX_TASK_* flags
+ */
+struct sched_ext_entity {
+	struct list_head	dsq_node;
+	struct list_head	runnable_node;
+	struct scx_dispatch_q	*dsq;
+	u64			slice;
+	unsigned long		runnable_at;
+	s32			holding_cpu;
+	u32			flags;
+};
+
+/**
+ * struct sched_ext_ops - a BPF scheduler
+ *
+ * All callbacks are optional and called with the rq lock held, so they
+ * must not sleep.  Tasks are FIFO within a dispatch queue.
+ */
+struct sched_ext_ops {
+	/*
+	 * Pick the CPU @p wakes up on.  Defaults to an idle CPU, or to
+	 * @prev_cpu if there is none.
+	 */
+	s32 (*select_cpu)(struct task_struct *p, s32 prev_cpu, u64 wake_flags);
+
+	/*
+	 * @p becomes runnable on the CPU picked above.  Return the id of the
+	 * dispatch queue to put it on.  Defaults to SCX_DSQ_GLOBAL.
+	 */
+	u64 (*enqueue)(struct task_struct *p, u64 enq_flags);
+
+	/*
+	 * The local queue of @cpu ran dry.  Return the id of the dispatch
+	 * queue @cpu takes its next task from.  The global queue is tried
+	 * after that.
+	 */
+	u64 (*dispatch)(s32 cpu);
+
+	/* Called every scheduler tick while @p runs.  Clear its slice to preempt. */
+	void (*tick)(struct task_struct *p);
+
+	/* Number of dispatch queues to create, at most SCX_DSQ_MAX */
+	u32 nr_dsqs;
+
+	/*
+	 * Fall back to CFS when a task stays runnable without running for
+	 * this long.  Defaults to SCX_TIMEOUT_DFL_MS.
+	 */
+	u32 timeout_ms;
+
+	char name[SCX_OPS_NAME_LEN];
+};
+
+int scx_ops_enable(struct sched_ext_ops *ops);
+void scx_ops_disable(struct sched_ext_ops *ops);
+
+#endif /* CONFIG_SCHED_CLASS_EXT */
+#endif /* _LINUX_SCHED_EXT_H */
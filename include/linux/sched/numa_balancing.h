@@ -7,6 +7,7 @@
  * implements memory access pattern based NUMA-balancing:
  */
 
+#include <linux/jump_label.h>
 #include <linux/sched.h>
 
 #define TNF_MIGRATED	0x01
@@ -44,4 +45,32 @@ static inline bool should_numa_migrate_memory(struct task_struct *p,
 }
 #endif
 
+#ifdef CONFIG_NUMA_BALANCING_PMU
+DECLARE_STATIC_KEY_FALSE(numa_sample_active);
+
+static inline bool numa_sample_enabled(void)
+{
+	return static_branch_unlikely(&numa_sample_active);
+}
+
+extern int numa_sample_set_state(bool enabled);
+extern void init_numa_sample(struct task_struct *p);
+extern void task_numa_sample_tick(struct task_struct *curr);
+#else
+static inline bool numa_sample_enabled(void)
+{
+	return false;
+}
+static inline int numa_sample_set_state(bool enabled)
+{
+	return enabled ? -EOPNOTSUPP : 0;
+}
+static inline void init_numa_sample(struct task_struct *p)
+{
+}
+static inline void task_numa_sample_tick(struct task_struct *curr)
+{
+}
+#endif
+
 #endif /* _LINUX_SCHED_NUMA_BALANCING_H */
@@ -33,6 +33,8 @@ struct kernel_clone_args {
 	int cgroup;
 	struct cgroup *cgrp;
 	struct css_set *cset;
+	/* spawn(2): work that execs in the child, owned by it once queued */
+	struct callback_head *spawn_work;
 };
 
 /*
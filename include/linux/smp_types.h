@@ -6,6 +6,7 @@
 
 enum {
 	CSD_FLAG_LOCK		= 0x01,
+	CSD_FLAG_SHARED		= 0x02, /* ->info is a struct cfd_request */
 
 	IRQ_WORK_PENDING	= 0x01,
 	IRQ_WORK_BUSY		= 0x02,
@@ -47,6 +47,7 @@ struct stat64;
 struct statfs;
 struct statfs64;
 struct statx;
+struct dirent_statx;
 struct sysinfo;
 struct timespec;
 struct __kernel_old_timeval;
@@ -68,6 +69,8 @@ union bpf_attr;
 struct io_uring_params;
 struct clone_args;
 struct open_how;
+struct futex_waitv;
+struct spawn_args;
 
 #include <linux/types.h>
 #include <linux/aio_abi.h>
@@ -482,6 +485,10 @@ asmlinkage long sys_quotactl(unsigned int cmd, const char __user *special,
 asmlinkage long sys_getdents64(unsigned int fd,
 				struct linux_dirent64 __user *dirent,
 				unsigned int count);
+asmlinkage long sys_getdents_statx(unsigned int fd,
+				struct dirent_statx __user *dirent,
+				unsigned int count, unsigned int flags,
+				unsigned int mask);
 
 /* fs/read_write.c */
 asmlinkage long sys_llseek(unsigned int fd, unsigned long offset_high,
@@ -607,6 +614,10 @@ asmlinkage long sys_futex(u32 __user *uaddr, int op, u32 val,
 asmlinkage long sys_futex_time32(u32 __user *uaddr, int op, u32 val,
 			struct old_timespec32 __user *utime, u32 __user *uaddr2,
 			u32 val3);
+asmlinkage long sys_futex_waitv(struct futex_waitv __user *waiters,
+				unsigned int nr_futexes, unsigned int flags,
+				struct __kernel_timespec __user *timeout,
+				clockid_t clockid);
 asmlinkage long sys_get_robust_list(int pid,
 				    struct robust_list_head __user * __user *head_ptr,
 				    size_t __user *len_ptr);
@@ -999,6 +1010,7 @@ asmlinkage long sys_bpf(int cmd, union bpf_attr *attr, unsigned int size);
 asmlinkage long sys_execveat(int dfd, const char __user *filename,
 			const char __user *const __user *argv,
 			const char __user *const __user *envp, int flags);
+asmlinkage long sys_spawn(struct spawn_args __user *uargs, size_t usize);
 asmlinkage long sys_userfaultfd(int flags);
 asmlinkage long sys_membarrier(int cmd, unsigned int flags, int cpu_id);
 asmlinkage long sys_mlock2(unsigned long start, size_t len, int flags);
@@ -256,6 +256,7 @@ struct bonding {
 	/* protecting ipsec_list */
 	spinlock_t ipsec_lock;
 #endif /* CONFIG_XFRM_OFFLOAD */
+	struct bpf_prog *xdp_prog;
 };
 
 #define bond_slave_get_rcu(dev) \
@@ -331,6 +332,13 @@ static inline bool bond_mode_uses_arp(int mode)
 	       mode != BOND_MODE_ALB;
 }
 
+/* modes whose slave selection doesn't need an skb */
+static inline bool bond_mode_can_use_xdp(int mode)
+{
+	return mode == BOND_MODE_ACTIVEBACKUP || mode == BOND_MODE_XOR ||
+	       mode == BOND_MODE_8023AD;
+}
+
 static inline bool bond_mode_uses_primary(int mode)
 {
 	return mode == BOND_MODE_ACTIVEBACKUP || mode == BOND_MODE_TLB ||
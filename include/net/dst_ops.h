@@ -2,6 +2,7 @@
 #ifndef _NET_DST_OPS_H
 #define _NET_DST_OPS_H
 #include <linux/types.h>
+#include <linux/gfp.h>
 #include <linux/percpu_counter.h>
 #include <linux/cache.h>
 
@@ -276,6 +276,9 @@ int fib_table_dump(struct fib_table *table, struct sk_buff *skb,
 int fib_table_flush(struct net *net, struct fib_table *table, bool flush_all);
 struct fib_table *fib_trie_unmerge(struct fib_table *main_tb);
 void fib_table_flush_external(struct fib_table *table);
+#ifdef CONFIG_IP_FIB_DIR24_8
+int fib_table_dir_set(struct fib_table *tb, bool enable);
+#endif
 void fib_free_table(struct fib_table *tb);
 
 #ifndef CONFIG_IP_MULTIPLE_TABLES
@@ -57,9 +57,41 @@ struct mptcp_out_options {
 #endif
 };
 
+#define MPTCP_SCHED_NAME_MAX		16
+#define MPTCP_SCHED_MAX_SUBFLOWS	8
+
+/* Subflows a packet scheduler can pick from: only the ones usable for
+ * sending data are listed, in the msk conn_list order.
+ */
+struct mptcp_sched_data {
+	struct sock	*subflows[MPTCP_SCHED_MAX_SUBFLOWS];
+	u8		nr_subflows;
+	u8		backup;		/* BIT(i) if subflows[i] is a backup */
+	u8		writable;	/* BIT(i) if subflows[i] has wspace */
+};
+
+struct mptcp_sched_ops {
+	/* return the index in @data->subflows of the subflow to send the
+	 * next burst on, or a negative value if none is suitable (required)
+	 */
+	int (*get_subflow)(const struct sock *sk,
+			   struct mptcp_sched_data *data);
+	/* initialize private data (optional) */
+	void (*init)(struct sock *sk);
+	/* cleanup private data  (optional) */
+	void (*release)(struct sock *sk);
+
+	char			name[MPTCP_SCHED_NAME_MAX];
+	struct module		*owner;
+	struct list_head	list;
+} ____cacheline_aligned_in_smp;
+
 #ifdef CONFIG_MPTCP
 extern struct request_sock_ops mptcp_subflow_request_sock_ops;
 
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched);
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched);
+
 void mptcp_init(void);
 
 static inline bool sk_is_mptcp(const struct sock *sk)
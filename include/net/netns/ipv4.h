@@ -172,6 +172,7 @@ struct netns_ipv4 {
 	int sysctl_tcp_wmem[3];
 	int sysctl_tcp_rmem[3];
 	int sysctl_tcp_comp_sack_nr;
+	int sysctl_tcp_migrate_req;
 	unsigned long sysctl_tcp_comp_sack_delay_ns;
 	unsigned long sysctl_tcp_comp_sack_slack_ns;
 	struct inet_timewait_death_row tcp_death_row;
@@ -218,6 +219,9 @@ struct netns_ipv4 {
 	int sysctl_fib_multipath_use_neigh;
 	int sysctl_fib_multipath_hash_policy;
 #endif
+#ifdef CONFIG_IP_FIB_DIR24_8
+	int sysctl_fib_dir24_8;
+#endif
 
 	struct fib_notifier_ops	*notifier_ops;
 	unsigned int	fib_seq;	/* protected by rtnl_mutex */
@@ -26,6 +26,10 @@
  * will either recycle the page, or in case of elevated refcnt, it
  * will release the DMA mapping and in-flight state accounting.  We
  * hope to lift this requirement in the future.
+ *
+ * Pages handed to the network stack inside an skb can stay in-flight
+ * instead of being released: marking the skb with skb_mark_for_recycle()
+ * makes skb_release_data() give them back to their page_pool.
  */
 #ifndef _NET_PAGE_POOL_H
 #define _NET_PAGE_POOL_H
@@ -33,6 +37,7 @@
 #include <linux/mm.h> /* Needed by ptr_ring */
 #include <linux/ptr_ring.h>
 #include <linux/dma-direction.h>
+#include <linux/poison.h>
 
 #define PP_FLAG_DMA_MAP		BIT(0) /* Should page_pool do the DMA
 					* map/unmap
@@ -152,6 +157,7 @@ struct page_pool *page_pool_create(const struct page_pool_params *params);
 void page_pool_destroy(struct page_pool *pool);
 void page_pool_use_xdp_mem(struct page_pool *pool, void (*disconnect)(void *));
 void page_pool_release_page(struct page_pool *pool, struct page *page);
+bool page_pool_return_skb_page(struct page *page);
 #else
 static inline void page_pool_destroy(struct page_pool *pool)
 {
@@ -165,6 +171,11 @@ static inline void page_pool_release_page(struct page_pool *pool,
 					  struct page *page)
 {
 }
+
+static inline bool page_pool_return_skb_page(struct page *page)
+{
+	return false;
+}
 #endif
 
 void page_pool_put_page(struct page_pool *pool, struct page *page,
@@ -204,6 +215,14 @@ static inline void page_pool_set_dma_addr(struct page *page, dma_addr_t addr)
 		page->dma_addr[1] = upper_32_bits(addr);
 }
 
+/* Whether @page was handed out by a page_pool and is still owned by it.
+ * The pfmemalloc bit is masked out, it is checked again on recycling.
+ */
+static inline bool page_is_page_pool(struct page *page)
+{
+	return (page->pp_magic & ~0x3UL) == PP_SIGNATURE;
+}
+
 static inline bool is_page_pool_compiled_in(void)
 {
 #ifdef CONFIG_PAGE_POOL
@@ -220,6 +220,14 @@ static inline void reqsk_queue_removed(struct request_sock_queue *queue,
 	atomic_dec(&queue->qlen);
 }
 
+static inline void reqsk_queue_migrated(struct request_sock_queue *queue,
+					 const struct request_sock *req)
+{
+	if (req->num_timeout == 0)
+		atomic_inc(&queue->young);
+	atomic_inc(&queue->qlen);
+}
+
 static inline void reqsk_queue_added(struct request_sock_queue *queue)
 {
 	atomic_inc(&queue->young);
@@ -7,6 +7,7 @@
 #define __LINUX_NET_XDP_H__
 
 #include <linux/skbuff.h> /* skb_shared_info */
+#include <uapi/linux/bpf.h> /* enum xdp_rss_hash_type */
 
 /**
  * DOC: XDP RX-queue information
@@ -53,12 +54,28 @@ struct xdp_mem_info {
 };
 
 struct page_pool;
+struct xdp_buff;
+
+/* RX descriptor hints exposed to XDP programs through the
+ * bpf_xdp_metadata_rx_*() helpers.  The callbacks run from the driver
+ * NAPI poll, with @xdp pointing at the buffer the driver built, so they
+ * may recover their own wrapping structure.  Return -ENODATA when the
+ * hint is missing for this packet.
+ */
+struct xdp_metadata_ops {
+	int	(*xmo_rx_timestamp)(const struct xdp_buff *xdp, u64 *timestamp);
+	int	(*xmo_rx_hash)(const struct xdp_buff *xdp, u32 *hash,
+			       enum xdp_rss_hash_type *rss_type);
+	int	(*xmo_rx_vlan_tag)(const struct xdp_buff *xdp, __be16 *vlan_proto,
+				   u16 *vlan_tci);
+};
 
 struct xdp_rxq_info {
 	struct net_device *dev;
 	u32 queue_index;
 	u32 reg_state;
 	struct xdp_mem_info mem;
+	const struct xdp_metadata_ops *metadata_ops;
 } ____cacheline_aligned; /* perf critical, avoid false-sharing */
 
 struct xdp_txq_info {
@@ -219,6 +236,17 @@ int xdp_rxq_info_reg_mem_model(struct xdp_rxq_info *xdp_rxq,
 			       enum xdp_mem_type type, void *allocator);
 void xdp_rxq_info_unreg_mem_model(struct xdp_rxq_info *xdp_rxq);
 
+/* Called by drivers after xdp_rxq_info_reg() when the xdp_buffs they build
+ * for this queue carry the context needed by @ops.  Queues registered by
+ * the core for generic XDP never set it.
+ */
+static inline void
+xdp_rxq_info_set_metadata_ops(struct xdp_rxq_info *xdp_rxq,
+			      const struct xdp_metadata_ops *ops)
+{
+	xdp_rxq->metadata_ops = ops;
+}
+
 /* Drivers not supporting XDP metadata can use this helper, which
  * rejects any room expansion for metadata as a result.
  */
@@ -50,6 +50,7 @@ struct xdp_sock {
 	struct xsk_buff_pool *pool;
 	u16 queue_id;
 	bool zc;
+	bool sg;
 	enum {
 		XSK_READY = 0,
 		XSK_BOUND,
@@ -58,6 +59,8 @@ struct xdp_sock {
 
 	struct xsk_queue *tx ____cacheline_aligned_in_smp;
 	struct list_head tx_list;
+	/* Multi-buffer packet being built by the copy mode Tx path */
+	struct sk_buff *skb;
 	/* Protects generic receive. */
 	spinlock_t rx_lock;
 
@@ -166,6 +166,9 @@ struct xfrm_state {
 
 	u32			genid;
 
+	/* cpu this SA is used for, UINT_MAX if it is shared by all */
+	u32			pcpu_num;
+
 	/* Key manager bits */
 	struct xfrm_state_walk	km;
 
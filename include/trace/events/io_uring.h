@@ -460,6 +460,50 @@ TRACE_EVENT(io_uring_task_run,
 			  (unsigned long long) __entry->user_data)
 );
 
+/**
+ * io_uring_req_latency - called when posting a CQE for a request being
+ *			  tracked with IORING_REGISTER_LAT_STATS
+ *
+ * @ctx:		pointer to a ring context structure
+ * @opcode:		opcode of request
+ * @user_data:		user data associated with the request
+ * @queue_ns:		time from submission to the issue that completed
+ * @exec_ns:		time from that issue to posting the CQE
+ * @total_ns:		time from submission to posting the CQE
+ */
+TRACE_EVENT(io_uring_req_latency,
+
+	TP_PROTO(void *ctx, u8 opcode, u64 user_data, u64 queue_ns,
+		 u64 exec_ns, u64 total_ns),
+
+	TP_ARGS(ctx, opcode, user_data, queue_ns, exec_ns, total_ns),
+
+	TP_STRUCT__entry (
+		__field(  void *,	ctx		)
+		__field(  u8,		opcode		)
+		__field(  u64,		user_data	)
+		__field(  u64,		queue_ns	)
+		__field(  u64,		exec_ns		)
+		__field(  u64,		total_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->ctx		= ctx;
+		__entry->opcode		= opcode;
+		__entry->user_data	= user_data;
+		__entry->queue_ns	= queue_ns;
+		__entry->exec_ns	= exec_ns;
+		__entry->total_ns	= total_ns;
+	),
+
+	TP_printk("ring %p, op %d, data 0x%llx, queue %llu ns, exec %llu ns, "
+		  "total %llu ns", __entry->ctx, __entry->opcode,
+		  (unsigned long long) __entry->user_data,
+		  (unsigned long long) __entry->queue_ns,
+		  (unsigned long long) __entry->exec_ns,
+		  (unsigned long long) __entry->total_ns)
+);
+
 #endif /* _TRACE_IO_URING_H */
 
 /* This part must be outside protection */
@@ -42,10 +42,43 @@ static inline void syscall_tracepoint_update(struct task_struct *p)
 	else
 		clear_tsk_thread_flag(p, TIF_SYSCALL_TRACEPOINT);
 }
+
+DECLARE_STATIC_KEY_FALSE(sys_tracepoint_unfiltered);
+extern unsigned long sys_tracepoint_mask[];
+
+extern void sys_tracepoint_filter_nr(int nr, bool enable);
+extern void sys_tracepoint_filtered_probe(bool add);
+
+/*
+ * Whether the sys_enter/sys_exit tracepoints have to be called for syscall
+ * @nr. As long as the only probes are the ones of the per-syscall events,
+ * which throw away all the other syscalls anyway, only the syscalls with
+ * an enabled event are passed on.
+ */
+static inline bool sys_tracepoint_wanted(long nr)
+{
+	if (static_branch_unlikely(&sys_tracepoint_unfiltered))
+		return true;
+
+	return nr >= 0 && nr < NR_syscalls && test_bit(nr, sys_tracepoint_mask);
+}
 #else
 static inline void syscall_tracepoint_update(struct task_struct *p)
 {
 }
+
+static inline void sys_tracepoint_filter_nr(int nr, bool enable)
+{
+}
+
+static inline void sys_tracepoint_filtered_probe(bool add)
+{
+}
+
+static inline bool sys_tracepoint_wanted(long nr)
+{
+	return true;
+}
 #endif
 
 #endif /* _TRACE_SYSCALL_H */
@@ -860,6 +860,34 @@ struct btrfs_ioctl_get_subvol_rootref_args {
 };
 
 /* Error codes as returned by the kernel */
+/* Values for btrfs_ioctl_encoded_read_args::compression */
+#define BTRFS_ENCODED_IO_COMPRESSION_NONE	0
+#define BTRFS_ENCODED_IO_COMPRESSION_ZLIB	1
+#define BTRFS_ENCODED_IO_COMPRESSION_LZO	2
+#define BTRFS_ENCODED_IO_COMPRESSION_ZSTD	3
+
+struct btrfs_ioctl_encoded_read_args {
+	/* in, file offset to read at, must be sector aligned */
+	__u64 offset;
+	/* in, user buffer receiving the encoded (on-disk) extent */
+	__u64 buf;
+	/* in, size of @buf */
+	__u64 buf_len;
+	/* out, length of file data covered by the extent from @offset */
+	__u64 len;
+	/* out, length of the extent once decoded */
+	__u64 unencoded_len;
+	/* out, offset of @offset within the decoded extent */
+	__u64 unencoded_offset;
+	/* out, number of bytes copied to @buf */
+	__u64 encoded_len;
+	/* out, one of BTRFS_ENCODED_IO_COMPRESSION_* */
+	__u32 compression;
+	/* in, must be zero */
+	__u32 reserved32;
+	__u64 reserved[8];
+};
+
 enum btrfs_err_code {
 	BTRFS_ERROR_DEV_RAID1_MIN_NOT_MET = 1,
 	BTRFS_ERROR_DEV_RAID10_MIN_NOT_MET,
@@ -987,5 +1015,7 @@ enum btrfs_err_code {
 				struct btrfs_ioctl_ino_lookup_user_args)
 #define BTRFS_IOC_SNAP_DESTROY_V2 _IOW(BTRFS_IOCTL_MAGIC, 63, \
 				struct btrfs_ioctl_vol_args_v2)
+#define BTRFS_IOC_ENCODED_READ _IOWR(BTRFS_IOCTL_MAGIC, 64, \
+				struct btrfs_ioctl_encoded_read_args)
 
 #endif /* _UAPI_LINUX_BTRFS_H */
@@ -26,6 +26,13 @@
 #define EPOLL_CTL_ADD 1
 #define EPOLL_CTL_DEL 2
 #define EPOLL_CTL_MOD 3
+/*
+ * Batch wakeups: the fd argument is ignored, event->events is the number of
+ * ready events to wait for and event->data the longest time, in
+ * microseconds, to wait for them once the first one has arrived.  A count
+ * of 0 or 1 turns batching off.
+ */
+#define EPOLL_CTL_MIN_WAIT 4
 
 /* Epoll event masks */
 #define EPOLLIN		(__force __poll_t)0x00000001
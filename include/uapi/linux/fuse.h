@@ -175,6 +175,12 @@
  *
  *  7.32
  *  - add flags to fuse_attr, add FUSE_ATTR_SUBMOUNT, add FUSE_SUBMOUNTS
+ *
+ *  7.33
+ *  - add FUSE_PASSTHROUGH, FUSE_DEV_IOC_PASSTHROUGH_OPEN and
+ *    passthrough_fh to fuse_open_out
+ *  - add FUSE_URING_REQ_FETCH, FUSE_URING_REQ_COMMIT_AND_FETCH and
+ *    struct fuse_uring_cmd_req
  */
 
 #ifndef _LINUX_FUSE_H
@@ -210,7 +216,7 @@
 #define FUSE_KERNEL_VERSION 7
 
 /** Minor version number of this interface */
-#define FUSE_KERNEL_MINOR_VERSION 32
+#define FUSE_KERNEL_MINOR_VERSION 33
 
 /** The node ID of the root inode */
 #define FUSE_ROOT_ID 1
@@ -320,6 +326,8 @@ struct fuse_file_lock {
  *		       foffset and moffset fields in struct
  *		       fuse_setupmapping_out and fuse_removemapping_one.
  * FUSE_SUBMOUNTS: kernel supports auto-mounting directory submounts
+ * FUSE_PASSTHROUGH: read/write/mmap can be forwarded to a backing file
+ *		     registered with FUSE_DEV_IOC_PASSTHROUGH_OPEN
  */
 #define FUSE_ASYNC_READ		(1 << 0)
 #define FUSE_POSIX_LOCKS	(1 << 1)
@@ -349,6 +357,7 @@ struct fuse_file_lock {
 #define FUSE_EXPLICIT_INVAL_DATA (1 << 25)
 #define FUSE_MAP_ALIGNMENT	(1 << 26)
 #define FUSE_SUBMOUNTS		(1 << 27)
+#define FUSE_PASSTHROUGH	(1 << 28)
 
 /**
  * CUSE INIT request/reply flags
@@ -605,7 +614,7 @@ struct fuse_create_in {
 struct fuse_open_out {
 	uint64_t	fh;
 	uint32_t	open_flags;
-	uint32_t	padding;
+	uint32_t	passthrough_fh;
 };
 
 struct fuse_release_in {
@@ -882,8 +891,29 @@ struct fuse_notify_retrieve_in {
 	uint64_t	dummy4;
 };
 
+struct fuse_passthrough_out {
+	uint32_t	fd;
+	uint32_t	flags;	/* must be zero */
+};
+
 /* Device ioctls: */
 #define FUSE_DEV_IOC_CLONE	_IOR(229, 0, uint32_t)
+#define FUSE_DEV_IOC_PASSTHROUGH_OPEN	_IOW(229, 1, struct fuse_passthrough_out)
+
+/*
+ * IORING_OP_URING_CMD commands on the device, with a struct
+ * fuse_uring_cmd_req payload.  The buffer receives a request in the same
+ * format read(2) returns it, and COMMIT_AND_FETCH first takes a reply
+ * from it in the format write(2) expects.
+ */
+#define FUSE_URING_REQ_FETCH		1
+#define FUSE_URING_REQ_COMMIT_AND_FETCH	2
+
+struct fuse_uring_cmd_req {
+	uint64_t	buf;
+	uint32_t	buf_len;
+	uint32_t	flags;	/* must be zero */
+};
 
 struct fuse_lseek_in {
 	uint64_t	fh;
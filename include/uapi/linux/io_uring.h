@@ -22,6 +22,10 @@ struct io_uring_sqe {
 	union {
 		__u64	off;	/* offset into file */
 		__u64	addr2;
+		struct {
+			__u32	cmd_op;
+			__u32	__pad1;
+		};
 	};
 	union {
 		__u64	addr;	/* pointer to buffer or iovecs */
@@ -42,6 +46,8 @@ struct io_uring_sqe {
 		__u32		statx_flags;
 		__u32		fadvise_advice;
 		__u32		splice_flags;
+		__u32		rename_flags;
+		__u32		unlink_flags;
 	};
 	__u64	user_data;	/* data to be passed back at completion time */
 	union {
@@ -56,6 +62,14 @@ struct io_uring_sqe {
 			/* personality to use, if used */
 			__u16	personality;
 			__s32	splice_fd_in;
+			union {
+				__u64	__pad3[2];
+				/*
+				 * IORING_OP_URING_CMD payload, 16 bytes or
+				 * 80 bytes with IORING_SETUP_SQE128
+				 */
+				__u8	cmd[0];
+			};
 		};
 		__u64	__pad2[3];
 	};
@@ -96,6 +110,19 @@ enum {
 #define IORING_SETUP_CLAMP	(1U << 4)	/* clamp SQ/CQ ring sizes */
 #define IORING_SETUP_ATTACH_WQ	(1U << 5)	/* attach to existing wq */
 #define IORING_SETUP_R_DISABLED	(1U << 6)	/* start with ring disabled */
+#define IORING_SETUP_SQE128	(1U << 7)	/* SQEs are 128 byte */
+#define IORING_SETUP_CQE32	(1U << 8)	/* CQEs are 32 byte */
+/*
+ * Only one task is allowed to submit requests and register resources
+ */
+#define IORING_SETUP_SINGLE_ISSUER	(1U << 9)
+/*
+ * Defer running task work to get events. Rather than running async
+ * completion work each time the submitting task is interrupted, it is only
+ * run when the task enters the kernel to wait for events. Requires
+ * IORING_SETUP_SINGLE_ISSUER.
+ */
+#define IORING_SETUP_DEFER_TASKRUN	(1U << 10)
 
 enum {
 	IORING_OP_NOP,
@@ -132,6 +159,12 @@ enum {
 	IORING_OP_PROVIDE_BUFFERS,
 	IORING_OP_REMOVE_BUFFERS,
 	IORING_OP_TEE,
+	IORING_OP_SEND_ZC,
+	IORING_OP_URING_CMD,
+	IORING_OP_RENAMEAT,
+	IORING_OP_UNLINKAT,
+	IORING_OP_MKDIRAT,
+	IORING_OP_GETDENTS,
 
 	/* this goes last, obviously */
 	IORING_OP_LAST,
@@ -153,6 +186,23 @@ enum {
  */
 #define SPLICE_F_FD_IN_FIXED	(1U << 31) /* the last bit of __u32 */
 
+/*
+ * accept flags stored in sqe->ioprio
+ *
+ * IORING_ACCEPT_MULTISHOT	Keep the request armed and post a CQE for
+ *				every accepted connection.
+ */
+#define IORING_ACCEPT_MULTISHOT	(1U << 0)
+
+/*
+ * recv flags stored in sqe->ioprio
+ *
+ * IORING_RECV_MULTISHOT	Keep the request armed and post a CQE every
+ *				time data is received into a selected buffer.
+ *				Requires IOSQE_BUFFER_SELECT.
+ */
+#define IORING_RECV_MULTISHOT	(1U << 0)
+
 /*
  * IO completion data structure (Completion Queue Entry)
  */
@@ -160,14 +210,27 @@ struct io_uring_cqe {
 	__u64	user_data;	/* sqe->data submission passed back */
 	__s32	res;		/* result code for this event */
 	__u32	flags;
+
+	/*
+	 * If the ring is initialized with IORING_SETUP_CQE32, then this field
+	 * holds 16 bytes of extra completion data, doubling the CQE size.
+	 * For a write with RWF_ZONE_APPEND, big_cqe[0] is the byte offset
+	 * the data was written at.
+	 */
+	__u64 big_cqe[];
 };
 
 /*
  * cqe->flags
  *
  * IORING_CQE_F_BUFFER	If set, the upper 16 bits are the buffer ID
+ * IORING_CQE_F_MORE	If set, parent SQE will generate more CQE entries
+ * IORING_CQE_F_NOTIF	Notification CQE of IORING_OP_SEND_ZC, the kernel
+ *			no longer references the sent buffer
  */
 #define IORING_CQE_F_BUFFER		(1U << 0)
+#define IORING_CQE_F_MORE		(1U << 1)
+#define IORING_CQE_F_NOTIF		(1U << 2)
 
 enum {
 	IORING_CQE_BUFFER_SHIFT		= 16,
@@ -226,6 +289,7 @@ struct io_cqring_offsets {
 #define IORING_ENTER_GETEVENTS	(1U << 0)
 #define IORING_ENTER_SQ_WAKEUP	(1U << 1)
 #define IORING_ENTER_SQ_WAIT	(1U << 2)
+#define IORING_ENTER_REGISTERED_RING	(1U << 3)
 
 /*
  * Passed in for io_uring_setup(2). Copied back with updated info on success
@@ -272,6 +336,23 @@ enum {
 	IORING_REGISTER_RESTRICTIONS		= 11,
 	IORING_REGISTER_ENABLE_RINGS		= 12,
 
+	/* register/unregister a mapped ring of provided buffers */
+	IORING_REGISTER_PBUF_RING		= 13,
+	IORING_UNREGISTER_PBUF_RING		= 14,
+
+	/* register/unregister io_uring fds with the ring task table */
+	IORING_REGISTER_RING_FDS		= 15,
+	IORING_UNREGISTER_RING_FDS		= 16,
+
+	/* set/clear io-wq worker cpu affinity, set io-wq worker caps */
+	IORING_REGISTER_IOWQ_AFF		= 17,
+	IORING_UNREGISTER_IOWQ_AFF		= 18,
+	IORING_REGISTER_IOWQ_MAX_WORKERS	= 19,
+
+	/* enable/disable per-opcode latency histograms, see fdinfo */
+	IORING_REGISTER_LAT_STATS		= 20,
+	IORING_UNREGISTER_LAT_STATS		= 21,
+
 	/* this goes last */
 	IORING_REGISTER_LAST
 };
@@ -282,6 +363,12 @@ struct io_uring_files_update {
 	__aligned_u64 /* __s32 * */ fds;
 };
 
+struct io_uring_rsrc_update {
+	__u32 offset;
+	__u32 resv;
+	__aligned_u64 data;
+};
+
 #define IO_URING_OP_SUPPORTED	(1U << 0)
 
 struct io_uring_probe_op {
@@ -310,6 +397,38 @@ struct io_uring_restriction {
 	__u32 resv2[3];
 };
 
+struct io_uring_buf {
+	__u64	addr;
+	__u32	len;
+	__u16	bid;
+	__u16	resv;
+};
+
+struct io_uring_buf_ring {
+	union {
+		/*
+		 * To avoid spilling into more pages than we need to, the
+		 * ring tail is overlaid with the io_uring_buf->resv field.
+		 */
+		struct {
+			__u64	resv1;
+			__u32	resv2;
+			__u16	resv3;
+			__u16	tail;
+		};
+		struct io_uring_buf	bufs[0];
+	};
+};
+
+/* argument for IORING_(UN)REGISTER_PBUF_RING */
+struct io_uring_buf_reg {
+	__u64	ring_addr;
+	__u32	ring_entries;
+	__u16	bgid;
+	__u16	pad;
+	__u64	resv[3];
+};
+
 /*
  * io_uring_restriction->opcode values
  */
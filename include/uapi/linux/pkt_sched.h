@@ -1264,4 +1264,14 @@ enum {
 
 #define TCA_ETS_MAX (__TCA_ETS_MAX - 1)
 
+/* SHARD */
+
+enum {
+	TCA_SHARD_UNSPEC,
+	TCA_SHARD_COUNT,	/* u32, number of shards */
+	__TCA_SHARD_MAX,
+};
+
+#define TCA_SHARD_MAX (__TCA_SHARD_MAX - 1)
+
 #endif
@@ -55,4 +55,24 @@ struct rand_pool_info {
 #define GRND_RANDOM	0x0002
 #define GRND_INSECURE	0x0004
 
+/**
+ * struct vgetrandom_opaque_params - arguments for allocating memory for vgetrandom
+ *
+ * @size_of_opaque_state:	Size of each state that is to be passed to vgetrandom().
+ * @mmap_prot:			Value of the prot argument in mmap(2).
+ * @mmap_flags:			Value of the flags argument in mmap(2).
+ * @madvise_advice:		Value of the advice argument in madvise(2), to be
+ *				applied to the mapping before any state is used.
+ *				It wipes the states in the child on fork(), so
+ *				that the child doesn't replay the parent's bytes.
+ * @reserved:			Reserved for future use.
+ */
+struct vgetrandom_opaque_params {
+	__u32 size_of_opaque_state;
+	__u32 mmap_prot;
+	__u32 mmap_flags;
+	__u32 madvise_advice;
+	__u32 reserved[12];
+};
+
 #endif /* _UAPI_LINUX_RANDOM_H */
@@ -10,6 +10,7 @@ struct sched_param {
 
 #define SCHED_ATTR_SIZE_VER0	48	/* sizeof first published struct */
 #define SCHED_ATTR_SIZE_VER1	56	/* add: util_{min,max} */
+#define SCHED_ATTR_SIZE_VER2	60	/* add: latency_nice */
 
 /*
  * Extended scheduling parameters data structure.
@@ -96,6 +97,13 @@ struct sched_param {
  * on a CPU with a capacity big enough to fit the specified value.
  * A task with a max utilization value smaller than 1024 is more likely
  * scheduled on a CPU with no more capacity than the specified value.
+ *
+ *  @sched_latency_nice	task's latency_nice value
+ *
+ * Latency nice is in the range [-20..19] and, unlike the nice value, does
+ * not change the CPU share of a task.  SCHED_NORMAL and SCHED_BATCH tasks
+ * with a lower latency nice value than the running task preempt it sooner
+ * on wakeup, tasks with a higher value later.
  */
 struct sched_attr {
 	__u32 size;
@@ -118,6 +126,8 @@ struct sched_attr {
 	__u32 sched_util_min;
 	__u32 sched_util_max;
 
+	/* latency requirement hints */
+	__s32 sched_latency_nice;
 };
 
 #endif /* _UAPI_LINUX_SCHED_TYPES_H */
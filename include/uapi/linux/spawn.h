@@ -0,0 +1,61 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_SPAWN_H
+#define _UAPI_LINUX_SPAWN_H
+
+#include <linux/types.h>
+
+/*
+ * A file action applied by the child of spawn(2) before it executes the new
+ * program, in array order, like posix_spawn_file_actions_*().
+ *
+ * @type: SPAWN_ACTION_* type.
+ * @fd: file descriptor the action operates on.
+ * @newfd: SPAWN_ACTION_DUP2 target descriptor.
+ * @flags: SPAWN_ACTION_OPEN O_* flags.
+ * @mode: SPAWN_ACTION_OPEN O_CREAT/O_TMPFILE file mode.
+ * @path: SPAWN_ACTION_OPEN/SPAWN_ACTION_CHDIR path.
+ */
+struct spawn_action {
+	__u32 type;
+	__s32 fd;
+	__s32 newfd;
+	__u32 flags;
+	__u32 mode;
+	__u32 __reserved;
+	__aligned_u64 path;
+};
+
+#define SPAWN_ACTION_CLOSE	1 /* close(fd) */
+#define SPAWN_ACTION_DUP2	2 /* dup2(fd, newfd) */
+#define SPAWN_ACTION_OPEN	3 /* open path as fd */
+#define SPAWN_ACTION_CHDIR	4 /* chdir(path) */
+
+/*
+ * Arguments for spawn(2).
+ *
+ * @flags: SPAWN_* flags.
+ * @filename: program to execute.
+ * @argv: NULL terminated argument vector.
+ * @envp: NULL terminated environment vector.
+ * @actions: array of @nr_actions struct spawn_action.
+ * @nr_actions: number of file actions, at most SPAWN_ACTIONS_MAX.
+ * @sigmask: with SPAWN_SETSIGMASK, sigset_t the new program starts with.
+ */
+struct spawn_args {
+	__aligned_u64 flags;
+	__aligned_u64 filename;
+	__aligned_u64 argv;
+	__aligned_u64 envp;
+	__aligned_u64 actions;
+	__aligned_u64 nr_actions;
+	__aligned_u64 sigmask;
+};
+
+#define SPAWN_ARGS_SIZE_VER0	56 /* sizeof first published struct */
+
+/* args->flags for spawn(2). */
+#define SPAWN_SETSIGMASK	0x01 /* Start the program with args->sigmask */
+
+#define SPAWN_ACTIONS_MAX	1024
+
+#endif /* _UAPI_LINUX_SPAWN_H */
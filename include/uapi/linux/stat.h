@@ -188,5 +188,23 @@ struct statx {
 #define STATX_ATTR_VERITY		0x00100000 /* [I] Verity protected file */
 #define STATX_ATTR_DAX			0x00200000 /* File is currently in DAX state */
 
+/*
+ * Record returned by getdents_statx().  The layout up to d_type matches
+ * struct linux_dirent64.  d_statx is filled from the dentry cache; if the
+ * entry is not cached (or is a mountpoint), d_statx.stx_mask is zero and the
+ * caller should fall back to statx().
+ */
+struct dirent_statx {
+	__u64	d_ino;
+	__s64	d_off;
+	__u16	d_reclen;
+	__u8	d_type;
+	__u8	__spare0[5];
+	/* 0x18 */
+	struct statx d_statx;
+	/* 0x118 */
+	char	d_name[];
+};
+
 
 #endif /* _UAPI_LINUX_STAT_H */
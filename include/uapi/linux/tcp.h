@@ -343,6 +343,10 @@ struct tcp_diag_md5sig {
 
 /* setsockopt(fd, IPPROTO_TCP, TCP_ZEROCOPY_RECEIVE, ...) */
 
+/* The target range is known to hold no PTEs (e.g. it was just mapped or
+ * MADV_DONTNEED'ed), so the kernel only zaps it if an insert hits a page.
+ */
+#define TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT 0x1
 struct tcp_zerocopy_receive {
 	__u64 address;		/* in: address of mapping */
 	__u32 length;		/* in/out: number of bytes to map/mapped */
@@ -351,5 +355,6 @@ struct tcp_zerocopy_receive {
 	__s32 err; /* out: socket error */
 	__u64 copybuf_address;	/* in: copybuf address (small reads) */
 	__s32 copybuf_len; /* in/out: copybuf bytes avail/used or error */
+	__u32 flags; /* in: TCP_RECEIVE_ZEROCOPY_FLAG_* */
 };
 #endif /* _UAPI_LINUX_TCP_H */
@@ -289,6 +289,8 @@ extern void audit_kill_trees(struct audit_context *context);
 extern int audit_signal_info_syscall(struct task_struct *t);
 extern void audit_filter_inodes(struct task_struct *tsk,
 				struct audit_context *ctx);
+extern void audit_syscall_mask_add(struct audit_krule *rule, bool inode);
+extern void audit_syscall_mask_rebuild(void);
 extern struct list_head *audit_killed_trees(void);
 #else /* CONFIG_AUDITSYSCALL */
 #define auditsc_get_stamp(c, t, s) 0
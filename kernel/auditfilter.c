@@ -985,6 +985,10 @@ static inline int audit_add_rule(struct audit_entry *entry)
 			entry->rule.prio = ++prio_high;
 		else
 			entry->rule.prio = --prio_low;
+#ifdef CONFIG_AUDITSYSCALL
+		audit_syscall_mask_add(&entry->rule,
+				list != &audit_filter_list[AUDIT_FILTER_EXIT]);
+#endif
 	}
 
 	if (entry->rule.flags & AUDIT_FILTER_PREPEND) {
@@ -1054,6 +1058,10 @@ int audit_del_rule(struct audit_entry *entry)
 
 	list_del_rcu(&e->list);
 	list_del(&e->rule.list);
+#ifdef CONFIG_AUDITSYSCALL
+	if (e->rule.listnr == AUDIT_FILTER_EXIT)
+		audit_syscall_mask_rebuild();
+#endif
 	call_rcu(&e->rcu, audit_free_rule_rcu);
 
 out:
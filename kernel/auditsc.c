@@ -97,6 +97,16 @@ int audit_n_rules;
 /* determines whether we collect data for signals sent */
 int audit_signals;
 
+/*
+ * Union of the syscall masks of the AUDIT_FILTER_EXIT rules on the exit
+ * filter list and on the inode hash.  A syscall whose bit is clear cannot
+ * match any of these rules, so the filters are not walked at syscall exit.
+ * Bits are only set before a rule becomes visible and only cleared when
+ * the masks are recomputed after a removal, both under audit_filter_mutex.
+ */
+static u32 audit_exit_syscalls[AUDIT_BITMASK_SIZE];
+static u32 audit_inode_syscalls[AUDIT_BITMASK_SIZE];
+
 struct audit_aux_data {
 	struct audit_aux_data	*next;
 	int			type;
@@ -801,6 +811,64 @@ static int audit_in_mask(const struct audit_krule *rule, unsigned long val)
 	return rule->mask[word] & bit;
 }
 
+static bool audit_syscall_may_match(const u32 *mask, unsigned long val)
+{
+	int word;
+
+	if (val > 0xffffffff)
+		return false;
+
+	word = AUDIT_WORD(val);
+	if (word >= AUDIT_BITMASK_SIZE)
+		return false;
+
+	return READ_ONCE(mask[word]) & AUDIT_BIT(val);
+}
+
+/**
+ * audit_syscall_mask_add - account for a new syscall exit rule
+ * @rule: the rule about to be added
+ * @inode: whether it goes on the inode hash rather than the exit list
+ *
+ * Called with audit_filter_mutex held, before the rule is made visible.
+ */
+void audit_syscall_mask_add(struct audit_krule *rule, bool inode)
+{
+	u32 *mask = inode ? audit_inode_syscalls : audit_exit_syscalls;
+	int i;
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+		WRITE_ONCE(mask[i], mask[i] | rule->mask[i]);
+}
+
+/**
+ * audit_syscall_mask_rebuild - recompute the syscall masks of the exit rules
+ *
+ * Called with audit_filter_mutex held, after a syscall exit rule has been
+ * removed.
+ */
+void audit_syscall_mask_rebuild(void)
+{
+	u32 exit_mask[AUDIT_BITMASK_SIZE] = { 0 };
+	u32 inode_mask[AUDIT_BITMASK_SIZE] = { 0 };
+	struct audit_entry *e;
+	int h, i;
+
+	list_for_each_entry(e, &audit_filter_list[AUDIT_FILTER_EXIT], list)
+		for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+			exit_mask[i] |= e->rule.mask[i];
+
+	for (h = 0; h < AUDIT_INODE_BUCKETS; h++)
+		list_for_each_entry(e, &audit_inode_hash[h], list)
+			for (i = 0; i < AUDIT_BITMASK_SIZE; i++)
+				inode_mask[i] |= e->rule.mask[i];
+
+	for (i = 0; i < AUDIT_BITMASK_SIZE; i++) {
+		WRITE_ONCE(audit_exit_syscalls[i], exit_mask[i]);
+		WRITE_ONCE(audit_inode_syscalls[i], inode_mask[i]);
+	}
+}
+
 /* At syscall entry and exit time, this filter is called if the
  * audit_state is not low enough that auditing cannot take place, but is
  * also not high enough that we already know we have to write an audit
@@ -813,6 +881,9 @@ static enum audit_state audit_filter_syscall(struct task_struct *tsk,
 	struct audit_entry *e;
 	enum audit_state state;
 
+	if (!audit_syscall_may_match(audit_exit_syscalls, ctx->major))
+		return AUDIT_BUILD_CONTEXT;
+
 	if (auditd_test_task(tsk))
 		return AUDIT_DISABLED;
 
@@ -861,6 +932,9 @@ void audit_filter_inodes(struct task_struct *tsk, struct audit_context *ctx)
 {
 	struct audit_names *n;
 
+	if (!audit_syscall_may_match(audit_inode_syscalls, ctx->major))
+		return;
+
 	if (auditd_test_task(tsk))
 		return;
 
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * bloom_filter.c: BPF bloom filter map
+ *
+ * A keyless map answering "possibly present" or "definitely not present"
+ * for a value. Values are added with push and tested with peek; they can't
+ * be enumerated or removed.
+ */
+#include <linux/bitmap.h>
+#include <linux/bpf.h>
+#include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/overflow.h>
+#include <linux/random.h>
+#include <linux/slab.h>
+
+#define BLOOM_CREATE_FLAG_MASK \
+	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK)
+
+/* The lower 4 bits of map_extra select the number of hash functions */
+#define BLOOM_NR_HASH_FUNCS_MASK	0xf
+#define BLOOM_DEF_NR_HASH_FUNCS		5
+
+struct bpf_bloom_filter {
+	struct bpf_map map;
+	u32 bitset_mask;
+	u32 hash_seed;
+	/* Number of u32 words in a value when value_size is a multiple of
+	 * sizeof(u32), so that jhash2() can be used; 0 otherwise.
+	 */
+	u32 aligned_u32_count;
+	u32 nr_hash_funcs;
+	unsigned long bitset[];
+};
+
+static inline struct bpf_bloom_filter *bpf_bloom_filter(struct bpf_map *map)
+{
+	return container_of(map, struct bpf_bloom_filter, map);
+}
+
+static u32 bloom_hash(struct bpf_bloom_filter *bloom, void *value,
+		      u32 value_size, u32 index)
+{
+	u32 h;
+
+	if (bloom->aligned_u32_count)
+		h = jhash2(value, bloom->aligned_u32_count,
+			   bloom->hash_seed + index);
+	else
+		h = jhash(value, value_size, bloom->hash_seed + index);
+
+	return h & bloom->bitset_mask;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_peek_elem(struct bpf_map *map, void *value)
+{
+	struct bpf_bloom_filter *bloom = bpf_bloom_filter(map);
+	u32 value_size = map->value_size;
+	u32 i;
+
+	for (i = 0; i < bloom->nr_hash_funcs; i++) {
+		if (!test_bit(bloom_hash(bloom, value, value_size, i),
+			      bloom->bitset))
+			return -ENOENT;
+	}
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_push_elem(struct bpf_map *map, void *value, u64 flags)
+{
+	struct bpf_bloom_filter *bloom = bpf_bloom_filter(map);
+	u32 value_size = map->value_size;
+	u32 i;
+
+	if (flags != BPF_ANY)
+		return -EINVAL;
+
+	for (i = 0; i < bloom->nr_hash_funcs; i++)
+		set_bit(bloom_hash(bloom, value, value_size, i), bloom->bitset);
+
+	return 0;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_pop_elem(struct bpf_map *map, void *value)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_delete_elem(struct bpf_map *map, void *value)
+{
+	return -EOPNOTSUPP;
+}
+
+/* Called from syscall */
+static int bloom_map_alloc_check(union bpf_attr *attr)
+{
+	if (!bpf_capable())
+		return -EPERM;
+
+	if ((attr->map_flags & BPF_F_ZERO_SEED) && !capable(CAP_SYS_ADMIN))
+		/* Guard against local DoS, and discourage production use. */
+		return -EPERM;
+
+	/* check sanity of attributes */
+	if (attr->key_size != 0 || attr->value_size == 0 ||
+	    attr->max_entries == 0 ||
+	    attr->map_flags & ~BLOOM_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags) ||
+	    attr->map_extra & ~BLOOM_NR_HASH_FUNCS_MASK)
+		return -EINVAL;
+
+	if (attr->value_size > KMALLOC_MAX_SIZE)
+		/* if value_size is bigger, the user space won't be able to
+		 * access the elements.
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
+{
+	int ret, numa_node = bpf_map_attr_numa_node(attr);
+	u32 nr_hash_funcs, nr_bits, bitset_mask;
+	struct bpf_map_memory mem = {0};
+	struct bpf_bloom_filter *bloom;
+	u64 bitset_bytes, cost;
+
+	nr_hash_funcs = attr->map_extra & BLOOM_NR_HASH_FUNCS_MASK;
+	if (!nr_hash_funcs)
+		nr_hash_funcs = BLOOM_DEF_NR_HASH_FUNCS;
+
+	/* The bit array size minimizing the false positive rate is
+	 * n * k / ln(2), n being the expected number of entries and k the
+	 * number of hash functions; 7 / 5 approximates 1 / ln(2). It is
+	 * rounded up to a power of two so that a hash can be reduced to a
+	 * bit index with a mask, and capped at 2^32 bits.
+	 */
+	if (check_mul_overflow(attr->max_entries, nr_hash_funcs, &nr_bits) ||
+	    check_mul_overflow(nr_bits / 5, (u32)7, &nr_bits) ||
+	    nr_bits > (1UL << 31)) {
+		bitset_bytes = BITS_TO_BYTES((u64)U32_MAX + 1);
+		bitset_mask = U32_MAX;
+	} else {
+		if (nr_bits <= BITS_PER_LONG)
+			nr_bits = BITS_PER_LONG;
+		else
+			nr_bits = roundup_pow_of_two(nr_bits);
+		bitset_bytes = BITS_TO_BYTES(nr_bits);
+		bitset_mask = nr_bits - 1;
+	}
+	bitset_bytes = roundup(bitset_bytes, sizeof(unsigned long));
+
+	cost = sizeof(*bloom) + bitset_bytes;
+	ret = bpf_map_charge_init(&mem, cost);
+	if (ret < 0)
+		return ERR_PTR(ret);
+
+	bloom = bpf_map_area_alloc(cost, numa_node);
+	if (!bloom) {
+		bpf_map_charge_finish(&mem);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	bpf_map_init_from_attr(&bloom->map, attr);
+	bpf_map_charge_move(&bloom->map.memory, &mem);
+
+	bloom->nr_hash_funcs = nr_hash_funcs;
+	bloom->bitset_mask = bitset_mask;
+
+	/* jhash2() is faster than jhash() on u32-aligned values */
+	if ((attr->value_size & (sizeof(u32) - 1)) == 0)
+		bloom->aligned_u32_count = attr->value_size / sizeof(u32);
+
+	if (!(attr->map_flags & BPF_F_ZERO_SEED))
+		bloom->hash_seed = get_random_int();
+
+	return &bloom->map;
+}
+
+/* Called when map->refcnt goes to zero, either from workqueue or from syscall */
+static void bloom_map_free(struct bpf_map *map)
+{
+	struct bpf_bloom_filter *bloom = bpf_bloom_filter(map);
+
+	bpf_map_area_free(bloom);
+}
+
+/* Called from syscall or from eBPF program */
+static void *bloom_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	/* The eBPF program should use map_peek_elem instead */
+	return ERR_PTR(-EINVAL);
+}
+
+/* Called from syscall or from eBPF program */
+static int bloom_map_update_elem(struct bpf_map *map, void *key,
+				 void *value, u64 flags)
+{
+	/* The eBPF program should use map_push_elem instead */
+	return -EINVAL;
+}
+
+/* Called from syscall */
+static int bloom_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	return -EOPNOTSUPP;
+}
+
+static int bloom_map_btf_id;
+const struct bpf_map_ops bloom_filter_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = bloom_map_alloc_check,
+	.map_alloc = bloom_map_alloc,
+	.map_free = bloom_map_free,
+	.map_get_next_key = bloom_map_get_next_key,
+	.map_push_elem = bloom_map_push_elem,
+	.map_peek_elem = bloom_map_peek_elem,
+	.map_pop_elem = bloom_map_pop_elem,
+	.map_lookup_elem = bloom_map_lookup_elem,
+	.map_update_elem = bloom_map_update_elem,
+	.map_delete_elem = bloom_map_delete_elem,
+	.map_btf_name = "bpf_bloom_filter",
+	.map_btf_id = &bloom_map_btf_id,
+};
@@ -0,0 +1,470 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Resizable hash map backed by rhashtable.
+ *
+ * Unlike BPF_MAP_TYPE_HASH, the bucket array is not sized for max_entries
+ * at creation time: it grows and shrinks with the number of elements, and
+ * elements are allocated on update. max_entries is still enforced as an
+ * upper bound on the number of elements.
+ */
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+#include <linux/rhashtable.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <uapi/linux/btf.h>
+
+#define RHTAB_CREATE_FLAG_MASK						\
+	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE | BPF_F_ACCESS_MASK)
+
+struct bpf_rhtab {
+	struct bpf_map map;
+	struct rhashtable ht;
+	struct rhashtable_params params;
+	atomic_t count;	/* number of elements in this hashtable */
+	u32 elem_size;	/* size of each element in bytes */
+};
+
+struct rhtab_elem {
+	struct rhash_head node;
+	struct rcu_head rcu;
+	char key[] __aligned(8);
+};
+
+static inline void *rhtab_elem_value(struct rhtab_elem *l, u32 key_size)
+{
+	return l->key + round_up(key_size, 8);
+}
+
+/* rhashtable bucket locks disable softirqs, which can't be done from
+ * hard irq or NMI context.
+ */
+static inline bool rhtab_update_allowed(void)
+{
+	return !in_irq() && !in_nmi();
+}
+
+static int rhtab_map_alloc_check(union bpf_attr *attr)
+{
+	/* elements are always allocated at update time */
+	if (attr->map_flags & ~RHTAB_CREATE_FLAG_MASK ||
+	    !(attr->map_flags & BPF_F_NO_PREALLOC) ||
+	    !bpf_map_flags_access_ok(attr->map_flags))
+		return -EINVAL;
+
+	if (attr->max_entries == 0 || attr->key_size == 0 ||
+	    attr->value_size == 0)
+		return -EINVAL;
+
+	if (attr->key_size > MAX_BPF_STACK)
+		/* eBPF programs initialize keys on stack, so they cannot be
+		 * larger than max stack size
+		 */
+		return -E2BIG;
+
+	if (attr->value_size >= KMALLOC_MAX_SIZE -
+	    MAX_BPF_STACK - sizeof(struct rhtab_elem))
+		/* if value_size is bigger, the user space won't be able to
+		 * access the elements via bpf syscall.
+		 */
+		return -E2BIG;
+
+	return 0;
+}
+
+static struct bpf_map *rhtab_map_alloc(union bpf_attr *attr)
+{
+	struct bpf_rhtab *rhtab;
+	u64 cost;
+	int err;
+
+	rhtab = kzalloc(sizeof(*rhtab), GFP_USER);
+	if (!rhtab)
+		return ERR_PTR(-ENOMEM);
+
+	bpf_map_init_from_attr(&rhtab->map, attr);
+
+	rhtab->elem_size = sizeof(struct rhtab_elem) +
+			   round_up(rhtab->map.key_size, 8) +
+			   round_up(rhtab->map.value_size, 8);
+
+	/* charge for the worst case, like a BPF_F_NO_PREALLOC hash map */
+	cost = sizeof(*rhtab) + (u64) rhtab->elem_size * rhtab->map.max_entries;
+	err = bpf_map_charge_init(&rhtab->map.memory, cost);
+	if (err)
+		goto free_rhtab;
+
+	rhtab->params = (struct rhashtable_params) {
+		.key_len		= rhtab->map.key_size,
+		.key_offset		= offsetof(struct rhtab_elem, key),
+		.head_offset		= offsetof(struct rhtab_elem, node),
+		.automatic_shrinking	= true,
+	};
+
+	err = rhashtable_init(&rhtab->ht, &rhtab->params);
+	if (err)
+		goto free_charge;
+
+	return &rhtab->map;
+
+free_charge:
+	bpf_map_charge_finish(&rhtab->map.memory);
+free_rhtab:
+	kfree(rhtab);
+	return ERR_PTR(err);
+}
+
+static void rhtab_free_elem(void *ptr, void *arg)
+{
+	kfree(ptr);
+}
+
+static void rhtab_map_free(struct bpf_map *map)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+
+	/* bpf_free_used_maps() or close(map_fd) will trigger this map_free
+	 * callback after bpf progs stopped executing, so no one can look up
+	 * elements anymore. Elements already deleted are owned by their
+	 * kfree_rcu() callbacks.
+	 */
+	rhashtable_free_and_destroy(&rhtab->ht, rhtab_free_elem, NULL);
+	kfree(rhtab);
+}
+
+static struct rhtab_elem *__rhtab_map_lookup_elem(struct bpf_map *map,
+						  void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	return rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+}
+
+static void *rhtab_map_lookup_elem(struct bpf_map *map, void *key)
+{
+	struct rhtab_elem *l = __rhtab_map_lookup_elem(map, key);
+
+	if (l)
+		return rhtab_elem_value(l, map->key_size);
+
+	return NULL;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_update_elem(struct bpf_map *map, void *key, void *value,
+				 u64 map_flags)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l_new, *l_old;
+	int ret;
+
+	if (unlikely(map_flags > BPF_EXIST))
+		/* unknown flags */
+		return -EINVAL;
+
+	if (unlikely(!rhtab_update_allowed()))
+		return -EBUSY;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	l_new = kmalloc_node(rhtab->elem_size, GFP_ATOMIC | __GFP_NOWARN,
+			     map->numa_node);
+	if (!l_new)
+		return -ENOMEM;
+
+	memcpy(l_new->key, key, map->key_size);
+	memcpy(rhtab_elem_value(l_new, map->key_size), value, map->value_size);
+
+again:
+	l_old = rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+	if (l_old) {
+		if (map_flags == BPF_NOEXIST) {
+			ret = -EEXIST;
+			goto err;
+		}
+
+		ret = rhashtable_replace_fast(&rhtab->ht, &l_old->node,
+					      &l_new->node, rhtab->params);
+		if (ret == -ENOENT)
+			/* l_old was deleted or replaced under us */
+			goto again;
+		if (ret)
+			goto err;
+
+		kfree_rcu(l_old, rcu);
+		return 0;
+	}
+
+	if (map_flags == BPF_EXIST) {
+		ret = -ENOENT;
+		goto err;
+	}
+
+	if (atomic_inc_return(&rhtab->count) > map->max_entries) {
+		atomic_dec(&rhtab->count);
+		ret = -E2BIG;
+		goto err;
+	}
+
+	l_old = rhashtable_lookup_get_insert_fast(&rhtab->ht, &l_new->node,
+						  rhtab->params);
+	if (!l_old)
+		return 0;
+
+	atomic_dec(&rhtab->count);
+	if (IS_ERR(l_old)) {
+		ret = PTR_ERR(l_old);
+		goto err;
+	}
+	/* raced with an insert of the same key */
+	goto again;
+
+err:
+	kfree(l_new);
+	return ret;
+}
+
+/* Called from syscall or from eBPF program */
+static int rhtab_map_delete_elem(struct bpf_map *map, void *key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct rhtab_elem *l;
+	int ret;
+
+	if (unlikely(!rhtab_update_allowed()))
+		return -EBUSY;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	do {
+		l = rhashtable_lookup(&rhtab->ht, key, rhtab->params);
+		if (!l)
+			return -ENOENT;
+
+		/* -ENOENT means l was replaced under us, retry the lookup */
+		ret = rhashtable_remove_fast(&rhtab->ht, &l->node,
+					     rhtab->params);
+	} while (ret == -ENOENT);
+
+	if (ret)
+		return ret;
+
+	atomic_dec(&rhtab->count);
+	kfree_rcu(l, rcu);
+	return 0;
+}
+
+static struct rhtab_elem *rhtab_first_elem(struct bucket_table *tbl, u32 i)
+{
+	struct rhash_head *pos;
+	struct rhtab_elem *l;
+
+	for (; i < tbl->size; i++)
+		rht_for_each_entry_rcu(l, pos, tbl, i, node)
+			return l;
+
+	return NULL;
+}
+
+/* Called from syscall. Walks the current bucket table; as with the other
+ * hash maps, elements may be missed or returned twice if the map is
+ * updated or resized while it is being walked.
+ */
+static int rhtab_map_get_next_key(struct bpf_map *map, void *key,
+				  void *next_key)
+{
+	struct bpf_rhtab *rhtab = container_of(map, struct bpf_rhtab, map);
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	struct rhtab_elem *l;
+	bool found = false;
+	u32 hash = 0;
+
+	WARN_ON_ONCE(!rcu_read_lock_held());
+
+	tbl = rht_dereference_rcu(rhtab->ht.tbl, &rhtab->ht);
+
+	if (key) {
+		hash = rht_key_hashfn(&rhtab->ht, tbl, key, rhtab->params);
+		rht_for_each_entry_rcu(l, pos, tbl, hash, node) {
+			if (found)
+				goto copy_key;
+			found = !memcmp(l->key, key, map->key_size);
+		}
+	}
+
+	/* key was the last one in its bucket, or wasn't found at all, in
+	 * which case iterate from the beginning
+	 */
+	l = rhtab_first_elem(tbl, found ? hash + 1 : 0);
+	if (!l)
+		return -ENOENT;
+
+copy_key:
+	memcpy(next_key, l->key, map->key_size);
+	return 0;
+}
+
+static void rhtab_map_seq_show_elem(struct bpf_map *map, void *key,
+				    struct seq_file *m)
+{
+	void *value;
+
+	rcu_read_lock();
+
+	value = rhtab_map_lookup_elem(map, key);
+	if (!value) {
+		rcu_read_unlock();
+		return;
+	}
+
+	btf_type_seq_show(map->btf, map->btf_key_type_id, key, m);
+	seq_puts(m, ": ");
+	btf_type_seq_show(map->btf, map->btf_value_type_id, value, m);
+	seq_puts(m, "\n");
+
+	rcu_read_unlock();
+}
+
+struct bpf_iter_seq_rhash_map_info {
+	struct bpf_map *map;
+	struct bpf_rhtab *rhtab;
+	u32 bucket_id;
+	u32 skip_elems;
+};
+
+static struct rhtab_elem *
+bpf_rhash_map_seq_find_next(struct bpf_iter_seq_rhash_map_info *info)
+{
+	struct bpf_rhtab *rhtab = info->rhtab;
+	u32 skip_elems = info->skip_elems;
+	struct bucket_table *tbl;
+	struct rhash_head *pos;
+	struct rhtab_elem *l;
+	u32 i, count;
+
+	tbl = rht_dereference_rcu(rhtab->ht.tbl, &rhtab->ht);
+
+	for (i = info->bucket_id; i < tbl->size; i++) {
+		count = 0;
+		rht_for_each_entry_rcu(l, pos, tbl, i, node) {
+			if (count >= skip_elems) {
+				info->bucket_id = i;
+				info->skip_elems = count;
+				return l;
+			}
+			count++;
+		}
+		skip_elems = 0;
+	}
+
+	info->bucket_id = i;
+	info->skip_elems = 0;
+	return NULL;
+}
+
+static void *bpf_rhash_map_seq_start(struct seq_file *seq, loff_t *pos)
+{
+	struct bpf_iter_seq_rhash_map_info *info = seq->private;
+	struct rhtab_elem *l;
+
+	rcu_read_lock();
+	l = bpf_rhash_map_seq_find_next(info);
+	if (!l)
+		return NULL;
+
+	if (*pos == 0)
+		++*pos;
+	return l;
+}
+
+static void *bpf_rhash_map_seq_next(struct seq_file *seq, void *v, loff_t *pos)
+{
+	struct bpf_iter_seq_rhash_map_info *info = seq->private;
+
+	++*pos;
+	++info->skip_elems;
+	return bpf_rhash_map_seq_find_next(info);
+}
+
+static int __bpf_rhash_map_seq_show(struct seq_file *seq, struct rhtab_elem *l)
+{
+	struct bpf_iter_seq_rhash_map_info *info = seq->private;
+	struct bpf_iter__bpf_map_elem ctx = {};
+	struct bpf_map *map = info->map;
+	struct bpf_iter_meta meta;
+	struct bpf_prog *prog;
+	int ret = 0;
+
+	meta.seq = seq;
+	prog = bpf_iter_get_info(&meta, l == NULL);
+	if (prog) {
+		ctx.meta = &meta;
+		ctx.map = map;
+		if (l) {
+			ctx.key = l->key;
+			ctx.value = rhtab_elem_value(l, map->key_size);
+		}
+		ret = bpf_iter_run_prog(prog, &ctx);
+	}
+
+	return ret;
+}
+
+static int bpf_rhash_map_seq_show(struct seq_file *seq, void *v)
+{
+	return __bpf_rhash_map_seq_show(seq, v);
+}
+
+static void bpf_rhash_map_seq_stop(struct seq_file *seq, void *v)
+{
+	if (!v)
+		(void)__bpf_rhash_map_seq_show(seq, NULL);
+	rcu_read_unlock();
+}
+
+static int bpf_iter_init_rhash_map(void *priv_data,
+				   struct bpf_iter_aux_info *aux)
+{
+	struct bpf_iter_seq_rhash_map_info *seq_info = priv_data;
+	struct bpf_map *map = aux->map;
+
+	seq_info->map = map;
+	seq_info->rhtab = container_of(map, struct bpf_rhtab, map);
+	return 0;
+}
+
+static const struct seq_operations bpf_rhash_map_seq_ops = {
+	.start	= bpf_rhash_map_seq_start,
+	.next	= bpf_rhash_map_seq_next,
+	.stop	= bpf_rhash_map_seq_stop,
+	.show	= bpf_rhash_map_seq_show,
+};
+
+static const struct bpf_iter_seq_info iter_seq_info = {
+	.seq_ops		= &bpf_rhash_map_seq_ops,
+	.init_seq_private	= bpf_iter_init_rhash_map,
+	.seq_priv_size		= sizeof(struct bpf_iter_seq_rhash_map_info),
+};
+
+static int rhtab_map_btf_id;
+const struct bpf_map_ops rhtab_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc_check = rhtab_map_alloc_check,
+	.map_alloc = rhtab_map_alloc,
+	.map_free = rhtab_map_free,
+	.map_get_next_key = rhtab_map_get_next_key,
+	.map_lookup_elem = rhtab_map_lookup_elem,
+	.map_update_elem = rhtab_map_update_elem,
+	.map_delete_elem = rhtab_map_delete_elem,
+	.map_seq_show_elem = rhtab_map_seq_show_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+	.map_btf_name = "bpf_rhtab",
+	.map_btf_id = &rhtab_map_btf_id,
+	.iter_seq_info = &iter_seq_info,
+};
@@ -37,10 +37,16 @@ struct bpf_ringbuf {
 	struct page **pages;
 	int nr_pages;
 	spinlock_t spinlock ____cacheline_aligned_in_smp;
+	/* For user ring buffers, set while a BPF program drains records, as
+	 * there can be only one kernel consumer at a time.
+	 */
+	atomic_t busy ____cacheline_aligned_in_smp;
 	/* Consumer and producer counters are put into separate pages to allow
 	 * mapping consumer page as r/w, but restrict producer page to r/o.
 	 * This protects producer position from being modified by user-space
 	 * application and ruining in-kernel position tracking.
+	 * For user ring buffers the roles are swapped: user-space produces
+	 * and may only write the producer page and the data pages.
 	 */
 	unsigned long consumer_pos __aligned(PAGE_SIZE);
 	unsigned long producer_pos __aligned(PAGE_SIZE);
@@ -158,11 +164,20 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
 		return ERR_PTR(-EINVAL);
 
-	if (attr->key_size || attr->value_size ||
+	if (attr->key_size ||
+	    (attr->map_type == BPF_MAP_TYPE_RINGBUF && attr->value_size) ||
 	    !is_power_of_2(attr->max_entries) ||
 	    !PAGE_ALIGNED(attr->max_entries))
 		return ERR_PTR(-EINVAL);
 
+	/* A user ring buffer hands each record to BPF programs as value_size
+	 * bytes of memory, so that much must fit in the ring behind a header.
+	 */
+	if (attr->map_type == BPF_MAP_TYPE_USER_RINGBUF &&
+	    (!attr->value_size ||
+	     attr->value_size > attr->max_entries - BPF_RINGBUF_HDR_SZ))
+		return ERR_PTR(-EINVAL);
+
 #ifdef CONFIG_64BIT
 	/* on 32-bit arch, it's impossible to overflow record's hdr->pgoff */
 	if (attr->max_entries > RINGBUF_MAX_DATA_SZ)
@@ -260,6 +275,25 @@ static int ringbuf_map_mmap(struct bpf_map *map, struct vm_area_struct *vma)
 				   vma->vm_pgoff + RINGBUF_PGOFF);
 }
 
+static int user_ringbuf_map_mmap(struct bpf_map *map,
+				 struct vm_area_struct *vma)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+
+	if (vma->vm_flags & VM_WRITE) {
+		/* allow writable mapping for producer_pos and data only */
+		if (vma->vm_pgoff == 0)
+			return -EPERM;
+	} else {
+		vma->vm_flags &= ~VM_MAYWRITE;
+	}
+	/* remap_vmalloc_range() checks size and offset constraints */
+	return remap_vmalloc_range(vma, rb_map->rb,
+				   vma->vm_pgoff + RINGBUF_PGOFF);
+}
+
 static unsigned long ringbuf_avail_data_sz(struct bpf_ringbuf *rb)
 {
 	unsigned long cons_pos, prod_pos;
@@ -282,6 +316,19 @@ static __poll_t ringbuf_map_poll(struct bpf_map *map, struct file *filp,
 	return 0;
 }
 
+static __poll_t user_ringbuf_map_poll(struct bpf_map *map, struct file *filp,
+				      struct poll_table_struct *pts)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	poll_wait(filp, &rb_map->rb->waitq, pts);
+
+	if (ringbuf_avail_data_sz(rb_map->rb) < rb_map->rb->mask + 1)
+		return EPOLLOUT | EPOLLWRNORM;
+	return 0;
+}
+
 static int ringbuf_map_btf_id;
 const struct bpf_map_ops ringbuf_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -297,6 +344,21 @@ const struct bpf_map_ops ringbuf_map_ops = {
 	.map_btf_id = &ringbuf_map_btf_id,
 };
 
+static int user_ringbuf_map_btf_id;
+const struct bpf_map_ops user_ringbuf_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = ringbuf_map_alloc,
+	.map_free = ringbuf_map_free,
+	.map_mmap = user_ringbuf_map_mmap,
+	.map_poll = user_ringbuf_map_poll,
+	.map_lookup_elem = ringbuf_map_lookup_elem,
+	.map_update_elem = ringbuf_map_update_elem,
+	.map_delete_elem = ringbuf_map_delete_elem,
+	.map_get_next_key = ringbuf_map_get_next_key,
+	.map_btf_name = "bpf_ringbuf_map",
+	.map_btf_id = &user_ringbuf_map_btf_id,
+};
+
 /* Given pointer to ring buffer record metadata and struct bpf_ringbuf itself,
  * calculate offset from record metadata to ring buffer in pages, rounded
  * down. This page offset is stored as part of record metadata and allows to
@@ -494,3 +556,117 @@ const struct bpf_func_proto bpf_ringbuf_query_proto = {
 	.arg1_type	= ARG_CONST_MAP_PTR,
 	.arg2_type	= ARG_ANYTHING,
 };
+
+/* Maximum number of records a single bpf_user_ringbuf_drain() consumes */
+#define BPF_MAX_USER_RINGBUF_SAMPLES (128 * 1024)
+
+/* Look at the record at the consumer position of a user ring buffer.
+ * Everything read from the ring was written by user-space and is validated
+ * before being handed to the program.
+ */
+static int __bpf_user_ringbuf_peek(struct bpf_ringbuf *rb, u32 max_size,
+				   void **sample, u32 *size)
+{
+	unsigned long cons_pos, prod_pos;
+	u32 hdr_len, sample_len, total_len, flags, *hdr;
+
+	/* pairs with producer's smp_store_release() */
+	prod_pos = smp_load_acquire(&rb->producer_pos);
+	if (prod_pos % 8)
+		return -EINVAL;
+
+	cons_pos = rb->consumer_pos;
+	if (cons_pos >= prod_pos)
+		return -ENODATA;
+
+	hdr = (u32 *)(rb->data + (cons_pos & rb->mask));
+	/* pairs with producer's smp_store_release() of the header */
+	hdr_len = smp_load_acquire(hdr);
+	flags = hdr_len & (BPF_RINGBUF_BUSY_BIT | BPF_RINGBUF_DISCARD_BIT);
+	sample_len = hdr_len & ~flags;
+	total_len = round_up(sample_len + BPF_RINGBUF_HDR_SZ, 8);
+
+	/* the record must be within what the producer has published */
+	if (total_len > prod_pos - cons_pos)
+		return -EINVAL;
+
+	if (sample_len > max_size)
+		return -E2BIG;
+
+	if (flags & BPF_RINGBUF_DISCARD_BIT) {
+		/* skip the record and let the caller try the next one */
+		smp_store_release(&rb->consumer_pos, cons_pos + total_len);
+		return -EAGAIN;
+	}
+
+	if (flags & BPF_RINGBUF_BUSY_BIT)
+		return -ENODATA;
+
+	*sample = rb->data + ((cons_pos + BPF_RINGBUF_HDR_SZ) & rb->mask);
+	*size = sample_len;
+	return 0;
+}
+
+BPF_CALL_4(bpf_user_ringbuf_drain, struct bpf_map *, map,
+	   void *, callback_fn, void *, callback_ctx, u64, flags)
+{
+	bpf_callback_t callback = (bpf_callback_t)callback_fn;
+	long samples, discarded = 0, ret = 0;
+	struct bpf_ringbuf *rb;
+	int err;
+
+	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
+		return -EINVAL;
+
+	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+
+	/* only one consumer may advance consumer_pos at a time */
+	if (atomic_cmpxchg(&rb->busy, 0, 1))
+		return -EBUSY;
+
+	for (samples = 0; samples < BPF_MAX_USER_RINGBUF_SAMPLES && !ret;
+	     samples++) {
+		void *sample;
+		u32 size;
+
+		err = __bpf_user_ringbuf_peek(rb, map->value_size, &sample,
+					      &size);
+		if (err == -ENODATA)
+			break;
+		if (err == -EAGAIN) {
+			discarded++;
+			continue;
+		}
+		if (err) {
+			ret = err;
+			goto out;
+		}
+
+		/* return value: 0 - continue, 1 - stop and return */
+		ret = callback((u64)(long)sample, size,
+			       (u64)(long)callback_ctx, 0, 0);
+		/* pairs with producer's smp_load_acquire() */
+		smp_store_release(&rb->consumer_pos, rb->consumer_pos +
+				  round_up(size + BPF_RINGBUF_HDR_SZ, 8));
+	}
+	ret = samples - discarded;
+
+out:
+	/* order the release of the ring after consumer_pos updates */
+	atomic_set_release(&rb->busy, 0);
+
+	if (flags & BPF_RB_FORCE_WAKEUP)
+		irq_work_queue(&rb->work);
+	else if (!(flags & BPF_RB_NO_WAKEUP) && samples > 0)
+		irq_work_queue(&rb->work);
+	return ret;
+}
+
+const struct bpf_func_proto bpf_user_ringbuf_drain_proto = {
+	.func		= bpf_user_ringbuf_drain,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_CONST_MAP_PTR,
+	.arg2_type	= ARG_PTR_TO_FUNC,
+	.arg3_type	= ARG_PTR_TO_STACK_OR_NULL,
+	.arg4_type	= ARG_ANYTHING,
+};
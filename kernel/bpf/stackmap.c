@@ -11,16 +11,20 @@
 #include <linux/pagemap.h>
 #include <linux/irq_work.h>
 #include <linux/btf_ids.h>
+#include <linux/cgroup.h>
 #include "percpu_freelist.h"
 
 #define STACK_CREATE_FLAG_MASK					\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY |	\
-	 BPF_F_STACK_BUILD_ID)
+	 BPF_F_STACK_BUILD_ID | BPF_F_STACK_COUNT)
 
 struct stack_map_bucket {
 	struct pcpu_freelist_node fnode;
 	u32 hash;
 	u32 nr;
+	/* BPF_F_STACK_COUNT only: aggregation key and number of hits */
+	u64 key;
+	atomic64_t cnt;
 	u64 data[];
 };
 
@@ -62,6 +66,37 @@ static inline int stack_map_data_size(struct bpf_map *map)
 		sizeof(struct bpf_stack_build_id) : sizeof(u64);
 }
 
+static inline bool stack_map_use_count(struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_STACK_COUNT);
+}
+
+/* With BPF_F_STACK_COUNT, the value starts with a struct bpf_stack_count */
+static inline u32 stack_map_hdr_size(struct bpf_map *map)
+{
+	return stack_map_use_count(map) ? sizeof(struct bpf_stack_count) : 0;
+}
+
+static inline u32 stack_map_max_depth(struct bpf_map *map)
+{
+	return (map->value_size - stack_map_hdr_size(map)) /
+		stack_map_data_size(map);
+}
+
+static u64 stack_map_count_key(struct bpf_map *map)
+{
+	switch (map->map_extra) {
+	case BPF_STACK_COUNT_KEY_PID:
+		return current->tgid;
+#ifdef CONFIG_CGROUPS
+	case BPF_STACK_COUNT_KEY_CGROUP:
+		return cgroup_id(task_dfl_cgroup(current));
+#endif
+	default:
+		return 0;
+	}
+}
+
 static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 {
 	u64 elem_size = sizeof(struct stack_map_bucket) +
@@ -90,6 +125,7 @@ static int prealloc_elems_and_freelist(struct bpf_stack_map *smap)
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
 	u32 value_size = attr->value_size;
+	u32 frames_size = value_size;
 	struct bpf_stack_map *smap;
 	struct bpf_map_memory mem;
 	u64 cost, n_buckets;
@@ -106,13 +142,27 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	    value_size < 8 || value_size % 8)
 		return ERR_PTR(-EINVAL);
 
+	BUILD_BUG_ON(sizeof(struct bpf_stack_count) % sizeof(u64));
+	if (attr->map_flags & BPF_F_STACK_COUNT) {
+		if (value_size <= sizeof(struct bpf_stack_count))
+			return ERR_PTR(-EINVAL);
+		if (attr->map_extra > BPF_STACK_COUNT_KEY_CGROUP)
+			return ERR_PTR(-EINVAL);
+		if (attr->map_extra == BPF_STACK_COUNT_KEY_CGROUP &&
+		    !IS_ENABLED(CONFIG_CGROUPS))
+			return ERR_PTR(-EOPNOTSUPP);
+		frames_size -= sizeof(struct bpf_stack_count);
+	} else if (attr->map_extra) {
+		return ERR_PTR(-EINVAL);
+	}
+
 	BUILD_BUG_ON(sizeof(struct bpf_stack_build_id) % sizeof(u64));
 	if (attr->map_flags & BPF_F_STACK_BUILD_ID) {
-		if (value_size % sizeof(struct bpf_stack_build_id) ||
-		    value_size / sizeof(struct bpf_stack_build_id)
+		if (frames_size % sizeof(struct bpf_stack_build_id) ||
+		    frames_size / sizeof(struct bpf_stack_build_id)
 		    > sysctl_perf_event_max_stack)
 			return ERR_PTR(-EINVAL);
-	} else if (value_size / 8 > sysctl_perf_event_max_stack)
+	} else if (frames_size / 8 > sysctl_perf_event_max_stack)
 		return ERR_PTR(-EINVAL);
 
 	/* hash table size must be power of 2 */
@@ -400,13 +450,14 @@ static long __bpf_get_stackid(struct bpf_map *map,
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
 	struct stack_map_bucket *bucket, *new_bucket, *old_bucket;
-	u32 max_depth = map->value_size / stack_map_data_size(map);
+	u32 max_depth = stack_map_max_depth(map);
 	/* stack_map_alloc() checks that max_depth <= sysctl_perf_event_max_stack */
 	u32 init_nr = sysctl_perf_event_max_stack - max_depth;
 	u32 skip = flags & BPF_F_SKIP_FIELD_MASK;
+	bool count = stack_map_use_count(map);
 	u32 hash, id, trace_nr, trace_len;
 	bool user = flags & BPF_F_USER_STACK;
-	u64 *ips;
+	u64 key = 0, *ips;
 	bool hash_matches;
 
 	/* get_perf_callchain() guarantees that trace->nr >= init_nr
@@ -422,13 +473,17 @@ static long __bpf_get_stackid(struct bpf_map *map,
 	trace_len = trace_nr * sizeof(u64);
 	ips = trace->ip + skip + init_nr;
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
+	if (count) {
+		key = stack_map_count_key(map);
+		hash = jhash_2words((u32)key, (u32)(key >> 32), hash);
+	}
 	id = hash & (smap->n_buckets - 1);
 	bucket = READ_ONCE(smap->buckets[id]);
 
-	hash_matches = bucket && bucket->hash == hash;
+	hash_matches = bucket && bucket->hash == hash && bucket->key == key;
 	/* fast cmp */
 	if (hash_matches && flags & BPF_F_FAST_STACK_CMP)
-		return id;
+		goto hit;
 
 	if (stack_map_use_build_id(map)) {
 		/* for build_id+offset, pop a bucket before slow cmp */
@@ -444,7 +499,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 		if (hash_matches && bucket->nr == trace_nr &&
 		    memcmp(bucket->data, new_bucket->data, trace_len) == 0) {
 			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
-			return id;
+			goto hit;
 		}
 		if (bucket && !(flags & BPF_F_REUSE_STACKID)) {
 			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
@@ -453,7 +508,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 	} else {
 		if (hash_matches && bucket->nr == trace_nr &&
 		    memcmp(bucket->data, ips, trace_len) == 0)
-			return id;
+			goto hit;
 		if (bucket && !(flags & BPF_F_REUSE_STACKID))
 			return -EEXIST;
 
@@ -466,17 +521,27 @@ static long __bpf_get_stackid(struct bpf_map *map,
 
 	new_bucket->hash = hash;
 	new_bucket->nr = trace_nr;
+	new_bucket->key = key;
+	atomic64_set(&new_bucket->cnt, 1);
 
 	old_bucket = xchg(&smap->buckets[id], new_bucket);
 	if (old_bucket)
 		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
 	return id;
+
+hit:
+	/* The bucket may be replaced concurrently with BPF_F_REUSE_STACKID,
+	 * in which case this hit is lost along with the old stack.
+	 */
+	if (count)
+		atomic64_inc(&bucket->cnt);
+	return id;
 }
 
 BPF_CALL_3(bpf_get_stackid, struct pt_regs *, regs, struct bpf_map *, map,
 	   u64, flags)
 {
-	u32 max_depth = map->value_size / stack_map_data_size(map);
+	u32 max_depth = stack_map_max_depth(map);
 	/* stack_map_alloc() checks that max_depth <= sysctl_perf_event_max_stack */
 	u32 init_nr = sysctl_perf_event_max_stack - max_depth;
 	bool user = flags & BPF_F_USER_STACK;
@@ -759,12 +824,12 @@ static void *stack_map_lookup_elem(struct bpf_map *map, void *key)
 	return ERR_PTR(-EOPNOTSUPP);
 }
 
-/* Called from syscall */
-int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
+static int __bpf_stackmap_copy(struct bpf_map *map, void *key, void *value,
+			       bool reset)
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
+	u32 id = *(u32 *)key, trace_len, hdr_size = stack_map_hdr_size(map);
 	struct stack_map_bucket *bucket, *old_bucket;
-	u32 id = *(u32 *)key, trace_len;
 
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
@@ -773,9 +838,18 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	if (!bucket)
 		return -ENOENT;
 
+	if (hdr_size) {
+		struct bpf_stack_count *hdr = value;
+
+		hdr->count = reset ? atomic64_xchg(&bucket->cnt, 0) :
+				     atomic64_read(&bucket->cnt);
+		hdr->key = bucket->key;
+		value += hdr_size;
+	}
+
 	trace_len = bucket->nr * stack_map_data_size(map);
 	memcpy(value, bucket->data, trace_len);
-	memset(value + trace_len, 0, map->value_size - trace_len);
+	memset(value + trace_len, 0, map->value_size - hdr_size - trace_len);
 
 	old_bucket = xchg(&smap->buckets[id], bucket);
 	if (old_bucket)
@@ -783,6 +857,23 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	return 0;
 }
 
+/* Called from syscall */
+int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
+{
+	return __bpf_stackmap_copy(map, key, value, false);
+}
+
+/* Called from syscall. The stack stays in the map so that its id remains
+ * valid, only its count is reset.
+ */
+int bpf_stackmap_copy_and_reset(struct bpf_map *map, void *key, void *value)
+{
+	if (!stack_map_use_count(map))
+		return -ENOTSUPP;
+
+	return __bpf_stackmap_copy(map, key, value, true);
+}
+
 static int stack_map_get_next_key(struct bpf_map *map, void *key,
 				  void *next_key)
 {
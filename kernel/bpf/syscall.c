@@ -210,7 +210,8 @@ static int bpf_map_update_value(struct bpf_map *map, struct fd f, void *key,
 		err = bpf_fd_reuseport_array_update_elem(map, key, value,
 							 flags);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_push_elem(map, value, flags);
 	} else {
 		rcu_read_lock();
@@ -249,7 +250,8 @@ static int bpf_map_copy_value(struct bpf_map *map, void *key, void *value,
 	} else if (map->map_type == BPF_MAP_TYPE_REUSEPORT_SOCKARRAY) {
 		err = bpf_fd_reuseport_array_lookup_elem(map, key, value);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_peek_elem(map, value);
 	} else if (map->map_type == BPF_MAP_TYPE_STRUCT_OPS) {
 		/* struct_ops map requires directly updating "value" */
@@ -308,11 +310,16 @@ static void *__bpf_map_area_alloc(u64 size, int numa_node, bool mmapable)
 		BUG_ON(!PAGE_ALIGNED(size));
 		align = SHMLBA;
 		flags = VM_USERMAP;
-	} else if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER)) {
-		area = kmalloc_node(size, gfp | GFP_USER | __GFP_NORETRY,
-				    numa_node);
-		if (area != NULL)
-			return area;
+	} else {
+		if (size <= (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER)) {
+			area = kmalloc_node(size,
+					    gfp | GFP_USER | __GFP_NORETRY,
+					    numa_node);
+			if (area != NULL)
+				return area;
+		}
+		/* Large hash tables and arrays benefit from PMD mappings */
+		flags = VM_ALLOW_HUGE_VMAP;
 	}
 
 	return __vmalloc_node_range(size, align, VMALLOC_START, VMALLOC_END,
@@ -355,6 +362,7 @@ void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr)
 	map->max_entries = attr->max_entries;
 	map->map_flags = bpf_map_flags_retain_permanent(attr->map_flags);
 	map->numa_node = bpf_map_attr_numa_node(attr);
+	map->map_extra = attr->map_extra;
 }
 
 static int bpf_charge_memlock(struct user_struct *user, u32 pages)
@@ -785,7 +793,8 @@ static int map_check_btf(struct bpf_map *map, const struct btf *btf,
 		    map->map_type != BPF_MAP_TYPE_ARRAY &&
 		    map->map_type != BPF_MAP_TYPE_CGROUP_STORAGE &&
 		    map->map_type != BPF_MAP_TYPE_SK_STORAGE &&
-		    map->map_type != BPF_MAP_TYPE_INODE_STORAGE)
+		    map->map_type != BPF_MAP_TYPE_INODE_STORAGE &&
+		    map->map_type != BPF_MAP_TYPE_TASK_STORAGE)
 			return -ENOTSUPP;
 		if (map->spin_lock_off + sizeof(struct bpf_spin_lock) >
 		    map->value_size) {
@@ -802,7 +811,7 @@ static int map_check_btf(struct bpf_map *map, const struct btf *btf,
 	return ret;
 }
 
-#define BPF_MAP_CREATE_LAST_FIELD btf_vmlinux_value_type_id
+#define BPF_MAP_CREATE_LAST_FIELD map_extra
 /* called via syscall */
 static int map_create(union bpf_attr *attr)
 {
@@ -816,6 +825,11 @@ static int map_create(union bpf_attr *attr)
 	if (err)
 		return -EINVAL;
 
+	if (attr->map_type != BPF_MAP_TYPE_BLOOM_FILTER &&
+	    attr->map_type != BPF_MAP_TYPE_STACK_TRACE &&
+	    attr->map_extra != 0)
+		return -EINVAL;
+
 	if (attr->btf_vmlinux_value_type_id) {
 		if (attr->map_type != BPF_MAP_TYPE_STRUCT_OPS ||
 		    attr->btf_key_type_id || attr->btf_value_type_id)
@@ -997,6 +1011,12 @@ int __weak bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	return -ENOTSUPP;
 }
 
+int __weak bpf_stackmap_copy_and_reset(struct bpf_map *map, void *key,
+				       void *value)
+{
+	return -ENOTSUPP;
+}
+
 static void *__bpf_copy_key(void __user *ukey, u64 key_size)
 {
 	if (key_size)
@@ -1056,6 +1076,15 @@ static int map_lookup_elem(union bpf_attr *attr)
 	if (!value)
 		goto free_key;
 
+	if (map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
+		/* the value is the input: test it for membership */
+		if (copy_from_user(value, uvalue, value_size))
+			err = -EFAULT;
+		else
+			err = bpf_map_copy_value(map, key, value, attr->flags);
+		goto free_value;
+	}
+
 	err = bpf_map_copy_value(map, key, value, attr->flags);
 	if (err)
 		goto free_value;
@@ -1520,6 +1549,10 @@ static int map_lookup_and_delete_elem(union bpf_attr *attr)
 	if (map->map_type == BPF_MAP_TYPE_QUEUE ||
 	    map->map_type == BPF_MAP_TYPE_STACK) {
 		err = map->ops->map_pop_elem(map, value);
+	} else if (map->map_type == BPF_MAP_TYPE_STACK_TRACE) {
+		bpf_disable_instrumentation();
+		err = bpf_stackmap_copy_and_reset(map, key, value);
+		bpf_enable_instrumentation();
 	} else {
 		err = -ENOTSUPP;
 	}
@@ -1826,14 +1859,20 @@ static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "memlock:\t%llu\n"
 		   "prog_id:\t%u\n"
 		   "run_time_ns:\t%llu\n"
-		   "run_cnt:\t%llu\n",
+		   "run_cnt:\t%llu\n"
+		   "verified_insns:\t%u\n"
+		   "verified_states:\t%u\n"
+		   "verification_time_ns:\t%llu\n",
 		   prog->type,
 		   prog->jited,
 		   prog_tag,
 		   prog->pages * 1ULL << PAGE_SHIFT,
 		   prog->aux->id,
 		   stats.nsecs,
-		   stats.cnt);
+		   stats.cnt,
+		   prog->aux->verified_insns,
+		   prog->aux->verified_states,
+		   prog->aux->verification_time);
 }
 #endif
 
@@ -1977,6 +2016,11 @@ static void bpf_prog_load_fixup_attach_type(union bpf_attr *attr)
 			attr->expected_attach_type =
 				BPF_CGROUP_INET_SOCK_CREATE;
 		break;
+	case BPF_PROG_TYPE_SK_REUSEPORT:
+		if (!attr->expected_attach_type)
+			attr->expected_attach_type =
+				BPF_SK_REUSEPORT_SELECT;
+		break;
 	}
 }
 
@@ -2053,6 +2097,14 @@ bpf_prog_load_check_attach(enum bpf_prog_type prog_type,
 		if (expected_attach_type == BPF_SK_LOOKUP)
 			return 0;
 		return -EINVAL;
+	case BPF_PROG_TYPE_SK_REUSEPORT:
+		switch (expected_attach_type) {
+		case BPF_SK_REUSEPORT_SELECT:
+		case BPF_SK_REUSEPORT_SELECT_OR_MIGRATE:
+			return 0;
+		default:
+			return -EINVAL;
+		}
 	case BPF_PROG_TYPE_EXT:
 		if (expected_attach_type)
 			return -EINVAL;
@@ -2738,6 +2790,177 @@ static int bpf_tracing_prog_attach(struct bpf_prog *prog,
 	return err;
 }
 
+/* Upper bound on the number of programs of a tracing batch link */
+#define BPF_TRACING_BATCH_MAX	(1U << 16)
+
+struct bpf_tracing_batch_link {
+	struct bpf_link link;
+	enum bpf_attach_type attach_type;
+	u32 cnt;
+	/* attach[0].prog is link.prog, the others hold a prog reference */
+	struct bpf_tramp_attach attach[];
+};
+
+static void bpf_tracing_batch_link_release(struct bpf_link *link)
+{
+	struct bpf_tracing_batch_link *tb_link =
+		container_of(link, struct bpf_tracing_batch_link, link);
+	struct bpf_tramp_attach *attach;
+	u32 i;
+
+	for (i = 0; i < tb_link->cnt; i++) {
+		attach = &tb_link->attach[i];
+		WARN_ON_ONCE(bpf_trampoline_unlink_prog(attach->prog,
+							attach->tr));
+		bpf_trampoline_put(attach->tr);
+		if (attach->prog != link->prog)
+			bpf_prog_put(attach->prog);
+	}
+}
+
+static void bpf_tracing_batch_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_tracing_batch_link *tb_link =
+		container_of(link, struct bpf_tracing_batch_link, link);
+
+	kvfree(tb_link);
+}
+
+static void bpf_tracing_batch_link_show_fdinfo(const struct bpf_link *link,
+					       struct seq_file *seq)
+{
+	struct bpf_tracing_batch_link *tb_link =
+		container_of(link, struct bpf_tracing_batch_link, link);
+
+	seq_printf(seq,
+		   "attach_type:\t%d\n"
+		   "prog_cnt:\t%u\n",
+		   tb_link->attach_type,
+		   tb_link->cnt);
+}
+
+static int bpf_tracing_batch_link_fill_link_info(const struct bpf_link *link,
+						 struct bpf_link_info *info)
+{
+	struct bpf_tracing_batch_link *tb_link =
+		container_of(link, struct bpf_tracing_batch_link, link);
+
+	info->tracing.attach_type = tb_link->attach_type;
+
+	return 0;
+}
+
+static const struct bpf_link_ops bpf_tracing_batch_link_lops = {
+	.release = bpf_tracing_batch_link_release,
+	.dealloc = bpf_tracing_batch_link_dealloc,
+	.show_fdinfo = bpf_tracing_batch_link_show_fdinfo,
+	.fill_link_info = bpf_tracing_batch_link_fill_link_info,
+};
+
+/* Give back the load-time trampolines taken by bpf_tracing_batch_attach() */
+static void bpf_tracing_batch_restore(struct bpf_tracing_batch_link *link)
+{
+	struct bpf_tramp_attach *attach;
+	u32 i;
+
+	for (i = 0; i < link->cnt; i++) {
+		attach = &link->attach[i];
+		if (attach->tr) {
+			mutex_lock(&attach->prog->aux->dst_mutex);
+			attach->prog->aux->dst_trampoline = attach->tr;
+			mutex_unlock(&attach->prog->aux->dst_mutex);
+		}
+		if (attach->prog != link->link.prog)
+			bpf_prog_put(attach->prog);
+	}
+}
+
+/* Attach @prog and the programs in link_create.tracing_batch.prog_fds to
+ * the kernel functions they were loaded for, all with one bpf_link. The
+ * trampolines are registered together by bpf_trampoline_link_progs(), so
+ * attaching to many functions costs one round of text patching.
+ */
+static int bpf_tracing_batch_attach(const union bpf_attr *attr,
+				    struct bpf_prog *prog)
+{
+	u32 __user *ufds = u64_to_user_ptr(attr->link_create.tracing_batch.prog_fds);
+	u32 cnt = attr->link_create.tracing_batch.cnt;
+	struct bpf_tracing_batch_link *link;
+	struct bpf_link_primer link_primer;
+	struct bpf_tramp_attach *attach;
+	struct bpf_prog *p;
+	int err = 0;
+	u32 i, fd;
+
+	if (!!ufds != !!cnt)
+		return -EINVAL;
+	if (cnt >= BPF_TRACING_BATCH_MAX)
+		return -E2BIG;
+
+	link = kvzalloc(struct_size(link, attach, cnt + 1), GFP_USER);
+	if (!link)
+		return -ENOMEM;
+	bpf_link_init(&link->link, BPF_LINK_TYPE_TRACING,
+		      &bpf_tracing_batch_link_lops, prog);
+	link->attach_type = prog->expected_attach_type;
+	link->attach[0].prog = prog;
+	link->cnt = 1;
+
+	for (i = 0; i < cnt; i++) {
+		if (get_user(fd, ufds + i)) {
+			err = -EFAULT;
+			goto out_restore;
+		}
+		p = bpf_prog_get(fd);
+		if (IS_ERR(p)) {
+			err = PTR_ERR(p);
+			goto out_restore;
+		}
+		link->attach[link->cnt++].prog = p;
+		if (p->type != prog->type ||
+		    p->expected_attach_type != prog->expected_attach_type) {
+			err = -EINVAL;
+			goto out_restore;
+		}
+	}
+
+	/* Take over the trampoline each program got at load time. A program
+	 * that was already attached, or listed twice, has none left.
+	 */
+	for (i = 0; i < link->cnt; i++) {
+		attach = &link->attach[i];
+		p = attach->prog;
+		mutex_lock(&p->aux->dst_mutex);
+		if (!p->aux->dst_trampoline || p->aux->dst_prog) {
+			/* only kernel functions can be attached in batch */
+			err = p->aux->dst_trampoline ? -EINVAL : -ENOENT;
+			mutex_unlock(&p->aux->dst_mutex);
+			goto out_restore;
+		}
+		attach->tr = p->aux->dst_trampoline;
+		p->aux->dst_trampoline = NULL;
+		mutex_unlock(&p->aux->dst_mutex);
+	}
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err)
+		goto out_restore;
+
+	err = bpf_trampoline_link_progs(link->attach, link->cnt);
+	if (err) {
+		bpf_tracing_batch_restore(link);
+		bpf_link_cleanup(&link_primer);
+		return err;
+	}
+
+	return bpf_link_settle(&link_primer);
+
+out_restore:
+	bpf_tracing_batch_restore(link);
+	kvfree(link);
+	return err;
+}
+
 struct bpf_raw_tp_link {
 	struct bpf_link link;
 	struct bpf_raw_event_map *btp;
@@ -2921,6 +3144,14 @@ static int bpf_prog_attach_check_attach_type(const struct bpf_prog *prog,
 		return prog->enforce_expected_attach_type &&
 			prog->expected_attach_type != attach_type ?
 			-EINVAL : 0;
+	case BPF_PROG_TYPE_KPROBE:
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI &&
+		    attach_type != BPF_TRACE_KPROBE_MULTI)
+			return -EINVAL;
+		if (attach_type == BPF_TRACE_KPROBE_MULTI &&
+		    prog->expected_attach_type != BPF_TRACE_KPROBE_MULTI)
+			return -EINVAL;
+		return 0;
 	default:
 		return 0;
 	}
@@ -2975,6 +3206,12 @@ attach_type_to_prog_type(enum bpf_attach_type attach_type)
 		return BPF_PROG_TYPE_SK_LOOKUP;
 	case BPF_XDP:
 		return BPF_PROG_TYPE_XDP;
+	case BPF_TRACE_KPROBE_MULTI:
+		return BPF_PROG_TYPE_KPROBE;
+	case BPF_TRACE_FENTRY:
+	case BPF_TRACE_FEXIT:
+	case BPF_MODIFY_RETURN:
+		return BPF_PROG_TYPE_TRACING;
 	default:
 		return BPF_PROG_TYPE_UNSPEC;
 	}
@@ -3461,6 +3698,9 @@ static int bpf_prog_get_info_by_fd(struct file *file,
 	bpf_prog_get_stats(prog, &stats);
 	info.run_time_ns = stats.nsecs;
 	info.run_cnt = stats.cnt;
+	info.verified_insns = prog->aux->verified_insns;
+	info.verified_states = prog->aux->verified_states;
+	info.verification_time_ns = prog->aux->verification_time;
 
 	if (!bpf_capable()) {
 		info.jited_prog_len = 0;
@@ -3716,6 +3956,7 @@ static int bpf_map_get_info_by_fd(struct file *file,
 		info.btf_value_type_id = map->btf_value_type_id;
 	}
 	info.btf_vmlinux_value_type_id = map->btf_vmlinux_value_type_id;
+	info.map_extra = map->map_extra;
 
 	if (bpf_map_is_dev_bound(map)) {
 		err = bpf_map_offload_info_fill(&info, map);
@@ -4043,10 +4284,14 @@ static int tracing_bpf_link_attach(const union bpf_attr *attr, struct bpf_prog *
 		return bpf_tracing_prog_attach(prog,
 					       attr->link_create.target_fd,
 					       attr->link_create.target_btf_id);
+	else if (prog->expected_attach_type == BPF_TRACE_FENTRY ||
+		 prog->expected_attach_type == BPF_TRACE_FEXIT ||
+		 prog->expected_attach_type == BPF_MODIFY_RETURN)
+		return bpf_tracing_batch_attach(attr, prog);
 	return -EINVAL;
 }
 
-#define BPF_LINK_CREATE_LAST_FIELD link_create.iter_info_len
+#define BPF_LINK_CREATE_LAST_FIELD link_create.kprobe_multi.cookies
 static int link_create(union bpf_attr *attr)
 {
 	enum bpf_prog_type ptype;
@@ -4098,6 +4343,9 @@ static int link_create(union bpf_attr *attr)
 		ret = bpf_xdp_link_attach(attr, prog);
 		break;
 #endif
+	case BPF_PROG_TYPE_KPROBE:
+		ret = bpf_kprobe_multi_link_attach(attr, prog);
+		break;
 	default:
 		ret = -EINVAL;
 	}
@@ -9,6 +9,7 @@
 #include <linux/btf.h>
 #include <linux/rcupdate_trace.h>
 #include <linux/rcupdate_wait.h>
+#include <linux/sort.h>
 
 /* dummy _ops. The verifier will operate on target program's ops. */
 const struct bpf_verifier_ops bpf_extension_verifier_ops = {
@@ -25,6 +26,9 @@ static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
 /* serializes access to trampoline_table */
 static DEFINE_MUTEX(trampoline_mutex);
 
+/* serializes bpf_trampoline_link_progs(), which holds several tr->mutex */
+static DEFINE_MUTEX(trampoline_batch_mutex);
+
 void *bpf_jit_alloc_exec_page(void)
 {
 	void *image;
@@ -165,11 +169,8 @@ bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total)
 	return tprogs;
 }
 
-static void __bpf_tramp_image_put_deferred(struct work_struct *work)
+static void bpf_tramp_image_free(struct bpf_tramp_image *im)
 {
-	struct bpf_tramp_image *im;
-
-	im = container_of(work, struct bpf_tramp_image, work);
 	bpf_image_ksym_del(&im->ksym);
 	bpf_jit_free_exec(im->image);
 	bpf_jit_uncharge_modmem(1);
@@ -177,6 +178,14 @@ static void __bpf_tramp_image_put_deferred(struct work_struct *work)
 	kfree_rcu(im, rcu);
 }
 
+static void __bpf_tramp_image_put_deferred(struct work_struct *work)
+{
+	struct bpf_tramp_image *im;
+
+	im = container_of(work, struct bpf_tramp_image, work);
+	bpf_tramp_image_free(im);
+}
+
 /* callback, fexit step 3 or fentry step 2 */
 static void __bpf_tramp_image_put_rcu(struct rcu_head *rcu)
 {
@@ -298,11 +307,38 @@ static struct bpf_tramp_image *bpf_tramp_image_alloc(u64 key, u32 idx)
 	return ERR_PTR(err);
 }
 
+/* Build a new image for the progs currently linked to @tr. The image is
+ * not reachable until the caller registers it at tr->func.addr.
+ */
+static struct bpf_tramp_image *
+bpf_trampoline_build(struct bpf_trampoline *tr, struct bpf_tramp_progs *tprogs)
+{
+	u32 flags = BPF_TRAMP_F_RESTORE_REGS;
+	struct bpf_tramp_image *im;
+	int err;
+
+	im = bpf_tramp_image_alloc(tr->key, tr->selector);
+	if (IS_ERR(im))
+		return im;
+
+	if (tprogs[BPF_TRAMP_FEXIT].nr_progs ||
+	    tprogs[BPF_TRAMP_MODIFY_RETURN].nr_progs)
+		flags = BPF_TRAMP_F_CALL_ORIG | BPF_TRAMP_F_SKIP_FRAME;
+
+	err = arch_prepare_bpf_trampoline(im, im->image, im->image + PAGE_SIZE,
+					  &tr->func.model, flags, tprogs,
+					  tr->func.addr);
+	if (err < 0) {
+		bpf_tramp_image_free(im);
+		return ERR_PTR(err);
+	}
+	return im;
+}
+
 static int bpf_trampoline_update(struct bpf_trampoline *tr)
 {
 	struct bpf_tramp_image *im;
 	struct bpf_tramp_progs *tprogs;
-	u32 flags = BPF_TRAMP_F_RESTORE_REGS;
 	int err, total;
 
 	tprogs = bpf_trampoline_get_progs(tr, &total);
@@ -317,22 +353,12 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 		goto out;
 	}
 
-	im = bpf_tramp_image_alloc(tr->key, tr->selector);
+	im = bpf_trampoline_build(tr, tprogs);
 	if (IS_ERR(im)) {
 		err = PTR_ERR(im);
 		goto out;
 	}
 
-	if (tprogs[BPF_TRAMP_FEXIT].nr_progs ||
-	    tprogs[BPF_TRAMP_MODIFY_RETURN].nr_progs)
-		flags = BPF_TRAMP_F_CALL_ORIG | BPF_TRAMP_F_SKIP_FRAME;
-
-	err = arch_prepare_bpf_trampoline(im, im->image, im->image + PAGE_SIZE,
-					  &tr->func.model, flags, tprogs,
-					  tr->func.addr);
-	if (err < 0)
-		goto out;
-
 	WARN_ON(tr->cur_image && tr->selector == 0);
 	WARN_ON(!tr->cur_image && tr->selector);
 	if (tr->cur_image)
@@ -341,8 +367,10 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 	else
 		/* first time registering */
 		err = register_fentry(tr, im->image);
-	if (err)
+	if (err) {
+		bpf_tramp_image_free(im);
 		goto out;
+	}
 	if (tr->cur_image)
 		bpf_tramp_image_put(tr->cur_image);
 	tr->cur_image = im;
@@ -374,6 +402,24 @@ static enum bpf_tramp_prog_type bpf_attach_type_to_tramp(struct bpf_prog *prog)
 	}
 }
 
+/* Add @prog to the progs of @tr, the caller then updates the trampoline */
+static int bpf_trampoline_add_prog(struct bpf_prog *prog,
+				   struct bpf_trampoline *tr,
+				   enum bpf_tramp_prog_type kind)
+{
+	int cnt;
+
+	cnt = tr->progs_cnt[BPF_TRAMP_FENTRY] + tr->progs_cnt[BPF_TRAMP_FEXIT];
+	if (cnt >= BPF_MAX_TRAMP_PROGS)
+		return -E2BIG;
+	if (!hlist_unhashed(&prog->aux->tramp_hlist))
+		/* prog already linked */
+		return -EBUSY;
+	hlist_add_head(&prog->aux->tramp_hlist, &tr->progs_hlist[kind]);
+	tr->progs_cnt[kind]++;
+	return 0;
+}
+
 int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 {
 	enum bpf_tramp_prog_type kind;
@@ -401,17 +447,9 @@ int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 					 prog->bpf_func);
 		goto out;
 	}
-	if (cnt >= BPF_MAX_TRAMP_PROGS) {
-		err = -E2BIG;
-		goto out;
-	}
-	if (!hlist_unhashed(&prog->aux->tramp_hlist)) {
-		/* prog already linked */
-		err = -EBUSY;
+	err = bpf_trampoline_add_prog(prog, tr, kind);
+	if (err)
 		goto out;
-	}
-	hlist_add_head(&prog->aux->tramp_hlist, &tr->progs_hlist[kind]);
-	tr->progs_cnt[kind]++;
 	err = bpf_trampoline_update(tr);
 	if (err) {
 		hlist_del(&prog->aux->tramp_hlist);
@@ -422,6 +460,166 @@ int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 	return err;
 }
 
+static int bpf_tramp_attach_cmp(const void *a, const void *b)
+{
+	const struct bpf_tramp_attach *aa = a, *ab = b;
+
+	if (aa->tr == ab->tr)
+		return 0;
+	return aa->tr < ab->tr ? -1 : 1;
+}
+
+/* Undo bpf_trampoline_link_progs() for the first @linked entries of
+ * @attach, of which trampolines at index < @done were already processed.
+ */
+static void bpf_trampoline_link_progs_undo(struct bpf_tramp_attach *attach,
+					   struct bpf_tramp_image **ims,
+					   u32 linked, u32 done)
+{
+	enum bpf_tramp_prog_type kind;
+	u32 i;
+
+	for (i = 0; i < linked; i++) {
+		kind = bpf_attach_type_to_tramp(attach[i].prog);
+		hlist_del_init(&attach[i].prog->aux->tramp_hlist);
+		attach[i].tr->progs_cnt[kind]--;
+	}
+	for (i = 0; i < done; i++) {
+		if (i && attach[i].tr == attach[i - 1].tr)
+			continue;
+		if (ims[i])
+			bpf_tramp_image_free(ims[i]);
+		else
+			WARN_ON_ONCE(bpf_trampoline_update(attach[i].tr));
+	}
+}
+
+/**
+ * bpf_trampoline_link_progs - link many fentry/fexit progs at once
+ * @attach: array of (prog, trampoline) pairs, sorted in place
+ * @cnt: number of entries in @attach
+ *
+ * Same as calling bpf_trampoline_link_prog() for each entry, except that
+ * the trampolines that are not attached yet and sit on ftrace locations
+ * are built first and then registered with a single ftrace update, i.e.
+ * one round of text patching instead of one per function. Trampolines
+ * already in use are updated one by one. Either all the progs get linked
+ * or none does.
+ */
+int bpf_trampoline_link_progs(struct bpf_tramp_attach *attach, u32 cnt)
+{
+	struct bpf_tramp_progs *tprogs;
+	struct bpf_tramp_image **ims;
+	enum bpf_tramp_prog_type kind;
+	unsigned long *ips, *addrs;
+	u32 i, linked = 0, nr_ips = 0;
+	struct bpf_trampoline *tr;
+	int err, total;
+
+	if (!cnt)
+		return -EINVAL;
+
+	/* group the progs of a same trampoline together */
+	sort(attach, cnt, sizeof(*attach), bpf_tramp_attach_cmp, NULL);
+
+	ims = kvcalloc(cnt, sizeof(*ims), GFP_KERNEL);
+	ips = kvcalloc(cnt, sizeof(*ips), GFP_KERNEL);
+	addrs = kvcalloc(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!ims || !ips || !addrs) {
+		err = -ENOMEM;
+		goto out_free;
+	}
+
+	mutex_lock(&trampoline_batch_mutex);
+	for (i = 0; i < cnt; i++)
+		if (!i || attach[i].tr != attach[i - 1].tr)
+			mutex_lock_nest_lock(&attach[i].tr->mutex,
+					     &trampoline_batch_mutex);
+
+	/* Link all the progs first, so that each trampoline is built once */
+	for (i = 0; i < cnt; i++) {
+		kind = bpf_attach_type_to_tramp(attach[i].prog);
+		if (kind == BPF_TRAMP_REPLACE) {
+			err = -EINVAL;
+			goto out_undo;
+		}
+		if (attach[i].tr->extension_prog) {
+			err = -EBUSY;
+			goto out_undo;
+		}
+		err = bpf_trampoline_add_prog(attach[i].prog, attach[i].tr, kind);
+		if (err)
+			goto out_undo;
+		linked++;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		tr = attach[i].tr;
+		if (i && tr == attach[i - 1].tr)
+			continue;
+
+		err = tr->cur_image ? 0 : is_ftrace_location(tr->func.addr);
+		if (err < 0)
+			goto out_undo_upto;
+		if (!err) {
+			/* in use, or not patched through ftrace */
+			err = bpf_trampoline_update(tr);
+			if (err)
+				goto out_undo_upto;
+			continue;
+		}
+
+		tprogs = bpf_trampoline_get_progs(tr, &total);
+		if (IS_ERR(tprogs)) {
+			err = PTR_ERR(tprogs);
+			goto out_undo_upto;
+		}
+		ims[i] = bpf_trampoline_build(tr, tprogs);
+		kfree(tprogs);
+		if (IS_ERR(ims[i])) {
+			err = PTR_ERR(ims[i]);
+			ims[i] = NULL;
+			goto out_undo_upto;
+		}
+		ips[nr_ips] = (unsigned long)tr->func.addr;
+		addrs[nr_ips] = (unsigned long)ims[i]->image;
+		nr_ips++;
+	}
+
+	if (nr_ips) {
+		err = register_ftrace_direct_ips(ips, addrs, nr_ips);
+		if (err)
+			goto out_undo_upto;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		if (!ims[i])
+			continue;
+		tr = attach[i].tr;
+		tr->func.ftrace_managed = true;
+		tr->cur_image = ims[i];
+		tr->selector++;
+	}
+	err = 0;
+	goto out_unlock;
+
+out_undo_upto:
+	bpf_trampoline_link_progs_undo(attach, ims, linked, i);
+	goto out_unlock;
+out_undo:
+	bpf_trampoline_link_progs_undo(attach, ims, linked, 0);
+out_unlock:
+	for (i = 0; i < cnt; i++)
+		if (!i || attach[i].tr != attach[i - 1].tr)
+			mutex_unlock(&attach[i].tr->mutex);
+	mutex_unlock(&trampoline_batch_mutex);
+out_free:
+	kvfree(addrs);
+	kvfree(ips);
+	kvfree(ims);
+	return err;
+}
+
 /* bpf_trampoline_unlink_prog() should never fail. */
 int bpf_trampoline_unlink_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 {
@@ -180,6 +180,9 @@ struct cpuset {
 #define PRS_ENABLED		1
 #define PRS_ERROR		-1
 
+/* CPUs of the valid isolated partitions, see is_prs_isolated() */
+static cpumask_var_t isolated_cpus;
+
 /*
  * Temporary cpumasks for working with partitions that are passed among
  * functions to avoid memory allocation in inner functions.
@@ -263,6 +266,17 @@ static inline int is_partition_root(const struct cpuset *cs)
 	return cs->partition_root_state > 0;
 }
 
+/*
+ * An isolated partition is a partition root with load balancing turned
+ * off, which only happens to partitions on the default hierarchy.  Its
+ * CPUs are left out of the scheduler domains and of the unbound
+ * workqueues, so that only the tasks put there run on them.
+ */
+static inline bool is_prs_isolated(const struct cpuset *cs)
+{
+	return cs->partition_root_state && !is_sched_load_balance(cs);
+}
+
 static struct cpuset top_cpuset = {
 	.flags = ((1 << CS_ONLINE) | (1 << CS_CPU_EXCLUSIVE) |
 		  (1 << CS_MEM_EXCLUSIVE)),
@@ -1099,6 +1113,42 @@ enum subparts_cmd {
 	partcmd_update,		/* Update parent's subparts_cpus */
 };
 
+/*
+ * update_isolated_cpus - recompute the CPUs of the isolated partitions
+ *
+ * Keep the unbound workqueues off them.  Called with cpuset_rwsem and the
+ * CPU hotplug lock held.
+ */
+static void update_isolated_cpus(void)
+{
+	struct cgroup_subsys_state *pos_css;
+	cpumask_var_t new_cpus;
+	struct cpuset *cp;
+
+	if (!zalloc_cpumask_var(&new_cpus, GFP_KERNEL))
+		return;
+
+	rcu_read_lock();
+	cpuset_for_each_descendant_pre(cp, pos_css, &top_cpuset) {
+		if (cp == &top_cpuset)
+			continue;
+		/* Partitions only ever have partition roots as parents */
+		if (!is_partition_root(cp)) {
+			pos_css = css_rightmost_descendant(pos_css);
+			continue;
+		}
+		if (is_prs_isolated(cp))
+			cpumask_or(new_cpus, new_cpus, cp->effective_cpus);
+	}
+	rcu_read_unlock();
+
+	if (!cpumask_equal(new_cpus, isolated_cpus)) {
+		cpumask_copy(isolated_cpus, new_cpus);
+		WARN_ON_ONCE(workqueue_unbound_exclude_cpumask(isolated_cpus));
+	}
+	free_cpumask_var(new_cpus);
+}
+
 /**
  * update_parent_subparts_cpumask - update subparts_cpus mask of parent cpuset
  * @cpuset:  The cpuset that requests change in partition root state
@@ -1584,6 +1634,7 @@ static int update_cpumask(struct cpuset *cs, struct cpuset *trialcs,
 		if (parent->child_ecpus_count)
 			update_sibling_cpumasks(parent, cs, &tmp);
 	}
+	update_isolated_cpus();
 	return 0;
 }
 
@@ -1941,20 +1992,42 @@ static int update_flag(cpuset_flagbits_t bit, struct cpuset *cs,
 	return err;
 }
 
+
+/*
+ * Load balance an isolated partition root never, a plain one always, and a
+ * member like its parent.
+ */
+static void update_partition_sd_lb(struct cpuset *cs, int new_prs,
+				   bool isolated)
+{
+	bool load_balance = new_prs ? !isolated :
+			    is_sched_load_balance(parent_cs(cs));
+
+	spin_lock_irq(&callback_lock);
+	if (load_balance)
+		set_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
+	else
+		clear_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
+	spin_unlock_irq(&callback_lock);
+}
+
 /*
  * update_prstate - update partititon_root_state
  * cs: the cpuset to update
  * new_prs: new partition root state
+ * isolated: whether a partition root should be isolated
  *
  * Call with cpuset_mutex held.
  */
-static int update_prstate(struct cpuset *cs, int new_prs)
+static int update_prstate(struct cpuset *cs, int new_prs, bool isolated)
 {
 	int err, old_prs = cs->partition_root_state;
 	struct cpuset *parent = parent_cs(cs);
 	struct tmpmasks tmpmask;
 
-	if (old_prs == new_prs)
+	if (!new_prs)
+		isolated = false;
+	if (old_prs == new_prs && is_prs_isolated(cs) == isolated)
 		return 0;
 
 	/*
@@ -1987,6 +2060,15 @@ static int update_prstate(struct cpuset *cs, int new_prs)
 			update_flag(CS_CPU_EXCLUSIVE, cs, 0);
 			goto out;
 		}
+	} else if (new_prs) {
+		/*
+		 * Switching between a plain and an isolated partition root
+		 * would leave the load balancing of children inconsistent.
+		 */
+		err = -EBUSY;
+		if (css_has_online_children(&cs->css))
+			goto out;
+		err = 0;
 	} else {
 		/*
 		 * Turning off partition root will clear the
@@ -1994,6 +2076,7 @@ static int update_prstate(struct cpuset *cs, int new_prs)
 		 */
 		if (old_prs == PRS_ERROR) {
 			update_flag(CS_CPU_EXCLUSIVE, cs, 0);
+			update_partition_sd_lb(cs, new_prs, false);
 			err = 0;
 			goto out;
 		}
@@ -2007,6 +2090,9 @@ static int update_prstate(struct cpuset *cs, int new_prs)
 		update_flag(CS_CPU_EXCLUSIVE, cs, 0);
 	}
 
+	/* The sched domains rebuilt below account for the new setting. */
+	update_partition_sd_lb(cs, new_prs, isolated);
+
 	/*
 	 * Update cpumask of parent's tasks except when it is the top
 	 * cpuset as some system daemons cannot be mapped to other CPUs.
@@ -2023,6 +2109,7 @@ static int update_prstate(struct cpuset *cs, int new_prs)
 		spin_lock_irq(&callback_lock);
 		cs->partition_root_state = new_prs;
 		spin_unlock_irq(&callback_lock);
+		update_isolated_cpus();
 	}
 
 	free_cpumasks(NULL, &tmpmask);
@@ -2516,13 +2603,14 @@ static int sched_partition_show(struct seq_file *seq, void *v)
 
 	switch (cs->partition_root_state) {
 	case PRS_ENABLED:
-		seq_puts(seq, "root\n");
+		seq_puts(seq, is_prs_isolated(cs) ? "isolated\n" : "root\n");
 		break;
 	case PRS_DISABLED:
 		seq_puts(seq, "member\n");
 		break;
 	case PRS_ERROR:
-		seq_puts(seq, "root invalid\n");
+		seq_puts(seq, is_prs_isolated(cs) ? "isolated invalid\n"
+						  : "root invalid\n");
 		break;
 	}
 	return 0;
@@ -2532,20 +2620,26 @@ static ssize_t sched_partition_write(struct kernfs_open_file *of, char *buf,
 				     size_t nbytes, loff_t off)
 {
 	struct cpuset *cs = css_cs(of_css(of));
+	bool isolated = false;
 	int val;
 	int retval = -ENODEV;
 
 	buf = strstrip(buf);
 
 	/*
-	 * Convert "root" to ENABLED, and convert "member" to DISABLED.
+	 * Convert "root" and "isolated" to ENABLED, and convert "member"
+	 * to DISABLED.
 	 */
-	if (!strcmp(buf, "root"))
+	if (!strcmp(buf, "root")) {
 		val = PRS_ENABLED;
-	else if (!strcmp(buf, "member"))
+	} else if (!strcmp(buf, "isolated")) {
+		val = PRS_ENABLED;
+		isolated = true;
+	} else if (!strcmp(buf, "member")) {
 		val = PRS_DISABLED;
-	else
+	} else {
 		return -EINVAL;
+	}
 
 	css_get(&cs->css);
 	get_online_cpus();
@@ -2553,7 +2647,7 @@ static ssize_t sched_partition_write(struct kernfs_open_file *of, char *buf,
 	if (!is_cpuset_online(cs))
 		goto out_unlock;
 
-	retval = update_prstate(cs, val);
+	retval = update_prstate(cs, val, isolated);
 out_unlock:
 	percpu_up_write(&cpuset_rwsem);
 	put_online_cpus();
@@ -2780,6 +2874,11 @@ static int cpuset_css_online(struct cgroup_subsys_state *css)
 		cs->use_parent_ecpus = true;
 		parent->child_ecpus_count++;
 	}
+
+	/* Children of an isolated partition are not load balanced either */
+	if (cgroup_subsys_on_dfl(cpuset_cgrp_subsys) &&
+	    !is_sched_load_balance(parent))
+		clear_bit(CS_SCHED_LOAD_BALANCE, &cs->flags);
 	spin_unlock_irq(&callback_lock);
 
 	if (!test_bit(CGRP_CPUSET_CLONE_CHILDREN, &css->cgroup->flags))
@@ -2838,7 +2937,7 @@ static void cpuset_css_offline(struct cgroup_subsys_state *css)
 	percpu_down_write(&cpuset_rwsem);
 
 	if (is_partition_root(cs))
-		update_prstate(cs, 0);
+		update_prstate(cs, 0, false);
 
 	if (!cgroup_subsys_on_dfl(cpuset_cgrp_subsys) &&
 	    is_sched_load_balance(cs))
@@ -2938,6 +3037,7 @@ int __init cpuset_init(void)
 	top_cpuset.relax_domain_level = -1;
 
 	BUG_ON(!alloc_cpumask_var(&cpus_attach, GFP_KERNEL));
+	BUG_ON(!zalloc_cpumask_var(&isolated_cpus, GFP_KERNEL));
 
 	return 0;
 }
@@ -3248,6 +3348,15 @@ static void cpuset_hotplug_workfn(struct work_struct *work)
 		rebuild_sched_domains();
 	}
 
+	/* Onlined CPUs of isolated partitions must be kept isolated */
+	if (cpus_updated) {
+		get_online_cpus();
+		percpu_down_write(&cpuset_rwsem);
+		update_isolated_cpus();
+		percpu_up_write(&cpuset_rwsem);
+		put_online_cpus();
+	}
+
 	free_cpumasks(NULL, ptmp);
 }
 
@@ -3,87 +3,121 @@
 
 #include <linux/sched/cputime.h>
 
-static DEFINE_SPINLOCK(cgroup_rstat_lock);
-static DEFINE_PER_CPU(raw_spinlock_t, cgroup_rstat_cpu_lock);
+/*
+ * Every subsystem implementing ->css_rstat_flush() has its own updated
+ * trees and its own locks, so that flushing the stats of one subsystem
+ * never waits for or holds off another.  The base stats use the trees of
+ * the cgroup's self css and the extra slot at the end.
+ */
+#define RSTAT_BASE_ID	CGROUP_SUBSYS_COUNT
+
+static spinlock_t rstat_ss_lock[CGROUP_SUBSYS_COUNT + 1];
+static DEFINE_PER_CPU(raw_spinlock_t, rstat_ss_cpu_lock[CGROUP_SUBSYS_COUNT + 1]);
 
 static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu);
 
+static int rstat_id(struct cgroup_subsys_state *css)
+{
+	return css->ss ? css->ss->id : RSTAT_BASE_ID;
+}
+
+static spinlock_t *rstat_lock(struct cgroup_subsys_state *css)
+{
+	return &rstat_ss_lock[rstat_id(css)];
+}
+
+static raw_spinlock_t *rstat_cpu_lock(struct cgroup_subsys_state *css, int cpu)
+{
+	return per_cpu_ptr(&rstat_ss_cpu_lock[rstat_id(css)], cpu);
+}
+
 static struct cgroup_rstat_cpu *cgroup_rstat_cpu(struct cgroup *cgrp, int cpu)
 {
 	return per_cpu_ptr(cgrp->rstat_cpu, cpu);
 }
 
+static struct css_rstat_cpu *css_rstat_cpu(struct cgroup_subsys_state *css,
+					   int cpu)
+{
+	return per_cpu_ptr(css->rstat_cpu, cpu);
+}
+
 /**
- * cgroup_rstat_updated - keep track of updated rstat_cpu
- * @cgrp: target cgroup
+ * css_rstat_updated - keep track of updated rstat_cpu
+ * @css: target css, the cgroup's self css for the base stats
  * @cpu: cpu on which rstat_cpu was updated
  *
- * @cgrp's rstat_cpu on @cpu was updated.  Put it on the parent's matching
+ * @css's rstat_cpu on @cpu was updated.  Put it on the parent's matching
  * rstat_cpu->updated_children list.  See the comment on top of
- * cgroup_rstat_cpu definition for details.
+ * css_rstat_cpu definition for details.
  */
-void cgroup_rstat_updated(struct cgroup *cgrp, int cpu)
+void css_rstat_updated(struct cgroup_subsys_state *css, int cpu)
 {
-	raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu);
-	struct cgroup *parent;
+	raw_spinlock_t *cpu_lock = rstat_cpu_lock(css, cpu);
 	unsigned long flags;
 
-	/* nothing to do for root */
-	if (!cgroup_parent(cgrp))
-		return;
-
 	/*
 	 * Speculative already-on-list test. This may race leading to
 	 * temporary inaccuracies, which is fine.
 	 *
 	 * Because @parent's updated_children is terminated with @parent
-	 * instead of NULL, we can tell whether @cgrp is on the list by
+	 * instead of NULL, we can tell whether @css is on the list by
 	 * testing the next pointer for NULL.
 	 */
-	if (cgroup_rstat_cpu(cgrp, cpu)->updated_next)
+	if (css_rstat_cpu(css, cpu)->updated_next)
 		return;
 
 	raw_spin_lock_irqsave(cpu_lock, flags);
 
-	/* put @cgrp and all ancestors on the corresponding updated lists */
-	for (parent = cgroup_parent(cgrp); parent;
-	     cgrp = parent, parent = cgroup_parent(cgrp)) {
-		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
-		struct cgroup_rstat_cpu *prstatc = cgroup_rstat_cpu(parent, cpu);
+	/* put @css and all ancestors on the corresponding updated lists */
+	while (true) {
+		struct css_rstat_cpu *rstatc = css_rstat_cpu(css, cpu);
+		struct cgroup_subsys_state *parent = css->parent;
+		struct css_rstat_cpu *prstatc;
 
 		/*
-		 * Both additions and removals are bottom-up.  If a cgroup
-		 * is already in the tree, all ancestors are.
+		 * Both additions and removals are bottom-up.  If a css is
+		 * already in the tree, all ancestors are.
 		 */
 		if (rstatc->updated_next)
 			break;
 
+		/* Root has no parent to link it to, but mark it busy */
+		if (!parent) {
+			rstatc->updated_next = css;
+			break;
+		}
+
+		prstatc = css_rstat_cpu(parent, cpu);
 		rstatc->updated_next = prstatc->updated_children;
-		prstatc->updated_children = cgrp;
+		prstatc->updated_children = css;
+
+		css = parent;
 	}
 
 	raw_spin_unlock_irqrestore(cpu_lock, flags);
 }
 
 /**
- * cgroup_rstat_cpu_pop_updated - iterate and dismantle rstat_cpu updated tree
+ * css_rstat_cpu_pop_updated - iterate and dismantle rstat_cpu updated tree
  * @pos: current position
  * @root: root of the tree to traversal
  * @cpu: target cpu
  *
  * Walks the udpated rstat_cpu tree on @cpu from @root.  %NULL @pos starts
  * the traversal and %NULL return indicates the end.  During traversal,
- * each returned cgroup is unlinked from the tree.  Must be called with the
- * matching cgroup_rstat_cpu_lock held.
+ * each returned css is unlinked from the tree.  Must be called with the
+ * matching rstat cpu lock held.
  *
  * The only ordering guarantee is that, for a parent and a child pair
  * covered by a given traversal, if a child is visited, its parent is
  * guaranteed to be visited afterwards.
  */
-static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
-						   struct cgroup *root, int cpu)
+static struct cgroup_subsys_state *
+css_rstat_cpu_pop_updated(struct cgroup_subsys_state *pos,
+			  struct cgroup_subsys_state *root, int cpu)
 {
-	struct cgroup_rstat_cpu *rstatc;
+	struct css_rstat_cpu *rstatc;
 
 	if (pos == root)
 		return NULL;
@@ -95,11 +129,11 @@ static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
 	if (!pos)
 		pos = root;
 	else
-		pos = cgroup_parent(pos);
+		pos = pos->parent;
 
 	/* walk down to the first leaf */
 	while (true) {
-		rstatc = cgroup_rstat_cpu(pos, cpu);
+		rstatc = css_rstat_cpu(pos, cpu);
 		if (rstatc->updated_children == pos)
 			break;
 		pos = rstatc->updated_children;
@@ -112,24 +146,25 @@ static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
 	 * child in most cases. The only exception is @root.
 	 */
 	if (rstatc->updated_next) {
-		struct cgroup *parent = cgroup_parent(pos);
-		struct cgroup_rstat_cpu *prstatc = cgroup_rstat_cpu(parent, cpu);
-		struct cgroup_rstat_cpu *nrstatc;
-		struct cgroup **nextp;
-
-		nextp = &prstatc->updated_children;
-		while (true) {
-			nrstatc = cgroup_rstat_cpu(*nextp, cpu);
-			if (*nextp == pos)
-				break;
-
-			WARN_ON_ONCE(*nextp == parent);
-			nextp = &nrstatc->updated_next;
+		struct cgroup_subsys_state *parent = pos->parent;
+
+		if (parent) {
+			struct css_rstat_cpu *prstatc;
+			struct cgroup_subsys_state **nextp;
+
+			prstatc = css_rstat_cpu(parent, cpu);
+			nextp = &prstatc->updated_children;
+			while (*nextp != pos) {
+				struct css_rstat_cpu *nrstatc;
+
+				nrstatc = css_rstat_cpu(*nextp, cpu);
+				WARN_ON_ONCE(*nextp == parent);
+				nextp = &nrstatc->updated_next;
+			}
+			*nextp = rstatc->updated_next;
 		}
 
-		*nextp = rstatc->updated_next;
 		rstatc->updated_next = NULL;
-
 		return pos;
 	}
 
@@ -137,154 +172,218 @@ static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
 	return NULL;
 }
 
-/* see cgroup_rstat_flush() */
-static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
-	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+/*
+ * Lockless test for an empty updated tree below and including @css on
+ * @cpu.  Racing with an update just means that it's picked up by the next
+ * flush, same as when the update comes in right after the flush.
+ */
+static bool css_rstat_cpu_idle(struct cgroup_subsys_state *css, int cpu)
 {
-	int cpu;
-
-	lockdep_assert_held(&cgroup_rstat_lock);
+	struct css_rstat_cpu *rstatc = css_rstat_cpu(css, cpu);
 
-	for_each_possible_cpu(cpu) {
-		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
-						       cpu);
-		struct cgroup *pos = NULL;
+	return READ_ONCE(rstatc->updated_children) == css &&
+		!READ_ONCE(rstatc->updated_next);
+}
 
-		raw_spin_lock(cpu_lock);
-		while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
-			struct cgroup_subsys_state *css;
+/* see css_rstat_flush() */
+static void css_rstat_flush_locked(struct cgroup_subsys_state *css,
+				   bool may_sleep)
+	__releases(rstat_lock(css)) __acquires(rstat_lock(css))
+{
+	spinlock_t *lock = rstat_lock(css);
+	int cpu;
 
-			cgroup_base_stat_flush(pos, cpu);
+	lockdep_assert_held(lock);
 
-			rcu_read_lock();
-			list_for_each_entry_rcu(css, &pos->rstat_css_list,
-						rstat_css_node)
-				css->ss->css_rstat_flush(css, cpu);
-			rcu_read_unlock();
+	for_each_possible_cpu(cpu) {
+		raw_spinlock_t *cpu_lock = rstat_cpu_lock(css, cpu);
+		struct cgroup_subsys_state *pos = NULL;
+
+		if (!css_rstat_cpu_idle(css, cpu)) {
+			raw_spin_lock(cpu_lock);
+			while ((pos = css_rstat_cpu_pop_updated(pos, css, cpu))) {
+				if (pos->ss)
+					pos->ss->css_rstat_flush(pos, cpu);
+				else
+					cgroup_base_stat_flush(pos->cgroup, cpu);
+			}
+			raw_spin_unlock(cpu_lock);
 		}
-		raw_spin_unlock(cpu_lock);
-
-		/* if @may_sleep, play nice and yield if necessary */
-		if (may_sleep && (need_resched() ||
-				  spin_needbreak(&cgroup_rstat_lock))) {
-			spin_unlock_irq(&cgroup_rstat_lock);
-			if (!cond_resched())
-				cpu_relax();
-			spin_lock_irq(&cgroup_rstat_lock);
+
+		/*
+		 * Bound the time other flushers of this tree wait for us.
+		 * If @may_sleep, play nice and yield if necessary.  irqsafe
+		 * flushers can't, but still step aside between cpus when
+		 * someone is spinning on the lock; the per-cpu trees are
+		 * consistent at this point and the waiter may well finish
+		 * part of our work.
+		 */
+		if (may_sleep) {
+			if (need_resched() || spin_needbreak(lock)) {
+				spin_unlock_irq(lock);
+				if (!cond_resched())
+					cpu_relax();
+				spin_lock_irq(lock);
+			}
+		} else if (spin_is_contended(lock)) {
+			spin_unlock(lock);
+			cpu_relax();
+			spin_lock(lock);
 		}
 	}
 }
 
 /**
- * cgroup_rstat_flush - flush stats in @cgrp's subtree
- * @cgrp: target cgroup
+ * css_rstat_flush - flush stats in @css's subtree
+ * @css: target css, the cgroup's self css for the base stats
  *
- * Collect all per-cpu stats in @cgrp's subtree into the global counters
- * and propagate them upwards.  After this function returns, all cgroups in
- * the subtree have up-to-date ->stat.
+ * Collect all per-cpu stats in @css's subtree into the global counters
+ * and propagate them upwards.  After this function returns, all csses in
+ * the subtree have up-to-date ->stat.  Only the trees of @css's subsystem
+ * are walked and only flushers of the same subsystem are waited for.
  *
- * This also gets all cgroups in the subtree including @cgrp off the
+ * This also gets all csses in the subtree including @css off the
  * ->updated_children lists.
  *
  * This function may block.
  */
-void cgroup_rstat_flush(struct cgroup *cgrp)
+void css_rstat_flush(struct cgroup_subsys_state *css)
 {
+	spinlock_t *lock = rstat_lock(css);
+
 	might_sleep();
 
-	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
-	spin_unlock_irq(&cgroup_rstat_lock);
+	spin_lock_irq(lock);
+	css_rstat_flush_locked(css, true);
+	spin_unlock_irq(lock);
 }
 
 /**
- * cgroup_rstat_flush_irqsafe - irqsafe version of cgroup_rstat_flush()
- * @cgrp: target cgroup
+ * css_rstat_flush_irqsafe - irqsafe version of css_rstat_flush()
+ * @css: target css
  *
  * This function can be called from any context.
  */
-void cgroup_rstat_flush_irqsafe(struct cgroup *cgrp)
+void css_rstat_flush_irqsafe(struct cgroup_subsys_state *css)
 {
+	spinlock_t *lock = rstat_lock(css);
 	unsigned long flags;
 
-	spin_lock_irqsave(&cgroup_rstat_lock, flags);
-	cgroup_rstat_flush_locked(cgrp, false);
-	spin_unlock_irqrestore(&cgroup_rstat_lock, flags);
+	spin_lock_irqsave(lock, flags);
+	css_rstat_flush_locked(css, false);
+	spin_unlock_irqrestore(lock, flags);
 }
 
 /**
- * cgroup_rstat_flush_begin - flush stats in @cgrp's subtree and hold
+ * cgroup_rstat_flush_hold - flush base stats in @cgrp's subtree and hold
  * @cgrp: target cgroup
  *
- * Flush stats in @cgrp's subtree and prevent further flushes.  Must be
- * paired with cgroup_rstat_flush_release().
+ * Flush base stats in @cgrp's subtree and prevent further flushes of
+ * them.  Must be paired with cgroup_rstat_flush_release().
  *
  * This function may block.
  */
 void cgroup_rstat_flush_hold(struct cgroup *cgrp)
-	__acquires(&cgroup_rstat_lock)
+	__acquires(&rstat_ss_lock[RSTAT_BASE_ID])
 {
 	might_sleep();
-	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
+	spin_lock_irq(&rstat_ss_lock[RSTAT_BASE_ID]);
+	css_rstat_flush_locked(&cgrp->self, true);
 }
 
 /**
  * cgroup_rstat_flush_release - release cgroup_rstat_flush_hold()
  */
 void cgroup_rstat_flush_release(void)
-	__releases(&cgroup_rstat_lock)
+	__releases(&rstat_ss_lock[RSTAT_BASE_ID])
 {
-	spin_unlock_irq(&cgroup_rstat_lock);
+	spin_unlock_irq(&rstat_ss_lock[RSTAT_BASE_ID]);
 }
 
-int cgroup_rstat_init(struct cgroup *cgrp)
+int css_rstat_init(struct cgroup_subsys_state *css)
 {
 	int cpu;
 
-	/* the root cgrp has rstat_cpu preallocated */
-	if (!cgrp->rstat_cpu) {
-		cgrp->rstat_cpu = alloc_percpu(struct cgroup_rstat_cpu);
-		if (!cgrp->rstat_cpu)
+	/* the root cgrp's self css has rstat_cpu preallocated */
+	if (!css->rstat_cpu) {
+		css->rstat_cpu = alloc_percpu(struct css_rstat_cpu);
+		if (!css->rstat_cpu)
 			return -ENOMEM;
 	}
 
 	/* ->updated_children list is self terminated */
-	for_each_possible_cpu(cpu) {
-		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
-
-		rstatc->updated_children = cgrp;
-		u64_stats_init(&rstatc->bsync);
-	}
+	for_each_possible_cpu(cpu)
+		css_rstat_cpu(css, cpu)->updated_children = css;
 
 	return 0;
 }
 
-void cgroup_rstat_exit(struct cgroup *cgrp)
+void css_rstat_exit(struct cgroup_subsys_state *css)
 {
 	int cpu;
 
-	cgroup_rstat_flush(cgrp);
+	/* css_create() may have failed before css_rstat_init() */
+	if (!css->rstat_cpu)
+		return;
+
+	css_rstat_flush(css);
 
 	/* sanity check */
 	for_each_possible_cpu(cpu) {
-		struct cgroup_rstat_cpu *rstatc = cgroup_rstat_cpu(cgrp, cpu);
+		struct css_rstat_cpu *rstatc = css_rstat_cpu(css, cpu);
 
-		if (WARN_ON_ONCE(rstatc->updated_children != cgrp) ||
+		if (WARN_ON_ONCE(rstatc->updated_children != css) ||
 		    WARN_ON_ONCE(rstatc->updated_next))
 			return;
 	}
 
+	free_percpu(css->rstat_cpu);
+	css->rstat_cpu = NULL;
+}
+
+int cgroup_rstat_init(struct cgroup *cgrp)
+{
+	int cpu, ret;
+
+	/* the root cgrp has rstat_cpu preallocated */
+	if (!cgrp->rstat_cpu) {
+		cgrp->rstat_cpu = alloc_percpu(struct cgroup_rstat_cpu);
+		if (!cgrp->rstat_cpu)
+			return -ENOMEM;
+	}
+
+	ret = css_rstat_init(&cgrp->self);
+	if (ret) {
+		free_percpu(cgrp->rstat_cpu);
+		cgrp->rstat_cpu = NULL;
+		return ret;
+	}
+
+	for_each_possible_cpu(cpu)
+		u64_stats_init(&cgroup_rstat_cpu(cgrp, cpu)->bsync);
+
+	return 0;
+}
+
+void cgroup_rstat_exit(struct cgroup *cgrp)
+{
+	css_rstat_exit(&cgrp->self);
+	if (cgrp->self.rstat_cpu)
+		return;
+
 	free_percpu(cgrp->rstat_cpu);
 	cgrp->rstat_cpu = NULL;
 }
 
 void __init cgroup_rstat_boot(void)
 {
-	int cpu;
+	int i, cpu;
 
-	for_each_possible_cpu(cpu)
-		raw_spin_lock_init(per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu));
+	for (i = 0; i <= CGROUP_SUBSYS_COUNT; i++) {
+		spin_lock_init(&rstat_ss_lock[i]);
+		for_each_possible_cpu(cpu)
+			raw_spin_lock_init(per_cpu_ptr(&rstat_ss_cpu_lock[i], cpu));
+	}
 
 	BUG_ON(cgroup_rstat_init(&cgrp_dfl_root.cgrp));
 }
@@ -316,6 +415,10 @@ static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu)
 	struct cgroup_base_stat cur, delta;
 	unsigned seq;
 
+	/* Root-level stats are sourced from system-wide CPU stats */
+	if (!parent)
+		return;
+
 	/* fetch the current per-cpu values */
 	do {
 		seq = __u64_stats_fetch_begin(&rstatc->bsync);
@@ -329,12 +432,10 @@ static void cgroup_base_stat_flush(struct cgroup *cgrp, int cpu)
 	cgroup_base_stat_add(&rstatc->last_bstat, &delta);
 
 	/* propagate global delta to parent */
-	if (parent) {
-		delta = cgrp->bstat;
-		cgroup_base_stat_sub(&delta, &cgrp->last_bstat);
-		cgroup_base_stat_add(&parent->bstat, &delta);
-		cgroup_base_stat_add(&cgrp->last_bstat, &delta);
-	}
+	delta = cgrp->bstat;
+	cgroup_base_stat_sub(&delta, &cgrp->last_bstat);
+	cgroup_base_stat_add(&parent->bstat, &delta);
+	cgroup_base_stat_add(&cgrp->last_bstat, &delta);
 }
 
 static struct cgroup_rstat_cpu *
@@ -351,7 +452,7 @@ static void cgroup_base_stat_cputime_account_end(struct cgroup *cgrp,
 						 struct cgroup_rstat_cpu *rstatc)
 {
 	u64_stats_update_end(&rstatc->bsync);
-	cgroup_rstat_updated(cgrp, smp_processor_id());
+	css_rstat_updated(&cgrp->self, smp_processor_id());
 	put_cpu_ptr(rstatc);
 }
 
@@ -547,17 +547,35 @@ static int bringup_wait_for_ap(unsigned int cpu)
 	return cpuhp_kick_ap(st, st->target);
 }
 
-static int bringup_cpu(unsigned int cpu)
+/*
+ * Architectures which can start an AP without waiting for it override
+ * this.  The AP must then get as far as it can on its own and wait for
+ * __cpu_up() before it touches anything shared with other CPUs.
+ */
+int __weak arch_cpuhp_kick_ap_alive(unsigned int cpu, struct task_struct *tidle)
+{
+	return 0;
+}
+
+static int cpuhp_kick_ap_alive(unsigned int cpu)
 {
 	struct task_struct *idle = idle_thread_get(cpu);
-	int ret;
 
 	/*
 	 * Reset stale stack state from the last time this CPU was online.
+	 * The AP may start running on this stack right below.
 	 */
 	scs_task_reset(idle);
 	kasan_unpoison_task_stack(idle);
 
+	return arch_cpuhp_kick_ap_alive(cpu, idle);
+}
+
+static int bringup_cpu(unsigned int cpu)
+{
+	struct task_struct *idle = idle_thread_get(cpu);
+	int ret;
+
 	/*
 	 * Some architectures have to walk the irq descriptors to
 	 * setup the vector space for the cpu which comes online.
@@ -1388,9 +1406,35 @@ int bringup_hibernate_cpu(unsigned int sleep_cpu)
 	return 0;
 }
 
-void bringup_nonboot_cpus(unsigned int setup_max_cpus)
+static bool cpuhp_parallel_bringup __initdata = true;
+
+static int __init parallel_bringup_parse_param(char *arg)
 {
-	unsigned int cpu;
+	return kstrtobool(arg, &cpuhp_parallel_bringup);
+}
+early_param("cpuhp.parallel", parallel_bringup_parse_param);
+
+bool __weak __init arch_cpuhp_init_parallel_bringup(void)
+{
+	return false;
+}
+
+void __init bringup_nonboot_cpus(unsigned int setup_max_cpus)
+{
+	unsigned int cpu, n = num_online_cpus();
+
+	/*
+	 * Kick all the APs first, so that they run their early startup
+	 * concurrently, then finish bringing them up one by one.
+	 */
+	if (cpuhp_parallel_bringup && arch_cpuhp_init_parallel_bringup()) {
+		for_each_present_cpu(cpu) {
+			if (n >= setup_max_cpus)
+				break;
+			if (!cpu_online(cpu) && !cpu_up(cpu, CPUHP_BP_KICK_AP))
+				n++;
+		}
+	}
 
 	for_each_present_cpu(cpu) {
 		if (num_online_cpus() >= setup_max_cpus)
@@ -1621,6 +1665,12 @@ static struct cpuhp_step cpuhp_hp_states[] = {
 		.startup.single		= timers_prepare_cpu,
 		.teardown.single	= timers_dead_cpu,
 	},
+	/* Starts the AP, which then runs up to its first sync point */
+	[CPUHP_BP_KICK_AP] = {
+		.name			= "cpu:kick_ap",
+		.startup.single		= cpuhp_kick_ap_alive,
+		.teardown.single	= NULL,
+	},
 	/* Kicks the plugged cpu into life */
 	[CPUHP_BRINGUP_CPU] = {
 		.name			= "cpu:bringup",
@@ -0,0 +1,301 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Compact NUMA-aware (CNA) slow path for queued spinlocks.
+ *
+ * The native slow path hands the lock over to the waiters in FIFO order,
+ * no matter which NUMA node they are on, so a contended lock and the data
+ * it protects keep moving between sockets.  CNA keeps the qspinlock word
+ * and its MCS queue of waiters (the main queue), but the queue head picks
+ * its successor among the waiters on its own node.  The waiters it skips
+ * are moved to a secondary queue, which is passed along with the lock.
+ *
+ * The secondary queue goes back into the main queue, ahead of everybody
+ * else, when the main queue runs out of waiters or when it has been
+ * waiting for longer than numa_spinlock_threshold_ns, so that nobody is
+ * starved.  The secondary queue is circular: the lock holder only keeps a
+ * pointer to its tail, whose ->next is its head.
+ *
+ * Only the slow path differs, so the fast path, trylock and unlock are
+ * shared with the native qspinlock.  The slow path is switched at boot,
+ * before any other CPU is up, so native and CNA waiters never mix.
+ */
+
+#include <linux/smp.h>
+#include <linux/bug.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/percpu.h>
+#include <linux/spinlock.h>
+#include <linux/topology.h>
+#include <linux/sched/clock.h>
+#include <asm/qspinlock.h>
+#include <asm/paravirt.h>
+
+/* One node per context: task, softirq, hardirq and nmi. */
+#define MAX_NODES	4
+
+#define _Q_LOCKED_PENDING_MASK (_Q_LOCKED_MASK | _Q_PENDING_MASK)
+
+struct cna_node {
+	struct cna_node	*next;
+	int		locked;		/* 1 if this node is the queue head */
+	int		count;		/* nesting count, see qspinlock.c */
+	int		numa_node;
+	u32		encoded_tail;
+	struct cna_node	*sec_tail;	/* secondary queue handed over */
+	u64		sec_start;	/* time the secondary queue started */
+};
+
+static DEFINE_PER_CPU_ALIGNED(struct cna_node, cna_nodes[MAX_NODES]);
+
+enum {
+	CNA_AUTO,
+	CNA_ON,
+	CNA_OFF,
+};
+
+static int cna_mode __initdata = CNA_AUTO;
+static u64 cna_threshold_ns __read_mostly = NSEC_PER_MSEC;
+
+static int __init numa_spinlock_setup(char *str)
+{
+	if (!strcmp(str, "auto"))
+		cna_mode = CNA_AUTO;
+	else if (!strcmp(str, "on"))
+		cna_mode = CNA_ON;
+	else if (!strcmp(str, "off"))
+		cna_mode = CNA_OFF;
+	else
+		return 0;
+
+	return 1;
+}
+__setup("numa_spinlock=", numa_spinlock_setup);
+
+static int __init numa_spinlock_threshold_setup(char *str)
+{
+	return !kstrtou64(str, 0, &cna_threshold_ns);
+}
+__setup("numa_spinlock_threshold_ns=", numa_spinlock_threshold_setup);
+
+static inline u32 encode_tail(int cpu, int idx)
+{
+	return ((cpu + 1) << _Q_TAIL_CPU_OFFSET) | (idx << _Q_TAIL_IDX_OFFSET);
+}
+
+static inline struct cna_node *decode_tail(u32 tail)
+{
+	int cpu = (tail >> _Q_TAIL_CPU_OFFSET) - 1;
+	int idx = (tail & _Q_TAIL_IDX_MASK) >> _Q_TAIL_IDX_OFFSET;
+
+	return per_cpu_ptr(&cna_nodes[idx], cpu);
+}
+
+/*
+ * Put @tail into the tail of @lock and return the previous tail, with the
+ * locked and pending bits left alone.
+ */
+static __always_inline u32 xchg_tail(struct qspinlock *lock, u32 tail)
+{
+#if _Q_PENDING_BITS == 8
+	return (u32)xchg_relaxed(&lock->tail,
+				 tail >> _Q_TAIL_OFFSET) << _Q_TAIL_OFFSET;
+#else
+	u32 old, new, val = atomic_read(&lock->val);
+
+	for (;;) {
+		new = (val & _Q_LOCKED_PENDING_MASK) | tail;
+		old = atomic_cmpxchg_relaxed(&lock->val, val, new);
+		if (old == val)
+			break;
+
+		val = old;
+	}
+	return old;
+#endif
+}
+
+/* Append the main queue waiters @first..@last to @node's secondary queue. */
+static void cna_splice_tail(struct cna_node *node, struct cna_node *first,
+			    struct cna_node *last)
+{
+	if (!node->sec_tail) {
+		last->next = first;
+		node->sec_start = local_clock();
+	} else {
+		last->next = node->sec_tail->next;
+		node->sec_tail->next = first;
+	}
+	node->sec_tail = last;
+}
+
+/*
+ * Pick the next queue head among the waiters behind @node in the main
+ * queue, starting with @next.  A waiter on @node's NUMA node is preferred,
+ * and the waiters in front of it are moved to the secondary queue.  The
+ * last waiter of the main queue is never moved, the lock word points to
+ * it.
+ */
+static struct cna_node *cna_find_next(struct cna_node *node,
+				      struct cna_node *next)
+{
+	struct cna_node *cur = next, *last = NULL;
+
+	/* Let the secondary queue go first if it waited long enough. */
+	if (node->sec_tail &&
+	    local_clock() - node->sec_start > READ_ONCE(cna_threshold_ns)) {
+		cur = node->sec_tail->next;
+		node->sec_tail->next = next;
+		node->sec_tail = NULL;
+		return cur;
+	}
+
+	while (cur->numa_node != node->numa_node) {
+		last = cur;
+		cur = READ_ONCE(cur->next);
+		if (!cur)
+			return next;
+	}
+
+	if (last)
+		cna_splice_tail(node, next, last);
+
+	return cur;
+}
+
+/**
+ * __cna_queued_spin_lock_slowpath - acquire a contended queued spinlock
+ * @lock: Pointer to queued spinlock structure
+ * @val: Current value of the queued spinlock 32-bit word
+ *
+ * Unlike the native slow path, this one doesn't use the pending bit: every
+ * waiter goes through the queue, so that the order of handoffs is always
+ * decided by the queue head.
+ */
+void __cna_queued_spin_lock_slowpath(struct qspinlock *lock, u32 val)
+{
+	struct cna_node *node, *prev, *next;
+	u32 old, tail;
+	int idx;
+
+	if (virt_spin_lock(lock))
+		return;
+
+	node = this_cpu_ptr(&cna_nodes[0]);
+	idx = node->count++;
+	tail = encode_tail(smp_processor_id(), idx);
+
+	/*
+	 * Running out of nodes takes nested NMIs while spinning on locks,
+	 * which should never happen.  Spin on the lock word instead.
+	 */
+	if (unlikely(idx >= MAX_NODES)) {
+		while (!queued_spin_trylock(lock))
+			cpu_relax();
+		goto release;
+	}
+
+	node += idx;
+
+	/*
+	 * Ensure that we increment the head node->count before initialising
+	 * the actual node.  If the compiler is kind enough to reorder these
+	 * stores, then an IRQ could overwrite our assignments.
+	 */
+	barrier();
+
+	node->locked = 0;
+	node->next = NULL;
+	node->sec_tail = NULL;
+
+	if (queued_spin_trylock(lock))
+		goto release;
+
+	/* Initialise the node before it can be found through the tail. */
+	smp_wmb();
+
+	old = xchg_tail(lock, tail);
+	if (old & _Q_TAIL_MASK) {
+		prev = decode_tail(old);
+		WRITE_ONCE(prev->next, node);
+
+		/* Wait for the previous head to make us the queue head. */
+		smp_cond_load_acquire(&node->locked, VAL);
+	}
+
+	/* We're at the head of the queue, wait for the owner to go away. */
+	val = atomic_cond_read_acquire(&lock->val,
+				       !(VAL & _Q_LOCKED_PENDING_MASK));
+
+	if ((val & _Q_TAIL_MASK) == tail) {
+		struct cna_node *sec_tail = node->sec_tail;
+
+		/* We're the last waiter, take the lock and clear the tail. */
+		if (!sec_tail) {
+			if (atomic_try_cmpxchg_relaxed(&lock->val, &val,
+						       _Q_LOCKED_VAL))
+				goto release;
+		} else {
+			/* Turn the secondary queue into the main queue. */
+			next = sec_tail->next;
+			sec_tail->next = NULL;
+			if (atomic_try_cmpxchg_release(&lock->val, &val,
+						       sec_tail->encoded_tail |
+						       _Q_LOCKED_VAL)) {
+				next->sec_tail = NULL;
+				/* Publish ->sec_tail along with the handoff. */
+				smp_store_release(&next->locked, 1);
+				goto release;
+			}
+			sec_tail->next = next;
+		}
+	}
+
+	/* Somebody queued up behind us, take the lock and pick a successor. */
+	WRITE_ONCE(lock->locked, _Q_LOCKED_VAL);
+
+	next = smp_cond_load_relaxed(&node->next, (VAL));
+	next = cna_find_next(node, next);
+
+	next->sec_tail = node->sec_tail;
+	next->sec_start = node->sec_start;
+	/* Publish the secondary queue along with the handoff. */
+	smp_store_release(&next->locked, 1);
+
+release:
+	__this_cpu_dec(cna_nodes[0].count);
+}
+
+/*
+ * Switch the queued spinlock slow path to CNA on native multi-node
+ * machines.  Called before the paravirt call sites are patched and before
+ * the secondary CPUs are brought up.
+ */
+void __init cna_configure_spin_lock_slowpath(void)
+{
+	int cpu, idx;
+
+	if (cna_mode == CNA_OFF)
+		return;
+
+	if (cna_mode == CNA_AUTO && num_possible_nodes() <= 1)
+		return;
+
+	/* Leave paravirt spinlocks of hypervisors alone. */
+	if (pv_ops.lock.queued_spin_lock_slowpath !=
+	    native_queued_spin_lock_slowpath)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		for (idx = 0; idx < MAX_NODES; idx++) {
+			struct cna_node *node = per_cpu_ptr(&cna_nodes[idx], cpu);
+
+			node->numa_node = cpu_to_node(cpu);
+			node->encoded_tail = encode_tail(cpu, idx);
+		}
+	}
+
+	pv_ops.lock.queued_spin_lock_slowpath = __cna_queued_spin_lock_slowpath;
+
+	pr_info("Enabling CNA spinlock\n");
+}
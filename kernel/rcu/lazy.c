@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Lazy batching of RCU callbacks that are in no hurry to be invoked.
+ *
+ * Many call_rcu() users merely free memory, and nothing waits for their
+ * callbacks.  Each such callback still keeps grace periods going and
+ * wakes up the CPU that queued it.  call_rcu_lazy() instead parks the
+ * callbacks on a per-CPU list, which is handed to call_rcu() in one go
+ * once it grows long enough, once its oldest callback has waited long
+ * enough, or once the system runs short of memory.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/percpu.h>
+#include <linux/rcupdate.h>
+#include <linux/shrinker.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+#include <linux/moduleparam.h>
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "rcutree."
+
+/* Batch callbacks at all?  Otherwise call_rcu_lazy() is call_rcu(). */
+static bool lazy = true;
+module_param(lazy, bool, 0444);
+
+/* Flush a CPU's lazy callbacks once this many are queued... */
+static long lazy_batch = 1000;
+module_param(lazy_batch, long, 0644);
+
+/* ...or once the oldest of them has waited this many jiffies. */
+static ulong jiffies_till_lazy_flush = 10 * HZ;
+module_param(jiffies_till_lazy_flush, ulong, 0644);
+
+struct rcu_lazy_data {
+	raw_spinlock_t		lock;
+	struct rcu_head		*head;
+	struct rcu_head		**tail;
+	long			len;
+	struct timer_list	timer;
+};
+
+static DEFINE_PER_CPU(struct rcu_lazy_data, rcu_lazy_data);
+static bool rcu_lazy_active __read_mostly;
+
+/* Hand all lazy callbacks of @rld over to call_rcu(). */
+static void rcu_lazy_flush(struct rcu_lazy_data *rld)
+{
+	struct rcu_head *rhp, *next;
+	unsigned long flags;
+
+	raw_spin_lock_irqsave(&rld->lock, flags);
+	rhp = rld->head;
+	rld->head = NULL;
+	rld->tail = &rld->head;
+	WRITE_ONCE(rld->len, 0);
+	raw_spin_unlock_irqrestore(&rld->lock, flags);
+
+	for (; rhp; rhp = next) {
+		next = rhp->next;
+		call_rcu(rhp, rhp->func);
+	}
+}
+
+static void rcu_lazy_timer_fn(struct timer_list *t)
+{
+	struct rcu_lazy_data *rld = from_timer(rld, t, timer);
+
+	rcu_lazy_flush(rld);
+}
+
+/**
+ * call_rcu_lazy() - Queue an RCU callback that may be invoked late.
+ * @head: structure to be used for queueing the RCU updates.
+ * @func: actual callback function to be invoked after the grace period
+ *
+ * This is call_rcu() for callbacks that nothing is waiting for, typically
+ * ones that only free memory.  The callback is batched with others queued
+ * on this CPU and may be invoked seconds after a grace period has elapsed,
+ * which saves grace periods and wakeups on otherwise idle systems.  The
+ * batch is flushed early when memory runs low.
+ *
+ * rcu_barrier() does not wait for callbacks that are still batched, so
+ * callback functions that live in modules must use call_rcu(), or their
+ * modules must call rcu_lazy_flush_all() before rcu_barrier().
+ */
+void call_rcu_lazy(struct rcu_head *head, rcu_callback_t func)
+{
+	struct rcu_lazy_data *rld;
+	unsigned long flags;
+	bool flush;
+
+	if (!READ_ONCE(rcu_lazy_active)) {
+		call_rcu(head, func);
+		return;
+	}
+
+	head->func = func;
+	head->next = NULL;
+
+	local_irq_save(flags);
+	rld = this_cpu_ptr(&rcu_lazy_data);
+	raw_spin_lock(&rld->lock);
+	*rld->tail = head;
+	rld->tail = &head->next;
+	WRITE_ONCE(rld->len, rld->len + 1);
+	if (rld->len == 1)
+		mod_timer(&rld->timer,
+			  jiffies + READ_ONCE(jiffies_till_lazy_flush));
+	flush = rld->len >= READ_ONCE(lazy_batch);
+	raw_spin_unlock(&rld->lock);
+	local_irq_restore(flags);
+
+	if (flush)
+		rcu_lazy_flush(rld);
+}
+EXPORT_SYMBOL_GPL(call_rcu_lazy);
+
+/**
+ * rcu_lazy_flush_all() - Hand all lazy callbacks over to call_rcu().
+ *
+ * After this returns, every callback queued by call_rcu_lazy() before the
+ * call has been passed to call_rcu(), so a following rcu_barrier() waits
+ * for them.
+ */
+void rcu_lazy_flush_all(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_lazy_data *rld = per_cpu_ptr(&rcu_lazy_data, cpu);
+
+		if (READ_ONCE(rld->len))
+			rcu_lazy_flush(rld);
+	}
+}
+EXPORT_SYMBOL_GPL(rcu_lazy_flush_all);
+
+static unsigned long rcu_lazy_shrink_count(struct shrinker *shrink,
+					   struct shrink_control *sc)
+{
+	unsigned long count = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		count += READ_ONCE(per_cpu_ptr(&rcu_lazy_data, cpu)->len);
+
+	return count ? count : SHRINK_EMPTY;
+}
+
+static unsigned long rcu_lazy_shrink_scan(struct shrinker *shrink,
+					  struct shrink_control *sc)
+{
+	unsigned long freed = 0;
+	long count;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_lazy_data *rld = per_cpu_ptr(&rcu_lazy_data, cpu);
+
+		count = READ_ONCE(rld->len);
+		if (!count)
+			continue;
+		rcu_lazy_flush(rld);
+		freed += count;
+		if (freed >= sc->nr_to_scan)
+			break;
+	}
+
+	return freed ? freed : SHRINK_STOP;
+}
+
+static struct shrinker rcu_lazy_shrinker = {
+	.count_objects	= rcu_lazy_shrink_count,
+	.scan_objects	= rcu_lazy_shrink_scan,
+	.batch		= 0,
+	.seeks		= DEFAULT_SEEKS,
+};
+
+static int __init rcu_lazy_init(void)
+{
+	int cpu;
+
+	if (!lazy)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		struct rcu_lazy_data *rld = per_cpu_ptr(&rcu_lazy_data, cpu);
+
+		raw_spin_lock_init(&rld->lock);
+		rld->tail = &rld->head;
+		timer_setup(&rld->timer, rcu_lazy_timer_fn, 0);
+	}
+
+	if (register_shrinker(&rcu_lazy_shrinker)) {
+		pr_err("Failed to register lazy RCU shrinker!\n");
+		return 0;
+	}
+
+	WRITE_ONCE(rcu_lazy_active, true);
+	return 0;
+}
+early_initcall(rcu_lazy_init);
@@ -84,11 +84,18 @@
 static int rseq_update_cpu_id(struct task_struct *t)
 {
 	u32 cpu_id = raw_smp_processor_id();
+	u32 node_id = cpu_to_node(cpu_id);
+	u32 mm_cid = task_mm_cid(t);
 
+	WARN_ON_ONCE((int) mm_cid < 0);
 	if (put_user(cpu_id, &t->rseq->cpu_id_start))
 		return -EFAULT;
 	if (put_user(cpu_id, &t->rseq->cpu_id))
 		return -EFAULT;
+	if (put_user(node_id, &t->rseq->node_id))
+		return -EFAULT;
+	if (put_user(mm_cid, &t->rseq->mm_cid))
+		return -EFAULT;
 	trace_rseq_update(t);
 	return 0;
 }
@@ -109,6 +116,13 @@ static int rseq_reset_rseq_cpu_id(struct task_struct *t)
 	 */
 	if (put_user(cpu_id, &t->rseq->cpu_id))
 		return -EFAULT;
+	/*
+	 * Reset node_id and mm_cid to their initial state (0).
+	 */
+	if (put_user(0U, &t->rseq->node_id))
+		return -EFAULT;
+	if (put_user(0U, &t->rseq->mm_cid))
+		return -EFAULT;
 	return 0;
 }
 
@@ -352,7 +352,7 @@ static enum hrtimer_restart hrtick(struct hrtimer *timer)
 
 	rq_lock(rq, &rf);
 	update_rq_clock(rq);
-	rq->curr->sched_class->task_tick(rq, rq->curr, 1);
+	rq->donor->sched_class->task_tick(rq, rq->donor, 1);
 	rq_unlock(rq, &rf);
 
 	return HRTIMER_NORESTART;
@@ -639,6 +639,24 @@ void resched_cpu(int cpu)
 	raw_spin_unlock_irqrestore(&rq->lock, flags);
 }
 
+/*
+ * Like resched_cpu(), but only if @cpu is idle, and without taking its
+ * rq->lock so that it can be called with another rq->lock held.  Setting
+ * TIF_NEED_RESCHED on an idle task that just stopped running is harmless.
+ */
+void resched_idle_cpu(int cpu)
+{
+	struct rq *rq = cpu_rq(cpu);
+
+	if (READ_ONCE(rq->curr) != rq->idle)
+		return;
+
+	if (set_nr_and_not_polling(rq->idle))
+		smp_send_reschedule(cpu);
+	else
+		trace_sched_wake_idle_without_ipi(cpu);
+}
+
 #ifdef CONFIG_SMP
 #ifdef CONFIG_NO_HZ_COMMON
 /*
@@ -1690,9 +1708,11 @@ static inline void check_class_changed(struct rq *rq, struct task_struct *p,
 
 void check_preempt_curr(struct rq *rq, struct task_struct *p, int flags)
 {
-	if (p->sched_class == rq->curr->sched_class)
-		rq->curr->sched_class->check_preempt_curr(rq, p, flags);
-	else if (p->sched_class > rq->curr->sched_class)
+	struct task_struct *donor = rq->donor;
+
+	if (p->sched_class == donor->sched_class)
+		donor->sched_class->check_preempt_curr(rq, p, flags);
+	else if (p->sched_class > donor->sched_class)
 		resched_curr(rq);
 
 	/*
@@ -1847,7 +1867,7 @@ void do_set_cpus_allowed(struct task_struct *p, const struct cpumask *new_mask)
 	lockdep_assert_held(&p->pi_lock);
 
 	queued = task_on_rq_queued(p);
-	running = task_current(rq, p);
+	running = task_current_donor(rq, p);
 
 	if (queued) {
 		/*
@@ -1935,7 +1955,8 @@ static int __set_cpus_allowed_ptr(struct task_struct *p,
 	if (cpumask_test_cpu(task_cpu(p), new_mask))
 		goto out;
 
-	if (task_running(rq, p) || p->state == TASK_WAKING) {
+	if (task_running(rq, p) || task_current_donor(rq, p) ||
+	    p->state == TASK_WAKING) {
 		struct migration_arg arg = { p, dest_cpu };
 		/* Need help from migration thread: drop lock and wait. */
 		task_rq_unlock(rq, p, &rf);
@@ -2557,6 +2578,9 @@ static int ttwu_runnable(struct task_struct *p, int wake_flags)
 		/* check_preempt_curr() may use rq clock */
 		update_rq_clock(rq);
 		ttwu_do_wakeup(rq, p, wake_flags, &rf);
+		/* Stop running the owner of the mutex @p waited for. */
+		if (task_current_donor(rq, p) && !task_current(rq, p))
+			resched_curr(rq);
 		ret = 1;
 	}
 	__task_rq_unlock(rq, &rf);
@@ -2656,6 +2680,18 @@ bool cpus_share_cache(int this_cpu, int that_cpu)
 	return per_cpu(sd_llc_id, this_cpu) == per_cpu(sd_llc_id, that_cpu);
 }
 
+/*
+ * Whether CPUs are in the same cluster, or in the same LLC on machines
+ * without clusters.
+ */
+bool cpus_share_resources(int this_cpu, int that_cpu)
+{
+	if (this_cpu == that_cpu)
+		return true;
+
+	return per_cpu(sd_share_id, this_cpu) == per_cpu(sd_share_id, that_cpu);
+}
+
 static inline bool ttwu_queue_cond(int cpu, int wake_flags)
 {
 	/*
@@ -3104,6 +3140,15 @@ static void __sched_fork(unsigned long clone_flags, struct task_struct *p)
 	p->rt.on_rq		= 0;
 	p->rt.on_list		= 0;
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+	INIT_LIST_HEAD(&p->scx.dsq_node);
+	INIT_LIST_HEAD(&p->scx.runnable_node);
+	p->scx.dsq		= NULL;
+	p->scx.slice		= SCX_SLICE_DFL;
+	p->scx.holding_cpu	= -1;
+	p->scx.flags		= 0;
+#endif
+
 #ifdef CONFIG_PREEMPT_NOTIFIERS
 	INIT_HLIST_HEAD(&p->preempt_notifiers);
 #endif
@@ -3121,7 +3166,9 @@ DEFINE_STATIC_KEY_FALSE(sched_numa_balancing);
 
 #ifdef CONFIG_NUMA_BALANCING
 
-void set_numabalancing_state(bool enabled)
+int sysctl_numa_balancing_mode;
+
+static void __set_numabalancing_state(bool enabled)
 {
 	if (enabled)
 		static_branch_enable(&sched_numa_balancing);
@@ -3129,13 +3176,22 @@ void set_numabalancing_state(bool enabled)
 		static_branch_disable(&sched_numa_balancing);
 }
 
+void set_numabalancing_state(bool enabled)
+{
+	if (enabled)
+		sysctl_numa_balancing_mode = NUMA_BALANCING_NORMAL;
+	else
+		sysctl_numa_balancing_mode = NUMA_BALANCING_DISABLED;
+	__set_numabalancing_state(enabled);
+}
+
 #ifdef CONFIG_PROC_SYSCTL
 int sysctl_numa_balancing(struct ctl_table *table, int write,
 			  void *buffer, size_t *lenp, loff_t *ppos)
 {
 	struct ctl_table t;
 	int err;
-	int state = static_branch_likely(&sched_numa_balancing);
+	int state = sysctl_numa_balancing_mode;
 
 	if (write && !capable(CAP_SYS_ADMIN))
 		return -EPERM;
@@ -3145,8 +3201,13 @@ int sysctl_numa_balancing(struct ctl_table *table, int write,
 	err = proc_dointvec_minmax(&t, write, buffer, lenp, ppos);
 	if (err < 0)
 		return err;
-	if (write)
-		set_numabalancing_state(state);
+	if (write) {
+		err = numa_sample_set_state(state & NUMA_BALANCING_PMU_SAMPLING);
+		if (err)
+			return err;
+		sysctl_numa_balancing_mode = state;
+		__set_numabalancing_state(state);
+	}
 	return err;
 }
 #endif
@@ -3263,6 +3324,9 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 		p->prio = p->normal_prio = p->static_prio;
 		set_load_weight(p, false);
 
+		if (p->se.latency_nice < DEFAULT_LATENCY_NICE)
+			p->se.latency_nice = DEFAULT_LATENCY_NICE;
+
 		/*
 		 * We don't need the reset flag anymore after the fork. It has
 		 * fulfilled its duty:
@@ -3275,7 +3339,7 @@ int sched_fork(unsigned long clone_flags, struct task_struct *p)
 	else if (rt_prio(p->prio))
 		p->sched_class = &rt_sched_class;
 	else
-		p->sched_class = &fair_sched_class;
+		p->sched_class = normal_sched_class(p);
 
 	init_entity_runnable_average(&p->se);
 
@@ -3361,6 +3425,16 @@ void wake_up_new_task(struct task_struct *p)
 	 */
 	p->recent_used_cpu = task_cpu(p);
 	rseq_migrate(p);
+#ifdef CONFIG_SCHED_CLASS_EXT
+	/*
+	 * The BPF scheduler may have come or gone, or the cgroup changed,
+	 * since sched_fork().  Tasks on the task list are switched over by
+	 * scx_reset_task_class(), which serializes against us on pi_lock.
+	 */
+	if (p->sched_class == &fair_sched_class ||
+	    p->sched_class == &ext_sched_class)
+		p->sched_class = normal_sched_class(p);
+#endif
 	__set_task_cpu(p, select_task_rq(p, task_cpu(p), SD_BALANCE_FORK, 0));
 #endif
 	rq = __task_rq_lock(p, &rf);
@@ -3783,6 +3857,8 @@ context_switch(struct rq *rq, struct task_struct *prev,
 		}
 	}
 
+	switch_mm_cid(prev, next);
+
 	rq->clock_update_flags &= ~(RQCF_ACT_SKIP|RQCF_REQ_SKIP);
 
 	prepare_lock_switch(rq, next, rf);
@@ -3978,7 +4054,7 @@ unsigned long long task_sched_runtime(struct task_struct *p)
 	 * project cycles that may never be accounted to this
 	 * thread, breaking clock_gettime().
 	 */
-	if (task_current(rq, p) && task_on_rq_queued(p)) {
+	if (task_current_donor(rq, p) && task_on_rq_queued(p)) {
 		prefetch_curr_exec_start(p);
 		update_rq_clock(rq);
 		p->sched_class->update_curr(rq);
@@ -3997,7 +4073,7 @@ void scheduler_tick(void)
 {
 	int cpu = smp_processor_id();
 	struct rq *rq = cpu_rq(cpu);
-	struct task_struct *curr = rq->curr;
+	struct task_struct *donor;
 	struct rq_flags rf;
 	unsigned long thermal_pressure;
 
@@ -4005,11 +4081,12 @@ void scheduler_tick(void)
 	sched_clock_tick();
 
 	rq_lock(rq, &rf);
+	donor = rq->donor;
 
 	update_rq_clock(rq);
 	thermal_pressure = arch_scale_thermal_pressure(cpu_of(rq));
 	update_thermal_load_avg(rq_clock_thermal(rq), rq, thermal_pressure);
-	curr->sched_class->task_tick(rq, curr, 0);
+	donor->sched_class->task_tick(rq, donor, 0);
 	calc_global_load_tick(rq);
 	psi_task_tick(rq);
 
@@ -4082,7 +4159,7 @@ static void sched_tick_remote(struct work_struct *work)
 		goto out_requeue;
 
 	rq_lock_irq(rq, &rf);
-	curr = rq->curr;
+	curr = rq->donor;
 	if (cpu_is_offline(cpu))
 		goto out_unlock;
 
@@ -4318,7 +4395,18 @@ static void put_prev_task_balance(struct rq *rq, struct task_struct *prev,
 				  struct rq_flags *rf)
 {
 #ifdef CONFIG_SMP
+	const struct sched_class *start_class = prev->sched_class;
 	const struct sched_class *class;
+
+#ifdef CONFIG_SCHED_CLASS_EXT
+	/*
+	 * The ext class only moves tasks to this CPU from its balance(), so
+	 * it has to be called even when an idle CPU reschedules.
+	 */
+	if (scx_enabled() && start_class < &ext_sched_class)
+		start_class = &ext_sched_class;
+#endif
+
 	/*
 	 * We must do the balancing pass before put_prev_task(), such
 	 * that when we release the rq->lock the task is in the same
@@ -4327,7 +4415,7 @@ static void put_prev_task_balance(struct rq *rq, struct task_struct *prev,
 	 * We can terminate the balance pass as soon as we know there is
 	 * a runnable task of @class priority or higher.
 	 */
-	for_class_range(class, prev->sched_class, &idle_sched_class) {
+	for_class_range(class, start_class, &idle_sched_class) {
 		if (class->balance(rq, prev, rf))
 			break;
 	}
@@ -4351,7 +4439,7 @@ pick_next_task(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 	 * higher scheduling class, because otherwise those loose the
 	 * opportunity to pull in more work from other CPUs.
 	 */
-	if (likely(prev->sched_class <= &fair_sched_class &&
+	if (likely(!scx_enabled() && prev->sched_class <= &fair_sched_class &&
 		   rq->nr_running == rq->cfs.h_nr_running)) {
 
 		p = pick_next_task_fair(rq, prev, rf);
@@ -4380,6 +4468,94 @@ pick_next_task(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 	BUG();
 }
 
+#ifdef CONFIG_SCHED_PROXY_EXEC
+/* See __mutex_owner() in kernel/locking/mutex.c. */
+static inline struct task_struct *proxy_mutex_owner(struct mutex *lock)
+{
+	return (struct task_struct *)(atomic_long_read(&lock->owner) & ~0x07UL);
+}
+
+/* Longest chain of mutex waiters and owners proxy() follows. */
+#define PROXY_MAX_DEPTH	16
+
+/*
+ * Follow the chain of mutexes from the blocked task @p to the task that
+ * should run in its place: the first owner on the chain that isn't waiting
+ * for a mutex itself.  That is @p itself when it has been woken up or the
+ * mutex has been released, and NULL when the owner can't run on this
+ * runqueue right now.
+ */
+static struct task_struct *proxy_find_owner(struct rq *rq, struct task_struct *p)
+{
+	struct task_struct *owner;
+	struct mutex *lock;
+	int depth;
+
+	for (depth = 0; depth < PROXY_MAX_DEPTH; depth++) {
+		lock = READ_ONCE(p->blocked_mutex);
+		if (!lock || p->state == TASK_RUNNING)
+			return p;
+
+		owner = proxy_mutex_owner(lock);
+		if (!owner || owner == p)
+			return p;
+
+		/*
+		 * The owner must be on this runqueue, @rq->lock then keeps it
+		 * there.  Owners that are asleep can't be run either.
+		 */
+		if (task_cpu(owner) != cpu_of(rq) || !task_on_rq_queued(owner) ||
+		    owner->sched_class != &fair_sched_class)
+			return NULL;
+
+		if (!task_is_blocked(owner))
+			return owner;
+
+		p = owner;
+	}
+
+	return NULL;
+}
+
+/*
+ * @donor was picked while blocked on a mutex.  Return the task to run with
+ * the scheduling context of @donor, which stays rq->donor.  When the owner
+ * can't be run here, @donor is put to sleep the way __schedule() puts a
+ * blocking task to sleep, and NULL is returned so that another task is
+ * picked.
+ */
+static struct task_struct *proxy(struct rq *rq, struct task_struct *donor)
+{
+	unsigned long state = donor->state;
+	struct task_struct *owner;
+
+	owner = proxy_find_owner(rq, donor);
+	if (owner)
+		return owner;
+
+	if (signal_pending_state(state, donor)) {
+		donor->state = TASK_RUNNING;
+		return donor;
+	}
+
+	donor->sched_contributes_to_load =
+		(state & TASK_UNINTERRUPTIBLE) &&
+		!(state & TASK_NOLOAD) &&
+		!(donor->flags & PF_FROZEN);
+
+	if (donor->sched_contributes_to_load)
+		rq->nr_uninterruptible++;
+
+	deactivate_task(rq, donor, DEQUEUE_SLEEP | DEQUEUE_NOCLOCK);
+	return NULL;
+}
+#else /* !CONFIG_SCHED_PROXY_EXEC */
+static inline struct task_struct *proxy(struct rq *rq, struct task_struct *donor)
+{
+	return donor;
+}
+#endif /* CONFIG_SCHED_PROXY_EXEC */
+
 /*
  * __schedule() is the main scheduler function.
  *
@@ -4421,7 +4597,7 @@ pick_next_task(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
  */
 static void __sched notrace __schedule(bool preempt)
 {
-	struct task_struct *prev, *next;
+	struct task_struct *prev, *prev_donor, *next;
 	unsigned long *switch_count;
 	unsigned long prev_state;
 	struct rq_flags rf;
@@ -4475,7 +4651,12 @@ static void __sched notrace __schedule(bool preempt)
 	if (!preempt && prev_state) {
 		if (signal_pending_state(prev_state, prev)) {
 			prev->state = TASK_RUNNING;
-		} else {
+		} else if (!task_is_blocked(prev)) {
+			/*
+			 * Tasks blocked on a mutex stay on the runqueue, so
+			 * that picking them runs the mutex owner instead, see
+			 * proxy().
+			 */
 			prev->sched_contributes_to_load =
 				(prev_state & TASK_UNINTERRUPTIBLE) &&
 				!(prev_state & TASK_NOLOAD) &&
@@ -4505,7 +4686,17 @@ static void __sched notrace __schedule(bool preempt)
 		switch_count = &prev->nvcsw;
 	}
 
-	next = pick_next_task(rq, prev, &rf);
+	prev_donor = rq->donor;
+pick_again:
+	next = pick_next_task(rq, prev_donor, &rf);
+	rq->donor = next;
+	if (unlikely(task_is_blocked(next))) {
+		next = proxy(rq, next);
+		if (!next) {
+			prev_donor = rq->donor;
+			goto pick_again;
+		}
+	}
 	clear_tsk_need_resched(prev);
 	clear_preempt_need_resched();
 
@@ -4821,11 +5012,53 @@ static void __setscheduler_prio(struct task_struct *p, int prio)
 	else if (rt_prio(prio))
 		p->sched_class = &rt_sched_class;
 	else
-		p->sched_class = &fair_sched_class;
+		p->sched_class = normal_sched_class(p);
 
 	p->prio = prio;
 }
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+/*
+ * Move @p between the fair and the ext class, after the BPF scheduler was
+ * loaded or unloaded, or the cgroup of @p opted in or out.
+ */
+void scx_reset_task_class(struct task_struct *p)
+{
+	const struct sched_class *prev_class, *new_class;
+	int queued, running, queue_flags = DEQUEUE_SAVE | DEQUEUE_NOCLOCK;
+	struct rq_flags rf;
+	struct rq *rq;
+
+	rq = task_rq_lock(p, &rf);
+	prev_class = p->sched_class;
+	if (prev_class != &fair_sched_class && prev_class != &ext_sched_class)
+		goto out;
+
+	new_class = normal_sched_class(p);
+	if (new_class == prev_class)
+		goto out;
+
+	update_rq_clock(rq);
+	queued = task_on_rq_queued(p);
+	running = task_current_donor(rq, p);
+	if (queued)
+		dequeue_task(rq, p, queue_flags);
+	if (running)
+		put_prev_task(rq, p);
+
+	p->sched_class = new_class;
+
+	if (queued)
+		enqueue_task(rq, p, queue_flags | ENQUEUE_RESTORE);
+	if (running)
+		set_next_task(rq, p);
+
+	check_class_changed(rq, p, prev_class, p->prio);
+out:
+	task_rq_unlock(rq, p, &rf);
+}
+#endif
+
 #ifdef CONFIG_RT_MUTEXES
 
 static inline int __rt_effective_prio(struct task_struct *pi_task, int prio)
@@ -4917,7 +5150,7 @@ void rt_mutex_setprio(struct task_struct *p, struct task_struct *pi_task)
 
 	prev_class = p->sched_class;
 	queued = task_on_rq_queued(p);
-	running = task_current(rq, p);
+	running = task_current_donor(rq, p);
 	if (queued)
 		dequeue_task(rq, p, queue_flag);
 	if (running)
@@ -5003,7 +5236,7 @@ void set_user_nice(struct task_struct *p, long nice)
 		goto out_unlock;
 	}
 	queued = task_on_rq_queued(p);
-	running = task_current(rq, p);
+	running = task_current_donor(rq, p);
 	if (queued)
 		dequeue_task(rq, p, DEQUEUE_SAVE | DEQUEUE_NOCLOCK);
 	if (running)
@@ -5231,6 +5464,12 @@ static int __sched_setscheduler(struct task_struct *p,
 	if (attr->sched_flags & ~(SCHED_FLAG_ALL | SCHED_FLAG_SUGOV))
 		return -EINVAL;
 
+	if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE) {
+		if (attr->sched_latency_nice > MAX_LATENCY_NICE ||
+		    attr->sched_latency_nice < MIN_LATENCY_NICE)
+			return -EINVAL;
+	}
+
 	/*
 	 * Valid priorities for SCHED_FIFO and SCHED_RR are
 	 * 1..MAX_USER_RT_PRIO-1, valid priority for SCHED_NORMAL,
@@ -5292,6 +5531,11 @@ static int __sched_setscheduler(struct task_struct *p,
 		/* Normal users shall not reset the sched_reset_on_fork flag: */
 		if (p->sched_reset_on_fork && !reset_on_fork)
 			return -EPERM;
+
+		/* Can't decrease the latency nice value, like the nice one: */
+		if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+		    attr->sched_latency_nice < p->se.latency_nice)
+			return -EPERM;
 	}
 
 	if (user) {
@@ -5344,6 +5588,8 @@ static int __sched_setscheduler(struct task_struct *p,
 			goto change;
 		if (attr->sched_flags & SCHED_FLAG_UTIL_CLAMP)
 			goto change;
+		if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE)
+			goto change;
 
 		p->sched_reset_on_fork = reset_on_fork;
 		retval = 0;
@@ -5420,7 +5666,7 @@ static int __sched_setscheduler(struct task_struct *p,
 	}
 
 	queued = task_on_rq_queued(p);
-	running = task_current(rq, p);
+	running = task_current_donor(rq, p);
 	if (queued)
 		dequeue_task(rq, p, queue_flags);
 	if (running)
@@ -5433,6 +5679,8 @@ static int __sched_setscheduler(struct task_struct *p,
 		__setscheduler_prio(p, newprio);
 	}
 	__setscheduler_uclamp(p, attr);
+	if (attr->sched_flags & SCHED_FLAG_LATENCY_NICE)
+		p->se.latency_nice = attr->sched_latency_nice;
 
 	if (queued) {
 		/*
@@ -5640,6 +5888,10 @@ static int sched_copy_attr(struct sched_attr __user *uattr, struct sched_attr *a
 	    size < SCHED_ATTR_SIZE_VER1)
 		return -EINVAL;
 
+	if ((attr->sched_flags & SCHED_FLAG_LATENCY_NICE) &&
+	    size < SCHED_ATTR_SIZE_VER2)
+		return -EINVAL;
+
 	/*
 	 * XXX: Do we want to be lenient like existing syscalls; or do we want
 	 * to be strict and return an error on out-of-bounds values?
@@ -5869,6 +6121,8 @@ SYSCALL_DEFINE4(sched_getattr, pid_t, pid, struct sched_attr __user *, uattr,
 	else
 		kattr.sched_nice = task_nice(p);
 
+	kattr.sched_latency_nice = p->se.latency_nice;
+
 #ifdef CONFIG_UCLAMP_TASK
 	/*
 	 * This could race with another potential updater, but this is fine
@@ -6548,6 +6802,7 @@ void __init init_idle(struct task_struct *idle, int cpu)
 
 	rq->idle = idle;
 	rcu_assign_pointer(rq->curr, idle);
+	rq->donor = idle;
 	idle->on_rq = TASK_ON_RQ_QUEUED;
 #ifdef CONFIG_SMP
 	idle->on_cpu = 1;
@@ -6644,7 +6899,7 @@ void sched_setnuma(struct task_struct *p, int nid)
 
 	rq = task_rq_lock(p, &rf);
 	queued = task_on_rq_queued(p);
-	running = task_current(rq, p);
+	running = task_current_donor(rq, p);
 
 	if (queued)
 		dequeue_task(rq, p, DEQUEUE_SAVE);
@@ -7053,8 +7308,13 @@ void __init sched_init(void)
 	int i;
 
 	/* Make sure the linker didn't screw up */
-	BUG_ON(&idle_sched_class + 1 != &fair_sched_class ||
-	       &fair_sched_class + 1 != &rt_sched_class ||
+#ifdef CONFIG_SCHED_CLASS_EXT
+	BUG_ON(&idle_sched_class + 1 != &ext_sched_class ||
+	       &ext_sched_class + 1 != &fair_sched_class);
+#else
+	BUG_ON(&idle_sched_class + 1 != &fair_sched_class);
+#endif
+	BUG_ON(&fair_sched_class + 1 != &rt_sched_class ||
 	       &rt_sched_class + 1   != &dl_sched_class);
 #ifdef CONFIG_SMP
 	BUG_ON(&dl_sched_class + 1 != &stop_sched_class);
@@ -7131,6 +7391,9 @@ void __init sched_init(void)
 		init_cfs_rq(&rq->cfs);
 		init_rt_rq(&rq->rt);
 		init_dl_rq(&rq->dl);
+#ifdef CONFIG_SCHED_CLASS_EXT
+		init_scx_rq(&rq->scx);
+#endif
 #ifdef CONFIG_FAIR_GROUP_SCHED
 		INIT_LIST_HEAD(&rq->leaf_cfs_rq_list);
 		rq->tmp_alone_branch = &rq->leaf_cfs_rq_list;
@@ -7452,6 +7715,10 @@ struct task_group *sched_create_group(struct task_group *parent)
 
 	alloc_uclamp_sched_group(tg, parent);
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+	tg->scx_enabled = parent->scx_enabled;
+#endif
+
 	return tg;
 
 err:
@@ -7542,7 +7809,7 @@ void sched_move_task(struct task_struct *tsk)
 	rq = task_rq_lock(tsk, &rf);
 	update_rq_clock(rq);
 
-	running = task_current(rq, tsk);
+	running = task_current_donor(rq, tsk);
 	queued = task_on_rq_queued(tsk);
 
 	if (queued)
@@ -7681,8 +7948,12 @@ static void cpu_cgroup_attach(struct cgroup_taskset *tset)
 	struct task_struct *task;
 	struct cgroup_subsys_state *css;
 
-	cgroup_taskset_for_each(task, css, tset)
+	cgroup_taskset_for_each(task, css, tset) {
 		sched_move_task(task);
+#ifdef CONFIG_SCHED_CLASS_EXT
+		scx_reset_task_class(task);
+#endif
+	}
 }
 
 #ifdef CONFIG_UCLAMP_TASK_GROUP
@@ -8179,6 +8450,51 @@ static u64 cpu_rt_period_read_uint(struct cgroup_subsys_state *css,
 }
 #endif /* CONFIG_RT_GROUP_SCHED */
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+static u64 cpu_ext_enabled_read_u64(struct cgroup_subsys_state *css,
+				    struct cftype *cft)
+{
+	return css_tg(css)->scx_enabled;
+}
+
+static int cpu_ext_enabled_write_u64(struct cgroup_subsys_state *css,
+				     struct cftype *cft, u64 enabled)
+{
+	struct task_group *tg = css_tg(css);
+	struct css_task_iter it;
+	struct task_struct *p;
+
+	if (enabled > 1)
+		return -ERANGE;
+
+	WRITE_ONCE(tg->scx_enabled, enabled);
+
+	css_task_iter_start(css, 0, &it);
+	while ((p = css_task_iter_next(&it)))
+		scx_reset_task_class(p);
+	css_task_iter_end(&it);
+
+	return 0;
+}
+#endif
+
+#ifdef CONFIG_FAIR_GROUP_SCHED
+static s64 cpu_latency_nice_read_s64(struct cgroup_subsys_state *css,
+				     struct cftype *cft)
+{
+	return css_tg(css)->latency_nice;
+}
+
+static int cpu_latency_nice_write_s64(struct cgroup_subsys_state *css,
+				      struct cftype *cft, s64 nice)
+{
+	if (nice < MIN_LATENCY_NICE || nice > MAX_LATENCY_NICE)
+		return -ERANGE;
+
+	return sched_group_set_latency(css_tg(css), nice);
+}
+#endif
+
 static struct cftype cpu_legacy_files[] = {
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	{
@@ -8186,6 +8502,12 @@ static struct cftype cpu_legacy_files[] = {
 		.read_u64 = cpu_shares_read_u64,
 		.write_u64 = cpu_shares_write_u64,
 	},
+	{
+		.name = "latency.nice",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -8228,6 +8550,14 @@ static struct cftype cpu_legacy_files[] = {
 		.seq_show = cpu_uclamp_max_show,
 		.write = cpu_uclamp_max_write,
 	},
+#endif
+#ifdef CONFIG_SCHED_CLASS_EXT
+	{
+		.name = "ext.enabled",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_ext_enabled_read_u64,
+		.write_u64 = cpu_ext_enabled_write_u64,
+	},
 #endif
 	{ }	/* Terminate */
 };
@@ -8387,6 +8717,12 @@ static struct cftype cpu_files[] = {
 		.read_s64 = cpu_weight_nice_read_s64,
 		.write_s64 = cpu_weight_nice_write_s64,
 	},
+	{
+		.name = "latency.nice",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_s64 = cpu_latency_nice_read_s64,
+		.write_s64 = cpu_latency_nice_write_s64,
+	},
 #endif
 #ifdef CONFIG_CFS_BANDWIDTH
 	{
@@ -8409,6 +8745,14 @@ static struct cftype cpu_files[] = {
 		.seq_show = cpu_uclamp_max_show,
 		.write = cpu_uclamp_max_write,
 	},
+#endif
+#ifdef CONFIG_SCHED_CLASS_EXT
+	{
+		.name = "ext.enabled",
+		.flags = CFTYPE_NOT_ON_ROOT,
+		.read_u64 = cpu_ext_enabled_read_u64,
+		.write_u64 = cpu_ext_enabled_write_u64,
+	},
 #endif
 	{ }	/* terminate */
 };
@@ -8481,3 +8825,53 @@ void call_trace_sched_update_nr_running(struct rq *rq, int count)
 {
         trace_sched_update_nr_running_tp(rq, count);
 }
+
+#ifdef CONFIG_SCHED_MM_CID
+void sched_mm_cid_exit_signals(struct task_struct *t)
+{
+	struct mm_struct *mm = t->mm;
+	unsigned long flags;
+
+	if (!mm)
+		return;
+	local_irq_save(flags);
+	mm_cid_put(mm, t->mm_cid);
+	t->mm_cid = -1;
+	t->mm_cid_active = 0;
+	local_irq_restore(flags);
+}
+
+void sched_mm_cid_before_execve(struct task_struct *t)
+{
+	struct mm_struct *mm = t->mm;
+	unsigned long flags;
+
+	if (!mm)
+		return;
+	local_irq_save(flags);
+	mm_cid_put(mm, t->mm_cid);
+	t->mm_cid = -1;
+	t->mm_cid_active = 0;
+	local_irq_restore(flags);
+}
+
+void sched_mm_cid_after_execve(struct task_struct *t)
+{
+	struct mm_struct *mm = t->mm;
+	unsigned long flags;
+
+	if (!mm)
+		return;
+	local_irq_save(flags);
+	t->mm_cid = mm_cid_get(mm);
+	t->mm_cid_active = 1;
+	local_irq_restore(flags);
+	rseq_set_notify_resume(t);
+}
+
+void sched_mm_cid_fork(struct task_struct *t)
+{
+	WARN_ON_ONCE(!t->mm || t->mm_cid != -1);
+	t->mm_cid_active = 1;
+}
+#endif
@@ -0,0 +1,808 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF extensible scheduling class (SCHED_EXT)
+ *
+ * Scheduling policy is implemented by a BPF struct_ops program, the "BPF
+ * scheduler".  It sits between the fair and the idle class.  While one is
+ * loaded, tasks with the SCHED_EXT policy, and the normal tasks of cgroups
+ * with cpu.ext.enabled set, are run by it.  Otherwise, and whenever it
+ * misbehaves, those tasks are run by CFS.
+ *
+ * The BPF scheduler places runnable tasks on FIFO dispatch queues (DSQs):
+ * its own ones, the global one, or the local one of the task's CPU.  A CPU
+ * only runs tasks off its local DSQ and refills it from the shared DSQs,
+ * migrating tasks over as needed, when it runs dry.
+ *
+ * If a runnable task is not run for sched_ext_ops::timeout_ms, the watchdog
+ * unloads the BPF scheduler.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+#include <linux/irq_work.h>
+
+#include "sched.h"
+
+/* sched_ext_entity::flags */
+#define SCX_TASK_QUEUED		(1U << 0)	/* queued on the rq */
+#define SCX_TASK_ENQ_LOCAL	(1U << 1)	/* migrated in, enqueue locally */
+
+enum scx_ops_state {
+	SCX_OPS_DISABLED,
+	SCX_OPS_ENABLING,
+	SCX_OPS_ENABLED,
+	SCX_OPS_DISABLING,
+};
+
+DEFINE_STATIC_KEY_FALSE(__scx_ops_enabled);
+
+static DEFINE_MUTEX(scx_ops_mutex);
+static enum scx_ops_state scx_ops_state;
+static struct sched_ext_ops *scx_ops;
+
+static struct scx_dispatch_q scx_dsq_global = {
+	.lock	= __RAW_SPIN_LOCK_UNLOCKED(scx_dsq_global.lock),
+	.list	= LIST_HEAD_INIT(scx_dsq_global.list),
+};
+static struct scx_dispatch_q *scx_dsqs;
+static u32 scx_nr_dsqs;
+
+static unsigned long scx_watchdog_timeout;
+
+static atomic_t scx_exiting = ATOMIC_INIT(0);
+static char scx_exit_reason[128];
+
+/*
+ * While the BPF scheduler is being unloaded its callbacks are skipped and
+ * all tasks go through the global DSQ, so the ones the unload cannot switch
+ * back to CFS are guaranteed to make progress.
+ */
+static bool scx_ops_bypass(void)
+{
+	return READ_ONCE(scx_ops_state) == SCX_OPS_DISABLING;
+}
+
+static void __scx_ops_disable(void);
+
+static void scx_ops_disable_workfn(struct work_struct *work)
+{
+	mutex_lock(&scx_ops_mutex);
+	if (atomic_read(&scx_exiting))
+		__scx_ops_disable();
+	mutex_unlock(&scx_ops_mutex);
+}
+static DECLARE_WORK(scx_ops_disable_work, scx_ops_disable_workfn);
+
+static void scx_ops_error_irq_workfn(struct irq_work *irq_work)
+{
+	schedule_work(&scx_ops_disable_work);
+}
+static DEFINE_IRQ_WORK(scx_ops_error_irq_work, scx_ops_error_irq_workfn);
+
+/*
+ * Unload the BPF scheduler because of @fmt.  Usually called with the rq
+ * lock held, so the actual work is punted.
+ */
+static __printf(1, 2) void scx_ops_error(const char *fmt, ...)
+{
+	va_list args;
+
+	if (atomic_xchg(&scx_exiting, 1))
+		return;
+
+	va_start(args, fmt);
+	vscnprintf(scx_exit_reason, sizeof(scx_exit_reason), fmt, args);
+	va_end(args);
+
+	irq_work_queue(&scx_ops_error_irq_work);
+}
+
+bool task_should_scx(struct task_struct *p)
+{
+	enum scx_ops_state state = READ_ONCE(scx_ops_state);
+
+	if (state != SCX_OPS_ENABLING && state != SCX_OPS_ENABLED)
+		return false;
+	if (p->policy == SCHED_EXT)
+		return true;
+#ifdef CONFIG_CGROUP_SCHED
+	if (fair_policy(p->policy) && !(p->flags & PF_KTHREAD) &&
+	    READ_ONCE(task_group(p)->scx_enabled))
+		return true;
+#endif
+	return false;
+}
+
+static void init_dsq(struct scx_dispatch_q *dsq)
+{
+	raw_spin_lock_init(&dsq->lock);
+	INIT_LIST_HEAD(&dsq->list);
+	dsq->nr = 0;
+}
+
+void init_scx_rq(struct scx_rq *scx_rq)
+{
+	init_dsq(&scx_rq->local_dsq);
+	INIT_LIST_HEAD(&scx_rq->runnable_list);
+	scx_rq->nr_running = 0;
+}
+
+static struct scx_dispatch_q *find_dsq(struct rq *rq, u64 dsq_id)
+{
+	if (dsq_id == SCX_DSQ_LOCAL)
+		return &rq->scx.local_dsq;
+	if (dsq_id == SCX_DSQ_GLOBAL)
+		return &scx_dsq_global;
+	if (dsq_id < scx_nr_dsqs)
+		return &scx_dsqs[dsq_id];
+	return NULL;
+}
+
+static void dispatch_enqueue(struct scx_dispatch_q *dsq, struct task_struct *p,
+			     bool head)
+{
+	raw_spin_lock(&dsq->lock);
+	if (head)
+		list_add(&p->scx.dsq_node, &dsq->list);
+	else
+		list_add_tail(&p->scx.dsq_node, &dsq->list);
+	WRITE_ONCE(dsq->nr, dsq->nr + 1);
+	WRITE_ONCE(p->scx.dsq, dsq);
+	raw_spin_unlock(&dsq->lock);
+}
+
+static void dispatch_dequeue(struct task_struct *p)
+{
+	struct scx_dispatch_q *dsq = READ_ONCE(p->scx.dsq);
+
+	if (dsq) {
+		raw_spin_lock(&dsq->lock);
+		/* consume_dsq() may have taken it off meanwhile */
+		if (p->scx.dsq == dsq) {
+			list_del_init(&p->scx.dsq_node);
+			WRITE_ONCE(dsq->nr, dsq->nr - 1);
+			WRITE_ONCE(p->scx.dsq, NULL);
+		}
+		raw_spin_unlock(&dsq->lock);
+	}
+
+	/* Tell a CPU about to migrate @p that it went away, see consume_dsq() */
+	p->scx.holding_cpu = -1;
+}
+
+static void scx_kick_idle_cpu(struct task_struct *p)
+{
+	int cpu;
+
+	for_each_cpu_and(cpu, p->cpus_ptr, cpu_online_mask) {
+		if (idle_cpu(cpu)) {
+			resched_idle_cpu(cpu);
+			return;
+		}
+	}
+}
+
+static void do_enqueue_scx(struct rq *rq, struct task_struct *p, u64 enq_flags)
+{
+	struct scx_dispatch_q *dsq;
+	u64 dsq_id = SCX_DSQ_GLOBAL;
+
+	p->scx.slice = SCX_SLICE_DFL;
+	if (scx_ops->enqueue && !scx_ops_bypass())
+		dsq_id = scx_ops->enqueue(p, enq_flags);
+
+	dsq = find_dsq(rq, dsq_id);
+	if (unlikely(!dsq)) {
+		scx_ops_error("enqueue of %s[%d] to invalid DSQ 0x%llx",
+			      p->comm, p->pid, dsq_id);
+		dsq = &scx_dsq_global;
+	}
+	dispatch_enqueue(dsq, p, false);
+
+	/* This CPU is busy, make sure somebody picks the task up */
+	if (dsq != &rq->scx.local_dsq && rq->curr != rq->idle)
+		scx_kick_idle_cpu(p);
+}
+
+static void update_curr_scx(struct rq *rq)
+{
+	struct task_struct *curr = rq->curr;
+	u64 delta_exec;
+
+	if (curr->sched_class != &ext_sched_class)
+		return;
+
+	delta_exec = rq_clock_task(rq) - curr->se.exec_start;
+	if (unlikely((s64)delta_exec <= 0))
+		return;
+
+	schedstat_set(curr->se.statistics.exec_max,
+		      max(curr->se.statistics.exec_max, delta_exec));
+
+	curr->se.sum_exec_runtime += delta_exec;
+	account_group_exec_runtime(curr, delta_exec);
+
+	curr->se.exec_start = rq_clock_task(rq);
+	cgroup_account_cputime(curr, delta_exec);
+
+	curr->scx.slice -= min(curr->scx.slice, delta_exec);
+}
+
+static void enqueue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	p->scx.flags |= SCX_TASK_QUEUED;
+	rq->scx.nr_running++;
+	add_nr_running(rq, 1);
+
+	p->scx.runnable_at = jiffies;
+	list_add_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+
+	/* consume_remote_task() picked @p to run next on this CPU */
+	if (p->scx.flags & SCX_TASK_ENQ_LOCAL) {
+		p->scx.flags &= ~SCX_TASK_ENQ_LOCAL;
+		dispatch_enqueue(&rq->scx.local_dsq, p, true);
+		return;
+	}
+
+	do_enqueue_scx(rq, p, (flags & ENQUEUE_WAKEUP) ? SCX_ENQ_WAKEUP : 0);
+}
+
+static void dequeue_task_scx(struct rq *rq, struct task_struct *p, int flags)
+{
+	if (!(p->scx.flags & SCX_TASK_QUEUED))
+		return;
+
+	update_curr_scx(rq);
+	dispatch_dequeue(p);
+	list_del_init(&p->scx.runnable_node);
+
+	p->scx.flags &= ~SCX_TASK_QUEUED;
+	rq->scx.nr_running--;
+	sub_nr_running(rq, 1);
+}
+
+static void yield_task_scx(struct rq *rq)
+{
+	rq->curr->scx.slice = 0;
+}
+
+static void check_preempt_curr_scx(struct rq *rq, struct task_struct *p,
+				   int wake_flags)
+{
+}
+
+static void set_next_task_scx(struct rq *rq, struct task_struct *p, bool first)
+{
+	dispatch_dequeue(p);
+	list_del_init(&p->scx.runnable_node);
+	p->se.exec_start = rq_clock_task(rq);
+}
+
+static struct task_struct *pick_next_task_scx(struct rq *rq)
+{
+	struct task_struct *p;
+
+	p = list_first_entry_or_null(&rq->scx.local_dsq.list,
+				     struct task_struct, scx.dsq_node);
+	if (!p)
+		return NULL;
+
+	set_next_task_scx(rq, p, true);
+	return p;
+}
+
+static void put_prev_task_scx(struct rq *rq, struct task_struct *p)
+{
+	update_curr_scx(rq);
+
+	if (!(p->scx.flags & SCX_TASK_QUEUED))
+		return;
+
+	p->scx.runnable_at = jiffies;
+	list_add_tail(&p->scx.runnable_node, &rq->scx.runnable_list);
+
+	/* balance_scx() already handed it back to the BPF scheduler */
+	if (p->scx.dsq)
+		return;
+
+	/* Preempted by a higher class, keep running it once that is done */
+	if (p->scx.slice)
+		dispatch_enqueue(&rq->scx.local_dsq, p, true);
+	else
+		do_enqueue_scx(rq, p, SCX_ENQ_EXPIRED);
+}
+
+/*
+ * Move @p, which consume_dsq() took off a shared DSQ, from @src_rq over to
+ * @rq and queue it there to run next.
+ */
+static bool consume_remote_task(struct rq *rq, struct rq_flags *rf,
+				struct task_struct *p, struct rq *src_rq)
+{
+	int cpu = cpu_of(rq);
+	bool moved = false;
+
+	rq_unpin_lock(rq, rf);
+	double_lock_balance(rq, src_rq);
+
+	/* Unless @p was dequeued from @src_rq while no lock was held */
+	if (p->scx.holding_cpu == cpu) {
+		p->scx.holding_cpu = -1;
+
+		if (!task_running(src_rq, p) &&
+		    cpumask_test_cpu(cpu, p->cpus_ptr)) {
+			update_rq_clock(src_rq);
+			deactivate_task(src_rq, p, DEQUEUE_NOCLOCK);
+			set_task_cpu(p, cpu);
+			p->scx.flags |= SCX_TASK_ENQ_LOCAL;
+			activate_task(rq, p, ENQUEUE_NOCLOCK);
+			moved = true;
+		} else {
+			/* Still switching out or no longer allowed here */
+			dispatch_enqueue(&src_rq->scx.local_dsq, p, false);
+			if (src_rq->curr == src_rq->idle)
+				resched_curr(src_rq);
+		}
+	}
+
+	double_unlock_balance(rq, src_rq);
+	rq_repin_lock(rq, rf);
+
+	return moved;
+}
+
+/* Move the first task of @dsq that may run on @rq to the local DSQ of @rq. */
+static bool consume_dsq(struct rq *rq, struct rq_flags *rf,
+			struct scx_dispatch_q *dsq)
+{
+	int cpu = cpu_of(rq);
+	struct task_struct *p;
+	struct rq *src_rq;
+
+	if (!READ_ONCE(dsq->nr))
+		return false;
+
+	raw_spin_lock(&dsq->lock);
+	list_for_each_entry(p, &dsq->list, scx.dsq_node) {
+		/* Stable, dequeueing @p from its rq takes @dsq->lock */
+		src_rq = task_rq(p);
+		if (src_rq != rq && !cpumask_test_cpu(cpu, p->cpus_ptr))
+			continue;
+
+		list_del_init(&p->scx.dsq_node);
+		WRITE_ONCE(dsq->nr, dsq->nr - 1);
+		WRITE_ONCE(p->scx.dsq, NULL);
+		p->scx.holding_cpu = cpu;
+		raw_spin_unlock(&dsq->lock);
+
+		if (src_rq == rq) {
+			p->scx.holding_cpu = -1;
+			dispatch_enqueue(&rq->scx.local_dsq, p, false);
+			return true;
+		}
+		return consume_remote_task(rq, rf, p, src_rq);
+	}
+	raw_spin_unlock(&dsq->lock);
+
+	return false;
+}
+
+static int balance_scx(struct rq *rq, struct task_struct *prev,
+		       struct rq_flags *rf)
+{
+	struct scx_dispatch_q *dsq;
+	u64 dsq_id;
+
+	if (prev->sched_class == &ext_sched_class &&
+	    (prev->scx.flags & SCX_TASK_QUEUED)) {
+		update_curr_scx(rq);
+		if (prev->scx.slice)
+			return 1;
+		do_enqueue_scx(rq, prev, SCX_ENQ_EXPIRED);
+	}
+
+	if (READ_ONCE(rq->scx.local_dsq.nr))
+		return 1;
+
+	if (scx_ops->dispatch && !scx_ops_bypass()) {
+		dsq_id = scx_ops->dispatch(cpu_of(rq));
+		dsq = find_dsq(rq, dsq_id);
+		if (unlikely(!dsq))
+			scx_ops_error("dispatch from invalid DSQ 0x%llx on CPU%d",
+				      dsq_id, cpu_of(rq));
+		else if (dsq != &rq->scx.local_dsq && consume_dsq(rq, rf, dsq))
+			return 1;
+	}
+
+	if (consume_dsq(rq, rf, &scx_dsq_global))
+		return 1;
+
+	/* The rq lock may have been dropped while migrating */
+	return READ_ONCE(rq->scx.local_dsq.nr) != 0;
+}
+
+static int scx_pick_idle_cpu(struct task_struct *p, int prev_cpu)
+{
+	int cpu;
+
+	for_each_cpu_wrap(cpu, p->cpus_ptr, prev_cpu) {
+		if (available_idle_cpu(cpu))
+			return cpu;
+	}
+	return prev_cpu;
+}
+
+static int select_task_rq_scx(struct task_struct *p, int prev_cpu, int sd_flag,
+			      int wake_flags)
+{
+	s32 cpu;
+
+	if (!scx_ops->select_cpu || scx_ops_bypass())
+		return scx_pick_idle_cpu(p, prev_cpu);
+
+	cpu = scx_ops->select_cpu(p, prev_cpu, wake_flags);
+	if (unlikely(cpu < 0 || cpu >= nr_cpu_ids ||
+		     !cpumask_test_cpu(cpu, p->cpus_ptr))) {
+		scx_ops_error("select_cpu() returned invalid CPU %d for %s[%d]",
+			      cpu, p->comm, p->pid);
+		return prev_cpu;
+	}
+	return cpu;
+}
+
+/* Move the tasks of @rq on @dsq over to its local DSQ. */
+static void scx_reclaim_dsq(struct rq *rq, struct scx_dispatch_q *dsq)
+{
+	struct task_struct *p, *tmp;
+	LIST_HEAD(tasks);
+
+	raw_spin_lock(&dsq->lock);
+	list_for_each_entry_safe(p, tmp, &dsq->list, scx.dsq_node) {
+		if (task_rq(p) != rq)
+			continue;
+		list_move_tail(&p->scx.dsq_node, &tasks);
+		WRITE_ONCE(dsq->nr, dsq->nr - 1);
+		WRITE_ONCE(p->scx.dsq, NULL);
+	}
+	raw_spin_unlock(&dsq->lock);
+
+	list_for_each_entry_safe(p, tmp, &tasks, scx.dsq_node) {
+		list_del_init(&p->scx.dsq_node);
+		dispatch_enqueue(&rq->scx.local_dsq, p, false);
+	}
+}
+
+/*
+ * Tasks on shared DSQs are still queued on their rq.  Before the CPU goes
+ * away, make them visible to migrate_tasks(), which only looks at what
+ * pick_next_task_scx() returns.
+ */
+static void rq_offline_scx(struct rq *rq)
+{
+	u32 i;
+
+	if (!scx_enabled() || !rq->scx.nr_running)
+		return;
+
+	scx_reclaim_dsq(rq, &scx_dsq_global);
+	for (i = 0; i < scx_nr_dsqs; i++)
+		scx_reclaim_dsq(rq, &scx_dsqs[i]);
+}
+
+static void task_tick_scx(struct rq *rq, struct task_struct *curr, int queued)
+{
+	update_curr_scx(rq);
+
+	if (scx_ops->tick && !scx_ops_bypass())
+		scx_ops->tick(curr);
+
+	if (!curr->scx.slice)
+		resched_curr(rq);
+}
+
+static void switched_to_scx(struct rq *rq, struct task_struct *p)
+{
+	if (task_on_rq_queued(p) && rq->curr == rq->idle)
+		resched_curr(rq);
+}
+
+static void prio_changed_scx(struct rq *rq, struct task_struct *p, int oldprio)
+{
+}
+
+const struct sched_class ext_sched_class
+	__section("__ext_sched_class") = {
+	.enqueue_task		= enqueue_task_scx,
+	.dequeue_task		= dequeue_task_scx,
+	.yield_task		= yield_task_scx,
+
+	.check_preempt_curr	= check_preempt_curr_scx,
+
+	.pick_next_task		= pick_next_task_scx,
+	.put_prev_task		= put_prev_task_scx,
+	.set_next_task		= set_next_task_scx,
+
+	.balance		= balance_scx,
+	.select_task_rq		= select_task_rq_scx,
+	.set_cpus_allowed	= set_cpus_allowed_common,
+	.rq_offline		= rq_offline_scx,
+
+	.task_tick		= task_tick_scx,
+
+	.prio_changed		= prio_changed_scx,
+	.switched_to		= switched_to_scx,
+
+	.update_curr		= update_curr_scx,
+};
+
+static void scx_watchdog_workfn(struct work_struct *work)
+{
+	unsigned long runnable_at = 0;
+	struct task_struct *p;
+	char comm[TASK_COMM_LEN];
+	bool stalled = false;
+	struct rq_flags rf;
+	struct rq *rq;
+	pid_t pid = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		rq = cpu_rq(cpu);
+
+		rq_lock_irqsave(rq, &rf);
+		p = list_first_entry_or_null(&rq->scx.runnable_list,
+					     struct task_struct,
+					     scx.runnable_node);
+		if (p && time_after(jiffies,
+				    p->scx.runnable_at + scx_watchdog_timeout)) {
+			runnable_at = p->scx.runnable_at;
+			get_task_comm(comm, p);
+			pid = p->pid;
+			stalled = true;
+		}
+		rq_unlock_irqrestore(rq, &rf);
+
+		if (stalled) {
+			scx_ops_error("%s[%d] stalled on CPU%d for %ums", comm,
+				      pid, cpu,
+				      jiffies_to_msecs(jiffies - runnable_at));
+			return;
+		}
+		cond_resched();
+	}
+
+	queue_delayed_work(system_unbound_wq, to_delayed_work(work),
+			   scx_watchdog_timeout / 2);
+}
+static DECLARE_DELAYED_WORK(scx_watchdog_work, scx_watchdog_workfn);
+
+static void __scx_ops_disable(void)
+{
+	struct task_struct *g, *p;
+	int cpu;
+
+	lockdep_assert_held(&scx_ops_mutex);
+
+	if (scx_ops_state != SCX_OPS_ENABLED)
+		return;
+
+	WRITE_ONCE(scx_ops_state, SCX_OPS_DISABLING);
+	cancel_delayed_work_sync(&scx_watchdog_work);
+
+	/* task_should_scx() is false for everybody now */
+	rcu_read_lock();
+	for_each_process_thread(g, p)
+		scx_reset_task_class(p);
+	rcu_read_unlock();
+
+	/* Exiting tasks may be off the task list but still runnable */
+	for_each_possible_cpu(cpu) {
+		while (READ_ONCE(cpu_rq(cpu)->scx.nr_running))
+			schedule_timeout_uninterruptible(1);
+	}
+
+	static_branch_disable(&__scx_ops_enabled);
+	/* Wait for rq lock holders that may still look at @scx_ops */
+	synchronize_rcu();
+
+	if (atomic_read(&scx_exiting))
+		pr_err("sched_ext: BPF scheduler \"%s\" disabled (%s)\n",
+		       scx_ops->name, scx_exit_reason);
+	else
+		pr_info("sched_ext: BPF scheduler \"%s\" disabled\n",
+			scx_ops->name);
+
+	kfree(scx_dsqs);
+	scx_dsqs = NULL;
+	scx_nr_dsqs = 0;
+	scx_ops = NULL;
+	WRITE_ONCE(scx_ops_state, SCX_OPS_DISABLED);
+}
+
+/**
+ * scx_ops_enable - load a BPF scheduler
+ * @ops: the scheduler
+ *
+ * Switch all SCHED_EXT tasks, and all normal tasks of cgroups with
+ * cpu.ext.enabled set, over to @ops.
+ *
+ * Return: 0 on success, -EBUSY if a BPF scheduler is already loaded, or
+ * another negative error code.
+ */
+int scx_ops_enable(struct sched_ext_ops *ops)
+{
+	struct task_struct *g, *p;
+	int ret = 0;
+	u32 i;
+
+	if (ops->nr_dsqs > SCX_DSQ_MAX)
+		return -E2BIG;
+
+	/* Do not let an error of the previous scheduler unload this one */
+	irq_work_sync(&scx_ops_error_irq_work);
+	flush_work(&scx_ops_disable_work);
+
+	mutex_lock(&scx_ops_mutex);
+	if (scx_ops_state != SCX_OPS_DISABLED) {
+		ret = -EBUSY;
+		goto out;
+	}
+
+	if (ops->nr_dsqs) {
+		scx_dsqs = kcalloc(ops->nr_dsqs, sizeof(*scx_dsqs), GFP_KERNEL);
+		if (!scx_dsqs) {
+			ret = -ENOMEM;
+			goto out;
+		}
+		for (i = 0; i < ops->nr_dsqs; i++)
+			init_dsq(&scx_dsqs[i]);
+	}
+	scx_nr_dsqs = ops->nr_dsqs;
+	scx_watchdog_timeout =
+		msecs_to_jiffies(ops->timeout_ms ?: SCX_TIMEOUT_DFL_MS);
+	atomic_set(&scx_exiting, 0);
+	scx_ops = ops;
+
+	WRITE_ONCE(scx_ops_state, SCX_OPS_ENABLING);
+	static_branch_enable(&__scx_ops_enabled);
+
+	/* New tasks are taken care of by sched_fork() and wake_up_new_task() */
+	rcu_read_lock();
+	for_each_process_thread(g, p)
+		scx_reset_task_class(p);
+	rcu_read_unlock();
+
+	WRITE_ONCE(scx_ops_state, SCX_OPS_ENABLED);
+	queue_delayed_work(system_unbound_wq, &scx_watchdog_work,
+			   scx_watchdog_timeout / 2);
+
+	pr_info("sched_ext: BPF scheduler \"%s\" enabled\n", ops->name);
+out:
+	mutex_unlock(&scx_ops_mutex);
+	return ret;
+}
+
+/**
+ * scx_ops_disable - unload a BPF scheduler
+ * @ops: the scheduler
+ *
+ * Switch the tasks of @ops back to CFS.  No-op if @ops has been unloaded
+ * already because of an error.
+ */
+void scx_ops_disable(struct sched_ext_ops *ops)
+{
+	mutex_lock(&scx_ops_mutex);
+	if (scx_ops == ops)
+		__scx_ops_disable();
+	mutex_unlock(&scx_ops_mutex);
+}
+
+/* BPF struct_ops glue */
+
+static const struct btf_type *task_struct_type;
+
+static int bpf_scx_init(struct btf *btf)
+{
+	s32 type_id;
+
+	type_id = btf_find_by_name_kind(btf, "task_struct", BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	task_struct_type = btf_type_by_id(btf, type_id);
+
+	return 0;
+}
+
+static bool bpf_scx_is_valid_access(int off, int size,
+				    enum bpf_access_type type,
+				    const struct bpf_prog *prog,
+				    struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off >= sizeof(__u64) * MAX_BPF_FUNC_ARGS)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+
+	return btf_ctx_access(off, size, type, prog, info);
+}
+
+static int bpf_scx_btf_struct_access(struct bpf_verifier_log *log,
+				     const struct btf_type *t, int off,
+				     int size, enum bpf_access_type atype,
+				     u32 *next_btf_id)
+{
+	if (atype == BPF_READ)
+		return btf_struct_access(log, t, off, size, atype, next_btf_id);
+
+	if (t == task_struct_type &&
+	    off >= offsetof(struct task_struct, scx.slice) &&
+	    off + size <= offsetofend(struct task_struct, scx.slice))
+		return NOT_INIT;
+
+	bpf_log(log, "only task_struct->scx.slice can be written\n");
+	return -EACCES;
+}
+
+static const struct bpf_func_proto *
+bpf_scx_get_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id);
+}
+
+static const struct bpf_verifier_ops bpf_scx_verifier_ops = {
+	.get_func_proto		= bpf_scx_get_func_proto,
+	.is_valid_access	= bpf_scx_is_valid_access,
+	.btf_struct_access	= bpf_scx_btf_struct_access,
+};
+
+static int bpf_scx_init_member(const struct btf_type *t,
+			       const struct btf_member *member,
+			       void *kdata, const void *udata)
+{
+	const struct sched_ext_ops *uops = udata;
+	struct sched_ext_ops *ops = kdata;
+	u32 moff;
+
+	moff = btf_member_bit_offset(t, member) / 8;
+	switch (moff) {
+	case offsetof(struct sched_ext_ops, nr_dsqs):
+		ops->nr_dsqs = uops->nr_dsqs;
+		return 1;
+	case offsetof(struct sched_ext_ops, timeout_ms):
+		ops->timeout_ms = uops->timeout_ms;
+		return 1;
+	case offsetof(struct sched_ext_ops, name):
+		if (bpf_obj_name_cpy(ops->name, uops->name,
+				     sizeof(ops->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	/* All callbacks are optional */
+	return 0;
+}
+
+static int bpf_scx_reg(void *kdata)
+{
+	return scx_ops_enable(kdata);
+}
+
+static void bpf_scx_unreg(void *kdata)
+{
+	scx_ops_disable(kdata);
+}
+
+/* Avoid sparse warning.  It is only used in bpf_struct_ops.c. */
+extern struct bpf_struct_ops bpf_sched_ext_ops;
+
+struct bpf_struct_ops bpf_sched_ext_ops = {
+	.verifier_ops	= &bpf_scx_verifier_ops,
+	.reg		= bpf_scx_reg,
+	.unreg		= bpf_scx_unreg,
+	.init_member	= bpf_scx_init_member,
+	.init		= bpf_scx_init,
+	.name		= "sched_ext_ops",
+};
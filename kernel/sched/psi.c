@@ -185,6 +185,7 @@ static void group_init(struct psi_group *group)
 {
 	int cpu;
 
+	group->enabled = true;
 	for_each_possible_cpu(cpu)
 		seqcount_init(&per_cpu_ptr(group->pcpu, cpu)->seq);
 	group->avg_last_update = sched_clock();
@@ -707,10 +708,16 @@ static void psi_group_change(struct psi_group *group, int cpu,
 	 *
 	 * Then we update the task counts according to the state
 	 * change requested through the @clear and @set bits.
+	 *
+	 * With accounting disabled for the group, only the task counts
+	 * are kept, so that the state is right again when it is
+	 * re-enabled. The first change after disabling concludes the
+	 * state the group was in.
 	 */
 	write_seqcount_begin(&groupc->seq);
 
-	record_times(groupc, cpu, false);
+	if (group->enabled || groupc->state_mask)
+		record_times(groupc, cpu, false);
 
 	for (t = 0, m = clear; m; m &= ~(1 << t), t++) {
 		if (!(m & (1 << t)))
@@ -730,6 +737,12 @@ static void psi_group_change(struct psi_group *group, int cpu,
 		if (set & (1 << t))
 			groupc->tasks[t]++;
 
+	if (!group->enabled) {
+		groupc->state_mask = 0;
+		write_seqcount_end(&groupc->seq);
+		return;
+	}
+
 	/* Calculate state mask representing active states */
 	for (s = 0; s < NR_PSI_STATES; s++) {
 		if (test_state(groupc->tasks, s))
@@ -844,15 +857,43 @@ void psi_task_switch(struct task_struct *prev, struct task_struct *next,
 	 * of the outgoing TSK_ONCPU alongside TSK_RUNNING already. We
 	 * only need to deal with it during preemption.
 	 */
-	if (sleep)
-		return;
-
 	if (prev->pid) {
-		psi_flags_change(prev, TSK_ONCPU, 0);
+		int clear = TSK_ONCPU, set = 0;
+		bool wake_clock = true;
+
+		/*
+		 * When @prev goes to sleep, psi_dequeue() leaves its
+		 * TSK_RUNNING and TSK_IOWAIT changes to us, so that they
+		 * are combined with TSK_ONCPU and the ancestors below the
+		 * common one are walked only once.
+		 */
+		if (sleep) {
+			clear |= TSK_RUNNING;
+			if (prev->in_iowait)
+				set |= TSK_IOWAIT;
+
+			/* See psi_task_change() */
+			if (unlikely((prev->flags & PF_WQ_WORKER) &&
+				     wq_worker_last_func(prev) == psi_avgs_work))
+				wake_clock = false;
+		}
+
+		psi_flags_change(prev, clear, set);
 
 		iter = NULL;
 		while ((group = iterate_groups(prev, &iter)) && group != common)
-			psi_group_change(group, cpu, TSK_ONCPU, 0, true);
+			psi_group_change(group, cpu, clear, set, wake_clock);
+
+		/*
+		 * TSK_ONCPU stops at the common ancestor, the rest of a
+		 * sleep has to go all the way up.
+		 */
+		if (sleep) {
+			clear &= ~TSK_ONCPU;
+			for (; group; group = iterate_groups(prev, &iter))
+				psi_group_change(group, cpu, clear, set,
+						 wake_clock);
+		}
 	}
 }
 
@@ -864,6 +905,9 @@ void psi_memstall_tick(struct task_struct *task, int cpu)
 	while ((group = iterate_groups(task, &iter))) {
 		struct psi_group_cpu *groupc;
 
+		if (!group->enabled)
+			continue;
+
 		groupc = per_cpu_ptr(group->pcpu, cpu);
 		write_seqcount_begin(&groupc->seq);
 		record_times(groupc, cpu, true);
@@ -1005,6 +1049,31 @@ void cgroup_move_task(struct task_struct *task, struct css_set *to)
 
 	task_rq_unlock(rq, task, &rf);
 }
+
+/**
+ * psi_cgroup_restart - resume pressure accounting of a cgroup
+ * @group: the psi_group of the cgroup, just re-enabled
+ *
+ * While accounting was off only the task counts were maintained. Derive
+ * the state from them on every CPU and restart the clock from now, no
+ * task state actually changes.
+ */
+void psi_cgroup_restart(struct psi_group *group)
+{
+	int cpu;
+
+	if (!group->enabled)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct rq *rq = cpu_rq(cpu);
+		struct rq_flags rf;
+
+		rq_lock_irq(rq, &rf);
+		psi_group_change(group, cpu, 0, 0, true);
+		rq_unlock_irq(rq, &rf);
+	}
+}
 #endif /* CONFIG_CGROUPS */
 
 int psi_show(struct seq_file *m, struct psi_group *group, enum psi_res res)
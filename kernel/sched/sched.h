@@ -162,9 +162,20 @@ static inline int idle_policy(int policy)
 {
 	return policy == SCHED_IDLE;
 }
+static inline int ext_policy(int policy)
+{
+#ifdef CONFIG_SCHED_CLASS_EXT
+	return policy == SCHED_EXT;
+#else
+	return 0;
+#endif
+}
+
+/* SCHED_EXT tasks are run by CFS while no BPF scheduler is loaded */
 static inline int fair_policy(int policy)
 {
-	return policy == SCHED_NORMAL || policy == SCHED_BATCH;
+	return policy == SCHED_NORMAL || policy == SCHED_BATCH ||
+		ext_policy(policy);
 }
 
 static inline int rt_policy(int policy)
@@ -393,6 +404,8 @@ struct task_group {
 	/* runqueue "owned" by this group on each CPU */
 	struct cfs_rq		**cfs_rq;
 	unsigned long		shares;
+	/* latency nice of the group entities, see wakeup_latency_gran() */
+	int			latency_nice;
 
 #ifdef	CONFIG_SMP
 	/*
@@ -433,6 +446,10 @@ struct task_group {
 	struct uclamp_se	uclamp[UCLAMP_CNT];
 #endif
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+	/* Normal tasks of the group are run by the BPF scheduler */
+	bool			scx_enabled;
+#endif
 };
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
@@ -502,6 +519,7 @@ extern void sched_move_task(struct task_struct *tsk);
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
+extern int sched_group_set_latency(struct task_group *tg, int latency_nice);
 
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
@@ -618,6 +636,23 @@ static inline int rt_bandwidth_enabled(void)
 # define HAVE_RT_PUSH_IPI
 #endif
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+/* A FIFO of ext class tasks, see kernel/sched/ext.c */
+struct scx_dispatch_q {
+	raw_spinlock_t		lock;
+	struct list_head	list;
+	unsigned int		nr;
+};
+
+/* ext classes' related field in a runqueue: */
+struct scx_rq {
+	struct scx_dispatch_q	local_dsq;
+	/* Queued tasks ordered by runnable_at, for the watchdog */
+	struct list_head	runnable_list;
+	unsigned int		nr_running;
+};
+#endif
+
 /* Real-Time classes' related field in a runqueue: */
 struct rt_rq {
 	struct rt_prio_array	active;
@@ -934,6 +969,9 @@ struct rq {
 	struct cfs_rq		cfs;
 	struct rt_rq		rt;
 	struct dl_rq		dl;
+#ifdef CONFIG_SCHED_CLASS_EXT
+	struct scx_rq		scx;
+#endif
 
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	/* list of leaf cfs_rq on this CPU: */
@@ -950,6 +988,11 @@ struct rq {
 	unsigned long		nr_uninterruptible;
 
 	struct task_struct __rcu	*curr;
+	/*
+	 * The task whose scheduling context is in use.  This is @curr,
+	 * unless @curr runs as a proxy for a mutex waiter, see proxy().
+	 */
+	struct task_struct	*donor;
 	struct task_struct	*idle;
 	struct task_struct	*stop;
 	unsigned long		next_balance;
@@ -1080,6 +1123,12 @@ static inline int cpu_of(struct rq *rq)
 }
 
 
+#ifdef CONFIG_SMP
+extern void update_idle_cpumask(struct rq *rq, bool idle);
+#else
+static inline void update_idle_cpumask(struct rq *rq, bool idle) { }
+#endif
+
 #ifdef CONFIG_SCHED_SMT
 extern void __update_idle_core(struct rq *rq);
 
@@ -1453,11 +1502,14 @@ static inline struct sched_domain *lowest_flag_domain(int cpu, int flag)
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_llc);
 DECLARE_PER_CPU(int, sd_llc_size);
 DECLARE_PER_CPU(int, sd_llc_id);
+DECLARE_PER_CPU(int, sd_share_id);
 DECLARE_PER_CPU(struct sched_domain_shared __rcu *, sd_llc_shared);
+DECLARE_PER_CPU(struct sched_domain __rcu *, sd_cluster);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_numa);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_asym_packing);
 DECLARE_PER_CPU(struct sched_domain __rcu *, sd_asym_cpucapacity);
 extern struct static_key_false sched_asym_cpucapacity;
+extern struct static_key_false sched_cluster_active;
 
 struct sched_group_capacity {
 	atomic_t		ref;
@@ -1699,6 +1751,15 @@ static inline int task_current(struct rq *rq, struct task_struct *p)
 	return rq->curr == p;
 }
 
+/*
+ * Whether @p is the task the sched class considers to be running, that is
+ * whose state put_prev_task() and set_next_task() save and restore.
+ */
+static inline int task_current_donor(struct rq *rq, struct task_struct *p)
+{
+	return rq->donor == p;
+}
+
 static inline int task_running(struct rq *rq, struct task_struct *p)
 {
 #ifdef CONFIG_SMP
@@ -1870,6 +1931,44 @@ extern const struct sched_class rt_sched_class;
 extern const struct sched_class fair_sched_class;
 extern const struct sched_class idle_sched_class;
 
+#ifdef CONFIG_SCHED_CLASS_EXT
+extern const struct sched_class ext_sched_class;
+
+DECLARE_STATIC_KEY_FALSE(__scx_ops_enabled);
+#define scx_enabled()	static_branch_unlikely(&__scx_ops_enabled)
+
+extern bool task_should_scx(struct task_struct *p);
+extern void scx_reset_task_class(struct task_struct *p);
+#else
+#define scx_enabled()	false
+
+static inline bool task_should_scx(struct task_struct *p)
+{
+	return false;
+}
+#endif
+
+/* The class of a task with a normal (non-RT, non-DL) priority */
+static inline const struct sched_class *normal_sched_class(struct task_struct *p)
+{
+#ifdef CONFIG_SCHED_CLASS_EXT
+	if (task_should_scx(p))
+		return &ext_sched_class;
+#endif
+	return &fair_sched_class;
+}
+
+/* Whether picking @p should run the owner of the mutex @p waits for. */
+static inline bool task_is_blocked(struct task_struct *p)
+{
+#ifdef CONFIG_SCHED_PROXY_EXEC
+	return READ_ONCE(p->blocked_mutex) &&
+	       p->sched_class == &fair_sched_class;
+#else
+	return false;
+#endif
+}
+
 static inline bool sched_stop_runnable(struct rq *rq)
 {
 	return rq->stop && task_on_rq_queued(rq->stop);
@@ -1942,6 +2041,7 @@ extern void reweight_task(struct task_struct *p, int prio);
 
 extern void resched_curr(struct rq *rq);
 extern void resched_cpu(int cpu);
+extern void resched_idle_cpu(int cpu);
 
 extern struct rt_bandwidth def_rt_bandwidth;
 extern void init_rt_bandwidth(struct rt_bandwidth *rt_b, u64 period, u64 runtime);
@@ -2285,6 +2385,9 @@ print_numa_stats(struct seq_file *m, int node, unsigned long tsf,
 extern void init_cfs_rq(struct cfs_rq *cfs_rq);
 extern void init_rt_rq(struct rt_rq *rt_rq);
 extern void init_dl_rq(struct dl_rq *dl_rq);
+#ifdef CONFIG_SCHED_CLASS_EXT
+extern void init_scx_rq(struct scx_rq *scx_rq);
+#endif
 
 extern void cfs_bandwidth_usage_inc(void);
 extern void cfs_bandwidth_usage_dec(void);
@@ -2642,5 +2745,68 @@ static inline bool is_per_cpu_kthread(struct task_struct *p)
 }
 #endif
 
+#ifdef CONFIG_SCHED_MM_CID
+static inline int __mm_cid_get(struct mm_struct *mm)
+{
+	struct cpumask *cpumask;
+	int cid;
+
+	cpumask = mm_cidmask(mm);
+	cid = find_first_zero_bit(cpumask_bits(cpumask), nr_cpu_ids);
+	if (cid >= nr_cpu_ids)
+		return -1;
+	__cpumask_set_cpu(cid, cpumask);
+	return cid;
+}
+
+static inline void mm_cid_put(struct mm_struct *mm, int cid)
+{
+	lockdep_assert_irqs_disabled();
+	if (cid < 0)
+		return;
+	raw_spin_lock(&mm->cid_lock);
+	__cpumask_clear_cpu(cid, mm_cidmask(mm));
+	raw_spin_unlock(&mm->cid_lock);
+}
+
+static inline int mm_cid_get(struct mm_struct *mm)
+{
+	int ret;
+
+	lockdep_assert_irqs_disabled();
+	raw_spin_lock(&mm->cid_lock);
+	ret = __mm_cid_get(mm);
+	raw_spin_unlock(&mm->cid_lock);
+	return ret;
+}
+
+/*
+ * A concurrency id is only held while the task runs, so at most as many ids
+ * are in use as threads of the mm run at the same time, which bounds them by
+ * both the number of threads and the number of CPUs the mm may run on.
+ */
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next)
+{
+	if (prev->mm_cid_active) {
+		if (next->mm_cid_active && next->mm == prev->mm) {
+			/*
+			 * Context switch between threads in same mm, hand over
+			 * the mm_cid from prev to next.
+			 */
+			next->mm_cid = prev->mm_cid;
+			prev->mm_cid = -1;
+			return;
+		}
+		mm_cid_put(prev->mm, prev->mm_cid);
+		prev->mm_cid = -1;
+	}
+	if (next->mm_cid_active)
+		next->mm_cid = mm_cid_get(next->mm);
+}
+
+#else
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next) { }
+#endif
+
 void swake_up_all_locked(struct swait_queue_head *q);
 void __prepare_to_swait(struct swait_queue_head *q, struct swait_queue *wait);
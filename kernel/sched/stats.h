@@ -95,11 +95,14 @@ static inline void psi_dequeue(struct task_struct *p, bool sleep)
 	} else {
 		/*
 		 * When a task sleeps, schedule() dequeues it before
-		 * switching to the next one. Merge the clearing of
-		 * TSK_RUNNING and TSK_ONCPU to save an unnecessary
-		 * psi_task_change() call in psi_sched_switch().
+		 * switching to the next one. psi_task_switch() clears
+		 * TSK_RUNNING together with TSK_ONCPU then, to save
+		 * walking the ancestors both tasks share twice. A blocked
+		 * proxy donor that goes to sleep is not on the CPU and
+		 * is handled here.
 		 */
-		clear |= TSK_ONCPU;
+		if (p == current)
+			return;
 
 		if (p->in_iowait)
 			set |= TSK_IOWAIT;
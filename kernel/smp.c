@@ -30,10 +30,22 @@
 
 #define CSD_TYPE(_csd)	((_csd)->flags & CSD_FLAG_TYPE_MASK)
 
+/*
+ * The part of a smp_call_function_many() request that all target CPUs
+ * share.  @pending is how many of them have yet to pick the request up,
+ * or to run the function when the sender waits for it, so that the
+ * sender polls a single counter rather than one csd per target.
+ */
+struct cfd_request {
+	void			*info;
+	atomic_t		pending;
+};
+
 struct call_function_data {
 	call_single_data_t	__percpu *csd;
 	cpumask_var_t		cpumask;
 	cpumask_var_t		cpumask_ipi;
+	struct cfd_request	req ____cacheline_aligned_in_smp;
 };
 
 static DEFINE_PER_CPU_ALIGNED(struct call_function_data, cfd_data);
@@ -252,6 +264,13 @@ static __always_inline void csd_unlock(struct __call_single_data *csd)
 	smp_store_release(&csd->flags, 0);
 }
 
+/* Called by a target once it no longer needs @req. */
+static __always_inline void cfd_request_done(struct cfd_request *req)
+{
+	/* Order the callback, if it ran, before the sender sees the count. */
+	atomic_dec_return_release(&req->pending);
+}
+
 static DEFINE_PER_CPU_SHARED_ALIGNED(call_single_data_t, csd_data);
 
 void __smp_call_single_queue(int cpu, struct llist_node *node)
@@ -384,6 +403,7 @@ static void flush_smp_call_function_queue(bool warn_cpu_offline)
 		if (CSD_TYPE(csd) == CSD_TYPE_SYNC) {
 			smp_call_func_t func = csd->func;
 			void *info = csd->info;
+			struct cfd_request *req = NULL;
 
 			if (prev) {
 				prev->next = &csd_next->llist;
@@ -391,9 +411,16 @@ static void flush_smp_call_function_queue(bool warn_cpu_offline)
 				entry = &csd_next->llist;
 			}
 
+			if (csd->flags & CSD_FLAG_SHARED) {
+				req = info;
+				info = req->info;
+			}
+
 			csd_lock_record(csd);
 			func(info);
 			csd_unlock(csd);
+			if (req)
+				cfd_request_done(req);
 			csd_lock_record(NULL);
 		} else {
 			prev = &csd->llist;
@@ -420,9 +447,17 @@ static void flush_smp_call_function_queue(bool warn_cpu_offline)
 			if (type == CSD_TYPE_ASYNC) {
 				smp_call_func_t func = csd->func;
 				void *info = csd->info;
+				struct cfd_request *req = NULL;
+
+				if (csd->flags & CSD_FLAG_SHARED) {
+					req = info;
+					info = req->info;
+				}
 
 				csd_lock_record(csd);
 				csd_unlock(csd);
+				if (req)
+					cfd_request_done(req);
 				func(info);
 				csd_lock_record(NULL);
 			} else if (type == CSD_TYPE_IRQ_WORK) {
@@ -608,12 +643,22 @@ int smp_call_function_any(const struct cpumask *mask,
 }
 EXPORT_SYMBOL_GPL(smp_call_function_any);
 
+#define SCF_WAIT	(1U << 0)
+#define SCF_RUN_LOCAL	(1U << 1)
+
 static void smp_call_function_many_cond(const struct cpumask *mask,
 					smp_call_func_t func, void *info,
-					bool wait, smp_cond_func_t cond_func)
+					unsigned int scf_flags,
+					smp_cond_func_t cond_func)
 {
+	int cpu, last_cpu, this_cpu = smp_processor_id();
 	struct call_function_data *cfd;
-	int cpu, next_cpu, this_cpu = smp_processor_id();
+	bool wait = scf_flags & SCF_WAIT;
+	bool run_remote = false;
+	bool run_local = false;
+	int nr_cpus = 0, nr_queued = 0;
+
+	lockdep_assert_preemption_disabled();
 
 	/*
 	 * Can deadlock when called with interrupts disabled.
@@ -632,66 +677,92 @@ static void smp_call_function_many_cond(const struct cpumask *mask,
 	 */
 	WARN_ON_ONCE(!in_task());
 
-	/* Try to fastpath.  So, what's a CPU they want? Ignoring this one. */
+	/* Check if we need local execution. */
+	if ((scf_flags & SCF_RUN_LOCAL) && cpumask_test_cpu(this_cpu, mask))
+		run_local = true;
+
+	/* Check if we need remote execution, i.e., any CPU excluding this one. */
 	cpu = cpumask_first_and(mask, cpu_online_mask);
 	if (cpu == this_cpu)
 		cpu = cpumask_next_and(cpu, mask, cpu_online_mask);
+	if (cpu < nr_cpu_ids)
+		run_remote = true;
 
-	/* No online cpus?  We're done. */
-	if (cpu >= nr_cpu_ids)
-		return;
-
-	/* Do we have another CPU which isn't us? */
-	next_cpu = cpumask_next_and(cpu, mask, cpu_online_mask);
-	if (next_cpu == this_cpu)
-		next_cpu = cpumask_next_and(next_cpu, mask, cpu_online_mask);
+	if (run_remote) {
+		cfd = this_cpu_ptr(&cfd_data);
 
-	/* Fastpath: do that cpu by itself. */
-	if (next_cpu >= nr_cpu_ids) {
-		if (!cond_func || cond_func(cpu, info))
-			smp_call_function_single(cpu, func, info, wait);
-		return;
-	}
+		/* Targets of the previous request may still read ->req. */
+		atomic_cond_read_acquire(&cfd->req.pending, !VAL);
+		cfd->req.info = info;
 
-	cfd = this_cpu_ptr(&cfd_data);
+		cpumask_and(cfd->cpumask, mask, cpu_online_mask);
+		__cpumask_clear_cpu(this_cpu, cfd->cpumask);
 
-	cpumask_and(cfd->cpumask, mask, cpu_online_mask);
-	__cpumask_clear_cpu(this_cpu, cfd->cpumask);
+		cpumask_clear(cfd->cpumask_ipi);
+		for_each_cpu(cpu, cfd->cpumask) {
+			call_single_data_t *csd = per_cpu_ptr(cfd->csd, cpu);
+
+			if (cond_func && !cond_func(cpu, info))
+				continue;
+
+			csd_lock(csd);
+			csd->flags |= CSD_FLAG_SHARED;
+			if (wait)
+				csd->flags |= CSD_TYPE_SYNC;
+			csd->func = func;
+			csd->info = &cfd->req;
+			nr_queued++;
+#ifdef CONFIG_CSD_LOCK_WAIT_DEBUG
+			csd->src = smp_processor_id();
+			csd->dst = cpu;
+#endif
+			if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu))) {
+				__cpumask_set_cpu(cpu, cfd->cpumask_ipi);
+				nr_cpus++;
+				last_cpu = cpu;
+			}
+		}
 
-	/* Some callers race with other cpus changing the passed mask */
-	if (unlikely(!cpumask_weight(cfd->cpumask)))
-		return;
+		/*
+		 * Choose the most efficient way to send an IPI. Note that the
+		 * number of CPUs might be zero due to concurrent changes to the
+		 * provided mask.
+		 */
+		if (nr_cpus == 1)
+			send_call_function_single_ipi(last_cpu);
+		else if (likely(nr_cpus > 1))
+			arch_send_call_function_ipi_mask(cfd->cpumask_ipi);
 
-	cpumask_clear(cfd->cpumask_ipi);
-	for_each_cpu(cpu, cfd->cpumask) {
-		call_single_data_t *csd = per_cpu_ptr(cfd->csd, cpu);
+		/*
+		 * The targets may have already counted ->pending down below
+		 * zero, it only reaches zero again once they are all done.
+		 */
+		atomic_add(nr_queued, &cfd->req.pending);
+	}
 
-		if (cond_func && !cond_func(cpu, info))
-			continue;
+	/*
+	 * Run the local function only after the IPIs went out, so that it
+	 * overlaps with the remote CPUs running theirs.
+	 */
+	if (run_local && (!cond_func || cond_func(this_cpu, info))) {
+		unsigned long flags;
 
-		csd_lock(csd);
-		if (wait)
-			csd->flags |= CSD_TYPE_SYNC;
-		csd->func = func;
-		csd->info = info;
-#ifdef CONFIG_CSD_LOCK_WAIT_DEBUG
-		csd->src = smp_processor_id();
-		csd->dst = cpu;
-#endif
-		if (llist_add(&csd->llist, &per_cpu(call_single_queue, cpu)))
-			__cpumask_set_cpu(cpu, cfd->cpumask_ipi);
+		local_irq_save(flags);
+		func(info);
+		local_irq_restore(flags);
 	}
 
-	/* Send a message to all CPUs in the map */
-	arch_send_call_function_ipi_mask(cfd->cpumask_ipi);
+	if (run_remote && wait) {
+		/* Wait on each csd to get their stall reports. */
+		if (IS_ENABLED(CONFIG_CSD_LOCK_WAIT_DEBUG)) {
+			for_each_cpu(cpu, cfd->cpumask) {
+				call_single_data_t *csd;
 
-	if (wait) {
-		for_each_cpu(cpu, cfd->cpumask) {
-			call_single_data_t *csd;
-
-			csd = per_cpu_ptr(cfd->csd, cpu);
-			csd_lock_wait(csd);
+				csd = per_cpu_ptr(cfd->csd, cpu);
+				csd_lock_wait(csd);
+			}
 		}
+		atomic_cond_read_acquire(&cfd->req.pending, !VAL);
 	}
 }
 
@@ -712,7 +783,7 @@ static void smp_call_function_many_cond(const struct cpumask *mask,
 void smp_call_function_many(const struct cpumask *mask,
 			    smp_call_func_t func, void *info, bool wait)
 {
-	smp_call_function_many_cond(mask, func, info, wait, NULL);
+	smp_call_function_many_cond(mask, func, info, wait * SCF_WAIT, NULL);
 }
 EXPORT_SYMBOL(smp_call_function_many);
 
@@ -830,14 +901,7 @@ void __init smp_init(void)
  */
 void on_each_cpu(smp_call_func_t func, void *info, int wait)
 {
-	unsigned long flags;
-
-	preempt_disable();
-	smp_call_function(func, info, wait);
-	local_irq_save(flags);
-	func(info);
-	local_irq_restore(flags);
-	preempt_enable();
+	on_each_cpu_cond_mask(NULL, func, info, wait, cpu_online_mask);
 }
 EXPORT_SYMBOL(on_each_cpu);
 
@@ -860,16 +924,14 @@ EXPORT_SYMBOL(on_each_cpu);
 void on_each_cpu_mask(const struct cpumask *mask, smp_call_func_t func,
 			void *info, bool wait)
 {
-	int cpu = get_cpu();
+	unsigned int scf_flags = SCF_RUN_LOCAL;
 
-	smp_call_function_many(mask, func, info, wait);
-	if (cpumask_test_cpu(cpu, mask)) {
-		unsigned long flags;
-		local_irq_save(flags);
-		func(info);
-		local_irq_restore(flags);
-	}
-	put_cpu();
+	if (wait)
+		scf_flags |= SCF_WAIT;
+
+	preempt_disable();
+	smp_call_function_many_cond(mask, func, info, scf_flags, NULL);
+	preempt_enable();
 }
 EXPORT_SYMBOL(on_each_cpu_mask);
 
@@ -898,17 +960,14 @@ EXPORT_SYMBOL(on_each_cpu_mask);
 void on_each_cpu_cond_mask(smp_cond_func_t cond_func, smp_call_func_t func,
 			   void *info, bool wait, const struct cpumask *mask)
 {
-	int cpu = get_cpu();
+	unsigned int scf_flags = SCF_RUN_LOCAL;
 
-	smp_call_function_many_cond(mask, func, info, wait, cond_func);
-	if (cpumask_test_cpu(cpu, mask) && cond_func(cpu, info)) {
-		unsigned long flags;
+	if (wait)
+		scf_flags |= SCF_WAIT;
 
-		local_irq_save(flags);
-		func(info);
-		local_irq_restore(flags);
-	}
-	put_cpu();
+	preempt_disable();
+	smp_call_function_many_cond(mask, func, info, scf_flags, cond_func);
+	preempt_enable();
 }
 EXPORT_SYMBOL(on_each_cpu_cond_mask);
 
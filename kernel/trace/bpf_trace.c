@@ -16,6 +16,9 @@
 #include <linux/syscalls.h>
 #include <linux/error-injection.h>
 #include <linux/btf_ids.h>
+#include <linux/bsearch.h>
+#include <linux/sort.h>
+#include <linux/kallsyms.h>
 
 #include <uapi/linux/bpf.h>
 #include <uapi/linux/btf.h>
@@ -1017,6 +1020,20 @@ const struct bpf_func_proto bpf_get_current_task_proto = {
 	.ret_type	= RET_INTEGER,
 };
 
+BPF_CALL_0(bpf_get_current_task_btf)
+{
+	return (unsigned long) current;
+}
+
+BTF_ID_LIST_SINGLE(bpf_get_current_btf_ids, struct, task_struct)
+
+static const struct bpf_func_proto bpf_get_current_task_btf_proto = {
+	.func		= bpf_get_current_task_btf,
+	.gpl_only	= true,
+	.ret_type	= RET_PTR_TO_BTF_ID,
+	.ret_btf_id	= &bpf_get_current_btf_ids[0],
+};
+
 BPF_CALL_2(bpf_current_task_under_cgroup, struct bpf_map *, map, u32, idx)
 {
 	struct bpf_array *array = container_of(map, struct bpf_array, map);
@@ -1260,6 +1277,12 @@ bpf_tracing_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_get_current_pid_tgid_proto;
 	case BPF_FUNC_get_current_task:
 		return &bpf_get_current_task_proto;
+	case BPF_FUNC_get_current_task_btf:
+		return &bpf_get_current_task_btf_proto;
+	case BPF_FUNC_task_storage_get:
+		return &bpf_task_storage_get_proto;
+	case BPF_FUNC_task_storage_delete:
+		return &bpf_task_storage_delete_proto;
 	case BPF_FUNC_get_current_uid_gid:
 		return &bpf_get_current_uid_gid_proto;
 	case BPF_FUNC_get_current_comm:
@@ -1336,6 +1359,24 @@ bpf_tracing_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 	}
 }
 
+/* Cookie of the function a kprobe_multi program is currently running for.
+ * The handler runs with preemption disabled and under the bpf_prog_active
+ * guard, so a single value per CPU is enough.
+ */
+static DEFINE_PER_CPU(u64, bpf_kprobe_multi_cookie);
+
+BPF_CALL_1(bpf_get_attach_cookie_kprobe_multi, struct pt_regs *, regs)
+{
+	return __this_cpu_read(bpf_kprobe_multi_cookie);
+}
+
+static const struct bpf_func_proto bpf_get_attach_cookie_proto_kmulti = {
+	.func		= bpf_get_attach_cookie_kprobe_multi,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+};
+
 static const struct bpf_func_proto *
 kprobe_prog_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 {
@@ -1348,8 +1389,17 @@ kprobe_prog_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_get_stack_proto;
 #ifdef CONFIG_BPF_KPROBE_OVERRIDE
 	case BPF_FUNC_override_return:
+		/* kprobe_multi programs run from an ftrace callback, which
+		 * can't change the traced function's return path.
+		 */
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return NULL;
 		return &bpf_override_return_proto;
 #endif
+	case BPF_FUNC_get_attach_cookie:
+		if (prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+			return &bpf_get_attach_cookie_proto_kmulti;
+		return NULL;
 	default:
 		return bpf_tracing_func_proto(func_id, prog);
 	}
@@ -1905,6 +1955,11 @@ int perf_event_attach_bpf_prog(struct perf_event *event,
 	struct bpf_prog_array *new_array;
 	int ret = -EEXIST;
 
+	/* kprobe_multi programs only attach through their own link */
+	if (prog->type == BPF_PROG_TYPE_KPROBE &&
+	    prog->expected_attach_type == BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
 	/*
 	 * Kprobe override only works if they are on the function entry,
 	 * and only if they are on the opt-in list.
@@ -2231,3 +2286,256 @@ static int __init bpf_event_init(void)
 
 fs_initcall(bpf_event_init);
 #endif /* CONFIG_MODULES */
+
+#ifdef CONFIG_DYNAMIC_FTRACE_WITH_REGS
+/* Upper bound on the number of functions a single link can attach to */
+#define KPROBE_MULTI_MAX_CNT	(1U << 20)
+
+struct bpf_kprobe_multi_entry {
+	unsigned long addr;
+	u64 cookie;
+};
+
+/* One ftrace_ops shared by all the functions of the link: its filter hash
+ * holds every address, so attaching is a single ftrace update rather than
+ * one kprobe registration (and text patching round) per function.
+ */
+struct bpf_kprobe_multi_link {
+	struct bpf_link link;
+	struct ftrace_ops ops;
+	/* sorted by addr, for the cookie lookup */
+	struct bpf_kprobe_multi_entry *entries;
+	u32 cnt;
+	bool has_cookies;
+};
+
+static int bpf_kprobe_multi_entry_cmp(const void *a, const void *b)
+{
+	const struct bpf_kprobe_multi_entry *ea = a, *eb = b;
+
+	if (ea->addr == eb->addr)
+		return 0;
+	return ea->addr < eb->addr ? -1 : 1;
+}
+
+static u64 bpf_kprobe_multi_cookie_get(struct bpf_kprobe_multi_link *link,
+				       unsigned long ip)
+{
+	struct bpf_kprobe_multi_entry key = { .addr = ip }, *entry;
+
+	if (!link->has_cookies)
+		return 0;
+
+	entry = bsearch(&key, link->entries, link->cnt, sizeof(*entry),
+			bpf_kprobe_multi_entry_cmp);
+	return entry ? entry->cookie : 0;
+}
+
+static void bpf_kprobe_multi_handler(unsigned long ip, unsigned long parent_ip,
+				     struct ftrace_ops *ops,
+				     struct pt_regs *regs)
+{
+	struct bpf_kprobe_multi_link *link;
+
+	link = container_of(ops, struct bpf_kprobe_multi_link, ops);
+
+	if (unlikely(__this_cpu_inc_return(bpf_prog_active) != 1))
+		goto out;
+
+	__this_cpu_write(bpf_kprobe_multi_cookie,
+			 bpf_kprobe_multi_cookie_get(link, ip));
+	rcu_read_lock();
+	BPF_PROG_RUN(link->link.prog, regs);
+	rcu_read_unlock();
+
+out:
+	__this_cpu_dec(bpf_prog_active);
+}
+
+static void bpf_kprobe_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	unregister_ftrace_function(&kmulti_link->ops);
+}
+
+static void bpf_kprobe_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	ftrace_free_filter(&kmulti_link->ops);
+	kvfree(kmulti_link->entries);
+	kfree(kmulti_link);
+}
+
+static void bpf_kprobe_multi_link_show_fdinfo(const struct bpf_link *link,
+					      struct seq_file *seq)
+{
+	struct bpf_kprobe_multi_link *kmulti_link;
+
+	kmulti_link = container_of(link, struct bpf_kprobe_multi_link, link);
+	seq_printf(seq, "func_cnt:\t%u\n", kmulti_link->cnt);
+}
+
+static const struct bpf_link_ops bpf_kprobe_multi_link_lops = {
+	.release = bpf_kprobe_multi_link_release,
+	.dealloc = bpf_kprobe_multi_link_dealloc,
+	.show_fdinfo = bpf_kprobe_multi_link_show_fdinfo,
+};
+
+static int bpf_kprobe_multi_resolve_syms(u64 __user *usyms,
+					 struct bpf_kprobe_multi_entry *entries,
+					 u32 cnt)
+{
+	unsigned long addr;
+	char *func;
+	u64 usym;
+	int err = 0;
+	u32 i;
+
+	func = kmalloc(KSYM_NAME_LEN, GFP_KERNEL);
+	if (!func)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		if (get_user(usym, usyms + i)) {
+			err = -EFAULT;
+			break;
+		}
+		err = strncpy_from_user(func, u64_to_user_ptr(usym),
+					KSYM_NAME_LEN);
+		if (err == KSYM_NAME_LEN)
+			err = -E2BIG;
+		if (err < 0)
+			break;
+		err = 0;
+
+		addr = kallsyms_lookup_name(func);
+		if (!addr) {
+			err = -ENOENT;
+			break;
+		}
+		entries[i].addr = addr;
+	}
+
+	kfree(func);
+	return err;
+}
+
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	struct bpf_kprobe_multi_link *link = NULL;
+	struct bpf_kprobe_multi_entry *entries;
+	struct bpf_link_primer link_primer;
+	u64 __user *ucookies, *uaddrs, *usyms;
+	unsigned long *addrs = NULL;
+	u64 addr, cookie;
+	u32 cnt, i;
+	int err;
+
+	if (prog->expected_attach_type != BPF_TRACE_KPROBE_MULTI)
+		return -EINVAL;
+
+	/* Return probes need a per-task return stack, which ftrace_ops
+	 * callbacks don't provide; only entry probes are supported.
+	 */
+	if (attr->link_create.kprobe_multi.flags)
+		return -EINVAL;
+
+	uaddrs = u64_to_user_ptr(attr->link_create.kprobe_multi.addrs);
+	usyms = u64_to_user_ptr(attr->link_create.kprobe_multi.syms);
+	if (!!uaddrs == !!usyms)
+		return -EINVAL;
+
+	cnt = attr->link_create.kprobe_multi.cnt;
+	if (!cnt)
+		return -EINVAL;
+	if (cnt > KPROBE_MULTI_MAX_CNT)
+		return -E2BIG;
+
+	entries = kvmalloc_array(cnt, sizeof(*entries), GFP_KERNEL | __GFP_ZERO);
+	addrs = kvmalloc_array(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!entries || !addrs) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	if (uaddrs) {
+		for (i = 0; i < cnt; i++) {
+			if (get_user(addr, uaddrs + i)) {
+				err = -EFAULT;
+				goto error;
+			}
+			entries[i].addr = addr;
+		}
+	} else {
+		err = bpf_kprobe_multi_resolve_syms(usyms, entries, cnt);
+		if (err)
+			goto error;
+	}
+
+	ucookies = u64_to_user_ptr(attr->link_create.kprobe_multi.cookies);
+	if (ucookies) {
+		for (i = 0; i < cnt; i++) {
+			if (get_user(cookie, ucookies + i)) {
+				err = -EFAULT;
+				goto error;
+			}
+			entries[i].cookie = cookie;
+		}
+	}
+
+	sort(entries, cnt, sizeof(*entries), bpf_kprobe_multi_entry_cmp, NULL);
+	for (i = 0; i < cnt; i++)
+		addrs[i] = entries[i].addr;
+
+	link = kzalloc(sizeof(*link), GFP_KERNEL);
+	if (!link) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	bpf_link_init(&link->link, BPF_LINK_TYPE_KPROBE_MULTI,
+		      &bpf_kprobe_multi_link_lops, prog);
+	link->ops.func = bpf_kprobe_multi_handler;
+	link->ops.flags = FTRACE_OPS_FL_SAVE_REGS | FTRACE_OPS_FL_RCU;
+	link->entries = entries;
+	link->cnt = cnt;
+	link->has_cookies = !!ucookies;
+
+	err = ftrace_set_filter_ips(&link->ops, addrs, cnt, 0, 0);
+	if (err) {
+		ftrace_free_filter(&link->ops);
+		goto error;
+	}
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err) {
+		ftrace_free_filter(&link->ops);
+		goto error;
+	}
+
+	err = register_ftrace_function(&link->ops);
+	kvfree(addrs);
+	if (err) {
+		/* dealloc releases the filter and entries */
+		bpf_link_cleanup(&link_primer);
+		return err;
+	}
+
+	return bpf_link_settle(&link_primer);
+
+error:
+	kfree(link);
+	kvfree(addrs);
+	kvfree(entries);
+	return err;
+}
+#else /* !CONFIG_DYNAMIC_FTRACE_WITH_REGS */
+int bpf_kprobe_multi_link_attach(const union bpf_attr *attr, struct bpf_prog *prog)
+{
+	return -EOPNOTSUPP;
+}
+#endif
@@ -4955,9 +4955,25 @@ ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
 	return add_hash_entry(hash, ip);
 }
 
+static int
+ftrace_match_addrs(struct ftrace_hash *hash, unsigned long *ips,
+		   unsigned int cnt, int remove)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < cnt; i++) {
+		err = ftrace_match_addr(hash, ips[i], remove);
+		if (err < 0)
+			return err;
+	}
+	return 0;
+}
+
 static int
 ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
-		unsigned long ip, int remove, int reset, int enable)
+		unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
 	struct ftrace_hash **orig_hash;
 	struct ftrace_hash *hash;
@@ -4987,8 +5003,8 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 		ret = -EINVAL;
 		goto out_regex_unlock;
 	}
-	if (ip) {
-		ret = ftrace_match_addr(hash, ip, remove);
+	if (ips) {
+		ret = ftrace_match_addrs(hash, ips, cnt, remove);
 		if (ret < 0)
 			goto out_regex_unlock;
 	}
@@ -5005,10 +5021,10 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 }
 
 static int
-ftrace_set_addr(struct ftrace_ops *ops, unsigned long ip, int remove,
-		int reset, int enable)
+ftrace_set_addr(struct ftrace_ops *ops, unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
-	return ftrace_set_hash(ops, NULL, 0, ip, remove, reset, enable);
+	return ftrace_set_hash(ops, NULL, 0, ips, cnt, remove, reset, enable);
 }
 
 #ifdef CONFIG_DYNAMIC_FTRACE_WITH_DIRECT_CALLS
@@ -5085,45 +5101,61 @@ static struct ftrace_direct_func *ftrace_alloc_direct_func(unsigned long addr)
  */
 int register_ftrace_direct(unsigned long ip, unsigned long addr)
 {
+	return register_ftrace_direct_ips(&ip, &addr, 1);
+}
+EXPORT_SYMBOL_GPL(register_ftrace_direct);
+
+/**
+ * register_ftrace_direct_ips - Call custom trampolines directly from many ips
+ * @ips: Array of addresses of the nops at the beginning of functions
+ * @addrs: Array of trampoline addresses, @addrs[i] is called from @ips[i]
+ * @cnt: Number of entries in @ips and @addrs
+ *
+ * This is register_ftrace_direct() for @cnt functions at once. All the
+ * direct calls are installed with a single update of the direct_ops
+ * filter, i.e. one pass over the ftrace records and one round of text
+ * patching, and the direct_functions hash is resized at most once.
+ * Either all the direct calls are installed or none is.
+ *
+ * On success, @ips is updated to hold the exact record addresses.
+ *
+ * Returns:
+ *  0 on success
+ *  -EBUSY - Another direct function is already attached to one of @ips
+ *  -ENODEV - One of @ips does not point to a ftrace nop location
+ *  -ENOMEM - There was an allocation failure.
+ */
+int register_ftrace_direct_ips(unsigned long *ips, unsigned long *addrs,
+			       unsigned int cnt)
+{
+	struct {
+		struct ftrace_func_entry *entry;
+		struct ftrace_direct_func *direct;
+	} *slots;
 	struct ftrace_direct_func *direct;
 	struct ftrace_func_entry *entry;
 	struct ftrace_hash *free_hash = NULL;
+	unsigned int i, added = 0, nr_free = 0;
 	struct dyn_ftrace *rec;
-	int ret = -EBUSY;
-
-	mutex_lock(&direct_mutex);
-
-	/* See if there's a direct function at @ip already */
-	if (ftrace_find_rec_direct(ip))
-		goto out_unlock;
+	int ret;
 
-	ret = -ENODEV;
-	rec = lookup_rec(ip, ip);
-	if (!rec)
-		goto out_unlock;
+	if (!cnt)
+		return -EINVAL;
 
-	/*
-	 * Check if the rec says it has a direct call but we didn't
-	 * find one earlier?
-	 */
-	if (WARN_ON(rec->flags & FTRACE_FL_DIRECT))
-		goto out_unlock;
+	slots = kvcalloc(cnt, sizeof(*slots), GFP_KERNEL);
+	if (!slots)
+		return -ENOMEM;
 
-	/* Make sure the ip points to the exact record */
-	if (ip != rec->ip) {
-		ip = rec->ip;
-		/* Need to check this ip for a direct. */
-		if (ftrace_find_rec_direct(ip))
-			goto out_unlock;
-	}
+	mutex_lock(&direct_mutex);
 
 	ret = -ENOMEM;
 	if (ftrace_hash_empty(direct_functions) ||
-	    direct_functions->count > 2 * (1 << direct_functions->size_bits)) {
+	    direct_functions->count + cnt > 2 * (1 << direct_functions->size_bits)) {
 		struct ftrace_hash *new_hash;
 		int size = ftrace_hash_empty(direct_functions) ? 0 :
-			direct_functions->count + 1;
+			direct_functions->count;
 
+		size += cnt;
 		if (size < 32)
 			size = 32;
 
@@ -5135,46 +5167,94 @@ int register_ftrace_direct(unsigned long ip, unsigned long addr)
 		direct_functions = new_hash;
 	}
 
-	entry = kmalloc(sizeof(*entry), GFP_KERNEL);
-	if (!entry)
-		goto out_unlock;
+	for (i = 0; i < cnt; i++) {
+		/* See if there's a direct function at @ip already */
+		ret = -EBUSY;
+		if (ftrace_find_rec_direct(ips[i]))
+			goto out_remove;
 
-	direct = ftrace_find_direct_func(addr);
-	if (!direct) {
-		direct = ftrace_alloc_direct_func(addr);
+		ret = -ENODEV;
+		rec = lookup_rec(ips[i], ips[i]);
+		if (!rec)
+			goto out_remove;
+
+		/*
+		 * Check if the rec says it has a direct call but we didn't
+		 * find one earlier?
+		 */
+		if (WARN_ON(rec->flags & FTRACE_FL_DIRECT))
+			goto out_remove;
+
+		/* Make sure the ip points to the exact record */
+		if (ips[i] != rec->ip) {
+			ips[i] = rec->ip;
+			/* Need to check this ip for a direct. */
+			ret = -EBUSY;
+			if (ftrace_find_rec_direct(ips[i]))
+				goto out_remove;
+		}
+
+		ret = -ENOMEM;
+		entry = kmalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry)
+			goto out_remove;
+
+		direct = ftrace_find_direct_func(addrs[i]);
 		if (!direct) {
-			kfree(entry);
-			goto out_unlock;
+			direct = ftrace_alloc_direct_func(addrs[i]);
+			if (!direct) {
+				kfree(entry);
+				goto out_remove;
+			}
 		}
+
+		entry->ip = ips[i];
+		entry->direct = addrs[i];
+		__add_hash_entry(direct_functions, entry);
+		slots[added].entry = entry;
+		slots[added].direct = direct;
+		added++;
 	}
 
-	entry->ip = ip;
-	entry->direct = addr;
-	__add_hash_entry(direct_functions, entry);
-
-	ret = ftrace_set_filter_ip(&direct_ops, ip, 0, 0);
-	if (ret)
-		remove_hash_entry(direct_functions, entry);
+	ret = ftrace_set_filter_ips(&direct_ops, ips, cnt, 0, 0);
 
 	if (!ret && !(direct_ops.flags & FTRACE_OPS_FL_ENABLED)) {
 		ret = register_ftrace_function(&direct_ops);
 		if (ret)
-			ftrace_set_filter_ip(&direct_ops, ip, 1, 0);
+			ftrace_set_filter_ips(&direct_ops, ips, cnt, 1, 0);
 	}
 
-	if (ret) {
-		kfree(entry);
-		if (!direct->count) {
-			list_del_rcu(&direct->next);
-			synchronize_rcu_tasks();
-			kfree(direct);
-			if (free_hash)
-				free_ftrace_hash(free_hash);
-			free_hash = NULL;
-			ftrace_direct_func_count--;
-		}
-	} else {
-		direct->count++;
+	if (!ret) {
+		for (i = 0; i < added; i++)
+			slots[i].direct->count++;
+		goto out_unlock;
+	}
+
+ out_remove:
+	for (i = 0; i < added; i++) {
+		remove_hash_entry(direct_functions, slots[i].entry);
+		kfree(slots[i].entry);
+	}
+	/*
+	 * Unlink the direct funcs allocated above; a direct func used by
+	 * several ips is only unlinked once (count is set to -1).
+	 */
+	for (i = 0; i < added; i++) {
+		direct = slots[i].direct;
+		if (direct->count)
+			continue;
+		list_del_rcu(&direct->next);
+		direct->count = -1;
+		ftrace_direct_func_count--;
+		slots[nr_free++].direct = direct;
+	}
+	if (nr_free) {
+		synchronize_rcu_tasks();
+		for (i = 0; i < nr_free; i++)
+			kfree(slots[i].direct);
+		if (free_hash)
+			free_ftrace_hash(free_hash);
+		free_hash = NULL;
 	}
  out_unlock:
 	mutex_unlock(&direct_mutex);
@@ -5183,10 +5263,11 @@ int register_ftrace_direct(unsigned long ip, unsigned long addr)
 		synchronize_rcu_tasks();
 		free_ftrace_hash(free_hash);
 	}
+	kvfree(slots);
 
 	return ret;
 }
-EXPORT_SYMBOL_GPL(register_ftrace_direct);
+EXPORT_SYMBOL_GPL(register_ftrace_direct_ips);
 
 static struct ftrace_func_entry *find_direct_entry(unsigned long *ip,
 						   struct dyn_ftrace **recp)
@@ -5419,10 +5500,31 @@ int ftrace_set_filter_ip(struct ftrace_ops *ops, unsigned long ip,
 			 int remove, int reset)
 {
 	ftrace_ops_init(ops);
-	return ftrace_set_addr(ops, ip, remove, reset, 1);
+	return ftrace_set_addr(ops, ip ? &ip : NULL, 1, remove, reset, 1);
 }
 EXPORT_SYMBOL_GPL(ftrace_set_filter_ip);
 
+/**
+ * ftrace_set_filter_ips - set functions to filter on in ftrace by addresses
+ * @ops - the ops to set the filter with
+ * @ips - the array of addresses to add to or remove from the filter.
+ * @cnt - the number of addresses in @ips
+ * @remove - non zero to remove ips from the filter
+ * @reset - non zero to reset all filters before applying this filter.
+ *
+ * Filters denote which functions should be enabled when tracing is enabled
+ * If @ips array or any ip specified within is NULL , it fails to update filter.
+ * All addresses are applied with a single hash update, so a registered @ops
+ * is only updated once.
+ */
+int ftrace_set_filter_ips(struct ftrace_ops *ops, unsigned long *ips,
+			  unsigned int cnt, int remove, int reset)
+{
+	ftrace_ops_init(ops);
+	return ftrace_set_addr(ops, ips, cnt, remove, reset, 1);
+}
+EXPORT_SYMBOL_GPL(ftrace_set_filter_ips);
+
 /**
  * ftrace_ops_set_global_filter - setup ops to use global filters
  * @ops - the ops which will use the global filters
@@ -5444,7 +5546,7 @@ static int
 ftrace_set_regex(struct ftrace_ops *ops, unsigned char *buf, int len,
 		 int reset, int enable)
 {
-	return ftrace_set_hash(ops, buf, len, 0, 0, reset, enable);
+	return ftrace_set_hash(ops, buf, len, NULL, 0, 0, reset, enable);
 }
 
 /**
@@ -27,6 +27,7 @@
 #include <linux/oom.h>
 
 #include <asm/local.h>
+#include <asm/cacheflush.h>
 
 static void update_pages_handler(struct work_struct *work);
 
@@ -332,6 +333,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned int	 id;		/* ID for external mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -531,6 +533,11 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* user space mapping, protected by buffer->mutex and reader_lock */
+	unsigned int			mapped;
+	struct trace_buffer_meta	*meta_page;
+	unsigned long			*subbuf_ids;	/* ID to data page */
 };
 
 struct trace_buffer {
@@ -1248,6 +1255,18 @@ static inline void rb_inc_page(struct ring_buffer_per_cpu *cpu_buffer,
 	*bpage = list_entry(p, struct buffer_page, list);
 }
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs do not have data cache coherency between kernel and user space */
+	flush_dcache_page(virt_to_page(cpu_buffer->reader_page->page));
+}
+
 static struct buffer_page *
 rb_set_head_page(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -4904,6 +4923,16 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 	cpu_buffer->last_overrun = 0;
 
 	rb_head_page_activate(cpu_buffer);
+
+	if (cpu_buffer->mapped) {
+		struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+		meta->reader.id = cpu_buffer->reader_page->id;
+		meta->reader.read = 0;
+		meta->reader.commit = 0;
+		meta->reader.lost_events = 0;
+		rb_update_meta_page(cpu_buffer);
+	}
 }
 
 /* Must have disabled the cpu buffer then done a synchronize_rcu */
@@ -5111,6 +5140,11 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* The pages of a mapped buffer must stay with it */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -5330,12 +5364,14 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the pages are mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -5444,6 +5480,271 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned long *subbuf_ids = cpu_buffer->subbuf_ids;
+	struct buffer_page *first_subbuf, *subbuf;
+	unsigned int nr_subbufs = cpu_buffer->nr_pages + 1;
+	unsigned int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first_subbuf = subbuf = cpu_buffer->head_page;
+	do {
+		if (RB_WARN_ON(cpu_buffer, id >= nr_subbufs))
+			break;
+
+		subbuf_ids[id] = (unsigned long)subbuf->page;
+		subbuf->id = id++;
+
+		rb_inc_page(cpu_buffer, &subbuf);
+	} while (subbuf != first_subbuf);
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = nr_subbufs;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.commit = cpu_buffer->reader_page->read;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+static int __rb_map_vma(struct ring_buffer_per_cpu *cpu_buffer,
+			struct vm_area_struct *vma)
+{
+	unsigned long nr_pages, nr_vma_pages, pgoff = vma->vm_pgoff;
+	unsigned long addr = vma->vm_start;
+	unsigned long i;
+	int err;
+
+	/* The meta-page and the sub-buffers are read-only for user space */
+	if (vma->vm_flags & (VM_WRITE | VM_EXEC) ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	vma->vm_flags |= VM_DONTCOPY | VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	/* The meta-page comes first, then the sub-buffers in ID order */
+	nr_pages = cpu_buffer->nr_pages + 2;
+	nr_vma_pages = vma_pages(vma);
+	if (!nr_vma_pages || pgoff >= nr_pages ||
+	    nr_vma_pages > nr_pages - pgoff)
+		return -EINVAL;
+
+	for (i = 0; i < nr_vma_pages; i++, pgoff++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pgoff)
+			page = virt_to_page(cpu_buffer->meta_page);
+		else
+			page = virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff - 1]);
+
+		err = vm_insert_page(vma, addr, page);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a per CPU buffer to user space
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to map
+ * @vma: The user space mapping, from a file mmap() handler, or NULL to
+ *	account for a copy of an existing mapping, e.g. from mremap()
+ *
+ * The first page of the mapping is a struct trace_buffer_meta, followed
+ * by the pages of the buffer. While mapped, the buffer can't be resized
+ * and its pages are never swapped out by ring_buffer_read_page().
+ *
+ * Returns 0 on success and < 0 on failure.
+ */
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long flags, *subbuf_ids;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	/* prevent another thread from changing buffer sizes */
+	mutex_lock(&buffer->mutex);
+
+	if (cpu_buffer->mapped) {
+		err = vma ? __rb_map_vma(cpu_buffer, vma) : 0;
+		if (!err)
+			cpu_buffer->mapped++;
+		goto out;
+	}
+
+	if (!vma) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!subbuf_ids) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	if (!meta) {
+		kfree(subbuf_ids);
+		err = -ENOMEM;
+		goto out;
+	}
+
+	atomic_inc(&cpu_buffer->resize_disabled);
+
+	/*
+	 * Set mapped with the reader_lock held, so that no reader swaps
+	 * a page out between the ID setup and ring_buffer_read_page()
+	 * seeing the buffer mapped.
+	 */
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	rb_setup_ids_meta_page(cpu_buffer);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	err = __rb_map_vma(cpu_buffer, vma);
+	if (err) {
+		raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+		cpu_buffer->mapped = 0;
+		cpu_buffer->meta_page = NULL;
+		cpu_buffer->subbuf_ids = NULL;
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+		atomic_dec(&cpu_buffer->resize_disabled);
+		free_page((unsigned long)meta);
+		kfree(subbuf_ids);
+	}
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - drop a user space mapping of a per CPU buffer
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to unmap
+ *
+ * Returns 0 on success and < 0 on failure.
+ */
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	unsigned long flags, *subbuf_ids;
+	int err = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&buffer->mutex);
+
+	if (!cpu_buffer->mapped) {
+		err = -ENODEV;
+		goto out;
+	}
+
+	if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	meta = cpu_buffer->meta_page;
+	subbuf_ids = cpu_buffer->subbuf_ids;
+	cpu_buffer->meta_page = NULL;
+	cpu_buffer->subbuf_ids = NULL;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	atomic_dec(&cpu_buffer->resize_disabled);
+	free_page((unsigned long)meta);
+	kfree(subbuf_ids);
+ out:
+	mutex_unlock(&buffer->mutex);
+	return err;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next events to a mapped reader
+ * @buffer: The ring buffer
+ * @cpu: The mapped CPU buffer
+ *
+ * Swaps in a new reader page if the current one has been fully consumed,
+ * then consumes all the events committed on the reader page. The meta-page
+ * tells user space which sub-buffer and range of it hold these events.
+ *
+ * Returns 0 on success and < 0 on failure.
+ */
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct trace_buffer_meta *meta;
+	struct buffer_page *reader;
+	unsigned int start, end;
+	unsigned long flags;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+		return -ENODEV;
+	}
+
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader) {
+		/* Nothing new, hand back an empty range */
+		reader = cpu_buffer->reader_page;
+		start = end = reader->read;
+	} else {
+		start = reader->read;
+		end = rb_page_size(reader);
+		while (reader->read < end)
+			rb_advance_reader(cpu_buffer);
+	}
+
+	meta = cpu_buffer->meta_page;
+	meta->reader.id = reader->id;
+	meta->reader.read = start;
+	meta->reader.commit = end;
+	meta->reader.lost_events = cpu_buffer->lost_events;
+	cpu_buffer->lost_events = 0;
+
+	rb_update_meta_page(cpu_buffer);
+
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
@@ -1214,11 +1214,24 @@ int tracing_alloc_snapshot_instance(struct trace_array *tr)
 
 	if (!tr->allocated_snapshot) {
 
+		/* a snapshot would swap the mapped buffer pages away */
+		spin_lock(&tr->mapped_lock);
+		if (tr->mapped) {
+			spin_unlock(&tr->mapped_lock);
+			return -EBUSY;
+		}
+		tr->snapshot_in_use = true;
+		spin_unlock(&tr->mapped_lock);
+
 		/* allocate spare buffer */
 		ret = resize_buffer_duplicate_size(&tr->max_buffer,
 				   &tr->array_buffer, RING_BUFFER_ALL_CPUS);
-		if (ret < 0)
+		if (ret < 0) {
+			spin_lock(&tr->mapped_lock);
+			tr->snapshot_in_use = false;
+			spin_unlock(&tr->mapped_lock);
 			return ret;
+		}
 
 		tr->allocated_snapshot = true;
 	}
@@ -1237,6 +1250,10 @@ static void free_snapshot(struct trace_array *tr)
 	set_buffer_entries(&tr->max_buffer, 1);
 	tracing_reset_online_cpus(&tr->max_buffer);
 	tr->allocated_snapshot = false;
+
+	spin_lock(&tr->mapped_lock);
+	tr->snapshot_in_use = false;
+	spin_unlock(&tr->mapped_lock);
 }
 
 /**
@@ -5274,7 +5291,11 @@ static const char readme_msg[] =
 	"\t            .execname   display a common_pid as a program name\n"
 	"\t            .syscall    display a syscall id as a syscall name\n"
 	"\t            .log2       display log2 value rather than raw number\n"
+	"\t            .buckets=size  display values in groups of size rather than raw number\n"
 	"\t            .usecs      display a common_timestamp in microseconds\n\n"
+	"\t    On a value, .log2 and .buckets=size also keep a distribution\n"
+	"\t    of the value per entry and display its p50 and p99, as the\n"
+	"\t    upper bound of the bucket holding each percentile.\n\n"
 	"\t    The 'pause' parameter can be used to pause an existing hist\n"
 	"\t    trigger or to start a hist trigger but not log any events\n"
 	"\t    until told to do so.  'continue' can be used to start or\n"
@@ -7781,12 +7802,113 @@ tracing_buffers_splice_read(struct file *file, loff_t *ppos,
 	return ret;
 }
 
+static long tracing_buffers_ioctl(struct file *file, unsigned int cmd,
+				  unsigned long arg)
+{
+	struct ftrace_buffer_info *info = file->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (cmd != TRACE_MMAP_IOCTL_GET_READER)
+		return -ENOTTY;
+
+	if (!(file->f_flags & O_NONBLOCK) && trace_empty(iter)) {
+		ret = wait_on_pipe(iter, 0);
+		if (ret)
+			return ret;
+	}
+
+	return ring_buffer_map_get_reader(iter->array_buffer->buffer,
+					  iter->cpu_file);
+}
+
+static int get_buffers_map(struct trace_array *tr)
+{
+	int ret = 0;
+
+	spin_lock(&tr->mapped_lock);
+#ifdef CONFIG_TRACER_MAX_TRACE
+	/* a snapshot would swap the mapped buffer pages away */
+	if (tr->allocated_snapshot || tr->snapshot_in_use)
+		ret = -EBUSY;
+#endif
+	if (!ret)
+		tr->mapped++;
+	spin_unlock(&tr->mapped_lock);
+
+	return ret;
+}
+
+static void put_buffers_map(struct trace_array *tr)
+{
+	spin_lock(&tr->mapped_lock);
+	if (!WARN_ON(!tr->mapped))
+		tr->mapped--;
+	spin_unlock(&tr->mapped_lock);
+}
+
+static void tracing_buffers_mmap_open(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	/* the vma was duplicated by mremap(), account for the copy */
+	WARN_ON(get_buffers_map(iter->tr));
+	WARN_ON(ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file,
+				NULL));
+}
+
+static void tracing_buffers_mmap_close(struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = vma->vm_file->private_data;
+	struct trace_iterator *iter = &info->iter;
+
+	WARN_ON(ring_buffer_unmap(iter->array_buffer->buffer, iter->cpu_file));
+	put_buffers_map(iter->tr);
+}
+
+static int tracing_buffers_mmap_split(struct vm_area_struct *vma,
+				      unsigned long addr)
+{
+	/* the mapping is accounted as a whole */
+	return -EINVAL;
+}
+
+static const struct vm_operations_struct tracing_buffers_vmops = {
+	.open		= tracing_buffers_mmap_open,
+	.close		= tracing_buffers_mmap_close,
+	.split		= tracing_buffers_mmap_split,
+};
+
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	ret = get_buffers_map(iter->tr);
+	if (ret)
+		return ret;
+
+	ret = ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file, vma);
+	if (ret) {
+		put_buffers_map(iter->tr);
+		return ret;
+	}
+
+	vma->vm_ops = &tracing_buffers_vmops;
+
+	return 0;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
 	.poll		= tracing_buffers_poll,
 	.release	= tracing_buffers_release,
 	.splice_read	= tracing_buffers_splice_read,
+	.unlocked_ioctl	= tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -8717,6 +8839,7 @@ static struct trace_array *trace_array_create(const char *name)
 	cpumask_copy(tr->tracing_cpumask, cpu_all_mask);
 
 	raw_spin_lock_init(&tr->start_lock);
+	spin_lock_init(&tr->mapped_lock);
 
 	tr->max_lock = (arch_spinlock_t)__ARCH_SPIN_LOCK_UNLOCKED;
 
@@ -9528,6 +9651,7 @@ __init static int tracer_alloc_buffers(void)
 	cpumask_copy(global_trace.tracing_cpumask, cpu_all_mask);
 
 	raw_spin_lock_init(&global_trace.start_lock);
+	spin_lock_init(&global_trace.mapped_lock);
 
 	/*
 	 * The prepare callbacks allocates some memory for the ring buffer. We
@@ -303,6 +303,8 @@ struct trace_array {
 	 */
 	struct array_buffer	max_buffer;
 	bool			allocated_snapshot;
+	/* snapshot buffer allocated or being allocated, under mapped_lock */
+	bool			snapshot_in_use;
 #endif
 #if defined(CONFIG_TRACER_MAX_TRACE) || defined(CONFIG_HWLAT_TRACER)
 	unsigned long		max_latency;
@@ -346,6 +348,12 @@ struct trace_array {
 	unsigned char		trace_flags_index[TRACE_FLAGS_MAX_SIZE];
 	unsigned int		flags;
 	raw_spinlock_t		start_lock;
+	/*
+	 * Protects mapped, the count of trace_pipe_raw mappings. This can't
+	 * be trace_types_lock, as mmap() is called with mmap_lock held.
+	 */
+	spinlock_t		mapped_lock;
+	unsigned int		mapped;
 	struct list_head	err_log;
 	struct dentry		*dir;
 	struct dentry		*options;
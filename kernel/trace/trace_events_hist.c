@@ -150,6 +150,12 @@ struct hist_field {
 	bool                            read_once;
 
 	unsigned int			var_str_idx;
+
+	/* Bucket width for HIST_FIELD_FL_BUCKET */
+	unsigned long			buckets;
+
+	/* Distribution index of a log2 or bucket value, see HIST_DIST_BUCKETS */
+	unsigned int			dist_idx;
 };
 
 static u64 hist_field_none(struct hist_field *field,
@@ -212,6 +218,19 @@ static u64 hist_field_log2(struct hist_field *hist_field,
 	return (u64) ilog2(roundup_pow_of_two(val));
 }
 
+static u64 hist_field_bucket(struct hist_field *hist_field,
+			     struct tracing_map_elt *elt,
+			     struct ring_buffer_event *rbe,
+			     void *event)
+{
+	struct hist_field *operand = hist_field->operands[0];
+	unsigned long buckets = hist_field->buckets;
+
+	u64 val = operand->fn(operand, elt, rbe, event);
+
+	return div64_u64(val, buckets) * buckets;
+}
+
 static u64 hist_field_plus(struct hist_field *hist_field,
 			   struct tracing_map_elt *elt,
 			   struct ring_buffer_event *rbe,
@@ -307,8 +326,17 @@ enum hist_field_flags {
 	HIST_FIELD_FL_VAR_REF		= 1 << 14,
 	HIST_FIELD_FL_CPU		= 1 << 15,
 	HIST_FIELD_FL_ALIAS		= 1 << 16,
+	HIST_FIELD_FL_BUCKET		= 1 << 17,
 };
 
+/*
+ * Values with the log2 or buckets modifier also keep a distribution
+ * per entry, from which percentiles are displayed. Values past the
+ * last bucket are counted in it.
+ */
+#define HIST_DIST_BUCKETS	64
+#define HIST_DIST_FLAGS		(HIST_FIELD_FL_LOG2 | HIST_FIELD_FL_BUCKET)
+
 struct var_defs {
 	unsigned int	n_vars;
 	char		*name[TRACING_MAP_VARS_MAX];
@@ -353,6 +381,7 @@ struct hist_trigger_data {
 	unsigned int			n_fields;
 	unsigned int			n_vars;
 	unsigned int			n_var_str;
+	unsigned int			n_dists;
 	unsigned int			key_size;
 	struct tracing_map_sort_key	sort_keys[TRACING_MAP_SORT_KEYS_MAX];
 	unsigned int			n_sort_keys;
@@ -474,6 +503,8 @@ struct hist_elt_data {
 	char *comm;
 	u64 *var_ref_vals;
 	char *field_var_str[SYNTH_FIELDS_MAX];
+	/* n_dists * HIST_DIST_BUCKETS counters */
+	atomic64_t *dists;
 };
 
 struct snapshot_context {
@@ -1093,6 +1124,7 @@ static const char *hist_field_name(struct hist_field *field,
 	if (field->field)
 		field_name = field->field->name;
 	else if (field->flags & HIST_FIELD_FL_LOG2 ||
+		 field->flags & HIST_FIELD_FL_BUCKET ||
 		 field->flags & HIST_FIELD_FL_ALIAS)
 		field_name = hist_field_name(field->operands[0], ++level);
 	else if (field->flags & HIST_FIELD_FL_CPU)
@@ -1364,6 +1396,7 @@ static void hist_elt_data_free(struct hist_elt_data *elt_data)
 	for (i = 0; i < SYNTH_FIELDS_MAX; i++)
 		kfree(elt_data->field_var_str[i]);
 
+	kfree(elt_data->dists);
 	kfree(elt_data->comm);
 	kfree(elt_data);
 }
@@ -1419,11 +1452,33 @@ static int hist_trigger_elt_data_alloc(struct tracing_map_elt *elt)
 		}
 	}
 
+	if (hist_data->n_dists) {
+		elt_data->dists = kcalloc(hist_data->n_dists * HIST_DIST_BUCKETS,
+					  sizeof(*elt_data->dists), GFP_KERNEL);
+		if (!elt_data->dists) {
+			hist_elt_data_free(elt_data);
+			return -ENOMEM;
+		}
+	}
+
 	elt->private_data = elt_data;
 
 	return 0;
 }
 
+static void hist_trigger_elt_data_clear(struct tracing_map_elt *elt)
+{
+	struct hist_trigger_data *hist_data = elt->map->private_data;
+	struct hist_elt_data *elt_data = elt->private_data;
+	unsigned int i;
+
+	if (!elt_data->dists)
+		return;
+
+	for (i = 0; i < hist_data->n_dists * HIST_DIST_BUCKETS; i++)
+		atomic64_set(&elt_data->dists[i], 0);
+}
+
 static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 {
 	struct hist_elt_data *elt_data = elt->private_data;
@@ -1435,6 +1490,7 @@ static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 static const struct tracing_map_ops hist_trigger_elt_data_ops = {
 	.elt_alloc	= hist_trigger_elt_data_alloc,
 	.elt_free	= hist_trigger_elt_data_free,
+	.elt_clear	= hist_trigger_elt_data_clear,
 	.elt_init	= hist_trigger_elt_data_init,
 };
 
@@ -1454,6 +1510,8 @@ static const char *get_hist_field_flags(struct hist_field *hist_field)
 		flags_str = "syscall";
 	else if (hist_field->flags & HIST_FIELD_FL_LOG2)
 		flags_str = "log2";
+	else if (hist_field->flags & HIST_FIELD_FL_BUCKET)
+		flags_str = "buckets";
 	else if (hist_field->flags & HIST_FIELD_FL_TIMESTAMP_USECS)
 		flags_str = "usecs";
 
@@ -1474,6 +1532,12 @@ static void expr_field_str(struct hist_field *field, char *expr)
 			strcat(expr, ".");
 			strcat(expr, flags_str);
 		}
+		if (field->flags & HIST_FIELD_FL_BUCKET) {
+			char buckets[24];
+
+			snprintf(buckets, sizeof(buckets), "=%lu", field->buckets);
+			strcat(expr, buckets);
+		}
 	}
 }
 
@@ -1653,6 +1717,17 @@ static struct hist_field *create_hist_field(struct hist_trigger_data *hist_data,
 		goto out;
 	}
 
+	if (flags & HIST_FIELD_FL_BUCKET) {
+		unsigned long fl = flags & ~HIST_FIELD_FL_BUCKET;
+		hist_field->fn = hist_field_bucket;
+		hist_field->operands[0] = create_hist_field(hist_data, field, fl, NULL);
+		hist_field->size = hist_field->operands[0]->size;
+		hist_field->type = kstrdup(hist_field->operands[0]->type, GFP_KERNEL);
+		if (!hist_field->type)
+			goto free;
+		goto out;
+	}
+
 	if (flags & HIST_FIELD_FL_TIMESTAMP) {
 		hist_field->fn = hist_field_timestamp;
 		hist_field->size = sizeof(u64);
@@ -1938,7 +2013,7 @@ static struct hist_field *parse_var_ref(struct hist_trigger_data *hist_data,
 
 static struct ftrace_event_field *
 parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
-	    char *field_str, unsigned long *flags)
+	    char *field_str, unsigned long *flags, unsigned long *buckets)
 {
 	struct ftrace_event_field *field = NULL;
 	char *field_name, *modifier, *str;
@@ -1963,7 +2038,14 @@ parse_field(struct hist_trigger_data *hist_data, struct trace_event_file *file,
 			*flags |= HIST_FIELD_FL_SYSCALL;
 		else if (strcmp(modifier, "log2") == 0)
 			*flags |= HIST_FIELD_FL_LOG2;
-		else if (strcmp(modifier, "usecs") == 0)
+		else if (strncmp(modifier, "buckets=", 8) == 0) {
+			if (kstrtoul(modifier + 8, 0, buckets) || !*buckets) {
+				hist_err(tr, HIST_ERR_BAD_FIELD_MODIFIER, errpos(modifier));
+				field = ERR_PTR(-EINVAL);
+				goto out;
+			}
+			*flags |= HIST_FIELD_FL_BUCKET;
+		} else if (strcmp(modifier, "usecs") == 0)
 			*flags |= HIST_FIELD_FL_TIMESTAMP_USECS;
 		else {
 			hist_err(tr, HIST_ERR_BAD_FIELD_MODIFIER, errpos(modifier));
@@ -2034,6 +2116,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 	char *s, *ref_system = NULL, *ref_event = NULL, *ref_var = str;
 	struct ftrace_event_field *field = NULL;
 	struct hist_field *hist_field = NULL;
+	unsigned long buckets = 0;
 	int ret = 0;
 
 	s = strchr(str, '.');
@@ -2071,7 +2154,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 	} else
 		str = s;
 
-	field = parse_field(hist_data, file, str, flags);
+	field = parse_field(hist_data, file, str, flags, &buckets);
 	if (IS_ERR(field)) {
 		ret = PTR_ERR(field);
 		goto out;
@@ -2082,6 +2165,7 @@ static struct hist_field *parse_atom(struct hist_trigger_data *hist_data,
 		ret = -ENOMEM;
 		goto out;
 	}
+	hist_field->buckets = buckets;
 
 	return hist_field;
  out:
@@ -3704,10 +3788,21 @@ static int create_val_field(struct hist_trigger_data *hist_data,
 			    struct trace_event_file *file,
 			    char *field_str)
 {
+	struct hist_field *hist_field;
+	int ret;
+
 	if (WARN_ON(val_idx >= TRACING_MAP_VALS_MAX))
 		return -EINVAL;
 
-	return __create_val_field(hist_data, val_idx, file, NULL, field_str, 0);
+	ret = __create_val_field(hist_data, val_idx, file, NULL, field_str, 0);
+	if (ret)
+		return ret;
+
+	hist_field = hist_data->fields[val_idx];
+	if (hist_field->flags & HIST_DIST_FLAGS)
+		hist_field->dist_idx = hist_data->n_dists++;
+
+	return 0;
 }
 
 static int create_var_field(struct hist_trigger_data *hist_data,
@@ -4446,6 +4541,50 @@ create_hist_data(unsigned int map_bits,
 	goto out;
 }
 
+static unsigned int hist_dist_bucket(struct hist_field *hist_field, u64 val)
+{
+	u64 idx;
+
+	if (hist_field->flags & HIST_FIELD_FL_LOG2)
+		idx = val > 1 ? fls64(val - 1) : 0;
+	else
+		idx = div64_u64(val, hist_field->buckets);
+
+	return min_t(u64, idx, HIST_DIST_BUCKETS - 1);
+}
+
+/* The upper bound of the values counted in a distribution bucket */
+static u64 hist_dist_bucket_max(struct hist_field *hist_field,
+				unsigned int idx)
+{
+	if (hist_field->flags & HIST_FIELD_FL_LOG2)
+		return 1ULL << idx;
+
+	return (u64)(idx + 1) * hist_field->buckets - 1;
+}
+
+/*
+ * A distribution value sums the raw values, so that it can still be
+ * used as a sort key, and counts them in the bucket they fall into.
+ */
+static void hist_trigger_dist_update(struct hist_elt_data *elt_data,
+				     struct hist_field *hist_field,
+				     unsigned int val_idx,
+				     struct tracing_map_elt *elt,
+				     struct ring_buffer_event *rbe, void *rec)
+{
+	struct hist_field *operand = hist_field->operands[0];
+	unsigned int idx;
+	u64 val;
+
+	val = operand->fn(operand, elt, rbe, rec);
+	idx = hist_field->dist_idx * HIST_DIST_BUCKETS +
+		hist_dist_bucket(hist_field, val);
+
+	atomic64_inc(&elt_data->dists[idx]);
+	tracing_map_update_sum(elt, val_idx, val);
+}
+
 static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 				    struct tracing_map_elt *elt, void *rec,
 				    struct ring_buffer_event *rbe,
@@ -4461,6 +4600,12 @@ static void hist_trigger_elt_update(struct hist_trigger_data *hist_data,
 
 	for_each_hist_val_field(i, hist_data) {
 		hist_field = hist_data->fields[i];
+		if (hist_field->flags & HIST_DIST_FLAGS &&
+		    !(hist_field->flags & HIST_FIELD_FL_VAR)) {
+			hist_trigger_dist_update(elt_data, hist_field, i, elt,
+						 rbe, rec);
+			continue;
+		}
 		hist_val = hist_field->fn(hist_field, elt, rbe, rec);
 		if (hist_field->flags & HIST_FIELD_FL_VAR) {
 			var_idx = hist_field->var.idx;
@@ -4677,6 +4822,12 @@ static void hist_trigger_print_key(struct seq_file *m,
 		} else if (key_field->flags & HIST_FIELD_FL_LOG2) {
 			seq_printf(m, "%s: ~ 2^%-2llu", field_name,
 				   *(u64 *)(key + key_field->offset));
+		} else if (key_field->flags & HIST_FIELD_FL_BUCKET) {
+			unsigned long buckets = key_field->buckets;
+
+			uval = *(u64 *)(key + key_field->offset);
+			seq_printf(m, "%s: ~ %llu-%llu", field_name,
+				   uval, uval + buckets - 1);
 		} else if (key_field->flags & HIST_FIELD_FL_STRING) {
 			seq_printf(m, "%s: %-50s", field_name,
 				   (char *)(key + key_field->offset));
@@ -4692,6 +4843,42 @@ static void hist_trigger_print_key(struct seq_file *m,
 	seq_puts(m, "}");
 }
 
+static u64 hist_dist_percentile(struct hist_field *hist_field,
+				atomic64_t *dist, u64 total, unsigned int pct)
+{
+	u64 count = 0;
+	unsigned int i;
+
+	for (i = 0; i < HIST_DIST_BUCKETS - 1; i++) {
+		count += atomic64_read(&dist[i]);
+		if (count * 100 >= total * pct)
+			break;
+	}
+
+	return hist_dist_bucket_max(hist_field, i);
+}
+
+static void hist_trigger_dist_print(struct seq_file *m,
+				    struct hist_field *hist_field,
+				    struct tracing_map_elt *elt)
+{
+	struct hist_elt_data *elt_data = elt->private_data;
+	atomic64_t *dist;
+	u64 total = 0;
+	unsigned int i;
+
+	dist = &elt_data->dists[hist_field->dist_idx * HIST_DIST_BUCKETS];
+	for (i = 0; i < HIST_DIST_BUCKETS; i++)
+		total += atomic64_read(&dist[i]);
+
+	if (!total)
+		return;
+
+	seq_printf(m, " p50: %10llu p99: %10llu",
+		   hist_dist_percentile(hist_field, dist, total, 50),
+		   hist_dist_percentile(hist_field, dist, total, 99));
+}
+
 static void hist_trigger_entry_print(struct seq_file *m,
 				     struct hist_trigger_data *hist_data,
 				     void *key,
@@ -4719,6 +4906,9 @@ static void hist_trigger_entry_print(struct seq_file *m,
 			seq_printf(m, "  %s: %10llu", field_name,
 				   tracing_map_read_sum(elt, i));
 		}
+
+		if (hist_data->fields[i]->flags & HIST_DIST_FLAGS)
+			hist_trigger_dist_print(m, hist_data->fields[i], elt);
 	}
 
 	print_actions(m, hist_data, elt);
@@ -5114,6 +5304,8 @@ static void hist_field_print(struct seq_file *m, struct hist_field *hist_field)
 
 			if (flags)
 				seq_printf(m, ".%s", flags);
+			if (hist_field->flags & HIST_FIELD_FL_BUCKET)
+				seq_printf(m, "=%lu", hist_field->buckets);
 		}
 	}
 }
@@ -5404,6 +5596,8 @@ static bool hist_trigger_match(struct event_trigger_data *data,
 			return false;
 		if (key_field->is_signed != key_field_test->is_signed)
 			return false;
+		if (key_field->buckets != key_field_test->buckets)
+			return false;
 		if (!!key_field->var.name != !!key_field_test->var.name)
 			return false;
 		if (key_field->var.name &&
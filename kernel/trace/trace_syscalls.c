@@ -397,9 +397,13 @@ static int reg_event_syscall_enter(struct trace_event_file *file,
 	if (WARN_ON_ONCE(num < 0 || num >= NR_syscalls))
 		return -ENOSYS;
 	mutex_lock(&syscall_trace_lock);
-	if (!tr->sys_refcount_enter)
+	if (!tr->sys_refcount_enter) {
 		ret = register_trace_sys_enter(ftrace_syscall_enter, tr);
+		if (!ret)
+			sys_tracepoint_filtered_probe(true);
+	}
 	if (!ret) {
+		sys_tracepoint_filter_nr(num, true);
 		rcu_assign_pointer(tr->enter_syscall_files[num], file);
 		tr->sys_refcount_enter++;
 	}
@@ -419,8 +423,11 @@ static void unreg_event_syscall_enter(struct trace_event_file *file,
 	mutex_lock(&syscall_trace_lock);
 	tr->sys_refcount_enter--;
 	RCU_INIT_POINTER(tr->enter_syscall_files[num], NULL);
-	if (!tr->sys_refcount_enter)
+	sys_tracepoint_filter_nr(num, false);
+	if (!tr->sys_refcount_enter) {
+		sys_tracepoint_filtered_probe(false);
 		unregister_trace_sys_enter(ftrace_syscall_enter, tr);
+	}
 	mutex_unlock(&syscall_trace_lock);
 }
 
@@ -435,9 +442,13 @@ static int reg_event_syscall_exit(struct trace_event_file *file,
 	if (WARN_ON_ONCE(num < 0 || num >= NR_syscalls))
 		return -ENOSYS;
 	mutex_lock(&syscall_trace_lock);
-	if (!tr->sys_refcount_exit)
+	if (!tr->sys_refcount_exit) {
 		ret = register_trace_sys_exit(ftrace_syscall_exit, tr);
+		if (!ret)
+			sys_tracepoint_filtered_probe(true);
+	}
 	if (!ret) {
+		sys_tracepoint_filter_nr(num, true);
 		rcu_assign_pointer(tr->exit_syscall_files[num], file);
 		tr->sys_refcount_exit++;
 	}
@@ -457,8 +468,11 @@ static void unreg_event_syscall_exit(struct trace_event_file *file,
 	mutex_lock(&syscall_trace_lock);
 	tr->sys_refcount_exit--;
 	RCU_INIT_POINTER(tr->exit_syscall_files[num], NULL);
-	if (!tr->sys_refcount_exit)
+	sys_tracepoint_filter_nr(num, false);
+	if (!tr->sys_refcount_exit) {
+		sys_tracepoint_filtered_probe(false);
 		unregister_trace_sys_exit(ftrace_syscall_exit, tr);
+	}
 	mutex_unlock(&syscall_trace_lock);
 }
 
@@ -648,12 +662,16 @@ static int perf_sysenter_enable(struct trace_event_call *call)
 	num = ((struct syscall_metadata *)call->data)->syscall_nr;
 
 	mutex_lock(&syscall_trace_lock);
-	if (!sys_perf_refcount_enter)
+	if (!sys_perf_refcount_enter) {
 		ret = register_trace_sys_enter(perf_syscall_enter, NULL);
+		if (!ret)
+			sys_tracepoint_filtered_probe(true);
+	}
 	if (ret) {
 		pr_info("event trace: Could not activate syscall entry trace point");
 	} else {
 		set_bit(num, enabled_perf_enter_syscalls);
+		sys_tracepoint_filter_nr(num, true);
 		sys_perf_refcount_enter++;
 	}
 	mutex_unlock(&syscall_trace_lock);
@@ -669,8 +687,11 @@ static void perf_sysenter_disable(struct trace_event_call *call)
 	mutex_lock(&syscall_trace_lock);
 	sys_perf_refcount_enter--;
 	clear_bit(num, enabled_perf_enter_syscalls);
-	if (!sys_perf_refcount_enter)
+	sys_tracepoint_filter_nr(num, false);
+	if (!sys_perf_refcount_enter) {
+		sys_tracepoint_filtered_probe(false);
 		unregister_trace_sys_enter(perf_syscall_enter, NULL);
+	}
 	mutex_unlock(&syscall_trace_lock);
 }
 
@@ -744,12 +765,16 @@ static int perf_sysexit_enable(struct trace_event_call *call)
 	num = ((struct syscall_metadata *)call->data)->syscall_nr;
 
 	mutex_lock(&syscall_trace_lock);
-	if (!sys_perf_refcount_exit)
+	if (!sys_perf_refcount_exit) {
 		ret = register_trace_sys_exit(perf_syscall_exit, NULL);
+		if (!ret)
+			sys_tracepoint_filtered_probe(true);
+	}
 	if (ret) {
 		pr_info("event trace: Could not activate syscall exit trace point");
 	} else {
 		set_bit(num, enabled_perf_exit_syscalls);
+		sys_tracepoint_filter_nr(num, true);
 		sys_perf_refcount_exit++;
 	}
 	mutex_unlock(&syscall_trace_lock);
@@ -765,8 +790,11 @@ static void perf_sysexit_disable(struct trace_event_call *call)
 	mutex_lock(&syscall_trace_lock);
 	sys_perf_refcount_exit--;
 	clear_bit(num, enabled_perf_exit_syscalls);
-	if (!sys_perf_refcount_exit)
+	sys_tracepoint_filter_nr(num, false);
+	if (!sys_perf_refcount_exit) {
+		sys_tracepoint_filtered_probe(false);
 		unregister_trace_sys_exit(perf_syscall_exit, NULL);
+	}
 	mutex_unlock(&syscall_trace_lock);
 }
 
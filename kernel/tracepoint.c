@@ -14,6 +14,7 @@
 #include <linux/sched/signal.h>
 #include <linux/sched/task.h>
 #include <linux/static_key.h>
+#include <trace/syscall.h>
 
 enum tp_func_state {
 	TP_FUNC_0,
@@ -480,6 +481,74 @@ static int tracepoint_remove_func(struct tracepoint *tp,
 	return 0;
 }
 
+#ifdef CONFIG_HAVE_SYSCALL_TRACEPOINTS
+
+/*
+ * The syscalls:sys_{enter,exit}_* events all hang off the sys_enter and
+ * sys_exit tracepoints, with probes that filter on the syscall number. While
+ * no other probe (raw_syscalls events, BPF raw tracepoints, ...) is attached,
+ * the entry code only calls the tracepoints for the syscalls that have one of
+ * these events enabled, see sys_tracepoint_wanted().
+ *
+ * All counters are protected by tracepoints_mutex.
+ */
+static int sys_tracepoint_probes;
+static int sys_tracepoint_filtered_probes;
+static int sys_tracepoint_nr_refs[NR_syscalls];
+DECLARE_BITMAP(sys_tracepoint_mask, NR_syscalls);
+DEFINE_STATIC_KEY_FALSE(sys_tracepoint_unfiltered);
+
+static void sys_tracepoint_update_filter(void)
+{
+	if (sys_tracepoint_probes > sys_tracepoint_filtered_probes)
+		static_branch_enable(&sys_tracepoint_unfiltered);
+	else
+		static_branch_disable(&sys_tracepoint_unfiltered);
+}
+
+static void sys_tracepoint_count_probe(struct tracepoint *tp, int delta)
+{
+	if (tp->regfunc != syscall_regfunc)
+		return;
+
+	sys_tracepoint_probes += delta;
+	sys_tracepoint_update_filter();
+}
+
+/*
+ * Called by the per-syscall events right after they registered their probe
+ * and right before they unregister it, so that the filter is only active
+ * while all the probes are known to be filtering.
+ */
+void sys_tracepoint_filtered_probe(bool add)
+{
+	mutex_lock(&tracepoints_mutex);
+	sys_tracepoint_filtered_probes += add ? 1 : -1;
+	sys_tracepoint_update_filter();
+	mutex_unlock(&tracepoints_mutex);
+}
+
+void sys_tracepoint_filter_nr(int nr, bool enable)
+{
+	if (WARN_ON_ONCE(nr < 0 || nr >= NR_syscalls))
+		return;
+
+	mutex_lock(&tracepoints_mutex);
+	if (enable) {
+		if (!sys_tracepoint_nr_refs[nr]++)
+			set_bit(nr, sys_tracepoint_mask);
+	} else {
+		if (!--sys_tracepoint_nr_refs[nr])
+			clear_bit(nr, sys_tracepoint_mask);
+	}
+	mutex_unlock(&tracepoints_mutex);
+}
+#else
+static inline void sys_tracepoint_count_probe(struct tracepoint *tp, int delta)
+{
+}
+#endif
+
 /**
  * tracepoint_probe_register_prio_may_exist -  Connect a probe to a tracepoint with priority
  * @tp: tracepoint
@@ -501,6 +570,8 @@ int tracepoint_probe_register_prio_may_exist(struct tracepoint *tp, void *probe,
 	tp_func.data = data;
 	tp_func.prio = prio;
 	ret = tracepoint_add_func(tp, &tp_func, prio, false);
+	if (!ret)
+		sys_tracepoint_count_probe(tp, 1);
 	mutex_unlock(&tracepoints_mutex);
 	return ret;
 }
@@ -530,6 +601,8 @@ int tracepoint_probe_register_prio(struct tracepoint *tp, void *probe,
 	tp_func.data = data;
 	tp_func.prio = prio;
 	ret = tracepoint_add_func(tp, &tp_func, prio, true);
+	if (!ret)
+		sys_tracepoint_count_probe(tp, 1);
 	mutex_unlock(&tracepoints_mutex);
 	return ret;
 }
@@ -570,6 +643,8 @@ int tracepoint_probe_unregister(struct tracepoint *tp, void *probe, void *data)
 	tp_func.func = probe;
 	tp_func.data = data;
 	ret = tracepoint_remove_func(tp, &tp_func);
+	if (!ret)
+		sys_tracepoint_count_probe(tp, -1);
 	mutex_unlock(&tracepoints_mutex);
 	return ret;
 }
@@ -0,0 +1,150 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF struct_ops support for the readahead policy.
+ */
+
+#include <linux/types.h>
+#include <linux/bpf_verifier.h>
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+#include <linux/readahead_policy.h>
+
+static const struct btf_type *ra_policy_ctx_type;
+
+static int bpf_ra_policy_init(struct btf *btf)
+{
+	s32 type_id;
+
+	type_id = btf_find_by_name_kind(btf, "ra_policy_ctx", BTF_KIND_STRUCT);
+	if (type_id < 0)
+		return -EINVAL;
+	ra_policy_ctx_type = btf_type_by_id(btf, type_id);
+
+	return 0;
+}
+
+extern struct btf *btf_vmlinux;
+
+static bool bpf_ra_policy_is_valid_access(int off, int size,
+					  enum bpf_access_type type,
+					  const struct bpf_prog *prog,
+					  struct bpf_insn_access_aux *info)
+{
+	if (off < 0 || off >= sizeof(__u64) * MAX_BPF_FUNC_ARGS)
+		return false;
+	if (type != BPF_READ)
+		return false;
+	if (off % size != 0)
+		return false;
+
+	return btf_ctx_access(off, size, type, prog, info);
+}
+
+static int bpf_ra_policy_btf_struct_access(struct bpf_verifier_log *log,
+					   const struct btf_type *t, int off,
+					   int size, enum bpf_access_type atype,
+					   u32 *next_btf_id)
+{
+	size_t end;
+
+	if (atype == BPF_READ)
+		return btf_struct_access(log, t, off, size, atype, next_btf_id);
+
+	if (t != ra_policy_ctx_type) {
+		bpf_log(log, "only read is supported\n");
+		return -EACCES;
+	}
+
+	switch (off) {
+	case offsetof(struct ra_policy_ctx, start):
+		end = offsetofend(struct ra_policy_ctx, start);
+		break;
+	case offsetof(struct ra_policy_ctx, size):
+		end = offsetofend(struct ra_policy_ctx, size);
+		break;
+	case offsetof(struct ra_policy_ctx, async_size):
+		end = offsetofend(struct ra_policy_ctx, async_size);
+		break;
+	default:
+		bpf_log(log, "no write support to ra_policy_ctx at off %d\n",
+			off);
+		return -EACCES;
+	}
+
+	if (off + size > end) {
+		bpf_log(log,
+			"write access at off %d with size %d beyond the member of ra_policy_ctx ended at %zu\n",
+			off, size, end);
+		return -EACCES;
+	}
+
+	return NOT_INIT;
+}
+
+static const struct bpf_func_proto *
+bpf_ra_policy_get_func_proto(enum bpf_func_id func_id,
+			     const struct bpf_prog *prog)
+{
+	return bpf_base_func_proto(func_id);
+}
+
+static const struct bpf_verifier_ops bpf_ra_policy_verifier_ops = {
+	.get_func_proto		= bpf_ra_policy_get_func_proto,
+	.is_valid_access	= bpf_ra_policy_is_valid_access,
+	.btf_struct_access	= bpf_ra_policy_btf_struct_access,
+};
+
+static int bpf_ra_policy_init_member(const struct btf_type *t,
+				     const struct btf_member *member,
+				     void *kdata, const void *udata)
+{
+	const struct readahead_policy_ops *upolicy;
+	struct readahead_policy_ops *policy;
+	int prog_fd;
+	u32 moff;
+
+	upolicy = (const struct readahead_policy_ops *)udata;
+	policy = (struct readahead_policy_ops *)kdata;
+
+	moff = btf_member_bit_offset(t, member) / 8;
+	switch (moff) {
+	case offsetof(struct readahead_policy_ops, name):
+		if (bpf_obj_name_cpy(policy->name, upolicy->name,
+				     sizeof(policy->name)) <= 0)
+			return -EINVAL;
+		return 1;
+	}
+
+	if (!btf_type_resolve_func_ptr(btf_vmlinux, member->type, NULL))
+		return 0;
+
+	/* Ensure bpf_prog is provided for compulsory func ptr */
+	prog_fd = (int)(*(unsigned long *)(udata + moff));
+	if (!prog_fd)
+		return -EINVAL;
+
+	return 0;
+}
+
+static int bpf_ra_policy_reg(void *kdata)
+{
+	return readahead_register_policy(kdata);
+}
+
+static void bpf_ra_policy_unreg(void *kdata)
+{
+	readahead_unregister_policy(kdata);
+}
+
+/* Avoid sparse warning.  It is only used in bpf_struct_ops.c. */
+extern struct bpf_struct_ops bpf_readahead_policy_ops;
+
+struct bpf_struct_ops bpf_readahead_policy_ops = {
+	.verifier_ops	= &bpf_ra_policy_verifier_ops,
+	.reg		= bpf_ra_policy_reg,
+	.unreg		= bpf_ra_policy_unreg,
+	.init_member	= bpf_ra_policy_init_member,
+	.init		= bpf_ra_policy_init,
+	.name		= "readahead_policy_ops",
+};
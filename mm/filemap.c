@@ -102,8 +102,8 @@
  *    ->swap_lock		(try_to_unmap_one)
  *    ->private_lock		(try_to_unmap_one)
  *    ->i_pages lock		(try_to_unmap_one)
- *    ->pgdat->lru_lock		(follow_page->mark_page_accessed)
- *    ->pgdat->lru_lock		(check_pte_range->isolate_lru_page)
+ *    ->lruvec->lru_lock	(follow_page->mark_page_accessed)
+ *    ->lruvec->lru_lock	(check_pte_range->isolate_lru_page)
  *    ->private_lock		(page_remove_rmap->set_page_dirty)
  *    ->i_pages lock		(page_remove_rmap->set_page_dirty)
  *    bdi.wb->list_lock		(page_remove_rmap->set_page_dirty)
@@ -771,6 +771,30 @@ int file_write_and_wait_range(struct file *file, loff_t lstart, loff_t lend)
 }
 EXPORT_SYMBOL(file_write_and_wait_range);
 
+/**
+ * filemap_dontcache_write - drop the page cache behind an RWF_DONTCACHE write
+ * @iocb:	the kiocb of the write, with ki_pos already advanced
+ * @count:	number of bytes written
+ *
+ * Start writeback of the range just written and drop the pages that are
+ * already clean.  Pages still dirty or under writeback are deactivated so
+ * that they are the first to be reclaimed once writeback completes.
+ */
+void filemap_dontcache_write(struct kiocb *iocb, ssize_t count)
+{
+	struct address_space *mapping = iocb->ki_filp->f_mapping;
+	loff_t start = iocb->ki_pos - count;
+	loff_t end = iocb->ki_pos - 1;
+
+	if (iocb->ki_flags & IOCB_DIRECT)
+		return;
+
+	__filemap_fdatawrite_range(mapping, start, end, WB_SYNC_NONE);
+	invalidate_mapping_pages(mapping, start >> PAGE_SHIFT,
+				 end >> PAGE_SHIFT);
+}
+EXPORT_SYMBOL_GPL(filemap_dontcache_write);
+
 /**
  * replace_page_cache_page - replace a pagecache page with a new one
  * @old:	page to be replaced
@@ -962,6 +986,98 @@ int add_to_page_cache_lru(struct page *page, struct address_space *mapping,
 }
 EXPORT_SYMBOL_GPL(add_to_page_cache_lru);
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/*
+ * Add a THP to the page cache of a file not open for write, for readahead.
+ * Like collapse_file(), each index of the THP refers to the head page and
+ * the file is accounted in nr_thps so that opening it for write truncates
+ * the THPs.
+ */
+int add_to_page_cache_thp_lru(struct page *page, struct address_space *mapping,
+			      pgoff_t index, gfp_t gfp)
+{
+	XA_STATE_ORDER(xas, &mapping->i_pages, index, thp_order(page));
+	unsigned long nr = thp_nr_pages(page);
+	unsigned long i, nr_shadows;
+	int error;
+
+	VM_BUG_ON_PAGE(!PageTransHuge(page), page);
+	VM_BUG_ON_PAGE(index != round_down(index, nr), page);
+	VM_BUG_ON_PAGE(PageSwapBacked(page), page);
+	mapping_set_update(&xas, mapping);
+
+	__SetPageLocked(page);
+	page_ref_add(page, nr);
+	page->mapping = mapping;
+	page->index = index;
+
+	error = mem_cgroup_charge(page, current->mm, gfp);
+	if (error)
+		goto error;
+
+	gfp &= GFP_RECLAIM_MASK;
+
+	do {
+		void *entry;
+
+		nr_shadows = 0;
+		xas_lock_irq(&xas);
+		/* shadow entries are dropped, the THP is not a refault */
+		xas_for_each_conflict(&xas, entry) {
+			if (!xa_is_value(entry)) {
+				xas_set_err(&xas, -EEXIST);
+				goto unlock;
+			}
+			nr_shadows++;
+		}
+		xas_create_range(&xas);
+		if (xas_error(&xas))
+			goto unlock;
+
+		filemap_nr_thps_inc(mapping);
+		/*
+		 * Pairs with the fully ordered i_writecount increment done by
+		 * do_dentry_open() before it checks nr_thps: either it
+		 * truncates the THP or we see the writer here.
+		 */
+		smp_mb();
+		if (inode_is_open_for_write(mapping->host)) {
+			filemap_nr_thps_dec(mapping);
+			xas_set_err(&xas, -ETXTBSY);
+			goto unlock;
+		}
+
+		for (i = 0; i < nr; i++) {
+			if (i)
+				xas_next(&xas);
+			xas_store(&xas, page);
+		}
+		mapping->nrexceptional -= nr_shadows;
+		mapping->nrpages += nr;
+		__mod_lruvec_page_state(page, NR_FILE_PAGES, nr);
+		__inc_node_page_state(page, NR_FILE_THPS);
+unlock:
+		xas_unlock_irq(&xas);
+	} while (xas_nomem(&xas, gfp));
+
+	if (xas_error(&xas)) {
+		error = xas_error(&xas);
+		mem_cgroup_uncharge(page);
+		goto error;
+	}
+
+	trace_mm_filemap_add_to_page_cache(page);
+	count_vm_event(THP_FILE_ALLOC);
+	lru_cache_add(page);
+	return 0;
+error:
+	page->mapping = NULL;
+	page_ref_sub(page, nr);
+	__ClearPageLocked(page);
+	return error;
+}
+#endif /* CONFIG_READ_ONLY_THP_FOR_FS */
+
 #ifdef CONFIG_NUMA
 struct page *__page_cache_alloc(gfp_t gfp)
 {
@@ -2195,6 +2311,7 @@ ssize_t generic_file_buffered_read(struct kiocb *iocb,
 	struct file_ra_state *ra = &filp->f_ra;
 	loff_t *ppos = &iocb->ki_pos;
 	pgoff_t index;
+	pgoff_t first_index;
 	pgoff_t last_index;
 	pgoff_t prev_index;
 	unsigned long offset;      /* offset into pagecache page */
@@ -2206,6 +2323,7 @@ ssize_t generic_file_buffered_read(struct kiocb *iocb,
 	iov_iter_truncate(iter, inode->i_sb->s_maxbytes);
 
 	index = *ppos >> PAGE_SHIFT;
+	first_index = index;
 	prev_index = ra->prev_pos >> PAGE_SHIFT;
 	prev_offset = ra->prev_pos & (PAGE_SIZE-1);
 	last_index = (*ppos + iter->count + PAGE_SIZE-1) >> PAGE_SHIFT;
@@ -2478,6 +2596,9 @@ ssize_t generic_file_buffered_read(struct kiocb *iocb,
 
 	*ppos = ((loff_t)index << PAGE_SHIFT) + offset;
 	file_accessed(filp);
+	/* Drop the pages we have finished with, like POSIX_FADV_DONTNEED */
+	if ((iocb->ki_flags & IOCB_DONTCACHE) && index > first_index)
+		invalidate_mapping_pages(mapping, first_index, index - 1);
 	return written ? written : error;
 }
 EXPORT_SYMBOL_GPL(generic_file_buffered_read);
@@ -2597,7 +2718,7 @@ static int lock_page_maybe_drop_mmap(struct vm_fault *vmf, struct page *page,
 			 * mmap_lock here and return 0 if we don't have a fpin.
 			 */
 			if (*fpin == NULL)
-				mmap_read_unlock(vmf->vma->vm_mm);
+				release_fault_lock(vmf);
 			return 0;
 		}
 	} else
@@ -42,6 +42,7 @@
 #include <linux/userfaultfd_k.h>
 #include <linux/page_owner.h>
 #include "internal.h"
+#include "hugetlb_vmemmap.h"
 
 int hugetlb_max_hstate __read_mostly;
 unsigned int default_hstate_idx;
@@ -94,6 +95,32 @@ static inline void ClearPageHugeFreed(struct page *head)
 	set_page_private(head + 4, 0);
 }
 
+/* The page was cleared by hugetlb_zero_workfn() and not used since. */
+static inline bool PageHugeZeroed(struct page *head)
+{
+	return page_private(head + 6) == -1UL;
+}
+
+static inline void SetPageHugeZeroed(struct page *head)
+{
+	set_page_private(head + 6, -1UL);
+}
+
+static inline void ClearPageHugeZeroed(struct page *head)
+{
+	set_page_private(head + 6, 0);
+}
+
+/* Per-node work items that zero free huge pages, see hugetlb_zero_workfn() */
+static struct work_struct *hugetlb_zero_works;
+
+static void hugetlb_zero_kick(int nid)
+{
+	if (hugetlb_zero_works)
+		queue_work_node(nid, system_unbound_wq,
+				&hugetlb_zero_works[nid]);
+}
+
 /* Forward declaration */
 static int hugetlb_acct_memory(struct hstate *h, long delta);
 
@@ -1068,12 +1095,33 @@ static bool vma_has_reserves(struct vm_area_struct *vma, long chg)
 static void enqueue_huge_page(struct hstate *h, struct page *page)
 {
 	int nid = page_to_nid(page);
-	list_move(&page->lru, &h->hugepage_freelists[nid]);
+
+	/*
+	 * Keep the pages still to be zeroed at the tail of the list, so that
+	 * dequeue_huge_page_node_exact() prefers the zeroed ones.
+	 */
+	if (READ_ONCE(h->zero_free_pages) && !PageHugeZeroed(page)) {
+		list_move_tail(&page->lru, &h->hugepage_freelists[nid]);
+		hugetlb_zero_kick(nid);
+	} else {
+		list_move(&page->lru, &h->hugepage_freelists[nid]);
+	}
 	h->free_huge_pages++;
 	h->free_huge_pages_node[nid]++;
 	SetPageHugeFreed(page);
 }
 
+static void __dequeue_huge_page(struct hstate *h, struct page *page)
+{
+	int nid = page_to_nid(page);
+
+	list_move(&page->lru, &h->hugepage_activelist);
+	set_page_refcounted(page);
+	ClearPageHugeFreed(page);
+	h->free_huge_pages--;
+	h->free_huge_pages_node[nid]--;
+}
+
 static struct page *dequeue_huge_page_node_exact(struct hstate *h, int nid)
 {
 	struct page *page;
@@ -1086,11 +1134,7 @@ static struct page *dequeue_huge_page_node_exact(struct hstate *h, int nid)
 		if (PageHWPoison(page))
 			continue;
 
-		list_move(&page->lru, &h->hugepage_activelist);
-		set_page_refcounted(page);
-		ClearPageHugeFreed(page);
-		h->free_huge_pages--;
-		h->free_huge_pages_node[nid]--;
+		__dequeue_huge_page(h, page);
 		return page;
 	}
 
@@ -1334,16 +1378,11 @@ static inline void destroy_compound_gigantic_page(struct page *page,
 						unsigned int order) { }
 #endif
 
-static void update_and_free_page(struct hstate *h, struct page *page)
+static void __update_and_free_page(struct hstate *h, struct page *page)
 {
 	int i;
 	struct page *subpage = page;
 
-	if (hstate_is_gigantic(h) && !gigantic_page_runtime_supported())
-		return;
-
-	h->nr_huge_pages--;
-	h->nr_huge_pages_node[page_to_nid(page)]--;
 	for (i = 0; i < pages_per_huge_page(h);
 	     i++, subpage = mem_map_next(subpage, page, i)) {
 		subpage->flags &= ~(1 << PG_locked | 1 << PG_error |
@@ -1369,6 +1408,96 @@ static void update_and_free_page(struct hstate *h, struct page *page)
 	}
 }
 
+/*
+ * The tail struct pages are written to when the page is freed, so the
+ * vmemmap pages freed by free_huge_page_vmemmap() have to be allocated
+ * again first.  If that fails, the page is put back into the pool as a
+ * surplus page and false is returned.
+ *
+ * Called with hugetlb_lock held, which is dropped for the allocation.
+ * The page must not be on any list.
+ */
+static bool update_and_free_page_vmemmap(struct hstate *h, struct page *page)
+{
+	int nid = page_to_nid(page);
+	int ret;
+
+	if (!PageHugeVmemmapOptimized(page))
+		return true;
+
+	spin_unlock(&hugetlb_lock);
+	ret = alloc_huge_page_vmemmap(h, page);
+	spin_lock(&hugetlb_lock);
+	if (!ret)
+		return true;
+
+	h->nr_huge_pages++;
+	h->nr_huge_pages_node[nid]++;
+	h->surplus_huge_pages++;
+	h->surplus_huge_pages_node[nid]++;
+	INIT_LIST_HEAD(&page->lru);
+	enqueue_huge_page(h, page);
+	return false;
+}
+
+/*
+ * Pages whose vmemmap has to be restored before they can be freed, but
+ * which were released from a context that cannot sleep.  Like in
+ * free_huge_page(), page->mapping is reused as the llist_node.
+ */
+static LLIST_HEAD(hpage_update_freelist);
+
+static void update_hpage_vmemmap_workfn(struct work_struct *work)
+{
+	struct llist_node *node;
+
+	node = llist_del_all(&hpage_update_freelist);
+
+	while (node) {
+		struct page *page;
+		struct hstate *h;
+
+		page = container_of((struct address_space **)node,
+				     struct page, mapping);
+		node = node->next;
+		page->mapping = NULL;
+		h = page_hstate(page);
+
+		spin_lock(&hugetlb_lock);
+		if (update_and_free_page_vmemmap(h, page))
+			__update_and_free_page(h, page);
+		spin_unlock(&hugetlb_lock);
+
+		cond_resched();
+	}
+}
+static DECLARE_WORK(update_hpage_vmemmap_work, update_hpage_vmemmap_workfn);
+
+/*
+ * Called with hugetlb_lock held.  If @atomic is set, the caller cannot
+ * sleep and a page whose vmemmap has to be restored is freed from a
+ * workqueue instead.
+ */
+static void update_and_free_page(struct hstate *h, struct page *page,
+				 bool atomic)
+{
+	if (hstate_is_gigantic(h) && !gigantic_page_runtime_supported())
+		return;
+
+	h->nr_huge_pages--;
+	h->nr_huge_pages_node[page_to_nid(page)]--;
+
+	if (atomic && PageHugeVmemmapOptimized(page)) {
+		if (llist_add((struct llist_node *)&page->mapping,
+			      &hpage_update_freelist))
+			schedule_work(&update_hpage_vmemmap_work);
+		return;
+	}
+
+	if (update_and_free_page_vmemmap(h, page))
+		__update_and_free_page(h, page);
+}
+
 struct hstate *size_to_hstate(unsigned long size)
 {
 	struct hstate *h;
@@ -1477,15 +1606,16 @@ static void __free_huge_page(struct page *page)
 	if (PageHugeTemporary(page)) {
 		list_del(&page->lru);
 		ClearPageHugeTemporary(page);
-		update_and_free_page(h, page);
+		update_and_free_page(h, page, true);
 	} else if (h->surplus_huge_pages_node[nid]) {
 		/* remove the page from active list */
 		list_del(&page->lru);
-		update_and_free_page(h, page);
+		update_and_free_page(h, page, true);
 		h->surplus_huge_pages--;
 		h->surplus_huge_pages_node[nid]--;
 	} else {
 		arch_clear_hugepage_flags(page);
+		ClearPageHugeZeroed(page);
 		enqueue_huge_page(h, page);
 	}
 	spin_unlock(&hugetlb_lock);
@@ -1539,8 +1669,101 @@ void free_huge_page(struct page *page)
 	__free_huge_page(page);
 }
 
+/*
+ * Clearing a gigantic page takes the faulting task hundreds of milliseconds.
+ * With zero_free_hugepages set, free pages are cleared in the background by
+ * an unbound worker on their home node instead, and faults handed such a page
+ * skip clear_huge_page().
+ *
+ * While being cleared the page is taken off the free list like an allocated
+ * page, so the pool never lends out a page that backs a reservation.
+ */
+static struct page *hugetlb_zero_isolate(struct hstate *h, int nid)
+{
+	struct page *page;
+
+	spin_lock(&hugetlb_lock);
+	if (h->free_huge_pages - h->resv_huge_pages == 0)
+		goto out;
+
+	/* See enqueue_huge_page(), the pages still to be zeroed are last */
+	list_for_each_entry_reverse(page, &h->hugepage_freelists[nid], lru) {
+		if (PageHugeZeroed(page))
+			break;
+		if (PageHWPoison(page))
+			continue;
+
+		__dequeue_huge_page(h, page);
+		spin_unlock(&hugetlb_lock);
+		return page;
+	}
+out:
+	spin_unlock(&hugetlb_lock);
+	return NULL;
+}
+
+/* Put a page cleared by hugetlb_zero_workfn() back, like __free_huge_page() */
+static void hugetlb_zero_putback(struct hstate *h, struct page *page)
+{
+	int nid = page_to_nid(page);
+
+	/* Somebody raced with a speculative reference, let them free it */
+	if (!put_page_testzero(page))
+		return;
+
+	spin_lock(&hugetlb_lock);
+	if (h->surplus_huge_pages_node[nid]) {
+		list_del(&page->lru);
+		update_and_free_page(h, page, true);
+		h->surplus_huge_pages--;
+		h->surplus_huge_pages_node[nid]--;
+	} else {
+		SetPageHugeZeroed(page);
+		enqueue_huge_page(h, page);
+	}
+	spin_unlock(&hugetlb_lock);
+}
+
+static void hugetlb_zero_workfn(struct work_struct *work)
+{
+	int nid = work - hugetlb_zero_works;
+	struct hstate *h;
+	struct page *page;
+
+	for_each_hstate(h) {
+		while (READ_ONCE(h->zero_free_pages)) {
+			page = hugetlb_zero_isolate(h, nid);
+			if (!page)
+				break;
+			clear_huge_page(page, 0, pages_per_huge_page(h));
+			hugetlb_zero_putback(h, page);
+			cond_resched();
+		}
+	}
+}
+
+/**
+ * hugetlb_clear_page - clear a newly allocated huge page for user space
+ * @h: hstate of @page
+ * @page: the page returned by alloc_huge_page()
+ * @addr: user address @page is going to be mapped at
+ *
+ * Pages zeroed ahead of time by hugetlb_zero_workfn() are left alone.
+ */
+void hugetlb_clear_page(struct hstate *h, struct page *page,
+			unsigned long addr)
+{
+	if (PageHugeZeroed(page)) {
+		ClearPageHugeZeroed(page);
+		return;
+	}
+	clear_huge_page(page, addr, pages_per_huge_page(h));
+}
+
 static void prep_new_huge_page(struct hstate *h, struct page *page, int nid)
 {
+	ClearPageHugeVmemmapOptimized(page);
+	free_huge_page_vmemmap(h, page);
 	INIT_LIST_HEAD(&page->lru);
 	set_compound_page_dtor(page, HUGETLB_PAGE_DTOR);
 	set_hugetlb_cgroup(page, NULL);
@@ -1549,6 +1772,7 @@ static void prep_new_huge_page(struct hstate *h, struct page *page, int nid)
 	h->nr_huge_pages++;
 	h->nr_huge_pages_node[nid]++;
 	ClearPageHugeFreed(page);
+	ClearPageHugeZeroed(page);
 	spin_unlock(&hugetlb_lock);
 }
 
@@ -1771,7 +1995,7 @@ static int free_pool_huge_page(struct hstate *h, nodemask_t *nodes_allowed,
 				h->surplus_huge_pages--;
 				h->surplus_huge_pages_node[node]--;
 			}
-			update_and_free_page(h, page);
+			update_and_free_page(h, page, false);
 			ret = 1;
 			break;
 		}
@@ -1787,6 +2011,7 @@ static int free_pool_huge_page(struct hstate *h, nodemask_t *nodes_allowed,
  *
  *  -EBUSY: failed to dissolved free hugepages or the hugepage is in-use
  *          (allocated or reserved.)
+ *  -ENOMEM: failed to allocate the vmemmap pages of the hugepage
  *       0: successfully dissolved free hugepages or the page is not a
  *          hugepage (considered as already dissolved)
  */
@@ -1831,6 +2056,26 @@ int dissolve_free_huge_page(struct page *page)
 			goto retry;
 		}
 
+		list_del(&head->lru);
+		h->free_huge_pages--;
+		h->free_huge_pages_node[nid]--;
+
+		/*
+		 * The tail struct pages have to be writable before the
+		 * PageHWPoison flag can be moved to one of them.  The page is
+		 * off the free list, so nobody else can get at it meanwhile.
+		 */
+		if (PageHugeVmemmapOptimized(head)) {
+			spin_unlock(&hugetlb_lock);
+			rc = alloc_huge_page_vmemmap(h, head);
+			spin_lock(&hugetlb_lock);
+			if (rc) {
+				INIT_LIST_HEAD(&head->lru);
+				enqueue_huge_page(h, head);
+				goto out;
+			}
+		}
+
 		/*
 		 * Move PageHWPoison flag from head page to the raw error page,
 		 * which makes any subpages rather than the error page reusable.
@@ -1839,11 +2084,8 @@ int dissolve_free_huge_page(struct page *page)
 			SetPageHWPoison(page);
 			ClearPageHWPoison(head);
 		}
-		list_del(&head->lru);
-		h->free_huge_pages--;
-		h->free_huge_pages_node[nid]--;
 		h->max_huge_pages--;
-		update_and_free_page(h, head);
+		update_and_free_page(h, head, false);
 		rc = 0;
 	}
 out:
@@ -2592,17 +2834,20 @@ static void try_to_free_low(struct hstate *h, unsigned long count,
 		return;
 
 	for_each_node_mask(i, *nodes_allowed) {
-		struct page *page, *next;
+		struct page *page;
 		struct list_head *freel = &h->hugepage_freelists[i];
-		list_for_each_entry_safe(page, next, freel, lru) {
+retry:
+		list_for_each_entry(page, freel, lru) {
 			if (count >= h->nr_huge_pages)
 				return;
 			if (PageHighMem(page))
 				continue;
 			list_del(&page->lru);
-			update_and_free_page(h, page);
 			h->free_huge_pages--;
 			h->free_huge_pages_node[page_to_nid(page)]--;
+			/* hugetlb_lock may have been dropped, start over */
+			update_and_free_page(h, page, false);
+			goto retry;
 		}
 	}
 }
@@ -2971,12 +3216,45 @@ static ssize_t surplus_hugepages_show(struct kobject *kobj,
 }
 HSTATE_ATTR_RO(surplus_hugepages);
 
+static ssize_t zero_free_hugepages_show(struct kobject *kobj,
+					struct kobj_attribute *attr, char *buf)
+{
+	struct hstate *h = kobj_to_hstate(kobj, NULL);
+
+	return sprintf(buf, "%d\n", READ_ONCE(h->zero_free_pages));
+}
+
+static ssize_t zero_free_hugepages_store(struct kobject *kobj,
+					 struct kobj_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct hstate *h = kobj_to_hstate(kobj, NULL);
+	bool enable;
+	int nid;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+	if (enable && !hugetlb_zero_works)
+		return -ENOMEM;
+
+	WRITE_ONCE(h->zero_free_pages, enable);
+	if (enable) {
+		for_each_node_state(nid, N_MEMORY)
+			hugetlb_zero_kick(nid);
+	}
+	return count;
+}
+HSTATE_ATTR(zero_free_hugepages);
+
 static struct attribute *hstate_attrs[] = {
 	&nr_hugepages_attr.attr,
 	&nr_overcommit_hugepages_attr.attr,
 	&free_hugepages_attr.attr,
 	&resv_hugepages_attr.attr,
 	&surplus_hugepages_attr.attr,
+	&zero_free_hugepages_attr.attr,
 #ifdef CONFIG_NUMA
 	&nr_hugepages_mempolicy_attr.attr,
 #endif
@@ -3214,6 +3492,13 @@ static int __init hugetlb_init(void)
 	gather_bootmem_prealloc();
 	report_hugepages();
 
+	hugetlb_zero_works = kcalloc(nr_node_ids, sizeof(*hugetlb_zero_works),
+				     GFP_KERNEL);
+	if (hugetlb_zero_works) {
+		for (i = 0; i < nr_node_ids; i++)
+			INIT_WORK(&hugetlb_zero_works[i], hugetlb_zero_workfn);
+	}
+
 	hugetlb_sysfs_init();
 	hugetlb_register_all_nodes();
 	hugetlb_cgroup_file_init();
@@ -3262,6 +3547,7 @@ void __init hugetlb_add_hstate(unsigned int order)
 	h->next_nid_to_free = first_memory_node;
 	snprintf(h->name, HSTATE_NAME_LEN, "hugepages-%lukB",
 					huge_page_size(h)/1024);
+	hugetlb_vmemmap_init(h);
 
 	parsed_hstate = h;
 }
@@ -4323,6 +4609,43 @@ int huge_add_to_page_cache(struct page *page, struct address_space *mapping,
 	return 0;
 }
 
+static inline vm_fault_t hugetlb_handle_userfault(struct vm_area_struct *vma,
+						  struct address_space *mapping,
+						  pgoff_t idx,
+						  unsigned int flags,
+						  unsigned long haddr,
+						  unsigned long reason)
+{
+	vm_fault_t ret;
+	u32 hash;
+	struct vm_fault vmf = {
+		.vma = vma,
+		.address = haddr,
+		.flags = flags,
+		/*
+		 * Hard to debug if it ends up being
+		 * used by a callee that assumes
+		 * something about the other
+		 * uninitialized fields... same as in
+		 * memory.c
+		 */
+	};
+
+	/*
+	 * hugetlb_fault_mutex and i_mmap_rwsem must be
+	 * dropped before handling userfault.  Reacquire
+	 * after handling fault to make calling code simpler.
+	 */
+	hash = hugetlb_fault_mutex_hash(mapping, idx);
+	mutex_unlock(&hugetlb_fault_mutex_table[hash]);
+	i_mmap_unlock_read(mapping);
+	ret = handle_userfault(&vmf, reason);
+	i_mmap_lock_read(mapping);
+	mutex_lock(&hugetlb_fault_mutex_table[hash]);
+
+	return ret;
+}
+
 static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 			struct vm_area_struct *vma,
 			struct address_space *mapping, pgoff_t idx,
@@ -4365,31 +4688,9 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 		 * Check for page in userfault range
 		 */
 		if (userfaultfd_missing(vma)) {
-			u32 hash;
-			struct vm_fault vmf = {
-				.vma = vma,
-				.address = haddr,
-				.flags = flags,
-				/*
-				 * Hard to debug if it ends up being
-				 * used by a callee that assumes
-				 * something about the other
-				 * uninitialized fields... same as in
-				 * memory.c
-				 */
-			};
-
-			/*
-			 * hugetlb_fault_mutex and i_mmap_rwsem must be
-			 * dropped before handling userfault.  Reacquire
-			 * after handling fault to make calling code simpler.
-			 */
-			hash = hugetlb_fault_mutex_hash(mapping, idx);
-			mutex_unlock(&hugetlb_fault_mutex_table[hash]);
-			i_mmap_unlock_read(mapping);
-			ret = handle_userfault(&vmf, VM_UFFD_MISSING);
-			i_mmap_lock_read(mapping);
-			mutex_lock(&hugetlb_fault_mutex_table[hash]);
+			ret = hugetlb_handle_userfault(vma, mapping, idx,
+						       flags, haddr,
+						       VM_UFFD_MISSING);
 			goto out;
 		}
 
@@ -4417,7 +4718,7 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 			ret = vmf_error(PTR_ERR(page));
 			goto out;
 		}
-		clear_huge_page(page, address, pages_per_huge_page(h));
+		hugetlb_clear_page(h, page, address);
 		__SetPageUptodate(page);
 		new_page = true;
 
@@ -4448,6 +4749,16 @@ static vm_fault_t hugetlb_no_page(struct mm_struct *mm,
 				VM_FAULT_SET_HINDEX(hstate_index(h));
 			goto backout_unlocked;
 		}
+
+		/* Check for page in userfault range. */
+		if (userfaultfd_minor(vma)) {
+			unlock_page(page);
+			put_page(page);
+			ret = hugetlb_handle_userfault(vma, mapping, idx,
+						       flags, haddr,
+						       VM_UFFD_MINOR);
+			goto out;
+		}
 	}
 
 	/*
@@ -4688,17 +4999,20 @@ vm_fault_t hugetlb_fault(struct mm_struct *mm, struct vm_area_struct *vma,
 	return ret;
 }
 
+#ifdef CONFIG_USERFAULTFD
 /*
- * Used by userfaultfd UFFDIO_COPY.  Based on mcopy_atomic_pte with
- * modifications for huge pages.
+ * Used by userfaultfd UFFDIO_COPY and UFFDIO_CONTINUE.  Based on
+ * mcopy_atomic_pte with modifications for huge pages.
  */
 int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 			    pte_t *dst_pte,
 			    struct vm_area_struct *dst_vma,
 			    unsigned long dst_addr,
 			    unsigned long src_addr,
+			    enum mcopy_atomic_mode mode,
 			    struct page **pagep)
 {
+	bool is_continue = (mode == MCOPY_ATOMIC_CONTINUE);
 	struct address_space *mapping;
 	pgoff_t idx;
 	unsigned long size;
@@ -4708,8 +5022,17 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	spinlock_t *ptl;
 	int ret;
 	struct page *page;
+	int writable;
+
+	mapping = dst_vma->vm_file->f_mapping;
+	idx = vma_hugecache_offset(h, dst_vma, dst_addr);
 
-	if (!*pagep) {
+	if (is_continue) {
+		ret = -EFAULT;
+		page = find_lock_page(mapping, idx);
+		if (!page)
+			goto out;
+	} else if (!*pagep) {
 		/* If a page already exists, then it's UFFDIO_COPY for
 		 * a non-missing case. Return -EEXIST.
 		 */
@@ -4748,13 +5071,8 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	 */
 	__SetPageUptodate(page);
 
-	mapping = dst_vma->vm_file->f_mapping;
-	idx = vma_hugecache_offset(h, dst_vma, dst_addr);
-
-	/*
-	 * If shared, add to page cache
-	 */
-	if (vm_shared) {
+	/* Add shared, newly allocated pages to the page cache. */
+	if (vm_shared && !is_continue) {
 		size = i_size_read(mapping->host) >> huge_page_shift(h);
 		ret = -EFAULT;
 		if (idx >= size)
@@ -4792,15 +5110,22 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	if (!huge_pte_none(huge_ptep_get(dst_pte)))
 		goto out_release_unlock;
 
-	if (vm_shared) {
+	/* A page cache page is mapped as such, and CoW'ed on write */
+	if (vm_shared || is_continue) {
 		page_dup_rmap(page, true);
 	} else {
 		ClearPagePrivate(page);
 		hugepage_add_new_anon_rmap(page, dst_vma, dst_addr);
 	}
 
-	_dst_pte = make_huge_pte(dst_vma, page, dst_vma->vm_flags & VM_WRITE);
-	if (dst_vma->vm_flags & VM_WRITE)
+	/* For CONTINUE on a non-shared VMA, don't set VM_WRITE for CoW. */
+	if (is_continue && !vm_shared)
+		writable = 0;
+	else
+		writable = dst_vma->vm_flags & VM_WRITE;
+
+	_dst_pte = make_huge_pte(dst_vma, page, writable);
+	if (writable)
 		_dst_pte = huge_pte_mkdirty(_dst_pte);
 	_dst_pte = pte_mkyoung(_dst_pte);
 
@@ -4814,20 +5139,22 @@ int hugetlb_mcopy_atomic_pte(struct mm_struct *dst_mm,
 	update_mmu_cache(dst_vma, dst_addr, dst_pte);
 
 	spin_unlock(ptl);
-	set_page_huge_active(page);
-	if (vm_shared)
+	if (!is_continue)
+		set_page_huge_active(page);
+	if (vm_shared || is_continue)
 		unlock_page(page);
 	ret = 0;
 out:
 	return ret;
 out_release_unlock:
 	spin_unlock(ptl);
-	if (vm_shared)
+	if (vm_shared || is_continue)
 		unlock_page(page);
 out_release_nounlock:
 	put_page(page);
 	goto out;
 }
+#endif /* CONFIG_USERFAULTFD */
 
 long follow_hugetlb_page(struct mm_struct *mm, struct vm_area_struct *vma,
 			 struct page **pages, struct vm_area_struct **vmas,
@@ -819,9 +819,9 @@ static int kasan_depopulate_vmalloc_pte(pte_t *ptep, unsigned long addr,
  * Release the backing for the vmalloc region [start, end), which
  * lies within the free region [free_region_start, free_region_end).
  *
- * This can be run lazily, long after the region was freed. It runs
- * under vmap_area_lock, so it's not safe to interact with the vmalloc/vmap
- * infrastructure.
+ * This can be run lazily, long after the region was freed. It may run
+ * under free_vmap_area_lock, so it's not safe to interact with the
+ * vmalloc/vmap infrastructure.
  *
  * How does this work?
  * -------------------
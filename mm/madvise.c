@@ -29,7 +29,9 @@
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
 #include <linux/mmu_notifier.h>
+#include <linux/rmap.h>
 
+#include <asm/pgalloc.h>
 #include <asm/tlb.h>
 
 #include "internal.h"
@@ -53,6 +55,9 @@ static int madvise_need_mmap_write(int behavior)
 	case MADV_COLD:
 	case MADV_PAGEOUT:
 	case MADV_FREE:
+	case MADV_POPULATE_READ:
+	case MADV_POPULATE_WRITE:
+	case MADV_COLLAPSE:
 		return 0;
 	default:
 		/* be safe, default to 1. list exceptions explicitly */
@@ -168,6 +173,7 @@ static long madvise_behavior(struct vm_area_struct *vma,
 	/*
 	 * vm_flags is protected by the mmap_lock held in write mode.
 	 */
+	vma_start_write(vma);
 	vma->vm_flags = new_flags;
 
 out_convert_errno:
@@ -685,12 +691,8 @@ static int madvise_free_pte_range(pmd_t *pmd, unsigned long addr,
 		mark_page_lazyfree(page);
 	}
 out:
-	if (nr_swap) {
-		if (current->mm == mm)
-			sync_mm_rss(mm);
-
+	if (nr_swap)
 		add_mm_counter(mm, MM_SWAPENTS, nr_swap);
-	}
 	arch_leave_lazy_mmu_mode();
 	pte_unmap_unlock(orig_pte, ptl);
 	cond_resched();
@@ -821,6 +823,147 @@ static long madvise_dontneed_free(struct vm_area_struct *vma,
 		return -EINVAL;
 }
 
+/*
+ * Free the PTE table at @pmd if it maps nothing at all any more.  The
+ * caller excludes page faults and rmap walks of the vma, and @tlb defers
+ * freeing the table until the TLB (and lockless GUP) cannot see it.
+ */
+static bool madvise_free_pte_table(struct mmu_gather *tlb,
+				   struct vm_area_struct *vma,
+				   pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	spinlock_t *pml, *ptl;
+	pte_t *start_pte, *pte;
+	pmd_t pmdval;
+	int i;
+
+	pml = pmd_lock(mm, pmd);
+	start_pte = pte = pte_offset_map(pmd, addr);
+	ptl = pte_lockptr(mm, pmd);
+	if (ptl != pml)
+		spin_lock_nested(ptl, SINGLE_DEPTH_NESTING);
+
+	for (i = 0; i < PTRS_PER_PTE; i++, pte++)
+		if (!pte_none(*pte))
+			break;
+	if (i == PTRS_PER_PTE) {
+		pmdval = *pmd;
+		pmd_clear(pmd);
+	}
+
+	if (ptl != pml)
+		spin_unlock(ptl);
+	pte_unmap(start_pte);
+	spin_unlock(pml);
+
+	if (i < PTRS_PER_PTE)
+		return false;
+
+	pte_free_tlb(tlb, pmd_pgtable(pmdval), addr);
+	mm_dec_nr_ptes(mm);
+	return true;
+}
+
+static bool madvise_pte_table_empty(struct mm_struct *mm, pmd_t *pmd,
+				    unsigned long addr)
+{
+	pte_t *start_pte, *pte;
+	spinlock_t *ptl;
+	int i;
+
+	start_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	for (i = 0; i < PTRS_PER_PTE; i++, pte++)
+		if (!pte_none(*pte))
+			break;
+	pte_unmap_unlock(start_pte, ptl);
+
+	return i == PTRS_PER_PTE;
+}
+
+/*
+ * Walk the PTE tables covering [start, end) that only map a single vma,
+ * as a table shared with a neighbouring vma is left to munmap.  Without
+ * @tlb, only tell whether any of them is empty: that is safe under the
+ * mmap_lock held for read, as nothing frees PTE tables then.  With @tlb,
+ * free the empty ones: the caller holds the mmap_lock for write.
+ */
+static bool madvise_walk_pte_tables(struct mmu_gather *tlb,
+				    struct mm_struct *mm,
+				    unsigned long start, unsigned long end)
+{
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	bool found = false;
+	pmd_t *pmd;
+
+	for (vma = find_vma(mm, start); vma && vma->vm_start < end;
+	     vma = vma->vm_next) {
+		addr = max(ALIGN_DOWN(start, PMD_SIZE),
+			   ALIGN(vma->vm_start, PMD_SIZE));
+		if (addr + PMD_SIZE > vma->vm_end || addr >= end)
+			continue;
+		if (!can_madv_lru_vma(vma))
+			continue;
+
+		if (tlb) {
+			/* Exclude page faults and then rmap walkers */
+			vma_start_write(vma);
+			if (vma->vm_file)
+				i_mmap_lock_write(vma->vm_file->f_mapping);
+			if (vma->anon_vma)
+				anon_vma_lock_write(vma->anon_vma);
+		}
+
+		for (; addr + PMD_SIZE <= vma->vm_end && addr < end;
+		     addr += PMD_SIZE) {
+			pmd = mm_find_pmd(mm, addr);
+			if (!pmd)
+				continue;
+			if (tlb) {
+				found |= madvise_free_pte_table(tlb, vma,
+								pmd, addr);
+			} else if (madvise_pte_table_empty(mm, pmd, addr)) {
+				found = true;
+				break;
+			}
+		}
+
+		if (tlb) {
+			if (vma->anon_vma)
+				anon_vma_unlock_write(vma->anon_vma);
+			if (vma->vm_file)
+				i_mmap_unlock_write(vma->vm_file->f_mapping);
+		} else if (found) {
+			break;
+		}
+	}
+
+	return found;
+}
+
+/*
+ * MADV_DONTNEED leaves the PTE tables of the zapped range in place, and
+ * allocators returning memory that way keep piling up empty ones.  Free
+ * them if the mmap_lock can be taken for write without waiting: faults
+ * and most page table walkers only hold it for read and do not expect a
+ * PTE table to go away under them.
+ */
+static void madvise_reclaim_pte_tables(struct mm_struct *mm,
+				       unsigned long start, unsigned long end)
+{
+	struct mmu_gather tlb;
+
+	if (!mmap_write_trylock(mm))
+		return;
+
+	tlb_gather_mmu(&tlb, mm, start, end);
+	madvise_walk_pte_tables(&tlb, mm, start, end);
+	tlb_finish_mmu(&tlb, start, end);
+
+	mmap_write_unlock(mm);
+}
+
 /*
  * Application wants to free up the pages and associated backing store.
  * This is effectively punching a hole into the middle of a file.
@@ -923,6 +1066,63 @@ static int madvise_inject_error(int behavior,
 }
 #endif
 
+static long madvise_populate(struct vm_area_struct *vma,
+			     struct vm_area_struct **prev,
+			     unsigned long start, unsigned long end,
+			     int behavior)
+{
+	const bool write = behavior == MADV_POPULATE_WRITE;
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long tmp_end;
+	int locked = 1;
+	long pages;
+
+	*prev = vma;
+
+	while (start < end) {
+		/*
+		 * We might have temporarily dropped the lock. For example,
+		 * our VMA might have been split.
+		 */
+		if (!vma || start >= vma->vm_end) {
+			vma = find_vma(mm, start);
+			if (!vma || start < vma->vm_start)
+				return -ENOMEM;
+		}
+
+		tmp_end = min_t(unsigned long, end, vma->vm_end);
+		/* Populate (prefault) page tables readable/writable. */
+		pages = faultin_vma_page_range(vma, start, tmp_end, write,
+					       &locked);
+		if (!locked) {
+			mmap_read_lock(mm);
+			locked = 1;
+			*prev = NULL;
+			vma = NULL;
+		}
+		if (pages < 0) {
+			switch (pages) {
+			case -EINTR:
+				return -EINTR;
+			case -EINVAL: /* Incompatible mappings / permissions. */
+				return -EINVAL;
+			case -EHWPOISON:
+				return -EHWPOISON;
+			case -EFAULT: /* VM_FAULT_SIGBUS or VM_FAULT_SIGSEGV */
+				return -EFAULT;
+			default:
+				pr_warn_once("%s: unhandled return value: %ld\n",
+					     __func__, pages);
+				fallthrough;
+			case -ENOMEM:
+				return -ENOMEM;
+			}
+		}
+		start += pages * PAGE_SIZE;
+	}
+	return 0;
+}
+
 static long
 madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 		unsigned long start, unsigned long end, int behavior)
@@ -939,6 +1139,11 @@ madvise_vma(struct vm_area_struct *vma, struct vm_area_struct **prev,
 	case MADV_FREE:
 	case MADV_DONTNEED:
 		return madvise_dontneed_free(vma, prev, start, end, behavior);
+	case MADV_POPULATE_READ:
+	case MADV_POPULATE_WRITE:
+		return madvise_populate(vma, prev, start, end, behavior);
+	case MADV_COLLAPSE:
+		return madvise_collapse(vma, prev, start, end);
 	default:
 		return madvise_behavior(vma, prev, start, end, behavior);
 	}
@@ -959,6 +1164,8 @@ madvise_behavior_valid(int behavior)
 	case MADV_FREE:
 	case MADV_COLD:
 	case MADV_PAGEOUT:
+	case MADV_POPULATE_READ:
+	case MADV_POPULATE_WRITE:
 #ifdef CONFIG_KSM
 	case MADV_MERGEABLE:
 	case MADV_UNMERGEABLE:
@@ -966,6 +1173,7 @@ madvise_behavior_valid(int behavior)
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	case MADV_HUGEPAGE:
 	case MADV_NOHUGEPAGE:
+	case MADV_COLLAPSE:
 #endif
 	case MADV_DONTDUMP:
 	case MADV_DODUMP:
@@ -988,6 +1196,7 @@ process_madvise_behavior_valid(int behavior)
 	switch (behavior) {
 	case MADV_COLD:
 	case MADV_PAGEOUT:
+	case MADV_COLLAPSE:
 		return true;
 	default:
 		return false;
@@ -1038,6 +1247,8 @@ process_madvise_behavior_valid(int behavior)
  *  MADV_NOHUGEPAGE - mark the given range as not worth being backed by
  *		transparent huge pages so the existing pages will not be
  *		coalesced into THP and new pages will not be allocated as THP.
+ *  MADV_COLLAPSE - synchronously coalesce pages in the given range into
+ *		transparent huge pages, regardless of the khugepaged settings.
  *  MADV_DONTDUMP - the application wants to prevent pages in the given range
  *		from being included in its core dump.
  *  MADV_DODUMP - cancel MADV_DONTDUMP: no longer exclude from core dump.
@@ -1046,6 +1257,10 @@ process_madvise_behavior_valid(int behavior)
  *		easily if memory pressure hanppens.
  *  MADV_PAGEOUT - the application is not expected to use this memory soon,
  *		page out the pages in this range immediately.
+ *  MADV_POPULATE_READ - populate (prefault) page tables readable by
+ *		triggering read faults if required
+ *  MADV_POPULATE_WRITE - populate (prefault) page tables writable by
+ *		triggering write faults if required
  *
  * return values:
  *  zero    - success
@@ -1062,10 +1277,11 @@ process_madvise_behavior_valid(int behavior)
  */
 int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in, int behavior)
 {
-	unsigned long end, tmp;
+	unsigned long end, tmp, zap_start;
 	struct vm_area_struct *vma, *prev;
 	int unmapped_error = 0;
 	int error = -EINVAL;
+	bool reclaim_pt = false;
 	int write;
 	size_t len;
 	struct blk_plug plug;
@@ -1113,6 +1329,7 @@ int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in, int beh
 	if (vma && start > vma->vm_start)
 		prev = vma;
 
+	zap_start = start;
 	blk_start_plug(&plug);
 	for (;;) {
 		/* Still start < end. */
@@ -1150,11 +1367,16 @@ int do_madvise(struct mm_struct *mm, unsigned long start, size_t len_in, int beh
 	}
 out:
 	blk_finish_plug(&plug);
+	if (behavior == MADV_DONTNEED)
+		reclaim_pt = madvise_walk_pte_tables(NULL, mm, zap_start, end);
 	if (write)
 		mmap_write_unlock(mm);
 	else
 		mmap_read_unlock(mm);
 
+	if (reclaim_pt)
+		madvise_reclaim_pte_tables(mm, zap_start, end);
+
 	return error;
 }
 
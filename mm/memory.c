@@ -156,58 +156,11 @@ static int __init init_zero_pfn(void)
 }
 early_initcall(init_zero_pfn);
 
-void mm_trace_rss_stat(struct mm_struct *mm, int member, long count)
+void mm_trace_rss_stat(struct mm_struct *mm, int member)
 {
-	trace_rss_stat(mm, member, count);
+	trace_rss_stat(mm, member);
 }
 
-#if defined(SPLIT_RSS_COUNTING)
-
-void sync_mm_rss(struct mm_struct *mm)
-{
-	int i;
-
-	for (i = 0; i < NR_MM_COUNTERS; i++) {
-		if (current->rss_stat.count[i]) {
-			add_mm_counter(mm, i, current->rss_stat.count[i]);
-			current->rss_stat.count[i] = 0;
-		}
-	}
-	current->rss_stat.events = 0;
-}
-
-static void add_mm_counter_fast(struct mm_struct *mm, int member, int val)
-{
-	struct task_struct *task = current;
-
-	if (likely(task->mm == mm))
-		task->rss_stat.count[member] += val;
-	else
-		add_mm_counter(mm, member, val);
-}
-#define inc_mm_counter_fast(mm, member) add_mm_counter_fast(mm, member, 1)
-#define dec_mm_counter_fast(mm, member) add_mm_counter_fast(mm, member, -1)
-
-/* sync counter once per 64 page faults */
-#define TASK_RSS_EVENTS_THRESH	(64)
-static void check_sync_rss_stat(struct task_struct *task)
-{
-	if (unlikely(task != current))
-		return;
-	if (unlikely(task->rss_stat.events++ > TASK_RSS_EVENTS_THRESH))
-		sync_mm_rss(task->mm);
-}
-#else /* SPLIT_RSS_COUNTING */
-
-#define inc_mm_counter_fast(mm, member) inc_mm_counter(mm, member)
-#define dec_mm_counter_fast(mm, member) dec_mm_counter(mm, member)
-
-static void check_sync_rss_stat(struct task_struct *task)
-{
-}
-
-#endif /* SPLIT_RSS_COUNTING */
-
 /*
  * Note: this doesn't free the actual pages themselves. That
  * has been handled earlier when unmapping all the memory regions.
@@ -484,8 +437,6 @@ static inline void add_mm_rss_vec(struct mm_struct *mm, int *rss)
 {
 	int i;
 
-	if (current->mm == mm)
-		sync_mm_rss(mm);
 	for (i = 0; i < NR_MM_COUNTERS; i++)
 		if (rss[i])
 			add_mm_counter(mm, i, rss[i]);
@@ -1650,7 +1601,7 @@ static int insert_page_into_pte_locked(struct mm_struct *mm, pte_t *pte,
 		return -EBUSY;
 	/* Ok, finally just insert the thing.. */
 	get_page(page);
-	inc_mm_counter_fast(mm, mm_counter_file(page));
+	inc_mm_counter(mm, mm_counter_file(page));
 	page_add_file_rmap(page, false);
 	set_pte_at(mm, addr, pte, mk_pte(page, prot));
 	return 0;
@@ -2846,9 +2797,11 @@ static vm_fault_t wp_page_copy(struct vm_fault *vmf)
 	pte_t entry;
 	int page_copied = 0;
 	struct mmu_notifier_range range;
+	vm_fault_t ret;
 
-	if (unlikely(anon_vma_prepare(vma)))
-		goto oom;
+	ret = vmf_anon_prepare(vmf);
+	if (unlikely(ret))
+		goto out;
 
 	if (is_zero_pfn(pte_pfn(vmf->orig_pte))) {
 		new_page = alloc_zeroed_user_highpage_movable(vma,
@@ -2893,12 +2846,12 @@ static vm_fault_t wp_page_copy(struct vm_fault *vmf)
 	if (likely(pte_same(*vmf->pte, vmf->orig_pte))) {
 		if (old_page) {
 			if (!PageAnon(old_page)) {
-				dec_mm_counter_fast(mm,
+				dec_mm_counter(mm,
 						mm_counter_file(old_page));
-				inc_mm_counter_fast(mm, MM_ANONPAGES);
+				inc_mm_counter(mm, MM_ANONPAGES);
 			}
 		} else {
-			inc_mm_counter_fast(mm, MM_ANONPAGES);
+			inc_mm_counter(mm, MM_ANONPAGES);
 		}
 		flush_cache_page(vma, vmf->address, pte_pfn(vmf->orig_pte));
 		entry = mk_pte(new_page, vma->vm_page_prot);
@@ -2979,9 +2932,11 @@ static vm_fault_t wp_page_copy(struct vm_fault *vmf)
 oom_free_new:
 	put_page(new_page);
 oom:
+	ret = VM_FAULT_OOM;
+out:
 	if (old_page)
 		put_page(old_page);
-	return VM_FAULT_OOM;
+	return ret;
 }
 
 /**
@@ -3098,8 +3053,25 @@ static vm_fault_t do_wp_page(struct vm_fault *vmf)
 	struct vm_area_struct *vma = vmf->vma;
 
 	if (userfaultfd_pte_wp(vma, *vmf->pte)) {
-		pte_unmap_unlock(vmf->pte, vmf->ptl);
-		return handle_userfault(vmf, VM_UFFD_WP);
+		pte_t pte;
+
+		if (!userfaultfd_wp_async(vma)) {
+			pte_unmap_unlock(vmf->pte, vmf->ptl);
+			return handle_userfault(vmf, VM_UFFD_WP);
+		}
+
+		/*
+		 * Nothing needed (cache flush, TLB invalidations,
+		 * etc.) because we're only removing the uffd-wp bit,
+		 * which is completely invisible to the user.
+		 */
+		pte = pte_clear_uffd_wp(*vmf->pte);
+		set_pte_at(vma->vm_mm, vmf->address, vmf->pte, pte);
+		/*
+		 * Update this to be prepared for following up CoW
+		 * handling
+		 */
+		vmf->orig_pte = pte;
 	}
 
 	/*
@@ -3291,6 +3263,198 @@ void unmap_mapping_range(struct address_space *mapping,
 }
 EXPORT_SYMBOL(unmap_mapping_range);
 
+#ifdef CONFIG_THP_SWAP
+#define SWAPIN_THP_BATCH	32
+
+/*
+ * A THP swapped out as a whole occupies an aligned swap cluster, and the
+ * ptes it was split into at unmap time hold the consecutive entries of
+ * that cluster.  Check that the page table still maps the whole cluster.
+ */
+static bool swap_pte_range_is_thp(struct vm_fault *vmf, unsigned long haddr,
+				  swp_entry_t first)
+{
+	spinlock_t *ptl;
+	pte_t *pte;
+	int i;
+
+	pte = pte_offset_map_lock(vmf->vma->vm_mm, vmf->pmd, haddr, &ptl);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (!is_swap_pte(pte[i]) ||
+		    pte_to_swp_entry(pte[i]).val != first.val + i)
+			break;
+	}
+	pte_unmap_unlock(pte, ptl);
+	return i == HPAGE_PMD_NR;
+}
+
+/*
+ * Read one page of the range into a fresh page, bypassing the swap cache
+ * as do_swap_page() does for a single exclusive entry.  The pages beyond
+ * the faulting one are speculative, so don't try hard to get them.
+ */
+static struct page *swapin_page_nocache(struct vm_area_struct *vma,
+					unsigned long addr, swp_entry_t entry)
+{
+	struct page *page;
+	void *shadow;
+
+	page = alloc_page_vma(GFP_HIGHUSER_MOVABLE | __GFP_NORETRY |
+			      __GFP_NOWARN, vma, addr);
+	if (!page)
+		return NULL;
+
+	__SetPageLocked(page);
+	__SetPageSwapBacked(page);
+	set_page_private(page, entry.val);
+
+	/* Tell memcg to use swap ownership records */
+	SetPageSwapCache(page);
+	if (mem_cgroup_charge(page, vma->vm_mm, GFP_KERNEL | __GFP_NORETRY)) {
+		ClearPageSwapCache(page);
+		unlock_page(page);
+		put_page(page);
+		return NULL;
+	}
+	ClearPageSwapCache(page);
+
+	shadow = get_shadow_from_swap_cache(entry);
+	if (shadow)
+		workingset_refault(page, shadow);
+
+	lru_cache_add(page);
+	swap_readpage(page, true);
+	return page;
+}
+
+/*
+ * Map the pages read for the @nr ptes starting at @addr, skipping any pte
+ * that changed while the page table lock was dropped.  Returns the number
+ * of ptes mapped; pages that were not mapped are released.
+ */
+static int swapin_thp_map_pages(struct vm_fault *vmf, unsigned long addr,
+				swp_entry_t entry, struct page **pages, int nr,
+				vm_fault_t *ret)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	spinlock_t *ptl;
+	pte_t *start_pte, *ptep;
+	int i, nr_mapped = 0;
+
+	start_pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, addr, &ptl);
+	for (i = 0, ptep = start_pte; i < nr;
+	     i++, ptep++, addr += PAGE_SIZE, entry.val++) {
+		struct page *page = pages[i];
+		pte_t orig_pte = *ptep;
+		pte_t pte;
+
+		if (!is_swap_pte(orig_pte) ||
+		    pte_to_swp_entry(orig_pte).val != entry.val ||
+		    !PageUptodate(page)) {
+			unlock_page(page);
+			put_page(page);
+			continue;
+		}
+
+		inc_mm_counter(vma->vm_mm, MM_ANONPAGES);
+		dec_mm_counter(vma->vm_mm, MM_SWAPENTS);
+		pte = mk_pte(page, vma->vm_page_prot);
+		if (addr == (vmf->address & PAGE_MASK) &&
+		    (vmf->flags & FAULT_FLAG_WRITE)) {
+			pte = maybe_mkwrite(pte_mkdirty(pte), vma);
+			vmf->flags &= ~FAULT_FLAG_WRITE;
+			*ret |= VM_FAULT_WRITE;
+		}
+		flush_icache_page(vma, page);
+		if (pte_swp_soft_dirty(orig_pte))
+			pte = pte_mksoft_dirty(pte);
+		if (pte_swp_uffd_wp(orig_pte)) {
+			pte = pte_mkuffd_wp(pte);
+			pte = pte_wrprotect(pte);
+		}
+		set_pte_at(vma->vm_mm, addr, ptep, pte);
+		arch_do_swap_page(vma->vm_mm, vma, addr, pte, orig_pte);
+		do_page_add_anon_rmap(page, vma, addr, RMAP_EXCLUSIVE);
+		swap_free(entry);
+		unlock_page(page);
+
+		/* No need to invalidate - it was non-present before */
+		update_mmu_cache(vma, addr, ptep);
+		nr_mapped++;
+	}
+	pte_unmap_unlock(start_pte, ptl);
+	return nr_mapped;
+}
+
+/*
+ * Swap in a THP that was swapped out as a unit in one fault, rather than
+ * taking a fault for each of its subpages.  This is only done from a
+ * synchronous swap device where all of the entries are exclusive to this
+ * mapping, so the pages can bypass the swap cache.  The page table cannot
+ * be replaced under the shared mmap_lock; the range is mapped with ptes
+ * and left to khugepaged to collapse.
+ *
+ * Returns 0 if nothing was mapped and the caller should fall back to
+ * swapping in the faulting page alone.
+ */
+static vm_fault_t do_swap_page_thp(struct vm_fault *vmf, swp_entry_t entry)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned long haddr = vmf->address & HPAGE_PMD_MASK;
+	unsigned long idx = (vmf->address - haddr) >> PAGE_SHIFT;
+	struct page *pages[SWAPIN_THP_BATCH];
+	int i, nr, nr_mapped = 0;
+	swp_entry_t first;
+	vm_fault_t ret = 0;
+
+	if (!transhuge_vma_suitable(vma, haddr) ||
+	    !__transparent_hugepage_enabled(vma))
+		return 0;
+	if (swp_offset(entry) < idx ||
+	    !IS_ALIGNED(swp_offset(entry) - idx, HPAGE_PMD_NR))
+		return 0;
+
+	first = swp_entry(swp_type(entry), swp_offset(entry) - idx);
+	if (!swap_pte_range_is_thp(vmf, haddr, first) ||
+	    !swap_entries_exclusive(first, HPAGE_PMD_NR))
+		return 0;
+
+	for (i = 0; i < HPAGE_PMD_NR; i += SWAPIN_THP_BATCH) {
+		unsigned long addr = haddr + i * PAGE_SIZE;
+		swp_entry_t batch = first;
+
+		batch.val += i;
+		for (nr = 0; nr < SWAPIN_THP_BATCH; nr++) {
+			swp_entry_t ent = batch;
+
+			ent.val += nr;
+			pages[nr] = swapin_page_nocache(vma,
+					addr + nr * PAGE_SIZE, ent);
+			if (!pages[nr])
+				break;
+		}
+		if (nr)
+			nr_mapped += swapin_thp_map_pages(vmf, addr, batch,
+							  pages, nr, &ret);
+		if (nr < SWAPIN_THP_BATCH)
+			break;
+	}
+
+	if (!nr_mapped) {
+		count_vm_event(THP_SWPIN_FALLBACK);
+		return 0;
+	}
+	count_vm_event(THP_SWPIN);
+	return ret | VM_FAULT_MAJOR;
+}
+#else
+static inline vm_fault_t do_swap_page_thp(struct vm_fault *vmf,
+					  swp_entry_t entry)
+{
+	return 0;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_lock (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -3313,6 +3477,12 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	if (!pte_unmap_same(vma->vm_mm, vmf->pmd, vmf->pte, vmf->orig_pte))
 		goto out;
 
+	/* swapin can drop mmap_lock in many places, retry under it */
+	if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
+		vma_end_read(vma);
+		return VM_FAULT_RETRY;
+	}
+
 	entry = pte_to_swp_entry(vmf->orig_pte);
 	if (unlikely(non_swap_entry(entry))) {
 		if (is_migration_entry(entry)) {
@@ -3340,6 +3510,14 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 
 		if (data_race(si->flags & SWP_SYNCHRONOUS_IO) &&
 		    __swap_count(entry) == 1) {
+			ret = do_swap_page_thp(vmf, entry);
+			if (ret) {
+				delayacct_clear_flag(DELAYACCT_PF_SWAPIN);
+				count_vm_event(PGMAJFAULT);
+				count_memcg_event_mm(vma->vm_mm, PGMAJFAULT);
+				goto out;
+			}
+
 			/* skip swapcache */
 			page = alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma,
 							vmf->address);
@@ -3450,8 +3628,8 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	 * must be called after the swap_free(), or it will never succeed.
 	 */
 
-	inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
-	dec_mm_counter_fast(vma->vm_mm, MM_SWAPENTS);
+	inc_mm_counter(vma->vm_mm, MM_ANONPAGES);
+	dec_mm_counter(vma->vm_mm, MM_SWAPENTS);
 	pte = mk_pte(page, vma->vm_page_prot);
 	if ((vmf->flags & FAULT_FLAG_WRITE) && reuse_swap_page(page, NULL)) {
 		pte = maybe_mkwrite(pte_mkdirty(pte), vma);
@@ -3578,8 +3756,9 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	}
 
 	/* Allocate our own private page. */
-	if (unlikely(anon_vma_prepare(vma)))
-		goto oom;
+	ret = vmf_anon_prepare(vmf);
+	if (unlikely(ret))
+		return ret;
 	page = alloc_zeroed_user_highpage_movable(vma, vmf->address);
 	if (!page)
 		goto oom;
@@ -3618,7 +3797,7 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 		return handle_userfault(vmf, VM_UFFD_MISSING);
 	}
 
-	inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+	inc_mm_counter(vma->vm_mm, MM_ANONPAGES);
 	page_add_new_anon_rmap(page, vma, vmf->address, false);
 	lru_cache_add_inactive_or_unevictable(page, vma);
 setpte:
@@ -3877,11 +4056,11 @@ vm_fault_t alloc_set_pte(struct vm_fault *vmf, struct page *page)
 		entry = maybe_mkwrite(pte_mkdirty(entry), vma);
 	/* copy-on-write page */
 	if (write && !(vma->vm_flags & VM_SHARED)) {
-		inc_mm_counter_fast(vma->vm_mm, MM_ANONPAGES);
+		inc_mm_counter(vma->vm_mm, MM_ANONPAGES);
 		page_add_new_anon_rmap(page, vma, vmf->address, false);
 		lru_cache_add_inactive_or_unevictable(page, vma);
 	} else {
-		inc_mm_counter_fast(vma->vm_mm, mm_counter_file(page));
+		inc_mm_counter(vma->vm_mm, mm_counter_file(page));
 		page_add_file_rmap(page, false);
 	}
 	set_pte_at(vma->vm_mm, vmf->address, vmf->pte, entry);
@@ -4056,9 +4235,11 @@ static vm_fault_t do_read_fault(struct vm_fault *vmf)
 	/*
 	 * Let's call ->map_pages() first and use ->fault() as fallback
 	 * if page by the offset is not ready to be mapped (cold cache or
-	 * something).
+	 * something).  Not with uffd minor faults armed, as mapping the
+	 * page cache around the fault would skip them.
 	 */
-	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1) {
+	if (vma->vm_ops->map_pages && fault_around_bytes >> PAGE_SHIFT > 1 &&
+	    likely(!userfaultfd_minor(vma))) {
 		ret = do_fault_around(vmf);
 		if (ret)
 			return ret;
@@ -4080,8 +4261,9 @@ static vm_fault_t do_cow_fault(struct vm_fault *vmf)
 	struct vm_area_struct *vma = vmf->vma;
 	vm_fault_t ret;
 
-	if (unlikely(anon_vma_prepare(vma)))
-		return VM_FAULT_OOM;
+	ret = vmf_anon_prepare(vmf);
+	if (unlikely(ret))
+		return ret;
 
 	vmf->cow_page = alloc_page_vma(GFP_HIGHUSER_MOVABLE, vma, vmf->address);
 	if (!vmf->cow_page)
@@ -4324,8 +4506,12 @@ static inline vm_fault_t create_huge_pmd(struct vm_fault *vmf)
 static inline vm_fault_t wp_huge_pmd(struct vm_fault *vmf, pmd_t orig_pmd)
 {
 	if (vma_is_anonymous(vmf->vma)) {
-		if (userfaultfd_huge_pmd_wp(vmf->vma, orig_pmd))
+		if (userfaultfd_huge_pmd_wp(vmf->vma, orig_pmd)) {
+			/* Resolved on pte level, a 4K page at a time */
+			if (userfaultfd_wp_async(vmf->vma))
+				goto split;
 			return handle_userfault(vmf, VM_UFFD_WP);
+		}
 		return do_huge_pmd_wp_page(vmf, orig_pmd);
 	}
 	if (vmf->vma->vm_ops->huge_fault) {
@@ -4335,6 +4521,7 @@ static inline vm_fault_t wp_huge_pmd(struct vm_fault *vmf, pmd_t orig_pmd)
 			return ret;
 	}
 
+split:
 	/* COW or write-notify handled on pte level: split pmd. */
 	__split_huge_pmd(vmf->vma, vmf->pmd, vmf->address, false, NULL);
 
@@ -4632,7 +4819,8 @@ static inline void mm_account_fault(struct pt_regs *regs,
 }
 
 /*
- * By the time we get here, we already hold the mm semaphore
+ * By the time we get here, we already hold the mm semaphore, or only the
+ * VMA lock if FAULT_FLAG_VMA_LOCK is set.
  *
  * The mmap_lock may have been released depending on flags and our
  * return value.  See filemap_fault() and __lock_page_or_retry().
@@ -4647,9 +4835,6 @@ vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 	count_vm_event(PGFAULT);
 	count_memcg_event_mm(vma->vm_mm, PGFAULT);
 
-	/* do counter updates before entering really critical section. */
-	check_sync_rss_stat(current);
-
 	if (!arch_vma_access_permitted(vma, flags & FAULT_FLAG_WRITE,
 					    flags & FAULT_FLAG_INSTRUCTION,
 					    flags & FAULT_FLAG_REMOTE))
@@ -4685,6 +4870,82 @@ vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+vm_fault_t vmf_anon_prepare(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+
+	if (likely(vma->anon_vma))
+		return 0;
+	/* anon_vma lookup walks the neighbour VMAs, it needs mmap_lock */
+	if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
+		vma_end_read(vma);
+		return VM_FAULT_RETRY;
+	}
+	if (__anon_vma_prepare(vma))
+		return VM_FAULT_OOM;
+	return 0;
+}
+
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Look up and read lock the VMA covering @address without mmap_lock, for
+ * the page fault handler. The rbtree is walked locklessly: the rotations
+ * can make the walk miss the VMA but never loop, and the VMAs are freed
+ * after RCU. Returns NULL when the caller must fall back to mmap_lock.
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma = NULL;
+	struct rb_node *node;
+
+	rcu_read_lock();
+	node = READ_ONCE(mm->mm_rb.rb_node);
+	while (node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(node, struct vm_area_struct, vm_rb);
+		if (READ_ONCE(tmp->vm_end) > address) {
+			vma = tmp;
+			if (READ_ONCE(tmp->vm_start) <= address)
+				break;
+			node = READ_ONCE(node->rb_left);
+		} else {
+			node = READ_ONCE(node->rb_right);
+		}
+	}
+	if (!vma || !vma_start_read(vma))
+		goto inval;
+
+	/* The VMA may have been removed or resized before we locked it */
+	if (unlikely(vma->detached || address < vma->vm_start ||
+		     address >= vma->vm_end)) {
+		count_vm_event(VMA_LOCK_MISS);
+		goto inval_end_read;
+	}
+
+	/*
+	 * Only anonymous and page cache faults are known not to depend on
+	 * mmap_lock; userfaultfd may drop it to wait for userspace.
+	 */
+	if (!vma_is_anonymous(vma) && !vma_is_shmem(vma) &&
+	    vma->vm_ops->fault != filemap_fault)
+		goto inval_end_read;
+	if (userfaultfd_armed(vma))
+		goto inval_end_read;
+
+	rcu_read_unlock();
+	return vma;
+
+inval_end_read:
+	vma_end_read(vma);
+inval:
+	rcu_read_unlock();
+	count_vm_event(VMA_LOCK_ABORT);
+	return NULL;
+}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
@@ -5176,12 +5437,60 @@ static void clear_subpage(unsigned long addr, int idx, void *arg)
 	clear_user_highpage(page + idx, addr);
 }
 
+#ifdef clear_pages
+/* Largest extent handed to clear_pages() between reschedule points */
+#define CLEAR_PAGES_CHUNK	(SZ_2M >> PAGE_SHIFT)
+
+static void clear_pages_resched(void *kaddr, unsigned int start,
+				unsigned int end)
+{
+	unsigned int n;
+
+	for (; start < end; start += n) {
+		n = min_t(unsigned int, end - start, CLEAR_PAGES_CHUNK);
+		cond_resched();
+		clear_pages(kaddr + start * PAGE_SIZE, n);
+	}
+}
+
+/*
+ * Clear the huge page with the architecture's cache-avoiding clear_pages(),
+ * so that zeroing it does not evict everybody else's working set.  Only the
+ * target subpage, which is about to be accessed, goes through the cache.
+ */
+static bool clear_huge_page_extents(struct page *page, unsigned long addr,
+				    unsigned long addr_hint,
+				    unsigned int pages_per_huge_page)
+{
+	unsigned int target = (addr_hint - addr) >> PAGE_SHIFT;
+	void *kaddr = page_address(page);
+
+	might_sleep();
+	clear_pages_resched(kaddr, 0, target);
+	clear_pages_resched(kaddr, target + 1, pages_per_huge_page);
+	cond_resched();
+	clear_user_highpage(nth_page(page, target), addr + target * PAGE_SIZE);
+	return true;
+}
+#else
+static inline bool clear_huge_page_extents(struct page *page,
+					   unsigned long addr,
+					   unsigned long addr_hint,
+					   unsigned int pages_per_huge_page)
+{
+	return false;
+}
+#endif
+
 void clear_huge_page(struct page *page,
 		     unsigned long addr_hint, unsigned int pages_per_huge_page)
 {
 	unsigned long addr = addr_hint &
 		~(((unsigned long)pages_per_huge_page << PAGE_SHIFT) - 1);
 
+	if (clear_huge_page_extents(page, addr, addr_hint, pages_per_huge_page))
+		return;
+
 	if (unlikely(pages_per_huge_page > MAX_ORDER_NR_PAGES)) {
 		clear_gigantic_page(page, addr, pages_per_huge_page);
 		return;
@@ -36,6 +36,7 @@
 #include <linux/memblock.h>
 #include <linux/compaction.h>
 #include <linux/rmap.h>
+#include <linux/padata.h>
 
 #include <asm/tlbflush.h>
 
@@ -679,6 +680,70 @@ static void __meminit resize_pgdat_range(struct pglist_data *pgdat, unsigned lon
 	pgdat->node_spanned_pages = max(start_pfn + nr_pages, old_end_pfn) - pgdat->node_start_pfn;
 
 }
+
+struct memmap_init_args {
+	struct zone *zone;
+	int migratetype;
+};
+
+static void __meminit memmap_init_chunk(unsigned long start_pfn,
+					unsigned long end_pfn, void *arg)
+{
+	struct memmap_init_args *args = arg;
+	struct zone *zone = args->zone;
+
+	memmap_init_zone(end_pfn - start_pfn, zone_to_nid(zone),
+			 zone_idx(zone), start_pfn, 0, MEMINIT_HOTPLUG, NULL,
+			 args->migratetype);
+}
+
+/*
+ * Initializing the memmap of a large range takes a long time, so split it
+ * into sections and let padata spread them over the CPUs of the node, as
+ * deferred_init_memmap() does at boot.
+ */
+static void __meminit memmap_init_hotplug(struct zone *zone,
+					  unsigned long start_pfn,
+					  unsigned long nr_pages,
+					  struct vmem_altmap *altmap,
+					  int migratetype)
+{
+	int nid = zone_to_nid(zone);
+	const struct cpumask *cpumask = cpumask_of_node(nid);
+	struct memmap_init_args args = {
+		.zone		= zone,
+		.migratetype	= migratetype,
+	};
+	struct padata_mt_job job = {
+		.thread_fn   = memmap_init_chunk,
+		.fn_arg      = &args,
+		.start       = start_pfn,
+		.size        = nr_pages,
+		.align       = PAGES_PER_SECTION,
+		.min_chunk   = PAGES_PER_SECTION,
+		.max_threads = cpumask_weight(cpumask),
+	};
+
+#ifdef CONFIG_ZONE_DEVICE
+	/* Only the altmap part is initialized here, see memmap_init_zone() */
+	if (zone_idx(zone) == ZONE_DEVICE) {
+		memmap_init_zone(nr_pages, nid, ZONE_DEVICE, start_pfn, 0,
+				 MEMINIT_HOTPLUG, altmap, migratetype);
+		return;
+	}
+#endif
+
+	/* Memory-only nodes borrow the CPUs of the others */
+	if (!job.max_threads)
+		job.max_threads = num_online_cpus();
+
+	padata_do_multithreaded(&job);
+
+	/* The chunks may have raced updating it */
+	if (highest_memmap_pfn < start_pfn + nr_pages - 1)
+		highest_memmap_pfn = start_pfn + nr_pages - 1;
+}
+
 /*
  * Associate the pfn range with the given zone, initializing the memmaps
  * and resizing the pgdat/zone data to span the added pages. After this
@@ -693,7 +758,6 @@ void __ref move_pfn_range_to_zone(struct zone *zone, unsigned long start_pfn,
 				  struct vmem_altmap *altmap, int migratetype)
 {
 	struct pglist_data *pgdat = zone->zone_pgdat;
-	int nid = pgdat->node_id;
 	unsigned long flags;
 
 	clear_zone_contiguous(zone);
@@ -714,8 +778,7 @@ void __ref move_pfn_range_to_zone(struct zone *zone, unsigned long start_pfn,
 	 * expects the zone spans the pfn range. All the pages in the range
 	 * are reserved so nobody should be touching them so we should be safe
 	 */
-	memmap_init_zone(nr_pages, nid, zone_idx(zone), start_pfn, 0,
-			 MEMINIT_HOTPLUG, altmap, migratetype);
+	memmap_init_hotplug(zone, start_pfn, nr_pages, altmap, migratetype);
 
 	set_zone_contiguous(zone);
 }
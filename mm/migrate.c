@@ -47,8 +47,10 @@
 #include <linux/page_idle.h>
 #include <linux/page_owner.h>
 #include <linux/sched/mm.h>
+#include <linux/sched/sysctl.h>
 #include <linux/ptrace.h>
 #include <linux/oom.h>
+#include <linux/memory.h>
 
 #include <asm/tlbflush.h>
 
@@ -2028,8 +2030,21 @@ static int numamigrate_isolate_page(pg_data_t *pgdat, struct page *page)
 	VM_BUG_ON_PAGE(compound_order(page) && !PageTransHuge(page), page);
 
 	/* Avoid migrating to a node that is nearly full */
-	if (!migrate_balanced_pgdat(pgdat, compound_nr(page)))
+	if (!migrate_balanced_pgdat(pgdat, compound_nr(page))) {
+		int z;
+
+		if (!(sysctl_numa_balancing_mode & NUMA_BALANCING_MEMORY_TIERING))
+			return 0;
+
+		/* make room for promotions by demoting the coldest pages */
+		for (z = pgdat->nr_zones - 1; z >= 0; z--) {
+			if (populated_zone(pgdat->node_zones + z))
+				break;
+		}
+		wakeup_kswapd(pgdat->node_zones + z, 0, compound_order(page),
+			      ZONE_MOVABLE);
 		return 0;
+	}
 
 	if (isolate_lru_page(page))
 		return 0;
@@ -2076,6 +2091,9 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 	pg_data_t *pgdat = NODE_DATA(node);
 	int isolated;
 	int nr_remaining;
+	bool is_promote = !node_is_toptier(page_to_nid(page)) &&
+			  node_is_toptier(node);
+	int nr_pages = thp_nr_pages(page);
 	LIST_HEAD(migratepages);
 
 	/*
@@ -2109,8 +2127,11 @@ int migrate_misplaced_page(struct page *page, struct vm_area_struct *vma,
 			putback_lru_page(page);
 		}
 		isolated = 0;
-	} else
+	} else {
 		count_vm_numa_event(NUMA_PAGE_MIGRATE);
+		if (is_promote)
+			mod_node_page_state(pgdat, PGPROMOTE_SUCCESS, nr_pages);
+	}
 	BUG_ON(!list_empty(&migratepages));
 	return isolated;
 
@@ -2231,6 +2252,8 @@ int migrate_misplaced_transhuge_page(struct mm_struct *mm,
 
 	count_vm_events(PGMIGRATE_SUCCESS, HPAGE_PMD_NR);
 	count_vm_numa_events(NUMA_PAGE_MIGRATE, HPAGE_PMD_NR);
+	if (!node_is_toptier(page_to_nid(page)) && node_is_toptier(node))
+		mod_node_page_state(pgdat, PGPROMOTE_SUCCESS, HPAGE_PMD_NR);
 
 	mod_node_page_state(page_pgdat(page),
 			NR_ISOLATED_ANON + page_lru,
@@ -3115,3 +3138,167 @@ void migrate_vma_finalize(struct migrate_vma *migrate)
 }
 EXPORT_SYMBOL(migrate_vma_finalize);
 #endif /* CONFIG_DEVICE_PRIVATE */
+
+#ifdef CONFIG_NUMA
+/*
+ * node_demotion[] maps each node to the node its cold pages are demoted to
+ * instead of being discarded, or NUMA_NO_NODE. The nodes with CPUs form the
+ * top tier, and each following tier is made of the nearest nodes not in an
+ * upper tier, so that demotion never cycles.
+ *
+ * The array is rebuilt on memory hotplug and read locklessly: a stale target
+ * is harmless, demotion only allocates __GFP_THISNODE from it.
+ */
+static int node_demotion[MAX_NUMNODES] __read_mostly = {
+	[0 ... MAX_NUMNODES - 1] = NUMA_NO_NODE
+};
+static DEFINE_MUTEX(node_demotion_mutex);
+
+bool numa_demotion_enabled __read_mostly;
+
+/**
+ * next_demotion_node() - Get the next node in the demotion path
+ * @node: The starting node to lookup the next node
+ *
+ * Return: node id for next memory node in the demotion path hierarchy
+ * from @node; NUMA_NO_NODE if @node is terminal.
+ */
+int next_demotion_node(int node)
+{
+	return READ_ONCE(node_demotion[node]);
+}
+
+static int find_demotion_target(int node, const nodemask_t *used)
+{
+	int target, best = NUMA_NO_NODE;
+	int distance, best_distance = INT_MAX;
+
+	for_each_node_state(target, N_MEMORY) {
+		if (node_isset(target, *used))
+			continue;
+		distance = node_distance(node, target);
+		if (distance < best_distance) {
+			best = target;
+			best_distance = distance;
+		}
+	}
+
+	return best;
+}
+
+static void set_demotion_targets(void)
+{
+	nodemask_t used = NODE_MASK_NONE;
+	nodemask_t this_pass, next_pass;
+	int node, target;
+
+	mutex_lock(&node_demotion_mutex);
+
+	for_each_node(node)
+		WRITE_ONCE(node_demotion[node], NUMA_NO_NODE);
+
+	nodes_and(this_pass, node_states[N_CPU], node_states[N_MEMORY]);
+	while (!nodes_empty(this_pass)) {
+		nodes_or(used, used, this_pass);
+		nodes_clear(next_pass);
+
+		for_each_node_mask(node, this_pass) {
+			target = find_demotion_target(node, &used);
+			if (target == NUMA_NO_NODE)
+				continue;
+
+			WRITE_ONCE(node_demotion[node], target);
+			node_set(target, next_pass);
+		}
+		this_pass = next_pass;
+	}
+
+	mutex_unlock(&node_demotion_mutex);
+}
+
+static int demotion_memory_callback(struct notifier_block *self,
+				    unsigned long action, void *arg)
+{
+	struct memory_notify *mnb = arg;
+
+	/* only a change of the nodes with memory affects the tiers */
+	if (mnb->status_change_nid < 0)
+		return notifier_from_errno(0);
+
+	switch (action) {
+	case MEM_ONLINE:
+	case MEM_OFFLINE:
+		set_demotion_targets();
+		break;
+	}
+
+	return notifier_from_errno(0);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t demotion_enabled_show(struct kobject *kobj,
+				     struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%s\n",
+		       numa_demotion_enabled ? "true" : "false");
+}
+
+static ssize_t demotion_enabled_store(struct kobject *kobj,
+				      struct kobj_attribute *attr,
+				      const char *buf, size_t count)
+{
+	if (!strncmp(buf, "true", 4) || !strncmp(buf, "1", 1))
+		numa_demotion_enabled = true;
+	else if (!strncmp(buf, "false", 5) || !strncmp(buf, "0", 1))
+		numa_demotion_enabled = false;
+	else
+		return -EINVAL;
+
+	return count;
+}
+
+static struct kobj_attribute numa_demotion_enabled_attr =
+	__ATTR(demotion_enabled, 0644, demotion_enabled_show,
+	       demotion_enabled_store);
+
+static struct attribute *numa_attrs[] = {
+	&numa_demotion_enabled_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group numa_attr_group = {
+	.attrs = numa_attrs,
+};
+
+static int __init numa_init_sysfs(void)
+{
+	int err;
+	struct kobject *numa_kobj;
+
+	numa_kobj = kobject_create_and_add("numa", mm_kobj);
+	if (!numa_kobj) {
+		pr_err("failed to create numa kobject\n");
+		return -ENOMEM;
+	}
+	err = sysfs_create_group(numa_kobj, &numa_attr_group);
+	if (err) {
+		pr_err("failed to register numa group\n");
+		goto delete_obj;
+	}
+	return 0;
+
+delete_obj:
+	kobject_put(numa_kobj);
+	return err;
+}
+subsys_initcall(numa_init_sysfs);
+#endif /* CONFIG_SYSFS */
+
+static int __init numa_init_demotion(void)
+{
+	set_demotion_targets();
+	hotplug_memory_notifier(demotion_memory_callback, 100);
+	return 0;
+}
+late_initcall(numa_init_demotion);
+#endif /* CONFIG_NUMA */
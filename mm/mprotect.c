@@ -28,6 +28,7 @@
 #include <linux/ksm.h>
 #include <linux/uaccess.h>
 #include <linux/mm_inline.h>
+#include <linux/sched/sysctl.h>
 #include <linux/pgtable.h>
 #include <asm/cacheflush.h>
 #include <asm/mmu_context.h>
@@ -111,6 +112,15 @@ static unsigned long change_pte_range(struct vm_area_struct *vma, pmd_t *pmd,
 				 */
 				if (target_node == page_to_nid(page))
 					continue;
+
+				/*
+				 * Only slow memory is scanned for promotion if
+				 * normal NUMA balancing is disabled.
+				 */
+				if (!(sysctl_numa_balancing_mode &
+				      NUMA_BALANCING_NORMAL) &&
+				    node_is_toptier(page_to_nid(page)))
+					continue;
 			}
 
 			oldpte = ptep_modify_prot_start(vma, addr, pte);
@@ -480,6 +490,7 @@ mprotect_fixup(struct vm_area_struct *vma, struct vm_area_struct **pprev,
 	 * vm_flags and vm_page_prot are protected by the mmap_lock
 	 * held in write mode.
 	 */
+	vma_start_write(vma);
 	vma->vm_flags = newflags;
 	dirty_accountable = vma_wants_writenotify(vma, vma->vm_page_prot);
 	vma_set_page_prot(vma);
@@ -0,0 +1,266 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NUMA balancing driven by PMU memory access samples
+ *
+ * Instead of marking address ranges PROT_NONE and waiting for hinting faults,
+ * sample the data addresses of user memory accesses with a precise PMU event
+ * (PEBS, IBS, ...) and feed each sample to the same placement and migration
+ * logic the hinting faults use.
+ *
+ * The overflow handler only appends the address to a small per-task buffer.
+ * Once that fills up, the scheduler tick queues numa_sample_work, which runs
+ * on the way back to user space and resolves the samples to pages.
+ */
+
+#define pr_fmt(fmt) "numa-sample: " fmt
+
+#include <linux/cpuhotplug.h>
+#include <linux/mempolicy.h>
+#include <linux/migrate.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/perf_event.h>
+#include <linux/sched/numa_balancing.h>
+#include <linux/task_work.h>
+#include <linux/vmstat.h>
+
+#ifdef MODULE_PARAM_PREFIX
+#undef MODULE_PARAM_PREFIX
+#endif
+#define MODULE_PARAM_PREFIX "numa_sample."
+
+/*
+ * PMU type and config of the sampled event.
+ *
+ * The event must record data addresses, e.g. MEM_LOAD_RETIRED.L3_MISS
+ * (raw config 0x20d1) on recent Intel CPUs, or the type of the ibs_op PMU on
+ * AMD.  Only read when sampling is enabled.
+ */
+static unsigned int event_type __read_mostly = PERF_TYPE_RAW;
+module_param(event_type, uint, 0600);
+
+static unsigned long event_config __read_mostly;
+module_param(event_config, ulong, 0600);
+
+/* Take one sample every this many events.  10007 by default. */
+static unsigned long sample_period __read_mostly = 10007;
+module_param(sample_period, ulong, 0600);
+
+/* Skid constraint for the event, see perf_event_attr.precise_ip. */
+static unsigned int precise_ip __read_mostly = 2;
+module_param(precise_ip, uint, 0600);
+
+DEFINE_STATIC_KEY_FALSE(numa_sample_active);
+
+static DEFINE_PER_CPU(struct perf_event *, numa_sample_event);
+static DEFINE_MUTEX(numa_sample_mutex);
+static enum cpuhp_state numa_sample_hp_state;
+
+/* Runs in NMI context on the CPU the sampled task is running on. */
+static void numa_sample_overflow(struct perf_event *event,
+				 struct perf_sample_data *data,
+				 struct pt_regs *regs)
+{
+	struct task_struct *p = current;
+	unsigned int nr;
+
+	if (!data->addr || data->addr >= TASK_SIZE)
+		return;
+	if (!p->mm || (p->flags & (PF_EXITING | PF_KTHREAD)))
+		return;
+
+	nr = p->numa_sample_nr;
+	if (nr >= NUMA_SAMPLE_NR)
+		return;
+	p->numa_sample_addr[nr] = data->addr & PAGE_MASK;
+	barrier();
+	WRITE_ONCE(p->numa_sample_nr, nr + 1);
+}
+
+/* Same filter as task_numa_work() applies to the VMAs it scans. */
+static bool numa_sample_vma_ok(struct vm_area_struct *vma)
+{
+	if (!vma_migratable(vma) || !vma_policy_mof(vma) ||
+	    is_vm_hugetlb_page(vma) || (vma->vm_flags & VM_MIXEDMAP))
+		return false;
+
+	/* Shared library pages are mapped read-only by many processes */
+	if (vma->vm_file &&
+	    (vma->vm_flags & (VM_READ | VM_WRITE)) == VM_READ)
+		return false;
+
+	return vma_is_accessible(vma);
+}
+
+/* The sampled equivalent of do_numa_page(). */
+static void numa_sample_page(struct vm_area_struct *vma, unsigned long addr)
+{
+	int last_cpupid, page_nid, target_nid;
+	struct page *page;
+	int flags = 0;
+
+	page = follow_page(vma, addr, FOLL_GET);
+	if (IS_ERR_OR_NULL(page))
+		return;
+
+	count_vm_numa_event(NUMA_SAMPLES);
+
+	/* A sample does not tell whether the access was a write */
+	if (!(vma->vm_flags & VM_WRITE))
+		flags |= TNF_NO_GROUP;
+	if (page_mapcount(page) > 1 && (vma->vm_flags & VM_SHARED))
+		flags |= TNF_SHARED;
+
+	last_cpupid = page_cpupid_last(page);
+	page_nid = page_to_nid(page);
+	if (page_nid == numa_node_id())
+		flags |= TNF_FAULT_LOCAL;
+
+	/* As in do_numa_page(), THPs are only accounted, not migrated */
+	target_nid = NUMA_NO_NODE;
+	if (!PageCompound(page))
+		target_nid = mpol_misplaced(page, vma, addr);
+
+	if (target_nid == NUMA_NO_NODE) {
+		put_page(page);
+	} else if (migrate_misplaced_page(page, vma, target_nid)) {
+		page_nid = target_nid;
+		flags |= TNF_MIGRATED;
+	} else {
+		flags |= TNF_MIGRATE_FAIL;
+	}
+
+	task_numa_fault(last_cpupid, page_nid, 1, flags);
+}
+
+static void numa_sample_work(struct callback_head *work)
+{
+	unsigned long addrs[NUMA_SAMPLE_NR];
+	struct task_struct *p = current;
+	struct mm_struct *mm = p->mm;
+	struct vm_area_struct *vma;
+	unsigned int i, nr;
+
+	work->next = work;
+	if (p->flags & PF_EXITING)
+		return;
+
+	/*
+	 * The overflow handler only runs while this task is current, so it
+	 * cannot race with the copy below, only interrupt it.
+	 */
+	nr = READ_ONCE(p->numa_sample_nr);
+	memcpy(addrs, p->numa_sample_addr, nr * sizeof(addrs[0]));
+	barrier();
+	WRITE_ONCE(p->numa_sample_nr, 0);
+
+	if (!mmap_read_trylock(mm))
+		return;
+
+	for (i = 0; i < nr; i++) {
+		vma = find_vma(mm, addrs[i]);
+		if (!vma || addrs[i] < vma->vm_start)
+			continue;
+		if (numa_sample_vma_ok(vma))
+			numa_sample_page(vma, addrs[i]);
+	}
+
+	mmap_read_unlock(mm);
+}
+
+void init_numa_sample(struct task_struct *p)
+{
+	p->numa_sample_nr = 0;
+	/* Protect against double add, see task_numa_sample_tick */
+	p->numa_sample_work.next = &p->numa_sample_work;
+	init_task_work(&p->numa_sample_work, numa_sample_work);
+}
+
+void task_numa_sample_tick(struct task_struct *curr)
+{
+	struct callback_head *work = &curr->numa_sample_work;
+
+	if (READ_ONCE(curr->numa_sample_nr) < NUMA_SAMPLE_NR ||
+	    work->next != work)
+		return;
+
+	task_work_add(curr, work, TWA_RESUME);
+}
+
+static int numa_sample_cpu_online(unsigned int cpu)
+{
+	struct perf_event_attr attr = {
+		.type		= event_type,
+		.config		= event_config,
+		.size		= sizeof(attr),
+		.sample_period	= sample_period,
+		.sample_type	= PERF_SAMPLE_ADDR,
+		.precise_ip	= precise_ip,
+		.exclude_kernel	= 1,
+		.exclude_hv	= 1,
+	};
+	struct perf_event *event;
+
+	event = perf_event_create_kernel_counter(&attr, cpu, NULL,
+						 numa_sample_overflow, NULL);
+	if (IS_ERR(event)) {
+		pr_warn("cannot create sampling event on CPU%u: %ld\n",
+			cpu, PTR_ERR(event));
+		return PTR_ERR(event);
+	}
+
+	per_cpu(numa_sample_event, cpu) = event;
+	return 0;
+}
+
+static int numa_sample_cpu_offline(unsigned int cpu)
+{
+	struct perf_event *event = per_cpu(numa_sample_event, cpu);
+
+	if (event) {
+		per_cpu(numa_sample_event, cpu) = NULL;
+		perf_event_release_kernel(event);
+	}
+	return 0;
+}
+
+/*
+ * Start or stop sampling on all CPUs.  Called when the
+ * NUMA_BALANCING_PMU_SAMPLING bit of kernel.numa_balancing changes.
+ */
+int numa_sample_set_state(bool enabled)
+{
+	int ret = 0;
+
+	mutex_lock(&numa_sample_mutex);
+	if (enabled == static_key_enabled(&numa_sample_active))
+		goto out;
+
+	if (!enabled) {
+		static_branch_disable(&numa_sample_active);
+		cpuhp_remove_state(numa_sample_hp_state);
+		goto out;
+	}
+
+	if (event_type == PERF_TYPE_RAW && !event_config) {
+		pr_warn("no sampling event configured\n");
+		ret = -ENODEV;
+		goto out;
+	}
+	if (!sample_period) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "mm/numa_sample:online",
+				numa_sample_cpu_online,
+				numa_sample_cpu_offline);
+	if (ret < 0)
+		goto out;
+	numa_sample_hp_state = ret;
+	ret = 0;
+	static_branch_enable(&numa_sample_active);
+out:
+	mutex_unlock(&numa_sample_mutex);
+	return ret;
+}
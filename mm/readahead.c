@@ -23,6 +23,7 @@
 #include <linux/blk-cgroup.h>
 #include <linux/fadvise.h>
 #include <linux/sched/mm.h>
+#include <linux/readahead_policy.h>
 
 #include "internal.h"
 
@@ -157,6 +158,50 @@ static void read_pages(struct readahead_control *rac, struct list_head *pages,
 		rac->_index++;
 }
 
+#ifdef CONFIG_READ_ONLY_THP_FOR_FS
+/*
+ * Try to read the @nr pages at @index into a THP, for mappings which can
+ * read them. Returns the number of pages added to the batch, or 0 if the
+ * caller should fall back to base pages.
+ */
+static unsigned long page_cache_ra_thp(struct readahead_control *ractl,
+		pgoff_t index, unsigned long nr, gfp_t gfp_mask)
+{
+	struct address_space *mapping = ractl->mapping;
+	struct page *page;
+
+	if (!mapping_thp_readahead(mapping) || mapping->a_ops->readpages)
+		return 0;
+	if (!(transparent_hugepage_flags & (1 << TRANSPARENT_HUGEPAGE_FLAG)))
+		return 0;
+	if ((index & (HPAGE_PMD_NR - 1)) || nr < HPAGE_PMD_NR)
+		return 0;
+	if (inode_is_open_for_write(mapping->host))
+		return 0;
+
+	/* opportunistic, don't stall readahead on compaction */
+	page = alloc_pages((gfp_mask | __GFP_COMP) & ~__GFP_DIRECT_RECLAIM,
+			   HPAGE_PMD_ORDER);
+	if (!page) {
+		count_vm_event(THP_FILE_FALLBACK);
+		return 0;
+	}
+	prep_transhuge_page(page);
+
+	if (add_to_page_cache_thp_lru(page, mapping, index, gfp_mask) < 0) {
+		put_page(page);
+		return 0;
+	}
+	return HPAGE_PMD_NR;
+}
+#else
+static inline unsigned long page_cache_ra_thp(struct readahead_control *ractl,
+		pgoff_t index, unsigned long nr, gfp_t gfp_mask)
+{
+	return 0;
+}
+#endif /* CONFIG_READ_ONLY_THP_FOR_FS */
+
 /**
  * page_cache_ra_unbounded - Start unchecked readahead.
  * @ractl: Readahead control.
@@ -178,7 +223,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	unsigned long index = readahead_index(ractl);
 	LIST_HEAD(page_pool);
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
-	unsigned long i;
+	unsigned long i, nr;
 
 	/*
 	 * Partway through the readahead operation, we will have added
@@ -213,6 +258,18 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 			continue;
 		}
 
+		/*
+		 * PG_readahead can't be set on a THP, the lookahead mark is
+		 * lost if it falls inside one.
+		 */
+		nr = page_cache_ra_thp(ractl, index + i, nr_to_read - i,
+				       gfp_mask);
+		if (nr) {
+			ractl->_nr_pages += nr;
+			i += nr - 1;
+			continue;
+		}
+
 		page = __page_cache_alloc(gfp_mask);
 		if (!page)
 			break;
@@ -264,6 +321,10 @@ void do_page_cache_ra(struct readahead_control *ractl,
 	if (nr_to_read > end_index - index)
 		nr_to_read = end_index - index + 1;
 
+#ifdef CONFIG_BPF_READAHEAD
+	WRITE_ONCE(ractl->mapping->ra_stats.pages,
+		   ractl->mapping->ra_stats.pages + nr_to_read);
+#endif
 	page_cache_ra_unbounded(ractl, nr_to_read, lookahead_size);
 }
 
@@ -429,6 +490,99 @@ static int try_context_readahead(struct address_space *mapping,
 	return 1;
 }
 
+#ifdef CONFIG_BPF_READAHEAD
+static struct readahead_policy_ops __rcu *ra_policy;
+static DEFINE_MUTEX(ra_policy_mutex);
+
+int readahead_register_policy(struct readahead_policy_ops *ops)
+{
+	int ret = 0;
+
+	if (!ops->get_window)
+		return -EINVAL;
+
+	mutex_lock(&ra_policy_mutex);
+	if (rcu_access_pointer(ra_policy))
+		ret = -EBUSY;
+	else
+		rcu_assign_pointer(ra_policy, ops);
+	mutex_unlock(&ra_policy_mutex);
+
+	if (!ret)
+		pr_debug("readahead: policy %s registered\n", ops->name);
+	return ret;
+}
+
+void readahead_unregister_policy(struct readahead_policy_ops *ops)
+{
+	mutex_lock(&ra_policy_mutex);
+	if (rcu_access_pointer(ra_policy) == ops)
+		RCU_INIT_POINTER(ra_policy, NULL);
+	mutex_unlock(&ra_policy_mutex);
+
+	synchronize_rcu();
+}
+
+/*
+ * Record the decision in the file's history and the mapping's stats, then
+ * let the attached policy, if any, pick the window.  Returns true with the
+ * new window in @ra if the policy took the decision.
+ */
+static bool ra_policy_window(struct readahead_control *ractl,
+		struct file_ra_state *ra, bool async, unsigned long req_size,
+		unsigned long max_pages)
+{
+	struct address_space *mapping = ractl->mapping;
+	struct readahead_policy_ops *ops;
+	pgoff_t index = readahead_index(ractl);
+	struct ra_policy_ctx ctx;
+	bool taken = false;
+	int i;
+
+	if (async)
+		WRITE_ONCE(mapping->ra_stats.async, mapping->ra_stats.async + 1);
+	else
+		WRITE_ONCE(mapping->ra_stats.sync, mapping->ra_stats.sync + 1);
+
+	if (rcu_access_pointer(ra_policy)) {
+		ctx.file = ractl->file;
+		ctx.index = index;
+		ctx.req_count = req_size;
+		ctx.max_pages = max_pages;
+		ctx.async = async;
+		for (i = 0; i < RA_HISTORY_LEN; i++)
+			ctx.history[i] = ra->history[(ra->history_idx - 1 - i) %
+						     RA_HISTORY_LEN];
+		ctx.start = ra->start;
+		ctx.size = ra->size;
+		ctx.async_size = ra->async_size;
+
+		rcu_read_lock();
+		ops = rcu_dereference(ra_policy);
+		if (ops)
+			taken = ops->get_window(&ctx);
+		rcu_read_unlock();
+	}
+
+	ra->history[ra->history_idx++ % RA_HISTORY_LEN] = index;
+	if (!taken)
+		return false;
+
+	WRITE_ONCE(mapping->ra_stats.policy, mapping->ra_stats.policy + 1);
+	ra->start = ctx.start;
+	ra->size = min(ctx.size, max_pages);
+	ra->async_size = min_t(unsigned long, ctx.async_size, ra->size);
+	return true;
+}
+#else
+static inline bool ra_policy_window(struct readahead_control *ractl,
+		struct file_ra_state *ra, bool async, unsigned long req_size,
+		unsigned long max_pages)
+{
+	return false;
+}
+#endif /* CONFIG_BPF_READAHEAD */
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
@@ -449,6 +603,15 @@ static void ondemand_readahead(struct readahead_control *ractl,
 	if (req_size > max_pages && bdi->io_pages > max_pages)
 		max_pages = min(req_size, bdi->io_pages);
 
+	if (ra_policy_window(ractl, ra, hit_readahead_marker, req_size,
+			     max_pages)) {
+		if (ra->size) {
+			ractl->_index = ra->start;
+			do_page_cache_ra(ractl, ra->size, ra->async_size);
+		}
+		return;
+	}
+
 	/*
 	 * start of file
 	 */
@@ -0,0 +1,139 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Slab allocator micro-benchmark: each SLAB_BENCHMARK ioctl allocates
+ * ->count objects of ->size bytes, then frees them, and reports how long
+ * both phases took. Several tasks issuing the ioctl at the same time
+ * measure the allocator under contention.
+ */
+#include <linux/kernel.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+
+#define SLAB_BENCHMARK		_IOWR('k', 1, struct slab_benchmark)
+
+/* allocate from a dedicated cache rather than from the kmalloc caches */
+#define SLAB_BENCHMARK_CACHE	(1 << 0)
+#define SLAB_BENCHMARK_FLAGS	SLAB_BENCHMARK_CACHE
+
+#define SLAB_BENCHMARK_MAX_COUNT	(1U << 20)
+
+struct slab_benchmark {
+	__u64 alloc_delta_nsec;
+	__u64 free_delta_nsec;
+	__u32 size;
+	__u32 count;
+	__u32 bulk;		/* objects per bulk call, 0: one at a time */
+	__u32 flags;
+	__u64 expansion[10];	/* For future use */
+};
+
+static int __slab_benchmark_ioctl(struct slab_benchmark *sb)
+{
+	struct kmem_cache *cache = NULL;
+	ktime_t start_time, end_time;
+	unsigned int i, nr;
+	void **objs;
+	int ret = 0;
+
+	if (!sb->size || sb->size > KMALLOC_MAX_CACHE_SIZE ||
+	    !sb->count || sb->count > SLAB_BENCHMARK_MAX_COUNT ||
+	    sb->flags & ~SLAB_BENCHMARK_FLAGS)
+		return -EINVAL;
+
+	/* the bulk API works on a kmem_cache */
+	if (sb->bulk && !(sb->flags & SLAB_BENCHMARK_CACHE))
+		return -EINVAL;
+
+	objs = kvcalloc(sb->count, sizeof(void *), GFP_KERNEL);
+	if (!objs)
+		return -ENOMEM;
+
+	if (sb->flags & SLAB_BENCHMARK_CACHE) {
+		cache = kmem_cache_create("slab_benchmark", sb->size, 0, 0, NULL);
+		if (!cache) {
+			ret = -ENOMEM;
+			goto free_objs;
+		}
+	}
+
+	start_time = ktime_get();
+	for (i = 0; i < sb->count; i += nr) {
+		if (sb->bulk) {
+			nr = min(sb->bulk, sb->count - i);
+			if (!kmem_cache_alloc_bulk(cache, GFP_KERNEL, nr, objs + i))
+				break;
+		} else {
+			nr = 1;
+			objs[i] = cache ? kmem_cache_alloc(cache, GFP_KERNEL) :
+					  kmalloc(sb->size, GFP_KERNEL);
+			if (!objs[i])
+				break;
+		}
+	}
+	end_time = ktime_get();
+	sb->alloc_delta_nsec = ktime_to_ns(ktime_sub(end_time, start_time));
+
+	/* Shifting the meaning of count: now it is actual number allocated */
+	sb->count = i;
+
+	start_time = ktime_get();
+	for (i = 0; i < sb->count; i += nr) {
+		if (sb->bulk) {
+			nr = min(sb->bulk, sb->count - i);
+			kmem_cache_free_bulk(cache, nr, objs + i);
+		} else {
+			nr = 1;
+			if (cache)
+				kmem_cache_free(cache, objs[i]);
+			else
+				kfree(objs[i]);
+		}
+	}
+	end_time = ktime_get();
+	sb->free_delta_nsec = ktime_to_ns(ktime_sub(end_time, start_time));
+
+	kmem_cache_destroy(cache);
+free_objs:
+	kvfree(objs);
+	return ret;
+}
+
+static long slab_benchmark_ioctl(struct file *filep, unsigned int cmd,
+		unsigned long arg)
+{
+	struct slab_benchmark sb;
+	int ret;
+
+	if (cmd != SLAB_BENCHMARK)
+		return -EINVAL;
+
+	if (copy_from_user(&sb, (void __user *)arg, sizeof(sb)))
+		return -EFAULT;
+
+	ret = __slab_benchmark_ioctl(&sb);
+	if (ret)
+		return ret;
+
+	if (copy_to_user((void __user *)arg, &sb, sizeof(sb)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static const struct file_operations slab_benchmark_fops = {
+	.open = nonseekable_open,
+	.unlocked_ioctl = slab_benchmark_ioctl,
+};
+
+static int slab_benchmark_init(void)
+{
+	debugfs_create_file_unsafe("slab_benchmark", 0600, NULL, NULL,
+				   &slab_benchmark_fops);
+
+	return 0;
+}
+
+late_initcall(slab_benchmark_init);
@@ -1442,6 +1442,30 @@ int split_swap_cluster(swp_entry_t entry)
 	unlock_cluster(ci);
 	return 0;
 }
+
+/*
+ * Check whether each of the @nr swap entries starting at @entry is used by
+ * exactly one swap pte and has no page in the swap cache, so that the whole
+ * range may be read back without going through the swap cache.
+ */
+bool swap_entries_exclusive(swp_entry_t entry, int nr)
+{
+	struct swap_info_struct *si;
+	unsigned long offset = swp_offset(entry);
+	int i = 0;
+
+	si = get_swap_device(entry);
+	if (!si)
+		return false;
+	if (offset + nr <= si->max) {
+		/* Racy, but the caller revalidates each pte before use */
+		for (; i < nr; i++)
+			if (data_race(si->swap_map[offset + i]) != 1)
+				break;
+	}
+	put_swap_device(si);
+	return i == nr;
+}
 #endif
 
 static int swp_entry_cmp(const void *ent1, const void *ent2)
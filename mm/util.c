@@ -585,7 +585,12 @@ void *kvmalloc_node(size_t size, gfp_t flags, int node)
 	if (WARN_ON_ONCE(size > INT_MAX))
 		return NULL;
 
-	return __vmalloc_node(size, 1, flags, node,
+	/*
+	 * kvmalloc() can always use VM_ALLOW_HUGE_VMAP, since the callers
+	 * cannot tell whether they got a kmalloc() or vmalloc() area anyway.
+	 */
+	return __vmalloc_node_range(size, 1, VMALLOC_START, VMALLOC_END,
+			flags, PAGE_KERNEL, VM_ALLOW_HUGE_VMAP, node,
 			__builtin_return_address(0));
 }
 EXPORT_SYMBOL(kvmalloc_node);
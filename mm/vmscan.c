@@ -51,6 +51,10 @@
 #include <linux/printk.h>
 #include <linux/dax.h>
 #include <linux/psi.h>
+#include <linux/pagewalk.h>
+#include <linux/shmem_fs.h>
+#include <linux/memory_hotplug.h>
+#include <linux/migrate.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -123,6 +127,9 @@ struct scan_control {
 	/* The file pages on the current node are dangerously low */
 	unsigned int file_is_tiny:1;
 
+	/* Always discard instead of demoting to lower tier memory */
+	unsigned int no_demotion:1;
+
 	/* Allocation order */
 	s8 order;
 
@@ -291,6 +298,36 @@ static bool writeback_throttling_sane(struct scan_control *sc)
 }
 #endif
 
+static bool can_demote(int nid, struct scan_control *sc)
+{
+	if (!numa_demotion_enabled)
+		return false;
+	if (sc) {
+		if (sc->no_demotion)
+			return false;
+		/* demotion doesn't uncharge, pointless for memcg limits */
+		if (cgroup_reclaim(sc))
+			return false;
+	}
+
+	return next_demotion_node(nid) != NUMA_NO_NODE;
+}
+
+/* Can anon pages of @nid be reclaimed, by swapping or demoting them? */
+static bool can_reclaim_anon_pages(struct mem_cgroup *memcg, int nid,
+				   struct scan_control *sc)
+{
+	if (!memcg) {
+		if (get_nr_swap_pages() > 0)
+			return true;
+	} else {
+		if (mem_cgroup_get_nr_swap_pages(memcg) > 0)
+			return true;
+	}
+
+	return can_demote(nid, sc);
+}
+
 /*
  * This misses isolated pages which are not accounted for to save counters.
  * As the data only determines if reclaim or compaction continues, it is
@@ -302,7 +339,7 @@ unsigned long zone_reclaimable_pages(struct zone *zone)
 
 	nr = zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_FILE) +
 		zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, zone_to_nid(zone), NULL))
 		nr += zone_page_state_snapshot(zone, NR_ZONE_INACTIVE_ANON) +
 			zone_page_state_snapshot(zone, NR_ZONE_ACTIVE_ANON);
 
@@ -1069,6 +1106,91 @@ static void page_check_dirty_writeback(struct page *page,
 		mapping->a_ops->is_dirty_writeback(page, dirty, writeback);
 }
 
+struct demote_control {
+	struct migration_target_control mtc;
+	unsigned int nr_demoted;
+};
+
+static struct page *alloc_demote_page(struct page *page, unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+	struct page *newpage;
+
+	newpage = alloc_migration_target(page, (unsigned long)&dc->mtc);
+	if (newpage)
+		dc->nr_demoted += thp_nr_pages(newpage);
+
+	return newpage;
+}
+
+static void free_demote_page(struct page *newpage, unsigned long private)
+{
+	struct demote_control *dc = (struct demote_control *)private;
+
+	dc->nr_demoted -= thp_nr_pages(newpage);
+	put_page(newpage);
+}
+
+static void count_isolated(struct list_head *page_list, long *nr)
+{
+	struct page *page;
+
+	list_for_each_entry(page, page_list, lru)
+		nr[page_is_file_lru(page)] += thp_nr_pages(page);
+}
+
+/*
+ * Migrate the pages on @demote_pages to the next memory tier, returning the
+ * number of base pages demoted. Pages which could not be allocated a target
+ * page are left on the list.
+ */
+static unsigned int demote_page_list(struct list_head *demote_pages,
+				     struct pglist_data *pgdat)
+{
+	int target_nid = next_demotion_node(pgdat->node_id);
+	struct demote_control dc = {
+		/*
+		 * Allocate from the target node only, and fail quickly and
+		 * quietly: the pages are then reclaimed as usual.
+		 */
+		.mtc = {
+			.nid = target_nid,
+			.gfp_mask = (GFP_HIGHUSER_MOVABLE & ~__GFP_RECLAIM) |
+				    __GFP_THISNODE | __GFP_NOWARN |
+				    __GFP_NOMEMALLOC | GFP_NOWAIT,
+		},
+	};
+	long nr[ANON_AND_FILE] = { 0, 0 };
+	int type;
+
+	if (list_empty(demote_pages) || target_nid == NUMA_NO_NODE)
+		return 0;
+
+	count_isolated(demote_pages, nr);
+
+	/* Demotion ignores all cpuset and mempolicy settings */
+	migrate_pages(demote_pages, alloc_demote_page, free_demote_page,
+		      (unsigned long)&dc, MIGRATE_ASYNC, MR_DEMOTION);
+
+	/*
+	 * migrate_pages() drops NR_ISOLATED_* for the pages it consumed,
+	 * while our caller accounts for everything it isolated: give the
+	 * difference back.
+	 */
+	for (type = 0; type < ANON_AND_FILE; type++)
+		nr[type] = -nr[type];
+	count_isolated(demote_pages, nr);
+	for (type = 0; type < ANON_AND_FILE; type++)
+		mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr[type]);
+
+	if (current_is_kswapd())
+		count_vm_events(PGDEMOTE_KSWAPD, dc.nr_demoted);
+	else
+		count_vm_events(PGDEMOTE_DIRECT, dc.nr_demoted);
+
+	return dc.nr_demoted;
+}
+
 /*
  * shrink_page_list() returns the number of reclaimed pages
  */
@@ -1080,12 +1202,16 @@ static unsigned int shrink_page_list(struct list_head *page_list,
 {
 	LIST_HEAD(ret_pages);
 	LIST_HEAD(free_pages);
+	LIST_HEAD(demote_pages);
 	unsigned int nr_reclaimed = 0;
 	unsigned int pgactivate = 0;
+	bool do_demote_pass;
 
 	memset(stat, 0, sizeof(*stat));
 	cond_resched();
+	do_demote_pass = can_demote(pgdat->node_id, sc);
 
+retry:
 	while (!list_empty(page_list)) {
 		struct address_space *mapping;
 		struct page *page;
@@ -1234,6 +1360,17 @@ static unsigned int shrink_page_list(struct list_head *page_list,
 			; /* try to reclaim the page below */
 		}
 
+		/*
+		 * Before reclaiming the page, try to relocate its contents
+		 * to the next memory tier.
+		 */
+		if (do_demote_pass &&
+		    (thp_migration_supported() || !PageTransHuge(page))) {
+			list_add(&page->lru, &demote_pages);
+			unlock_page(page);
+			continue;
+		}
+
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
@@ -1483,6 +1620,15 @@ static unsigned int shrink_page_list(struct list_head *page_list,
 		list_add(&page->lru, &ret_pages);
 		VM_BUG_ON_PAGE(PageLRU(page) || PageUnevictable(page), page);
 	}
+	/* 'page_list' is always empty here */
+
+	nr_reclaimed += demote_page_list(&demote_pages, pgdat);
+	/* the pages which could not be demoted are reclaimed as usual */
+	if (!list_empty(&demote_pages)) {
+		list_splice_init(&demote_pages, page_list);
+		do_demote_pass = false;
+		goto retry;
+	}
 
 	pgactivate = stat->nr_activate[0] + stat->nr_activate[1];
 
@@ -1503,6 +1649,7 @@ unsigned int reclaim_clean_pages_from_list(struct zone *zone,
 		.gfp_mask = GFP_KERNEL,
 		.priority = DEF_PRIORITY,
 		.may_unmap = 1,
+		.no_demotion = 1,
 	};
 	struct reclaim_stat stat;
 	unsigned int nr_reclaimed;
@@ -1536,16 +1683,16 @@ unsigned int reclaim_clean_pages_from_list(struct zone *zone,
 }
 
 /*
- * Attempt to remove the specified page from its LRU.  Only take this page
- * if it is of the appropriate PageActive status.  Pages which are being
- * freed elsewhere are also ignored.
+ * Check whether the specified page can be isolated from its LRU.  Only take
+ * this page if it is of the appropriate PageActive status.  The caller pins
+ * the page and clears PageLRU when this returns 0.
  *
  * page:	page to consider
  * mode:	one of the LRU isolation modes defined above
  *
  * returns 0 on success, -ve errno on failure.
  */
-int __isolate_lru_page(struct page *page, isolate_mode_t mode)
+int __isolate_lru_page_prepare(struct page *page, isolate_mode_t mode)
 {
 	int ret = -EINVAL;
 
@@ -1599,17 +1746,7 @@ int __isolate_lru_page(struct page *page, isolate_mode_t mode)
 	if ((mode & ISOLATE_UNMAPPED) && page_mapped(page))
 		return ret;
 
-	if (likely(get_page_unless_zero(page))) {
-		/*
-		 * Be careful not to clear PageLRU until after we're
-		 * sure the page is not being freed elsewhere -- the
-		 * page release code relies on it.
-		 */
-		ClearPageLRU(page);
-		ret = 0;
-	}
-
-	return ret;
+	return 0;
 }
 
 
@@ -1632,7 +1769,9 @@ static __always_inline void update_lru_sizes(struct lruvec *lruvec,
 }
 
 /**
- * pgdat->lru_lock is heavily contended.  Some of the functions that
+ * Isolating page from the lruvec to fill in @dst list by nr_to_scan times.
+ *
+ * lruvec->lru_lock is heavily contended.  Some of the functions that
  * shrink the lists perform better by taking out a batch of pages
  * and working on them outside the LRU lock.
  *
@@ -1672,8 +1811,6 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		page = lru_to_page(src);
 		prefetchw_prev_lru_page(page, src, flags);
 
-		VM_BUG_ON_PAGE(!PageLRU(page), page);
-
 		nr_pages = compound_nr(page);
 		total_scan += nr_pages;
 
@@ -1690,24 +1827,38 @@ static unsigned long isolate_lru_pages(unsigned long nr_to_scan,
 		 * pages, triggering a premature OOM.
 		 *
 		 * Account all tail pages of THP.  This would not cause
-		 * premature OOM since __isolate_lru_page() returns -EBUSY
-		 * only when the page is being freed somewhere else.
+		 * premature OOM since __isolate_lru_page_prepare() returns
+		 * -EBUSY only when the page is being freed somewhere else.
 		 */
 		scan += nr_pages;
-		switch (__isolate_lru_page(page, mode)) {
+		switch (__isolate_lru_page_prepare(page, mode)) {
 		case 0:
+			/*
+			 * Be careful not to clear PageLRU until after we're
+			 * sure the page is not being freed elsewhere -- the
+			 * page release code relies on it.
+			 */
+			if (unlikely(!get_page_unless_zero(page)))
+				goto busy;
+
+			if (!TestClearPageLRU(page)) {
+				/*
+				 * This page may be in another isolation path,
+				 * but we still hold lru_lock.
+				 */
+				put_page(page);
+				goto busy;
+			}
+
 			nr_taken += nr_pages;
 			nr_zone_taken[page_zonenum(page)] += nr_pages;
 			list_move(&page->lru, dst);
 			break;
 
-		case -EBUSY:
+		default:
+busy:
 			/* else it is being freed elsewhere */
 			list_move(&page->lru, src);
-			continue;
-
-		default:
-			BUG();
 		}
 	}
 
@@ -1770,21 +1921,16 @@ int isolate_lru_page(struct page *page)
 	VM_BUG_ON_PAGE(!page_count(page), page);
 	WARN_RATELIMIT(PageTail(page), "trying to isolate tail page");
 
-	if (PageLRU(page)) {
-		pg_data_t *pgdat = page_pgdat(page);
+	if (TestClearPageLRU(page)) {
 		struct lruvec *lruvec;
 
-		spin_lock_irq(&pgdat->lru_lock);
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
-		if (PageLRU(page)) {
-			int lru = page_lru(page);
-			get_page(page);
-			ClearPageLRU(page);
-			del_page_from_lru_list(page, lruvec, lru);
-			ret = 0;
-		}
-		spin_unlock_irq(&pgdat->lru_lock);
+		get_page(page);
+		lruvec = lock_page_lruvec_irq(page);
+		del_page_from_lru_list(page, lruvec, page_lru(page));
+		unlock_page_lruvec_irq(lruvec);
+		ret = 0;
 	}
+
 	return ret;
 }
 
@@ -1832,9 +1978,9 @@ static int too_many_isolated(struct pglist_data *pgdat, int file,
  * processes, from rmap.
  *
  * If the pages are mostly unmapped, the processing is fast and it is
- * appropriate to hold zone_lru_lock across the whole operation.  But if
+ * appropriate to hold lru_lock across the whole operation.  But if
  * the pages are mapped, the processing is slow (page_referenced()) so we
- * should drop zone_lru_lock around each page.  It's impossible to balance
+ * should drop lru_lock around each page.  It's impossible to balance
  * this, so instead we remove the pages from the LRU while processing them.
  * It is safe to rely on PG_active against the non-LRU pages in here because
  * nobody will play with that bit on a non-LRU page.
@@ -1848,7 +1994,6 @@ static int too_many_isolated(struct pglist_data *pgdat, int file,
 static unsigned noinline_for_stack move_pages_to_lru(struct lruvec *lruvec,
 						     struct list_head *list)
 {
-	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
 	int nr_pages, nr_moved = 0;
 	LIST_HEAD(pages_to_free);
 	struct page *page;
@@ -1859,34 +2004,50 @@ static unsigned noinline_for_stack move_pages_to_lru(struct lruvec *lruvec,
 		VM_BUG_ON_PAGE(PageLRU(page), page);
 		if (unlikely(!page_evictable(page))) {
 			list_del(&page->lru);
-			spin_unlock_irq(&pgdat->lru_lock);
+			spin_unlock_irq(&lruvec->lru_lock);
 			putback_lru_page(page);
-			spin_lock_irq(&pgdat->lru_lock);
+			spin_lock_irq(&lruvec->lru_lock);
 			continue;
 		}
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
 
+		/*
+		 * All pages were isolated from the same lruvec (and isolation
+		 * inhibits memcg migration).
+		 */
+		VM_BUG_ON_PAGE(!lruvec_holds_page_lru_lock(page, lruvec), page);
+
+		/*
+		 * The SetPageLRU needs to be kept here for list integrity.
+		 * Otherwise:
+		 *   #0 move_pages_to_lru             #1 release_pages
+		 *   if !put_page_testzero
+		 *				      if (put_page_testzero())
+		 *				        !PageLRU //skip lru_lock
+		 *     SetPageLRU()
+		 *     list_add(&page->lru,)
+		 *                                        list_add(&page->lru,)
+		 */
 		SetPageLRU(page);
 		lru = page_lru(page);
 
 		nr_pages = thp_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, lruvec, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
-			__ClearPageActive(page);
-			del_page_from_lru_list(page, lruvec, lru);
+			del_page_from_lru_list(page, lruvec, page_lru(page));
+			__clear_page_lru_flags(page);
 
 			if (unlikely(PageCompound(page))) {
-				spin_unlock_irq(&pgdat->lru_lock);
+				spin_unlock_irq(&lruvec->lru_lock);
 				destroy_compound_page(page);
-				spin_lock_irq(&pgdat->lru_lock);
+				spin_lock_irq(&lruvec->lru_lock);
 			} else
 				list_add(&page->lru, &pages_to_free);
 		} else {
 			nr_moved += nr_pages;
-			if (PageActive(page))
+			if (is_active_lru(lru))
 				workingset_age_nonresident(lruvec, nr_pages);
 		}
 	}
@@ -1945,7 +2106,7 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 
 	lru_add_drain();
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &page_list,
 				     &nr_scanned, sc, lru);
@@ -1957,26 +2118,27 @@ shrink_inactive_list(unsigned long nr_to_scan, struct lruvec *lruvec,
 	__count_memcg_events(lruvec_memcg(lruvec), item, nr_scanned);
 	__count_vm_events(PGSCAN_ANON + file, nr_scanned);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	if (nr_taken == 0)
 		return 0;
 
 	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, &stat, false);
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	move_pages_to_lru(lruvec, &page_list);
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
-	lru_note_cost(lruvec, file, stat.nr_pageout);
 	item = current_is_kswapd() ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
 	if (!cgroup_reclaim(sc))
 		__count_vm_events(item, nr_reclaimed);
 	__count_memcg_events(lruvec_memcg(lruvec), item, nr_reclaimed);
 	__count_vm_events(PGSTEAL_ANON + file, nr_reclaimed);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	lru_note_cost(lruvec, file, stat.nr_pageout);
 
 	mem_cgroup_uncharge_list(&page_list);
 	free_unref_page_list(&page_list);
@@ -2028,7 +2190,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 
 	lru_add_drain();
 
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	nr_taken = isolate_lru_pages(nr_to_scan, lruvec, &l_hold,
 				     &nr_scanned, sc, lru);
@@ -2039,7 +2201,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 		__count_vm_events(PGREFILL, nr_scanned);
 	__count_memcg_events(lruvec_memcg(lruvec), PGREFILL, nr_scanned);
 
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	while (!list_empty(&l_hold)) {
 		cond_resched();
@@ -2085,7 +2247,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	/*
 	 * Move pages back to the lru list.
 	 */
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&lruvec->lru_lock);
 
 	nr_activate = move_pages_to_lru(lruvec, &l_active);
 	nr_deactivate = move_pages_to_lru(lruvec, &l_inactive);
@@ -2096,7 +2258,7 @@ static void shrink_active_list(unsigned long nr_to_scan,
 	__count_memcg_events(lruvec_memcg(lruvec), PGDEACTIVATE, nr_deactivate);
 
 	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + file, -nr_taken);
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&lruvec->lru_lock);
 
 	mem_cgroup_uncharge_list(&l_active);
 	free_unref_page_list(&l_active);
@@ -2117,6 +2279,7 @@ unsigned long reclaim_pages(struct list_head *page_list)
 		.may_writepage = 1,
 		.may_unmap = 1,
 		.may_swap = 1,
+		.no_demotion = 1,
 	};
 
 	while (!list_empty(page_list)) {
@@ -2248,7 +2411,8 @@ static void get_scan_count(struct lruvec *lruvec, struct scan_control *sc,
 	enum lru_list lru;
 
 	/* If we have no swap space, do not bother scanning anon pages. */
-	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, lruvec_pgdat(lruvec)->node_id, sc)) {
 		scan_balance = SCAN_FILE;
 		goto out;
 	}
@@ -2431,149 +2595,1161 @@ static void get_scan_count(struct lruvec *lruvec, struct scan_control *sc,
 	}
 }
 
-static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
-{
-	unsigned long nr[NR_LRU_LISTS];
-	unsigned long targets[NR_LRU_LISTS];
-	unsigned long nr_to_scan;
-	enum lru_list lru;
-	unsigned long nr_reclaimed = 0;
-	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
-	struct blk_plug plug;
-	bool scan_adjusted;
+#ifdef CONFIG_LRU_GEN
+/*
+ * Multi-gen LRU
+ *
+ * Instead of the active and inactive lists, each lruvec sorts its evictable
+ * pages into generations, see struct lru_gen_struct. The aging produces a new
+ * generation by walking the page tables of the processes charged to the
+ * lruvec and promoting the pages found accessed to it; the eviction only
+ * reclaims from the oldest generation of the selected type, and relies on
+ * shrink_page_list() for the final rmap check as the classic LRU does.
+ */
 
-	get_scan_count(lruvec, sc, nr);
+/* the number of pages handled under lru_lock before dropping it */
+#define MAX_LRU_BATCH		64
 
-	/* Record the original scan target for proportional adjustments later */
-	memcpy(targets, nr, sizeof(nr));
+#ifdef CONFIG_LRU_GEN_ENABLED
+DEFINE_STATIC_KEY_TRUE(lru_gen_key);
+#else
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+#endif
 
-	/*
-	 * Global reclaiming within direct reclaim at DEF_PRIORITY is a normal
-	 * event that can occur when there is little memory pressure e.g.
-	 * multiple streaming readers/writers. Hence, we do not abort scanning
-	 * when the requested number of pages are reclaimed when scanning at
-	 * DEF_PRIORITY on the assumption that the fact we are direct
-	 * reclaiming implies that kswapd is not keeping up and it is best to
-	 * do a batch of work at once. For memcg reclaim one check is made to
-	 * abort proportional reclaim if either the file or anon lru has already
-	 * dropped to zero at the first pass.
-	 */
-	scan_adjusted = (!cgroup_reclaim(sc) && !current_is_kswapd() &&
-			 sc->priority == DEF_PRIORITY);
+/* serializes the runtime switch against memcg onlining */
+static DEFINE_MUTEX(lru_gen_mutex);
 
-	blk_start_plug(&plug);
-	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
-					nr[LRU_INACTIVE_FILE]) {
-		unsigned long nr_anon, nr_file, percentage;
-		unsigned long nr_scanned;
+static LIST_HEAD(lru_gen_mm_list);
+static DEFINE_SPINLOCK(lru_gen_mm_lock);
 
-		for_each_evictable_lru(lru) {
-			if (nr[lru]) {
-				nr_to_scan = min(nr[lru], SWAP_CLUSTER_MAX);
-				nr[lru] -= nr_to_scan;
+#define for_each_gen_type_zone(gen, type, zone)				\
+	for ((gen) = 0; (gen) < MAX_NR_GENS; (gen)++)			\
+		for ((type) = 0; (type) < ANON_AND_FILE; (type)++)	\
+			for ((zone) = 0; (zone) < MAX_NR_ZONES; (zone)++)
 
-				nr_reclaimed += shrink_list(lru, nr_to_scan,
-							    lruvec, sc);
-			}
-		}
+static struct lruvec *get_lruvec(struct mem_cgroup *memcg, int nid)
+{
+	struct pglist_data *pgdat = NODE_DATA(nid);
 
-		cond_resched();
+#ifdef CONFIG_MEMCG
+	if (memcg) {
+		struct lruvec *lruvec = &mem_cgroup_nodeinfo(memcg, nid)->lruvec;
 
-		if (nr_reclaimed < nr_to_reclaim || scan_adjusted)
-			continue;
+		/* see the comment in mem_cgroup_lruvec() */
+		if (pgdat && lruvec->pgdat != pgdat)
+			lruvec->pgdat = pgdat;
 
-		/*
-		 * For kswapd and memcg, reclaim at least the number of pages
-		 * requested. Ensure that the anon and file LRUs are scanned
-		 * proportionally what was requested by get_scan_count(). We
-		 * stop reclaiming one LRU and reduce the amount scanning
-		 * proportional to the original scan target.
-		 */
-		nr_file = nr[LRU_INACTIVE_FILE] + nr[LRU_ACTIVE_FILE];
-		nr_anon = nr[LRU_INACTIVE_ANON] + nr[LRU_ACTIVE_ANON];
+		return lruvec;
+	}
+#endif
+	return pgdat ? &pgdat->__lruvec : NULL;
+}
 
-		/*
-		 * It's just vindictive to attack the larger once the smaller
-		 * has gone to zero.  And given the way we stop scanning the
-		 * smaller below, this makes sure that we only make one nudge
-		 * towards proportionality once we've got nr_to_reclaim.
-		 */
-		if (!nr_file || !nr_anon)
-			break;
+static int get_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
 
-		if (nr_file > nr_anon) {
-			unsigned long scan_target = targets[LRU_INACTIVE_ANON] +
-						targets[LRU_ACTIVE_ANON] + 1;
-			lru = LRU_BASE;
-			percentage = nr_anon * 100 / scan_target;
-		} else {
-			unsigned long scan_target = targets[LRU_INACTIVE_FILE] +
-						targets[LRU_ACTIVE_FILE] + 1;
-			lru = LRU_FILE;
-			percentage = nr_file * 100 / scan_target;
-		}
+	return lrugen->max_seq - lrugen->min_seq[type] + 1;
+}
 
-		/* Stop scanning the smaller of the LRU */
-		nr[lru] = 0;
-		nr[lru + LRU_ACTIVE] = 0;
+static bool lru_gen_is_empty(struct lruvec *lruvec, int gen, int type)
+{
+	int zone;
 
-		/*
-		 * Recalculate the other LRU scan count based on its original
-		 * scan target and the percentage scanning already complete
-		 */
-		lru = (lru == LRU_FILE) ? LRU_BASE : LRU_FILE;
-		nr_scanned = targets[lru] - nr[lru];
-		nr[lru] = targets[lru] * (100 - percentage) / 100;
-		nr[lru] -= min(nr[lru], nr_scanned);
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		if (!list_empty(&lruvec->lrugen.lists[gen][type][zone]))
+			return false;
+	}
 
-		lru += LRU_ACTIVE;
-		nr_scanned = targets[lru] - nr[lru];
-		nr[lru] = targets[lru] * (100 - percentage) / 100;
-		nr[lru] -= min(nr[lru], nr_scanned);
+	return true;
+}
 
-		scan_adjusted = true;
-	}
-	blk_finish_plug(&plug);
-	sc->nr_reclaimed += nr_reclaimed;
+/*
+ * Like get_scan_count(), but returns the swappiness used to balance the two
+ * types: 0 means file pages only.
+ */
+static int get_swappiness(struct lruvec *lruvec, struct scan_control *sc)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	int swappiness = mem_cgroup_swappiness(memcg);
 
-	/*
-	 * Even if we did not try to evict anon pages at all, we want to
-	 * rebalance the anon lru active/inactive ratio.
-	 */
-	if (total_swap_pages && inactive_is_low(lruvec, LRU_INACTIVE_ANON))
-		shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
-				   sc, LRU_ACTIVE_ANON);
+	if (!sc->may_swap ||
+	    !can_reclaim_anon_pages(memcg, lruvec_pgdat(lruvec)->node_id, sc))
+		return 0;
+
+	if (cgroup_reclaim(sc) && !swappiness)
+		return 0;
+
+	/* If the system is almost out of file pages, force-evict anon. */
+	if (sc->file_is_tiny)
+		return 200;
+
+	return swappiness;
 }
 
-/* Use reclaim/compaction for costly allocs or under memory pressure */
-static bool in_reclaim_compaction(struct scan_control *sc)
+void lru_gen_add_mm(struct mm_struct *mm)
 {
-	if (IS_ENABLED(CONFIG_COMPACTION) && sc->order &&
-			(sc->order > PAGE_ALLOC_COSTLY_ORDER ||
-			 sc->priority < DEF_PRIORITY - 2))
+	spin_lock(&lru_gen_mm_lock);
+	list_add_tail(&mm->lru_gen_list, &lru_gen_mm_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	spin_lock(&lru_gen_mm_lock);
+	list_del(&mm->lru_gen_list);
+	spin_unlock(&lru_gen_mm_lock);
+}
+
+/* whether the pages of @mm are expected to be charged to @memcg */
+static bool lru_gen_mm_is_target(struct mm_struct *mm, struct mem_cgroup *memcg)
+{
+#ifdef CONFIG_MEMCG
+	struct task_struct *task;
+	bool match;
+
+	if (mem_cgroup_disabled())
 		return true;
 
-	return false;
+	rcu_read_lock();
+	task = rcu_dereference(mm->owner);
+	match = task && mem_cgroup_from_task(task) == memcg;
+	rcu_read_unlock();
+
+	return match;
+#else
+	return true;
+#endif
 }
 
+struct lru_gen_mm_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	unsigned long max_seq;
+	bool can_swap;
+	/* the number of pages moved, and the deltas not yet applied */
+	int batched;
+	int nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+};
+
 /*
- * Reclaim/compaction is used for high-order allocation requests. It reclaims
- * order-0 pages before compacting the zone. should_continue_reclaim() returns
- * true if more pages should be reclaimed such that when the page allocator
- * calls try_to_compact_pages() that it will have enough free pages to succeed.
- * It will give up earlier than that if there is difficulty reclaiming pages.
+ * Moves @page to @gen unless it has been isolated meanwhile, and returns the
+ * generation it was in, or -1.
  */
-static inline bool should_continue_reclaim(struct pglist_data *pgdat,
-					unsigned long nr_reclaimed,
-					struct scan_control *sc)
+static int page_update_gen(struct page *page, int gen)
 {
-	unsigned long pages_for_compaction;
-	unsigned long inactive_lru_pages;
-	int z;
+	unsigned long old_flags, flags;
 
-	/* If not in reclaim/compaction mode, stop */
-	if (!in_reclaim_compaction(sc))
-		return false;
+	do {
+		old_flags = flags = READ_ONCE(page->flags);
+		if (!(flags & LRU_GEN_MASK))
+			return -1;
+
+		flags &= ~LRU_GEN_MASK;
+		flags |= (gen + 1UL) << LRU_GEN_PGOFF;
+	} while (unlikely(cmpxchg(&page->flags, old_flags, flags) != old_flags));
+
+	return lru_gen_from_flags(old_flags);
+}
+
+/*
+ * The pages of the oldest generation that the eviction can't take, or that
+ * are folded by the aging, are moved to the next generation. Pages promoted
+ * by the aging meanwhile are left where they are. Returns the generation
+ * @page ends up in.
+ */
+static int page_inc_gen(struct lruvec *lruvec, struct page *page)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type = page_is_file_lru(page);
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	unsigned long old_flags, flags;
+
+	do {
+		old_flags = flags = READ_ONCE(page->flags);
+		if (lru_gen_from_flags(flags) != old_gen)
+			return lru_gen_from_flags(flags);
+
+		flags &= ~LRU_GEN_MASK;
+		flags |= (new_gen + 1UL) << LRU_GEN_PGOFF;
+	} while (unlikely(cmpxchg(&page->flags, old_flags, flags) != old_flags));
+
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+
+	return new_gen;
+}
+
+static void reset_batch_size(struct lru_gen_mm_walk *walk)
+{
+	struct lruvec *lruvec = walk->lruvec;
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
+
+	walk->batched = 0;
+
+	spin_lock_irq(&walk->lruvec->lru_lock);
+
+	for_each_gen_type_zone(gen, type, zone) {
+		enum lru_list lru = type * LRU_FILE;
+		int delta = walk->nr_pages[gen][type][zone];
+
+		if (!delta)
+			continue;
+
+		walk->nr_pages[gen][type][zone] = 0;
+		WRITE_ONCE(lrugen->nr_pages[gen][type][zone],
+			   lrugen->nr_pages[gen][type][zone] + delta);
+
+		if (lru_gen_is_active(lruvec, gen))
+			lru += LRU_ACTIVE;
+		update_lru_size(lruvec, lru, zone, delta);
+	}
+
+	spin_unlock_irq(&walk->lruvec->lru_lock);
+}
+
+/* returns the head of @page if it belongs to the lruvec being aged */
+static struct page *get_walk_page(struct lru_gen_mm_walk *walk,
+				  struct page *page)
+{
+	if (page_pgdat(page) != walk->pgdat)
+		return NULL;
+
+	page = compound_head(page);
+	if (page_lru_gen(page) < 0)
+		return NULL;
+
+	if (!walk->can_swap && !page_is_file_lru(page))
+		return NULL;
+
+	if (mem_cgroup_page_lruvec(page, walk->pgdat) != walk->lruvec)
+		return NULL;
+
+	return page;
+}
+
+static void promote_page(struct lru_gen_mm_walk *walk, struct page *page)
+{
+	int type = page_is_file_lru(page);
+	int zone = page_zonenum(page);
+	int delta = thp_nr_pages(page);
+	int new_gen = lru_gen_from_seq(walk->max_seq);
+	int old_gen = page_update_gen(page, new_gen);
+
+	if (old_gen >= 0 && old_gen != new_gen) {
+		walk->nr_pages[old_gen][type][zone] -= delta;
+		walk->nr_pages[new_gen][type][zone] += delta;
+		walk->batched++;
+	}
+}
+
+static int should_skip_vma(unsigned long start, unsigned long end,
+			   struct mm_walk *args)
+{
+	struct vm_area_struct *vma = args->vma;
+	struct lru_gen_mm_walk *walk = args->private;
+	struct address_space *mapping;
+
+	if (!vma_is_accessible(vma) || is_vm_hugetlb_page(vma) ||
+	    (vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_SEQ_READ)))
+		return 1;
+
+	if (vma_is_anonymous(vma))
+		return !walk->can_swap;
+
+	if (WARN_ON_ONCE(!vma->vm_file || !vma->vm_file->f_mapping))
+		return 1;
+
+	mapping = vma->vm_file->f_mapping;
+	if (mapping_unevictable(mapping))
+		return 1;
+
+	/* tmpfs and shm pages can only be reclaimed by swapping */
+	if (shmem_mapping(mapping))
+		return !walk->can_swap;
+
+	/* to exclude special mappings like dax */
+	return !mapping->a_ops->readpage;
+}
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static void walk_pmd_huge(pmd_t *pmd, unsigned long addr,
+			  struct mm_walk *args)
+{
+	struct lru_gen_mm_walk *walk = args->private;
+	struct page *page;
+	pmd_t val = *pmd;
+
+	if (!pmd_trans_huge(val) || !pmd_young(val) || is_huge_zero_pmd(val))
+		return;
+
+	page = get_walk_page(walk, pmd_page(val));
+	if (!page)
+		return;
+
+	if (pmdp_test_and_clear_young(args->vma, addr, pmd))
+		promote_page(walk, page);
+}
+#else
+static void walk_pmd_huge(pmd_t *pmd, unsigned long addr,
+			  struct mm_walk *args)
+{
+}
+#endif
+
+static int walk_pmd_range(pmd_t *pmd, unsigned long start, unsigned long end,
+			  struct mm_walk *args)
+{
+	struct lru_gen_mm_walk *walk = args->private;
+	struct vm_area_struct *vma = args->vma;
+	pte_t *pte, *orig_pte;
+	unsigned long addr;
+	spinlock_t *ptl;
+
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		walk_pmd_huge(pmd, start, args);
+		spin_unlock(ptl);
+		goto done;
+	}
+
+	if (pmd_trans_unstable(pmd))
+		goto done;
+
+	orig_pte = pte = pte_offset_map_lock(args->mm, pmd, start, &ptl);
+	for (addr = start; addr != end; pte++, addr += PAGE_SIZE) {
+		struct page *page;
+
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page)
+			continue;
+
+		page = get_walk_page(walk, page);
+		if (!page)
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			promote_page(walk, page);
+	}
+	pte_unmap_unlock(orig_pte, ptl);
+done:
+	if (walk->batched >= MAX_LRU_BATCH)
+		reset_batch_size(walk);
+
+	cond_resched();
+
+	return 0;
+}
+
+static void walk_mm(struct mm_struct *mm, struct lru_gen_mm_walk *walk)
+{
+	static const struct mm_walk_ops mm_walk_ops = {
+		.test_walk = should_skip_vma,
+		.pmd_entry = walk_pmd_range,
+	};
+
+	if (!mmap_read_trylock(mm))
+		return;
+
+	if (mm->highest_vm_end)
+		walk_page_range(mm, 0, mm->highest_vm_end, &mm_walk_ops, walk);
+
+	mmap_read_unlock(mm);
+
+	if (walk->batched)
+		reset_batch_size(walk);
+}
+
+/*
+ * Walks the mms whose owner is charged to the memcg of the lruvec being aged.
+ * The walker holds a reference on the mm it's walking, which keeps that mm on
+ * lru_gen_mm_list and therefore a valid position to resume from.
+ */
+static void walk_mm_list(struct lru_gen_mm_walk *walk)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(walk->lruvec);
+	struct list_head *pos = &lru_gen_mm_list;
+	struct mm_struct *prev = NULL;
+
+	for (;;) {
+		struct mm_struct *mm = NULL;
+
+		spin_lock(&lru_gen_mm_lock);
+		for (pos = pos->next; pos != &lru_gen_mm_list; pos = pos->next) {
+			mm = list_entry(pos, struct mm_struct, lru_gen_list);
+			if (lru_gen_mm_is_target(mm, memcg) && mmget_not_zero(mm))
+				break;
+			mm = NULL;
+		}
+		spin_unlock(&lru_gen_mm_lock);
+
+		/* we might be the last user and can't block in __mmput() */
+		if (prev)
+			mmput_async(prev);
+
+		if (!mm)
+			break;
+
+		walk_mm(mm, walk);
+		prev = mm;
+
+		cond_resched();
+	}
+}
+
+/*
+ * Folds the oldest generation of @type into the next one. Returns false if
+ * lru_lock needs to be dropped before making further progress.
+ */
+static bool inc_min_seq(struct lruvec *lruvec, int type, bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int remaining = MAX_LRU_BATCH;
+	int zone;
+
+	/*
+	 * Anon pages can't be evicted without swap, so leave them where they
+	 * are: their generation becomes the youngest one once max_seq is
+	 * incremented, see inc_max_seq().
+	 */
+	if (type == LRU_GEN_ANON && !can_swap)
+		goto done;
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+			int new_gen = page_inc_gen(lruvec, page);
+
+			list_move_tail(&page->lru,
+				       &lrugen->lists[new_gen][type][zone]);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+done:
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+
+	return true;
+}
+
+/* retires the oldest generations of each type once the eviction emptied them */
+static void try_to_inc_min_seq(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int type;
+
+	lockdep_assert_held(&lruvec->lru_lock);
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		while (get_nr_gens(lruvec, type) > MIN_NR_GENS &&
+		       lru_gen_is_empty(lruvec,
+					lru_gen_from_seq(lrugen->min_seq[type]),
+					type))
+			WRITE_ONCE(lrugen->min_seq[type],
+				   lrugen->min_seq[type] + 1);
+	}
+}
+
+static void inc_max_seq(struct lruvec *lruvec, bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int prev, next, type, zone;
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	try_to_inc_min_seq(lruvec);
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		while (get_nr_gens(lruvec, type) == MAX_NR_GENS &&
+		       !inc_min_seq(lruvec, type, can_swap)) {
+			spin_unlock_irq(&lruvec->lru_lock);
+			cond_resched();
+			spin_lock_irq(&lruvec->lru_lock);
+		}
+	}
+
+	/*
+	 * Update the active/inactive LRU sizes: max_seq - 1 leaves the two
+	 * youngest generations, and max_seq + 1 is not necessarily empty, see
+	 * inc_min_seq().
+	 */
+	prev = lru_gen_from_seq(lrugen->max_seq - 1);
+	next = lru_gen_from_seq(lrugen->max_seq + 1);
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone] -
+				     lrugen->nr_pages[next][type][zone];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru, zone, delta);
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+		}
+	}
+
+	WRITE_ONCE(lrugen->max_seq, lrugen->max_seq + 1);
+	lrugen->aging = false;
+
+	spin_unlock_irq(&lruvec->lru_lock);
+}
+
+/*
+ * Produces a new generation unless @max_seq has already been retired or
+ * another aging pass is in progress for @lruvec. Returns false in the latter
+ * case.
+ */
+static bool try_to_inc_max_seq(struct lruvec *lruvec, unsigned long max_seq,
+			       bool can_swap)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lru_gen_mm_walk walk = {
+		.lruvec = lruvec,
+		.pgdat = pgdat,
+		.max_seq = max_seq,
+		.can_swap = can_swap,
+	};
+
+	spin_lock_irq(&lruvec->lru_lock);
+	if (lrugen->aging || max_seq != lrugen->max_seq) {
+		bool aged = !lrugen->aging;
+
+		spin_unlock_irq(&lruvec->lru_lock);
+		return aged;
+	}
+	lrugen->aging = true;
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	walk_mm_list(&walk);
+	inc_max_seq(lruvec, can_swap);
+
+	return true;
+}
+
+/* whether there is an evictable generation of @type */
+static bool can_evict(struct lruvec *lruvec, int type)
+{
+	return get_nr_gens(lruvec, type) > MIN_NR_GENS;
+}
+
+static bool should_age(struct lruvec *lruvec, int swappiness)
+{
+	return !can_evict(lruvec, LRU_GEN_FILE) &&
+	       (!swappiness || !can_evict(lruvec, LRU_GEN_ANON));
+}
+
+/*
+ * Proactively ages the lruvecs of @pgdat from kswapd, so that direct reclaim
+ * can usually evict without walking page tables first.
+ */
+static void lru_gen_age_node(struct pglist_data *pgdat,
+			     struct scan_control *sc)
+{
+	struct mem_cgroup *memcg;
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		struct lruvec *lruvec = mem_cgroup_lruvec(memcg, pgdat);
+		int swappiness = get_swappiness(lruvec, sc);
+
+		if (READ_ONCE(lruvec->lrugen.enabled) &&
+		    should_age(lruvec, swappiness))
+			try_to_inc_max_seq(lruvec,
+					   READ_ONCE(lruvec->lrugen.max_seq),
+					   swappiness);
+
+		cond_resched();
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+}
+
+/*
+ * Picks the evictable type that is behind its share of @scanned, the share
+ * being set by the reclaim costs the same way get_scan_count() does. Returns
+ * -1 if the aging needs to run first.
+ */
+static int get_type_to_scan(struct lruvec *lruvec, int swappiness,
+			    unsigned long *scanned)
+{
+	u64 weight[ANON_AND_FILE];
+	int type;
+
+	if (!swappiness)
+		return can_evict(lruvec, LRU_GEN_FILE) ? LRU_GEN_FILE : -1;
+
+	weight[LRU_GEN_ANON] = (u64)swappiness * (lruvec->file_cost + 1);
+	weight[LRU_GEN_FILE] = (u64)(200 - swappiness) *
+			       (lruvec->anon_cost + 1);
+
+	if (scanned[LRU_GEN_ANON] * weight[LRU_GEN_FILE] <
+	    scanned[LRU_GEN_FILE] * weight[LRU_GEN_ANON])
+		type = LRU_GEN_ANON;
+	else if (scanned[LRU_GEN_ANON] * weight[LRU_GEN_FILE] >
+		 scanned[LRU_GEN_FILE] * weight[LRU_GEN_ANON])
+		type = LRU_GEN_FILE;
+	else
+		type = weight[LRU_GEN_ANON] > weight[LRU_GEN_FILE] ?
+		       LRU_GEN_ANON : LRU_GEN_FILE;
+
+	if (can_evict(lruvec, type))
+		return type;
+
+	return can_evict(lruvec, !type) ? !type : -1;
+}
+
+/*
+ * Isolates up to SWAP_CLUSTER_MAX pages of @type from the oldest generation
+ * onto @dst. Pages promoted by the aging meanwhile are sorted into their own
+ * generations, and those that can't be taken by this reclaim are moved to the
+ * next generation, so that the oldest one can be retired. Returns the number
+ * of pages scanned.
+ */
+/* Pin the page and take it off the LRU, as isolate_lru_pages() does. */
+static bool isolate_lru_gen_page(struct page *page, isolate_mode_t mode)
+{
+	if (__isolate_lru_page_prepare(page, mode))
+		return false;
+
+	if (unlikely(!get_page_unless_zero(page)))
+		return false;
+
+	if (!TestClearPageLRU(page)) {
+		put_page(page);
+		return false;
+	}
+
+	return true;
+}
+
+static unsigned long isolate_lru_gen_pages(struct lruvec *lruvec,
+					   struct scan_control *sc, int type,
+					   struct list_head *dst,
+					   unsigned long *nr_taken)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	isolate_mode_t mode = (sc->may_unmap ? 0 : ISOLATE_UNMAPPED);
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	unsigned long nr_scanned = 0;
+	int remaining = MAX_LRU_BATCH;
+	int zone;
+
+	*nr_taken = 0;
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+			int nr_pages = thp_nr_pages(page);
+			int new_gen = page_lru_gen(page);
+
+			VM_BUG_ON_PAGE(new_gen < 0, page);
+
+			nr_scanned += nr_pages;
+
+			if (new_gen == gen &&
+			    (zone > sc->reclaim_idx ||
+			     !isolate_lru_gen_page(page, mode)))
+				new_gen = page_inc_gen(lruvec, page);
+
+			if (new_gen != gen) {
+				list_move(&page->lru,
+					  &lrugen->lists[new_gen][type][zone]);
+			} else {
+				lru_gen_del_page(lruvec, page, true);
+				list_add(&page->lru, dst);
+				*nr_taken += nr_pages;
+			}
+
+			if (!--remaining || *nr_taken >= SWAP_CLUSTER_MAX)
+				return nr_scanned;
+		}
+	}
+
+	return nr_scanned;
+}
+
+static unsigned long evict_pages(struct lruvec *lruvec,
+				 struct scan_control *sc, int type)
+{
+	LIST_HEAD(page_list);
+	unsigned long nr_scanned, nr_taken;
+	unsigned int nr_reclaimed;
+	struct reclaim_stat stat;
+	enum vm_event_item item;
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	nr_scanned = isolate_lru_gen_pages(lruvec, sc, type, &page_list,
+					   &nr_taken);
+	try_to_inc_min_seq(lruvec);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, nr_taken);
+	item = current_is_kswapd() ? PGSCAN_KSWAPD : PGSCAN_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_taken);
+	__count_memcg_events(memcg, item, nr_taken);
+	__count_vm_events(PGSCAN_ANON + type, nr_taken);
+
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	if (!nr_taken)
+		return nr_scanned;
+
+	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, &stat, false);
+
+	spin_lock_irq(&lruvec->lru_lock);
+
+	move_pages_to_lru(lruvec, &page_list);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr_taken);
+	item = current_is_kswapd() ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_reclaimed);
+	__count_memcg_events(memcg, item, nr_reclaimed);
+	__count_vm_events(PGSTEAL_ANON + type, nr_reclaimed);
+
+	spin_unlock_irq(&lruvec->lru_lock);
+
+	lru_note_cost(lruvec, type, stat.nr_pageout);
+
+	mem_cgroup_uncharge_list(&page_list);
+	free_unref_page_list(&page_list);
+
+	/* see shrink_inactive_list() */
+	if (stat.nr_unqueued_dirty == nr_taken)
+		wakeup_flusher_threads(WB_REASON_VMSCAN);
+
+	sc->nr.dirty += stat.nr_dirty;
+	sc->nr.congested += stat.nr_congested;
+	sc->nr.unqueued_dirty += stat.nr_unqueued_dirty;
+	sc->nr.writeback += stat.nr_writeback;
+	sc->nr.immediate += stat.nr_immediate;
+	sc->nr.taken += nr_taken;
+	if (type == LRU_GEN_FILE)
+		sc->nr.file_taken += nr_taken;
+	sc->nr_reclaimed += nr_reclaimed;
+
+	trace_mm_vmscan_lru_shrink_inactive(pgdat->node_id, nr_scanned,
+			nr_reclaimed, &stat, sc->priority, type);
+
+	return nr_scanned;
+}
+
+static unsigned long get_nr_to_scan(struct lruvec *lruvec,
+				    struct scan_control *sc, int swappiness)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long size = 0;
+	int gen, type, zone;
+
+	for_each_gen_type_zone(gen, type, zone) {
+		if (type == LRU_GEN_ANON && !swappiness)
+			continue;
+
+		size += max(READ_ONCE(lrugen->nr_pages[gen][type][zone]), 0L);
+	}
+
+	/* see get_scan_count() */
+	if (!(size >> sc->priority) && !mem_cgroup_online(lruvec_memcg(lruvec)))
+		return min(size, SWAP_CLUSTER_MAX);
+
+	return size >> sc->priority;
+}
+
+static bool lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+	unsigned long scanned[ANON_AND_FILE] = {};
+	unsigned long nr_to_scan;
+	struct blk_plug plug;
+	bool aged = false;
+	int swappiness;
+
+	if (!lru_gen_enabled() || !READ_ONCE(lruvec->lrugen.enabled))
+		return false;
+
+	swappiness = get_swappiness(lruvec, sc);
+	nr_to_scan = get_nr_to_scan(lruvec, sc, swappiness);
+
+	lru_add_drain();
+
+	blk_start_plug(&plug);
+
+	while (scanned[LRU_GEN_ANON] + scanned[LRU_GEN_FILE] < nr_to_scan) {
+		int type = get_type_to_scan(lruvec, swappiness, scanned);
+		unsigned long delta;
+
+		/* age at most once, the aging might not produce anything */
+		if (type < 0) {
+			if (aged || !try_to_inc_max_seq(lruvec,
+					READ_ONCE(lruvec->lrugen.max_seq),
+					swappiness))
+				break;
+			aged = true;
+			continue;
+		}
+
+		delta = evict_pages(lruvec, sc, type);
+		if (!delta)
+			break;
+
+		scanned[type] += delta;
+		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+
+		cond_resched();
+	}
+
+	blk_finish_plug(&plug);
+
+	return true;
+}
+
+/* moves the pages on the classic LRU lists of @lruvec to its generations */
+static bool fill_evictable(struct lruvec *lruvec)
+{
+	int remaining = MAX_LRU_BATCH;
+	enum lru_list lru;
+
+	for_each_evictable_lru(lru) {
+		struct list_head *head = &lruvec->lists[lru];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			del_page_from_lru_list(page, lruvec, lru);
+			add_page_to_lru_list(page, lruvec, page_lru(page));
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* moves the pages in the generations of @lruvec to the classic LRU lists */
+static bool drain_evictable(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int remaining = MAX_LRU_BATCH;
+	int gen, type, zone;
+
+	for_each_gen_type_zone(gen, type, zone) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+
+		while (!list_empty(head)) {
+			struct page *page = lru_to_page(head);
+
+			del_page_from_lru_list(page, lruvec, page_lru(page));
+			add_page_to_lru_list(page, lruvec, page_lru(page));
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+static void lru_gen_change_state(bool enabled)
+{
+	struct mem_cgroup *memcg;
+
+	cpus_read_lock();
+	get_online_mems();
+	mutex_lock(&lru_gen_mutex);
+
+	if (enabled == lru_gen_enabled())
+		goto unlock;
+
+	if (enabled)
+		static_branch_enable_cpuslocked(&lru_gen_key);
+	else
+		static_branch_disable_cpuslocked(&lru_gen_key);
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		int nid;
+
+		for_each_node(nid) {
+			struct lruvec *lruvec = get_lruvec(memcg, nid);
+			struct pglist_data *pgdat;
+
+			if (!lruvec)
+				continue;
+
+			/* a node that has never been online has no pages */
+			pgdat = lruvec_pgdat(lruvec);
+			if (!pgdat) {
+				lruvec->lrugen.enabled = enabled;
+				continue;
+			}
+
+			spin_lock_irq(&lruvec->lru_lock);
+
+			WRITE_ONCE(lruvec->lrugen.enabled, enabled);
+			while (!(enabled ? fill_evictable(lruvec) :
+					   drain_evictable(lruvec))) {
+				spin_unlock_irq(&lruvec->lru_lock);
+				cond_resched();
+				spin_lock_irq(&lruvec->lru_lock);
+			}
+
+			spin_unlock_irq(&lruvec->lru_lock);
+		}
+
+		cond_resched();
+		memcg = mem_cgroup_iter(NULL, memcg, NULL);
+	} while (memcg);
+unlock:
+	mutex_unlock(&lru_gen_mutex);
+	put_online_mems();
+	cpus_read_unlock();
+}
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
+
+	lrugen->max_seq = MIN_NR_GENS + 1;
+	lrugen->enabled = lru_gen_enabled();
+
+	for_each_gen_type_zone(gen, type, zone)
+		INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+}
+
+#ifdef CONFIG_MEMCG
+void lru_gen_online_memcg(struct mem_cgroup *memcg)
+{
+	int nid;
+
+	mutex_lock(&lru_gen_mutex);
+	for_each_node(nid)
+		get_lruvec(memcg, nid)->lrugen.enabled = lru_gen_enabled();
+	mutex_unlock(&lru_gen_mutex);
+}
+#endif
+
+static ssize_t lru_gen_enabled_show(struct kobject *kobj,
+				    struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t lru_gen_enabled_store(struct kobject *kobj,
+				     struct kobj_attribute *attr,
+				     const char *buf, size_t len)
+{
+	bool enabled;
+
+	if (kstrtobool(buf, &enabled))
+		return -EINVAL;
+
+	lru_gen_change_state(enabled);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr =
+	__ATTR(enabled, 0644, lru_gen_enabled_show, lru_gen_enabled_store);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init init_lru_gen(void)
+{
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	return 0;
+}
+late_initcall(init_lru_gen);
+
+#else /* !CONFIG_LRU_GEN */
+
+static void lru_gen_age_node(struct pglist_data *pgdat,
+			     struct scan_control *sc)
+{
+}
+
+static bool lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+	return false;
+}
+
+#endif /* CONFIG_LRU_GEN */
+
+static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
+{
+	unsigned long nr[NR_LRU_LISTS];
+	unsigned long targets[NR_LRU_LISTS];
+	unsigned long nr_to_scan;
+	enum lru_list lru;
+	unsigned long nr_reclaimed = 0;
+	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	struct blk_plug plug;
+	bool scan_adjusted;
+
+	if (lru_gen_shrink_lruvec(lruvec, sc))
+		return;
+
+	get_scan_count(lruvec, sc, nr);
+
+	/* Record the original scan target for proportional adjustments later */
+	memcpy(targets, nr, sizeof(nr));
+
+	/*
+	 * Global reclaiming within direct reclaim at DEF_PRIORITY is a normal
+	 * event that can occur when there is little memory pressure e.g.
+	 * multiple streaming readers/writers. Hence, we do not abort scanning
+	 * when the requested number of pages are reclaimed when scanning at
+	 * DEF_PRIORITY on the assumption that the fact we are direct
+	 * reclaiming implies that kswapd is not keeping up and it is best to
+	 * do a batch of work at once. For memcg reclaim one check is made to
+	 * abort proportional reclaim if either the file or anon lru has already
+	 * dropped to zero at the first pass.
+	 */
+	scan_adjusted = (!cgroup_reclaim(sc) && !current_is_kswapd() &&
+			 sc->priority == DEF_PRIORITY);
+
+	blk_start_plug(&plug);
+	while (nr[LRU_INACTIVE_ANON] || nr[LRU_ACTIVE_FILE] ||
+					nr[LRU_INACTIVE_FILE]) {
+		unsigned long nr_anon, nr_file, percentage;
+		unsigned long nr_scanned;
+
+		for_each_evictable_lru(lru) {
+			if (nr[lru]) {
+				nr_to_scan = min(nr[lru], SWAP_CLUSTER_MAX);
+				nr[lru] -= nr_to_scan;
+
+				nr_reclaimed += shrink_list(lru, nr_to_scan,
+							    lruvec, sc);
+			}
+		}
+
+		cond_resched();
+
+		if (nr_reclaimed < nr_to_reclaim || scan_adjusted)
+			continue;
+
+		/*
+		 * For kswapd and memcg, reclaim at least the number of pages
+		 * requested. Ensure that the anon and file LRUs are scanned
+		 * proportionally what was requested by get_scan_count(). We
+		 * stop reclaiming one LRU and reduce the amount scanning
+		 * proportional to the original scan target.
+		 */
+		nr_file = nr[LRU_INACTIVE_FILE] + nr[LRU_ACTIVE_FILE];
+		nr_anon = nr[LRU_INACTIVE_ANON] + nr[LRU_ACTIVE_ANON];
+
+		/*
+		 * It's just vindictive to attack the larger once the smaller
+		 * has gone to zero.  And given the way we stop scanning the
+		 * smaller below, this makes sure that we only make one nudge
+		 * towards proportionality once we've got nr_to_reclaim.
+		 */
+		if (!nr_file || !nr_anon)
+			break;
+
+		if (nr_file > nr_anon) {
+			unsigned long scan_target = targets[LRU_INACTIVE_ANON] +
+						targets[LRU_ACTIVE_ANON] + 1;
+			lru = LRU_BASE;
+			percentage = nr_anon * 100 / scan_target;
+		} else {
+			unsigned long scan_target = targets[LRU_INACTIVE_FILE] +
+						targets[LRU_ACTIVE_FILE] + 1;
+			lru = LRU_FILE;
+			percentage = nr_file * 100 / scan_target;
+		}
+
+		/* Stop scanning the smaller of the LRU */
+		nr[lru] = 0;
+		nr[lru + LRU_ACTIVE] = 0;
+
+		/*
+		 * Recalculate the other LRU scan count based on its original
+		 * scan target and the percentage scanning already complete
+		 */
+		lru = (lru == LRU_FILE) ? LRU_BASE : LRU_FILE;
+		nr_scanned = targets[lru] - nr[lru];
+		nr[lru] = targets[lru] * (100 - percentage) / 100;
+		nr[lru] -= min(nr[lru], nr_scanned);
+
+		lru += LRU_ACTIVE;
+		nr_scanned = targets[lru] - nr[lru];
+		nr[lru] = targets[lru] * (100 - percentage) / 100;
+		nr[lru] -= min(nr[lru], nr_scanned);
+
+		scan_adjusted = true;
+	}
+	blk_finish_plug(&plug);
+	sc->nr_reclaimed += nr_reclaimed;
+
+	/*
+	 * Even if we did not try to evict anon pages at all, we want to
+	 * rebalance the anon lru active/inactive ratio.
+	 */
+	if ((total_swap_pages || can_demote(lruvec_pgdat(lruvec)->node_id, sc)) &&
+	    inactive_is_low(lruvec, LRU_INACTIVE_ANON))
+		shrink_active_list(SWAP_CLUSTER_MAX, lruvec,
+				   sc, LRU_ACTIVE_ANON);
+}
+
+/* Use reclaim/compaction for costly allocs or under memory pressure */
+static bool in_reclaim_compaction(struct scan_control *sc)
+{
+	if (IS_ENABLED(CONFIG_COMPACTION) && sc->order &&
+			(sc->order > PAGE_ALLOC_COSTLY_ORDER ||
+			 sc->priority < DEF_PRIORITY - 2))
+		return true;
+
+	return false;
+}
+
+/*
+ * Reclaim/compaction is used for high-order allocation requests. It reclaims
+ * order-0 pages before compacting the zone. should_continue_reclaim() returns
+ * true if more pages should be reclaimed such that when the page allocator
+ * calls try_to_compact_pages() that it will have enough free pages to succeed.
+ * It will give up earlier than that if there is difficulty reclaiming pages.
+ */
+static inline bool should_continue_reclaim(struct pglist_data *pgdat,
+					unsigned long nr_reclaimed,
+					struct scan_control *sc)
+{
+	unsigned long pages_for_compaction;
+	unsigned long inactive_lru_pages;
+	int z;
+
+	/* If not in reclaim/compaction mode, stop */
+	if (!in_reclaim_compaction(sc))
+		return false;
 
 	/*
 	 * Stop if we failed to reclaim any pages from the last SWAP_CLUSTER_MAX
@@ -2610,7 +3786,7 @@ static inline bool should_continue_reclaim(struct pglist_data *pgdat,
 	 */
 	pages_for_compaction = compact_gap(sc->order);
 	inactive_lru_pages = node_page_state(pgdat, NR_INACTIVE_FILE);
-	if (get_nr_swap_pages() > 0)
+	if (can_reclaim_anon_pages(NULL, pgdat->node_id, sc))
 		inactive_lru_pages += node_page_state(pgdat, NR_INACTIVE_ANON);
 
 	return inactive_lru_pages > pages_for_compaction;
@@ -2692,10 +3868,10 @@ static void shrink_node(pg_data_t *pgdat, struct scan_control *sc)
 	/*
 	 * Determine the scan balance between anon and file LRUs.
 	 */
-	spin_lock_irq(&pgdat->lru_lock);
+	spin_lock_irq(&target_lruvec->lru_lock);
 	sc->anon_cost = target_lruvec->anon_cost;
 	sc->file_cost = target_lruvec->file_cost;
-	spin_unlock_irq(&pgdat->lru_lock);
+	spin_unlock_irq(&target_lruvec->lru_lock);
 
 	/*
 	 * Target desirable inactive:active list ratios for the anon
@@ -3369,7 +4545,12 @@ static void age_active_anon(struct pglist_data *pgdat,
 	struct mem_cgroup *memcg;
 	struct lruvec *lruvec;
 
-	if (!total_swap_pages)
+	if (lru_gen_enabled()) {
+		lru_gen_age_node(pgdat, sc);
+		return;
+	}
+
+	if (!total_swap_pages && !can_demote(pgdat->node_id, sc))
 		return;
 
 	lruvec = mem_cgroup_lruvec(NULL, pgdat);
@@ -4276,15 +5457,13 @@ int node_reclaim(struct pglist_data *pgdat, gfp_t gfp_mask, unsigned int order)
  */
 void check_move_unevictable_pages(struct pagevec *pvec)
 {
-	struct lruvec *lruvec;
-	struct pglist_data *pgdat = NULL;
+	struct lruvec *lruvec = NULL;
 	int pgscanned = 0;
 	int pgrescued = 0;
 	int i;
 
 	for (i = 0; i < pvec->nr; i++) {
 		struct page *page = pvec->pages[i];
-		struct pglist_data *pagepgdat = page_pgdat(page);
 		int nr_pages;
 
 		if (PageTransTail(page))
@@ -4293,18 +5472,12 @@ void check_move_unevictable_pages(struct pagevec *pvec)
 		nr_pages = thp_nr_pages(page);
 		pgscanned += nr_pages;
 
-		if (pagepgdat != pgdat) {
-			if (pgdat)
-				spin_unlock_irq(&pgdat->lru_lock);
-			pgdat = pagepgdat;
-			spin_lock_irq(&pgdat->lru_lock);
-		}
-		lruvec = mem_cgroup_page_lruvec(page, pgdat);
-
-		if (!PageLRU(page) || !PageUnevictable(page))
+		/* block memcg migration during page moving between lru */
+		if (!TestClearPageLRU(page))
 			continue;
 
-		if (page_evictable(page)) {
+		lruvec = relock_page_lruvec_irq(page, lruvec);
+		if (page_evictable(page) && PageUnevictable(page)) {
 			enum lru_list lru = page_lru_base_type(page);
 
 			VM_BUG_ON_PAGE(PageActive(page), page);
@@ -4313,12 +5486,15 @@ void check_move_unevictable_pages(struct pagevec *pvec)
 			add_page_to_lru_list(page, lruvec, lru);
 			pgrescued += nr_pages;
 		}
+		SetPageLRU(page);
 	}
 
-	if (pgdat) {
+	if (lruvec) {
 		__count_vm_events(UNEVICTABLE_PGRESCUED, pgrescued);
 		__count_vm_events(UNEVICTABLE_PGSCANNED, pgscanned);
-		spin_unlock_irq(&pgdat->lru_lock);
+		unlock_page_lruvec_irq(lruvec);
+	} else if (pgscanned) {
+		count_vm_events(UNEVICTABLE_PGSCANNED, pgscanned);
 	}
 }
 EXPORT_SYMBOL_GPL(check_move_unevictable_pages);
@@ -150,6 +150,16 @@
 #define ZS_SIZE_CLASSES	(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - ZS_MIN_ALLOC_SIZE, \
 				      ZS_SIZE_CLASS_DELTA) + 1)
 
+/* Objects of each size class kept allocated per CPU for zs_malloc() */
+#define ZS_PCP_CACHE_SIZE	4
+
+/*
+ * Skip background compaction of classes with fewer freeable pages, and
+ * don't retry it more often than this after a pass.
+ */
+#define ZS_COMPACT_MIN_PAGES	32
+#define ZS_COMPACT_INTERVAL	HZ
+
 enum fullness_group {
 	ZS_EMPTY,
 	ZS_ALMOST_EMPTY,
@@ -197,6 +207,13 @@ static struct vfsmount *zsmalloc_mnt;
 static const int fullness_threshold_frac = 4;
 static size_t huge_class_size;
 
+/*
+ * Percentage of a size class's pages that compaction could free, above
+ * which zs_free() kicks background compaction of the pool.  0 disables it.
+ */
+static unsigned int zs_compact_threshold = 30;
+module_param_named(compact_threshold, zs_compact_threshold, uint, 0644);
+
 struct size_class {
 	spinlock_t lock;
 	struct list_head fullness_list[NR_ZS_FULLNESS];
@@ -249,12 +266,25 @@ struct link_free {
 	};
 };
 
+/*
+ * Allocated objects cached for one CPU, so that most zs_malloc() and
+ * zs_free() calls don't need the class lock.  The lock is only taken
+ * from another CPU when the caches are drained, and nests inside the
+ * class lock.
+ */
+struct zs_pcp_cache {
+	spinlock_t lock;
+	unsigned char count[ZS_SIZE_CLASSES];
+	unsigned long handle[ZS_SIZE_CLASSES][ZS_PCP_CACHE_SIZE];
+};
+
 struct zs_pool {
 	const char *name;
 
 	struct size_class *size_class[ZS_SIZE_CLASSES];
 	struct kmem_cache *handle_cachep;
 	struct kmem_cache *zspage_cachep;
+	struct zs_pcp_cache __percpu *pcp;
 
 	atomic_long_t pages_allocated;
 
@@ -262,6 +292,9 @@ struct zs_pool {
 
 	/* Compact classes */
 	struct shrinker shrinker;
+	/* Compact classes in the background once they get fragmented */
+	struct work_struct compact_work;
+	unsigned long compact_next;
 
 #ifdef CONFIG_ZSMALLOC_STAT
 	struct dentry *stat_dentry;
@@ -320,6 +353,8 @@ static void init_deferred_free(struct zs_pool *pool) {}
 static void SetZsPageMovable(struct zs_pool *pool, struct zspage *zspage) {}
 #endif
 
+static bool zs_class_fragmented(struct zs_pool *pool, struct size_class *class);
+
 static int create_cache(struct zs_pool *pool)
 {
 	pool->handle_cachep = kmem_cache_create("zs_handle", ZS_HANDLE_SIZE,
@@ -1400,6 +1435,101 @@ static unsigned long obj_malloc(struct size_class *class,
 }
 
 
+/* Huge classes hold one object per page: don't pin those in the cache */
+static bool zs_pcp_cacheable(struct size_class *class)
+{
+	return class->objs_per_zspage > 1;
+}
+
+static unsigned long zs_pcp_pop(struct zs_pool *pool, struct size_class *class)
+{
+	struct zs_pcp_cache *pcp = raw_cpu_ptr(pool->pcp);
+	unsigned long handle = 0;
+
+	spin_lock(&pcp->lock);
+	if (pcp->count[class->index])
+		handle = pcp->handle[class->index][--pcp->count[class->index]];
+	spin_unlock(&pcp->lock);
+
+	return handle;
+}
+
+static bool zs_pcp_push(struct zs_pool *pool, struct size_class *class,
+			unsigned long handle)
+{
+	struct zs_pcp_cache *pcp;
+	bool ret = false;
+
+	if (!zs_pcp_cacheable(class))
+		return false;
+
+	pcp = raw_cpu_ptr(pool->pcp);
+	spin_lock(&pcp->lock);
+	if (pcp->count[class->index] < ZS_PCP_CACHE_SIZE) {
+		pcp->handle[class->index][pcp->count[class->index]++] = handle;
+		ret = true;
+	}
+	spin_unlock(&pcp->lock);
+
+	return ret;
+}
+
+/*
+ * Allocate objects for up to @nr of @handles from the zspages @class
+ * already has, and stash them in this CPU's cache.  Called with the
+ * class lock held; returns the number of handles used.
+ */
+static int zs_pcp_refill(struct zs_pool *pool, struct size_class *class,
+			 unsigned long *handles, int nr)
+{
+	struct zs_pcp_cache *pcp = this_cpu_ptr(pool->pcp);
+	struct zspage *zspage;
+	unsigned long obj;
+	int used = 0;
+
+	spin_lock(&pcp->lock);
+	while (used < nr && pcp->count[class->index] < ZS_PCP_CACHE_SIZE) {
+		zspage = find_get_zspage(class);
+		if (!zspage)
+			break;
+		obj = obj_malloc(class, zspage, handles[used]);
+		fix_fullness_group(class, zspage);
+		record_obj(handles[used], obj);
+		pcp->handle[class->index][pcp->count[class->index]++] =
+			handles[used++];
+	}
+	spin_unlock(&pcp->lock);
+
+	return used;
+}
+
+static void __zs_free(struct zs_pool *pool, unsigned long handle, bool cache);
+
+/* Give the objects cached on all CPUs back to their zspages */
+static void zs_pcp_drain(struct zs_pool *pool)
+{
+	unsigned long handles[ZS_PCP_CACHE_SIZE];
+	int cpu, i, nr;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_pcp_cache *pcp = per_cpu_ptr(pool->pcp, cpu);
+
+		for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+			if (!READ_ONCE(pcp->count[i]))
+				continue;
+
+			spin_lock(&pcp->lock);
+			nr = pcp->count[i];
+			memcpy(handles, pcp->handle[i], nr * sizeof(handles[0]));
+			pcp->count[i] = 0;
+			spin_unlock(&pcp->lock);
+
+			while (nr)
+				__zs_free(pool, handles[--nr], false);
+		}
+	}
+}
+
 /**
  * zs_malloc - Allocate block of given size from pool.
  * @pool: pool to allocate from
@@ -1413,6 +1543,8 @@ static unsigned long obj_malloc(struct size_class *class,
 unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 {
 	unsigned long handle, obj;
+	unsigned long refill[ZS_PCP_CACHE_SIZE - 1];
+	int nr_refill = 0, used;
 	struct size_class *class;
 	enum fullness_group newfg;
 	struct zspage *zspage;
@@ -1420,13 +1552,26 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
 		return 0;
 
+	/* extra space in chunk to keep the handle */
+	size += ZS_HANDLE_SIZE;
+	class = pool->size_class[get_size_class_index(size)];
+
+	handle = zs_pcp_pop(pool, class);
+	if (handle)
+		return handle;
+
 	handle = cache_alloc_handle(pool, gfp);
 	if (!handle)
 		return 0;
 
-	/* extra space in chunk to keep the handle */
-	size += ZS_HANDLE_SIZE;
-	class = pool->size_class[get_size_class_index(size)];
+	/* handles to stash objects in the per-cpu cache, if they come cheap */
+	while (zs_pcp_cacheable(class) && nr_refill < ARRAY_SIZE(refill)) {
+		refill[nr_refill] = cache_alloc_handle(pool,
+				(gfp & ~__GFP_DIRECT_RECLAIM) | __GFP_NOWARN);
+		if (!refill[nr_refill])
+			break;
+		nr_refill++;
+	}
 
 	spin_lock(&class->lock);
 	zspage = find_get_zspage(class);
@@ -1435,9 +1580,10 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 		/* Now move the zspage to another fullness group, if required */
 		fix_fullness_group(class, zspage);
 		record_obj(handle, obj);
+		used = zs_pcp_refill(pool, class, refill, nr_refill);
 		spin_unlock(&class->lock);
 
-		return handle;
+		goto out;
 	}
 
 	spin_unlock(&class->lock);
@@ -1445,7 +1591,9 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 	zspage = alloc_zspage(pool, class, gfp);
 	if (!zspage) {
 		cache_free_handle(pool, handle);
-		return 0;
+		handle = 0;
+		used = 0;
+		goto out;
 	}
 
 	spin_lock(&class->lock);
@@ -1460,7 +1608,11 @@ unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t gfp)
 
 	/* We completely set up zspage so mark them as movable */
 	SetZsPageMovable(pool, zspage);
+	used = zs_pcp_refill(pool, class, refill, nr_refill);
 	spin_unlock(&class->lock);
+out:
+	while (used < nr_refill)
+		cache_free_handle(pool, refill[used++]);
 
 	return handle;
 }
@@ -1491,7 +1643,7 @@ static void obj_free(struct size_class *class, unsigned long obj)
 	zs_stat_dec(class, OBJ_USED, 1);
 }
 
-void zs_free(struct zs_pool *pool, unsigned long handle)
+static void __zs_free(struct zs_pool *pool, unsigned long handle, bool cache)
 {
 	struct zspage *zspage;
 	struct page *f_page;
@@ -1515,8 +1667,17 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	get_zspage_mapping(zspage, &class_idx, &fullness);
 	class = pool->size_class[class_idx];
 
+	/* keep the object allocated for the next zs_malloc() on this CPU */
+	if (cache && zs_pcp_push(pool, class, handle)) {
+		migrate_read_unlock(zspage);
+		unpin_tag(handle);
+		return;
+	}
+
 	spin_lock(&class->lock);
 	obj_free(class, obj);
+	if (zs_class_fragmented(pool, class))
+		schedule_work(&pool->compact_work);
 	fullness = fix_fullness_group(class, zspage);
 	if (fullness != ZS_EMPTY) {
 		migrate_read_unlock(zspage);
@@ -1534,6 +1695,11 @@ void zs_free(struct zs_pool *pool, unsigned long handle)
 	unpin_tag(handle);
 	cache_free_handle(pool, handle);
 }
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	__zs_free(pool, handle, true);
+}
 EXPORT_SYMBOL_GPL(zs_free);
 
 static void zs_object_copy(struct size_class *class, unsigned long dst,
@@ -2217,6 +2383,24 @@ static unsigned long zs_can_compact(struct size_class *class)
 	return obj_wasted * class->pages_per_zspage;
 }
 
+/* Called with the class lock held */
+static bool zs_class_fragmented(struct zs_pool *pool, struct size_class *class)
+{
+	unsigned long pages, freeable;
+	unsigned int threshold = READ_ONCE(zs_compact_threshold);
+
+	if (!threshold || time_before(jiffies, READ_ONCE(pool->compact_next)))
+		return false;
+
+	freeable = zs_can_compact(class);
+	if (freeable < ZS_COMPACT_MIN_PAGES)
+		return false;
+
+	pages = zs_stat_get(class, OBJ_ALLOCATED) / class->objs_per_zspage *
+		class->pages_per_zspage;
+	return freeable * 100 >= pages * threshold;
+}
+
 static unsigned long __zs_compact(struct zs_pool *pool,
 				  struct size_class *class)
 {
@@ -2274,6 +2458,8 @@ unsigned long zs_compact(struct zs_pool *pool)
 	struct size_class *class;
 	unsigned long pages_freed = 0;
 
+	zs_pcp_drain(pool);
+
 	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--) {
 		class = pool->size_class[i];
 		if (!class)
@@ -2288,6 +2474,15 @@ unsigned long zs_compact(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_compact);
 
+static void zs_compact_work(struct work_struct *work)
+{
+	struct zs_pool *pool = container_of(work, struct zs_pool,
+					    compact_work);
+
+	WRITE_ONCE(pool->compact_next, jiffies + ZS_COMPACT_INTERVAL);
+	zs_compact(pool);
+}
+
 void zs_pool_stats(struct zs_pool *pool, struct zs_pool_stats *stats)
 {
 	memcpy(stats, &pool->stats, sizeof(struct zs_pool_stats));
@@ -2369,6 +2564,14 @@ struct zs_pool *zs_create_pool(const char *name)
 		return NULL;
 
 	init_deferred_free(pool);
+	INIT_WORK(&pool->compact_work, zs_compact_work);
+	pool->compact_next = jiffies;
+
+	pool->pcp = alloc_percpu(struct zs_pcp_cache);
+	if (!pool->pcp)
+		goto err;
+	for_each_possible_cpu(i)
+		spin_lock_init(&per_cpu_ptr(pool->pcp, i)->lock);
 
 	pool->name = kstrdup(name, GFP_KERNEL);
 	if (!pool->name)
@@ -2479,6 +2682,11 @@ void zs_destroy_pool(struct zs_pool *pool)
 	int i;
 
 	zs_unregister_shrinker(pool);
+	/* draining may kick compaction, so cancel it afterwards */
+	if (pool->pcp)
+		zs_pcp_drain(pool);
+	cancel_work_sync(&pool->compact_work);
+	free_percpu(pool->pcp);
 	zs_unregister_migration(pool);
 	zs_pool_stat_destroy(pool);
 
@@ -26,6 +26,9 @@
 #include <linux/crypto.h>
 #include <linux/mempool.h>
 #include <linux/zpool.h>
+#include <linux/list_lru.h>
+#include <linux/memcontrol.h>
+#include <linux/sched/mm.h>
 
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
@@ -53,7 +56,7 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /* Pool limit was hit (see zswap_max_pool_percent) */
 static u64 zswap_pool_limit_hit;
-/* Pages written back when pool limit was reached */
+/* Pages written back when pool limit was reached or by the shrinker */
 static u64 zswap_written_back_pages;
 /* Store failed due to a reclaim failure after pool limit was reached */
 static u64 zswap_reject_reclaim_fail;
@@ -68,6 +71,7 @@ static u64 zswap_duplicate_entry;
 
 /* Shrinker work queue */
 static struct workqueue_struct *shrink_wq;
+static struct work_struct zswap_shrink_work;
 /* Pool limit was hit, we need to calm down */
 static bool zswap_pool_reached_full;
 
@@ -123,6 +127,11 @@ static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 		   bool, 0644);
 
+/* Enable/disable writeback of cold entries under memory pressure */
+static bool zswap_shrinker_enabled = IS_ENABLED(
+		CONFIG_ZSWAP_SHRINKER_DEFAULT_ON);
+module_param_named(shrinker_enabled, zswap_shrinker_enabled, bool, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -133,7 +142,6 @@ struct zswap_pool {
 	struct kref kref;
 	struct list_head list;
 	struct work_struct release_work;
-	struct work_struct shrink_work;
 	struct hlist_node node;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
 };
@@ -145,7 +153,8 @@ struct zswap_pool {
  * page within zswap.
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
- * offset - the swap offset for the entry.  Index into the red-black tree.
+ * swpentry - the swap entry of the page.  Its offset is the index into the
+ *            red-black tree.
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -157,10 +166,12 @@ struct zswap_pool {
  * pool - the zswap_pool the entry's data is in
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
+ * lru - links a compressed entry into the LRU of the memcg that owned the
+ *       page, which the entry itself is charged to
  */
 struct zswap_entry {
 	struct rb_node rbnode;
-	pgoff_t offset;
+	swp_entry_t swpentry;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -168,10 +179,7 @@ struct zswap_entry {
 		unsigned long handle;
 		unsigned long value;
 	};
-};
-
-struct zswap_header {
-	swp_entry_t swpentry;
+	struct list_head lru;
 };
 
 /*
@@ -186,6 +194,13 @@ struct zswap_tree {
 
 static struct zswap_tree *zswap_trees[MAX_SWAPFILES];
 
+/*
+ * Compressed entries, oldest first, on the list of the memcg they are
+ * charged to.  Same-value filled entries have nothing to write back and
+ * are never on it.  Nests inside the tree lock.
+ */
+static struct list_lru zswap_list_lru;
+
 /* RCU-protected iteration */
 static LIST_HEAD(zswap_pools);
 /* protects zswap_pools list modification */
@@ -210,14 +225,9 @@ static bool zswap_has_pool;
 	pr_debug("%s pool %s/%s\n", msg, (p)->tfm_name,		\
 		 zpool_get_type((p)->zpool))
 
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
 
-static const struct zpool_ops zswap_zpool_ops = {
-	.evict = zswap_writeback_entry
-};
-
 static bool zswap_is_full(void)
 {
 	return totalram_pages() * zswap_max_pool_percent / 100 <
@@ -270,6 +280,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -288,9 +299,9 @@ static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
 
 	while (node) {
 		entry = rb_entry(node, struct zswap_entry, rbnode);
-		if (entry->offset > offset)
+		if (swp_offset(entry->swpentry) > offset)
 			node = node->rb_left;
-		else if (entry->offset < offset)
+		else if (swp_offset(entry->swpentry) < offset)
 			node = node->rb_right;
 		else
 			return entry;
@@ -307,13 +318,14 @@ static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
 {
 	struct rb_node **link = &root->rb_node, *parent = NULL;
 	struct zswap_entry *myentry;
+	pgoff_t offset = swp_offset(entry->swpentry);
 
 	while (*link) {
 		parent = *link;
 		myentry = rb_entry(parent, struct zswap_entry, rbnode);
-		if (myentry->offset > entry->offset)
+		if (swp_offset(myentry->swpentry) > offset)
 			link = &(*link)->rb_left;
-		else if (myentry->offset < entry->offset)
+		else if (swp_offset(myentry->swpentry) < offset)
 			link = &(*link)->rb_right;
 		else {
 			*dupentry = myentry;
@@ -342,6 +354,7 @@ static void zswap_free_entry(struct zswap_entry *entry)
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
+		list_lru_del(&zswap_list_lru, &entry->lru);
 		zpool_free(entry->pool->zpool, entry->handle);
 		zswap_pool_put(entry->pool);
 	}
@@ -479,24 +492,6 @@ static struct zswap_pool *zswap_pool_current_get(void)
 	return pool;
 }
 
-static struct zswap_pool *zswap_pool_last_get(void)
-{
-	struct zswap_pool *pool, *last = NULL;
-
-	rcu_read_lock();
-
-	list_for_each_entry_rcu(pool, &zswap_pools, list)
-		last = pool;
-	WARN_ONCE(!last && zswap_has_pool,
-		  "%s: no page storage pool!\n", __func__);
-	if (!zswap_pool_get(last))
-		last = NULL;
-
-	rcu_read_unlock();
-
-	return last;
-}
-
 /* type and compressor must be null-terminated */
 static struct zswap_pool *zswap_pool_find_get(char *type, char *compressor)
 {
@@ -518,16 +513,6 @@ static struct zswap_pool *zswap_pool_find_get(char *type, char *compressor)
 	return NULL;
 }
 
-static void shrink_worker(struct work_struct *w)
-{
-	struct zswap_pool *pool = container_of(w, typeof(*pool),
-						shrink_work);
-
-	if (zpool_shrink(pool->zpool, 1, NULL))
-		zswap_reject_reclaim_fail++;
-	zswap_pool_put(pool);
-}
-
 static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 {
 	struct zswap_pool *pool;
@@ -553,7 +538,7 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	/* unique name for each pool specifically required by zsmalloc */
 	snprintf(name, 38, "zswap%x", atomic_inc_return(&zswap_pools_count));
 
-	pool->zpool = zpool_create_pool(type, name, gfp, &zswap_zpool_ops);
+	pool->zpool = zpool_create_pool(type, name, gfp, NULL);
 	if (!pool->zpool) {
 		pr_err("%s zpool not available\n", type);
 		goto error;
@@ -578,7 +563,6 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	 */
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
-	INIT_WORK(&pool->shrink_work, shrink_worker);
 
 	zswap_pool_debug("created", pool);
 
@@ -856,6 +840,24 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
 	return ZSWAP_SWAPCACHE_EXIST;
 }
 
+static void zswap_decompress(struct zswap_entry *entry, struct page *page)
+{
+	struct crypto_comp *tfm;
+	unsigned int dlen = PAGE_SIZE;
+	u8 *src, *dst;
+	int ret;
+
+	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
+	dst = kmap_atomic(page);
+	tfm = *get_cpu_ptr(entry->pool->tfm);
+	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
+	put_cpu_ptr(entry->pool->tfm);
+	kunmap_atomic(dst);
+	zpool_unmap_handle(entry->pool->zpool, entry->handle);
+	BUG_ON(ret);
+	BUG_ON(dlen != PAGE_SIZE);
+}
+
 /*
  * Attempts to free an entry by adding a page to the swap cache,
  * decompressing the entry data into the page, and issuing a
@@ -867,65 +869,46 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds a reference to @entry.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_entry(struct zswap_tree *tree,
+				 struct zswap_entry *entry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
-	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	swp_entry_t swpentry = entry->swpentry;
 	struct page *page;
-	struct crypto_comp *tfm;
-	u8 *src, *dst;
-	unsigned int dlen;
-	int ret;
 	struct writeback_control wbc = {
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		zpool_unmap_handle(pool, handle);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
-		ret = -ENOMEM;
-		goto fail;
+		return -ENOMEM;
 
 	case ZSWAP_SWAPCACHE_EXIST:
 		/* page is already in the swap cache, ignore for now */
 		put_page(page);
-		ret = -EEXIST;
-		goto fail;
+		return -EEXIST;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
-		/* decompress */
-		dlen = PAGE_SIZE;
-		src = (u8 *)zhdr + sizeof(struct zswap_header);
-		dst = kmap_atomic(page);
-		tfm = *get_cpu_ptr(entry->pool->tfm);
-		ret = crypto_comp_decompress(tfm, src, entry->length,
-					     dst, &dlen);
-		put_cpu_ptr(entry->pool->tfm);
-		kunmap_atomic(dst);
-		BUG_ON(ret);
-		BUG_ON(dlen != PAGE_SIZE);
+		/*
+		 * The locked swap cache page pins the swap slot.  Make sure
+		 * the entry wasn't invalidated and the slot reused before we
+		 * got here, or we would fill the new page with stale data.
+		 */
+		spin_lock(&tree->lock);
+		if (zswap_rb_search(&tree->rbroot, swp_offset(swpentry)) !=
+		    entry) {
+			spin_unlock(&tree->lock);
+			delete_from_swap_cache(page);
+			unlock_page(page);
+			put_page(page);
+			return -ENOMEM;
+		}
+		spin_unlock(&tree->lock);
+
+		zswap_decompress(entry, page);
 
 		/* page is up to date */
 		SetPageUptodate(page);
@@ -937,42 +920,143 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	/* start writeback */
 	__swap_writepage(page, &wbc, end_swap_bio_write);
 	put_page(page);
-	zswap_written_back_pages++;
+	return 0;
+}
 
-	spin_lock(&tree->lock);
-	/* drop local reference */
-	zswap_entry_put(tree, entry);
+/*
+ * Write back one entry on behalf of the LRU walk.  The entry is always
+ * isolated, and put back on the LRU if it could not be written back, so
+ * report it as removed to the walk; @arg counts the entries written back.
+ */
+static enum lru_status zswap_shrink_cb(struct list_head *item,
+				       struct list_lru_one *l,
+				       spinlock_t *lock, void *arg)
+{
+	struct zswap_entry *entry = container_of(item, struct zswap_entry, lru);
+	swp_entry_t swpentry = entry->swpentry;
+	struct zswap_tree *tree = zswap_trees[swp_type(swpentry)];
+	unsigned long *nr_written = arg;
 
 	/*
-	* There are two possible situations for entry here:
-	* (1) refcount is 1(normal case),  entry is valid and on the tree
-	* (2) refcount is 0, entry is freed and not on the tree
-	*     because invalidate happened during writeback
-	*  search the tree and free the entry if find entry
-	*/
-	if (entry == zswap_rb_search(&tree->rbroot, offset))
-		zswap_entry_put(tree, entry);
+	 * Once the LRU lock is dropped the entry may be invalidated and
+	 * freed: don't touch it again until it is found in the tree.
+	 */
+	list_lru_isolate(l, item);
+	spin_unlock(lock);
+
+	spin_lock(&tree->lock);
+	if (entry != zswap_rb_search(&tree->rbroot, swp_offset(swpentry)))
+		goto unlock;
+
+	/* hold a reference to prevent a free during writeback */
+	zswap_entry_get(entry);
 	spin_unlock(&tree->lock);
 
-	goto end;
+	if (zswap_writeback_entry(tree, entry)) {
+		zswap_reject_reclaim_fail++;
+		spin_lock(&tree->lock);
+		/* put it back at the tail, unless invalidated meanwhile */
+		if (!RB_EMPTY_NODE(&entry->rbnode))
+			list_lru_add(&zswap_list_lru, &entry->lru);
+		goto put_unlock;
+	}
+	zswap_written_back_pages++;
+	(*nr_written)++;
 
-	/*
-	* if we get here due to ZSWAP_SWAPCACHE_EXIST
-	* a load may happening concurrently
-	* it is safe and okay to not free the entry
-	* if we free the entry in the following put
-	* it it either okay to return !0
-	*/
-fail:
 	spin_lock(&tree->lock);
+	/*
+	 * The entry is still in the tree unless an invalidate happened
+	 * during writeback; either way the page now lives in the swap
+	 * cache, so drop the compressed copy.
+	 */
+	if (entry == zswap_rb_search(&tree->rbroot, swp_offset(swpentry))) {
+		zswap_rb_erase(&tree->rbroot, entry);
+		zswap_entry_put(tree, entry);
+	}
+put_unlock:
+	/* drop local reference */
 	zswap_entry_put(tree, entry);
+unlock:
 	spin_unlock(&tree->lock);
+	spin_lock(lock);
+	return LRU_REMOVED_RETRY;
+}
 
-end:
-	zpool_unmap_handle(pool, handle);
-	return ret;
+/*
+ * The pool limit was hit: write back the oldest entry of each memcg in
+ * turn, so that no single cgroup's cold data holds the pool full, until
+ * new stores are accepted again or nothing more can be written back.
+ */
+static void shrink_worker(struct work_struct *w)
+{
+	struct mem_cgroup *memcg;
+	unsigned long nr_written;
+	int nid;
+
+	do {
+		nr_written = 0;
+		memcg = mem_cgroup_iter(NULL, NULL, NULL);
+		do {
+			for_each_online_node(nid) {
+				unsigned long nr_to_walk = 1;
+
+				list_lru_walk_one(&zswap_list_lru, nid, memcg,
+						  zswap_shrink_cb, &nr_written,
+						  &nr_to_walk);
+			}
+			if (zswap_can_accept()) {
+				mem_cgroup_iter_break(NULL, memcg);
+				return;
+			}
+			cond_resched();
+		} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+	} while (nr_written);
 }
 
+static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	unsigned long nr_freeable, nr_stored;
+
+	if (!zswap_shrinker_enabled)
+		return 0;
+
+	nr_freeable = list_lru_shrink_count(&zswap_list_lru, sc);
+	nr_stored = atomic_read(&zswap_stored_pages);
+	if (!nr_freeable || !nr_stored)
+		return 0;
+
+	/*
+	 * Writing back an entry only frees its compressed size, so scale
+	 * the count by the compression ratio to avoid pushing zswap out
+	 * harder than the uncompressed memory it competes with.
+	 */
+	return mult_frac(nr_freeable,
+			 DIV_ROUND_UP(zswap_pool_total_size, PAGE_SIZE),
+			 nr_stored);
+}
+
+static unsigned long zswap_shrinker_scan(struct shrinker *shrinker,
+					 struct shrink_control *sc)
+{
+	unsigned long nr_written = 0;
+
+	/* writeback allocates swap cache pages and issues I/O */
+	if (!zswap_shrinker_enabled || !(sc->gfp_mask & __GFP_IO))
+		return SHRINK_STOP;
+
+	list_lru_shrink_walk(&zswap_list_lru, sc, zswap_shrink_cb,
+			     &nr_written);
+	return nr_written;
+}
+
+static struct shrinker zswap_shrinker = {
+	.count_objects = zswap_shrinker_count,
+	.scan_objects = zswap_shrinker_scan,
+	.seeks = DEFAULT_SEEKS,
+	.flags = SHRINKER_NUMA_AWARE | SHRINKER_MEMCG_AWARE,
+};
+
 static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
 {
 	unsigned int pos;
@@ -1004,13 +1088,13 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry, *dupentry;
+	struct mem_cgroup *memcg, *old_memcg;
 	struct crypto_comp *tfm;
 	int ret;
-	unsigned int hlen, dlen = PAGE_SIZE;
+	unsigned int dlen = PAGE_SIZE;
 	unsigned long handle, value;
 	char *buf;
 	u8 *src, *dst;
-	struct zswap_header zhdr = { .swpentry = swp_entry(type, offset) };
 	gfp_t gfp;
 
 	/* THP isn't supported */
@@ -1026,13 +1110,9 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 
 	/* reclaim space if needed */
 	if (zswap_is_full()) {
-		struct zswap_pool *pool;
-
 		zswap_pool_limit_hit++;
 		zswap_pool_reached_full = true;
-		pool = zswap_pool_last_get();
-		if (pool)
-			queue_work(shrink_wq, &pool->shrink_work);
+		queue_work(shrink_wq, &zswap_shrink_work);
 		ret = -ENOMEM;
 		goto reject;
 	}
@@ -1045,8 +1125,12 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_pool_reached_full = false;
 	}
 
-	/* allocate entry */
-	entry = zswap_entry_cache_alloc(GFP_KERNEL);
+	/* allocate entry, charged to the page's memcg to put it on its LRU */
+	memcg = get_mem_cgroup_from_page(page);
+	old_memcg = set_active_memcg(memcg);
+	entry = zswap_entry_cache_alloc(GFP_KERNEL | __GFP_ACCOUNT);
+	set_active_memcg(old_memcg);
+	mem_cgroup_put(memcg);
 	if (!entry) {
 		zswap_reject_kmemcache_fail++;
 		ret = -ENOMEM;
@@ -1057,7 +1141,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		src = kmap_atomic(page);
 		if (zswap_is_page_same_filled(src, &value)) {
 			kunmap_atomic(src);
-			entry->offset = offset;
+			entry->swpentry = swp_entry(type, offset);
 			entry->length = 0;
 			entry->value = value;
 			atomic_inc(&zswap_same_filled_pages);
@@ -1086,11 +1170,10 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	}
 
 	/* store */
-	hlen = zpool_evictable(entry->pool->zpool) ? sizeof(zhdr) : 0;
 	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
 	if (zpool_malloc_support_movable(entry->pool->zpool))
 		gfp |= __GFP_HIGHMEM | __GFP_MOVABLE;
-	ret = zpool_malloc(entry->pool->zpool, hlen + dlen, gfp, &handle);
+	ret = zpool_malloc(entry->pool->zpool, dlen, gfp, &handle);
 	if (ret == -ENOSPC) {
 		zswap_reject_compress_poor++;
 		goto put_dstmem;
@@ -1100,13 +1183,12 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto put_dstmem;
 	}
 	buf = zpool_map_handle(entry->pool->zpool, handle, ZPOOL_MM_RW);
-	memcpy(buf, &zhdr, hlen);
-	memcpy(buf + hlen, dst, dlen);
+	memcpy(buf, dst, dlen);
 	zpool_unmap_handle(entry->pool->zpool, handle);
 	put_cpu_var(zswap_dstmem);
 
 	/* populate entry */
-	entry->offset = offset;
+	entry->swpentry = swp_entry(type, offset);
 	entry->handle = handle;
 	entry->length = dlen;
 
@@ -1122,6 +1204,8 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	if (entry->length)
+		list_lru_add(&zswap_list_lru, &entry->lru);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1148,10 +1232,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry;
-	struct crypto_comp *tfm;
-	u8 *src, *dst;
-	unsigned int dlen;
-	int ret;
+	u8 *dst;
 
 	/* find */
 	spin_lock(&tree->lock);
@@ -1171,17 +1252,7 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	}
 
 	/* decompress */
-	dlen = PAGE_SIZE;
-	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
-	if (zpool_evictable(entry->pool->zpool))
-		src += sizeof(struct zswap_header);
-	dst = kmap_atomic(page);
-	tfm = *get_cpu_ptr(entry->pool->tfm);
-	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
-	put_cpu_ptr(entry->pool->tfm);
-	kunmap_atomic(dst);
-	zpool_unmap_handle(entry->pool->zpool, entry->handle);
-	BUG_ON(ret);
+	zswap_decompress(entry, page);
 
 freeentry:
 	spin_lock(&tree->lock);
@@ -1352,12 +1423,25 @@ static int __init init_zswap(void)
 	shrink_wq = create_workqueue("zswap-shrink");
 	if (!shrink_wq)
 		goto fallback_fail;
+	INIT_WORK(&zswap_shrink_work, shrink_worker);
+
+	ret = prealloc_shrinker(&zswap_shrinker);
+	if (ret)
+		goto shrinker_fail;
+	ret = list_lru_init_memcg(&zswap_list_lru, &zswap_shrinker);
+	if (ret)
+		goto lru_fail;
+	register_shrinker_prepared(&zswap_shrinker);
 
 	frontswap_register_ops(&zswap_frontswap_ops);
 	if (zswap_debugfs_init())
 		pr_warn("debugfs initialization failed\n");
 	return 0;
 
+lru_fail:
+	free_prealloced_shrinker(&zswap_shrinker);
+shrinker_fail:
+	destroy_workqueue(shrink_wq);
 fallback_fail:
 	if (pool)
 		zswap_pool_destroy(pool);
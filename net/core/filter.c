@@ -3916,6 +3916,91 @@ static const struct bpf_func_proto bpf_xdp_adjust_meta_proto = {
 	.arg2_type	= ARG_ANYTHING,
 };
 
+static const struct xdp_metadata_ops *
+xdp_metadata_ops(const struct xdp_buff *xdp)
+{
+	const struct xdp_rxq_info *rxq = xdp->rxq;
+
+	/* Zero-copy AF_XDP buffers come from the pool, not from the
+	 * driver, and carry no descriptor context.
+	 */
+	if (rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL)
+		return NULL;
+	return rxq->metadata_ops;
+}
+
+BPF_CALL_2(bpf_xdp_metadata_rx_timestamp, struct xdp_buff *, xdp,
+	   u64 *, timestamp)
+{
+	const struct xdp_metadata_ops *ops = xdp_metadata_ops(xdp);
+
+	if (!ops || !ops->xmo_rx_timestamp)
+		return -EOPNOTSUPP;
+
+	return ops->xmo_rx_timestamp(xdp, timestamp);
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_timestamp_proto = {
+	.func		= bpf_xdp_metadata_rx_timestamp,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_LONG,
+};
+
+BPF_CALL_3(bpf_xdp_metadata_rx_hash, struct xdp_buff *, xdp, u32 *, hash,
+	   u32 *, rss_type)
+{
+	const struct xdp_metadata_ops *ops = xdp_metadata_ops(xdp);
+	enum xdp_rss_hash_type type;
+	int err;
+
+	if (!ops || !ops->xmo_rx_hash)
+		return -EOPNOTSUPP;
+
+	err = ops->xmo_rx_hash(xdp, hash, &type);
+	if (!err)
+		*rss_type = type;
+	return err;
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_hash_proto = {
+	.func		= bpf_xdp_metadata_rx_hash,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_INT,
+	.arg3_type	= ARG_PTR_TO_INT,
+};
+
+BPF_CALL_3(bpf_xdp_metadata_rx_vlan_tag, struct xdp_buff *, xdp,
+	   u32 *, vlan_proto, u32 *, vlan_tci)
+{
+	const struct xdp_metadata_ops *ops = xdp_metadata_ops(xdp);
+	__be16 proto;
+	u16 tci;
+	int err;
+
+	if (!ops || !ops->xmo_rx_vlan_tag)
+		return -EOPNOTSUPP;
+
+	err = ops->xmo_rx_vlan_tag(xdp, &proto, &tci);
+	if (!err) {
+		*vlan_proto = be16_to_cpu(proto);
+		*vlan_tci = tci;
+	}
+	return err;
+}
+
+static const struct bpf_func_proto bpf_xdp_metadata_rx_vlan_tag_proto = {
+	.func		= bpf_xdp_metadata_rx_vlan_tag,
+	.gpl_only	= false,
+	.ret_type	= RET_INTEGER,
+	.arg1_type	= ARG_PTR_TO_CTX,
+	.arg2_type	= ARG_PTR_TO_INT,
+	.arg3_type	= ARG_PTR_TO_INT,
+};
+
 static int __bpf_tx_xdp_map(struct net_device *dev_rx, void *fwd,
 			    struct bpf_map *map, struct xdp_buff *xdp)
 {
@@ -3974,6 +4059,39 @@ void bpf_clear_redirect_map(struct bpf_map *map)
 	}
 }
 
+DEFINE_STATIC_KEY_FALSE(bpf_master_redirect_enabled_key);
+EXPORT_SYMBOL_GPL(bpf_master_redirect_enabled_key);
+
+u32 xdp_master_redirect(struct xdp_buff *xdp)
+{
+	struct net_device *master, *slave;
+	struct bpf_redirect_info *ri;
+
+	if (!netif_is_bond_slave(xdp->rxq->dev))
+		return XDP_TX;
+
+	master = netdev_master_upper_dev_get_rcu(xdp->rxq->dev);
+	if (!master || !master->netdev_ops->ndo_xdp_get_xmit_slave)
+		return XDP_TX;
+
+	slave = master->netdev_ops->ndo_xdp_get_xmit_slave(master, xdp);
+	if (slave && slave != xdp->rxq->dev) {
+		/* The target device is different from the receiving device,
+		 * so redirect it to the new device. Using XDP_REDIRECT gets
+		 * the frames bulked on the target device as well.
+		 */
+		ri = this_cpu_ptr(&bpf_redirect_info);
+		ri->flags = 0;
+		ri->tgt_index = slave->ifindex;
+		ri->tgt_value = NULL;
+		WRITE_ONCE(ri->map, NULL);
+		return XDP_REDIRECT;
+	}
+
+	return XDP_TX;
+}
+EXPORT_SYMBOL_GPL(xdp_master_redirect);
+
 int xdp_do_redirect(struct net_device *dev, struct xdp_buff *xdp,
 		    struct bpf_prog *xdp_prog)
 {
@@ -7204,6 +7322,19 @@ tc_cls_act_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 	}
 }
 
+static const struct bpf_func_proto *
+xdp_metadata_func_proto(const struct bpf_prog *prog,
+			const struct bpf_func_proto *proto)
+{
+	/* devmap and cpumap programs run on xdp_frames, far away from the
+	 * RX descriptor the hints are read from.
+	 */
+	if (prog->expected_attach_type == BPF_XDP_DEVMAP ||
+	    prog->expected_attach_type == BPF_XDP_CPUMAP)
+		return NULL;
+	return proto;
+}
+
 static const struct bpf_func_proto *
 xdp_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 {
@@ -7226,6 +7357,15 @@ xdp_func_proto(enum bpf_func_id func_id, const struct bpf_prog *prog)
 		return &bpf_xdp_adjust_tail_proto;
 	case BPF_FUNC_fib_lookup:
 		return &bpf_xdp_fib_lookup_proto;
+	case BPF_FUNC_xdp_metadata_rx_timestamp:
+		return xdp_metadata_func_proto(prog,
+					       &bpf_xdp_metadata_rx_timestamp_proto);
+	case BPF_FUNC_xdp_metadata_rx_hash:
+		return xdp_metadata_func_proto(prog,
+					       &bpf_xdp_metadata_rx_hash_proto);
+	case BPF_FUNC_xdp_metadata_rx_vlan_tag:
+		return xdp_metadata_func_proto(prog,
+					       &bpf_xdp_metadata_rx_vlan_tag_proto);
 #ifdef CONFIG_INET
 	case BPF_FUNC_sk_lookup_udp:
 		return &bpf_xdp_sk_lookup_udp_proto;
@@ -9876,11 +10016,13 @@ int sk_get_filter(struct sock *sk, struct sock_filter __user *ubuf,
 static void bpf_init_reuseport_kern(struct sk_reuseport_kern *reuse_kern,
 				    struct sock_reuseport *reuse,
 				    struct sock *sk, struct sk_buff *skb,
+				    struct sock *migrating_sk,
 				    u32 hash)
 {
 	reuse_kern->skb = skb;
 	reuse_kern->sk = sk;
 	reuse_kern->selected_sk = NULL;
+	reuse_kern->migrating_sk = migrating_sk;
 	reuse_kern->data_end = skb->data + skb_headlen(skb);
 	reuse_kern->hash = hash;
 	reuse_kern->reuseport_id = reuse->reuseport_id;
@@ -9889,12 +10031,13 @@ static void bpf_init_reuseport_kern(struct sk_reuseport_kern *reuse_kern,
 
 struct sock *bpf_run_sk_reuseport(struct sock_reuseport *reuse, struct sock *sk,
 				  struct bpf_prog *prog, struct sk_buff *skb,
+				  struct sock *migrating_sk,
 				  u32 hash)
 {
 	struct sk_reuseport_kern reuse_kern;
 	enum sk_action action;
 
-	bpf_init_reuseport_kern(&reuse_kern, reuse, sk, skb, hash);
+	bpf_init_reuseport_kern(&reuse_kern, reuse, sk, skb, migrating_sk, hash);
 	action = BPF_PROG_RUN(prog, &reuse_kern);
 
 	if (action == SK_PASS)
@@ -10033,6 +10176,10 @@ sk_reuseport_is_valid_access(int off, int size,
 	case offsetof(struct sk_reuseport_md, hash):
 		return size == size_default;
 
+	case offsetof(struct sk_reuseport_md, migrating_sk):
+		info->reg_type = PTR_TO_SOCK_COMMON_OR_NULL;
+		return size == sizeof(__u64);
+
 	/* Fields that allow narrowing */
 	case bpf_ctx_range(struct sk_reuseport_md, eth_protocol):
 		if (size < sizeof_field(struct sk_buff, protocol))
@@ -10105,6 +10252,10 @@ static u32 sk_reuseport_convert_ctx_access(enum bpf_access_type type,
 	case offsetof(struct sk_reuseport_md, bind_inany):
 		SK_REUSEPORT_LOAD_FIELD(bind_inany);
 		break;
+
+	case offsetof(struct sk_reuseport_md, migrating_sk):
+		SK_REUSEPORT_LOAD_FIELD(migrating_sk);
+		break;
 	}
 
 	return insn - insn_buf;
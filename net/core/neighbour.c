@@ -14,7 +14,6 @@
 #define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
 
 #include <linux/slab.h>
-#include <linux/kmemleak.h>
 #include <linux/types.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -225,9 +224,11 @@ bool neigh_remove_one(struct neighbour *ndel, struct neigh_table *tbl)
 static int neigh_forced_gc(struct neigh_table *tbl)
 {
 	int max_clean = atomic_read(&tbl->gc_entries) - tbl->gc_thresh2;
+	u64 tmax = ktime_get_ns() + NSEC_PER_MSEC;
 	unsigned long tref = jiffies - 5 * HZ;
 	struct neighbour *n, *tmp;
 	int shrunk = 0;
+	int loop = 0;
 
 	NEIGH_CACHE_STAT_INC(tbl, forced_gc_runs);
 
@@ -250,11 +251,20 @@ static int neigh_forced_gc(struct neigh_table *tbl)
 				shrunk++;
 			if (shrunk >= max_clean)
 				break;
+			/* this runs from the allocation path with BHs
+			 * disabled: on very large tables don't walk the
+			 * whole gc_list, the next run will resume the job
+			 */
+			if (++loop == 16) {
+				if (ktime_get_ns() > tmax)
+					goto unlock;
+				loop = 0;
+			}
 		}
 	}
 
 	tbl->last_flush = jiffies;
-
+unlock:
 	write_unlock_bh(&tbl->lock);
 
 	return shrunk;
@@ -439,24 +449,18 @@ static void neigh_get_hash_rnd(u32 *x)
 	*x = get_random_u32() | 1;
 }
 
-static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
+static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift,
+						 gfp_t gfp)
 {
 	size_t size = (1 << shift) * sizeof(struct neighbour *);
 	struct neigh_hash_table *ret;
 	struct neighbour __rcu **buckets;
 	int i;
 
-	ret = kmalloc(sizeof(*ret), GFP_ATOMIC);
+	ret = kmalloc(sizeof(*ret), gfp);
 	if (!ret)
 		return NULL;
-	if (size <= PAGE_SIZE) {
-		buckets = kzalloc(size, GFP_ATOMIC);
-	} else {
-		buckets = (struct neighbour __rcu **)
-			  __get_free_pages(GFP_ATOMIC | __GFP_ZERO,
-					   get_order(size));
-		kmemleak_alloc(buckets, size, 1, GFP_ATOMIC);
-	}
+	buckets = kvzalloc(size, gfp);
 	if (!buckets) {
 		kfree(ret);
 		return NULL;
@@ -468,36 +472,31 @@ static struct neigh_hash_table *neigh_hash_alloc(unsigned int shift)
 	return ret;
 }
 
+static void neigh_hash_free(struct neigh_hash_table *nht)
+{
+	kvfree(nht->hash_buckets);
+	kfree(nht);
+}
+
 static void neigh_hash_free_rcu(struct rcu_head *head)
 {
 	struct neigh_hash_table *nht = container_of(head,
 						    struct neigh_hash_table,
 						    rcu);
-	size_t size = (1 << nht->hash_shift) * sizeof(struct neighbour *);
-	struct neighbour __rcu **buckets = nht->hash_buckets;
 
-	if (size <= PAGE_SIZE) {
-		kfree(buckets);
-	} else {
-		kmemleak_free(buckets);
-		free_pages((unsigned long)buckets, get_order(size));
-	}
-	kfree(nht);
+	neigh_hash_free(nht);
 }
 
-static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
-						unsigned long new_shift)
+static void neigh_hash_grow(struct neigh_table *tbl,
+			    struct neigh_hash_table *new_nht)
 {
+	struct neigh_hash_table *old_nht;
 	unsigned int i, hash;
-	struct neigh_hash_table *new_nht, *old_nht;
 
 	NEIGH_CACHE_STAT_INC(tbl, hash_grows);
 
 	old_nht = rcu_dereference_protected(tbl->nht,
 					    lockdep_is_held(&tbl->lock));
-	new_nht = neigh_hash_alloc(new_shift);
-	if (!new_nht)
-		return old_nht;
 
 	for (i = 0; i < (1 << old_nht->hash_shift); i++) {
 		struct neighbour *n, *next;
@@ -523,7 +522,46 @@ static struct neigh_hash_table *neigh_hash_grow(struct neigh_table *tbl,
 
 	rcu_assign_pointer(tbl->nht, new_nht);
 	call_rcu(&old_nht->rcu, neigh_hash_free_rcu);
-	return new_nht;
+}
+
+/* Resizing is deferred to process context, so that the new bucket array
+ * can be allocated with GFP_KERNEL and outside of tbl->lock: on tables
+ * with several hundred thousands entries it is too large for an atomic
+ * allocation, and neigh_create() would otherwise stall while holding the
+ * table lock.
+ */
+static void neigh_hash_work(struct work_struct *work)
+{
+	struct neigh_table *tbl = container_of(work, struct neigh_table,
+					       hash_work);
+	struct neigh_hash_table *nht, *new_nht;
+	unsigned int shift, entries;
+
+	rcu_read_lock();
+	shift = rcu_dereference(tbl->nht)->hash_shift;
+	rcu_read_unlock();
+
+	entries = atomic_read(&tbl->entries);
+	if (entries <= (1 << shift))
+		return;
+
+	shift = max_t(unsigned int, shift + 1,
+		      ilog2(roundup_pow_of_two(entries)));
+	new_nht = neigh_hash_alloc(shift, GFP_KERNEL);
+	if (!new_nht)
+		return;
+
+	write_lock_bh(&tbl->lock);
+	nht = rcu_dereference_protected(tbl->nht,
+					lockdep_is_held(&tbl->lock));
+	if (nht->hash_shift < shift) {
+		neigh_hash_grow(tbl, new_nht);
+		new_nht = NULL;
+	}
+	write_unlock_bh(&tbl->lock);
+
+	if (new_nht)
+		neigh_hash_free(new_nht);
 }
 
 struct neighbour *neigh_lookup(struct neigh_table *tbl, const void *pkey,
@@ -626,7 +664,7 @@ ___neigh_create(struct neigh_table *tbl, const void *pkey,
 					lockdep_is_held(&tbl->lock));
 
 	if (atomic_read(&tbl->entries) > (1 << nht->hash_shift))
-		nht = neigh_hash_grow(tbl, nht->hash_shift + 1);
+		queue_work(system_power_efficient_wq, &tbl->hash_work);
 
 	hash_val = tbl->hash(n->primary_key, dev, nht->hash_rnd) >> (32 - nht->hash_shift);
 
@@ -1708,7 +1746,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 		panic("cannot create neighbour proc dir entry");
 #endif
 
-	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3));
+	RCU_INIT_POINTER(tbl->nht, neigh_hash_alloc(3, GFP_KERNEL));
 
 	phsize = (PNEIGH_HASHMASK + 1) * sizeof(struct pneigh_entry *);
 	tbl->phash_buckets = kzalloc(phsize, GFP_KERNEL);
@@ -1724,6 +1762,7 @@ void neigh_table_init(int index, struct neigh_table *tbl)
 
 	rwlock_init(&tbl->lock);
 	INIT_DEFERRABLE_WORK(&tbl->gc_work, neigh_periodic_work);
+	INIT_WORK(&tbl->hash_work, neigh_hash_work);
 	queue_delayed_work(system_power_efficient_wq, &tbl->gc_work,
 			tbl->parms.reachable_time);
 	timer_setup(&tbl->proxy_timer, neigh_proxy_process, 0);
@@ -1742,6 +1781,7 @@ int neigh_table_clear(int index, struct neigh_table *tbl)
 	neigh_tables[index] = NULL;
 	/* It is not clean... Fix it to unload IPv6 module safely */
 	cancel_delayed_work_sync(&tbl->gc_work);
+	cancel_work_sync(&tbl->hash_work);
 	del_timer_sync(&tbl->proxy_timer);
 	pneigh_queue_purge(&tbl->proxy_queue);
 	neigh_ifdown(tbl, NULL);
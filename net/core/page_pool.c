@@ -15,6 +15,7 @@
 #include <linux/dma-mapping.h>
 #include <linux/page-flags.h>
 #include <linux/mm.h> /* for __put_page() */
+#include <linux/poison.h>
 
 #include <trace/events/page_pool.h>
 
@@ -232,6 +233,13 @@ static struct page *__page_pool_alloc_pages_slow(struct page_pool *pool,
 		page_pool_dma_sync_for_device(pool, page, pool->p.max_len);
 
 skip_dma_map:
+	/* Let the stack find its way back here when freeing an skb
+	 * holding this page, see page_pool_return_skb_page().
+	 * pp_magic is OR'ed to keep the pfmemalloc bit of lru.next.
+	 */
+	page->pp = pool;
+	page->pp_magic |= PP_SIGNATURE;
+
 	/* Track how many pages are held 'in-flight' */
 	pool->pages_state_hold_cnt++;
 
@@ -302,6 +310,9 @@ void page_pool_release_page(struct page_pool *pool, struct page *page)
 			     DMA_ATTR_SKIP_CPU_SYNC);
 	page_pool_set_dma_addr(page, 0);
 skip_dma_unmap:
+	page->pp_magic = 0;
+	page->pp = NULL;
+
 	/* This may be the last page returned, releasing the pool, so
 	 * it is not safe to reference pool afterwards.
 	 */
@@ -410,6 +421,30 @@ void page_pool_put_page(struct page_pool *pool, struct page *page,
 }
 EXPORT_SYMBOL(page_pool_put_page);
 
+/* Called when the stack drops its reference on a page of an skb marked
+ * with skb_mark_for_recycle().  Returns false if the page does not
+ * belong to a page_pool and must be freed by the caller.
+ */
+bool page_pool_return_skb_page(struct page *page)
+{
+	struct page_pool *pp;
+
+	page = compound_head(page);
+	if (unlikely(!page_is_page_pool(page)))
+		return false;
+
+	pp = page->pp;
+
+	/* This will *not* work for NICs using a split-page memory model:
+	 * the page is returned to the pool regardless of whether the
+	 * other half is still in use.
+	 */
+	page_pool_put_full_page(pp, page, false);
+
+	return true;
+}
+EXPORT_SYMBOL(page_pool_return_skb_page);
+
 static void page_pool_empty_ring(struct page_pool *pool)
 {
 	struct page *page;
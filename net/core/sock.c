@@ -1167,6 +1167,22 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 				WRITE_ONCE(sk->sk_ll_usec, val);
 		}
 		break;
+	case SO_PREFER_BUSY_POLL:
+		if (valbool && !capable(CAP_NET_ADMIN))
+			ret = -EPERM;
+		else
+			WRITE_ONCE(sk->sk_prefer_busy_poll, valbool);
+		break;
+	case SO_BUSY_POLL_BUDGET:
+		if (val > READ_ONCE(sk->sk_busy_poll_budget) && !capable(CAP_NET_ADMIN)) {
+			ret = -EPERM;
+		} else {
+			if (val < 0 || val > U16_MAX)
+				ret = -EINVAL;
+			else
+				WRITE_ONCE(sk->sk_busy_poll_budget, val);
+		}
+		break;
 #endif
 
 	case SO_MAX_PACING_RATE:
@@ -1203,6 +1219,9 @@ int sock_setsockopt(struct socket *sock, int level, int optname,
 			      (sk->sk_type == SOCK_DGRAM &&
 			       sk->sk_protocol == IPPROTO_UDP)))
 				ret = -ENOTSUPP;
+		} else if (sk->sk_family == PF_UNIX) {
+			if (sk->sk_type != SOCK_STREAM)
+				ret = -ENOTSUPP;
 		} else if (sk->sk_family != PF_RDS) {
 			ret = -ENOTSUPP;
 		}
@@ -1548,6 +1567,12 @@ int sock_getsockopt(struct socket *sock, int level, int optname,
 	case SO_BUSY_POLL:
 		v.val = sk->sk_ll_usec;
 		break;
+	case SO_PREFER_BUSY_POLL:
+		v.val = READ_ONCE(sk->sk_prefer_busy_poll);
+		break;
+	case SO_BUSY_POLL_BUDGET:
+		v.val = READ_ONCE(sk->sk_busy_poll_budget);
+		break;
 #endif
 
 	case SO_MAX_PACING_RATE:
@@ -2012,6 +2037,23 @@ void sk_free_unlock_clone(struct sock *sk)
 }
 EXPORT_SYMBOL_GPL(sk_free_unlock_clone);
 
+/* Only TCP over an IPv6 route can carry a hop-by-hop jumbo option (this
+ * excludes v4-mapped flows), every other socket keeps the 64KB limit.
+ */
+static u32 sk_dst_gso_max_size(struct sock *sk, struct dst_entry *dst)
+{
+	u32 max_size = READ_ONCE(dst->dev->gso_max_size);
+
+	if (max_size <= GSO_LEGACY_MAX_SIZE)
+		return max_size;
+#if IS_ENABLED(CONFIG_IPV6)
+	if (dst->ops->family == AF_INET6 && sk->sk_type == SOCK_STREAM &&
+	    sk->sk_protocol == IPPROTO_TCP)
+		return max_size;
+#endif
+	return GSO_LEGACY_MAX_SIZE;
+}
+
 void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 {
 	u32 max_segs = 1;
@@ -2026,7 +2068,7 @@ void sk_setup_caps(struct sock *sk, struct dst_entry *dst)
 			sk->sk_route_caps &= ~NETIF_F_GSO_MASK;
 		} else {
 			sk->sk_route_caps |= NETIF_F_SG | NETIF_F_HW_CSUM;
-			sk->sk_gso_max_size = dst->dev->gso_max_size;
+			sk->sk_gso_max_size = sk_dst_gso_max_size(sk, dst);
 			max_segs = max_t(u32, dst->dev->gso_max_segs, 1);
 		}
 	}
@@ -3031,6 +3073,8 @@ void sock_init_data(struct socket *sock, struct sock *sk)
 #ifdef CONFIG_NET_RX_BUSY_POLL
 	sk->sk_napi_id		=	0;
 	sk->sk_ll_usec		=	sysctl_net_busy_read;
+	sk->sk_prefer_busy_poll	=	false;
+	sk->sk_busy_poll_budget	=	0;
 #endif
 
 	sk->sk_max_pacing_rate = ~0UL;
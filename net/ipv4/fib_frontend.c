@@ -92,6 +92,10 @@ struct fib_table *fib_new_table(struct net *net, u32 id)
 
 	switch (id) {
 	case RT_TABLE_MAIN:
+#ifdef CONFIG_IP_FIB_DIR24_8
+		if (net->ipv4.sysctl_fib_dir24_8)
+			fib_table_dir_set(tb, true);
+#endif
 		rcu_assign_pointer(net->ipv4.fib_main, tb);
 		break;
 	case RT_TABLE_DEFAULT:
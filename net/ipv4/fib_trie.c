@@ -131,8 +131,14 @@ struct key_vector {
 
 struct tnode {
 	struct rcu_head rcu;
-	t_key empty_children;		/* KEYLENGTH bits needed */
-	t_key full_children;		/* KEYLENGTH bits needed */
+	union {
+		struct {
+			t_key empty_children;	/* KEYLENGTH bits needed */
+			t_key full_children;	/* KEYLENGTH bits needed */
+		};
+		/* leaves only: slot in the DIR-24-8 leaf array, 0 if none */
+		u32 dir_slot;
+	};
 	struct key_vector __rcu *parent;
 	struct key_vector kv[1];
 #define tn_bits kv[0].bits
@@ -167,6 +173,9 @@ struct trie {
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	struct trie_use_stats __percpu *stats;
 #endif
+#ifdef CONFIG_IP_FIB_DIR24_8
+	struct fib_dir __rcu *dir;
+#endif
 };
 
 static struct key_vector *resize(struct trie *t, struct key_vector *tn);
@@ -364,6 +373,7 @@ static struct key_vector *leaf_new(t_key key, struct fib_alias *fa)
 	l->pos = 0;
 	l->bits = 0;
 	l->slen = fa->fa_slen;
+	kv->dir_slot = 0;
 
 	/* link leaf to fib alias */
 	INIT_HLIST_HEAD(&l->leaf);
@@ -1059,6 +1069,482 @@ static void trie_rebalance(struct trie *t, struct key_vector *tn)
 		tn = resize(t, tn);
 }
 
+#ifdef CONFIG_IP_FIB_DIR24_8
+/* DIR-24-8 lookup table
+ *
+ * Optional read-mostly index of the trie, letting fib_table_lookup() find
+ * the leaf holding the longest matching prefix with at most two memory
+ * accesses: tbl24 is indexed by the 24 most significant bits of the key,
+ * and the /24 ranges containing longer prefixes point to a group of 256
+ * tbl8 entries indexed by the last byte.
+ *
+ * Each entry holds the length of the longest prefix covering it and the
+ * slot of that prefix's leaf in the leaves array, slot 0 meaning no route.
+ * The trie stays the source of truth: the table is updated under RTNL as
+ * prefixes appear and disappear, and it is rebuilt from the trie when it
+ * runs out of leaf slots or tbl8 groups.
+ */
+#define DIR_TBL24_SIZE		BIT(24)
+#define DIR_TBL8_SIZE		256
+#define DIR_TBL8		BIT(31)
+#define DIR_PLEN_SHIFT		25
+#define DIR_INDEX_MASK		(BIT(DIR_PLEN_SHIFT) - 1)
+#define DIR_MIN_SLOTS		1024
+#define DIR_MIN_GROUPS		64
+
+struct fib_dir {
+	u32			*tbl24;
+	u32			*tbl8;
+	unsigned long		*tbl8_used;
+	unsigned int		nr_groups;
+	struct key_vector __rcu	**leaves;
+	unsigned long		*leaves_used;
+	unsigned int		nr_slots;
+	/* one for the trie, one for each slot waiting for a grace period */
+	refcount_t		refcnt;
+	struct rcu_head		rcu;
+};
+
+/* a freed leaf slot, only reused once no reader can still map to it */
+struct fib_dir_slot {
+	struct fib_dir		*dir;
+	unsigned int		slot;
+	struct rcu_head		rcu;
+};
+
+static struct key_vector *leaf_walk_rcu(struct key_vector **tn, t_key key);
+
+static inline u32 dir_entry(u8 plen, u32 slot)
+{
+	return ((u32)plen << DIR_PLEN_SHIFT) | slot;
+}
+
+static inline u8 dir_entry_plen(u32 ent)
+{
+	return (ent & ~DIR_TBL8) >> DIR_PLEN_SHIFT;
+}
+
+static inline u32 *dir_group(struct fib_dir *dir, u32 ent)
+{
+	return &dir->tbl8[(ent & DIR_INDEX_MASK) * DIR_TBL8_SIZE];
+}
+
+/* caller must hold RCU read lock */
+static inline struct key_vector *fib_dir_lookup(struct trie *t, t_key key)
+{
+	struct fib_dir *dir = rcu_dereference(t->dir);
+	u32 ent;
+
+	if (!dir)
+		return NULL;
+
+	ent = READ_ONCE(dir->tbl24[key >> 8]);
+	if (ent & DIR_TBL8)
+		ent = READ_ONCE(dir_group(dir, ent)[key & 0xff]);
+	ent &= DIR_INDEX_MASK;
+
+	return ent ? rcu_dereference(dir->leaves[ent]) : NULL;
+}
+
+static void fib_dir_free(struct fib_dir *dir)
+{
+	kvfree(dir->tbl24);
+	kvfree(dir->tbl8);
+	kvfree(dir->tbl8_used);
+	kvfree(dir->leaves);
+	kvfree(dir->leaves_used);
+	kfree(dir);
+}
+
+static void fib_dir_put(struct fib_dir *dir)
+{
+	if (refcount_dec_and_test(&dir->refcnt))
+		fib_dir_free(dir);
+}
+
+static void fib_dir_free_rcu(struct rcu_head *head)
+{
+	fib_dir_put(container_of(head, struct fib_dir, rcu));
+}
+
+static void fib_dir_slot_free_rcu(struct rcu_head *head)
+{
+	struct fib_dir_slot *ds = container_of(head, struct fib_dir_slot, rcu);
+
+	clear_bit(ds->slot, ds->dir->leaves_used);
+	fib_dir_put(ds->dir);
+	kfree(ds);
+}
+
+static struct fib_dir *fib_dir_alloc(unsigned int nr_slots,
+				     unsigned int nr_groups)
+{
+	struct fib_dir *dir;
+
+	dir = kzalloc(sizeof(*dir), GFP_KERNEL_ACCOUNT);
+	if (!dir)
+		return NULL;
+
+	dir->nr_slots = nr_slots;
+	dir->nr_groups = nr_groups;
+	refcount_set(&dir->refcnt, 1);
+	dir->tbl24 = kvcalloc(DIR_TBL24_SIZE, sizeof(u32), GFP_KERNEL_ACCOUNT);
+	dir->tbl8 = kvcalloc(nr_groups, DIR_TBL8_SIZE * sizeof(u32),
+			     GFP_KERNEL_ACCOUNT);
+	dir->tbl8_used = kvcalloc(BITS_TO_LONGS(nr_groups),
+				  sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+	dir->leaves = kvcalloc(nr_slots, sizeof(*dir->leaves),
+			       GFP_KERNEL_ACCOUNT);
+	dir->leaves_used = kvcalloc(BITS_TO_LONGS(nr_slots),
+				    sizeof(unsigned long), GFP_KERNEL_ACCOUNT);
+	if (!dir->tbl24 || !dir->tbl8 || !dir->tbl8_used ||
+	    !dir->leaves || !dir->leaves_used) {
+		fib_dir_free(dir);
+		return NULL;
+	}
+
+	/* slot 0 stands for no route */
+	__set_bit(0, dir->leaves_used);
+
+	return dir;
+}
+
+static int fib_dir_leaf_slot(struct fib_dir *dir, struct key_vector *l)
+{
+	struct tnode *tn = tn_info(l);
+	unsigned int slot;
+
+	if (tn->dir_slot)
+		return tn->dir_slot;
+
+	slot = find_first_zero_bit(dir->leaves_used, dir->nr_slots);
+	if (slot >= dir->nr_slots)
+		return -ENOSPC;
+
+	/* atomic, freed slots are released from RCU callbacks */
+	set_bit(slot, dir->leaves_used);
+	rcu_assign_pointer(dir->leaves[slot], l);
+	/* the leaf must be visible before the entries pointing to it */
+	smp_wmb();
+	tn->dir_slot = slot;
+
+	return slot;
+}
+
+static void fib_dir_leaf_free(struct trie *t, struct key_vector *l)
+{
+	struct fib_dir *dir = rtnl_dereference(t->dir);
+	struct tnode *tn = tn_info(l);
+	struct fib_dir_slot *ds;
+
+	if (!dir || !tn->dir_slot)
+		return;
+
+	RCU_INIT_POINTER(dir->leaves[tn->dir_slot], NULL);
+
+	/* Readers may still hold table entries pointing to the slot, so it
+	 * can't be handed to another leaf before a grace period. If we can't
+	 * allocate the tracking struct the slot stays in use until the next
+	 * rebuild.
+	 */
+	ds = kmalloc(sizeof(*ds), GFP_KERNEL);
+	if (ds) {
+		ds->dir = dir;
+		ds->slot = tn->dir_slot;
+		refcount_inc(&dir->refcnt);
+		call_rcu(&ds->rcu, fib_dir_slot_free_rcu);
+	}
+	tn->dir_slot = 0;
+}
+
+/* When adding a prefix, only the entries pointing to a shorter one are
+ * replaced; when removing one, only the entries pointing to it.
+ */
+static inline bool dir_entry_match(u32 ent, u8 plen, bool remove)
+{
+	if (remove)
+		return (ent & DIR_INDEX_MASK) && dir_entry_plen(ent) == plen;
+
+	return dir_entry_plen(ent) <= plen;
+}
+
+static void fib_dir_fill(u32 *tbl, unsigned int first, unsigned int last,
+			 u8 plen, u32 ent, bool remove)
+{
+	unsigned int i;
+
+	for (i = first; i < last; i++) {
+		if (dir_entry_match(tbl[i], plen, remove))
+			WRITE_ONCE(tbl[i], ent);
+	}
+}
+
+static int fib_dir_update(struct fib_dir *dir, t_key key, u8 plen, u32 ent,
+			  bool remove)
+{
+	unsigned int i, j, first, last;
+	u32 cur;
+
+	if (plen <= 24) {
+		first = key >> 8;
+		last = first + (1U << (24 - plen));
+
+		for (i = first; i < last; i++) {
+			cur = dir->tbl24[i];
+			if (cur & DIR_TBL8)
+				fib_dir_fill(dir_group(dir, cur), 0,
+					     DIR_TBL8_SIZE, plen, ent, remove);
+			else if (dir_entry_match(cur, plen, remove))
+				WRITE_ONCE(dir->tbl24[i], ent);
+		}
+
+		return 0;
+	}
+
+	cur = dir->tbl24[key >> 8];
+	if (!(cur & DIR_TBL8)) {
+		u32 *grp;
+
+		if (remove)
+			return 0;
+
+		/* expand the /24 range into a tbl8 group */
+		i = find_first_zero_bit(dir->tbl8_used, dir->nr_groups);
+		if (i >= dir->nr_groups)
+			return -ENOBUFS;
+
+		__set_bit(i, dir->tbl8_used);
+		grp = &dir->tbl8[i * DIR_TBL8_SIZE];
+		for (j = 0; j < DIR_TBL8_SIZE; j++)
+			grp[j] = cur;
+
+		cur = DIR_TBL8 | i;
+		/* publish the group once its entries are initialized */
+		smp_store_release(&dir->tbl24[key >> 8], cur);
+	}
+
+	first = key & 0xff;
+	last = first + (1U << (KEYLENGTH - plen));
+	fib_dir_fill(dir_group(dir, cur), first, last, plen, ent, remove);
+
+	return 0;
+}
+
+static int fib_dir_populate(struct trie *t, struct fib_dir *dir)
+{
+	struct key_vector *l, *tp = t->kv;
+	t_key key = 0;
+
+	while ((l = leaf_walk_rcu(&tp, key)) != NULL) {
+		struct fib_alias *fa;
+		int slen = -1;
+		int slot, err;
+
+		tn_info(l)->dir_slot = 0;
+		slot = fib_dir_leaf_slot(dir, l);
+		if (slot < 0)
+			return slot;
+
+		/* aliases are sorted by suffix length */
+		hlist_for_each_entry(fa, &l->leaf, fa_list) {
+			u8 plen = KEYLENGTH - fa->fa_slen;
+
+			if (fa->fa_slen == slen)
+				continue;
+			slen = fa->fa_slen;
+
+			err = fib_dir_update(dir, l->key, plen,
+					     dir_entry(plen, slot), false);
+			if (err)
+				return err;
+		}
+
+		/* stop loop if key wrapped back to 0 */
+		key = l->key + 1;
+		if (key < l->key)
+			break;
+	}
+
+	return 0;
+}
+
+static struct fib_dir *fib_dir_build(struct trie *t, unsigned int nr_slots,
+				     unsigned int nr_groups)
+{
+	struct fib_dir *dir;
+	int err;
+
+	for (;;) {
+		dir = fib_dir_alloc(nr_slots, nr_groups);
+		if (!dir)
+			return NULL;
+
+		err = fib_dir_populate(t, dir);
+		if (!err)
+			return dir;
+
+		fib_dir_free(dir);
+		if (err == -ENOSPC)
+			nr_slots <<= 1;
+		else
+			nr_groups <<= 1;
+		if (nr_slots > DIR_INDEX_MASK || nr_groups > DIR_INDEX_MASK)
+			return NULL;
+	}
+}
+
+static void fib_dir_replace(struct trie *t, struct fib_dir *dir)
+{
+	struct fib_dir *old = rtnl_dereference(t->dir);
+
+	rcu_assign_pointer(t->dir, dir);
+	if (old)
+		call_rcu(&old->rcu, fib_dir_free_rcu);
+}
+
+static void fib_dir_rebuild(struct trie *t, int err)
+{
+	struct fib_dir *dir = rtnl_dereference(t->dir);
+	unsigned int nr_slots = dir->nr_slots;
+	unsigned int nr_groups = dir->nr_groups;
+
+	if (err == -ENOSPC)
+		nr_slots <<= 1;
+	else
+		nr_groups <<= 1;
+
+	dir = fib_dir_build(t, nr_slots, nr_groups);
+	if (!dir)
+		pr_warn("Unable to rebuild DIR-24-8 table, disabling it\n");
+
+	fib_dir_replace(t, dir);
+}
+
+static bool fib_dir_slen_used(struct key_vector *l, u8 slen,
+			      struct fib_alias *skip)
+{
+	struct fib_alias *fa;
+
+	hlist_for_each_entry(fa, &l->leaf, fa_list) {
+		if (fa != skip && fa->fa_slen == slen)
+			return true;
+	}
+
+	return false;
+}
+
+/* new has just been linked to l */
+static void fib_dir_alias_add(struct trie *t, struct key_vector *l,
+			      struct fib_alias *new)
+{
+	struct fib_dir *dir = rtnl_dereference(t->dir);
+	u8 plen = KEYLENGTH - new->fa_slen;
+	int slot, err;
+
+	if (!dir || fib_dir_slen_used(l, new->fa_slen, new))
+		return;
+
+	slot = fib_dir_leaf_slot(dir, l);
+	err = slot < 0 ? slot : fib_dir_update(dir, l->key, plen,
+					       dir_entry(plen, slot), false);
+	if (err)
+		fib_dir_rebuild(t, err);
+}
+
+/* an alias with suffix length slen has just been unlinked from l */
+static void fib_dir_alias_del(struct trie *t, struct key_vector *l, u8 slen)
+{
+	struct fib_dir *dir = rtnl_dereference(t->dir);
+	u8 plen = KEYLENGTH - slen;
+	u32 ent = 0;
+	u8 cplen;
+
+	if (!dir || fib_dir_slen_used(l, slen, NULL))
+		return;
+
+	/* look for the longest prefix still covering the removed one */
+	for (cplen = plen; cplen--; ) {
+		t_key ckey = cplen ? l->key & (KEY_MAX << (KEYLENGTH - cplen)) : 0;
+		struct key_vector *n, *tp;
+		int slot;
+
+		n = fib_find_node(t, &tp, ckey);
+		if (!n || !fib_dir_slen_used(n, KEYLENGTH - cplen, NULL))
+			continue;
+
+		slot = fib_dir_leaf_slot(dir, n);
+		if (slot < 0) {
+			fib_dir_rebuild(t, slot);
+			return;
+		}
+		ent = dir_entry(cplen, slot);
+		break;
+	}
+
+	fib_dir_update(dir, l->key, plen, ent, true);
+}
+
+/* Caller must hold RTNL. */
+int fib_table_dir_set(struct fib_table *tb, bool enable)
+{
+	struct trie *t = (struct trie *)tb->tb_data;
+	unsigned int nr_slots = DIR_MIN_SLOTS;
+	unsigned int nr_groups = DIR_MIN_GROUPS;
+	struct key_vector *l, *tp = t->kv;
+	struct fib_dir *dir = NULL;
+	t_key key = 0;
+
+	if (enable == !!rtnl_dereference(t->dir))
+		return 0;
+
+	if (!enable)
+		goto out;
+
+	/* size the table for twice the current number of leaves and of
+	 * leaves holding prefixes longer than 24 bits
+	 */
+	while ((l = leaf_walk_rcu(&tp, key)) != NULL) {
+		struct fib_alias *fa = hlist_entry(l->leaf.first,
+						   struct fib_alias, fa_list);
+
+		nr_slots++;
+		if (fa->fa_slen < KEYLENGTH - 24)
+			nr_groups++;
+
+		key = l->key + 1;
+		if (key < l->key)
+			break;
+	}
+
+	dir = fib_dir_build(t, roundup_pow_of_two(nr_slots * 2),
+			    roundup_pow_of_two(nr_groups * 2));
+	if (!dir)
+		return -ENOMEM;
+out:
+	fib_dir_replace(t, dir);
+	return 0;
+}
+#else
+static inline struct key_vector *fib_dir_lookup(struct trie *t, t_key key)
+{
+	return NULL;
+}
+
+static inline void fib_dir_leaf_free(struct trie *t, struct key_vector *l)
+{
+}
+
+static inline void fib_dir_alias_add(struct trie *t, struct key_vector *l,
+				     struct fib_alias *new)
+{
+}
+
+static inline void fib_dir_alias_del(struct trie *t, struct key_vector *l,
+				     u8 slen)
+{
+}
+#endif /* CONFIG_IP_FIB_DIR24_8 */
+
 static int fib_insert_node(struct trie *t, struct key_vector *tp,
 			   struct fib_alias *new, t_key key)
 {
@@ -1101,6 +1587,7 @@ static int fib_insert_node(struct trie *t, struct key_vector *tp,
 	NODE_INIT_PARENT(l, tp);
 	put_child_root(tp, key, l);
 	trie_rebalance(t, tp);
+	fib_dir_alias_add(t, l, new);
 
 	return 0;
 notnode:
@@ -1142,6 +1629,8 @@ static int fib_insert_alias(struct trie *t, struct key_vector *tp,
 		node_push_suffix(tp, new->fa_slen);
 	}
 
+	fib_dir_alias_add(t, l, new);
+
 	return 0;
 }
 
@@ -1405,6 +1894,13 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 	unsigned long index;
 	t_key cindex;
 
+	/* with a DIR-24-8 table the longest prefix match is a direct lookup */
+	n = fib_dir_lookup(t, key);
+	if (n) {
+		pn = NULL;
+		goto found;
+	}
+walk:
 	pn = t->kv;
 	cindex = 0;
 
@@ -1592,6 +2088,11 @@ int fib_table_lookup(struct fib_table *tb, const struct flowi4 *flp,
 #ifdef CONFIG_IP_FIB_TRIE_STATS
 	this_cpu_inc(stats->semantic_match_miss);
 #endif
+	/* shorter prefixes than the one found via the DIR-24-8 table may
+	 * still match, let the trie sort them out
+	 */
+	if (!pn)
+		goto walk;
 	goto backtrace;
 }
 EXPORT_SYMBOL_GPL(fib_table_lookup);
@@ -1605,6 +2106,7 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 
 	/* remove the fib_alias from the list */
 	hlist_del_rcu(&old->fa_list);
+	fib_dir_alias_del(t, l, old->fa_slen);
 
 	/* if we emptied the list this leaf will be freed and we can sort
 	 * out parent suffix lengths as a part of trie_rebalance
@@ -1613,6 +2115,7 @@ static void fib_remove_alias(struct trie *t, struct key_vector *tp,
 		if (tp->slen == l->slen)
 			node_pull_suffix(tp, tp->pos);
 		put_child_root(tp, l->key, NULL);
+		fib_dir_leaf_free(t, l);
 		node_free(l);
 		trie_rebalance(t, tp);
 		return;
@@ -1952,6 +2455,7 @@ void fib_table_flush_external(struct fib_table *tb)
 			 */
 			if (tb->tb_id != fa->tb_id) {
 				hlist_del_rcu(&fa->fa_list);
+				fib_dir_alias_del(t, n, fa->fa_slen);
 				alias_free_mem_rcu(fa);
 				continue;
 			}
@@ -1965,6 +2469,7 @@ void fib_table_flush_external(struct fib_table *tb)
 
 		if (hlist_empty(&n->leaf)) {
 			put_child_root(pn, n->key, NULL);
+			fib_dir_leaf_free(t, n);
 			node_free(n);
 		}
 	}
@@ -2037,6 +2542,7 @@ int fib_table_flush(struct net *net, struct fib_table *tb, bool flush_all)
 			fib_notify_alias_delete(net, n->key, &n->leaf, fa,
 						NULL);
 			hlist_del_rcu(&fa->fa_list);
+			fib_dir_alias_del(t, n, fa->fa_slen);
 			fib_release_info(fa->fa_info);
 			alias_free_mem_rcu(fa);
 			found++;
@@ -2047,6 +2553,7 @@ int fib_table_flush(struct net *net, struct fib_table *tb, bool flush_all)
 
 		if (hlist_empty(&n->leaf)) {
 			put_child_root(pn, n->key, NULL);
+			fib_dir_leaf_free(t, n);
 			node_free(n);
 		}
 	}
@@ -2203,12 +2710,19 @@ int fib_notify(struct net *net, struct notifier_block *nb,
 static void __trie_free_rcu(struct rcu_head *head)
 {
 	struct fib_table *tb = container_of(head, struct fib_table, rcu);
-#ifdef CONFIG_IP_FIB_TRIE_STATS
+#if defined(CONFIG_IP_FIB_TRIE_STATS) || defined(CONFIG_IP_FIB_DIR24_8)
 	struct trie *t = (struct trie *)tb->tb_data;
 
-	if (tb->tb_data == tb->__data)
+	if (tb->tb_data == tb->__data) {
+#ifdef CONFIG_IP_FIB_TRIE_STATS
 		free_percpu(t->stats);
 #endif /* CONFIG_IP_FIB_TRIE_STATS */
+#ifdef CONFIG_IP_FIB_DIR24_8
+		if (rcu_access_pointer(t->dir))
+			fib_dir_put(rcu_dereference_protected(t->dir, 1));
+#endif /* CONFIG_IP_FIB_DIR24_8 */
+	}
+#endif
 	kfree(tb);
 }
 
@@ -465,6 +465,40 @@ static int proc_fib_multipath_hash_policy(struct ctl_table *table, int write,
 }
 #endif
 
+#ifdef CONFIG_IP_FIB_DIR24_8
+static int proc_fib_dir24_8(struct ctl_table *table, int write,
+			    void *buffer, size_t *lenp, loff_t *ppos)
+{
+	struct net *net = container_of(table->data, struct net,
+	    ipv4.sysctl_fib_dir24_8);
+	struct ctl_table tmp = *table;
+	struct fib_table *tb;
+	int val, ret;
+
+	/* the table takes 64MB, don't let an unprivileged netns owner ask */
+	if (write && !net_eq(net, &init_net) && !capable(CAP_NET_ADMIN))
+		return -EPERM;
+
+	rtnl_lock();
+	val = net->ipv4.sysctl_fib_dir24_8;
+	tmp.data = &val;
+	ret = proc_dointvec_minmax(&tmp, write, buffer, lenp, ppos);
+	if (write && ret == 0) {
+		/* only the main table, which also holds the local routes
+		 * as long as there are no custom rules
+		 */
+		tb = fib_get_table(net, RT_TABLE_MAIN);
+		if (tb)
+			ret = fib_table_dir_set(tb, val);
+		if (ret == 0)
+			net->ipv4.sysctl_fib_dir24_8 = val;
+	}
+	rtnl_unlock();
+
+	return ret;
+}
+#endif
+
 static struct ctl_table ipv4_table[] = {
 	{
 		.procname	= "tcp_max_orphans",
@@ -1045,6 +1079,17 @@ static struct ctl_table ipv4_net_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= &two,
 	},
+#endif
+#ifdef CONFIG_IP_FIB_DIR24_8
+	{
+		.procname	= "fib_dir24_8",
+		.data		= &init_net.ipv4.sysctl_fib_dir24_8,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_fib_dir24_8,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
 #endif
 	{
 		.procname	= "ip_unprivileged_port_start",
@@ -1329,6 +1374,15 @@ static struct ctl_table ipv4_net_table[] = {
 		.extra1		= SYSCTL_ZERO,
 		.extra2		= &comp_sack_nr_max,
 	},
+	{
+		.procname	= "tcp_migrate_req",
+		.data		= &init_net.ipv4.sysctl_tcp_migrate_req,
+		.maxlen		= sizeof(int),
+		.mode		= 0644,
+		.proc_handler	= proc_dointvec_minmax,
+		.extra1		= SYSCTL_ZERO,
+		.extra2		= SYSCTL_ONE,
+	},
 	{
 		.procname       = "tcp_reflect_tos",
 		.data           = &init_net.ipv4.sysctl_tcp_reflect_tos,
@@ -1200,7 +1200,13 @@ int tcp_sendmsg_locked(struct sock *sk, struct msghdr *msg, size_t size)
 
 	flags = msg->msg_flags;
 
-	if (flags & MSG_ZEROCOPY && size && sock_flag(sk, SOCK_ZEROCOPY)) {
+	if (flags & MSG_ZEROCOPY && size && msg->msg_ubuf) {
+		uarg = msg->msg_ubuf;
+		sock_zerocopy_get(uarg);
+		zc = sk->sk_route_caps & NETIF_F_SG;
+		if (!zc)
+			uarg->zerocopy = 0;
+	} else if (flags & MSG_ZEROCOPY && size && sock_flag(sk, SOCK_ZEROCOPY)) {
 		skb = tcp_write_queue_tail(sk);
 		uarg = sock_zerocopy_realloc(sk, size, skb_zcopy(skb));
 		if (!uarg) {
@@ -1817,34 +1823,84 @@ static int tcp_zerocopy_handle_leftover_data(struct tcp_zerocopy_receive *zc,
 	return zc->copybuf_len < 0 ? 0 : copylen;
 }
 
+static int tcp_zerocopy_vm_insert_batch_error(struct vm_area_struct *vma,
+					      struct page **pending_pages,
+					      unsigned long pages_remaining,
+					      unsigned long *insert_addr,
+					      u32 *length_with_pending,
+					      u32 *seq,
+					      struct tcp_zerocopy_receive *zc,
+					      u32 total_bytes_to_map,
+					      int err)
+{
+	/* At least one page did not map. Try zapping if we skipped earlier. */
+	if (err == -EBUSY &&
+	    zc->flags & TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT) {
+		u32 maybe_zap_len;
+
+		maybe_zap_len = total_bytes_to_map -  /* All bytes to map */
+				*length_with_pending + /* Mapped or pending */
+				(pages_remaining * PAGE_SIZE); /* Failed map. */
+		zap_page_range(vma, *insert_addr, maybe_zap_len);
+		err = 0;
+	}
+
+	if (!err) {
+		unsigned long leftover_pages = pages_remaining;
+		int bytes_mapped;
+
+		/* We called zap_page_range, try to reinsert. */
+		err = vm_insert_pages(vma, *insert_addr, pending_pages,
+				      &pages_remaining);
+		bytes_mapped = PAGE_SIZE * (leftover_pages - pages_remaining);
+		*seq += bytes_mapped;
+		*insert_addr += bytes_mapped;
+	}
+	if (err) {
+		/* Either we were unable to zap, OR we zapped, retried an
+		 * insert, and still had an issue. Either ways, pages_remaining
+		 * is the number of pages we were unable to map, and we unroll
+		 * some state we speculatively touched before.
+		 */
+		const int bytes_not_mapped = PAGE_SIZE * pages_remaining;
+
+		*length_with_pending -= bytes_not_mapped;
+		zc->recv_skip_hint += bytes_not_mapped;
+	}
+	return err;
+}
+
 static int tcp_zerocopy_vm_insert_batch(struct vm_area_struct *vma,
 					struct page **pages,
 					unsigned long pages_to_map,
 					unsigned long *insert_addr,
 					u32 *length_with_pending,
 					u32 *seq,
-					struct tcp_zerocopy_receive *zc)
+					struct tcp_zerocopy_receive *zc,
+					u32 total_bytes_to_map)
 {
 	unsigned long pages_remaining = pages_to_map;
+	unsigned long pages_mapped;
 	int bytes_mapped;
 	int ret;
 
 	ret = vm_insert_pages(vma, *insert_addr, pages, &pages_remaining);
-	bytes_mapped = PAGE_SIZE * (pages_to_map - pages_remaining);
+	pages_mapped = pages_to_map - pages_remaining;
+	bytes_mapped = PAGE_SIZE * pages_mapped;
 	/* Even if vm_insert_pages fails, it may have partially succeeded in
 	 * mapping (some but not all of the pages).
 	 */
 	*seq += bytes_mapped;
 	*insert_addr += bytes_mapped;
-	if (ret) {
-		/* But if vm_insert_pages did fail, we have to unroll some state
-		 * we speculatively touched before.
-		 */
-		const int bytes_not_mapped = PAGE_SIZE * pages_remaining;
-		*length_with_pending -= bytes_not_mapped;
-		zc->recv_skip_hint += bytes_not_mapped;
-	}
-	return ret;
+
+	if (likely(!ret))
+		return 0;
+
+	/* Error: maybe zap and retry + rollback state for failed inserts. */
+	return tcp_zerocopy_vm_insert_batch_error(vma, pages + pages_mapped,
+						  pages_remaining, insert_addr,
+						  length_with_pending, seq, zc,
+						  total_bytes_to_map, ret);
 }
 
 static int tcp_zerocopy_receive(struct sock *sk,
@@ -1886,7 +1942,11 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	avail_len = min_t(u32, vma_len, inq);
 	aligned_len = avail_len & ~(PAGE_SIZE - 1);
 	if (aligned_len) {
-		zap_page_range(vma, address, aligned_len);
+		/* With the hint, defer the zap (and the TLB shootdown it
+		 * implies) until an insert actually finds a page mapped.
+		 */
+		if (!(zc->flags & TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT))
+			zap_page_range(vma, address, aligned_len);
 		zc->length = aligned_len;
 		zc->recv_skip_hint = 0;
 	} else {
@@ -1905,7 +1965,8 @@ static int tcp_zerocopy_receive(struct sock *sk,
 								   pg_idx,
 								   &curr_addr,
 								   &length,
-								   &seq, zc);
+								   &seq, zc,
+								   aligned_len);
 				if (ret)
 					goto out;
 				pg_idx = 0;
@@ -1942,7 +2003,8 @@ static int tcp_zerocopy_receive(struct sock *sk,
 		if (pg_idx == PAGE_BATCH_SIZE) {
 			ret = tcp_zerocopy_vm_insert_batch(vma, pages, pg_idx,
 							   &curr_addr, &length,
-							   &seq, zc);
+							   &seq, zc,
+							   aligned_len);
 			if (ret)
 				goto out;
 			pg_idx = 0;
@@ -1951,7 +2013,7 @@ static int tcp_zerocopy_receive(struct sock *sk,
 	if (pg_idx) {
 		ret = tcp_zerocopy_vm_insert_batch(vma, pages, pg_idx,
 						   &curr_addr, &length, &seq,
-						   zc);
+						   zc, aligned_len);
 	}
 out:
 	mmap_read_unlock(current->mm);
@@ -3946,6 +4008,8 @@ static int do_tcp_getsockopt(struct sock *sk, int level,
 		}
 		if (copy_from_user(&zc, optval, len))
 			return -EFAULT;
+		if (zc.flags & ~TCP_RECEIVE_ZEROCOPY_FLAG_TLB_CLEAN_HINT)
+			return -EINVAL;
 		lock_sock(sk);
 		err = tcp_zerocopy_receive(sk, &zc);
 		release_sock(sk);
@@ -1061,38 +1061,17 @@ static void mptcp_nospace(struct mptcp_sock *msk)
 	}
 }
 
-static bool mptcp_subflow_active(struct mptcp_subflow_context *subflow)
-{
-	struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
-
-	/* can't send if JOIN hasn't completed yet (i.e. is usable for mptcp) */
-	if (subflow->request_join && !subflow->fully_established)
-		return false;
-
-	/* only send if our side has not closed yet */
-	return ((1 << ssk->sk_state) & (TCPF_ESTABLISHED | TCPF_CLOSE_WAIT));
-}
-
 #define MPTCP_SEND_BURST_SIZE		((1 << 16) - \
 					 sizeof(struct tcphdr) - \
 					 MAX_TCP_OPTION_SPACE - \
 					 sizeof(struct ipv6hdr) - \
 					 sizeof(struct frag_hdr))
 
-struct subflow_send_info {
-	struct sock *ssk;
-	u64 ratio;
-};
-
 static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk,
 					   u32 *sndbuf)
 {
-	struct subflow_send_info send_info[2];
 	struct mptcp_subflow_context *subflow;
-	int i, nr_active = 0;
 	struct sock *ssk;
-	u64 ratio;
-	u32 pace;
 
 	sock_owned_by_me((struct sock *)msk);
 
@@ -1107,59 +1086,28 @@ static struct sock *mptcp_subflow_get_send(struct mptcp_sock *msk,
 		return sk_stream_memory_free(msk->first) ? msk->first : NULL;
 	}
 
-	/* re-use last subflow, if the burst allow that */
-	if (msk->last_snd && msk->snd_burst > 0 &&
-	    sk_stream_memory_free(msk->last_snd) &&
-	    mptcp_subflow_active(mptcp_subflow_ctx(msk->last_snd))) {
-		mptcp_for_each_subflow(msk, subflow) {
-			ssk =  mptcp_subflow_tcp_sock(subflow);
-			*sndbuf = max(tcp_sk(ssk)->snd_wnd, *sndbuf);
-		}
-		return msk->last_snd;
-	}
-
-	/* pick the subflow with the lower wmem/wspace ratio */
-	for (i = 0; i < 2; ++i) {
-		send_info[i].ssk = NULL;
-		send_info[i].ratio = -1;
-	}
 	mptcp_for_each_subflow(msk, subflow) {
-		ssk =  mptcp_subflow_tcp_sock(subflow);
 		if (!mptcp_subflow_active(subflow))
 			continue;
 
-		nr_active += !subflow->backup;
+		ssk =  mptcp_subflow_tcp_sock(subflow);
 		*sndbuf = max(tcp_sk(ssk)->snd_wnd, *sndbuf);
-		if (!sk_stream_memory_free(subflow->tcp_sock))
-			continue;
-
-		pace = READ_ONCE(ssk->sk_pacing_rate);
-		if (!pace)
-			continue;
-
-		ratio = div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32,
-				pace);
-		if (ratio < send_info[subflow->backup].ratio) {
-			send_info[subflow->backup].ssk = ssk;
-			send_info[subflow->backup].ratio = ratio;
-		}
 	}
 
-	pr_debug("msk=%p nr_active=%d ssk=%p:%lld backup=%p:%lld",
-		 msk, nr_active, send_info[0].ssk, send_info[0].ratio,
-		 send_info[1].ssk, send_info[1].ratio);
-
-	/* pick the best backup if no other subflow is active */
-	if (!nr_active)
-		send_info[0].ssk = send_info[1].ssk;
+	ssk = mptcp_sched_get_send(msk);
+	if (!ssk)
+		return NULL;
 
-	if (send_info[0].ssk) {
-		msk->last_snd = send_info[0].ssk;
+	/* a new burst starts whenever the scheduler moves to another subflow
+	 * or the current one is exhausted
+	 */
+	if (ssk != msk->last_snd || msk->snd_burst <= 0) {
+		msk->last_snd = ssk;
 		msk->snd_burst = min_t(int, MPTCP_SEND_BURST_SIZE,
-				       sk_stream_wspace(msk->last_snd));
-		return msk->last_snd;
+				       sk_stream_wspace(ssk));
 	}
-	return NULL;
+
+	return ssk;
 }
 
 static void ssk_check_wmem(struct mptcp_sock *msk)
@@ -1871,6 +1819,8 @@ static int mptcp_init_sock(struct sock *sk)
 	if (ret)
 		return ret;
 
+	mptcp_init_sched(mptcp_sk(sk), mptcp_get_scheduler(net));
+
 	sk_sockets_allocated_inc(sk);
 	sk->sk_rcvbuf = sock_net(sk)->ipv4.sysctl_tcp_rmem[1];
 	sk->sk_sndbuf = sock_net(sk)->ipv4.sysctl_tcp_wmem[1];
@@ -2074,6 +2024,8 @@ struct sock *mptcp_sk_clone(const struct sock *sk,
 	__mptcp_init_sock(nsk);
 
 	msk = mptcp_sk(nsk);
+	/* inherit the listener's scheduler, with its own reference */
+	mptcp_init_sched(msk, mptcp_sk(sk)->sched->name);
 	msk->local_key = subflow_req->local_key;
 	msk->token = subflow_req->token;
 	msk->subflow = NULL;
@@ -2184,6 +2136,7 @@ void mptcp_destroy_common(struct mptcp_sock *msk)
 	skb_rbtree_purge(&msk->out_of_order_queue);
 	mptcp_token_destroy(msk);
 	mptcp_pm_free_anno_list(msk);
+	mptcp_release_sched(msk);
 }
 
 static void mptcp_destroy(struct sock *sk)
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Multipath TCP packet scheduler
+ *
+ * Pluggable subflow selection for the msk transmit path, modeled after
+ * the TCP congestion control framework.
+ */
+#define pr_fmt(fmt) "MPTCP: " fmt
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/list.h>
+#include <linux/rculist.h>
+#include <linux/spinlock.h>
+#include <linux/bpf.h>
+#include <net/tcp.h>
+#include <net/mptcp.h>
+#include "protocol.h"
+
+static DEFINE_SPINLOCK(mptcp_sched_list_lock);
+static LIST_HEAD(mptcp_sched_list);
+
+/* pick the writable subflow with the lowest @metric, preferring non backup
+ * ones unless none of them is active
+ */
+static int mptcp_sched_pick(struct mptcp_sched_data *data,
+			    u64 (*metric)(const struct sock *ssk))
+{
+	int best[2] = { -1, -1 };
+	u64 best_val[2] = { U64_MAX, U64_MAX };
+	int i, nr_active = 0;
+
+	for (i = 0; i < data->nr_subflows; i++) {
+		bool backup = !!(data->backup & BIT(i));
+		u64 val;
+
+		nr_active += !backup;
+		if (!(data->writable & BIT(i)))
+			continue;
+
+		val = metric(data->subflows[i]);
+		if (val < best_val[backup]) {
+			best[backup] = i;
+			best_val[backup] = val;
+		}
+	}
+
+	/* pick the best backup if no other subflow is active */
+	if (!nr_active)
+		best[0] = best[1];
+
+	return best[0];
+}
+
+static u64 mptcp_sched_wmem_ratio(const struct sock *ssk)
+{
+	u32 pace = READ_ONCE(ssk->sk_pacing_rate);
+
+	if (!pace)
+		return U64_MAX;
+
+	return div_u64((u64)READ_ONCE(ssk->sk_wmem_queued) << 32, pace);
+}
+
+/* default scheduler: keep sending on the last used subflow until the
+ * current burst is exhausted, then pick the subflow with the lower
+ * wmem/pacing rate ratio
+ */
+static int mptcp_sched_default_get_subflow(const struct sock *sk,
+					   struct mptcp_sched_data *data)
+{
+	const struct mptcp_sock *msk = mptcp_sk(sk);
+	int i;
+
+	if (msk->last_snd && msk->snd_burst > 0) {
+		for (i = 0; i < data->nr_subflows; i++) {
+			if (data->subflows[i] == msk->last_snd &&
+			    (data->writable & BIT(i)))
+				return i;
+		}
+	}
+
+	return mptcp_sched_pick(data, mptcp_sched_wmem_ratio);
+}
+
+static struct mptcp_sched_ops mptcp_sched_default = {
+	.get_subflow	= mptcp_sched_default_get_subflow,
+	.name		= "default",
+	.owner		= THIS_MODULE,
+};
+
+static u64 mptcp_sched_srtt(const struct sock *ssk)
+{
+	u32 srtt = READ_ONCE(tcp_sk(ssk)->srtt_us);
+
+	/* no sample yet: try it only if nothing better is available */
+	return srtt ? srtt : U32_MAX;
+}
+
+/* min-RTT scheduler: always send on the subflow with the lowest smoothed
+ * RTT having some space left, trading throughput aggregation for latency
+ */
+static int mptcp_sched_minrtt_get_subflow(const struct sock *sk,
+					  struct mptcp_sched_data *data)
+{
+	return mptcp_sched_pick(data, mptcp_sched_srtt);
+}
+
+static struct mptcp_sched_ops mptcp_sched_minrtt = {
+	.get_subflow	= mptcp_sched_minrtt_get_subflow,
+	.name		= "minrtt",
+	.owner		= THIS_MODULE,
+};
+
+/* must be called with rcu read lock or mptcp_sched_list_lock held */
+static struct mptcp_sched_ops *mptcp_sched_find(const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	list_for_each_entry_rcu(sched, &mptcp_sched_list, list) {
+		if (!strcmp(sched->name, name))
+			return sched;
+	}
+
+	return NULL;
+}
+
+int mptcp_register_scheduler(struct mptcp_sched_ops *sched)
+{
+	int ret = 0;
+
+	if (!sched->get_subflow) {
+		pr_err("%s does not implement required ops\n", sched->name);
+		return -EINVAL;
+	}
+
+	spin_lock(&mptcp_sched_list_lock);
+	if (mptcp_sched_find(sched->name)) {
+		pr_notice("%s already registered\n", sched->name);
+		ret = -EEXIST;
+	} else {
+		list_add_tail_rcu(&sched->list, &mptcp_sched_list);
+		pr_debug("%s registered\n", sched->name);
+	}
+	spin_unlock(&mptcp_sched_list_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(mptcp_register_scheduler);
+
+void mptcp_unregister_scheduler(struct mptcp_sched_ops *sched)
+{
+	if (sched == &mptcp_sched_default)
+		return;
+
+	spin_lock(&mptcp_sched_list_lock);
+	list_del_rcu(&sched->list);
+	spin_unlock(&mptcp_sched_list_lock);
+
+	/* wait for all the mptcp_init_sched() lookups to complete; sockets
+	 * already using @sched hold a reference on its owner
+	 */
+	synchronize_rcu();
+}
+EXPORT_SYMBOL_GPL(mptcp_unregister_scheduler);
+
+void __init mptcp_sched_init(void)
+{
+	mptcp_register_scheduler(&mptcp_sched_default);
+	mptcp_register_scheduler(&mptcp_sched_minrtt);
+}
+
+void mptcp_init_sched(struct mptcp_sock *msk, const char *name)
+{
+	struct mptcp_sched_ops *sched;
+
+	rcu_read_lock();
+	sched = mptcp_sched_find(name);
+	if (!sched || !bpf_try_module_get(sched, sched->owner)) {
+		/* built-in, can't go away */
+		sched = &mptcp_sched_default;
+		bpf_try_module_get(sched, sched->owner);
+	}
+	rcu_read_unlock();
+
+	msk->sched = sched;
+	if (sched->init)
+		sched->init((struct sock *)msk);
+
+	pr_debug("msk=%p sched=%s", msk, sched->name);
+}
+
+void mptcp_release_sched(struct mptcp_sock *msk)
+{
+	struct mptcp_sched_ops *sched = msk->sched;
+
+	if (!sched)
+		return;
+
+	msk->sched = NULL;
+	if (sched->release)
+		sched->release((struct sock *)msk);
+
+	bpf_module_put(sched, sched->owner);
+}
+
+/* collect the subflows usable for data transmission and let the msk
+ * scheduler select one of them
+ */
+struct sock *mptcp_sched_get_send(struct mptcp_sock *msk)
+{
+	struct mptcp_subflow_context *subflow;
+	struct mptcp_sched_data data = {};
+	int idx;
+
+	sock_owned_by_me((struct sock *)msk);
+
+	mptcp_for_each_subflow(msk, subflow) {
+		struct sock *ssk = mptcp_subflow_tcp_sock(subflow);
+		u8 bit = BIT(data.nr_subflows);
+
+		if (!mptcp_subflow_active(subflow))
+			continue;
+
+		data.subflows[data.nr_subflows] = ssk;
+		if (subflow->backup)
+			data.backup |= bit;
+		if (sk_stream_memory_free(ssk))
+			data.writable |= bit;
+
+		if (++data.nr_subflows == MPTCP_SCHED_MAX_SUBFLOWS)
+			break;
+	}
+
+	if (!data.nr_subflows)
+		return NULL;
+
+	idx = msk->sched->get_subflow((struct sock *)msk, &data);
+	pr_debug("msk=%p sched=%s nr=%d backup=%x writable=%x idx=%d",
+		 msk, msk->sched->name, data.nr_subflows, data.backup,
+		 data.writable, idx);
+
+	/* never trust the scheduler to pick a valid, writable subflow */
+	if (idx < 0 || idx >= data.nr_subflows ||
+	    !(data.writable & BIT(idx)))
+		return NULL;
+
+	return data.subflows[idx];
+}
@@ -67,6 +67,9 @@ EXPORT_SYMBOL_GPL(nf_conntrack_hash);
 struct conntrack_gc_work {
 	struct delayed_work	dwork;
 	u32			next_bucket;
+	u32			avg_timeout;
+	u32			count;
+	u32			start_time;
 	bool			exiting;
 	bool			early_drop;
 };
@@ -78,8 +81,20 @@ static __read_mostly bool nf_conntrack_locks_all;
 /* serialize hash resizes and nf_ct_iterate_cleanup */
 static DEFINE_MUTEX(nf_conntrack_mutex);
 
-#define GC_SCAN_INTERVAL	(120u * HZ)
+#define GC_SCAN_INTERVAL_MAX	(60ul * HZ)
+#define GC_SCAN_INTERVAL_MIN	(1ul * HZ)
+
+/* clamp timeouts to this value (TCP unacked) */
+#define GC_SCAN_INTERVAL_CLAMP	(300ul * HZ)
+
+/* large initial bias so that we don't scan often just because we have
+ * three entries with a 1s timeout.
+ */
+#define GC_SCAN_INTERVAL_INIT	INT_MAX
+
 #define GC_SCAN_MAX_DURATION	msecs_to_jiffies(10)
+#define GC_SCAN_EXPIRED_MAX	(64000u / HZ)
+#define GC_SCAN_INITIAL_COUNT	100
 
 static struct conntrack_gc_work conntrack_gc_work;
 
@@ -176,6 +191,10 @@ static void nf_conntrack_all_unlock(void)
 unsigned int nf_conntrack_htable_size __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_htable_size);
 
+/* table entries are being moved to while a resize is in progress */
+static struct hlist_nulls_head *nf_conntrack_hash_next __read_mostly;
+static unsigned int nf_conntrack_htable_size_next __read_mostly;
+
 unsigned int nf_conntrack_max __read_mostly;
 EXPORT_SYMBOL_GPL(nf_conntrack_max);
 seqcount_spinlock_t nf_conntrack_generation __read_mostly;
@@ -730,18 +749,30 @@ static void nf_ct_gc_expired(struct nf_conn *ct)
  * - Caller must take a reference on returned object
  *   and recheck nf_ct_tuple_equal(tuple, &h->tuple)
  */
+static void nf_conntrack_get_ht_next(struct hlist_nulls_head **hash,
+				     unsigned int *hsize)
+{
+	struct hlist_nulls_head *hptr;
+	unsigned int sequence, hsz;
+
+	do {
+		sequence = read_seqcount_begin(&nf_conntrack_generation);
+		hsz = nf_conntrack_htable_size_next;
+		hptr = nf_conntrack_hash_next;
+	} while (read_seqcount_retry(&nf_conntrack_generation, sequence));
+
+	*hash = hptr;
+	*hsize = hsz;
+}
+
 static struct nf_conntrack_tuple_hash *
-____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
-		      const struct nf_conntrack_tuple *tuple, u32 hash)
+nf_conntrack_find_bucket(struct net *net, const struct nf_conntrack_zone *zone,
+			 const struct nf_conntrack_tuple *tuple,
+			 struct hlist_nulls_head *ct_hash, unsigned int bucket,
+			 bool *restart)
 {
 	struct nf_conntrack_tuple_hash *h;
-	struct hlist_nulls_head *ct_hash;
 	struct hlist_nulls_node *n;
-	unsigned int bucket, hsize;
-
-begin:
-	nf_conntrack_get_ht(&ct_hash, &hsize);
-	bucket = reciprocal_scale(hash, hsize);
 
 	hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[bucket], hnnode) {
 		struct nf_conn *ct;
@@ -760,14 +791,46 @@ ____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
 	 * not the expected one, we must restart lookup.
 	 * We probably met an item that was moved to another chain.
 	 */
-	if (get_nulls_value(n) != bucket) {
-		NF_CT_STAT_INC_ATOMIC(net, search_restart);
-		goto begin;
-	}
+	*restart = get_nulls_value(n) != bucket;
 
 	return NULL;
 }
 
+static struct nf_conntrack_tuple_hash *
+____nf_conntrack_find(struct net *net, const struct nf_conntrack_zone *zone,
+		      const struct nf_conntrack_tuple *tuple, u32 hash)
+{
+	struct nf_conntrack_tuple_hash *h;
+	struct hlist_nulls_head *ct_hash;
+	unsigned int hsize;
+	bool restart;
+
+begin:
+	nf_conntrack_get_ht(&ct_hash, &hsize);
+	h = nf_conntrack_find_bucket(net, zone, tuple, ct_hash,
+				     reciprocal_scale(hash, hsize), &restart);
+	if (h)
+		return h;
+
+	if (!restart) {
+		/* A resize moves entries without blocking lookups, check
+		 * the table the entry might have been moved to already.
+		 */
+		nf_conntrack_get_ht_next(&ct_hash, &hsize);
+		if (!ct_hash)
+			return NULL;
+
+		h = nf_conntrack_find_bucket(net, zone, tuple, ct_hash,
+					     reciprocal_scale(hash, hsize),
+					     &restart);
+		if (h || !restart)
+			return h;
+	}
+
+	NF_CT_STAT_INC_ATOMIC(net, search_restart);
+	goto begin;
+}
+
 /* Find a connection corresponding to a tuple. */
 static struct nf_conntrack_tuple_hash *
 __nf_conntrack_find_get(struct net *net, const struct nf_conntrack_zone *zone,
@@ -1350,16 +1413,31 @@ static bool gc_worker_can_early_drop(const struct nf_conn *ct)
 
 static void gc_worker(struct work_struct *work)
 {
-	unsigned long end_time = jiffies + GC_SCAN_MAX_DURATION;
 	unsigned int i, hashsz, nf_conntrack_max95 = 0;
-	unsigned long next_run = GC_SCAN_INTERVAL;
+	u32 end_time, start_time = nfct_time_stamp;
 	struct conntrack_gc_work *gc_work;
+	unsigned int expired_count = 0;
+	unsigned long next_run;
+	s32 delta_time;
+	long count;
+
 	gc_work = container_of(work, struct conntrack_gc_work, dwork.work);
 
 	i = gc_work->next_bucket;
 	if (gc_work->early_drop)
 		nf_conntrack_max95 = nf_conntrack_max / 100u * 95u;
 
+	if (i == 0) {
+		gc_work->avg_timeout = GC_SCAN_INTERVAL_INIT;
+		gc_work->count = GC_SCAN_INITIAL_COUNT;
+		gc_work->start_time = start_time;
+	}
+
+	next_run = gc_work->avg_timeout;
+	count = gc_work->count;
+
+	end_time = start_time + GC_SCAN_MAX_DURATION;
+
 	do {
 		struct nf_conntrack_tuple_hash *h;
 		struct hlist_nulls_head *ct_hash;
@@ -1376,6 +1454,7 @@ static void gc_worker(struct work_struct *work)
 
 		hlist_nulls_for_each_entry_rcu(h, n, &ct_hash[i], hnnode) {
 			struct net *net;
+			long expires;
 
 			tmp = nf_ct_tuplehash_to_ctrack(h);
 
@@ -1384,11 +1463,31 @@ static void gc_worker(struct work_struct *work)
 				continue;
 			}
 
+			if (expired_count > GC_SCAN_EXPIRED_MAX) {
+				rcu_read_unlock();
+
+				gc_work->next_bucket = i;
+				gc_work->avg_timeout = next_run;
+				gc_work->count = count;
+
+				delta_time = nfct_time_stamp - gc_work->start_time;
+
+				/* re-sched immediately if total cycle time is exceeded */
+				next_run = delta_time < (s32)GC_SCAN_INTERVAL_MAX;
+				goto early_exit;
+			}
+
 			if (nf_ct_is_expired(tmp)) {
 				nf_ct_gc_expired(tmp);
+				expired_count++;
 				continue;
 			}
 
+			expires = clamp(nf_ct_expires(tmp), GC_SCAN_INTERVAL_MIN,
+					GC_SCAN_INTERVAL_CLAMP);
+			expires = (expires - (long)next_run) / ++count;
+			next_run += expires;
+
 			if (nf_conntrack_max95 == 0 || gc_worker_skip_ct(tmp))
 				continue;
 
@@ -1419,13 +1518,30 @@ static void gc_worker(struct work_struct *work)
 		cond_resched();
 		i++;
 
-		if (time_after(jiffies, end_time) && i < hashsz) {
+		delta_time = nfct_time_stamp - end_time;
+		if (delta_time > 0 && i < hashsz) {
+			gc_work->avg_timeout = next_run;
+			gc_work->count = count;
 			gc_work->next_bucket = i;
 			next_run = 0;
-			break;
+			goto early_exit;
 		}
 	} while (i < hashsz);
 
+	gc_work->next_bucket = 0;
+
+	/* The next full scan is due when the average entry seen in this one
+	 * would have expired, minus the time this scan took.
+	 */
+	next_run = clamp(next_run, GC_SCAN_INTERVAL_MIN, GC_SCAN_INTERVAL_MAX);
+
+	delta_time = max_t(s32, nfct_time_stamp - gc_work->start_time, 1);
+	if (next_run > (unsigned long)delta_time)
+		next_run -= delta_time;
+	else
+		next_run = 1;
+
+early_exit:
 	if (gc_work->exiting)
 		return;
 
@@ -1436,10 +1552,9 @@ static void gc_worker(struct work_struct *work)
 	 * This worker is only here to reap expired entries when system went
 	 * idle after a busy period.
 	 */
-	if (next_run) {
+	if (next_run)
 		gc_work->early_drop = false;
-		gc_work->next_bucket = 0;
-	}
+
 	queue_delayed_work(system_power_efficient_wq, &gc_work->dwork, next_run);
 }
 
@@ -1464,8 +1579,15 @@ __nf_conntrack_alloc(struct net *net,
 	if (nf_conntrack_max &&
 	    unlikely(atomic_read(&net->ct.count) > nf_conntrack_max)) {
 		if (!early_drop(net, hash)) {
-			if (!conntrack_gc_work.early_drop)
+			/* Don't wait for the next scheduled scan, the table
+			 * may still hold plenty of expired entries.
+			 */
+			if (!conntrack_gc_work.early_drop) {
 				conntrack_gc_work.early_drop = true;
+				if (!conntrack_gc_work.exiting)
+					mod_delayed_work(system_power_efficient_wq,
+							 &conntrack_gc_work.dwork, 0);
+			}
 			atomic_dec(&net->ct.count);
 			net_warn_ratelimited("nf_conntrack: table full, dropping packet\n");
 			return ERR_PTR(-ENOMEM);
@@ -2473,13 +2595,15 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 
 	local_bh_disable();
 	nf_conntrack_all_lock();
-	write_seqcount_begin(&nf_conntrack_generation);
 
-	/* Lookups in the old hash might happen in parallel, which means we
-	 * might get false negatives during connection lookup. New connections
-	 * created because of a false negative won't make it into the hash
-	 * though since that required taking the locks.
+	/* Only publish the new table here: lookups keep running while the
+	 * entries are moved, and check both tables, see ____nf_conntrack_find().
+	 * Insertions and deletions need the locks and wait for the resize.
 	 */
+	write_seqcount_begin(&nf_conntrack_generation);
+	nf_conntrack_hash_next = hash;
+	nf_conntrack_htable_size_next = hashsize;
+	write_seqcount_end(&nf_conntrack_generation);
 
 	for (i = 0; i < nf_conntrack_htable_size; i++) {
 		while (!hlist_nulls_empty(&nf_conntrack_hash[i])) {
@@ -2495,9 +2619,11 @@ int nf_conntrack_hash_resize(unsigned int hashsize)
 	old_size = nf_conntrack_htable_size;
 	old_hash = nf_conntrack_hash;
 
+	write_seqcount_begin(&nf_conntrack_generation);
 	nf_conntrack_hash = hash;
 	nf_conntrack_htable_size = hashsize;
-
+	nf_conntrack_hash_next = NULL;
+	nf_conntrack_htable_size_next = 0;
 	write_seqcount_end(&nf_conntrack_generation);
 	nf_conntrack_all_unlock();
 	local_bh_enable();
@@ -79,29 +79,59 @@ static int flow_offload_fill_route(struct flow_offload *flow,
 				   enum flow_offload_tuple_dir dir)
 {
 	struct flow_offload_tuple *flow_tuple = &flow->tuplehash[dir].tuple;
-	struct dst_entry *other_dst = route->tuple[!dir].dst;
 	struct dst_entry *dst = route->tuple[dir].dst;
+	int i;
+
+	if (dst) {
+		switch (flow_tuple->l3proto) {
+		case NFPROTO_IPV4:
+			flow_tuple->mtu = ip_dst_mtu_maybe_forward(dst, true);
+			break;
+		case NFPROTO_IPV6:
+			flow_tuple->mtu = ip6_dst_mtu_forward(dst);
+			break;
+		}
+	} else {
+		flow_tuple->mtu = route->tuple[dir].out.mtu;
+	}
 
-	if (!dst_hold_safe(route->tuple[dir].dst))
-		return -1;
-
-	switch (flow_tuple->l3proto) {
-	case NFPROTO_IPV4:
-		flow_tuple->mtu = ip_dst_mtu_maybe_forward(dst, true);
+	flow_tuple->iifidx = route->tuple[dir].in.ifindex;
+	for (i = 0; i < route->tuple[dir].in.num_encaps; i++) {
+		flow_tuple->encap[i].id = route->tuple[dir].in.encap[i].id;
+		flow_tuple->encap[i].proto = route->tuple[dir].in.encap[i].proto;
+	}
+	flow_tuple->encap_num = route->tuple[dir].in.num_encaps;
+
+	switch (route->tuple[dir].xmit_type) {
+	case FLOW_OFFLOAD_XMIT_DIRECT:
+		memcpy(flow_tuple->out.h_dest, route->tuple[dir].out.h_dest,
+		       ETH_ALEN);
+		memcpy(flow_tuple->out.h_source, route->tuple[dir].out.h_source,
+		       ETH_ALEN);
+		flow_tuple->out.ifidx = route->tuple[dir].out.ifindex;
 		break;
-	case NFPROTO_IPV6:
-		flow_tuple->mtu = ip6_dst_mtu_forward(dst);
+	case FLOW_OFFLOAD_XMIT_NEIGH:
+		if (!dst || !dst_hold_safe(dst))
+			return -1;
+
+		flow_tuple->dst_cache = dst;
 		break;
 	}
-
-	flow_tuple->iifidx = other_dst->dev->ifindex;
-	flow_tuple->dst_cache = dst;
+	flow_tuple->xmit_type = route->tuple[dir].xmit_type;
 
 	return 0;
 }
 
-int flow_offload_route_init(struct flow_offload *flow,
-			    const struct nf_flow_route *route)
+static void flow_offload_dst_release(struct flow_offload *flow,
+				     enum flow_offload_tuple_dir dir)
+{
+	if (flow->tuplehash[dir].tuple.xmit_type == FLOW_OFFLOAD_XMIT_NEIGH)
+		dst_release(flow->tuplehash[dir].tuple.dst_cache);
+}
+
+static int __flow_offload_route_init(struct flow_offload *flow,
+				     const struct nf_flow_route *route,
+				     enum flow_offload_type type)
 {
 	int err;
 
@@ -113,17 +143,37 @@ int flow_offload_route_init(struct flow_offload *flow,
 	if (err < 0)
 		goto err_route_reply;
 
-	flow->type = NF_FLOW_OFFLOAD_ROUTE;
+	flow->type = type;
 
 	return 0;
 
 err_route_reply:
-	dst_release(route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].dst);
+	flow_offload_dst_release(flow, FLOW_OFFLOAD_DIR_ORIGINAL);
 
 	return err;
 }
+
+int flow_offload_route_init(struct flow_offload *flow,
+			    const struct nf_flow_route *route)
+{
+	return __flow_offload_route_init(flow, route, NF_FLOW_OFFLOAD_ROUTE);
+}
 EXPORT_SYMBOL_GPL(flow_offload_route_init);
 
+/* Bridged flows never carry a route: both directions are sent straight to
+ * the bridge port with the ethernet addresses seen when the flow was set up.
+ */
+int flow_offload_bridge_init(struct flow_offload *flow,
+			     const struct nf_flow_route *route)
+{
+	if (route->tuple[FLOW_OFFLOAD_DIR_ORIGINAL].xmit_type != FLOW_OFFLOAD_XMIT_DIRECT ||
+	    route->tuple[FLOW_OFFLOAD_DIR_REPLY].xmit_type != FLOW_OFFLOAD_XMIT_DIRECT)
+		return -1;
+
+	return __flow_offload_route_init(flow, route, NF_FLOW_OFFLOAD_BRIDGE);
+}
+EXPORT_SYMBOL_GPL(flow_offload_bridge_init);
+
 static void flow_offload_fixup_tcp(struct ip_ct_tcp *tcp)
 {
 	tcp->state = TCP_CONNTRACK_ESTABLISHED;
@@ -169,14 +219,15 @@ static void flow_offload_fixup_ct(struct nf_conn *ct)
 
 static void flow_offload_route_release(struct flow_offload *flow)
 {
-	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple.dst_cache);
-	dst_release(flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple.dst_cache);
+	flow_offload_dst_release(flow, FLOW_OFFLOAD_DIR_ORIGINAL);
+	flow_offload_dst_release(flow, FLOW_OFFLOAD_DIR_REPLY);
 }
 
 void flow_offload_free(struct flow_offload *flow)
 {
 	switch (flow->type) {
 	case NF_FLOW_OFFLOAD_ROUTE:
+	case NF_FLOW_OFFLOAD_BRIDGE:
 		flow_offload_route_release(flow);
 		break;
 	default:
@@ -191,14 +242,14 @@ static u32 flow_offload_hash(const void *data, u32 len, u32 seed)
 {
 	const struct flow_offload_tuple *tuple = data;
 
-	return jhash(tuple, offsetof(struct flow_offload_tuple, dir), seed);
+	return jhash(tuple, offsetof(struct flow_offload_tuple, __hash), seed);
 }
 
 static u32 flow_offload_hash_obj(const void *data, u32 len, u32 seed)
 {
 	const struct flow_offload_tuple_rhash *tuplehash = data;
 
-	return jhash(&tuplehash->tuple, offsetof(struct flow_offload_tuple, dir), seed);
+	return jhash(&tuplehash->tuple, offsetof(struct flow_offload_tuple, __hash), seed);
 }
 
 static int flow_offload_hash_cmp(struct rhashtable_compare_arg *arg,
@@ -207,7 +258,7 @@ static int flow_offload_hash_cmp(struct rhashtable_compare_arg *arg,
 	const struct flow_offload_tuple *tuple = arg->key;
 	const struct flow_offload_tuple_rhash *x = ptr;
 
-	if (memcmp(&x->tuple, tuple, offsetof(struct flow_offload_tuple, dir)))
+	if (memcmp(&x->tuple, tuple, offsetof(struct flow_offload_tuple, __hash)))
 		return 1;
 
 	return 0;
@@ -221,6 +272,20 @@ static const struct rhashtable_params nf_flow_offload_rhash_params = {
 	.automatic_shrinking	= true,
 };
 
+/* The hardware offload rules are built from the cached routes and do not
+ * match on VLAN tags, these flows are only handled by the software path.
+ */
+static bool flow_offload_tuple_hw_capable(const struct flow_offload_tuple *tuple)
+{
+	return tuple->xmit_type == FLOW_OFFLOAD_XMIT_NEIGH && !tuple->encap_num;
+}
+
+static bool flow_offload_hw_capable(const struct flow_offload *flow)
+{
+	return flow_offload_tuple_hw_capable(&flow->tuplehash[FLOW_OFFLOAD_DIR_ORIGINAL].tuple) &&
+	       flow_offload_tuple_hw_capable(&flow->tuplehash[FLOW_OFFLOAD_DIR_REPLY].tuple);
+}
+
 int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 {
 	int err;
@@ -245,7 +310,7 @@ int flow_offload_add(struct nf_flowtable *flow_table, struct flow_offload *flow)
 
 	nf_ct_offload_timeout(flow->ct);
 
-	if (nf_flowtable_hw_offload(flow_table)) {
+	if (nf_flowtable_hw_offload(flow_table) && flow_offload_hw_capable(flow)) {
 		__set_bit(NF_FLOW_HW, &flow->flags);
 		nf_flow_offload_add(flow_table, flow);
 	}
@@ -259,7 +324,8 @@ void flow_offload_refresh(struct nf_flowtable *flow_table,
 {
 	flow->timeout = nf_flowtable_time_stamp + NF_FLOW_TIMEOUT;
 
-	if (likely(!nf_flowtable_hw_offload(flow_table)))
+	if (likely(!nf_flowtable_hw_offload(flow_table)) ||
+	    !flow_offload_hw_capable(flow))
 		return;
 
 	nf_flow_offload_add(flow_table, flow);
@@ -525,6 +591,13 @@ int nf_flow_table_init(struct nf_flowtable *flowtable)
 }
 EXPORT_SYMBOL_GPL(nf_flow_table_init);
 
+static bool flow_offload_xmit_dev(const struct flow_offload_tuple *tuple,
+				  const struct net_device *dev)
+{
+	return tuple->xmit_type == FLOW_OFFLOAD_XMIT_DIRECT &&
+	       tuple->out.ifidx == dev->ifindex;
+}
+
 static void nf_flow_table_do_cleanup(struct flow_offload *flow, void *data)
 {
 	struct net_device *dev = data;
@@ -536,7 +609,9 @@ static void nf_flow_table_do_cleanup(struct flow_offload *flow, void *data)
 
 	if (net_eq(nf_ct_net(flow->ct), dev_net(dev)) &&
 	    (flow->tuplehash[0].tuple.iifidx == dev->ifindex ||
-	     flow->tuplehash[1].tuple.iifidx == dev->ifindex))
+	     flow->tuplehash[1].tuple.iifidx == dev->ifindex ||
+	     flow_offload_xmit_dev(&flow->tuplehash[0].tuple, dev) ||
+	     flow_offload_xmit_dev(&flow->tuplehash[1].tuple, dev)))
 		flow_offload_teardown(flow);
 }
 
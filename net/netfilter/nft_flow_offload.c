@@ -6,9 +6,12 @@
 #include <linux/netfilter.h>
 #include <linux/workqueue.h>
 #include <linux/spinlock.h>
+#include <linux/etherdevice.h>
+#include <linux/if_vlan.h>
 #include <linux/netfilter/nf_conntrack_common.h>
 #include <linux/netfilter/nf_tables.h>
 #include <net/ip.h> /* for ipv4 options. */
+#include <net/neighbour.h>
 #include <net/netfilter/nf_tables.h>
 #include <net/netfilter/nf_tables_core.h>
 #include <net/netfilter/nf_conntrack_core.h>
@@ -19,8 +22,113 @@ struct nft_flow_offload {
 	struct nft_flowtable	*flowtable;
 };
 
+static bool nft_flowtable_find_dev(const struct net_device *dev,
+				   const struct nft_flowtable *ft)
+{
+	struct nft_hook *hook;
+
+	list_for_each_entry_rcu(hook, &ft->hook_list, list) {
+		if (hook->ops.dev == dev)
+			return true;
+	}
+
+	return false;
+}
+
+/* If the flowtable is attached to the device below a (stacked) VLAN device
+ * rather than to the VLAN device itself, flows are looked up on the real
+ * device and the tags are recorded, outermost first.
+ */
+static bool nft_flow_route_encap(const struct net_device *dev,
+				 const struct nft_flowtable *ft,
+				 struct nf_flow_route *route,
+				 enum ip_conntrack_dir dir)
+{
+#if IS_ENABLED(CONFIG_VLAN_8021Q)
+	const struct net_device *real_dev = dev;
+	struct vlan_dev_priv *vlan;
+	int i, n = 0;
+
+	if (nft_flowtable_find_dev(dev, ft))
+		return false;
+
+	while (is_vlan_dev(real_dev)) {
+		if (n == NF_FLOW_TABLE_ENCAP_MAX)
+			return false;
+
+		vlan = vlan_dev_priv(real_dev);
+		real_dev = vlan->real_dev;
+		n++;
+	}
+
+	if (!n || !nft_flowtable_find_dev(real_dev, ft))
+		return false;
+
+	route->tuple[dir].in.ifindex = real_dev->ifindex;
+	route->tuple[dir].in.num_encaps = n;
+	for (i = n - 1; i >= 0; i--) {
+		vlan = vlan_dev_priv(dev);
+		route->tuple[dir].in.encap[i].id = vlan->vlan_id;
+		route->tuple[dir].in.encap[i].proto = vlan->vlan_proto;
+		dev = vlan->real_dev;
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+static int nft_flow_route_neigh(struct dst_entry *dst, const void *daddr,
+				u8 *ha)
+{
+	struct neighbour *n;
+	u8 nud_state;
+
+	n = dst_neigh_lookup(dst, daddr);
+	if (!n)
+		return -ENOENT;
+
+	read_lock_bh(&n->lock);
+	nud_state = n->nud_state;
+	ether_addr_copy(ha, n->ha);
+	read_unlock_bh(&n->lock);
+	neigh_release(n);
+
+	if (!(nud_state & NUD_VALID))
+		return -ENOENT;
+
+	return 0;
+}
+
+/* Packets leaving through a VLAN device on top of a flowtable device are
+ * sent directly to the real device, the tags are pushed from the encap the
+ * reply direction was set up with.
+ */
+static void nft_flow_route_xmit(const struct nf_conn *ct,
+				struct nf_flow_route *route,
+				enum ip_conntrack_dir dir)
+{
+	struct dst_entry *dst = route->tuple[dir].dst;
+	struct net_device *dev = dst->dev;
+
+	route->tuple[dir].xmit_type = FLOW_OFFLOAD_XMIT_NEIGH;
+
+	if (!route->tuple[!dir].in.num_encaps || dst_xfrm(dst))
+		return;
+
+	if (nft_flow_route_neigh(dst, &ct->tuplehash[!dir].tuple.src.u3,
+				 route->tuple[dir].out.h_dest) < 0)
+		return;
+
+	memcpy(route->tuple[dir].out.h_source, dev->dev_addr, ETH_ALEN);
+	route->tuple[dir].out.ifindex = route->tuple[!dir].in.ifindex;
+	route->tuple[dir].xmit_type = FLOW_OFFLOAD_XMIT_DIRECT;
+}
+
 static int nft_flow_route(const struct nft_pktinfo *pkt,
 			  const struct nf_conn *ct,
+			  const struct nft_flowtable *ft,
 			  struct nf_flow_route *route,
 			  enum ip_conntrack_dir dir)
 {
@@ -47,6 +155,49 @@ static int nft_flow_route(const struct nft_pktinfo *pkt,
 	route->tuple[dir].dst		= this_dst;
 	route->tuple[!dir].dst		= other_dst;
 
+	if (!nft_flow_route_encap(other_dst->dev, ft, route, dir))
+		route->tuple[dir].in.ifindex = other_dst->dev->ifindex;
+	if (!nft_flow_route_encap(this_dst->dev, ft, route, !dir))
+		route->tuple[!dir].in.ifindex = this_dst->dev->ifindex;
+
+	nft_flow_route_xmit(ct, route, dir);
+	nft_flow_route_xmit(ct, route, !dir);
+
+	return 0;
+}
+
+/* Bridged flows are sent straight to the output port, using the ethernet
+ * addresses of this packet, swapped for the reply direction. Tagged frames,
+ * and therefore VLAN filtering bridges, are left to the bridge.
+ */
+static int nft_flow_route_bridge(const struct nft_pktinfo *pkt,
+				 struct nf_flow_route *route,
+				 enum ip_conntrack_dir dir)
+{
+	const struct net_device *in = nft_in(pkt), *out = nft_out(pkt);
+	const struct sk_buff *skb = pkt->skb;
+	const struct ethhdr *eth;
+
+	if (skb_vlan_tag_present(skb) || eth_type_vlan(skb->protocol) ||
+	    !skb_mac_header_was_set(skb))
+		return -EOPNOTSUPP;
+
+	eth = eth_hdr(skb);
+
+	route->tuple[dir].in.ifindex = in->ifindex;
+	route->tuple[dir].out.ifindex = out->ifindex;
+	route->tuple[dir].out.mtu = out->mtu;
+	memcpy(route->tuple[dir].out.h_source, eth->h_source, ETH_ALEN);
+	memcpy(route->tuple[dir].out.h_dest, eth->h_dest, ETH_ALEN);
+	route->tuple[dir].xmit_type = FLOW_OFFLOAD_XMIT_DIRECT;
+
+	route->tuple[!dir].in.ifindex = out->ifindex;
+	route->tuple[!dir].out.ifindex = in->ifindex;
+	route->tuple[!dir].out.mtu = in->mtu;
+	memcpy(route->tuple[!dir].out.h_source, eth->h_dest, ETH_ALEN);
+	memcpy(route->tuple[!dir].out.h_dest, eth->h_source, ETH_ALEN);
+	route->tuple[!dir].xmit_type = FLOW_OFFLOAD_XMIT_DIRECT;
+
 	return 0;
 }
 
@@ -75,7 +226,7 @@ static void nft_flow_offload_eval(const struct nft_expr *expr,
 	struct nf_flowtable *flowtable = &priv->flowtable->data;
 	struct tcphdr _tcph, *tcph = NULL;
 	enum ip_conntrack_info ctinfo;
-	struct nf_flow_route route;
+	struct nf_flow_route route = {};
 	struct flow_offload *flow;
 	enum ip_conntrack_dir dir;
 	struct nf_conn *ct;
@@ -112,14 +263,22 @@ static void nft_flow_offload_eval(const struct nft_expr *expr,
 		goto out;
 
 	dir = CTINFO2DIR(ctinfo);
-	if (nft_flow_route(pkt, ct, &route, dir) < 0)
+	if (nft_pf(pkt) == NFPROTO_BRIDGE)
+		ret = nft_flow_route_bridge(pkt, &route, dir);
+	else
+		ret = nft_flow_route(pkt, ct, priv->flowtable, &route, dir);
+	if (ret < 0)
 		goto err_flow_route;
 
 	flow = flow_offload_alloc(ct);
 	if (!flow)
 		goto err_flow_alloc;
 
-	if (flow_offload_route_init(flow, &route) < 0)
+	if (nft_pf(pkt) == NFPROTO_BRIDGE)
+		ret = flow_offload_bridge_init(flow, &route);
+	else
+		ret = flow_offload_route_init(flow, &route);
+	if (ret < 0)
 		goto err_flow_add;
 
 	if (tcph) {
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0-only
+
+/* PIPAPO: PIle PAcket POlicies: NEON matching routines for arm64
+ *
+ * This is built with the FP/SIMD register file available to the compiler, so
+ * it must only be called between kernel_neon_begin() and kernel_neon_end().
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nf_tables.h>
+#include <net/netfilter/nf_tables_core.h>
+#include <uapi/linux/netfilter/nf_tables.h>
+#include <linux/bitmap.h>
+#include <linux/bitops.h>
+
+#include <asm/neon-intrinsics.h>
+
+#include "nft_set_pipapo_neon.h"
+#include "nft_set_pipapo.h"
+
+/* One Q register holds two longs of a bucket */
+#define NFT_PIPAPO_LONGS_PER_M128	(128 / BITS_PER_LONG)
+
+/**
+ * nft_pipapo_neon_refill() - Scan bitmap, select mapping table item, set bits
+ * @offset:	Start from given bitmap (equivalent to bucket) offset, in longs
+ * @map:	Bitmap to be scanned for set bits
+ * @dst:	Destination bitmap
+ * @mt:		Mapping table containing bit set specifiers
+ * @len:	Count of words to be scanned, one or two
+ * @last:	Return index of first set bit, if this is the last field
+ *
+ * Same as nft_pipapo_avx2_refill(), over the words of a single Q register.
+ *
+ * Return: first set bit index if @last, index of first filled word otherwise.
+ */
+static int nft_pipapo_neon_refill(int offset, unsigned long *map,
+				  unsigned long *dst,
+				  union nft_pipapo_map_bucket *mt, int len,
+				  bool last)
+{
+	int x, ret = -1;
+
+	for (x = 0; x < len; x++) {
+		while (map[x]) {
+			int r = __builtin_ctzl(map[x]);
+			int i = (offset + x) * BITS_PER_LONG + r;
+
+			if (last)
+				return i;
+
+			bitmap_set(dst, mt[i].to, mt[i].n);
+
+			if (ret == -1)
+				ret = mt[i].to;
+
+			map[x] &= ~(1UL << r);
+		}
+	}
+
+	return ret;
+}
+
+/**
+ * nft_pipapo_neon_lookup_field() - NEON-based lookup for a single field
+ * @map:	Previous match result, used as initial bitmap
+ * @fill:	Destination bitmap to be filled with current match result
+ * @f:		Field, containing lookup and mapping tables
+ * @offset:	Ignore buckets before the given index, no bits are filled there
+ * @pkt:	Packet data, pointer to input nftables register
+ * @first:	If this is the first field, don't source previous result
+ * @last:	Last field: stop at the first match and return bit index
+ *
+ * For each 128-bit slice of the buckets, load the slice of the starting bitmap
+ * (unless this is the first field) and intersect it with the slices of the
+ * buckets selected by each group of packet bits, then refill @fill from the
+ * result. A slice of the starting bitmap that is already empty is skipped
+ * without touching the lookup table, so that sparse intermediate results are
+ * cheap.
+ *
+ * As lookup table buckets are not aligned beyond a long here, a bucket made of
+ * an odd count of longs has its last word handled as a lone 64-bit lane.
+ *
+ * Return: -1 on no match, rule index of match if @last, otherwise first long
+ * word index to be checked next (i.e. first filled word).
+ */
+int nft_pipapo_neon_lookup_field(unsigned long *map, unsigned long *fill,
+				 struct nft_pipapo_field *f, int offset,
+				 const u8 *pkt, bool first, bool last)
+{
+	unsigned long *lt = f->lt, bsize = f->bsize;
+	int i, g, b, ret = -1, nbuckets = NFT_PIPAPO_BUCKETS(f->bb);
+	u8 pg[NFT_PIPAPO_MAX_BITS / NFT_PIPAPO_GROUP_BITS_LARGE_SET];
+
+	for (g = 0; g < f->groups; g++) {
+		if (f->bb == 8)
+			pg[g] = pkt[g];
+		else
+			pg[g] = g % 2 ? pkt[g / 2] & 0xf : pkt[g / 2] >> 4;
+	}
+	NFT_PIPAPO_GROUP_BITS_ARE_8_OR_4;
+
+	for (i = offset * NFT_PIPAPO_LONGS_PER_M128; i < bsize;
+	     i += NFT_PIPAPO_LONGS_PER_M128) {
+		if (likely(i + 1 < bsize)) {
+			uint64x2_t acc;
+
+			if (first) {
+				acc = vdupq_n_u64(~0ULL);
+			} else {
+				acc = vld1q_u64((u64 *)&map[i]);
+				if (!(vgetq_lane_u64(acc, 0) |
+				      vgetq_lane_u64(acc, 1)))
+					continue;
+			}
+
+			for (g = 0; g < f->groups; g++) {
+				unsigned long *bucket;
+
+				bucket = lt + (g * nbuckets + pg[g]) * bsize + i;
+				acc = vandq_u64(acc, vld1q_u64((u64 *)bucket));
+			}
+
+			vst1q_u64((u64 *)&map[i], acc);
+			if (!(vgetq_lane_u64(acc, 0) | vgetq_lane_u64(acc, 1)))
+				continue;
+
+			b = nft_pipapo_neon_refill(i, &map[i], fill, f->mt,
+						   NFT_PIPAPO_LONGS_PER_M128,
+						   last);
+		} else {
+			unsigned long acc = first ? ~0UL : map[i];
+
+			for (g = 0; g < f->groups && acc; g++)
+				acc &= lt[(g * nbuckets + pg[g]) * bsize + i];
+
+			map[i] = acc;
+			if (!acc)
+				continue;
+
+			b = nft_pipapo_neon_refill(i, &map[i], fill, f->mt, 1,
+						   last);
+		}
+
+		if (last)
+			return b;
+
+		if (unlikely(ret == -1))
+			ret = b / 128;
+	}
+
+	return ret;
+}
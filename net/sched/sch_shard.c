@@ -0,0 +1,486 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * net/sched/sch_shard.c	Flow sharding lockless scheduler
+ *
+ * Flows are spread over a set of child qdiscs (the shards), each one
+ * protected by its own spinlock. The shard qdisc itself is TCQ_F_NOLOCK:
+ * enqueues from different CPUs only contend when they hash to the same
+ * shard, instead of all serializing on the root qdisc lock.
+ *
+ * All packets of a socket (or of a flow hash, for traffic without a full
+ * socket) are steered to the same shard, so the per flow fairness, CoDel
+ * state and pacing of fq_codel or fq children are left intact. The single
+ * dequeue runner serves the shards in round robin order.
+ *
+ * Every child gets a private netdev_queue whose qdisc_sleeping points back
+ * at the child, so that sch_tree_lock() from the child's own control path
+ * takes the child lock the data path uses, while qdisc_root() still
+ * resolves to the shard qdisc for watchdog rescheduling.
+ */
+
+#include <linux/module.h>
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/skbuff.h>
+#include <linux/netdevice.h>
+#include <net/netlink.h>
+#include <net/pkt_sched.h>
+#include <net/sch_generic.h>
+#include <net/sock.h>
+
+#define SHARD_MAX_SHARDS	256
+
+struct shard {
+	struct Qdisc		*qdisc;
+	struct netdev_queue	dev_queue;
+	/* child qlen/backlog already folded into the shard qdisc */
+	unsigned int		qlen;
+	unsigned int		backlog;
+};
+
+struct shard_sched_data {
+	struct shard		*shards;
+	u32			nshards;
+	u32			next;
+};
+
+static const struct nla_policy shard_policy[TCA_SHARD_MAX + 1] = {
+	[TCA_SHARD_COUNT]	= NLA_POLICY_RANGE(NLA_U32, 1,
+						   SHARD_MAX_SHARDS),
+};
+
+static struct shard *shard_classify(struct sk_buff *skb,
+				    const struct shard_sched_data *q)
+{
+	struct sock *sk = skb->sk;
+	u32 hash;
+
+	/* Keep a socket in one shard even if its txhash is rehashed */
+	if (sk && sk_fullsock(sk))
+		hash = hash_ptr(sk, 32);
+	else
+		hash = skb_get_hash(skb);
+
+	return &q->shards[reciprocal_scale(hash, q->nshards)];
+}
+
+/* Called with the child lock held. Sets @qlen and @backlog to how far the
+ * child's counters moved since they were last folded into the shard qdisc.
+ * Besides our own enqueue or dequeue, this picks up packets a change() of
+ * the child dropped: qdisc_tree_reduce_backlog() stops at the
+ * TCQ_F_NOPARENT child.
+ */
+static void shard_sync(struct shard *s, int *qlen, int *backlog)
+{
+	struct Qdisc *child = s->qdisc;
+
+	*qlen = child->q.qlen - s->qlen;
+	*backlog = child->qstats.backlog - s->backlog;
+	s->qlen = child->q.qlen;
+	s->backlog = child->qstats.backlog;
+}
+
+/* Children account their own queue, fold the changes into the shard qdisc
+ * and, when it runs locked under a classful parent, into the ancestors.
+ * @expected is the qlen/backlog change the parent accounts by itself.
+ */
+static void shard_account(struct Qdisc *sch, int qlen, int backlog,
+			  int expected, int expected_len, int drops)
+{
+	if (qdisc_is_percpu_stats(sch)) {
+		this_cpu_add(sch->cpu_qstats->qlen, qlen);
+		this_cpu_add(sch->cpu_qstats->backlog, backlog);
+		if (drops > 0)
+			this_cpu_add(sch->cpu_qstats->drops, drops);
+		return;
+	}
+
+	sch->q.qlen += qlen;
+	sch->qstats.backlog += backlog;
+	if (drops > 0)
+		sch->qstats.drops += drops;
+
+	if (qlen != expected || backlog != expected_len)
+		qdisc_tree_reduce_backlog(sch, expected - qlen,
+					  expected_len - backlog);
+}
+
+static int shard_enqueue(struct sk_buff *skb, struct Qdisc *sch,
+			 struct sk_buff **to_free)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	struct shard *s = shard_classify(skb, q);
+	struct Qdisc *child = s->qdisc;
+	unsigned int pkt_len = qdisc_pkt_len(skb);
+	int qlen, backlog, ret, queued;
+
+	spin_lock_nested(qdisc_lock(child), SINGLE_DEPTH_NESTING);
+	ret = qdisc_enqueue(skb, child, to_free);
+	shard_sync(s, &qlen, &backlog);
+	spin_unlock(qdisc_lock(child));
+
+	queued = ret == NET_XMIT_SUCCESS;
+	shard_account(sch, qlen, backlog, queued, queued ? pkt_len : 0,
+		      1 - qlen - !!(ret & __NET_XMIT_STOLEN));
+	return ret;
+}
+
+static struct sk_buff *shard_dequeue_child(struct Qdisc *sch,
+					   struct shard *s)
+{
+	struct Qdisc *child = s->qdisc;
+	struct sk_buff *skb;
+	int qlen, backlog;
+
+	/* Still look at an emptied child we have not synced with yet */
+	if (!READ_ONCE(child->q.qlen) && !READ_ONCE(s->qlen))
+		return NULL;
+
+	spin_lock_nested(qdisc_lock(child), SINGLE_DEPTH_NESTING);
+	skb = child->q.qlen ? child->dequeue(child) : NULL;
+	shard_sync(s, &qlen, &backlog);
+	spin_unlock(qdisc_lock(child));
+
+	if (qlen || backlog)
+		shard_account(sch, qlen, backlog, skb ? -1 : 0,
+			      skb ? -(int)qdisc_pkt_len(skb) : 0,
+			      -qlen - !!skb);
+	return skb;
+}
+
+static struct sk_buff *shard_dequeue(struct Qdisc *sch)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	struct sk_buff *skb = NULL;
+	bool need_retry = true;
+	u32 i;
+
+retry:
+	for (i = 0; i < q->nshards && !skb; i++) {
+		struct shard *s = &q->shards[q->next];
+
+		if (++q->next == q->nshards)
+			q->next = 0;
+		skb = shard_dequeue_child(sch, s);
+	}
+	if (likely(skb)) {
+		if (qdisc_is_percpu_stats(sch))
+			qdisc_bstats_cpu_update(sch, skb);
+		else
+			qdisc_bstats_update(sch, skb);
+	} else if (need_retry &&
+		   test_bit(__QDISC_STATE_MISSED, &sch->state)) {
+		/* Same protocol as pfifo_fast_dequeue(): an enqueuer raced
+		 * with us while we held the seqlock, look once more.
+		 */
+		clear_bit(__QDISC_STATE_MISSED, &sch->state);
+
+		/* Make sure dequeuing happens after clearing STATE_MISSED */
+		smp_mb__after_atomic();
+		need_retry = false;
+		goto retry;
+	} else {
+		WRITE_ONCE(sch->empty, true);
+	}
+
+	return skb;
+}
+
+static void shard_reset(struct Qdisc *sch)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	u32 i;
+	int cpu;
+
+	for (i = 0; i < q->nshards && q->shards[i].qdisc; i++) {
+		struct shard *s = &q->shards[i];
+		struct Qdisc *child = s->qdisc;
+
+		spin_lock_nested(qdisc_lock(child), SINGLE_DEPTH_NESTING);
+		qdisc_reset(child);
+		s->qlen = 0;
+		s->backlog = 0;
+		spin_unlock(qdisc_lock(child));
+	}
+
+	if (qdisc_is_percpu_stats(sch)) {
+		for_each_possible_cpu(cpu) {
+			struct gnet_stats_queue *qstats;
+
+			qstats = per_cpu_ptr(sch->cpu_qstats, cpu);
+			qstats->backlog = 0;
+			qstats->qlen = 0;
+		}
+	}
+}
+
+static void shard_destroy(struct Qdisc *sch)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	u32 i;
+
+	if (!q->shards)
+		return;
+	for (i = 0; i < q->nshards && q->shards[i].qdisc; i++)
+		qdisc_put(q->shards[i].qdisc);
+	kfree(q->shards);
+}
+
+static int shard_init(struct Qdisc *sch, struct nlattr *opt,
+		      struct netlink_ext_ack *extack)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	struct net_device *dev = qdisc_dev(sch);
+	const struct Qdisc_ops *ops = default_qdisc_ops;
+	struct nlattr *tb[TCA_SHARD_MAX + 1];
+	u32 i, nshards;
+	int err;
+
+	nshards = min_t(u32, num_online_cpus(), SHARD_MAX_SHARDS);
+	if (opt) {
+		err = nla_parse_nested(tb, TCA_SHARD_MAX, opt, shard_policy,
+				       extack);
+		if (err < 0)
+			return err;
+		if (tb[TCA_SHARD_COUNT])
+			nshards = nla_get_u32(tb[TCA_SHARD_COUNT]);
+	}
+
+	/* Children must keep plain qlen/backlog counters and must not be
+	 * shard qdiscs themselves when shard is the default qdisc.
+	 */
+	if (ops == sch->ops || (ops->static_flags & TCQ_F_CPUSTATS))
+		ops = &pfifo_qdisc_ops;
+
+	q->shards = kcalloc(nshards, sizeof(*q->shards), GFP_KERNEL);
+	if (!q->shards)
+		return -ENOMEM;
+	q->nshards = nshards;
+
+	for (i = 0; i < nshards; i++) {
+		struct shard *s = &q->shards[i];
+		struct Qdisc *child;
+
+		s->dev_queue.dev = dev;
+		RCU_INIT_POINTER(s->dev_queue.qdisc, sch);
+		netdev_queue_numa_node_write(&s->dev_queue,
+					     netdev_queue_numa_node_read(sch->dev_queue));
+
+		child = qdisc_create_dflt(&s->dev_queue, ops,
+					  TC_H_MAKE(sch->handle, i + 1),
+					  extack);
+		if (!child)
+			return -ENOMEM;
+
+		child->flags |= TCQ_F_NOPARENT;
+		s->dev_queue.qdisc_sleeping = child;
+		s->qdisc = child;
+		qdisc_hash_add(child, true);
+	}
+
+	return 0;
+}
+
+/* Fold changes the data path has not seen yet, such as packets dropped by a
+ * change() of an idle child, so that dumps report exact counters.
+ */
+static void shard_sync_all(struct Qdisc *sch)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	bool percpu = qdisc_is_percpu_stats(sch);
+	int qlen, backlog;
+	u32 i;
+
+	if (percpu)
+		local_bh_disable();
+	else
+		sch_tree_lock(sch);
+
+	for (i = 0; i < q->nshards; i++) {
+		struct shard *s = &q->shards[i];
+
+		spin_lock_nested(qdisc_lock(s->qdisc), SINGLE_DEPTH_NESTING);
+		shard_sync(s, &qlen, &backlog);
+		spin_unlock(qdisc_lock(s->qdisc));
+
+		if (qlen || backlog)
+			shard_account(sch, qlen, backlog, 0, 0, -qlen);
+	}
+
+	if (percpu)
+		local_bh_enable();
+	else
+		sch_tree_unlock(sch);
+}
+
+static int shard_dump(struct Qdisc *sch, struct sk_buff *skb)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	struct nlattr *opts;
+
+	shard_sync_all(sch);
+
+	opts = nla_nest_start_noflag(skb, TCA_OPTIONS);
+	if (!opts)
+		goto nla_put_failure;
+	if (nla_put_u32(skb, TCA_SHARD_COUNT, q->nshards))
+		goto nla_put_failure;
+	return nla_nest_end(skb, opts);
+
+nla_put_failure:
+	return -1;
+}
+
+static struct shard *shard_get(struct Qdisc *sch, unsigned long cl)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+
+	if (!cl || cl > q->nshards)
+		return NULL;
+	return &q->shards[cl - 1];
+}
+
+static struct netdev_queue *shard_select_queue(struct Qdisc *sch,
+					       struct tcmsg *tcm)
+{
+	struct shard *s = shard_get(sch, TC_H_MIN(tcm->tcm_parent));
+
+	return s ? &s->dev_queue : NULL;
+}
+
+static int shard_graft(struct Qdisc *sch, unsigned long cl, struct Qdisc *new,
+		       struct Qdisc **old, struct netlink_ext_ack *extack)
+{
+	struct net_device *dev = qdisc_dev(sch);
+	struct shard *s = shard_get(sch, cl);
+	int qlen, backlog;
+
+	if (!new) {
+		new = qdisc_create_dflt(&s->dev_queue, &pfifo_qdisc_ops,
+					TC_H_MAKE(sch->handle, cl), extack);
+		if (!new)
+			return -ENOMEM;
+		qdisc_hash_add(new, true);
+	} else if (new->dev_queue != &s->dev_queue) {
+		NL_SET_ERR_MSG(extack, "Qdisc was not created for this shard");
+		return -EINVAL;
+	} else if (qdisc_is_percpu_stats(new)) {
+		NL_SET_ERR_MSG(extack, "Shards do not support per-cpu statistics qdiscs");
+		return -EOPNOTSUPP;
+	}
+
+	new->flags |= TCQ_F_NOPARENT;
+
+	/* The data path reads the shard without any lock held */
+	if (dev->flags & IFF_UP)
+		dev_deactivate(dev);
+
+	*old = s->qdisc;
+	s->qdisc = new;
+	s->dev_queue.qdisc_sleeping = new;
+
+	/* The packets of the old child are dropped when it is destroyed */
+	sch_tree_lock(sch);
+	shard_sync(s, &qlen, &backlog);
+	if (qlen || backlog)
+		shard_account(sch, qlen, backlog, 0, 0, -qlen);
+	sch_tree_unlock(sch);
+
+	if (dev->flags & IFF_UP)
+		dev_activate(dev);
+	return 0;
+}
+
+static struct Qdisc *shard_leaf(struct Qdisc *sch, unsigned long cl)
+{
+	return shard_get(sch, cl)->qdisc;
+}
+
+static unsigned long shard_find(struct Qdisc *sch, u32 classid)
+{
+	unsigned long cl = TC_H_MIN(classid);
+
+	return shard_get(sch, cl) ? cl : 0;
+}
+
+static int shard_dump_class(struct Qdisc *sch, unsigned long cl,
+			    struct sk_buff *skb, struct tcmsg *tcm)
+{
+	tcm->tcm_parent = TC_H_ROOT;
+	tcm->tcm_handle |= TC_H_MIN(cl);
+	tcm->tcm_info = shard_get(sch, cl)->qdisc->handle;
+	return 0;
+}
+
+static int shard_dump_class_stats(struct Qdisc *sch, unsigned long cl,
+				  struct gnet_dump *d)
+{
+	struct Qdisc *child = shard_get(sch, cl)->qdisc;
+
+	if (gnet_stats_copy_basic(qdisc_root_sleeping_running(child), d,
+				  child->cpu_bstats, &child->bstats) < 0 ||
+	    qdisc_qstats_copy(d, child) < 0)
+		return -1;
+	return 0;
+}
+
+static void shard_walk(struct Qdisc *sch, struct qdisc_walker *arg)
+{
+	struct shard_sched_data *q = qdisc_priv(sch);
+	u32 i;
+
+	if (arg->stop)
+		return;
+
+	arg->count = arg->skip;
+	for (i = arg->skip; i < q->nshards; i++) {
+		if (arg->fn(sch, i + 1, arg) < 0) {
+			arg->stop = 1;
+			break;
+		}
+		arg->count++;
+	}
+}
+
+static const struct Qdisc_class_ops shard_class_ops = {
+	.select_queue	= shard_select_queue,
+	.graft		= shard_graft,
+	.leaf		= shard_leaf,
+	.find		= shard_find,
+	.walk		= shard_walk,
+	.dump		= shard_dump_class,
+	.dump_stats	= shard_dump_class_stats,
+};
+
+static struct Qdisc_ops shard_qdisc_ops __read_mostly = {
+	.cl_ops		= &shard_class_ops,
+	.id		= "shard",
+	.priv_size	= sizeof(struct shard_sched_data),
+	.enqueue	= shard_enqueue,
+	.dequeue	= shard_dequeue,
+	.peek		= qdisc_peek_dequeued,
+	.init		= shard_init,
+	.reset		= shard_reset,
+	.destroy	= shard_destroy,
+	.dump		= shard_dump,
+	.static_flags	= TCQ_F_NOLOCK | TCQ_F_CPUSTATS,
+	.owner		= THIS_MODULE,
+};
+
+static int __init shard_module_init(void)
+{
+	return register_qdisc(&shard_qdisc_ops);
+}
+
+static void __exit shard_module_exit(void)
+{
+	unregister_qdisc(&shard_qdisc_ops);
+}
+
+module_init(shard_module_init)
+module_exit(shard_module_exit)
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Flow sharding lockless packet scheduler");
@@ -494,6 +494,7 @@ static void unix_sock_destructor(struct sock *sk)
 	struct unix_sock *u = unix_sk(sk);
 
 	skb_queue_purge(&sk->sk_receive_queue);
+	skb_queue_purge(&sk->sk_error_queue);
 
 	WARN_ON(refcount_read(&sk->sk_wmem_alloc));
 	WARN_ON(!sk_unhashed(sk));
@@ -1889,10 +1890,40 @@ static int unix_dgram_sendmsg(struct socket *sock, struct msghdr *msg,
  */
 #define UNIX_SKB_FRAGS_SZ (PAGE_SIZE << get_order(32768))
 
+/* MSG_ZEROCOPY: the user pages are pinned and attached as frags to an skb
+ * with an empty head, the receiver copies straight out of them. The
+ * completion is queued on the sender's error queue once the receiver has
+ * consumed the skb.
+ */
+static struct sk_buff *unix_stream_zerocopy_skb(struct sock *sk,
+						struct msghdr *msg,
+						struct ubuf_info *uarg,
+						int size, int *err)
+{
+	struct sk_buff *skb;
+
+	skb = sock_alloc_send_pskb(sk, 0, 0, msg->msg_flags & MSG_DONTWAIT,
+				   err, 0);
+	if (!skb)
+		return NULL;
+
+	*err = __zerocopy_sg_from_iter(NULL, skb, &msg->msg_iter, size);
+	if (*err == -EFAULT || (*err == -EMSGSIZE && !skb->len)) {
+		kfree_skb(skb);
+		return NULL;
+	}
+
+	*err = 0;
+	skb_zcopy_set(skb, uarg, NULL);
+
+	return skb;
+}
+
 static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 			       size_t len)
 {
 	struct sock *sk = sock->sk;
+	struct ubuf_info *uarg = NULL;
 	struct sock *other = NULL;
 	int err, size;
 	struct sk_buff *skb;
@@ -1923,24 +1954,46 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 	if (sk->sk_shutdown & SEND_SHUTDOWN)
 		goto pipe_err;
 
+	if (msg->msg_flags & MSG_ZEROCOPY && len) {
+		if (msg->msg_ubuf) {
+			uarg = msg->msg_ubuf;
+			sock_zerocopy_get(uarg);
+		} else if (sock_flag(sk, SOCK_ZEROCOPY)) {
+			uarg = sock_zerocopy_alloc(sk, len);
+			if (!uarg) {
+				err = -ENOBUFS;
+				goto out_err;
+			}
+		}
+	}
+
 	while (sent < len) {
 		size = len - sent;
 
 		/* Keep two messages in the pipe so it schedules better */
 		size = min_t(int, size, (sk->sk_sndbuf >> 1) - 64);
 
-		/* allow fallback to order-0 allocations */
-		size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
+		if (uarg) {
+			skb = unix_stream_zerocopy_skb(sk, msg, uarg, size,
+						       &err);
+			if (!skb)
+				goto out_err;
 
-		data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
+			size = skb->len;
+		} else {
+			/* allow fallback to order-0 allocations */
+			size = min_t(int, size, SKB_MAX_HEAD(0) + UNIX_SKB_FRAGS_SZ);
 
-		data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
+			data_len = max_t(int, 0, size - SKB_MAX_HEAD(0));
 
-		skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
-					   msg->msg_flags & MSG_DONTWAIT, &err,
-					   get_order(UNIX_SKB_FRAGS_SZ));
-		if (!skb)
-			goto out_err;
+			data_len = min_t(size_t, size, PAGE_ALIGN(data_len));
+
+			skb = sock_alloc_send_pskb(sk, size - data_len, data_len,
+						   msg->msg_flags & MSG_DONTWAIT, &err,
+						   get_order(UNIX_SKB_FRAGS_SZ));
+			if (!skb)
+				goto out_err;
+		}
 
 		/* Only send the fds in the first buffer */
 		err = unix_scm_to_skb(&scm, skb, !fds_sent);
@@ -1950,13 +2003,16 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		}
 		fds_sent = true;
 
-		skb_put(skb, size - data_len);
-		skb->data_len = data_len;
-		skb->len = size;
-		err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter, size);
-		if (err) {
-			kfree_skb(skb);
-			goto out_err;
+		if (!uarg) {
+			skb_put(skb, size - data_len);
+			skb->data_len = data_len;
+			skb->len = size;
+			err = skb_copy_datagram_from_iter(skb, 0, &msg->msg_iter,
+							  size);
+			if (err) {
+				kfree_skb(skb);
+				goto out_err;
+			}
 		}
 
 		unix_state_lock(other);
@@ -1973,6 +2029,7 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		sent += size;
 	}
 
+	sock_zerocopy_put(uarg);
 	scm_destroy(&scm);
 
 	return sent;
@@ -1985,6 +2042,10 @@ static int unix_stream_sendmsg(struct socket *sock, struct msghdr *msg,
 		send_sig(SIGPIPE, current, 0);
 	err = -EPIPE;
 out_err:
+	if (sent)
+		sock_zerocopy_put(uarg);
+	else
+		sock_zerocopy_put_abort(uarg, true);
 	scm_destroy(&scm);
 	return sent ? : err;
 }
@@ -2050,7 +2111,7 @@ static ssize_t unix_stream_sendpage(struct socket *socket, struct page *page,
 	skb = skb_peek_tail(&other->sk_receive_queue);
 	if (tail && tail == skb) {
 		skb = newskb;
-	} else if (!skb || !unix_skb_scm_eq(skb, &scm)) {
+	} else if (!skb || !unix_skb_scm_eq(skb, &scm) || skb_zcopy(skb)) {
 		if (newskb) {
 			skb = newskb;
 		} else {
@@ -2433,6 +2494,16 @@ static int unix_stream_read_generic(struct unix_stream_read_state *state,
 			sunaddr = NULL;
 		}
 
+		/* A pipe would keep referencing MSG_ZEROCOPY pages after the
+		 * completion has told the sender it can reuse them, so splice
+		 * a private copy. The skb must not be shared for that.
+		 */
+		if (state->pipe && skb_zcopy(skb)) {
+			err = skb_orphan_frags_rx(skb, GFP_KERNEL);
+			if (err)
+				break;
+		}
+
 		chunk = min_t(unsigned int, unix_skb_len(skb) - skip, size);
 		skb_get(skb);
 		chunk = state->recv_actor(skb, skip, chunk, state);
@@ -2532,6 +2603,11 @@ static int unix_stream_recvmsg(struct socket *sock, struct msghdr *msg,
 		.flags = flags
 	};
 
+	/* MSG_ZEROCOPY completions, reported the same way as RDS does */
+	if (unlikely(flags & MSG_ERRQUEUE))
+		return sock_recv_errqueue(sock->sk, msg, size, SOL_IP,
+					  IP_RECVERR);
+
 	return unix_stream_read_generic(&state, true);
 }
 
@@ -2722,8 +2798,9 @@ static __poll_t unix_poll(struct file *file, struct socket *sock, poll_table *wa
 	mask = 0;
 
 	/* exceptional events? */
-	if (sk->sk_err)
-		mask |= EPOLLERR;
+	if (sk->sk_err || !skb_queue_empty_lockless(&sk->sk_error_queue))
+		mask |= EPOLLERR |
+			(sock_flag(sk, SOCK_SELECT_ERR_QUEUE) ? EPOLLPRI : 0);
 	if (sk->sk_shutdown == SHUTDOWN_MASK)
 		mask |= EPOLLHUP;
 	if (sk->sk_shutdown & RCV_SHUTDOWN)
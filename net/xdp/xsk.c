@@ -30,6 +30,8 @@
 #include "xsk.h"
 
 #define TX_BATCH_SIZE 16
+/* Max descriptors per multi-buffer packet in copy mode */
+#define XSK_DESC_MAX (MAX_SKB_FRAGS + 1)
 
 static DEFINE_PER_CPU(struct list_head, xskmap_flush_list);
 
@@ -148,14 +150,15 @@ static u64 xp_get_handle(struct xdp_buff_xsk *xskb)
 	return xskb->orig_addr + (offset << XSK_UNALIGNED_BUF_OFFSET_SHIFT);
 }
 
-static int __xsk_rcv_zc(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len)
+static int __xsk_rcv_zc(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len,
+			u32 flags)
 {
 	struct xdp_buff_xsk *xskb = container_of(xdp, struct xdp_buff_xsk, xdp);
 	u64 addr;
 	int err;
 
 	addr = xp_get_handle(xskb);
-	err = xskq_prod_reserve_desc(xs->rx, addr, len);
+	err = xskq_prod_reserve_desc(xs->rx, addr, len, flags);
 	if (err) {
 		xs->rx_queue_full++;
 		return err;
@@ -183,6 +186,54 @@ static void xsk_copy_xdp(struct xdp_buff *to, struct xdp_buff *from, u32 len)
 	memcpy(to_buf, from_buf, len + metalen);
 }
 
+/* Copy a frame that does not fit in one buffer into a chain of buffers,
+ * all but the last one marked with XDP_PKT_CONTD. The chain is posted to
+ * the Rx ring as a whole or not at all.
+ */
+static int __xsk_rcv_sg(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len,
+			bool explicit_free)
+{
+	u32 frame_size = xsk_pool_get_rx_frame_size(xs->pool);
+	struct xdp_buff *bufs[XSK_DESC_MAX];
+	u32 i, nr, copied, copy_len;
+
+	nr = DIV_ROUND_UP(len, frame_size);
+	if (nr > XSK_DESC_MAX) {
+		xs->rx_dropped++;
+		return -ENOSPC;
+	}
+
+	if (xskq_prod_nb_free(xs->rx, nr) < nr) {
+		xs->rx_queue_full++;
+		return -ENOBUFS;
+	}
+
+	for (i = 0; i < nr; i++) {
+		bufs[i] = xsk_buff_alloc(xs->pool);
+		if (!bufs[i]) {
+			while (i--)
+				xsk_buff_free(bufs[i]);
+			xs->rx_dropped++;
+			return -ENOSPC;
+		}
+	}
+
+	/* Metadata, if any, only goes in front of the first buffer */
+	xsk_copy_xdp(bufs[0], xdp, frame_size);
+	__xsk_rcv_zc(xs, bufs[0], frame_size, XDP_PKT_CONTD);
+
+	for (i = 1, copied = frame_size; i < nr; i++, copied += copy_len) {
+		copy_len = min(len - copied, frame_size);
+		memcpy(bufs[i]->data, xdp->data + copied, copy_len);
+		__xsk_rcv_zc(xs, bufs[i], copy_len,
+			     i < nr - 1 ? XDP_PKT_CONTD : 0);
+	}
+
+	if (explicit_free)
+		xdp_return_buff(xdp);
+	return 0;
+}
+
 static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len,
 		     bool explicit_free)
 {
@@ -190,6 +241,8 @@ static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len,
 	int err;
 
 	if (len > xsk_pool_get_rx_frame_size(xs->pool)) {
+		if (xs->sg)
+			return __xsk_rcv_sg(xs, xdp, len, explicit_free);
 		xs->rx_dropped++;
 		return -ENOSPC;
 	}
@@ -201,7 +254,7 @@ static int __xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp, u32 len,
 	}
 
 	xsk_copy_xdp(xsk_xdp, xdp, len);
-	err = __xsk_rcv_zc(xs, xsk_xdp, len);
+	err = __xsk_rcv_zc(xs, xsk_xdp, len, 0);
 	if (err) {
 		xsk_buff_free(xsk_xdp);
 		return err;
@@ -243,7 +296,7 @@ static int xsk_rcv(struct xdp_sock *xs, struct xdp_buff *xdp,
 	len = xdp->data_end - xdp->data;
 
 	return xdp->rxq->mem.type == MEM_TYPE_XSK_BUFF_POOL ?
-		__xsk_rcv_zc(xs, xdp, len) :
+		__xsk_rcv_zc(xs, xdp, len, 0) :
 		__xsk_rcv(xs, xdp, len, explicit_free);
 }
 
@@ -322,6 +375,13 @@ bool xsk_tx_peek_desc(struct xsk_buff_pool *pool, struct xdp_desc *desc)
 			continue;
 		}
 
+		/* Zero-copy drivers only take single buffer packets */
+		if (unlikely(desc->options & XDP_PKT_CONTD)) {
+			xs->tx->invalid_descs++;
+			xskq_cons_release(xs->tx);
+			continue;
+		}
+
 		/* This is the backpressure mechanism for the Tx path.
 		 * Reserve space in the completion queue and only proceed
 		 * if there is space in it. This avoids having to implement
@@ -341,6 +401,75 @@ bool xsk_tx_peek_desc(struct xsk_buff_pool *pool, struct xdp_desc *desc)
 }
 EXPORT_SYMBOL(xsk_tx_peek_desc);
 
+static u32 xsk_tx_peek_release_fallback(struct xsk_buff_pool *pool,
+					u32 max_entries)
+{
+	struct xdp_desc *descs = pool->tx_descs;
+	u32 nb_pkts = 0;
+
+	while (nb_pkts < max_entries && xsk_tx_peek_desc(pool, &descs[nb_pkts]))
+		nb_pkts++;
+
+	xsk_tx_release(pool);
+	return nb_pkts;
+}
+
+/* Batched version of xsk_tx_peek_desc() and xsk_tx_release(): fills
+ * pool->tx_descs with up to @max_entries descriptors, reserves their
+ * completion slots and releases the Tx ring, all at once. A pool shared
+ * by several sockets goes through the one-by-one path.
+ */
+u32 xsk_tx_peek_release_desc_batch(struct xsk_buff_pool *pool, u32 max_entries)
+{
+	struct xdp_sock *xs;
+	u32 nb_pkts;
+
+	max_entries = min(max_entries, pool->tx_descs_cnt);
+	if (!max_entries)
+		return 0;
+
+	rcu_read_lock();
+	if (!list_is_singular(&pool->xsk_tx_list)) {
+		rcu_read_unlock();
+		return xsk_tx_peek_release_fallback(pool, max_entries);
+	}
+
+	xs = list_first_or_null_rcu(&pool->xsk_tx_list, struct xdp_sock,
+				    tx_list);
+	if (!xs) {
+		nb_pkts = 0;
+		goto out;
+	}
+
+	nb_pkts = xskq_cons_nb_entries(xs->tx, max_entries);
+
+	/* This is the backpressure mechanism for the Tx path. Reserve
+	 * space in the completion queue for as many packets as fit and
+	 * only send those. This avoids having to implement any buffering
+	 * in the Tx path.
+	 */
+	nb_pkts = xskq_prod_nb_free(pool->cq, nb_pkts);
+	if (!nb_pkts)
+		goto out;
+
+	nb_pkts = xskq_cons_read_desc_batch(xs->tx, pool, pool->tx_descs,
+					    nb_pkts);
+	if (!nb_pkts) {
+		xs->tx->queue_empty_descs++;
+		goto out;
+	}
+
+	__xskq_cons_release(xs->tx);
+	xskq_prod_write_addr_batch(pool->cq, pool->tx_descs, nb_pkts);
+	if (xsk_tx_writeable(xs))
+		xs->sk.sk_write_space(&xs->sk);
+
+out:
+	rcu_read_unlock();
+	return nb_pkts;
+}
+EXPORT_SYMBOL(xsk_tx_peek_release_desc_batch);
+
 static int xsk_wakeup(struct xdp_sock *xs, u8 flags)
 {
 	struct net_device *dev = xs->dev;
@@ -358,19 +487,106 @@ static int xsk_zc_xmit(struct xdp_sock *xs)
 	return xsk_wakeup(xs, XDP_WAKEUP_TX);
 }
 
+static u32 xsk_get_num_desc(struct sk_buff *skb)
+{
+	return skb ? (long)skb_shinfo(skb)->destructor_arg : 0;
+}
+
+static void xsk_cq_cancel_locked(struct xdp_sock *xs, u32 n)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&xs->pool->cq_lock, flags);
+	xskq_prod_cancel_n(xs->pool->cq, n);
+	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
+}
+
 static void xsk_destruct_skb(struct sk_buff *skb)
 {
-	u64 addr = (u64)(long)skb_shinfo(skb)->destructor_arg;
 	struct xdp_sock *xs = xdp_sk(skb->sk);
 	unsigned long flags;
 
 	spin_lock_irqsave(&xs->pool->cq_lock, flags);
-	xskq_prod_submit_addr(xs->pool->cq, addr);
+	xskq_prod_submit_n(xs->pool->cq, xsk_get_num_desc(skb));
 	spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 
 	sock_wfree(skb);
 }
 
+/* Free an skb whose descriptors never made it to the completion ring */
+static void xsk_consume_skb(struct sk_buff *skb)
+{
+	struct xdp_sock *xs = xdp_sk(skb->sk);
+
+	skb->destructor = sock_wfree;
+	xsk_cq_cancel_locked(xs, xsk_get_num_desc(skb));
+	/* Free skb without triggering the perf drop trace */
+	consume_skb(skb);
+	xs->skb = NULL;
+}
+
+static void xsk_drop_skb(struct sk_buff *skb)
+{
+	xdp_sk(skb->sk)->tx->invalid_descs += xsk_get_num_desc(skb);
+	xsk_consume_skb(skb);
+}
+
+static struct sk_buff *xsk_build_skb(struct xdp_sock *xs,
+				     struct xdp_desc *desc)
+{
+	struct net_device *dev = xs->dev;
+	struct sk_buff *skb = xs->skb;
+	char *buffer;
+	int err;
+	u32 len;
+
+	buffer = xsk_buff_raw_get_data(xs->pool, desc->addr);
+	len = desc->len;
+
+	if (!skb) {
+		u32 hr, tr;
+
+		hr = max(NET_SKB_PAD, L1_CACHE_ALIGN(dev->needed_headroom));
+		tr = dev->needed_tailroom;
+		skb = sock_alloc_send_skb(&xs->sk, hr + len + tr, 1, &err);
+		if (unlikely(!skb))
+			return ERR_PTR(err);
+
+		skb_reserve(skb, hr);
+		skb_put(skb, len);
+
+		err = skb_store_bits(skb, 0, buffer, len);
+		if (unlikely(err)) {
+			kfree_skb(skb);
+			return ERR_PTR(err);
+		}
+
+		skb->dev = dev;
+		skb->priority = xs->sk.sk_priority;
+		skb->mark = xs->sk.sk_mark;
+		skb->destructor = xsk_destruct_skb;
+		skb_shinfo(skb)->destructor_arg = (void *)1L;
+	} else {
+		int nr_frags = skb_shinfo(skb)->nr_frags;
+		struct page *page;
+
+		if (unlikely(nr_frags == MAX_SKB_FRAGS))
+			return ERR_PTR(-EOVERFLOW);
+
+		page = alloc_page(xs->sk.sk_allocation);
+		if (unlikely(!page))
+			return ERR_PTR(-EAGAIN);
+
+		memcpy(page_address(page), buffer, len);
+		skb_add_rx_frag(skb, nr_frags, page, 0, len, PAGE_SIZE);
+		refcount_add(PAGE_SIZE, &xs->sk.sk_wmem_alloc);
+		skb_shinfo(skb)->destructor_arg =
+			(void *)(long)(xsk_get_num_desc(skb) + 1);
+	}
+
+	return skb;
+}
+
 static int xsk_generic_xmit(struct sock *sk)
 {
 	struct xdp_sock *xs = xdp_sk(sk);
@@ -380,70 +596,71 @@ static int xsk_generic_xmit(struct sock *sk)
 	struct sk_buff *skb;
 	unsigned long flags;
 	int err = 0;
-	u32 hr, tr;
 
 	mutex_lock(&xs->mutex);
 
 	if (xs->queue_id >= xs->dev->real_num_tx_queues)
 		goto out;
 
-	hr = max(NET_SKB_PAD, L1_CACHE_ALIGN(xs->dev->needed_headroom));
-	tr = xs->dev->needed_tailroom;
-
 	while (xskq_cons_peek_desc(xs->tx, &desc, xs->pool)) {
-		char *buffer;
-		u64 addr;
-		u32 len;
-
 		if (max_batch-- == 0) {
 			err = -EAGAIN;
 			goto out;
 		}
 
-		len = desc.len;
-		skb = sock_alloc_send_skb(sk, hr + len + tr, 1, &err);
-		if (unlikely(!skb))
-			goto out;
-
-		skb_reserve(skb, hr);
-		skb_put(skb, len);
+		if (unlikely(!xs->sg && (desc.options & XDP_PKT_CONTD))) {
+			/* Multi-buffer packets need XDP_USE_SG at bind time */
+			xs->tx->invalid_descs++;
+			xskq_cons_release(xs->tx);
+			continue;
+		}
 
-		addr = desc.addr;
-		buffer = xsk_buff_raw_get_data(xs->pool, addr);
-		err = skb_store_bits(skb, 0, buffer, len);
 		/* This is the backpressure mechanism for the Tx path.
 		 * Reserve space in the completion queue and only proceed
 		 * if there is space in it. This avoids having to implement
 		 * any buffering in the Tx path.
 		 */
 		spin_lock_irqsave(&xs->pool->cq_lock, flags);
-		if (unlikely(err) || xskq_prod_reserve(xs->pool->cq)) {
+		if (xskq_prod_reserve_addr(xs->pool->cq, desc.addr)) {
 			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
-			kfree_skb(skb);
 			goto out;
 		}
 		spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
 
-		skb->dev = xs->dev;
-		skb->priority = sk->sk_priority;
-		skb->mark = sk->sk_mark;
-		skb_shinfo(skb)->destructor_arg = (void *)(long)desc.addr;
-		skb->destructor = xsk_destruct_skb;
+		skb = xsk_build_skb(xs, &desc);
+		if (IS_ERR(skb)) {
+			err = PTR_ERR(skb);
+			xsk_cq_cancel_locked(xs, 1);
+			if (err != -EOVERFLOW)
+				goto out;
+			/* Too many buffers for one skb: drop the whole packet */
+			xsk_drop_skb(xs->skb);
+			do {
+				xs->tx->invalid_descs++;
+				xskq_cons_release(xs->tx);
+			} while ((desc.options & XDP_PKT_CONTD) &&
+				 xskq_cons_peek_desc(xs->tx, &desc, xs->pool));
+			err = 0;
+			continue;
+		}
+
+		xskq_cons_release(xs->tx);
+
+		if (desc.options & XDP_PKT_CONTD) {
+			xs->skb = skb;
+			continue;
+		}
 
 		err = __dev_direct_xmit(skb, xs->queue_id);
 		if  (err == NETDEV_TX_BUSY) {
 			/* Tell user-space to retry the send */
-			skb->destructor = sock_wfree;
-			spin_lock_irqsave(&xs->pool->cq_lock, flags);
-			xskq_prod_cancel(xs->pool->cq);
-			spin_unlock_irqrestore(&xs->pool->cq_lock, flags);
-			/* Free skb without triggering the perf drop trace */
-			consume_skb(skb);
+			xskq_cons_cancel_n(xs->tx, xsk_get_num_desc(skb));
+			xsk_consume_skb(skb);
 			err = -EAGAIN;
 			goto out;
 		}
 
-		xskq_cons_release(xs->tx);
+		xs->skb = NULL;
 		/* Ignore NET_XMIT_CN as packet might have been sent */
 		if (err == NET_XMIT_DROP) {
 			/* SKB completed but not sent */
@@ -622,6 +839,8 @@ static int xsk_release(struct socket *sock)
 
 	xsk_delete_from_maps(xs);
 	mutex_lock(&xs->mutex);
+	if (xs->skb)
+		xsk_drop_skb(xs->skb);
 	xsk_unbind_dev(xs);
 	mutex_unlock(&xs->mutex);
 
@@ -677,9 +896,13 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 
 	flags = sxdp->sxdp_flags;
 	if (flags & ~(XDP_SHARED_UMEM | XDP_COPY | XDP_ZEROCOPY |
-		      XDP_USE_NEED_WAKEUP))
+		      XDP_USE_NEED_WAKEUP | XDP_USE_SG))
 		return -EINVAL;
 
+	/* Multi-buffer packets are handled by the copy mode paths only */
+	if ((flags & XDP_USE_SG) && (flags & XDP_ZEROCOPY))
+		return -EOPNOTSUPP;
+
 	rtnl_lock();
 	mutex_lock(&xs->mutex);
 	if (xs->state != XSK_READY) {
@@ -705,7 +928,7 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 		struct socket *sock;
 
 		if ((flags & XDP_COPY) || (flags & XDP_ZEROCOPY) ||
-		    (flags & XDP_USE_NEED_WAKEUP)) {
+		    (flags & XDP_USE_NEED_WAKEUP) || (flags & XDP_USE_SG)) {
 			/* Cannot specify flags for shared sockets. */
 			err = -EINVAL;
 			goto out_unlock;
@@ -761,10 +984,25 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 
 			xp_get_pool(umem_xs->pool);
 			xs->pool = umem_xs->pool;
+
+			/* The first socket of the pool may not have had a Tx
+			 * ring, in which case the batched Tx scratch space
+			 * does not exist yet.
+			 */
+			if (xs->tx && !xs->pool->tx_descs) {
+				err = xp_alloc_tx_descs(xs->pool, xs);
+				if (err) {
+					xp_put_pool(xs->pool);
+					xs->pool = NULL;
+					sockfd_put(sock);
+					goto out_unlock;
+				}
+			}
 		}
 
 		xdp_get_umem(umem_xs->umem);
 		WRITE_ONCE(xs->umem, umem_xs->umem);
+		xs->sg = umem_xs->sg;
 		sockfd_put(sock);
 	} else if (!xs->umem || !xsk_validate_queues(xs)) {
 		err = -EINVAL;
@@ -777,12 +1015,15 @@ static int xsk_bind(struct socket *sock, struct sockaddr *addr, int addr_len)
 			goto out_unlock;
 		}
 
+		if (flags & XDP_USE_SG)
+			flags |= XDP_COPY;
 		err = xp_assign_dev(xs->pool, dev, qid, flags);
 		if (err) {
 			xp_destroy(xs->pool);
 			xs->pool = NULL;
 			goto out_unlock;
 		}
+		xs->sg = !!(flags & XDP_USE_SG);
 	}
 
 	/* FQ and CQ are now owned by the buffer pool and cleaned up with it. */
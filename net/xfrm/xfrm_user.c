@@ -286,6 +286,10 @@ static int verify_newsa_info(struct xfrm_usersa_info *p,
 		if (!attrs[XFRMA_ENCAP])
 			err = -EINVAL;
 
+	if (attrs[XFRMA_SA_PCPU] &&
+	    nla_get_u32(attrs[XFRMA_SA_PCPU]) >= nr_cpu_ids)
+		err = -EINVAL;
+
 out:
 	return err;
 }
@@ -637,6 +641,9 @@ static struct xfrm_state *xfrm_state_construct(struct net *net,
 		}
 	}
 
+	if (attrs[XFRMA_SA_PCPU])
+		x->pcpu_num = nla_get_u32(attrs[XFRMA_SA_PCPU]);
+
 	err = __xfrm_init_state(x, false, attrs[XFRMA_OFFLOAD_DEV]);
 	if (err)
 		goto error;
@@ -982,8 +989,13 @@ static int copy_to_user_state_extra(struct xfrm_state *x,
 		if (ret)
 			goto out;
 	}
-	if (x->mapping_maxage)
+	if (x->mapping_maxage) {
 		ret = nla_put_u32(skb, XFRMA_MTIMER_THRESH, x->mapping_maxage);
+		if (ret)
+			goto out;
+	}
+	if (x->pcpu_num != UINT_MAX)
+		ret = nla_put_u32(skb, XFRMA_SA_PCPU, x->pcpu_num);
 out:
 	return ret;
 }
@@ -2668,6 +2680,7 @@ const struct nla_policy xfrma_policy[XFRMA_MAX+1] = {
 	[XFRMA_SET_MARK]	= { .type = NLA_U32 },
 	[XFRMA_SET_MARK_MASK]	= { .type = NLA_U32 },
 	[XFRMA_IF_ID]		= { .type = NLA_U32 },
+	[XFRMA_SA_PCPU]		= { .type = NLA_U32 },
 };
 EXPORT_SYMBOL_GPL(xfrma_policy);
 
@@ -2939,6 +2952,8 @@ static inline unsigned int xfrm_sa_len(struct xfrm_state *x)
 
 	if (x->mapping_maxage)
 		l += nla_total_size(sizeof(x->mapping_maxage));
+	if (x->pcpu_num != UINT_MAX)
+		l += nla_total_size(sizeof(x->pcpu_num));
 
 	return l;
 }
@@ -3033,6 +3048,7 @@ static inline unsigned int xfrm_acquire_msgsize(struct xfrm_state *x,
 	       + nla_total_size(sizeof(struct xfrm_user_tmpl) * xp->xfrm_nr)
 	       + nla_total_size(sizeof(struct xfrm_mark))
 	       + nla_total_size(xfrm_user_sec_ctx_size(x->security))
+	       + nla_total_size(sizeof(u32))
 	       + userpolicy_type_attrsize();
 }
 
@@ -3067,6 +3083,8 @@ static int build_acquire(struct sk_buff *skb, struct xfrm_state *x,
 		err = xfrm_mark_put(skb, &xp->mark);
 	if (!err)
 		err = xfrm_if_id_put(skb, xp->if_id);
+	if (!err && x->pcpu_num != UINT_MAX)
+		err = nla_put_u32(skb, XFRMA_SA_PCPU, x->pcpu_num);
 	if (err) {
 		nlmsg_cancel(skb, nlh);
 		return err;
@@ -411,6 +411,13 @@ static void print_prog_json(struct bpf_prog_info *info, int fd)
 	if (info->btf_id)
 		jsonw_int_field(json_wtr, "btf_id", info->btf_id);
 
+	if (info->verified_insns) {
+		jsonw_uint_field(json_wtr, "verified_insns", info->verified_insns);
+		jsonw_uint_field(json_wtr, "verified_states", info->verified_states);
+		jsonw_uint_field(json_wtr, "verification_time_ns",
+				 info->verification_time_ns);
+	}
+
 	if (!hash_empty(prog_table.table)) {
 		struct pinned_obj *obj;
 
@@ -493,6 +500,11 @@ static void print_prog_plain(struct bpf_prog_info *info, int fd)
 	if (info->btf_id)
 		printf("\n\tbtf_id %d", info->btf_id);
 
+	if (info->verified_insns)
+		printf("\n\tverified_insns %u  verified_states %u  verification_time_ns %llu",
+		       info->verified_insns, info->verified_states,
+		       info->verification_time_ns);
+
 	emit_obj_refs_plain(&refs_table, info->id, "\n\tpids ");
 
 	printf("\n");
@@ -859,9 +859,15 @@ __SYSCALL(__NR_pidfd_getfd, sys_pidfd_getfd)
 __SYSCALL(__NR_faccessat2, sys_faccessat2)
 #define __NR_process_madvise 440
 __SYSCALL(__NR_process_madvise, sys_process_madvise)
+#define __NR_futex_waitv 449
+__SYSCALL(__NR_futex_waitv, sys_futex_waitv)
+#define __NR_getdents_statx 500
+__SYSCALL(__NR_getdents_statx, sys_getdents_statx)
+#define __NR_spawn 501
+__SYSCALL(__NR_spawn, sys_spawn)
 
 #undef __NR_syscalls
-#define __NR_syscalls 441
+#define __NR_syscalls 502
 
 /*
  * 32 bit systems traditionally used different
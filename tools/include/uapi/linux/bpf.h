@@ -157,6 +157,10 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_STRUCT_OPS,
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
+	BPF_MAP_TYPE_RHASH,
+	BPF_MAP_TYPE_BLOOM_FILTER,
+	BPF_MAP_TYPE_USER_RINGBUF,
+	BPF_MAP_TYPE_TASK_STORAGE,
 };
 
 /* Note that tracing related programs such as
@@ -240,6 +244,9 @@ enum bpf_attach_type {
 	BPF_XDP_CPUMAP,
 	BPF_SK_LOOKUP,
 	BPF_XDP,
+	BPF_SK_REUSEPORT_SELECT,
+	BPF_SK_REUSEPORT_SELECT_OR_MIGRATE,
+	BPF_TRACE_KPROBE_MULTI,
 	__MAX_BPF_ATTACH_TYPE
 };
 
@@ -253,6 +260,7 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_ITER = 4,
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
+	BPF_LINK_TYPE_KPROBE_MULTI = 7,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -386,6 +394,15 @@ enum bpf_link_type {
  *                   is struct/union.
  */
 #define BPF_PSEUDO_BTF_ID	3
+/* insn[0].src_reg:  BPF_PSEUDO_FUNC
+ * insn[0].imm:      insn offset to the func
+ * insn[1].imm:      0
+ * insn[0].off:      0
+ * insn[1].off:      0
+ * ldimm64 rewrite:  address of the function
+ * verifier type:    PTR_TO_FUNC.
+ */
+#define BPF_PSEUDO_FUNC		4
 
 /* when bpf_call->src_reg == BPF_PSEUDO_CALL, bpf_call->imm == pc-relative
  * offset to another bpf function
@@ -438,6 +455,9 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Flag for stack_map, count hits per stack in struct bpf_stack_count */
+	BPF_F_STACK_COUNT	= (1U << 13),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -468,6 +488,23 @@ enum bpf_stack_build_id_status {
 	BPF_STACK_BUILD_ID_IP = 2,
 };
 
+/* What a BPF_F_STACK_COUNT stack_map aggregates on besides the stack,
+ * selected with map_extra.
+ */
+enum bpf_stack_count_key {
+	BPF_STACK_COUNT_KEY_NONE = 0,
+	/* tgid of the current task */
+	BPF_STACK_COUNT_KEY_PID = 1,
+	/* cgroup v2 id of the current task */
+	BPF_STACK_COUNT_KEY_CGROUP = 2,
+};
+
+/* Header of a BPF_F_STACK_COUNT stack_map value, followed by the frames */
+struct bpf_stack_count {
+	__u64	count;
+	__u64	key;
+};
+
 #define BPF_BUILD_ID_SIZE 20
 struct bpf_stack_build_id {
 	__s32		status;
@@ -502,6 +539,16 @@ union bpf_attr {
 						   * struct stored as the
 						   * map value
 						   */
+		/* Any per-map-type extra fields
+		 *
+		 * BPF_MAP_TYPE_BLOOM_FILTER - the lowest 4 bits indicate the
+		 * number of hash functions (if 0, the bloom filter will default
+		 * to using 5 hash functions).
+		 *
+		 * BPF_MAP_TYPE_STACK_TRACE with BPF_F_STACK_COUNT - one of
+		 * enum bpf_stack_count_key.
+		 */
+		__u64	map_extra;
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -669,6 +716,18 @@ union bpf_attr {
 				__aligned_u64	iter_info;	/* extra bpf_iter_link_info */
 				__u32		iter_info_len;	/* iter_info length */
 			};
+			struct {
+				__u32		flags;
+				__u32		cnt;
+				__aligned_u64	syms;
+				__aligned_u64	addrs;
+				__aligned_u64	cookies;
+			} kprobe_multi;
+			struct {
+				/* fentry/fexit progs attached along with prog_fd */
+				__aligned_u64	prog_fds;
+				__u32		cnt;
+			} tracing_batch;
 		};
 	} link_create;
 
@@ -1307,6 +1366,14 @@ union bpf_attr {
  * 		generating a variety of graphs (such as flame graphs or off-cpu
  * 		graphs).
  *
+ * 		If *map* was created with **BPF_F_STACK_COUNT**, the helper
+ * 		also counts how many times the stack was seen, separately for
+ * 		each task group or cgroup if requested through *map_extra*.
+ * 		The counts are read from user space along with the stacks, and
+ * 		**BPF_MAP_LOOKUP_AND_DELETE_ELEM** returns a count and resets
+ * 		it to zero atomically, so that samples no longer need to be
+ * 		exported one by one.
+ *
  * 		For walking a stack, this helper is an improvement over
  * 		**bpf_probe_read**\ (), which can be used with unrolled loops
  * 		but is not efficient and consumes a lot of eBPF instructions.
@@ -3742,6 +3809,171 @@ union bpf_attr {
  * 	Return
  * 		The helper returns **TC_ACT_REDIRECT** on success or
  * 		**TC_ACT_SHOT** on error.
+ *
+ * long bpf_xdp_metadata_rx_timestamp(struct xdp_md *ctx, u64 *timestamp)
+ *	Description
+ *		Read the hardware receive timestamp of the packet, as reported
+ *		in the RX descriptor by the driver, into *timestamp* (in
+ *		nanoseconds). Only available to XDP programs attached in
+ *		native (driver) mode.
+ *	Return
+ *		0 on success, or a negative error in case of failure:
+ *
+ *		**-EOPNOTSUPP** if the driver does not expose this hint.
+ *
+ *		**-ENODATA** if no timestamp is available for this packet,
+ *		for instance because RX timestamping is disabled.
+ *
+ * long bpf_xdp_metadata_rx_hash(struct xdp_md *ctx, u32 *hash, u32 *rss_type)
+ *	Description
+ *		Read the RSS hash computed by the NIC for the packet into
+ *		*hash*, and the set of headers the hash was computed over
+ *		(an **enum xdp_rss_hash_type** value) into *rss_type*. Only
+ *		available to XDP programs attached in native (driver) mode.
+ *	Return
+ *		0 on success, or a negative error in case of failure:
+ *
+ *		**-EOPNOTSUPP** if the driver does not expose this hint.
+ *
+ *		**-ENODATA** if the hash is not available for this packet.
+ *
+ * long bpf_xdp_metadata_rx_vlan_tag(struct xdp_md *ctx, u32 *vlan_proto, u32 *vlan_tci)
+ *	Description
+ *		Read the VLAN tag stripped by the NIC from the packet. The
+ *		tag protocol identifier (for instance **ETH_P_8021Q**) is
+ *		stored in *vlan_proto* and the tag control information in
+ *		*vlan_tci*, both in host byte order. Only available to XDP
+ *		programs attached in native (driver) mode.
+ *	Return
+ *		0 on success, or a negative error in case of failure:
+ *
+ *		**-EOPNOTSUPP** if the driver does not expose this hint.
+ *
+ *		**-ENODATA** if no VLAN tag was stripped from this packet.
+ *
+ * long bpf_loop(u32 nr_loops, void *callback_fn, void *callback_ctx, u64 flags)
+ *	Description
+ *		For **nr_loops**, call **callback_fn** function
+ *		with **callback_ctx** as the context parameter.
+ *		The **callback_fn** should be a static function and
+ *		the **callback_ctx** should be a pointer to the stack.
+ *		The **flags** is used to control certain aspects of the helper.
+ *		Currently, the **flags** must be 0. Currently, nr_loops is
+ *		limited to 1 << 23 (~8 million) loops.
+ *
+ *		long (\*callback_fn)(u32 index, void \*ctx);
+ *
+ *		where **index** is the current index in the loop. The index
+ *		is zero-indexed.
+ *
+ *		If **callback_fn** returns 0, the helper will continue to the next
+ *		loop. If return value is 1, the helper will skip the rest of
+ *		the loops and return. Other return values are not used now,
+ *		and will be rejected by the verifier.
+ *
+ *		Unlike a loop in the program itself, the body of the loop is
+ *		verified only once, regardless of **nr_loops**.
+ *	Return
+ *		The number of loops performed, **-EINVAL** for invalid **flags**,
+ *		**-E2BIG** if **nr_loops** exceeds the maximum number of loops.
+ *
+ * long bpf_user_ringbuf_drain(struct bpf_map *map, void *callback_fn, void *ctx, u64 flags)
+ *	Description
+ *		Drain records produced by user-space into the
+ *		**BPF_MAP_TYPE_USER_RINGBUF** *map*, calling *callback_fn*
+ *		for each of them:
+ *
+ *		long (\*callback_fn)(void \*sample, u32 size, void \*ctx);
+ *
+ *		*sample* points to the record's data, of which *size* bytes
+ *		were written by user-space. The program may access up to the
+ *		map's *value_size* bytes, the maximum size of a record. The
+ *		**callback_fn** should be a static function and *ctx* a
+ *		pointer to the stack.
+ *
+ *		If **callback_fn** returns 0, the helper continues with the
+ *		next record. If it returns 1, the helper stops after
+ *		consuming the current record. Other return values are
+ *		rejected by the verifier.
+ *
+ *		User-space produces records the same way the kernel does for
+ *		**BPF_MAP_TYPE_RINGBUF**: it writes a record with an 8-byte
+ *		header holding its length (**BPF_RINGBUF_BUSY_BIT** may be
+ *		set while writing, **BPF_RINGBUF_DISCARD_BIT** makes the
+ *		kernel skip it) into the data pages and advances the
+ *		producer position by the record's 8-byte aligned size. Only
+ *		the producer and data pages can be mapped writable.
+ *
+ *		If **BPF_RB_NO_WAKEUP** is specified in *flags*, no
+ *		notification of free space is sent to user-space. If
+ *		**BPF_RB_FORCE_WAKEUP** is specified, it is sent
+ *		unconditionally.
+ *	Return
+ *		The number of records consumed (including discarded ones),
+ *		or a negative error in case of failure:
+ *
+ *		**-EBUSY** if another program is draining the ring buffer.
+ *
+ *		**-EINVAL** if user-space published an invalid producer
+ *		position or record, or for invalid *flags*.
+ *
+ *		**-E2BIG** if a record is larger than the map's *value_size*.
+ *
+ * u64 bpf_get_attach_cookie(void *ctx)
+ *	Description
+ *		Get the cookie that was attached, through
+ *		**BPF_LINK_CREATE**'s *kprobe_multi.cookies*, to the function
+ *		the current **BPF_TRACE_KPROBE_MULTI** program was hit on.
+ *	Return
+ *		The cookie for the traced function, or 0 if none was set.
+ *
+ * void *bpf_task_storage_get(struct bpf_map *map, struct task_struct *task, void *value, u64 flags)
+ *	Description
+ *		Get a bpf_local_storage from the *task*.
+ *
+ *		Logically, it could be thought of as getting the value from
+ *		a *map* with *task* as the **key**.  From this
+ *		perspective,  the usage is not much different from
+ *		**bpf_map_lookup_elem**\ (*map*, **&**\ *task*) except this
+ *		helper enforces the key must be an task_struct and the map must also
+ *		be a **BPF_MAP_TYPE_TASK_STORAGE**.
+ *
+ *		Underneath, the value is stored locally at *task* instead of
+ *		the *map*.  The *map* is used as the bpf-local-storage
+ *		"type". The bpf-local-storage "type" (i.e. the *map*) is
+ *		searched against all bpf_local_storage residing at *task*.
+ *		The storage is freed when the task is.
+ *
+ *		An optional *flags* (**BPF_LOCAL_STORAGE_GET_F_CREATE**) can be
+ *		used such that a new bpf_local_storage will be
+ *		created if one does not exist.  *value* can be used
+ *		together with **BPF_LOCAL_STORAGE_GET_F_CREATE** to specify
+ *		the initial value of a bpf_local_storage.  If *value* is
+ *		**NULL**, the new bpf_local_storage will be zero initialized.
+ *	Return
+ *		A bpf_local_storage pointer is returned on success.
+ *
+ *		**NULL** if not found or there was an error in adding
+ *		a new bpf_local_storage.
+ *
+ * long bpf_task_storage_delete(struct bpf_map *map, struct task_struct *task)
+ *	Description
+ *		Delete a bpf_local_storage from a *task*.
+ *	Return
+ *		0 on success.
+ *
+ *		**-ENOENT** if the bpf_local_storage cannot be found.
+ *
+ *		**-EBUSY** if the task storage of this CPU is in use, e.g. by
+ *		a program this one interrupted.
+ *
+ * struct task_struct *bpf_get_current_task_btf(void)
+ *	Description
+ *		Return a BTF pointer to the "current" task.
+ *		This pointer can also be used in helpers that accept an
+ *		*ARG_PTR_TO_BTF_ID* of type *task_struct*.
+ *	Return
+ *		Pointer to the current task.
  */
 #define __BPF_FUNC_MAPPER(FN)		\
 	FN(unspec),			\
@@ -3900,6 +4132,15 @@ union bpf_attr {
 	FN(per_cpu_ptr),		\
 	FN(this_cpu_ptr),		\
 	FN(redirect_peer),		\
+	FN(xdp_metadata_rx_timestamp),	\
+	FN(xdp_metadata_rx_hash),	\
+	FN(xdp_metadata_rx_vlan_tag),	\
+	FN(loop),			\
+	FN(user_ringbuf_drain),		\
+	FN(get_attach_cookie),		\
+	FN(task_storage_get),		\
+	FN(task_storage_delete),	\
+	FN(get_current_task_btf),	\
 	/* */
 
 /* integer value in 'imm' field of BPF_CALL instruction selects which helper
@@ -4282,6 +4523,39 @@ struct xdp_md {
 	__u32 egress_ifindex;  /* txq->dev->ifindex */
 };
 
+/* Headers covered by the RSS hash reported by bpf_xdp_metadata_rx_hash().
+ * The XDP_RSS_L* values are bits, XDP_RSS_TYPE_* are the valid combinations.
+ */
+enum xdp_rss_hash_type {
+	XDP_RSS_L3_IPV4		= (1U << 0),
+	XDP_RSS_L3_IPV6		= (1U << 1),
+	XDP_RSS_L3_DYNHDR	= (1U << 2),	/* IPv4 options, IPv6 ext hdrs */
+	XDP_RSS_L4		= (1U << 3),
+	XDP_RSS_L4_TCP		= (1U << 4),
+	XDP_RSS_L4_UDP		= (1U << 5),
+	XDP_RSS_L4_SCTP		= (1U << 6),
+	XDP_RSS_L4_IPSEC	= (1U << 7),
+
+	XDP_RSS_TYPE_NONE		= 0,
+	XDP_RSS_TYPE_L2			= XDP_RSS_TYPE_NONE,
+
+	XDP_RSS_TYPE_L3_IPV4		= XDP_RSS_L3_IPV4,
+	XDP_RSS_TYPE_L3_IPV6		= XDP_RSS_L3_IPV6,
+	XDP_RSS_TYPE_L3_IPV4_OPT	= XDP_RSS_L3_IPV4 | XDP_RSS_L3_DYNHDR,
+	XDP_RSS_TYPE_L3_IPV6_EX		= XDP_RSS_L3_IPV6 | XDP_RSS_L3_DYNHDR,
+
+	XDP_RSS_TYPE_L4_ANY		= XDP_RSS_L4,
+	XDP_RSS_TYPE_L4_IPV4_TCP	= XDP_RSS_L3_IPV4 | XDP_RSS_L4 | XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV4_UDP	= XDP_RSS_L3_IPV4 | XDP_RSS_L4 | XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV4_SCTP	= XDP_RSS_L3_IPV4 | XDP_RSS_L4 | XDP_RSS_L4_SCTP,
+	XDP_RSS_TYPE_L4_IPV4_IPSEC	= XDP_RSS_L3_IPV4 | XDP_RSS_L4 | XDP_RSS_L4_IPSEC,
+
+	XDP_RSS_TYPE_L4_IPV6_TCP	= XDP_RSS_L3_IPV6 | XDP_RSS_L4 | XDP_RSS_L4_TCP,
+	XDP_RSS_TYPE_L4_IPV6_UDP	= XDP_RSS_L3_IPV6 | XDP_RSS_L4 | XDP_RSS_L4_UDP,
+	XDP_RSS_TYPE_L4_IPV6_SCTP	= XDP_RSS_L3_IPV6 | XDP_RSS_L4 | XDP_RSS_L4_SCTP,
+	XDP_RSS_TYPE_L4_IPV6_IPSEC	= XDP_RSS_L3_IPV6 | XDP_RSS_L4 | XDP_RSS_L4_IPSEC,
+};
+
 /* DEVMAP map-value layout
  *
  * The struct data-layout of map-value is a configuration interface.
@@ -4355,6 +4629,15 @@ struct sk_reuseport_md {
 	__u32 ip_protocol;	/* IP protocol. e.g. IPPROTO_TCP, IPPROTO_UDP */
 	__u32 bind_inany;	/* Is sock bound to an INANY address? */
 	__u32 hash;		/* A hash of the packet 4 tuples */
+	/* NULL when selecting a listener for a new connection request
+	 * (e.g. a received SYN in the TCP case).  Otherwise the listener
+	 * the packet or timer belonged to has been closed, and
+	 * migrating_sk is the fully established child or the request
+	 * sock in the middle of the 3-way handshake that needs to be
+	 * migrated to another listener of the reuseport group.  Only seen
+	 * by BPF_SK_REUSEPORT_SELECT_OR_MIGRATE programs.
+	 */
+	__bpf_md_ptr(struct bpf_sock *, migrating_sk);
 };
 
 #define BPF_TAG_SIZE	8
@@ -4395,6 +4678,9 @@ struct bpf_prog_info {
 	__aligned_u64 prog_tags;
 	__u64 run_time_ns;
 	__u64 run_cnt;
+	__u32 verified_insns;
+	__u32 verified_states;
+	__u64 verification_time_ns;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -4412,6 +4698,8 @@ struct bpf_map_info {
 	__u32 btf_id;
 	__u32 btf_key_type_id;
 	__u32 btf_value_type_id;
+	__u32 :32;	/* alignment pad */
+	__u64 map_extra;
 } __attribute__((aligned(8)));
 
 struct bpf_btf_info {
@@ -12,6 +12,24 @@
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <linux/futex.h>
+#include <linux/types.h>
+#include <time.h>
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+
+#ifndef FUTEX_32
+#define FUTEX_32		2
+#define FUTEX_WAITV_MAX		128
+
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
 
 /**
  * futex() - SYS_futex syscall wrapper
@@ -86,4 +104,18 @@ futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2, int nr_wak
 	return futex(uaddr, FUTEX_CMP_REQUEUE, nr_wake, nr_requeue, uaddr2,
 		 val, opflags);
 }
+
+/**
+ * futex_waitv() - block on several futexes until one of them is woken
+ * @waiters:	array of futexes to wait on
+ * @nr_waiters:	length of @waiters
+ * @timeout:	absolute timeout on @clockid, or NULL
+ */
+static inline int
+futex_waitv(struct futex_waitv *waiters, unsigned int nr_waiters,
+	    struct timespec *timeout, clockid_t clockid)
+{
+	return syscall(__NR_futex_waitv, waiters, nr_waiters, 0, timeout,
+		       clockid);
+}
 #endif /* _FUTEX_H */
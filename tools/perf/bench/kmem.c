@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * kmem: slab allocator throughput.
+ *
+ * The allocations happen in the kernel, in the SLAB_BENCHMARK ioctl of
+ * /sys/kernel/debug/slab_benchmark (CONFIG_SLAB_BENCHMARK, mm/slab_benchmark.c).
+ * Each call allocates --count objects of --size bytes and frees them again,
+ * with kmalloc()/kfree(), a dedicated kmem_cache (--cache) or the bulk API
+ * (--bulk, implies --cache). Threads issue the ioctl concurrently to see
+ * how the allocator scales.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/types.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <internal/cpumap.h>
+#include <perf/cpumap.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+/* keep in sync with mm/slab_benchmark.c */
+#define SLAB_BENCHMARK		_IOWR('k', 1, struct slab_benchmark)
+#define SLAB_BENCHMARK_CACHE	(1 << 0)
+
+struct slab_benchmark {
+	__u64 alloc_delta_nsec;
+	__u64 free_delta_nsec;
+	__u32 size;
+	__u32 count;
+	__u32 bulk;
+	__u32 flags;
+	__u64 expansion[10];
+};
+
+#define SLAB_BENCHMARK_PATH	"/sys/kernel/debug/slab_benchmark"
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int size     = 64;
+static unsigned int count    = 4096;
+static unsigned int bulk     = 0;
+static bool use_cache;
+static bool done = false, silent = false;
+
+struct timeval bench__start, bench__end, bench__runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+/* in picoseconds per object, update_stats() takes integers */
+static struct stats alloc_stats, free_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	int fd;
+	unsigned long long objs;
+	unsigned long long alloc_nsec;
+	unsigned long long free_nsec;
+	int err;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('S', "size",    &size,     "Specify object size (in bytes)"),
+	OPT_UINTEGER('n', "count",   &count,    "Specify amount of objects allocated per round"),
+	OPT_UINTEGER('b', "bulk",    &bulk,     "Allocate and free with the bulk API, by this many objects"),
+	OPT_BOOLEAN( 'c', "cache",   &use_cache, "Use a dedicated kmem_cache instead of kmalloc()"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_kmem_usage[] = {
+	"perf bench kmem slab <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	struct slab_benchmark sb;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		memset(&sb, 0, sizeof(sb));
+		sb.size = size;
+		sb.count = count;
+		sb.bulk = bulk;
+		sb.flags = use_cache ? SLAB_BENCHMARK_CACHE : 0;
+
+		if (ioctl(w->fd, SLAB_BENCHMARK, &sb)) {
+			w->err = errno;
+			break;
+		}
+
+		w->objs += sb.count;
+		w->alloc_nsec += sb.alloc_delta_nsec;
+		w->free_nsec += sb.free_delta_nsec;
+	} while (!done);
+
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_summary(void)
+{
+	double alloc_avg = avg_stats(&alloc_stats);
+	double free_avg = avg_stats(&free_stats);
+
+	printf("%sAveraged %.2f ns/alloc (+- %.2f%%), %.2f ns/free (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "",
+	       alloc_avg / 1000, rel_stddev_stats(stddev_stats(&alloc_stats), alloc_avg),
+	       free_avg / 1000, rel_stddev_stats(stddev_stats(&free_stats), free_avg),
+	       (int)bench__runtime.tv_sec);
+}
+
+int bench_kmem_slab(int argc, const char **argv)
+{
+	int ret = 0;
+	cpu_set_t cpuset;
+	struct sigaction act;
+	unsigned int i;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+
+	argc = parse_options(argc, argv, options, bench_kmem_usage, 0);
+	if (argc) {
+		usage_with_options(bench_kmem_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (bulk)
+		use_cache = true;
+
+	cpu = perf_cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = cpu->nr;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].fd = open(SLAB_BENCHMARK_PATH, O_RDWR);
+		if (worker[i].fd < 0)
+			err(EXIT_FAILURE, "open %s (needs CONFIG_SLAB_BENCHMARK)",
+			    SLAB_BENCHMARK_PATH);
+	}
+
+	printf("Run summary [PID %d]: %d threads, each allocating %d objects of %d bytes "
+	       "with %s for %d secs.\n\n", getpid(), nthreads, count, size,
+	       bulk ? "kmem_cache_alloc_bulk()" :
+	       use_cache ? "kmem_cache_alloc()" : "kmalloc()", nsecs);
+
+	init_stats(&alloc_stats);
+	init_stats(&free_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&bench__start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu->map[i % cpu->nr], &cpuset);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		struct worker *w = &worker[i];
+		double alloc_ns = w->objs ? (double)w->alloc_nsec / w->objs : 0;
+		double free_ns = w->objs ? (double)w->free_nsec / w->objs : 0;
+
+		close(w->fd);
+		if (w->err) {
+			fprintf(stderr, "[thread %2d] ioctl failed: %s\n",
+				w->tid, strerror(w->err));
+			ret = -1;
+			continue;
+		}
+
+		update_stats(&alloc_stats, alloc_ns * 1000);
+		update_stats(&free_stats, free_ns * 1000);
+		if (!silent)
+			printf("[thread %2d] %llu objects [ %.2f ns/alloc, %.2f ns/free ]\n",
+			       w->tid, w->objs, alloc_ns, free_ns);
+	}
+
+	print_summary();
+
+	free(worker);
+	free(cpu);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
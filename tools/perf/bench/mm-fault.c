@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * mm-fault: page fault scalability.
+ *
+ * Each thread repeatedly faults in its own region of --size MB and throws
+ * it away again. By default the region is munmap()ed and mmap()ed again
+ * every round, so the page faults (mmap_lock held for read) of some threads
+ * race with the munmap()/mmap() (mmap_lock held for write) of the others.
+ * With --madvise the mapping is kept and emptied with MADV_DONTNEED, which
+ * leaves only the faults and the zapping, both readers of mmap_lock.
+ *
+ * The region is anonymous memory, a shared mapping of a file created in
+ * --dir (faults on cached pages after the first round), or anonymous memory
+ * backed by transparent huge pages, touched once per 2MB.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <internal/cpumap.h>
+#include <perf/cpumap.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+#define THP_SIZE	(2UL << 20)
+
+enum fault_type {
+	FAULT_ANON,
+	FAULT_FILE,
+	FAULT_THP,
+};
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int size_mb  = 64;
+static const char *type_str  = "anon";
+static const char *dir       = "/tmp";
+static bool use_madvise, read_fault;
+static bool done = false, silent = false;
+static enum fault_type type;
+static size_t region_size, stride;
+
+struct timeval bench__start, bench__end, bench__runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	pthread_t thread;
+	int fd;
+	unsigned long ops;
+	unsigned long minflt;
+	unsigned long majflt;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('m', "size",    &size_mb,  "Specify region size per thread (in MB)"),
+	OPT_STRING(  'T', "type",    &type_str, "anon|file|thp", "Specify the memory to fault in"),
+	OPT_STRING(  'd', "dir",     &dir,      "path", "Directory for the files of --type file"),
+	OPT_BOOLEAN( 'M', "madvise", &use_madvise, "Empty the region with MADV_DONTNEED instead of munmap()"),
+	OPT_BOOLEAN( 'R', "read",    &read_fault, "Read faults instead of write faults"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_mm_fault_usage[] = {
+	"perf bench mm fault <options>",
+	NULL
+};
+
+static void *region_map(struct worker *w)
+{
+	int prot = PROT_READ | PROT_WRITE;
+	void *p;
+
+	if (type == FAULT_FILE)
+		return mmap(NULL, region_size, prot, MAP_SHARED, w->fd, 0);
+
+	p = mmap(NULL, region_size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p != MAP_FAILED && type == FAULT_THP)
+		madvise(p, region_size, MADV_HUGEPAGE);
+	return p;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = 0;
+	struct rusage ru;
+	char *region = NULL;
+	size_t off;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	getrusage(RUSAGE_THREAD, &ru);
+	w->minflt = ru.ru_minflt;
+	w->majflt = ru.ru_majflt;
+
+	do {
+		if (!region) {
+			region = region_map(w);
+			if (region == MAP_FAILED)
+				err(EXIT_FAILURE, "mmap");
+		}
+
+		for (off = 0; off < region_size && !done; off += stride, ops++) {
+			if (read_fault)
+				(void)READ_ONCE(region[off]);
+			else
+				WRITE_ONCE(region[off], 1);
+		}
+
+		if (use_madvise) {
+			if (madvise(region, region_size, MADV_DONTNEED))
+				err(EXIT_FAILURE, "madvise");
+		} else {
+			munmap(region, region_size);
+			region = NULL;
+		}
+	} while (!done);
+
+	if (region)
+		munmap(region, region_size);
+
+	getrusage(RUSAGE_THREAD, &ru);
+	w->minflt = ru.ru_minflt - w->minflt;
+	w->majflt = ru.ru_majflt - w->majflt;
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld faults/sec (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int)bench__runtime.tv_sec);
+}
+
+static int create_file(void)
+{
+	char path[PATH_MAX];
+	int fd;
+
+	scnprintf(path, sizeof(path), "%s/perf-bench-mm-fault-XXXXXX", dir);
+	fd = mkstemp(path);
+	if (fd < 0)
+		err(EXIT_FAILURE, "mkstemp %s", path);
+	unlink(path);
+
+	if (ftruncate(fd, region_size))
+		err(EXIT_FAILURE, "ftruncate");
+	return fd;
+}
+
+int bench_mm_fault(int argc, const char **argv)
+{
+	int ret = 0;
+	cpu_set_t cpuset;
+	struct sigaction act;
+	unsigned int i;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+
+	argc = parse_options(argc, argv, options, bench_mm_fault_usage, 0);
+	if (argc) {
+		usage_with_options(bench_mm_fault_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!strcmp(type_str, "anon"))
+		type = FAULT_ANON;
+	else if (!strcmp(type_str, "file"))
+		type = FAULT_FILE;
+	else if (!strcmp(type_str, "thp"))
+		type = FAULT_THP;
+	else
+		errx(EXIT_FAILURE, "unknown --type %s, use anon, file or thp", type_str);
+
+	stride = type == FAULT_THP ? THP_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+	region_size = round_up((size_t)size_mb << 20, stride);
+	if (!region_size)
+		errx(EXIT_FAILURE, "--size must not be 0");
+
+	cpu = perf_cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = cpu->nr;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	printf("Run summary [PID %d]: %d threads, each %s-faulting %d MB of %s memory "
+	       "(%s) for %d secs.\n\n", getpid(), nthreads, read_fault ? "read" : "write",
+	       size_mb, type_str, use_madvise ? "madvise" : "munmap", nsecs);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&bench__start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].fd = type == FAULT_FILE ? create_file() : -1;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu->map[i % cpu->nr], &cpuset);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] %ld faults/sec [ minor faults: %ld, major faults: %ld ]\n",
+			       worker[i].tid, t, worker[i].minflt, worker[i].majflt);
+
+		if (worker[i].fd >= 0)
+			close(worker[i].fd);
+	}
+
+	print_summary();
+
+	free(worker);
+	free(cpu);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
@@ -0,0 +1,566 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * uring: io_uring submission and completion throughput.
+ *
+ * Each thread sets up its own ring and keeps --depth requests in flight,
+ * submitting them --batch at a time with io_uring_enter(2) and reaping the
+ * completions. Requests are either NOPs, measuring the io_uring overhead
+ * alone, or reads of --block-size bytes from a file, optionally through
+ * registered (fixed) files and buffers, O_DIRECT with completion polling
+ * (--iopoll) and/or a kernel submission thread (--sqpoll).
+ *
+ * The rings are driven with the raw system calls, so this does not depend
+ * on liburing.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/io_uring.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+#include <asm/barrier.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <internal/cpumap.h>
+#include <perf/cpumap.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+#ifndef __NR_io_uring_setup
+#define __NR_io_uring_setup		425
+#endif
+#ifndef __NR_io_uring_enter
+#define __NR_io_uring_enter		426
+#endif
+#ifndef __NR_io_uring_register
+#define __NR_io_uring_register		427
+#endif
+
+static unsigned int nthreads = 0;
+static unsigned int nsecs    = 10;
+static unsigned int depth    = 32;
+static unsigned int batch    = 8;
+static unsigned int bs       = 4096;
+static const char *op_str    = "nop";
+static const char *filename;
+static bool sqpoll, iopoll, fixed_files, fixed_buffers, direct;
+static bool done = false, silent = false;
+static bool op_read;
+static off_t file_size;
+
+struct timeval bench__start, bench__end, bench__runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct sq_ring {
+	unsigned int	*head;
+	unsigned int	*tail;
+	unsigned int	*ring_mask;
+	unsigned int	*flags;
+	unsigned int	*array;
+};
+
+struct cq_ring {
+	unsigned int		*head;
+	unsigned int		*tail;
+	unsigned int		*ring_mask;
+	struct io_uring_cqe	*cqes;
+};
+
+struct worker {
+	int			tid;
+	pthread_t		thread;
+	int			ring_fd;
+	int			fd;
+	struct sq_ring		sq;
+	struct cq_ring		cq;
+	struct io_uring_sqe	*sqes;
+	void			*sq_ptr, *cq_ptr;
+	size_t			sq_len, cq_len, sqes_len;
+	struct iovec		*iovecs;
+	off_t			offset;
+	unsigned int		inflight;
+	unsigned long		ops;
+	int			err;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads (rings)"),
+	OPT_UINTEGER('r', "runtime", &nsecs,    "Specify runtime (in seconds)"),
+	OPT_UINTEGER('d', "depth",   &depth,    "Specify amount of requests in flight per ring"),
+	OPT_UINTEGER('b', "batch",   &batch,    "Specify amount of requests per submission"),
+	OPT_STRING(  'o', "op",      &op_str,   "nop|read", "Specify the request type"),
+	OPT_STRING(  'f', "file",    &filename, "path", "File or block device to read from"),
+	OPT_UINTEGER('B', "block-size", &bs,    "Specify read size (in bytes)"),
+	OPT_BOOLEAN( 0,   "sqpoll",  &sqpoll,   "Use a kernel thread for submission (IORING_SETUP_SQPOLL)"),
+	OPT_BOOLEAN( 0,   "iopoll",  &iopoll,   "Poll for read completions (IORING_SETUP_IOPOLL), implies --direct"),
+	OPT_BOOLEAN( 0,   "direct",  &direct,   "Open the file with O_DIRECT"),
+	OPT_BOOLEAN( 0,   "fixed-files",   &fixed_files,   "Use registered files"),
+	OPT_BOOLEAN( 0,   "fixed-buffers", &fixed_buffers, "Use registered buffers"),
+	OPT_BOOLEAN( 's', "silent",  &silent,   "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_uring_usage[] = {
+	"perf bench uring io <options>",
+	NULL
+};
+
+static int io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned int to_submit,
+			  unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+		       flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned int opcode, void *arg,
+			     unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int worker_setup_ring(struct worker *w)
+{
+	struct io_uring_params p;
+
+	memset(&p, 0, sizeof(p));
+	if (sqpoll)
+		p.flags |= IORING_SETUP_SQPOLL;
+	if (iopoll)
+		p.flags |= IORING_SETUP_IOPOLL;
+
+	w->ring_fd = io_uring_setup(depth, &p);
+	if (w->ring_fd < 0)
+		return -errno;
+
+	w->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	w->sq_ptr = mmap(NULL, w->sq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_SQ_RING);
+	if (w->sq_ptr == MAP_FAILED)
+		return -errno;
+
+	w->sq.head	= w->sq_ptr + p.sq_off.head;
+	w->sq.tail	= w->sq_ptr + p.sq_off.tail;
+	w->sq.ring_mask	= w->sq_ptr + p.sq_off.ring_mask;
+	w->sq.flags	= w->sq_ptr + p.sq_off.flags;
+	w->sq.array	= w->sq_ptr + p.sq_off.array;
+
+	w->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+	w->sqes = mmap(NULL, w->sqes_len, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_SQES);
+	if (w->sqes == MAP_FAILED)
+		return -errno;
+
+	w->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	w->cq_ptr = mmap(NULL, w->cq_len, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, w->ring_fd, IORING_OFF_CQ_RING);
+	if (w->cq_ptr == MAP_FAILED)
+		return -errno;
+
+	w->cq.head	= w->cq_ptr + p.cq_off.head;
+	w->cq.tail	= w->cq_ptr + p.cq_off.tail;
+	w->cq.ring_mask	= w->cq_ptr + p.cq_off.ring_mask;
+	w->cq.cqes	= w->cq_ptr + p.cq_off.cqes;
+
+	return 0;
+}
+
+static int worker_setup_file(struct worker *w)
+{
+	unsigned int i;
+
+	if (!op_read)
+		return 0;
+
+	w->fd = open(filename, O_RDONLY | (direct ? O_DIRECT : 0));
+	if (w->fd < 0)
+		return -errno;
+
+	if (fixed_files &&
+	    io_uring_register(w->ring_fd, IORING_REGISTER_FILES, &w->fd, 1) < 0)
+		return -errno;
+
+	w->iovecs = calloc(depth, sizeof(*w->iovecs));
+	if (!w->iovecs)
+		return -ENOMEM;
+
+	for (i = 0; i < depth; i++) {
+		if (posix_memalign(&w->iovecs[i].iov_base, 4096, bs))
+			return -ENOMEM;
+		w->iovecs[i].iov_len = bs;
+	}
+
+	if (fixed_buffers &&
+	    io_uring_register(w->ring_fd, IORING_REGISTER_BUFFERS, w->iovecs, depth) < 0)
+		return -errno;
+
+	/* spread the threads over the file */
+	w->offset = (file_size / nthreads * w->tid) / bs * bs;
+	return 0;
+}
+
+static void worker_cleanup(struct worker *w)
+{
+	unsigned int i;
+
+	if (w->iovecs) {
+		for (i = 0; i < depth; i++)
+			free(w->iovecs[i].iov_base);
+		zfree(&w->iovecs);
+	}
+	if (w->fd >= 0)
+		close(w->fd);
+	if (w->sqes && w->sqes != MAP_FAILED)
+		munmap(w->sqes, w->sqes_len);
+	if (w->sq_ptr && w->sq_ptr != MAP_FAILED)
+		munmap(w->sq_ptr, w->sq_len);
+	if (w->cq_ptr && w->cq_ptr != MAP_FAILED)
+		munmap(w->cq_ptr, w->cq_len);
+	if (w->ring_fd >= 0)
+		close(w->ring_fd);
+}
+
+static void worker_prep_sqe(struct worker *w, struct io_uring_sqe *sqe,
+			    unsigned int index)
+{
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = index;
+
+	if (!op_read) {
+		sqe->opcode = IORING_OP_NOP;
+		return;
+	}
+
+	if (fixed_files) {
+		sqe->fd = 0;
+		sqe->flags = IOSQE_FIXED_FILE;
+	} else {
+		sqe->fd = w->fd;
+	}
+
+	if (fixed_buffers) {
+		sqe->opcode = IORING_OP_READ_FIXED;
+		sqe->buf_index = index;
+	} else {
+		sqe->opcode = IORING_OP_READ;
+	}
+	sqe->addr = (unsigned long)w->iovecs[index].iov_base;
+	sqe->len = bs;
+	sqe->off = w->offset;
+
+	w->offset += bs;
+	if (w->offset + bs > file_size)
+		w->offset = 0;
+}
+
+/* Queue up to @nr requests, reusing the buffers of the completed ones. */
+static unsigned int worker_queue(struct worker *w, unsigned int nr,
+				 unsigned int *free_slots, unsigned int *nr_free)
+{
+	unsigned int tail = *w->sq.tail, mask = *w->sq.ring_mask;
+	unsigned int i;
+
+	for (i = 0; i < nr && *nr_free; i++) {
+		unsigned int index = free_slots[--(*nr_free)];
+		unsigned int slot = tail & mask;
+
+		worker_prep_sqe(w, &w->sqes[slot], index);
+		w->sq.array[slot] = slot;
+		tail++;
+	}
+
+	/* make the sqes visible before the new tail */
+	smp_store_release(w->sq.tail, tail);
+	return i;
+}
+
+static unsigned int worker_reap(struct worker *w, unsigned int *free_slots,
+				unsigned int *nr_free)
+{
+	unsigned int head = *w->cq.head, mask = *w->cq.ring_mask;
+	unsigned int tail = smp_load_acquire(w->cq.tail);
+	unsigned int reaped = 0;
+
+	for (; head != tail; head++, reaped++) {
+		struct io_uring_cqe *cqe = &w->cq.cqes[head & mask];
+
+		if (cqe->res < 0 && !w->err) {
+			w->err = cqe->res;
+			done = true;
+		}
+		free_slots[(*nr_free)++] = cqe->user_data;
+	}
+
+	smp_store_release(w->cq.head, head);
+	return reaped;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned int *free_slots, nr_free, i;
+	unsigned long ops = 0;
+
+	free_slots = calloc(depth, sizeof(*free_slots));
+	if (!free_slots)
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < depth; i++)
+		free_slots[i] = i;
+	nr_free = depth;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	do {
+		unsigned int to_submit = 0, flags = 0, min_complete = 0;
+		int ret;
+
+		if (nr_free >= batch || !w->inflight)
+			to_submit = worker_queue(w, batch, free_slots, &nr_free);
+		w->inflight += to_submit;
+
+		if (sqpoll) {
+			/* the kernel thread picks the sqes up by itself */
+			if (READ_ONCE(*w->sq.flags) & IORING_SQ_NEED_WAKEUP)
+				flags |= IORING_ENTER_SQ_WAKEUP;
+			else if (w->inflight < depth)
+				to_submit = 0;
+			if (w->inflight == depth) {
+				flags |= IORING_ENTER_GETEVENTS;
+				min_complete = 1;
+			}
+		} else {
+			flags |= IORING_ENTER_GETEVENTS;
+			min_complete = w->inflight > batch ? batch : 1;
+		}
+
+		if (to_submit || flags) {
+			ret = io_uring_enter(w->ring_fd, sqpoll ? 0 : to_submit,
+					     min_complete, flags);
+			if (ret < 0 && errno != EINTR && errno != EAGAIN &&
+			    errno != EBUSY) {
+				w->err = -errno;
+				break;
+			}
+		}
+
+		ret = worker_reap(w, free_slots, &nr_free);
+		w->inflight -= ret;
+		ops += ret;
+	} while (!done);
+
+	w->ops = ops;
+	free(free_slots);
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld operations/sec (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int)bench__runtime.tv_sec);
+	if (op_read)
+		printf("Averaged %.2f MB/sec per thread\n",
+		       (double)avg * bs / (1024 * 1024));
+}
+
+static void check_options(void)
+{
+	struct stat st;
+	int fd;
+
+	if (!strcmp(op_str, "read"))
+		op_read = true;
+	else if (strcmp(op_str, "nop"))
+		errx(EXIT_FAILURE, "unknown --op %s, use nop or read", op_str);
+
+	if (!depth || !batch || batch > depth)
+		errx(EXIT_FAILURE, "--batch must be between 1 and --depth");
+
+	if (!op_read) {
+		if (iopoll || fixed_files || fixed_buffers || filename)
+			errx(EXIT_FAILURE, "--file, --iopoll and --fixed-* need --op read");
+		return;
+	}
+
+	if (!filename)
+		errx(EXIT_FAILURE, "--op read needs --file");
+	if (!bs || (bs & 511))
+		errx(EXIT_FAILURE, "--block-size must be a multiple of 512");
+	if (iopoll)
+		direct = true;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) < 0)
+		err(EXIT_FAILURE, "%s", filename);
+	if (S_ISBLK(st.st_mode)) {
+		file_size = lseek(fd, 0, SEEK_END);
+		if (file_size < 0)
+			err(EXIT_FAILURE, "lseek");
+	} else {
+		file_size = st.st_size;
+	}
+	close(fd);
+
+	if (file_size < bs)
+		errx(EXIT_FAILURE, "%s is smaller than --block-size", filename);
+}
+
+int bench_uring_io(int argc, const char **argv)
+{
+	int ret = 0;
+	cpu_set_t cpuset;
+	struct sigaction act;
+	unsigned int i;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+
+	argc = parse_options(argc, argv, options, bench_uring_usage, 0);
+	if (argc) {
+		usage_with_options(bench_uring_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	check_options();
+
+	cpu = perf_cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = cpu->nr;
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	printf("Run summary [PID %d]: %d threads, each with %d %s requests in flight "
+	       "(batch %d%s%s%s%s%s) for %d secs.\n\n",
+	       getpid(), nthreads, depth, op_str, batch,
+	       sqpoll ? ", sqpoll" : "", iopoll ? ", iopoll" : "",
+	       direct ? ", direct" : "", fixed_files ? ", fixed files" : "",
+	       fixed_buffers ? ", fixed buffers" : "", nsecs);
+
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].fd = -1;
+		ret = worker_setup_ring(&worker[i]);
+		if (!ret)
+			ret = worker_setup_file(&worker[i]);
+		if (ret) {
+			errno = -ret;
+			err(EXIT_FAILURE, "io_uring setup");
+		}
+	}
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&bench__start, NULL);
+	for (i = 0; i < nthreads; i++) {
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu->map[i % cpu->nr], &cpuset);
+
+		ret = pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_create");
+	}
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	sleep(nsecs);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+
+		if (worker[i].err) {
+			fprintf(stderr, "[thread %2d] request failed: %s\n",
+				worker[i].tid, strerror(-worker[i].err));
+			ret = -1;
+		}
+
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] ring fd %d [ %ld ops/sec ]\n",
+			       worker[i].tid, worker[i].ring_fd, t);
+
+		worker_cleanup(&worker[i]);
+	}
+
+	print_summary();
+
+	free(worker);
+	free(cpu);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
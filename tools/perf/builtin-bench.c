@@ -16,6 +16,9 @@
  *  numa  ... NUMA scheduling and MM performance
  *  futex ... Futex performance
  *  epoll ... Event poll performance
+ *  uring ... io_uring performance
+ *  mm    ... Page fault performance
+ *  kmem  ... Kernel memory allocator performance
  */
 #include <subcmd/parse-options.h>
 #include "builtin.h"
@@ -69,6 +72,7 @@ static struct bench futex_benchmarks[] = {
 	{ "wake",	"Benchmark for futex wake calls",               bench_futex_wake	},
 	{ "wake-parallel", "Benchmark for parallel futex wake calls",   bench_futex_wake_parallel },
 	{ "requeue",	"Benchmark for futex requeue calls",            bench_futex_requeue	},
+	{ "waitv",	"Benchmark for futex_waitv wakeups",            bench_futex_waitv	},
 	/* pi-futexes */
 	{ "lock-pi",	"Benchmark for futex lock_pi calls",            bench_futex_lock_pi	},
 	{ "all",	"Run all futex benchmarks",			NULL			},
@@ -84,6 +88,24 @@ static struct bench epoll_benchmarks[] = {
 };
 #endif // HAVE_EVENTFD_SUPPORT
 
+static struct bench uring_benchmarks[] = {
+	{ "io",		"Benchmark io_uring submission and completion",	bench_uring_io		},
+	{ "all",	"Run all io_uring benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench mm_benchmarks[] = {
+	{ "fault",	"Benchmark concurrent page faults",		bench_mm_fault		},
+	{ "all",	"Run all mm benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
+static struct bench kmem_benchmarks[] = {
+	{ "slab",	"Benchmark slab allocation and free",		bench_kmem_slab		},
+	{ "all",	"Run all kmem benchmarks",			NULL			},
+	{ NULL,		NULL,						NULL			}
+};
+
 static struct bench internals_benchmarks[] = {
 	{ "synthesize", "Benchmark perf event synthesis",	bench_synthesize	},
 	{ "kallsyms-parse", "Benchmark kallsyms parsing",	bench_kallsyms_parse	},
@@ -108,6 +130,9 @@ static struct collection collections[] = {
 #ifdef HAVE_EVENTFD_SUPPORT
 	{"epoll",       "Epoll stressing benchmarks",                   epoll_benchmarks        },
 #endif
+	{ "uring",	"io_uring benchmarks",				uring_benchmarks	},
+	{ "mm",		"Page fault and memory mapping benchmarks",	mm_benchmarks		},
+	{ "kmem",	"Kernel memory allocator benchmarks",		kmem_benchmarks		},
 	{ "internals",	"Perf-internals benchmarks",			internals_benchmarks	},
 	{ "all",	"All benchmarks",				NULL			},
 	{ NULL,		NULL,						NULL			}
@@ -6,6 +6,7 @@
 
 #include "util/evlist.h" // for struct evsel_str_handler
 #include "util/evsel.h"
+#include "util/map.h"
 #include "util/symbol.h"
 #include "util/thread.h"
 #include "util/header.h"
@@ -70,6 +71,7 @@ struct lock_stat {
 	u64			wait_time_max;
 
 	int			discard; /* flag of blacklist */
+	unsigned int		flags; /* lock type of lock:contention_begin */
 };
 
 /*
@@ -109,6 +111,7 @@ struct lock_seq_stat {
 	void                    *addr;
 
 	int                     read_count;
+	struct lock_stat	*ls; /* aggregation entry of a contention */
 };
 
 struct thread_stat {
@@ -359,6 +362,12 @@ struct trace_lock_handler {
 
 	int (*release_event)(struct evsel *evsel,
 			     struct perf_sample *sample);
+
+	int (*contention_begin_event)(struct evsel *evsel,
+				      struct perf_sample *sample);
+
+	int (*contention_end_event)(struct evsel *evsel,
+				    struct perf_sample *sample);
 };
 
 static struct lock_seq_stat *get_seq(struct thread_stat *ts, void *addr)
@@ -646,6 +655,239 @@ static int report_lock_release_event(struct evsel *evsel,
 	return 0;
 }
 
+/* flags of lock:contention_begin, from include/trace/events/lock.h */
+#define LCB_F_SPIN	(1U << 0)
+#define LCB_F_READ	(1U << 1)
+#define LCB_F_WRITE	(1U << 2)
+#define LCB_F_RT	(1U << 3)
+#define LCB_F_PERCPU	(1U << 4)
+#define LCB_F_MUTEX	(1U << 5)
+
+static const char *get_type_str(unsigned int flags)
+{
+	switch (flags) {
+	case LCB_F_SPIN:
+		return "spinlock";
+	case LCB_F_SPIN | LCB_F_READ:
+		return "rwlock:R";
+	case LCB_F_SPIN | LCB_F_WRITE:
+		return "rwlock:W";
+	case LCB_F_READ:
+		return "rwsem:R";
+	case LCB_F_WRITE:
+		return "rwsem:W";
+	case LCB_F_RT:
+		return "rtmutex";
+	case LCB_F_PERCPU | LCB_F_READ:
+		return "pcpu-sem:R";
+	case LCB_F_PERCPU | LCB_F_WRITE:
+		return "pcpu-sem:W";
+	case LCB_F_MUTEX:
+	case LCB_F_MUTEX | LCB_F_SPIN:
+		return "mutex";
+	default:
+		break;
+	}
+	return "unknown";
+}
+
+/* aggregate contentions per lock instance instead of per caller */
+static bool contention_lock_addr;
+
+static bool lock_text_init;
+static u64 lock_text_start, lock_text_end;
+
+static u64 kernel_symbol_addr(struct machine *machine, const char *name)
+{
+	struct map *kmap;
+	struct symbol *sym;
+
+	sym = machine__find_kernel_symbol_by_name(machine, name, &kmap);
+	if (!sym)
+		return 0;
+	return kmap->unmap_ip(kmap, sym->start);
+}
+
+/*
+ * Spinlock and rwlock functions live in the lock text section, while the
+ * mutex, rwsem and queued lock slowpaths are only known by their names.
+ * The tracepoint glue itself is on top of every callchain as well.
+ */
+static bool is_lock_function(struct machine *machine, u64 addr)
+{
+	static const char * const lock_funcs[] = {
+		"__traceiter_", "mutex_lock", "rwsem", "_slowpath",
+		"percpu_down_", "down_read", "down_write",
+	};
+	struct symbol *sym;
+	struct map *kmap;
+	unsigned int i;
+
+	if (!lock_text_init) {
+		lock_text_start = kernel_symbol_addr(machine, "__lock_text_start");
+		lock_text_end = kernel_symbol_addr(machine, "__lock_text_end");
+		lock_text_init = true;
+	}
+
+	if (lock_text_start <= addr && addr < lock_text_end)
+		return true;
+
+	sym = machine__find_kernel_symbol(machine, addr, &kmap);
+	if (!sym)
+		return false;
+
+	for (i = 0; i < ARRAY_SIZE(lock_funcs); i++) {
+		if (strstr(sym->name, lock_funcs[i]))
+			return true;
+	}
+	return false;
+}
+
+/* returns the first kernel address in the callchain outside of the locking code */
+static u64 contention_caller(struct machine *machine, struct perf_sample *sample)
+{
+	struct ip_callchain *chain = sample->callchain;
+	u64 i;
+
+	if (!chain)
+		return 0;
+
+	for (i = 0; i < chain->nr; i++) {
+		u64 ip = chain->ips[i];
+
+		if (ip >= PERF_CONTEXT_MAX) {
+			/* only the kernel part of the callchain is of interest */
+			if (ip != PERF_CONTEXT_KERNEL)
+				break;
+			continue;
+		}
+		if (!is_lock_function(machine, ip))
+			return ip;
+	}
+	return 0;
+}
+
+static struct lock_stat *contention_stat_findnew(struct perf_sample *sample,
+						 void *addr)
+{
+	struct machine *machine = &session->machines.host;
+	struct symbol *sym;
+	struct map *kmap;
+	char name[128];
+	u64 key;
+
+	if (contention_lock_addr) {
+		/* static locks can be named, others only by their address */
+		key = (unsigned long)addr;
+		sym = machine__find_kernel_symbol(machine, key, &kmap);
+		scnprintf(name, sizeof(name), "%s", sym ? sym->name : "");
+	} else {
+		key = contention_caller(machine, sample);
+		sym = key ? machine__find_kernel_symbol(machine, key, &kmap) : NULL;
+		if (sym)
+			scnprintf(name, sizeof(name), "%s+%#" PRIx64, sym->name,
+				  kmap->map_ip(kmap, key) - sym->start);
+		else
+			scnprintf(name, sizeof(name), "%#" PRIx64, key);
+	}
+
+	return lock_stat_findnew((void *)(unsigned long)key, name);
+}
+
+static int report_contention_begin_event(struct evsel *evsel,
+					 struct perf_sample *sample)
+{
+	void *addr;
+	struct lock_stat *ls;
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	u64 tmp = evsel__intval(evsel, sample, "lock_addr");
+	unsigned int flags = evsel__intval(evsel, sample, "flags");
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	switch (seq->state) {
+	case SEQ_STATE_UNINITIALIZED:
+		break;
+	case SEQ_STATE_CONTENDED:
+		/*
+		 * A mutex waiter spins on the owner before it goes to sleep,
+		 * both are reported but the wait started with the first one.
+		 */
+		goto end;
+	default:
+		BUG_ON("Unknown state of lock sequence found!\n");
+		break;
+	}
+
+	ls = contention_stat_findnew(sample, addr);
+	if (!ls)
+		return -ENOMEM;
+
+	if (!ls->flags)
+		ls->flags = flags;
+	seq->ls = ls;
+	seq->state = SEQ_STATE_CONTENDED;
+	seq->prev_event_time = sample->time;
+end:
+	return 0;
+}
+
+static int report_contention_end_event(struct evsel *evsel,
+				       struct perf_sample *sample)
+{
+	void *addr;
+	struct lock_stat *ls;
+	struct thread_stat *ts;
+	struct lock_seq_stat *seq;
+	u64 contended_term;
+	u64 tmp = evsel__intval(evsel, sample, "lock_addr");
+
+	memcpy(&addr, &tmp, sizeof(void *));
+
+	ts = thread_stat_findnew(sample->tid);
+	if (!ts)
+		return -ENOMEM;
+
+	seq = get_seq(ts, addr);
+	if (!seq)
+		return -ENOMEM;
+
+	switch (seq->state) {
+	case SEQ_STATE_UNINITIALIZED:
+		/* orphan event, the contention began before recording */
+		goto free_seq;
+	case SEQ_STATE_CONTENDED:
+		break;
+	default:
+		BUG_ON("Unknown state of lock sequence found!\n");
+		break;
+	}
+
+	ls = seq->ls;
+	contended_term = sample->time - seq->prev_event_time;
+	ls->nr_contended++;
+	ls->wait_time_total += contended_term;
+	if (contended_term < ls->wait_time_min)
+		ls->wait_time_min = contended_term;
+	if (ls->wait_time_max < contended_term)
+		ls->wait_time_max = contended_term;
+	ls->avg_wait_time = ls->wait_time_total / ls->nr_contended;
+
+free_seq:
+	list_del_init(&seq->list);
+	free(seq);
+	return 0;
+}
+
 /* lock oriented handlers */
 /* TODO: handlers for CPU oriented, thread oriented */
 static struct trace_lock_handler report_lock_ops  = {
@@ -655,6 +897,11 @@ static struct trace_lock_handler report_lock_ops  = {
 	.release_event		= report_lock_release_event,
 };
 
+static struct trace_lock_handler contention_lock_ops  = {
+	.contention_begin_event	= report_contention_begin_event,
+	.contention_end_event	= report_contention_end_event,
+};
+
 static struct trace_lock_handler *trace_handler;
 
 static int evsel__process_lock_acquire(struct evsel *evsel, struct perf_sample *sample)
@@ -685,6 +932,20 @@ static int evsel__process_lock_release(struct evsel *evsel, struct perf_sample *
 	return 0;
 }
 
+static int evsel__process_contention_begin(struct evsel *evsel, struct perf_sample *sample)
+{
+	if (trace_handler->contention_begin_event)
+		return trace_handler->contention_begin_event(evsel, sample);
+	return 0;
+}
+
+static int evsel__process_contention_end(struct evsel *evsel, struct perf_sample *sample)
+{
+	if (trace_handler->contention_end_event)
+		return trace_handler->contention_end_event(evsel, sample);
+	return 0;
+}
+
 static void print_bad_events(int bad, int total)
 {
 	/* Output for debug, this have to be removed */
@@ -754,6 +1015,31 @@ static void print_result(void)
 	print_bad_events(bad, total);
 }
 
+static void print_contention_result(void)
+{
+	struct lock_stat *st;
+
+	pr_info("%10s ", "contended");
+	pr_info("%15s ", "total wait (ns)");
+	pr_info("%15s ", "max wait (ns)");
+	pr_info("%15s ", "avg wait (ns)");
+	pr_info("%12s ", "type");
+	pr_info("  %s\n\n", contention_lock_addr ? "address symbol" : "caller");
+
+	while ((st = pop_from_result())) {
+		pr_info("%10u ", st->nr_contended);
+		pr_info("%15" PRIu64 " ", st->wait_time_total);
+		pr_info("%15" PRIu64 " ", st->wait_time_max);
+		pr_info("%15" PRIu64 " ", st->avg_wait_time);
+		pr_info("%12s ", get_type_str(st->flags));
+
+		if (contention_lock_addr)
+			pr_info("  %016lx %s\n", (unsigned long)st->addr, st->name);
+		else
+			pr_info("  %s\n", st->name);
+	}
+}
+
 static bool info_threads, info_map;
 
 static void dump_threads(void)
@@ -851,9 +1137,14 @@ static const struct evsel_str_handler lock_tracepoints[] = {
 	{ "lock:lock_release",	 evsel__process_lock_release,   }, /* CONFIG_LOCKDEP */
 };
 
+static const struct evsel_str_handler contention_tracepoints[] = {
+	{ "lock:contention_begin", evsel__process_contention_begin, },
+	{ "lock:contention_end",   evsel__process_contention_end,   },
+};
+
 static bool force;
 
-static int __cmd_report(bool display_info)
+static int __cmd_report(bool display_info, bool contention)
 {
 	int err = -EINVAL;
 	struct perf_tool eops = {
@@ -879,10 +1170,16 @@ static int __cmd_report(bool display_info)
 	if (!perf_session__has_traces(session, "lock record"))
 		goto out_delete;
 
-	if (perf_session__set_tracepoints_handlers(session, lock_tracepoints)) {
+	if (contention)
+		err = perf_session__set_tracepoints_handlers(session, contention_tracepoints);
+	else
+		err = perf_session__set_tracepoints_handlers(session, lock_tracepoints);
+	if (err) {
 		pr_err("Initializing perf session tracepoint handlers failed\n");
+		err = -EINVAL;
 		goto out_delete;
 	}
+	err = -EINVAL;
 
 	if (select_key())
 		goto out_delete;
@@ -894,7 +1191,10 @@ static int __cmd_report(bool display_info)
 	setup_pager();
 	if (display_info) /* used for info subcommand */
 		err = dump_info();
-	else {
+	else if (contention) {
+		sort_result();
+		print_contention_result();
+	} else {
 		sort_result();
 		print_result();
 	}
@@ -904,26 +1204,44 @@ static int __cmd_report(bool display_info)
 	return err;
 }
 
-static int __cmd_record(int argc, const char **argv)
+static int __cmd_record(int argc, const char **argv, bool contention)
 {
 	const char *record_args[] = {
 		"record", "-R", "-m", "1024", "-c", "1",
 	};
+	/* the callers of contended locks are found from the callchains */
+	const char *contention_args[] = {
+		"-g",
+	};
+	const struct evsel_str_handler *tracepoints = lock_tracepoints;
+	unsigned int nr_tracepoints = ARRAY_SIZE(lock_tracepoints);
 	unsigned int rec_argc, i, j, ret;
 	const char **rec_argv;
 
-	for (i = 0; i < ARRAY_SIZE(lock_tracepoints); i++) {
-		if (!is_valid_tracepoint(lock_tracepoints[i].name)) {
+	if (contention) {
+		tracepoints = contention_tracepoints;
+		nr_tracepoints = ARRAY_SIZE(contention_tracepoints);
+	}
+
+	for (i = 0; i < nr_tracepoints; i++) {
+		if (!is_valid_tracepoint(tracepoints[i].name)) {
+			if (contention)
+				pr_err("tracepoint %s is not available.\n",
+				       tracepoints[i].name);
+			else
 				pr_err("tracepoint %s is not enabled. "
-				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled?\n",
-				       lock_tracepoints[i].name);
-				return 1;
+				       "Are CONFIG_LOCKDEP and CONFIG_LOCK_STAT enabled?\n"
+				       "Try 'perf lock contention record' otherwise.\n",
+				       tracepoints[i].name);
+			return 1;
 		}
 	}
 
 	rec_argc = ARRAY_SIZE(record_args) + argc - 1;
+	if (contention)
+		rec_argc += ARRAY_SIZE(contention_args);
 	/* factor of 2 is for -e in front of each tracepoint */
-	rec_argc += 2 * ARRAY_SIZE(lock_tracepoints);
+	rec_argc += 2 * nr_tracepoints;
 
 	rec_argv = calloc(rec_argc + 1, sizeof(char *));
 	if (!rec_argv)
@@ -932,9 +1250,14 @@ static int __cmd_record(int argc, const char **argv)
 	for (i = 0; i < ARRAY_SIZE(record_args); i++)
 		rec_argv[i] = strdup(record_args[i]);
 
-	for (j = 0; j < ARRAY_SIZE(lock_tracepoints); j++) {
+	if (contention) {
+		for (j = 0; j < ARRAY_SIZE(contention_args); j++)
+			rec_argv[i++] = strdup(contention_args[j]);
+	}
+
+	for (j = 0; j < nr_tracepoints; j++) {
 		rec_argv[i++] = "-e";
-		rec_argv[i++] = strdup(lock_tracepoints[j].name);
+		rec_argv[i++] = strdup(tracepoints[j].name);
 	}
 
 	for (j = 1; j < (unsigned int)argc; j++, i++)
@@ -972,12 +1295,20 @@ int cmd_lock(int argc, const char **argv)
 	OPT_PARENT(lock_options)
 	};
 
+	const struct option contention_options[] = {
+	OPT_STRING('k', "key", &sort_key, "wait_total",
+		    "key for sorting (contended / wait_total / wait_max / wait_min / avg_wait)"),
+	OPT_BOOLEAN('l', "lock-addr", &contention_lock_addr,
+		    "aggregate by lock instance instead of by caller"),
+	OPT_PARENT(lock_options)
+	};
+
 	const char * const info_usage[] = {
 		"perf lock info [<options>]",
 		NULL
 	};
 	const char *const lock_subcommands[] = { "record", "report", "script",
-						 "info", NULL };
+						 "info", "contention", NULL };
 	const char *lock_usage[] = {
 		NULL,
 		NULL
@@ -986,6 +1317,11 @@ int cmd_lock(int argc, const char **argv)
 		"perf lock report [<options>]",
 		NULL
 	};
+	const char * const contention_usage[] = {
+		"perf lock contention [<options>]",
+		"perf lock contention record [<command>]",
+		NULL
+	};
 	unsigned int i;
 	int rc = 0;
 
@@ -998,7 +1334,7 @@ int cmd_lock(int argc, const char **argv)
 		usage_with_options(lock_usage, lock_options);
 
 	if (!strncmp(argv[0], "rec", 3)) {
-		return __cmd_record(argc, argv);
+		return __cmd_record(argc, argv, false);
 	} else if (!strncmp(argv[0], "report", 6)) {
 		trace_handler = &report_lock_ops;
 		if (argc) {
@@ -1007,7 +1343,21 @@ int cmd_lock(int argc, const char **argv)
 			if (argc)
 				usage_with_options(report_usage, report_options);
 		}
-		rc = __cmd_report(false);
+		rc = __cmd_report(false, false);
+	} else if (!strcmp(argv[0], "contention")) {
+		if (argc > 1 && !strncmp(argv[1], "rec", 3))
+			return __cmd_record(argc - 1, argv + 1, true);
+
+		trace_handler = &contention_lock_ops;
+		sort_key = "wait_total";
+		if (argc) {
+			argc = parse_options(argc, argv, contention_options,
+					     contention_usage, 0);
+			if (argc)
+				usage_with_options(contention_usage,
+						   contention_options);
+		}
+		rc = __cmd_report(false, true);
 	} else if (!strcmp(argv[0], "script")) {
 		/* Aliased to 'perf script' */
 		return cmd_script(argc, argv);
@@ -1020,7 +1370,7 @@ int cmd_lock(int argc, const char **argv)
 		}
 		/* recycling report_lock_ops */
 		trace_handler = &report_lock_ops;
-		rc = __cmd_report(true);
+		rc = __cmd_report(true, false);
 	} else {
 		usage_with_options(lock_usage, lock_options);
 	}
@@ -49,6 +49,7 @@
 #include "util/clockid.h"
 #include "asm/bug.h"
 #include "perf.h"
+#include <api/fd/array.h>
 
 #include <errno.h>
 #include <inttypes.h>
@@ -85,6 +86,45 @@ struct switch_output {
 	int		 cur_file;
 };
 
+enum thread_spec {
+	THREAD_SPEC__UNDEFINED = 0,
+	THREAD_SPEC__CPU,
+	THREAD_SPEC__CORE,
+	THREAD_SPEC__PACKAGE,
+	THREAD_SPEC__NUMA,
+	THREAD_SPEC__MAX,
+};
+
+static const char *thread_spec_tags[THREAD_SPEC__MAX] = {
+	"undefined", "cpu", "core", "package", "numa"
+};
+
+/*
+ * With --threads every group of CPUs gets a thread which reads the mmaps
+ * of these CPUs and writes them, compressed with its own zstd stream if
+ * requested, to its own data.<n> file of the perf.data directory.
+ */
+struct record_thread {
+	pthread_t		tid;
+	struct record		*rec;
+	int			key;		/* CPU group the thread serves */
+	struct mmap		**maps;
+	int			nr_mmaps;
+	struct mmap_cpu_mask	mask;
+	struct perf_data_file	*file;
+	struct fdarray		pollfd;		/* entry 0 is the ctl pipe */
+	int			ctl[2];		/* closed by main to stop the thread */
+	struct zstd_data	zstd_data;
+	u64			bytes_written;
+	u64			bytes_transferred;
+	u64			bytes_compressed;
+	unsigned long long	samples;
+	unsigned long		waking;
+	int			err;
+	bool			started;
+	bool			finished;
+};
+
 struct record {
 	struct perf_tool	tool;
 	struct record_opts	opts;
@@ -108,6 +148,10 @@ struct record {
 	unsigned long long	samples;
 	struct mmap_cpu_mask	affinity_mask;
 	unsigned long		output_max_size;	/* = 0: unlimited */
+	enum thread_spec	threads_spec;
+	int			nr_threads;
+	struct record_thread	*thread_data;
+	int			thread_done[2];	/* threads out of events -> main */
 };
 
 static volatile int done;
@@ -1079,14 +1123,21 @@ static size_t process_comp_header(void *record, size_t increment)
 	return size;
 }
 
+static size_t __zstd_compress(struct zstd_data *zstd_data, void *dst, size_t dst_size,
+			      void *src, size_t src_size)
+{
+	size_t max_record_size = PERF_SAMPLE_MAX_SIZE - sizeof(struct perf_record_compressed) - 1;
+
+	return zstd_compress_stream_to_records(zstd_data, dst, dst_size, src, src_size,
+					       max_record_size, process_comp_header);
+}
+
 static size_t zstd_compress(struct perf_session *session, void *dst, size_t dst_size,
 			    void *src, size_t src_size)
 {
 	size_t compressed;
-	size_t max_record_size = PERF_SAMPLE_MAX_SIZE - sizeof(struct perf_record_compressed) - 1;
 
-	compressed = zstd_compress_stream_to_records(&session->zstd_data, dst, dst_size, src, src_size,
-						     max_record_size, process_comp_header);
+	compressed = __zstd_compress(&session->zstd_data, dst, dst_size, src, src_size);
 
 	session->bytes_transferred += src_size;
 	session->bytes_compressed  += compressed;
@@ -1171,10 +1222,19 @@ static int record__mmap_read_evlist(struct record *rec, struct evlist *evlist,
 	return rc;
 }
 
+static bool record__threads_enabled(struct record *rec)
+{
+	return rec->threads_spec != THREAD_SPEC__UNDEFINED;
+}
+
 static int record__mmap_read_all(struct record *rec, bool synch)
 {
 	int err;
 
+	/* the mmaps belong to the --threads threads */
+	if (record__threads_enabled(rec))
+		return 0;
+
 	err = record__mmap_read_evlist(rec, rec->evlist, false, synch);
 	if (err)
 		return err;
@@ -1182,6 +1242,355 @@ static int record__mmap_read_all(struct record *rec, bool synch)
 	return record__mmap_read_evlist(rec, rec->evlist, true, synch);
 }
 
+static int record__thread_write(struct record_thread *thread, void *bf, size_t size)
+{
+	if (perf_data_file__write(thread->file, bf, size) < 0) {
+		pr_err("failed to write perf data, error: %m\n");
+		return -1;
+	}
+
+	thread->bytes_written += size;
+	return 0;
+}
+
+static int record__thread_pushfn(struct mmap *map, void *to, void *bf, size_t size)
+{
+	struct record_thread *thread = to;
+
+	if (record__comp_enabled(thread->rec)) {
+		thread->bytes_transferred += size;
+		size = __zstd_compress(&thread->zstd_data, map->data,
+				       mmap__mmap_len(map), bf, size);
+		thread->bytes_compressed += size;
+		bf = map->data;
+	}
+
+	thread->samples++;
+	return record__thread_write(thread, bf, size);
+}
+
+static int record__thread_mmap_read(struct record_thread *thread, bool synch)
+{
+	int i, err;
+
+	for (i = 0; i < thread->nr_mmaps; i++) {
+		struct mmap *map = thread->maps[i];
+		u64 flush = 0;
+
+		if (!map->core.base)
+			continue;
+
+		if (synch) {
+			flush = map->core.flush;
+			map->core.flush = 1;
+		}
+		err = perf_mmap__push(map, thread, record__thread_pushfn);
+		if (synch)
+			map->core.flush = flush;
+		if (err < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The events are only ordered within each data file, so no FINISHED_ROUND
+ * events are written: perf report sorts all the files as a whole.
+ */
+static void *record__thread(void *arg)
+{
+	struct record_thread *thread = arg;
+	bool terminate = false;
+	int err = 0;
+
+	sched_setaffinity(0, MMAP_CPU_MASK_BYTES(&thread->mask),
+			  (cpu_set_t *)thread->mask.bits);
+
+	for (;;) {
+		unsigned long long hits = thread->samples;
+
+		if (record__thread_mmap_read(thread, false) < 0) {
+			err = -1;
+			break;
+		}
+
+		if (hits != thread->samples)
+			continue;
+
+		if (terminate)
+			break;
+
+		err = fdarray__poll(&thread->pollfd, -1);
+		/*
+		 * Propagate error, only if there's any. Ignore positive
+		 * number of returned events and interrupt error.
+		 */
+		if (err > 0 || (err < 0 && errno == EINTR))
+			err = 0;
+		if (err)
+			break;
+		thread->waking++;
+
+		/* stopped by the main thread or all the events are gone */
+		if (thread->pollfd.entries[0].revents ||
+		    fdarray__filter(&thread->pollfd, POLLERR | POLLHUP, NULL, NULL) == 0)
+			terminate = true;
+	}
+
+	if (!err)
+		err = record__thread_mmap_read(thread, true);
+	thread->err = err;
+
+	WRITE_ONCE(thread->finished, true);
+	if (write(thread->rec->thread_done[1], "", 1) < 0)
+		pr_debug("failed to notify the end of a reader thread\n");
+
+	return NULL;
+}
+
+static int record__thread_key(struct record *rec, int cpu)
+{
+	switch (rec->threads_spec) {
+	case THREAD_SPEC__CORE:
+		return (cpu_map__get_socket_id(cpu) << 16) | cpu_map__get_core_id(cpu);
+	case THREAD_SPEC__PACKAGE:
+		return cpu_map__get_socket_id(cpu);
+	case THREAD_SPEC__NUMA:
+		return cpu__get_node(cpu);
+	case THREAD_SPEC__CPU:
+	default:
+		return cpu;
+	}
+}
+
+static struct record_thread *record__thread_findnew(struct record *rec, int key,
+						    int nr_mmaps)
+{
+	struct record_thread *thread;
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		if (rec->thread_data[i].key == key)
+			return &rec->thread_data[i];
+	}
+
+	thread = &rec->thread_data[rec->nr_threads++];
+	thread->rec = rec;
+	thread->key = key;
+	thread->ctl[0] = thread->ctl[1] = -1;
+	fdarray__init(&thread->pollfd, 64);
+	thread->maps = calloc(nr_mmaps, sizeof(*thread->maps));
+	thread->mask.nbits = cpu__max_cpu();
+	thread->mask.bits = bitmap_alloc(thread->mask.nbits);
+	if (!thread->maps || !thread->mask.bits)
+		return NULL;
+
+	return thread;
+}
+
+static void record__free_threads(struct record *rec)
+{
+	int i;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		if (thread->ctl[0] >= 0)
+			close(thread->ctl[0]);
+		if (thread->ctl[1] >= 0)
+			close(thread->ctl[1]);
+		fdarray__exit(&thread->pollfd);
+		zstd_fini(&thread->zstd_data);
+		bitmap_free(thread->mask.bits);
+		free(thread->maps);
+	}
+	zfree(&rec->thread_data);
+	rec->nr_threads = 0;
+
+	if (rec->thread_done[0] >= 0)
+		close(rec->thread_done[0]);
+	if (rec->thread_done[1] >= 0)
+		close(rec->thread_done[1]);
+	rec->thread_done[0] = rec->thread_done[1] = -1;
+}
+
+/*
+ * Hand every mmap and the event fds feeding it over to the thread of its
+ * CPU group. The main thread keeps polling only the control, wakeup and
+ * thread_done fds.
+ */
+static int record__init_threads(struct record *rec)
+{
+	struct evlist *evlist = rec->evlist;
+	struct fdarray *fda = &evlist->core.pollfd;
+	int nr_mmaps = evlist->core.nr_mmaps;
+	int i, j, err;
+
+	if (rec->threads_spec == THREAD_SPEC__NUMA)
+		cpu__setup_cpunode_map();
+
+	rec->thread_data = calloc(nr_mmaps, sizeof(*rec->thread_data));
+	if (!rec->thread_data)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_mmaps; i++) {
+		struct mmap *map = &evlist->mmap[i];
+		struct record_thread *thread;
+
+		if (map->core.cpu < 0) {
+			pr_err("--threads needs per-cpu mmaps\n");
+			return -EINVAL;
+		}
+
+		thread = record__thread_findnew(rec, record__thread_key(rec, map->core.cpu),
+						nr_mmaps);
+		if (!thread)
+			return -ENOMEM;
+
+		thread->maps[thread->nr_mmaps++] = map;
+		set_bit(map->core.cpu, thread->mask.bits);
+	}
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		if (pipe(thread->ctl) < 0)
+			return -errno;
+
+		if (fdarray__add(&thread->pollfd, thread->ctl[0], POLLIN,
+				 fdarray_flag__nonfilterable) < 0)
+			return -ENOMEM;
+
+		if (zstd_init(&thread->zstd_data, rec->opts.comp_level) < 0) {
+			pr_err("Compression initialization failed.\n");
+			return -EINVAL;
+		}
+	}
+
+	for (i = 0; i < fda->nr; i++) {
+		struct perf_mmap *map = fda->priv[i].ptr;
+
+		if (!map)
+			continue;
+
+		for (j = 0; j < rec->nr_threads; j++) {
+			struct record_thread *thread = &rec->thread_data[j];
+			int k;
+
+			for (k = 0; k < thread->nr_mmaps; k++) {
+				if (&thread->maps[k]->core == map)
+					break;
+			}
+			if (k == thread->nr_mmaps)
+				continue;
+
+			if (fdarray__add(&thread->pollfd, fda->entries[i].fd,
+					 fda->entries[i].events,
+					 fdarray_flag__default) < 0)
+				return -ENOMEM;
+			break;
+		}
+		fda->entries[i].fd = -1;
+		fda->entries[i].events = 0;
+	}
+
+	if (pipe(rec->thread_done) < 0)
+		return -errno;
+	if (evlist__add_pollfd(evlist, rec->thread_done[0]) < 0)
+		return -ENOMEM;
+
+	err = perf_data__create_dir(&rec->data, rec->nr_threads);
+	if (err) {
+		pr_err("Failed to create data directory: %s\n", strerror(-err));
+		return err;
+	}
+
+	for (i = 0; i < rec->nr_threads; i++)
+		rec->thread_data[i].file = &rec->data.dir.files[i];
+
+	pr_debug("threads: %d (%s)\n", rec->nr_threads,
+		 thread_spec_tags[rec->threads_spec]);
+	return 0;
+}
+
+static int record__start_threads(struct record *rec)
+{
+	sigset_t full, mask;
+	int i, err = 0;
+
+	/* signals are for the main thread only */
+	sigfillset(&full);
+	pthread_sigmask(SIG_SETMASK, &full, &mask);
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		err = pthread_create(&thread->tid, NULL, record__thread, thread);
+		if (err) {
+			pr_err("Failed to start reader thread: %s\n", strerror(err));
+			err = -err;
+			break;
+		}
+		thread->started = true;
+	}
+
+	pthread_sigmask(SIG_SETMASK, &mask, NULL);
+	return err;
+}
+
+static bool record__threads_finished(struct record *rec)
+{
+	char buf[64];
+	int i;
+
+	/* empty the pipe so that it doesn't wake us up again */
+	while (read(rec->thread_done[0], buf, sizeof(buf)) > 0)
+		;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		if (!READ_ONCE(rec->thread_data[i].finished))
+			return false;
+	}
+	return true;
+}
+
+static int record__stop_threads(struct record *rec, unsigned long *waking)
+{
+	struct perf_session *session = rec->session;
+	int i, err = 0;
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		if (thread->ctl[1] >= 0)
+			close(thread->ctl[1]);
+		thread->ctl[1] = -1;
+	}
+
+	for (i = 0; i < rec->nr_threads; i++) {
+		struct record_thread *thread = &rec->thread_data[i];
+
+		if (!thread->started)
+			continue;
+
+		pthread_join(thread->tid, NULL);
+		thread->started = false;
+
+		if (thread->err)
+			err = thread->err;
+
+		rec->samples += thread->samples;
+		*waking += thread->waking;
+		session->bytes_transferred += thread->bytes_transferred;
+		session->bytes_compressed += thread->bytes_compressed;
+		pr_debug("thread %d: samples %llu, written %" PRIu64 " bytes\n",
+			 i, thread->samples, thread->bytes_written);
+	}
+
+	return err;
+}
+
 static void record__init_features(struct record *rec)
 {
 	struct perf_session *session = rec->session;
@@ -1208,7 +1617,8 @@ static void record__init_features(struct record *rec)
 	if (!rec->opts.use_clockid)
 		perf_header__clear_feat(&session->header, HEADER_CLOCK_DATA);
 
-	perf_header__clear_feat(&session->header, HEADER_DIR_FORMAT);
+	if (!record__threads_enabled(rec))
+		perf_header__clear_feat(&session->header, HEADER_DIR_FORMAT);
 	if (!record__comp_enabled(rec))
 		perf_header__clear_feat(&session->header, HEADER_COMPRESSED);
 
@@ -1226,6 +1636,8 @@ record__finish_output(struct record *rec)
 
 	rec->session->header.data_size += rec->bytes_written;
 	data->file.size = lseek(perf_data__fd(data), 0, SEEK_CUR);
+	if (record__threads_enabled(rec))
+		perf_data__update_dir(data);
 
 	if (!rec->no_buildid) {
 		process_buildids(rec);
@@ -1677,6 +2089,13 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	session->header.env.comp_type  = PERF_COMP_ZSTD;
 	session->header.env.comp_level = rec->opts.comp_level;
 
+	if (record__threads_enabled(rec) &&
+	    (data->is_pipe || rec->opts.full_auxtrace)) {
+		pr_err("--threads is not supported with %s\n",
+		       data->is_pipe ? "pipe output" : "AUX area tracing");
+		return -1;
+	}
+
 	if (rec->opts.kcore &&
 	    !record__kcore_readable(&session->machines.host)) {
 		pr_err("ERROR: kcore is not readable.\n");
@@ -1714,6 +2133,14 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 	}
 	session->header.env.comp_mmap_len = session->evlist->core.mmap_len;
 
+	if (record__threads_enabled(rec)) {
+		err = record__init_threads(rec);
+		if (!err)
+			err = record__start_threads(rec);
+		if (err)
+			goto out_child;
+	}
+
 	if (rec->opts.kcore) {
 		err = record__kcore_copy(&session->machines.host, data);
 		if (err) {
@@ -1935,7 +2362,10 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 				err = 0;
 			waking++;
 
-			if (evlist__filter_pollfd(rec->evlist, POLLERR | POLLHUP) == 0)
+			if (record__threads_enabled(rec)) {
+				if (record__threads_finished(rec))
+					draining = true;
+			} else if (evlist__filter_pollfd(rec->evlist, POLLERR | POLLHUP) == 0)
 				draining = true;
 		}
 
@@ -1992,6 +2422,9 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 
 out_child:
 	evlist__finalize_ctlfd(rec->evlist);
+	if (record__threads_enabled(rec) &&
+	    record__stop_threads(rec, &waking) < 0 && !err)
+		err = -1;
 	record__mmap_read_all(rec, true);
 	record__aio_mmap_read_sync(rec);
 
@@ -2063,6 +2496,8 @@ static int __cmd_record(struct record *rec, int argc, const char **argv)
 		close(done_fd);
 #endif
 	zstd_fini(&session->zstd_data);
+	if (record__threads_enabled(rec))
+		record__free_threads(rec);
 	perf_session__delete(session);
 
 	if (!opts->no_bpf_event)
@@ -2159,6 +2594,58 @@ static int perf_record_config(const char *var, const char *value, void *cb)
 }
 
 
+static int record__parse_threads(const struct option *opt, const char *str, int unset)
+{
+	struct record *rec = (struct record *)opt->value;
+	int s;
+
+	if (unset) {
+		rec->threads_spec = THREAD_SPEC__UNDEFINED;
+		return 0;
+	}
+
+	if (!str) {
+		rec->threads_spec = THREAD_SPEC__CPU;
+		return 0;
+	}
+
+	for (s = THREAD_SPEC__CPU; s < THREAD_SPEC__MAX; s++) {
+		if (!strcmp(str, thread_spec_tags[s])) {
+			rec->threads_spec = s;
+			return 0;
+		}
+	}
+
+	pr_err("Unknown --threads grouping: %s\n", str);
+	return -1;
+}
+
+static int record__check_threads(struct record *rec)
+{
+	const char *opt = NULL;
+
+	if (rec->opts.affinity != PERF_AFFINITY_SYS)
+		opt = "affinity";
+	else if (record__aio_enabled(rec))
+		opt = "aio";
+	else if (rec->switch_output.enabled || rec->timestamp_filename)
+		opt = "switch-output";
+	else if (rec->opts.overwrite)
+		opt = "overwrite";
+	else if (rec->output_max_size)
+		opt = "max-size";
+	else if (rec->opts.target.per_thread)
+		opt = "per-thread";
+
+	if (!opt)
+		return 0;
+
+	pr_err("--threads is not supported with --%s\n", opt);
+	parse_options_usage(record_usage, record_options, "threads", 0);
+	parse_options_usage(NULL, record_options, opt, 0);
+	return -EINVAL;
+}
+
 static int record__parse_affinity(const struct option *opt, const char *str, int unset)
 {
 	struct record_opts *opts = (struct record_opts *)opt->value;
@@ -2402,6 +2889,7 @@ static struct record record = {
 		.mmap2		= build_id__process_mmap2,
 		.ordered_events	= true,
 	},
+	.thread_done = { -1, -1 },
 };
 
 const char record_callchain_help[] = CALLCHAIN_RECORD_HELP
@@ -2584,6 +3072,10 @@ static struct option __record_options[] = {
 #endif
 	OPT_CALLBACK(0, "max-size", &record.output_max_size,
 		     "size", "Limit the maximum size of the output file", parse_output_max_size),
+	OPT_CALLBACK_OPTARG(0, "threads", &record, NULL, "cpu|core|package|numa",
+			    "Read the mmaps with one thread per cpu (default), core, package or numa node, "
+			    "each writing to its own file of a perf.data directory",
+			    record__parse_threads),
 	OPT_UINTEGER(0, "num-thread-synthesize",
 		     &record.opts.nr_threads_synthesize,
 		     "number of threads to run for event synthesis"),
@@ -2679,6 +3171,13 @@ int cmd_record(int argc, const char **argv)
 		goto out_opts;
 	}
 
+	if (record__threads_enabled(rec)) {
+		err = record__check_threads(rec);
+		if (err)
+			goto out_opts;
+		rec->data.is_dir = true;
+	}
+
 	if (rec->switch_output.time) {
 		signal(SIGALRM, alarm_sig_handler);
 		alarm(rec->switch_output.time);
@@ -51,6 +51,7 @@
 #include "ui/ui.h"
 #include "ui/progress.h"
 #include "util/block-info.h"
+#include "util/symbol-loader.h"
 
 #include <dlfcn.h>
 #include <errno.h>
@@ -105,6 +106,8 @@ struct report {
 	bool			total_cycles_mode;
 	struct block_report	*block_reports;
 	int			nr_block_reports;
+	int			nr_symbol_threads;
+	struct symbol_loader	symbol_loader;
 };
 
 static int report__config(const char *var, const char *value, void *cb)
@@ -311,6 +314,60 @@ static int process_sample_event(struct perf_tool *tool,
 	return ret;
 }
 
+/*
+ * With --symbol-threads the DSO of every new user space map is handed to
+ * the symbol loader, so that its symbols are parsed while the following
+ * events are processed.
+ */
+static void report__queue_symbol_load(struct report *rep, struct machine *machine,
+				      union perf_event *event, u32 pid, u32 tid,
+				      u64 start)
+{
+	struct thread *thread;
+	struct map *map;
+
+	if (!rep->nr_symbol_threads ||
+	    (event->header.misc & PERF_RECORD_MISC_CPUMODE_MASK) != PERF_RECORD_MISC_USER)
+		return;
+
+	thread = machine__find_thread(machine, pid, tid);
+	if (!thread)
+		return;
+
+	map = maps__find(thread->maps, start);
+	if (map)
+		symbol_loader__queue(&rep->symbol_loader, map);
+	thread__put(thread);
+}
+
+static int process_mmap_event(struct perf_tool *tool,
+			      union perf_event *event,
+			      struct perf_sample *sample,
+			      struct machine *machine)
+{
+	struct report *rep = container_of(tool, struct report, tool);
+	int ret = perf_event__process_mmap(tool, event, sample, machine);
+
+	if (!ret)
+		report__queue_symbol_load(rep, machine, event, event->mmap.pid,
+					  event->mmap.tid, event->mmap.start);
+	return ret;
+}
+
+static int process_mmap2_event(struct perf_tool *tool,
+			       union perf_event *event,
+			       struct perf_sample *sample,
+			       struct machine *machine)
+{
+	struct report *rep = container_of(tool, struct report, tool);
+	int ret = perf_event__process_mmap2(tool, event, sample, machine);
+
+	if (!ret)
+		report__queue_symbol_load(rep, machine, event, event->mmap2.pid,
+					  event->mmap2.tid, event->mmap2.start);
+	return ret;
+}
+
 static int process_read_event(struct perf_tool *tool,
 			      union perf_event *event,
 			      struct perf_sample *sample __maybe_unused,
@@ -910,7 +967,21 @@ static int __cmd_report(struct report *rep)
 	if (rep->tasks_mode)
 		tasks_setup(rep);
 
+	if (rep->nr_symbol_threads > 0 && !rep->stats_mode && !rep->tasks_mode) {
+		ret = symbol_loader__start(&rep->symbol_loader, rep->nr_symbol_threads);
+		if (ret) {
+			ui__error("failed to start the symbol loader\n");
+			return ret;
+		}
+	} else {
+		rep->nr_symbol_threads = 0;
+	}
+
 	ret = perf_session__process_events(session);
+
+	if (rep->nr_symbol_threads)
+		symbol_loader__stop(&rep->symbol_loader);
+
 	if (ret) {
 		ui__error("failed to process sample\n");
 		return ret;
@@ -1121,8 +1192,8 @@ int cmd_report(int argc, const char **argv)
 	struct report report = {
 		.tool = {
 			.sample		 = process_sample_event,
-			.mmap		 = perf_event__process_mmap,
-			.mmap2		 = perf_event__process_mmap2,
+			.mmap		 = process_mmap_event,
+			.mmap2		 = process_mmap2_event,
 			.comm		 = perf_event__process_comm,
 			.namespaces	 = perf_event__process_namespaces,
 			.cgroup		 = perf_event__process_cgroup,
@@ -1281,6 +1352,8 @@ int cmd_report(int argc, const char **argv)
 		    "Show callgraph from reference event"),
 	OPT_BOOLEAN(0, "stitch-lbr", &report.stitch_lbr,
 		    "Enable LBR callgraph stitching approach"),
+	OPT_INTEGER(0, "symbol-threads", &report.nr_symbol_threads,
+		    "Number of threads loading DSO symbols while processing events"),
 	OPT_INTEGER(0, "socket-filter", &report.socket_filter,
 		    "only show processor socket that match with this filter"),
 	OPT_BOOLEAN(0, "raw-trace", &symbol_conf.raw_trace,
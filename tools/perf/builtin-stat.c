@@ -43,6 +43,7 @@
 #include "builtin.h"
 #include "perf.h"
 #include "util/cgroup.h"
+#include "util/bpf_counter.h"
 #include <subcmd/parse-options.h>
 #include "util/parse-events.h"
 #include "util/pmu.h"
@@ -409,12 +410,32 @@ static int read_affinity_counters(struct timespec *rs)
 	return 0;
 }
 
+static int read_bpf_map_counters(void)
+{
+	struct evsel *counter;
+	int err;
+
+	evlist__for_each_entry(evsel_list, counter) {
+		err = bpf_counter__read(counter);
+		if (err)
+			return err;
+	}
+	return 0;
+}
+
 static void read_counters(struct timespec *rs)
 {
 	struct evsel *counter;
+	int ret;
 
-	if (!stat_config.stop_read_counter && (read_affinity_counters(rs) < 0))
-		return;
+	if (!stat_config.stop_read_counter) {
+		if (target.use_bpf)
+			ret = read_bpf_map_counters();
+		else
+			ret = read_affinity_counters(rs);
+		if (ret < 0)
+			return;
+	}
 
 	evlist__for_each_entry(evsel_list, counter) {
 		if (counter->err)
@@ -498,6 +519,15 @@ static bool handle_interval(unsigned int interval, int *times)
 
 static void enable_counters(void)
 {
+	struct evsel *evsel;
+
+	if (target.use_bpf) {
+		evlist__for_each_entry(evsel_list, evsel) {
+			if (bpf_counter__enable(evsel))
+				return;
+		}
+	}
+
 	if (stat_config.initial_delay < 0) {
 		pr_info(EVLIST_DISABLED_MSG);
 		return;
@@ -522,6 +552,13 @@ static void enable_counters(void)
 
 static void disable_counters(void)
 {
+	struct evsel *counter;
+
+	if (target.use_bpf) {
+		evlist__for_each_entry(evsel_list, counter)
+			bpf_counter__disable(counter);
+	}
+
 	/*
 	 * If we don't have tracee (attaching to task or cpu), counters may
 	 * still be running. To get accurate group ratios, we must stop groups
@@ -738,6 +775,13 @@ static int __run_perf_stat(int argc, const char **argv, int run_idx)
 	if (affinity__setup(&affinity) < 0)
 		return -1;
 
+	if (target.use_bpf) {
+		evlist__for_each_entry(evsel_list, counter) {
+			if (bpf_counter__load(counter, &target))
+				return -1;
+		}
+	}
+
 	evlist__for_each_cpu (evsel_list, i, cpu) {
 		affinity__set(&affinity, cpu);
 
@@ -746,6 +790,8 @@ static int __run_perf_stat(int argc, const char **argv, int run_idx)
 				continue;
 			if (counter->reset_group || counter->errored)
 				continue;
+			if (evsel__is_bpf(counter))
+				continue;
 try_again:
 			if (create_perf_stat_counter(counter, &stat_config, &target,
 						     counter->cpu_iter - 1) < 0) {
@@ -1117,6 +1163,10 @@ static struct option stat_options[] = {
 		     "monitor event in cgroup name only", parse_stat_cgroups),
 	OPT_STRING(0, "for-each-cgroup", &stat_config.cgroup_list, "name",
 		    "expand events for each cgroup"),
+#ifdef HAVE_BPF_SKEL
+	OPT_BOOLEAN(0, "bpf-counters", &target.use_bpf,
+		    "use a bpf program to count the events of each cgroup"),
+#endif
 	OPT_STRING('o', "output", &output_name, "file", "output file name"),
 	OPT_BOOLEAN(0, "append", &append_file, "append to the output file"),
 	OPT_INTEGER(0, "log-fd", &output_fd,
@@ -2235,8 +2285,22 @@ int cmd_stat(int argc, const char **argv)
 		}
 
 		if (evlist__expand_cgroup(evsel_list, stat_config.cgroup_list,
-					  &stat_config.metric_events, true) < 0)
+					  &stat_config.metric_events,
+					  !target.use_bpf) < 0)
+			goto out;
+	}
+
+	if (target.use_bpf) {
+		if (!stat_config.cgroup_list || !target__has_cpu(&target)) {
+			pr_err("--bpf-counters needs --for-each-cgroup in system-wide mode\n");
+			parse_options_usage(stat_usage, stat_options, "bpf-counters", 0);
+			parse_options_usage(NULL, stat_options, "for-each-cgroup", 0);
 			goto out;
+		}
+		if (STAT_RECORD) {
+			pr_err("--bpf-counters cannot be used with perf stat record\n");
+			goto out;
+		}
 	}
 
 	target__validate(&target);
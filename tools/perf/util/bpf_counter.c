@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <errno.h>
+#include "bpf_counter.h"
+#include "cgroup.h"
+#include "evsel.h"
+#include "target.h"
+
+extern struct bpf_counter_ops bperf_cgrp_ops;
+
+int bpf_counter__load(struct evsel *evsel, struct target *target)
+{
+	int err;
+
+	if (target->use_bpf && nr_cgroups)
+		evsel->bpf_counter_ops = &bperf_cgrp_ops;
+	else
+		return 0;
+
+	err = evsel->bpf_counter_ops->load(evsel, target);
+	if (err)
+		evsel->bpf_counter_ops = NULL;
+	return err;
+}
+
+int bpf_counter__enable(struct evsel *evsel)
+{
+	if (!evsel__is_bpf(evsel))
+		return 0;
+	return evsel->bpf_counter_ops->enable(evsel);
+}
+
+int bpf_counter__disable(struct evsel *evsel)
+{
+	if (!evsel__is_bpf(evsel))
+		return 0;
+	return evsel->bpf_counter_ops->disable(evsel);
+}
+
+int bpf_counter__read(struct evsel *evsel)
+{
+	if (!evsel__is_bpf(evsel))
+		return -EAGAIN;
+	return evsel->bpf_counter_ops->read(evsel);
+}
+
+void bpf_counter__destroy(struct evsel *evsel)
+{
+	if (!evsel__is_bpf(evsel))
+		return;
+	evsel->bpf_counter_ops->destroy(evsel);
+	evsel->bpf_counter_ops = NULL;
+}
@@ -175,6 +175,7 @@ struct dso {
 	u8		 is_64_bit:1;
 	bool		 sorted_by_name;
 	bool		 loaded;
+	bool		 load_queued;	/* handed to a symbol_loader */
 	u8		 rel;
 	struct build_id	 bid;
 	u64		 text_offset;
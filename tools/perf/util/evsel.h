@@ -13,6 +13,7 @@
 #include <internal/cpumap.h>
 
 struct bpf_object;
+struct bpf_counter_ops;
 struct cgroup;
 struct perf_counts;
 struct perf_stat_evsel;
@@ -127,6 +128,7 @@ struct evsel {
 	 * See also evsel__has_callchain().
 	 */
 	__u64			synth_sample_type;
+	struct bpf_counter_ops	*bpf_counter_ops;
 };
 
 struct perf_missing_features {
@@ -329,6 +331,11 @@ static inline struct evsel *evsel__prev(struct evsel *evsel)
  *
  * Return %true if @evsel is a group leader or a stand-alone event
  */
+static inline bool evsel__is_bpf(const struct evsel *evsel)
+{
+	return evsel->bpf_counter_ops != NULL;
+}
+
 static inline bool evsel__is_group_leader(const struct evsel *evsel)
 {
 	return evsel->leader == evsel;
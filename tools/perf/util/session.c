@@ -42,7 +42,8 @@ static int perf_session__process_compressed_event(struct perf_session *session,
 	size_t decomp_size, src_size;
 	u64 decomp_last_rem = 0;
 	size_t mmap_len, decomp_len = session->header.env.comp_mmap_len;
-	struct decomp *decomp, *decomp_last = session->decomp_last;
+	struct decomp_data *decomp_data = session->active_decomp;
+	struct decomp *decomp, *decomp_last = decomp_data->decomp_last;
 
 	if (decomp_last) {
 		decomp_last_rem = decomp_last->size - decomp_last->head;
@@ -69,7 +70,7 @@ static int perf_session__process_compressed_event(struct perf_session *session,
 	src = (void *)event + sizeof(struct perf_record_compressed);
 	src_size = event->pack.header.size - sizeof(struct perf_record_compressed);
 
-	decomp_size = zstd_decompress_stream(&(session->zstd_data), src, src_size,
+	decomp_size = zstd_decompress_stream(decomp_data->zstd_decomp, src, src_size,
 				&(decomp->data[decomp_last_rem]), decomp_len - decomp_last_rem);
 	if (!decomp_size) {
 		munmap(decomp, mmap_len);
@@ -79,12 +80,12 @@ static int perf_session__process_compressed_event(struct perf_session *session,
 
 	decomp->size += decomp_size;
 
-	if (session->decomp == NULL) {
-		session->decomp = decomp;
-		session->decomp_last = decomp;
+	if (decomp_data->decomp == NULL) {
+		decomp_data->decomp = decomp;
+		decomp_data->decomp_last = decomp;
 	} else {
-		session->decomp_last->next = decomp;
-		session->decomp_last = decomp;
+		decomp_data->decomp_last->next = decomp;
+		decomp_data->decomp_last = decomp;
 	}
 
 	pr_debug("decomp (B): %zd to %zd\n", src_size, decomp_size);
@@ -194,6 +195,8 @@ struct perf_session *perf_session__new(struct perf_data *data,
 
 	session->repipe = repipe;
 	session->tool   = tool;
+	session->decomp_data.zstd_decomp = &session->zstd_data;
+	session->active_decomp = &session->decomp_data;
 	INIT_LIST_HEAD(&session->auxtrace_index);
 	machines__init(&session->machines);
 	ordered_events__init(&session->ordered_events,
@@ -273,11 +276,11 @@ static void perf_session__delete_threads(struct perf_session *session)
 	machine__delete_threads(&session->machines.host);
 }
 
-static void perf_session__release_decomp_events(struct perf_session *session)
+static void perf_decomp__release_events(struct decomp *next)
 {
-	struct decomp *next, *decomp;
+	struct decomp *decomp;
 	size_t mmap_len;
-	next = session->decomp;
+
 	do {
 		decomp = next;
 		if (decomp == NULL)
@@ -296,7 +299,7 @@ void perf_session__delete(struct perf_session *session)
 	auxtrace_index__free(&session->auxtrace_index);
 	perf_session__destroy_kernel_maps(session);
 	perf_session__delete_threads(session);
-	perf_session__release_decomp_events(session);
+	perf_decomp__release_events(session->decomp_data.decomp);
 	perf_env__exit(&session->header.env);
 	machines__exit(&session->machines);
 	if (session->data)
@@ -2097,7 +2100,7 @@ static int __perf_session__process_decomp_events(struct perf_session *session)
 {
 	s64 skip;
 	u64 size, file_pos = 0;
-	struct decomp *decomp = session->decomp_last;
+	struct decomp *decomp = session->active_decomp->decomp_last;
 
 	if (!decomp)
 		return 0;
@@ -2145,40 +2148,75 @@ typedef s64 (*reader_cb_t)(struct perf_session *session,
 			   union perf_event *event,
 			   u64 file_offset);
 
+struct reader_state {
+	char	*mmaps[NUM_MMAPS];
+	size_t	 mmap_size;
+	int	 mmap_idx;
+	char	*mmap_cur;
+	u64	 file_pos;
+	u64	 file_offset;
+	u64	 data_size;
+	u64	 head;
+};
+
 struct reader {
-	int		 fd;
-	u64		 data_size;
-	u64		 data_offset;
-	reader_cb_t	 process;
+	int			 fd;
+	const char		*path;
+	u64			 data_size;
+	u64			 data_offset;
+	reader_cb_t		 process;
+	struct zstd_data	 zstd_data;
+	struct decomp_data	 decomp_data;
+	struct reader_state	 st;
 };
 
-static int
-reader__process_events(struct reader *rd, struct perf_session *session,
-		       struct ui_progress *prog)
+enum {
+	READER_OK,
+	READER_NODATA,
+};
+
+static void reader__init(struct reader *rd, bool *one_mmap)
 {
-	u64 data_size = rd->data_size;
-	u64 head, page_offset, file_offset, file_pos, size;
-	int err = 0, mmap_prot, mmap_flags, map_idx = 0;
-	size_t	mmap_size;
-	char *buf, *mmaps[NUM_MMAPS];
-	union perf_event *event;
-	s64 skip;
+	struct reader_state *st = &rd->st;
+	u64 page_offset;
+
+	pr_debug("reader processing %s\n", rd->path);
 
 	page_offset = page_size * (rd->data_offset / page_size);
-	file_offset = page_offset;
-	head = rd->data_offset - page_offset;
+	st->file_offset = page_offset;
+	st->head = rd->data_offset - page_offset;
+
+	st->data_size = rd->data_size + rd->data_offset;
 
-	ui_progress__init_size(prog, data_size, "Processing events...");
+	st->mmap_size = MMAP_SIZE;
+	if (st->mmap_size > st->data_size) {
+		st->mmap_size = st->data_size;
+		if (one_mmap)
+			*one_mmap = true;
+	}
+
+	memset(st->mmaps, 0, sizeof(st->mmaps));
+}
 
-	data_size += rd->data_offset;
+static void reader__release_mmaps(struct reader *rd)
+{
+	struct reader_state *st = &rd->st;
+	int i;
 
-	mmap_size = MMAP_SIZE;
-	if (mmap_size > data_size) {
-		mmap_size = data_size;
-		session->one_mmap = true;
+	for (i = 0; i < NUM_MMAPS; i++) {
+		if (!st->mmaps[i])
+			continue;
+		munmap(st->mmaps[i], st->mmap_size);
+		st->mmaps[i] = NULL;
 	}
+}
 
-	memset(mmaps, 0, sizeof(mmaps));
+static int reader__mmap(struct reader *rd, struct perf_session *session)
+{
+	struct reader_state *st = &rd->st;
+	int mmap_prot, mmap_flags;
+	char *buf, **mmaps = st->mmaps;
+	u64 page_offset;
 
 	mmap_prot  = PROT_READ;
 	mmap_flags = MAP_SHARED;
@@ -2187,68 +2225,109 @@ reader__process_events(struct reader *rd, struct perf_session *session,
 		mmap_prot  |= PROT_WRITE;
 		mmap_flags = MAP_PRIVATE;
 	}
-remap:
-	buf = mmap(NULL, mmap_size, mmap_prot, mmap_flags, rd->fd,
-		   file_offset);
+
+	if (mmaps[st->mmap_idx]) {
+		munmap(mmaps[st->mmap_idx], st->mmap_size);
+		mmaps[st->mmap_idx] = NULL;
+	}
+
+	page_offset = page_size * (st->head / page_size);
+	st->file_offset += page_offset;
+	st->head -= page_offset;
+
+	buf = mmap(NULL, st->mmap_size, mmap_prot, mmap_flags, rd->fd,
+		   st->file_offset);
 	if (buf == MAP_FAILED) {
 		pr_err("failed to mmap file\n");
-		err = -errno;
-		goto out;
+		return -errno;
 	}
-	mmaps[map_idx] = buf;
-	map_idx = (map_idx + 1) & (ARRAY_SIZE(mmaps) - 1);
-	file_pos = file_offset + head;
+	mmaps[st->mmap_idx] = st->mmap_cur = buf;
+	st->mmap_idx = (st->mmap_idx + 1) & (ARRAY_SIZE(st->mmaps) - 1);
+	st->file_pos = st->file_offset + st->head;
 	if (session->one_mmap) {
 		session->one_mmap_addr = buf;
-		session->one_mmap_offset = file_offset;
+		session->one_mmap_offset = st->file_offset;
 	}
 
-more:
-	event = fetch_mmaped_event(head, mmap_size, buf, session->header.needs_swap);
+	return 0;
+}
+
+static int
+reader__read_event(struct reader *rd, struct perf_session *session,
+		   struct ui_progress *prog)
+{
+	struct reader_state *st = &rd->st;
+	union perf_event *event;
+	u64 size;
+	s64 skip;
+	int err;
+
+	event = fetch_mmaped_event(st->head, st->mmap_size, st->mmap_cur,
+				   session->header.needs_swap);
 	if (IS_ERR(event))
 		return PTR_ERR(event);
 
-	if (!event) {
-		if (mmaps[map_idx]) {
-			munmap(mmaps[map_idx], mmap_size);
-			mmaps[map_idx] = NULL;
-		}
-
-		page_offset = page_size * (head / page_size);
-		file_offset += page_offset;
-		head -= page_offset;
-		goto remap;
-	}
+	if (!event)
+		return READER_NODATA;
 
 	size = event->header.size;
 
 	skip = -EINVAL;
 
 	if (size < sizeof(struct perf_event_header) ||
-	    (skip = rd->process(session, event, file_pos)) < 0) {
+	    (skip = rd->process(session, event, st->file_pos)) < 0) {
 		pr_err("%#" PRIx64 " [%#x]: failed to process type: %d [%s]\n",
-		       file_offset + head, event->header.size,
+		       st->file_offset + st->head, event->header.size,
 		       event->header.type, strerror(-skip));
-		err = skip;
-		goto out;
+		return skip;
 	}
 
 	if (skip)
 		size += skip;
 
-	head += size;
-	file_pos += size;
+	st->head += size;
+	st->file_pos += size;
 
 	err = __perf_session__process_decomp_events(session);
 	if (err)
-		goto out;
+		return err;
 
 	ui_progress__update(prog, size);
 
+	return READER_OK;
+}
+
+static inline bool reader__eof(struct reader *rd)
+{
+	return rd->st.file_pos >= rd->st.data_size;
+}
+
+static int
+reader__process_events(struct reader *rd, struct perf_session *session,
+		       struct ui_progress *prog)
+{
+	int err;
+
+	reader__init(rd, &session->one_mmap);
+
+	ui_progress__init_size(prog, rd->data_size, "Processing events...");
+
+remap:
+	err = reader__mmap(rd, session);
+	if (err)
+		goto out;
+
+more:
+	err = reader__read_event(rd, session, prog);
+	if (err < 0)
+		goto out;
+	else if (err == READER_NODATA)
+		goto remap;
+
 	if (session_done())
 		goto out;
 
-	if (file_pos < data_size)
+	if (!reader__eof(rd))
 		goto more;
 
 out:
@@ -2266,6 +2345,7 @@ static int __perf_session__process_events(struct perf_session *session)
 {
 	struct reader rd = {
 		.fd		= perf_data__fd(session->data),
+		.path		= session->data->file.path,
 		.data_size	= session->header.data_size,
 		.data_offset	= session->header.data_offset,
 		.process	= process_simple,
@@ -2307,6 +2387,126 @@ static int __perf_session__process_events(struct perf_session *session)
 	return err;
 }
 
+/*
+ * Each data file of a directory is written by its own 'perf record --threads'
+ * thread, so the events are only ordered within a file and no file carries
+ * FINISHED_ROUND events. The synthesized events of the header file are read
+ * first, then the data files in turns of READER_MAX_SIZE bytes, advancing the
+ * reader which is furthest behind; ordered_events sorts the rest before the
+ * final flush.
+ */
+#define READER_MAX_SIZE (2 * 1024 * 1024)
+
+static int __perf_session__process_dir_events(struct perf_session *session)
+{
+	struct perf_data *data = session->data;
+	struct perf_tool *tool = session->tool;
+	int i, err = 0, nr_readers = 0;
+	struct ui_progress prog;
+	u64 total_size = 0;
+	struct reader *rd;
+
+	perf_tool__fill_defaults(tool);
+
+	rd = zalloc(data->dir.nr * sizeof(*rd));
+	if (!rd)
+		return -ENOMEM;
+
+	if (session->header.data_size) {
+		struct reader hdr = {
+			.fd		= perf_data__fd(data),
+			.path		= data->file.path,
+			.data_size	= session->header.data_size,
+			.data_offset	= session->header.data_offset,
+			.process	= process_simple,
+		};
+
+		err = reader__process_events(&hdr, session, &prog);
+		if (err)
+			goto out_err;
+	}
+
+	for (i = 0; i < data->dir.nr; i++) {
+		struct perf_data_file *file = &data->dir.files[i];
+		struct reader *r = &rd[nr_readers];
+
+		if (!file->size)
+			continue;
+
+		r->fd		= file->fd;
+		r->path		= file->path;
+		r->data_size	= file->size;
+		r->data_offset	= 0;
+		r->process	= process_simple;
+
+		if (zstd_init(&r->zstd_data, 0) < 0) {
+			err = -EINVAL;
+			goto out_err;
+		}
+		r->decomp_data.zstd_decomp = &r->zstd_data;
+		nr_readers++;
+
+		reader__init(r, NULL);
+		err = reader__mmap(r, session);
+		if (err)
+			goto out_err;
+
+		total_size += file->size;
+	}
+
+	ui_progress__init_size(&prog, total_size, "Processing events...");
+
+	while (!session_done()) {
+		struct reader *next = NULL;
+		u64 limit;
+
+		for (i = 0; i < nr_readers; i++) {
+			if (reader__eof(&rd[i]))
+				continue;
+			if (!next || rd[i].st.file_pos < next->st.file_pos)
+				next = &rd[i];
+		}
+		if (!next)
+			break;
+
+		session->active_decomp = &next->decomp_data;
+		limit = next->st.file_pos + READER_MAX_SIZE;
+		while (!reader__eof(next) && next->st.file_pos < limit) {
+			err = reader__read_event(next, session, &prog);
+			if (err < 0)
+				goto out_err;
+			if (err == READER_NODATA) {
+				err = reader__mmap(next, session);
+				if (err)
+					goto out_err;
+			}
+		}
+	}
+	session->active_decomp = &session->decomp_data;
+
+	/* do the final flush for ordered samples */
+	err = ordered_events__flush(&session->ordered_events, OE_FLUSH__FINAL);
+	if (err)
+		goto out_err;
+	err = perf_session__flush_thread_stacks(session);
+out_err:
+	session->active_decomp = &session->decomp_data;
+	ui_progress__finish();
+	if (!tool->no_warn)
+		perf_session__warn_about_errors(session);
+	ordered_events__reinit(&session->ordered_events);
+	session->one_mmap = false;
+
+	/* the queued events pointed into these, release them only now */
+	for (i = 0; i < nr_readers; i++) {
+		reader__release_mmaps(&rd[i]);
+		perf_decomp__release_events(rd[i].decomp_data.decomp);
+		zstd_fini(&rd[i].zstd_data);
+	}
+	free(rd);
+	return err;
+}
+
 int perf_session__process_events(struct perf_session *session)
 {
 	if (perf_session__register_idle_thread(session) < 0)
@@ -2315,6 +2515,9 @@ int perf_session__process_events(struct perf_session *session)
 	if (perf_data__is_pipe(session->data))
 		return __perf_session__process_pipe_events(session);
 
+	if (perf_data__is_dir(session->data) && session->data->dir.nr)
+		return __perf_session__process_dir_events(session);
+
 	return __perf_session__process_events(session);
 }
 
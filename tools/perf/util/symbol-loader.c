@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/zalloc.h>
+#include "debug.h"
+#include "dso.h"
+#include "map.h"
+#include "namespaces.h"
+#include "symbol-loader.h"
+#include "util.h"
+
+struct symbol_load {
+	struct list_head	node;
+	struct map		*map;
+};
+
+static void *symbol_loader__thread(void *arg)
+{
+	struct symbol_loader *loader = arg;
+	struct symbol_load *load;
+	bool loaded;
+
+	for (;;) {
+		pthread_mutex_lock(&loader->lock);
+		while (list_empty(&loader->queue) && !loader->done)
+			pthread_cond_wait(&loader->cond, &loader->lock);
+		if (loader->done) {
+			pthread_mutex_unlock(&loader->lock);
+			break;
+		}
+		load = list_first_entry(&loader->queue, struct symbol_load, node);
+		list_del_init(&load->node);
+		pthread_mutex_unlock(&loader->lock);
+
+		/* dso__load() serializes with the main thread on dso->lock */
+		loaded = map__load(load->map) == 0;
+		map__put(load->map);
+		free(load);
+
+		if (loaded) {
+			pthread_mutex_lock(&loader->lock);
+			loader->nr_loaded++;
+			pthread_mutex_unlock(&loader->lock);
+		}
+	}
+
+	return NULL;
+}
+
+int symbol_loader__start(struct symbol_loader *loader, int nr_threads)
+{
+	int i, err;
+
+	INIT_LIST_HEAD(&loader->queue);
+	pthread_mutex_init(&loader->lock, NULL);
+	pthread_cond_init(&loader->cond, NULL);
+	loader->done = false;
+	loader->nr_loaded = 0;
+	loader->nr_threads = 0;
+
+	loader->threads = calloc(nr_threads, sizeof(*loader->threads));
+	if (!loader->threads)
+		return -ENOMEM;
+
+	/* the maps and machine threads are now shared with the loaders */
+	perf_set_multithreaded();
+
+	for (i = 0; i < nr_threads; i++) {
+		err = pthread_create(&loader->threads[i], NULL,
+				     symbol_loader__thread, loader);
+		if (err) {
+			pr_err("Failed to start symbol loader thread: %s\n", strerror(err));
+			symbol_loader__stop(loader);
+			return -err;
+		}
+		loader->nr_threads++;
+	}
+
+	return 0;
+}
+
+/*
+ * Only user space DSOs are loaded in the background: kernel DSOs split the
+ * kernel maps while loading, and setns() into a mount namespace is refused
+ * to a multithreaded process. These are left to the lazy load on first use.
+ */
+void symbol_loader__queue(struct symbol_loader *loader, struct map *map)
+{
+	struct dso *dso = map->dso;
+	struct symbol_load *load;
+
+	if (!loader->threads || dso->kernel != DSO_SPACE__USER ||
+	    dso->load_queued || dso__loaded(dso) ||
+	    (dso->nsinfo && dso->nsinfo->need_setns))
+		return;
+
+	load = malloc(sizeof(*load));
+	if (!load)
+		return;
+
+	dso->load_queued = true;
+	load->map = map__get(map);
+
+	pthread_mutex_lock(&loader->lock);
+	list_add_tail(&load->node, &loader->queue);
+	pthread_cond_signal(&loader->cond);
+	pthread_mutex_unlock(&loader->lock);
+}
+
+/* Loads still queued are dropped: they will happen on first use, if any. */
+void symbol_loader__stop(struct symbol_loader *loader)
+{
+	struct symbol_load *load, *tmp;
+	int i;
+
+	if (!loader->threads)
+		return;
+
+	pthread_mutex_lock(&loader->lock);
+	loader->done = true;
+	pthread_cond_broadcast(&loader->cond);
+	pthread_mutex_unlock(&loader->lock);
+
+	for (i = 0; i < loader->nr_threads; i++)
+		pthread_join(loader->threads[i], NULL);
+
+	list_for_each_entry_safe(load, tmp, &loader->queue, node) {
+		list_del_init(&load->node);
+		load->map->dso->load_queued = false;
+		map__put(load->map);
+		free(load);
+	}
+
+	pr_debug("symbol loader: %lu DSOs loaded by %d threads\n",
+		 loader->nr_loaded, loader->nr_threads);
+
+	zfree(&loader->threads);
+	loader->nr_threads = 0;
+	pthread_mutex_destroy(&loader->lock);
+	pthread_cond_destroy(&loader->cond);
+	perf_set_singlethreaded();
+}
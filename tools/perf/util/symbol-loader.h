@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __PERF_SYMBOL_LOADER_H
+#define __PERF_SYMBOL_LOADER_H
+
+#include <linux/list.h>
+#include <pthread.h>
+#include <stdbool.h>
+
+struct map;
+
+/*
+ * Loads the symbols of DSOs in worker threads while the events are still
+ * being processed, so that the first sample hitting a DSO finds its symbols
+ * already loaded (or waits on dso->lock for the load in flight) instead of
+ * parsing the binary on the main thread.
+ */
+struct symbol_loader {
+	pthread_t		*threads;
+	int			nr_threads;
+	pthread_mutex_t		lock;
+	pthread_cond_t		cond;
+	struct list_head	queue;
+	bool			done;
+	unsigned long		nr_loaded;
+};
+
+int symbol_loader__start(struct symbol_loader *loader, int nr_threads);
+void symbol_loader__queue(struct symbol_loader *loader, struct map *map);
+void symbol_loader__stop(struct symbol_loader *loader);
+
+#endif /* __PERF_SYMBOL_LOADER_H */
@@ -0,0 +1,334 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Test migration of the accept queue of a closed SO_REUSEPORT listener
+ * to the other listeners of its group, either enabled by the
+ * net.ipv4.tcp_migrate_req sysctl or decided by a
+ * BPF_SK_REUSEPORT_SELECT_OR_MIGRATE program.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/bpf.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "../kselftest_harness.h"
+
+#define MIGRATE_REQ	"/proc/sys/net/ipv4/tcp_migrate_req"
+#define NR_CLIENTS	32
+
+#ifndef SO_ATTACH_REUSEPORT_EBPF
+#define SO_ATTACH_REUSEPORT_EBPF 52
+#endif
+
+static int write_sysctl(const char *path, const char *val)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, val, strlen(val));
+	if (ret < 0)
+		ret = -errno;
+	close(fd);
+	return ret < 0 ? ret : 0;
+}
+
+/* Moves the caller to a new netns with lo up, so tests can't interfere */
+static int setup_netns(void)
+{
+	struct ifreq ifr = { .ifr_name = "lo" };
+	int fd, ret;
+
+	if (unshare(CLONE_NEWNET))
+		return -1;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0)
+		return -1;
+	ret = ioctl(fd, SIOCGIFFLAGS, &ifr);
+	if (!ret) {
+		ifr.ifr_flags |= IFF_UP;
+		ret = ioctl(fd, SIOCSIFFLAGS, &ifr);
+	}
+	close(fd);
+	return ret;
+}
+
+/*
+ * Lets the kernel pick a listener for new connections, and either refuses
+ * to migrate a socket (SK_DROP) or leaves the pick to the kernel as well.
+ */
+static int load_prog(enum bpf_attach_type attach_type, bool drop_migration)
+{
+	struct bpf_insn prog[] = {
+		/* r2 = ctx->migrating_sk */
+		{ .code = BPF_LDX | BPF_MEM | BPF_DW, .dst_reg = BPF_REG_2,
+		  .src_reg = BPF_REG_1,
+		  .off = offsetof(struct sk_reuseport_md, migrating_sk) },
+		/* r0 = SK_PASS */
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_0,
+		  .imm = SK_PASS },
+		/* if (!r2) goto out */
+		{ .code = BPF_JMP | BPF_JEQ | BPF_K, .dst_reg = BPF_REG_2,
+		  .off = 1, .imm = 0 },
+		/* r0 = drop_migration ? SK_DROP : SK_PASS */
+		{ .code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_0,
+		  .imm = drop_migration ? SK_DROP : SK_PASS },
+		/* out: return r0 */
+		{ .code = BPF_JMP | BPF_EXIT },
+	};
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+	attr.expected_attach_type = attach_type;
+	attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+	attr.insns = (unsigned long)prog;
+	attr.license = (unsigned long)"GPL";
+
+	return syscall(__NR_bpf, BPF_PROG_LOAD, &attr, sizeof(attr));
+}
+
+FIXTURE(migrate) {
+	struct sockaddr_storage		addr;
+	socklen_t			addrlen;
+	int				listeners[2];
+	int				clients[NR_CLIENTS];
+	bool				ready;
+};
+
+FIXTURE_VARIANT(migrate) {
+	int				family;
+	const char			*loopback;
+};
+
+FIXTURE_VARIANT_ADD(migrate, ipv4) {
+	.family		= AF_INET,
+	.loopback	= "127.0.0.1",
+};
+
+FIXTURE_VARIANT_ADD(migrate, ipv6) {
+	.family		= AF_INET6,
+	.loopback	= "::1",
+};
+
+/* A skip in FIXTURE_SETUP() still runs the test, which must bail out too */
+#define SKIP_IF_NOT_READY()						\
+	do {								\
+		if (!self->ready)					\
+			SKIP(return, "Skipping: needs root and "	\
+				     "tcp_migrate_req support");	\
+	} while (0)
+
+FIXTURE_SETUP(migrate)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		self->listeners[i] = -1;
+	for (i = 0; i < NR_CLIENTS; i++)
+		self->clients[i] = -1;
+
+	if (setup_netns() || access(MIGRATE_REQ, F_OK))
+		return;
+
+	memset(&self->addr, 0, sizeof(self->addr));
+	self->addr.ss_family = variant->family;
+	if (variant->family == AF_INET) {
+		struct sockaddr_in *sin = (struct sockaddr_in *)&self->addr;
+
+		ASSERT_EQ(1, inet_pton(AF_INET, variant->loopback,
+				       &sin->sin_addr));
+		self->addrlen = sizeof(*sin);
+	} else {
+		struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&self->addr;
+
+		ASSERT_EQ(1, inet_pton(AF_INET6, variant->loopback,
+				       &sin6->sin6_addr));
+		self->addrlen = sizeof(*sin6);
+	}
+
+	self->ready = true;
+}
+
+FIXTURE_TEARDOWN(migrate)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (self->listeners[i] >= 0)
+			close(self->listeners[i]);
+	for (i = 0; i < NR_CLIENTS; i++)
+		if (self->clients[i] >= 0)
+			close(self->clients[i]);
+}
+
+/* Binds both listeners to the same port, then fills their accept queues */
+static void start_listeners(struct __test_metadata *_metadata,
+			    FIXTURE_DATA(migrate) *self, int prog_fd)
+{
+	int i, one = 1;
+
+	for (i = 0; i < 2; i++) {
+		self->listeners[i] = socket(self->addr.ss_family,
+					    SOCK_STREAM | SOCK_NONBLOCK, 0);
+		ASSERT_LE(0, self->listeners[i]);
+		ASSERT_EQ(0, setsockopt(self->listeners[i], SOL_SOCKET,
+					SO_REUSEPORT, &one, sizeof(one)));
+		ASSERT_EQ(0, bind(self->listeners[i],
+				  (struct sockaddr *)&self->addr,
+				  self->addrlen));
+		ASSERT_EQ(0, listen(self->listeners[i], NR_CLIENTS));
+		/* the second listener binds the port the first one got */
+		ASSERT_EQ(0, getsockname(self->listeners[i],
+					 (struct sockaddr *)&self->addr,
+					 &self->addrlen));
+	}
+
+	if (prog_fd >= 0)
+		ASSERT_EQ(0, setsockopt(self->listeners[0], SOL_SOCKET,
+					SO_ATTACH_REUSEPORT_EBPF, &prog_fd,
+					sizeof(prog_fd)));
+
+	for (i = 0; i < NR_CLIENTS; i++) {
+		self->clients[i] = socket(self->addr.ss_family,
+					  SOCK_STREAM, 0);
+		ASSERT_LE(0, self->clients[i]);
+		ASSERT_EQ(0, connect(self->clients[i],
+				     (struct sockaddr *)&self->addr,
+				     self->addrlen));
+	}
+	/* let the final ACKs put the children in the accept queues */
+	usleep(100000);
+}
+
+/* Closes the first listener and counts what the second one can accept */
+static int close_and_accept(FIXTURE_DATA(migrate) *self)
+{
+	int fd, nr = 0;
+
+	close(self->listeners[0]);
+	self->listeners[0] = -1;
+
+	while ((fd = accept(self->listeners[1], NULL, NULL)) >= 0) {
+		close(fd);
+		nr++;
+	}
+	return nr;
+}
+
+/* Counts the clients whose connection was reset */
+static int nr_reset(FIXTURE_DATA(migrate) *self)
+{
+	int i, nr = 0;
+	char c;
+
+	for (i = 0; i < NR_CLIENTS; i++)
+		if (recv(self->clients[i], &c, 1, MSG_DONTWAIT) < 0 &&
+		    errno == ECONNRESET)
+			nr++;
+	return nr;
+}
+
+TEST_F(migrate, sysctl)
+{
+	SKIP_IF_NOT_READY();
+
+	ASSERT_EQ(0, write_sysctl(MIGRATE_REQ, "1"));
+	start_listeners(_metadata, self, -1);
+
+	EXPECT_EQ(NR_CLIENTS, close_and_accept(self));
+	EXPECT_EQ(0, nr_reset(self));
+}
+
+TEST_F(migrate, disabled)
+{
+	SKIP_IF_NOT_READY();
+
+	/* The default: the children of the closed listener are reset */
+	ASSERT_EQ(0, write_sysctl(MIGRATE_REQ, "0"));
+	start_listeners(_metadata, self, -1);
+
+	EXPECT_GT(NR_CLIENTS, close_and_accept(self));
+	EXPECT_LT(0, nr_reset(self));
+}
+
+TEST_F(migrate, bpf_pass)
+{
+	int prog_fd;
+
+	SKIP_IF_NOT_READY();
+
+	/* The program allows migration even with the sysctl off */
+	ASSERT_EQ(0, write_sysctl(MIGRATE_REQ, "0"));
+	prog_fd = load_prog(BPF_SK_REUSEPORT_SELECT_OR_MIGRATE, false);
+	ASSERT_LE(0, prog_fd);
+	start_listeners(_metadata, self, prog_fd);
+	close(prog_fd);
+
+	EXPECT_EQ(NR_CLIENTS, close_and_accept(self));
+	EXPECT_EQ(0, nr_reset(self));
+}
+
+TEST_F(migrate, bpf_drop)
+{
+	int prog_fd;
+
+	SKIP_IF_NOT_READY();
+
+	/* and can refuse it with the sysctl on */
+	ASSERT_EQ(0, write_sysctl(MIGRATE_REQ, "1"));
+	prog_fd = load_prog(BPF_SK_REUSEPORT_SELECT_OR_MIGRATE, true);
+	ASSERT_LE(0, prog_fd);
+	start_listeners(_metadata, self, prog_fd);
+	close(prog_fd);
+
+	EXPECT_GT(NR_CLIENTS, close_and_accept(self));
+	EXPECT_LT(0, nr_reset(self));
+}
+
+TEST_F(migrate, einval)
+{
+	SKIP_IF_NOT_READY();
+
+	EXPECT_EQ(-EINVAL, write_sysctl(MIGRATE_REQ, "2"));
+	EXPECT_EQ(-EINVAL, write_sysctl(MIGRATE_REQ, "-1"));
+
+	/* sk_reuseport programs only take the reuseport attach types */
+	EXPECT_EQ(-1, load_prog(BPF_SK_LOOKUP, false));
+	EXPECT_EQ(EINVAL, errno);
+}
+
+TEST_F(migrate, eperm)
+{
+	int status;
+	pid_t pid;
+
+	SKIP_IF_NOT_READY();
+
+	pid = fork();
+	ASSERT_LE(0, pid);
+	if (pid == 0) {
+		if (setresuid(65534, 65534, 65534))
+			_exit(2);
+		_exit(load_prog(BPF_SK_REUSEPORT_SELECT_OR_MIGRATE, false) == -1 &&
+		      errno == EPERM ? 0 : 1);
+	}
+	ASSERT_EQ(pid, waitpid(pid, &status, 0));
+	ASSERT_TRUE(WIFEXITED(status));
+	EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+TEST_HARNESS_MAIN
@@ -0,0 +1,248 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Ring-buffer memory mapping tests
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <linux/trace_mmap.h>
+
+#include "../kselftest_harness.h"
+
+#define TRACEFS_ROOT	"/sys/kernel/tracing"
+#define INSTANCE	TRACEFS_ROOT "/instances/map_test"
+#define MARKER		"map_test marker"
+
+static int write_file(const char *path, const char *val)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_WRONLY | O_TRUNC);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, val, strlen(val));
+	if (ret < 0)
+		ret = -errno;
+	close(fd);
+	return ret < 0 ? ret : 0;
+}
+
+static int pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set);
+}
+
+/* A skip in FIXTURE_SETUP() still runs the test, which must bail out too */
+#define SKIP_IF_UNMAPPED()					\
+	do {							\
+		if (!self->meta)				\
+			SKIP(return, "Skipping: no mapping");	\
+	} while (0)
+
+FIXTURE(map) {
+	struct trace_buffer_meta	*meta;
+	char				path[128];
+	size_t				map_len;
+	int				cpu;
+	int				fd;
+};
+
+FIXTURE_SETUP(map)
+{
+	size_t meta_len;
+	void *map;
+
+	self->meta = NULL;
+	self->fd = -1;
+
+	if (getuid() != 0)
+		SKIP(return, "Skipping: the test must be run as root");
+
+	if (access(TRACEFS_ROOT "/instances", F_OK))
+		SKIP(return, "Skipping: tracefs is not mounted");
+
+	if (mkdir(INSTANCE, 0755) && errno != EEXIST)
+		SKIP(return, "Skipping: cannot create a trace instance");
+
+	self->cpu = sched_getcpu();
+	ASSERT_GE(self->cpu, 0);
+	ASSERT_EQ(0, pin_to_cpu(self->cpu));
+
+	snprintf(self->path, sizeof(self->path),
+		 INSTANCE "/per_cpu/cpu%d/trace_pipe_raw", self->cpu);
+	self->fd = open(self->path, O_RDONLY | O_NONBLOCK);
+	ASSERT_GE(self->fd, 0);
+
+	meta_len = getpagesize();
+	map = mmap(NULL, meta_len, PROT_READ, MAP_SHARED, self->fd, 0);
+	if (map == MAP_FAILED && errno == ENODEV)
+		SKIP(return, "Skipping: trace_pipe_raw can't be mapped");
+	ASSERT_NE(MAP_FAILED, map);
+	self->meta = map;
+	self->map_len = meta_len;
+
+	/* Now that the layout is known, map the meta-page and every sub-buffer */
+	meta_len = self->meta->meta_page_size +
+		   (size_t)self->meta->nr_subbufs * self->meta->subbuf_size;
+	map = mmap(NULL, meta_len, PROT_READ, MAP_SHARED, self->fd, 0);
+	ASSERT_NE(MAP_FAILED, map);
+	munmap(self->meta, self->map_len);
+	self->meta = map;
+	self->map_len = meta_len;
+}
+
+FIXTURE_TEARDOWN(map)
+{
+	if (self->meta)
+		munmap(self->meta, self->map_len);
+	if (self->fd >= 0)
+		close(self->fd);
+	rmdir(INSTANCE);
+}
+
+TEST_F(map, meta_page)
+{
+	struct trace_buffer_meta *meta = self->meta;
+
+	SKIP_IF_UNMAPPED();
+
+	EXPECT_EQ(sizeof(*meta), meta->meta_struct_len);
+	EXPECT_EQ(getpagesize(), meta->meta_page_size);
+	EXPECT_EQ(getpagesize(), meta->subbuf_size);
+	/* at least the reader page and two buffer pages */
+	EXPECT_LE(3, meta->nr_subbufs);
+	EXPECT_GT(meta->nr_subbufs, meta->reader.id);
+	EXPECT_EQ(meta->reader.read, meta->reader.commit);
+}
+
+TEST_F(map, read_events)
+{
+	struct trace_buffer_meta *meta = self->meta;
+	char *subbuf;
+
+	SKIP_IF_UNMAPPED();
+
+	ASSERT_EQ(0, write_file(INSTANCE "/trace_marker", MARKER));
+
+	ASSERT_EQ(0, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	ASSERT_GT(meta->nr_subbufs, meta->reader.id);
+	EXPECT_LT(meta->reader.read, meta->reader.commit);
+	EXPECT_LE(1, meta->entries);
+	EXPECT_LE(1, meta->read);
+
+	subbuf = (char *)meta + meta->meta_page_size +
+		 (size_t)meta->reader.id * meta->subbuf_size;
+	EXPECT_NE(NULL, memmem(subbuf, meta->subbuf_size,
+			       MARKER, strlen(MARKER)));
+
+	/* The events were consumed, the next call hands back an empty range */
+	ASSERT_EQ(0, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	EXPECT_EQ(meta->reader.read, meta->reader.commit);
+}
+
+TEST_F(map, enotty)
+{
+	SKIP_IF_UNMAPPED();
+
+	EXPECT_EQ(-1, ioctl(self->fd, _IO('R', 0x21)));
+	EXPECT_EQ(ENOTTY, errno);
+}
+
+TEST_F(map, eperm)
+{
+	size_t len = getpagesize();
+	void *map;
+	int fd;
+
+	SKIP_IF_UNMAPPED();
+
+	/* The mapping is read-only and shared, even for a writable file */
+	fd = open(self->path, O_RDWR);
+	ASSERT_GE(fd, 0);
+	map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	EXPECT_EQ(MAP_FAILED, map);
+	EXPECT_EQ(EPERM, errno);
+	close(fd);
+
+	map = mmap(NULL, len, PROT_READ | PROT_EXEC, MAP_SHARED, self->fd, 0);
+	EXPECT_EQ(MAP_FAILED, map);
+	EXPECT_EQ(EPERM, errno);
+
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, self->fd, 0);
+	EXPECT_EQ(MAP_FAILED, map);
+	EXPECT_EQ(EPERM, errno);
+
+	/* and it can't be made writable later */
+	EXPECT_EQ(-1, mprotect(self->meta, len, PROT_READ | PROT_WRITE));
+	EXPECT_EQ(EACCES, errno);
+}
+
+TEST_F(map, einval)
+{
+	size_t len = getpagesize();
+	void *map;
+
+	SKIP_IF_UNMAPPED();
+
+	/* Past the last sub-buffer */
+	map = mmap(NULL, len, PROT_READ, MAP_SHARED, self->fd,
+		   self->map_len);
+	EXPECT_EQ(MAP_FAILED, map);
+	EXPECT_EQ(EINVAL, errno);
+
+	map = mmap(NULL, self->map_len + len, PROT_READ, MAP_SHARED,
+		   self->fd, 0);
+	EXPECT_EQ(MAP_FAILED, map);
+	EXPECT_EQ(EINVAL, errno);
+
+	/* The mapping can't be split */
+	EXPECT_EQ(-1, munmap(self->meta, len));
+	EXPECT_EQ(EINVAL, errno);
+}
+
+TEST_F(map, ebusy)
+{
+	char path[128], size[32];
+
+	SKIP_IF_UNMAPPED();
+
+	/* The mapped buffer can't be resized: ask for twice its size */
+	snprintf(path, sizeof(path), INSTANCE "/per_cpu/cpu%d/buffer_size_kb",
+		 self->cpu);
+	snprintf(size, sizeof(size), "%zu",
+		 (size_t)self->meta->nr_subbufs * self->meta->subbuf_size / 512);
+	EXPECT_EQ(-EBUSY, write_file(path, size));
+
+	/* nor swapped with a snapshot */
+	if (access(INSTANCE "/snapshot", F_OK))
+		SKIP(return, "Skipping: no snapshot support");
+	EXPECT_EQ(-EBUSY, write_file(INSTANCE "/snapshot", "1"));
+}
+
+TEST_F(map, unmapped)
+{
+	SKIP_IF_UNMAPPED();
+
+	/* Nothing can be handed to a reader once the last mapping is gone */
+	ASSERT_EQ(0, munmap(self->meta, self->map_len));
+	self->meta = NULL;
+
+	EXPECT_EQ(-1, ioctl(self->fd, TRACE_MMAP_IOCTL_GET_READER));
+	EXPECT_EQ(ENODEV, errno);
+}
+
+TEST_HARNESS_MAIN
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+#include <linux/spawn.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../kselftest_harness.h"
+
+#ifndef __NR_spawn
+#define __NR_spawn 501
+#endif
+
+#define ptr_to_u64(ptr) ((__u64)((uintptr_t)(ptr)))
+
+static pid_t sys_spawn(struct spawn_args *args, size_t size)
+{
+	return syscall(__NR_spawn, args, size);
+}
+
+static int wait_status(pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+		return -1;
+	return WEXITSTATUS(status);
+}
+
+/* spawns "/bin/sh -c cmd" with the given file actions */
+static pid_t spawn_sh(const char *cmd, struct spawn_action *actions,
+		      unsigned int nr_actions)
+{
+	char *argv[] = { "sh", "-c", (char *)cmd, NULL };
+	char *envp[] = { NULL };
+	struct spawn_args args = {
+		.filename	= ptr_to_u64("/bin/sh"),
+		.argv		= ptr_to_u64(argv),
+		.envp		= ptr_to_u64(envp),
+		.actions	= ptr_to_u64(actions),
+		.nr_actions	= nr_actions,
+	};
+
+	return sys_spawn(&args, sizeof(args));
+}
+
+#define SKIP_IF_UNSUPPORTED()						\
+	do {								\
+		if (sys_spawn(NULL, 0) < 0 && errno == ENOSYS)		\
+			SKIP(return, "spawn(2) not supported");		\
+		if (access("/bin/sh", X_OK))				\
+			SKIP(return, "no /bin/sh");			\
+	} while (0)
+
+TEST(exit_status)
+{
+	pid_t pid;
+
+	SKIP_IF_UNSUPPORTED();
+
+	pid = spawn_sh("exit 3", NULL, 0);
+	ASSERT_GT(pid, 0);
+	EXPECT_EQ(3, wait_status(pid));
+}
+
+TEST(exec_failure)
+{
+	char *argv[] = { "nonexistent", NULL };
+	struct spawn_args args = {
+		.filename	= ptr_to_u64("/nonexistent/program"),
+		.argv		= ptr_to_u64(argv),
+	};
+	pid_t pid;
+
+	SKIP_IF_UNSUPPORTED();
+
+	/* the child reports the failure like a shell would */
+	pid = sys_spawn(&args, sizeof(args));
+	ASSERT_GT(pid, 0);
+	EXPECT_EQ(127, wait_status(pid));
+}
+
+TEST(file_actions)
+{
+	char path[] = "/tmp/spawn_test.XXXXXX";
+	struct spawn_action actions[3] = {
+		{
+			.type	= SPAWN_ACTION_OPEN,
+			.fd	= 3,
+			.flags	= O_WRONLY | O_TRUNC,
+			.path	= ptr_to_u64(path),
+		},
+		{
+			.type	= SPAWN_ACTION_DUP2,
+			.fd	= 3,
+			.newfd	= 1,
+		},
+		{
+			.type	= SPAWN_ACTION_CHDIR,
+			.path	= ptr_to_u64("/"),
+		},
+	};
+	char buf[16] = {};
+	pid_t pid;
+	int fd;
+
+	SKIP_IF_UNSUPPORTED();
+
+	fd = mkstemp(path);
+	ASSERT_GE(fd, 0);
+
+	pid = spawn_sh("pwd", actions, 3);
+	ASSERT_GT(pid, 0);
+	EXPECT_EQ(0, wait_status(pid));
+
+	EXPECT_EQ(2, read(fd, buf, sizeof(buf) - 1));
+	EXPECT_STREQ("/\n", buf);
+	close(fd);
+	unlink(path);
+}
+
+TEST(close_unused_fd)
+{
+	struct spawn_action action = {
+		.type	= SPAWN_ACTION_CLOSE,
+		.fd	= 1000,
+	};
+	pid_t pid;
+
+	SKIP_IF_UNSUPPORTED();
+
+	/* like posix_spawn(), closing a descriptor that isn't open is fine */
+	pid = spawn_sh("exit 0", &action, 1);
+	ASSERT_GT(pid, 0);
+	EXPECT_EQ(0, wait_status(pid));
+}
+
+TEST(einval)
+{
+	struct spawn_action action = {
+		.type	= SPAWN_ACTION_CLOSE,
+		.fd	= 1000,
+	};
+	struct spawn_args args = {
+		.filename	= ptr_to_u64("/bin/sh"),
+		.actions	= ptr_to_u64(&action),
+	};
+
+	SKIP_IF_UNSUPPORTED();
+
+	EXPECT_EQ(-1, sys_spawn(&args, SPAWN_ARGS_SIZE_VER0 - 8));
+	EXPECT_EQ(EINVAL, errno);
+
+	args.flags = ~(__u64)SPAWN_SETSIGMASK;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EINVAL, errno);
+	args.flags = 0;
+
+	args.nr_actions = SPAWN_ACTIONS_MAX + 1;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EINVAL, errno);
+
+	args.nr_actions = 1;
+	action.type = 0;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EINVAL, errno);
+
+	action.type = SPAWN_ACTION_CLOSE;
+	action.__reserved = 1;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EINVAL, errno);
+}
+
+TEST(efault)
+{
+	char *argv[] = { "sh", NULL };
+	struct spawn_args args = {
+		.filename	= ptr_to_u64("/bin/sh"),
+		.argv		= ptr_to_u64(argv),
+	};
+	void *unmapped;
+
+	SKIP_IF_UNSUPPORTED();
+
+	unmapped = mmap(NULL, getpagesize(), PROT_NONE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	ASSERT_NE(MAP_FAILED, unmapped);
+
+	EXPECT_EQ(-1, sys_spawn(unmapped, sizeof(args)));
+	EXPECT_EQ(EFAULT, errno);
+
+	args.filename = ptr_to_u64(unmapped);
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EFAULT, errno);
+	args.filename = ptr_to_u64("/bin/sh");
+
+	args.argv = ptr_to_u64(unmapped);
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EFAULT, errno);
+	args.argv = ptr_to_u64(argv);
+
+	argv[0] = unmapped;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EFAULT, errno);
+	argv[0] = "sh";
+
+	args.actions = ptr_to_u64(unmapped);
+	args.nr_actions = 1;
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(EFAULT, errno);
+
+	munmap(unmapped, getpagesize());
+}
+
+TEST(e2big)
+{
+	/* more than the 1/4 of an 8MB stack allowed for strings */
+	const int nr = 24, len = 128 * 1024 - 1;
+	struct rlimit rlim;
+	char **envp;
+	struct spawn_args args = {
+		.filename	= ptr_to_u64("/bin/sh"),
+	};
+	int i;
+
+	SKIP_IF_UNSUPPORTED();
+
+	ASSERT_EQ(0, getrlimit(RLIMIT_STACK, &rlim));
+	rlim.rlim_cur = 8 << 20;
+	if (rlim.rlim_max < rlim.rlim_cur)
+		rlim.rlim_cur = rlim.rlim_max;
+	ASSERT_EQ(0, setrlimit(RLIMIT_STACK, &rlim));
+
+	envp = calloc(nr + 1, sizeof(*envp));
+	ASSERT_NE(NULL, envp);
+	for (i = 0; i < nr; i++) {
+		envp[i] = malloc(len + 1);
+		ASSERT_NE(NULL, envp[i]);
+		memset(envp[i], 'a', len);
+		envp[i][len] = '\0';
+	}
+	args.envp = ptr_to_u64(envp);
+
+	EXPECT_EQ(-1, sys_spawn(&args, sizeof(args)));
+	EXPECT_EQ(E2BIG, errno);
+
+	for (i = 0; i < nr; i++)
+		free(envp[i]);
+	free(envp);
+}
+
+TEST(eperm_seccomp)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {
+		.len = 1,
+		.filter = filter,
+	};
+	pid_t pid;
+
+	SKIP_IF_UNSUPPORTED();
+
+	pid = fork();
+	ASSERT_GE(pid, 0);
+	if (pid == 0) {
+		if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) ||
+		    syscall(__NR_seccomp, SECCOMP_SET_MODE_FILTER, 0, &prog))
+			_exit(2);
+		/* the file actions and exec would bypass the filter */
+		_exit(spawn_sh("exit 0", NULL, 0) == -1 && errno == EPERM ?
+		      0 : 1);
+	}
+	EXPECT_EQ(0, wait_status(pid));
+}
+
+TEST_HARNESS_MAIN
@@ -6,14 +6,19 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 
 #include <sys/mman.h>
+#include <sys/prctl.h>
 #include <sys/wait.h>
 
 #ifndef MADV_PAGEOUT
 #define MADV_PAGEOUT 21
 #endif
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE 25
+#endif
 
 #define BASE_ADDR ((void *)(1UL << 30))
 static unsigned long hpage_pmd_size;
@@ -1001,6 +1006,89 @@ static void collapse_max_ptes_shared()
 	munmap(p, hpage_pmd_size);
 }
 
+static void madvise_collapse_full(void)
+{
+	void *p;
+
+	p = alloc_mapping();
+	fill_memory(p, 0, hpage_pmd_size);
+	printf("MADV_COLLAPSE fully populated PTE table...");
+	if (madvise(p, hpage_pmd_size, MADV_COLLAPSE))
+		fail("Fail");
+	else if (check_huge(p))
+		success("OK");
+	else
+		fail("Fail");
+	validate_memory(p, 0, hpage_pmd_size);
+	munmap(p, hpage_pmd_size);
+}
+
+static void madvise_collapse_max_ptes_none(void)
+{
+	struct settings settings = default_settings;
+	void *p;
+
+	/* the khugepaged limits don't apply to an explicit request */
+	settings.khugepaged.max_ptes_none = 0;
+	write_settings(&settings);
+
+	p = alloc_mapping();
+	fill_memory(p, 0, page_size);
+	printf("MADV_COLLAPSE with max_ptes_none exceeded...");
+	if (madvise(p, hpage_pmd_size, MADV_COLLAPSE))
+		fail("Fail");
+	else if (check_huge(p))
+		success("OK");
+	else
+		fail("Fail");
+	validate_memory(p, 0, page_size);
+	munmap(p, hpage_pmd_size);
+
+	write_settings(&default_settings);
+}
+
+static void madvise_collapse_errors(void)
+{
+	void *p;
+
+	p = alloc_mapping();
+	fill_memory(p, 0, hpage_pmd_size);
+
+	printf("MADV_COLLAPSE with an unaligned start fails with EINVAL...");
+	if (!madvise(p + 1, hpage_pmd_size - 1, MADV_COLLAPSE) ||
+	    errno != EINVAL)
+		fail("Fail");
+	else
+		success("OK");
+
+	printf("MADV_COLLAPSE of a MADV_NOHUGEPAGE range fails with EINVAL...");
+	madvise(p, hpage_pmd_size, MADV_NOHUGEPAGE);
+	if (!madvise(p, hpage_pmd_size, MADV_COLLAPSE) || errno != EINVAL ||
+	    check_huge(p))
+		fail("Fail");
+	else
+		success("OK");
+	madvise(p, hpage_pmd_size, MADV_HUGEPAGE);
+
+	printf("MADV_COLLAPSE with PR_SET_THP_DISABLE fails with EINVAL...");
+	prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0);
+	if (!madvise(p, hpage_pmd_size, MADV_COLLAPSE) || errno != EINVAL ||
+	    check_huge(p))
+		fail("Fail");
+	else
+		success("OK");
+	prctl(PR_SET_THP_DISABLE, 0, 0, 0, 0);
+
+	validate_memory(p, 0, hpage_pmd_size);
+	munmap(p, hpage_pmd_size);
+
+	printf("MADV_COLLAPSE of an unmapped range fails with ENOMEM...");
+	if (!madvise(p, hpage_pmd_size, MADV_COLLAPSE) || errno != ENOMEM)
+		fail("Fail");
+	else
+		success("OK");
+}
+
 int main(void)
 {
 	setbuf(stdout, NULL);
@@ -1030,6 +1118,9 @@ int main(void)
 	collapse_fork();
 	collapse_fork_compound();
 	collapse_max_ptes_shared();
+	madvise_collapse_full();
+	madvise_collapse_max_ptes_none();
+	madvise_collapse_errors();
 
 	restore_settings(0);
 }
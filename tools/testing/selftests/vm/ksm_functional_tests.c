@@ -0,0 +1,236 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * PR_SET_MEMORY_MERGE and PR_GET_MEMORY_MERGE tests
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#ifndef PR_SET_MEMORY_MERGE
+#define PR_SET_MEMORY_MERGE	67
+#define PR_GET_MEMORY_MERGE	68
+#endif
+
+#define KSM_DIR		"/sys/kernel/mm/ksm/"
+#define NR_PAGES	64
+
+static size_t pagesize;
+static int pagemap_fd;
+
+static long ksm_read(const char *name)
+{
+	char path[64], buf[32];
+	ssize_t len;
+	int fd;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+	return strtol(buf, NULL, 10);
+}
+
+static int ksm_write(const char *name, long val)
+{
+	char path[64], buf[32];
+	int fd, len, ret;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -1;
+	len = snprintf(buf, sizeof(buf), "%ld", val);
+	ret = write(fd, buf, len) == len ? 0 : -1;
+	close(fd);
+	return ret;
+}
+
+/* PFNs in pagemap need CAP_SYS_ADMIN, which starting ksmd needed as well */
+static uint64_t pagemap_get_pfn(char *addr)
+{
+	uint64_t entry;
+	off_t off = (uintptr_t)addr / pagesize * sizeof(entry);
+
+	if (pread(pagemap_fd, &entry, sizeof(entry), off) != sizeof(entry))
+		ksft_exit_fail_msg("reading pagemap failed\n");
+	return entry & ((1ULL << 55) - 1);
+}
+
+/* Counts the pages of the range that share a frame with the first one */
+static int range_nr_merged(char *addr)
+{
+	uint64_t pfn = pagemap_get_pfn(addr);
+	int i, nr = 0;
+
+	for (i = 1; i < NR_PAGES; i++)
+		if (pagemap_get_pfn(addr + i * pagesize) == pfn)
+			nr++;
+	return nr;
+}
+
+/* ksmd needs two passes over a page to merge it */
+static bool ksm_wait_full_scans(void)
+{
+	long start = ksm_read("full_scans");
+	time_t deadline = time(NULL) + 60;
+
+	while (ksm_read("full_scans") < start + 2) {
+		if (time(NULL) > deadline)
+			return false;
+		usleep(10000);
+	}
+	return true;
+}
+
+static void test_prctl(void)
+{
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	ret = prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0);
+	ksft_test_result(ret == 0, "merging is off by default\n");
+
+	ret = prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0);
+	ksft_test_result(!ret && prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0) == 1,
+			 "PR_SET_MEMORY_MERGE enables merging\n");
+
+	ret = prctl(PR_SET_MEMORY_MERGE, 0, 0, 0, 0);
+	ksft_test_result(!ret && prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0) == 0,
+			 "PR_SET_MEMORY_MERGE disables merging\n");
+}
+
+static void test_prctl_einval(void)
+{
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	ret = prctl(PR_SET_MEMORY_MERGE, 1, 1, 0, 0);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "PR_SET_MEMORY_MERGE with unused arguments fails with EINVAL\n");
+
+	ret = prctl(PR_GET_MEMORY_MERGE, 1, 0, 0, 0);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "PR_GET_MEMORY_MERGE with unused arguments fails with EINVAL\n");
+
+	ksft_test_result(prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0) == 0,
+			 "failed PR_SET_MEMORY_MERGE leaves merging off\n");
+}
+
+static void test_prctl_fork_exec(const char *self)
+{
+	int status;
+	pid_t pid;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	if (prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0)) {
+		ksft_test_result_fail("PR_SET_MEMORY_MERGE failed\n");
+		return;
+	}
+
+	pid = fork();
+	if (pid == 0)
+		_exit(prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0));
+	ksft_test_result(pid > 0 && waitpid(pid, &status, 0) == pid &&
+			 WIFEXITED(status) && WEXITSTATUS(status) == 1,
+			 "merging is inherited on fork\n");
+
+	pid = fork();
+	if (pid == 0) {
+		execl(self, self, "get", NULL);
+		_exit(255);
+	}
+	ksft_test_result(pid > 0 && waitpid(pid, &status, 0) == pid &&
+			 WIFEXITED(status) && WEXITSTATUS(status) == 1,
+			 "merging is preserved across execve\n");
+
+	prctl(PR_SET_MEMORY_MERGE, 0, 0, 0, 0);
+}
+
+static void test_prctl_merge(void)
+{
+	long run;
+	char *addr;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	run = ksm_read("run");
+	if (run < 0 || ksm_write("run", 1)) {
+		ksft_test_result_skip("cannot start ksmd\n");
+		ksft_test_result_skip("cannot start ksmd\n");
+		return;
+	}
+
+	addr = mmap(NULL, NR_PAGES * pagesize, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (addr == MAP_FAILED)
+		ksft_exit_fail_msg("mmap failed\n");
+	memset(addr, 0xcf, NR_PAGES * pagesize);
+
+	/* Enabling after the mapping exists must pick the mapping up too */
+	if (prctl(PR_SET_MEMORY_MERGE, 1, 0, 0, 0))
+		ksft_exit_fail_msg("PR_SET_MEMORY_MERGE failed\n");
+	ksft_test_result(ksm_wait_full_scans() &&
+			 range_nr_merged(addr) == NR_PAGES - 1,
+			 "identical pages get merged\n");
+
+	/* Disabling unmerges what was merged */
+	ksft_test_result(!prctl(PR_SET_MEMORY_MERGE, 0, 0, 0, 0) &&
+			 range_nr_merged(addr) == 0,
+			 "PR_SET_MEMORY_MERGE 0 unmerges\n");
+
+	munmap(addr, NR_PAGES * pagesize);
+	ksm_write("run", run);
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	if (argc > 1 && !strcmp(argv[1], "get"))
+		return prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0);
+
+	pagesize = getpagesize();
+
+	ksft_print_header();
+	ksft_set_plan(10);
+
+	if (access(KSM_DIR, F_OK) ||
+	    (prctl(PR_GET_MEMORY_MERGE, 0, 0, 0, 0) < 0 && errno == EINVAL))
+		ksft_exit_skip("KSM not supported\n");
+
+	pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+	if (pagemap_fd < 0)
+		ksft_exit_fail_msg("opening pagemap failed\n");
+
+	test_prctl();
+	test_prctl_einval();
+	test_prctl_fork_exec("/proc/self/exe");
+	test_prctl_merge();
+
+	close(pagemap_fd);
+
+	err = ksft_get_fail_cnt();
+	if (err)
+		ksft_exit_fail_msg("%d out of %d tests failed\n",
+				   err, ksft_test_num());
+	return ksft_exit_pass();
+}
@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * MADV_POPULATE_READ and MADV_POPULATE_WRITE tests
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../kselftest.h"
+
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ	22
+#endif
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE	23
+#endif
+
+#define SIZE (2 * 1024 * 1024)
+
+static size_t pagesize;
+static int pagemap_fd;
+
+static uint64_t pagemap_get_entry(char *addr)
+{
+	const unsigned long pfn = (unsigned long)addr / pagesize;
+	uint64_t entry;
+
+	if (pread(pagemap_fd, &entry, sizeof(entry), pfn * sizeof(entry)) !=
+	    sizeof(entry))
+		ksft_exit_fail_msg("reading pagemap failed\n");
+	return entry;
+}
+
+/* bit 63 of a pagemap entry: page present */
+static bool range_is_populated(char *start, ssize_t size)
+{
+	for (; size > 0; size -= pagesize, start += pagesize)
+		if (!(pagemap_get_entry(start) & (1ULL << 63)))
+			return false;
+	return true;
+}
+
+static bool range_is_not_populated(char *start, ssize_t size)
+{
+	for (; size > 0; size -= pagesize, start += pagesize)
+		if (pagemap_get_entry(start) & (1ULL << 63))
+			return false;
+	return true;
+}
+
+static char *map_anon(int prot)
+{
+	char *addr;
+
+	addr = mmap(NULL, SIZE, prot, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (addr == MAP_FAILED)
+		ksft_exit_fail_msg("mmap failed\n");
+	return addr;
+}
+
+static void test_prot_read(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_READ);
+
+	ret = madvise(addr, SIZE, MADV_POPULATE_READ);
+	ksft_test_result(!ret, "MADV_POPULATE_READ with PROT_READ\n");
+
+	ret = madvise(addr, SIZE, MADV_POPULATE_WRITE);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "MADV_POPULATE_WRITE with PROT_READ fails with EINVAL\n");
+
+	munmap(addr, SIZE);
+}
+
+static void test_prot_none(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_NONE);
+
+	ret = madvise(addr, SIZE, MADV_POPULATE_READ);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "MADV_POPULATE_READ with PROT_NONE fails with EINVAL\n");
+	ret = madvise(addr, SIZE, MADV_POPULATE_WRITE);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "MADV_POPULATE_WRITE with PROT_NONE fails with EINVAL\n");
+
+	munmap(addr, SIZE);
+}
+
+static void test_holes(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_READ | PROT_WRITE);
+	ret = munmap(addr + pagesize, pagesize);
+	if (ret)
+		ksft_exit_fail_msg("munmap failed\n");
+
+	/* Hole in the middle */
+	ret = madvise(addr, SIZE, MADV_POPULATE_READ);
+	ksft_test_result(ret == -1 && errno == ENOMEM,
+			 "MADV_POPULATE_READ with holes in the middle fails with ENOMEM\n");
+	ret = madvise(addr, SIZE, MADV_POPULATE_WRITE);
+	ksft_test_result(ret == -1 && errno == ENOMEM,
+			 "MADV_POPULATE_WRITE with holes in the middle fails with ENOMEM\n");
+
+	/* Hole at end */
+	ret = madvise(addr, 2 * pagesize, MADV_POPULATE_READ);
+	ksft_test_result(ret == -1 && errno == ENOMEM,
+			 "MADV_POPULATE_READ with holes at the end fails with ENOMEM\n");
+
+	/* Hole at beginning */
+	ret = madvise(addr + pagesize, pagesize, MADV_POPULATE_WRITE);
+	ksft_test_result(ret == -1 && errno == ENOMEM,
+			 "MADV_POPULATE_WRITE with holes at the beginning fails with ENOMEM\n");
+
+	munmap(addr, SIZE);
+}
+
+static void test_unaligned(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_READ | PROT_WRITE);
+
+	ret = madvise(addr + 1, pagesize, MADV_POPULATE_READ);
+	ksft_test_result(ret == -1 && errno == EINVAL,
+			 "MADV_POPULATE_READ with an unaligned start fails with EINVAL\n");
+
+	munmap(addr, SIZE);
+}
+
+static void test_sigbus(void)
+{
+	char *addr;
+	int fd, ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	/* Only the first page is backed by the file, the second one SIGBUSes */
+	fd = syscall(__NR_memfd_create, "madv_populate", 0);
+	if (fd < 0)
+		ksft_exit_fail_msg("memfd_create failed\n");
+	if (ftruncate(fd, pagesize))
+		ksft_exit_fail_msg("ftruncate failed\n");
+
+	addr = mmap(NULL, 2 * pagesize, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	if (addr == MAP_FAILED)
+		ksft_exit_fail_msg("mmap failed\n");
+
+	ret = madvise(addr, 2 * pagesize, MADV_POPULATE_READ);
+	ksft_test_result(ret == -1 && errno == EFAULT,
+			 "MADV_POPULATE_READ beyond EOF fails with EFAULT\n");
+	ret = madvise(addr, 2 * pagesize, MADV_POPULATE_WRITE);
+	ksft_test_result(ret == -1 && errno == EFAULT,
+			 "MADV_POPULATE_WRITE beyond EOF fails with EFAULT\n");
+
+	munmap(addr, 2 * pagesize);
+	close(fd);
+}
+
+static void test_populate_read(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_READ | PROT_WRITE);
+	ksft_test_result(range_is_not_populated(addr, SIZE),
+			 "range initially not populated\n");
+
+	ret = madvise(addr, SIZE, MADV_POPULATE_READ);
+	ksft_test_result(!ret, "MADV_POPULATE_READ\n");
+	ksft_test_result(range_is_populated(addr, SIZE),
+			 "range is populated\n");
+
+	munmap(addr, SIZE);
+}
+
+static void test_populate_write(void)
+{
+	char *addr;
+	int ret;
+
+	ksft_print_msg("[RUN] %s\n", __func__);
+
+	addr = map_anon(PROT_READ | PROT_WRITE);
+	ksft_test_result(range_is_not_populated(addr, SIZE),
+			 "range initially not populated\n");
+
+	ret = madvise(addr, SIZE, MADV_POPULATE_WRITE);
+	ksft_test_result(!ret, "MADV_POPULATE_WRITE\n");
+	ksft_test_result(range_is_populated(addr, SIZE),
+			 "range is populated\n");
+
+	munmap(addr, SIZE);
+}
+
+int main(int argc, char **argv)
+{
+	int err;
+
+	pagesize = getpagesize();
+
+	ksft_print_header();
+	ksft_set_plan(17);
+
+	pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+	if (pagemap_fd < 0)
+		ksft_exit_fail_msg("opening pagemap failed\n");
+
+	test_prot_read();
+	test_prot_none();
+	test_holes();
+	test_unaligned();
+	test_sigbus();
+	test_populate_read();
+	test_populate_write();
+
+	close(pagemap_fd);
+	err = ksft_get_fail_cnt();
+	if (err)
+		ksft_exit_fail_msg("%d out of %d tests failed\n",
+				   err, ksft_test_num());
+	return ksft_exit_pass();
+}